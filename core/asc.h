@@ -28,7 +28,9 @@
 #include "event.h"
 #include "list.h"
 #include "log.h"
+#include "loop.h"
 #include "loopctl.h"
+#include "profile.h"
 #include "socket.h"
 #include "strbuffer.h"
 #include "thread.h"
@@ -39,6 +39,14 @@ uint64_t asc_utime(void)
 #endif
 }
 
+__thread uint64_t __asc_now = 0;
+
+uint64_t asc_now_update(void)
+{
+    __asc_now = asc_utime();
+    return __asc_now;
+}
+
 __asc_inline
 void asc_usleep(uint64_t usec)
 {
@@ -27,4 +27,17 @@
 uint64_t asc_utime(void);
 void asc_usleep(uint64_t usec);
 
+/*
+ * coarse clock: monotonic time cached per thread, refreshed by the loop of
+ * the thread once per event batch and before each timer callback.
+ * per-packet code uses asc_now_us(), code that needs precise time calls
+ * asc_utime(). threads that never refresh the cache get asc_utime()
+ */
+
+extern __thread uint64_t __asc_now;
+
+uint64_t asc_now_update(void);
+
+#define asc_now_us() ((__asc_now) ? __asc_now : asc_utime())
+
 #endif /* _ASC_CLOCK_H_ */
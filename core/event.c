@@ -19,10 +19,12 @@
  */
 
 #include "assert.h"
+#include "clock.h"
 #include "event.h"
 #include "list.h"
 #include "log.h"
 #include "loopctl.h"
+#include "profile.h"
 
 #ifndef EV_LIST_SIZE
 #   define EV_LIST_SIZE 1024
@@ -50,6 +52,7 @@
 #       define EPOLLCLOSE (EPOLLERR | EPOLLHUP)
 #   endif
 #   define MSG(_msg) "[core/event epoll] " _msg
+#   include <sys/eventfd.h>
 #else
 #   error "Event notification interface not set"
 #endif
@@ -63,6 +66,14 @@ struct asc_event_t
     void *arg;
 };
 
+static inline void event_callback(event_callback_t callback, void *arg)
+{
+    if(asc_profile_enabled)
+        asc_profile_call(callback, arg);
+    else
+        callback(arg);
+}
+
 #if defined(EV_TYPE_KQUEUE) || defined(EV_TYPE_EPOLL)
 
 /*
@@ -82,16 +93,104 @@ struct asc_event_t
  *                  88o8
  */
 
-typedef struct
+typedef struct asc_event_core_t
 {
     asc_list_t *event_list;
     bool is_changed;
 
     int fd;
     EV_OTYPE ed_list[EV_LIST_SIZE];
+
+    /* wakeup channel: eventfd on Linux (wake_rd == wake_wr), pipe on BSD */
+    int wake_rd;
+    int wake_wr;
+    volatile int wake_pending;
 } event_observer_t;
 
-static event_observer_t event_observer;
+/* one observer per thread: the main loop and each data loop (core/loop.c) */
+static __thread event_observer_t event_observer;
+static event_observer_t *event_observer_main = NULL;
+
+/* udata marker for the wakeup descriptor, never dereferenced */
+static char event_wake_marker;
+
+static void event_wake_open(void)
+{
+    event_observer.wake_rd = -1;
+    event_observer.wake_wr = -1;
+
+#if defined(EV_TYPE_EPOLL)
+    const int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    asc_assert(fd != -1, MSG("failed to init wakeup eventfd [%s]"), strerror(errno));
+    event_observer.wake_rd = fd;
+    event_observer.wake_wr = fd;
+
+    EV_OTYPE ed;
+    ed.data.ptr = &event_wake_marker;
+    ed.events = EPOLLIN;
+    const int ret = epoll_ctl(event_observer.fd, EPOLL_CTL_ADD, fd, &ed);
+#else
+    int fds[2];
+    asc_assert(pipe(fds) != -1, MSG("failed to init wakeup pipe [%s]"), strerror(errno));
+    for(int i = 0; i < 2; ++i)
+    {
+        fcntl(fds[i], F_SETFL, fcntl(fds[i], F_GETFL) | O_NONBLOCK);
+        fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+    }
+    event_observer.wake_rd = fds[0];
+    event_observer.wake_wr = fds[1];
+
+    EV_OTYPE ed;
+    EV_SET(&ed, fds[0], EVFILT_READ, EV_ADD, 0, 0, &event_wake_marker);
+    const int ret = kevent(event_observer.fd, &ed, 1, NULL, 0, NULL);
+#endif
+
+    asc_assert(ret != -1, MSG("failed to attach wakeup fd [%s]"), strerror(errno));
+}
+
+static void event_wake_close(void)
+{
+    if(event_observer.wake_rd != -1)
+        close(event_observer.wake_rd);
+    if(event_observer.wake_wr != -1 && event_observer.wake_wr != event_observer.wake_rd)
+        close(event_observer.wake_wr);
+    event_observer.wake_rd = -1;
+    event_observer.wake_wr = -1;
+}
+
+static void event_wake_drain(void)
+{
+    __atomic_store_n(&event_observer.wake_pending, 0, __ATOMIC_RELEASE);
+
+    uint64_t value;
+    while(read(event_observer.wake_rd, &value, sizeof(value)) > 0)
+        continue;
+}
+
+void asc_event_core_notify(asc_event_core_t *core)
+{
+    /* async-signal-safe: called from signal handlers and worker threads */
+    if(!core || core->wake_wr == -1)
+        return;
+    if(__atomic_exchange_n(&core->wake_pending, 1, __ATOMIC_ACQ_REL))
+        return;
+
+    const uint64_t value = 1;
+    const int saved_errno = errno;
+    if(write(core->wake_wr, &value, sizeof(value)) == -1)
+        __atomic_store_n(&core->wake_pending, 0, __ATOMIC_RELEASE);
+    errno = saved_errno;
+}
+
+void asc_event_core_wakeup(void)
+{
+    asc_event_core_notify(__atomic_load_n(&event_observer_main, __ATOMIC_ACQUIRE));
+}
+
+asc_event_core_t * asc_event_core_self(void)
+{
+    return &event_observer;
+}
 
 void asc_event_core_init(void)
 {
@@ -107,6 +206,13 @@ void asc_event_core_init(void)
     asc_assert(event_observer.fd != -1
                , MSG("failed to init event observer [%s]")
                , strerror(errno));
+
+    event_wake_open();
+
+    /* the first initialized observer belongs to the main thread */
+    event_observer_t *expected = NULL;
+    __atomic_compare_exchange_n(&event_observer_main, &expected, &event_observer
+                                , false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
 }
 
 void asc_event_core_destroy(void)
@@ -114,6 +220,11 @@ void asc_event_core_destroy(void)
     if(!event_observer.fd)
         return;
 
+    event_observer_t *expected = &event_observer;
+    __atomic_compare_exchange_n(&event_observer_main, &expected, NULL
+                                , false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+
+    event_wake_close();
     close(event_observer.fd);
     event_observer.fd = 0;
 
@@ -135,17 +246,23 @@ void asc_event_core_destroy(void)
     event_observer.event_list = NULL;
 }
 
-void asc_event_core_loop(void)
+void asc_event_core_wait(int timeout_ms)
 {
-    if(!asc_list_size(event_observer.event_list))
+    if(timeout_ms == 0 && !asc_list_size(event_observer.event_list))
         return;
 
 #if defined(EV_TYPE_KQUEUE)
-    static const struct timespec timeout = { 0, 0 };
+    struct timespec timeout = { 0, 0 };
+    if(timeout_ms > 0)
+    {
+        timeout.tv_sec = timeout_ms / 1000;
+        timeout.tv_nsec = (timeout_ms % 1000) * 1000000;
+    }
     const int ret = kevent(event_observer.fd, NULL, 0
-                           , event_observer.ed_list, EV_LIST_SIZE, &timeout);
+                           , event_observer.ed_list, EV_LIST_SIZE
+                           , (timeout_ms < 0) ? NULL : &timeout);
 #else
-    const int ret = epoll_wait(event_observer.fd, event_observer.ed_list, EV_LIST_SIZE, 0);
+    const int ret = epoll_wait(event_observer.fd, event_observer.ed_list, EV_LIST_SIZE, timeout_ms);
 #endif
 
     if(ret == -1)
@@ -153,17 +270,29 @@ void asc_event_core_loop(void)
         asc_assert(errno == EINTR, MSG("event observer critical error [%s]"), strerror(errno));
         return;
     }
+    if(ret > 0)
+        asc_now_update();
 
     event_observer.is_changed = false;
     for(int i = 0; i < ret; ++i)
     {
         EV_OTYPE *ed = &event_observer.ed_list[i];
 #if defined(EV_TYPE_KQUEUE)
+        if(ed->udata == (void *)&event_wake_marker)
+        {
+            event_wake_drain();
+            continue;
+        }
         asc_event_t *event = (asc_event_t *)ed->udata;
         const bool is_rd = (ed->data > 0) && (ed->filter == EVFILT_READ);
         const bool is_wr = (ed->data > 0) && (ed->filter == EVFILT_WRITE);
         const bool is_er = (ed->flags & ~EV_ADD) && (!is_rd || is_wr);
 #else
+        if(ed->data.ptr == (void *)&event_wake_marker)
+        {
+            event_wake_drain();
+            continue;
+        }
         asc_event_t *event = (asc_event_t *)ed->data.ptr;
         const bool is_rd = ed->events & EPOLLIN;
         const bool is_wr = ed->events & EPOLLOUT;
@@ -172,27 +301,32 @@ void asc_event_core_loop(void)
         if(event->on_read && is_rd)
         {
             is_main_loop_idle = false;
-            event->on_read(event->arg);
+            event_callback(event->on_read, event->arg);
             if(event_observer.is_changed)
                 break;
         }
         if(event->on_error && is_er)
         {
             is_main_loop_idle = false;
-            event->on_error(event->arg);
+            event_callback(event->on_error, event->arg);
             if(event_observer.is_changed)
                 break;
         }
         if(event->on_write && is_wr)
         {
             is_main_loop_idle = false;
-            event->on_write(event->arg);
+            event_callback(event->on_write, event->arg);
             if(event_observer.is_changed)
                 break;
         }
     }
 }
 
+void asc_event_core_loop(void)
+{
+    asc_event_core_wait(0);
+}
+
 static void asc_event_subscribe(asc_event_t *event)
 {
     int ret = 0;
@@ -305,7 +439,7 @@ void asc_event_close(asc_event_t *event)
  *
  */
 
-typedef struct
+typedef struct asc_event_core_t
 {
     asc_event_t *event_list[EV_LIST_SIZE];
     bool is_changed;
@@ -316,13 +450,18 @@ typedef struct
 
 #define ED_SIZE (int)(sizeof(struct pollfd))
 
-static event_observer_t event_observer;
+static __thread event_observer_t event_observer;
 
 void asc_event_core_init(void)
 {
     memset(&event_observer, 0, sizeof(event_observer));
 }
 
+asc_event_core_t * asc_event_core_self(void)
+{
+    return &event_observer;
+}
+
 void asc_event_core_destroy(void)
 {
     while(event_observer.fd_count > 0)
@@ -339,17 +478,35 @@ void asc_event_core_destroy(void)
     }
 }
 
-void asc_event_core_loop(void)
+/*
+ * poll/select have no wakeup channel: waiting is limited to 1ms so thread
+ * buffers and signals are picked up as fast as with the polling main loop.
+ */
+#define EV_WAIT_NO_WAKEUP_MS 1
+
+void asc_event_core_wakeup(void)
+{
+    ;
+}
+
+void asc_event_core_notify(asc_event_core_t *core)
+{
+    __uarg(core);
+}
+
+static void asc_event_core_poll(int timeout_ms)
 {
     if(!event_observer.fd_count)
         return;
 
-    int ret = poll(event_observer.fd_list, event_observer.fd_count, 10);
+    int ret = poll(event_observer.fd_list, event_observer.fd_count, timeout_ms);
     if(ret == -1)
     {
         asc_assert(errno == EINTR, MSG("event observer critical error [%s]"), strerror(errno));
         return;
     }
+    if(ret > 0)
+        asc_now_update();
 
     event_observer.is_changed = false;
     for(int i = 0; i < event_observer.fd_count && ret > 0; ++i)
@@ -363,27 +520,47 @@ void asc_event_core_loop(void)
         if(event->on_read && (revents & POLLIN))
         {
             is_main_loop_idle = false;
-            event->on_read(event->arg);
+            event_callback(event->on_read, event->arg);
             if(event_observer.is_changed)
                 break;
         }
         if(event->on_error && (revents & (POLLERR | POLLHUP | POLLNVAL)))
         {
             is_main_loop_idle = false;
-            event->on_error(event->arg);
+            event_callback(event->on_error, event->arg);
             if(event_observer.is_changed)
                 break;
         }
         if(event->on_write && (revents & POLLOUT))
         {
             is_main_loop_idle = false;
-            event->on_write(event->arg);
+            event_callback(event->on_write, event->arg);
             if(event_observer.is_changed)
                 break;
         }
     }
 }
 
+void asc_event_core_loop(void)
+{
+    asc_event_core_poll(10);
+}
+
+void asc_event_core_wait(int timeout_ms)
+{
+    if(timeout_ms < 0 || timeout_ms > EV_WAIT_NO_WAKEUP_MS)
+        timeout_ms = EV_WAIT_NO_WAKEUP_MS;
+
+    if(!event_observer.fd_count)
+    {
+        if(timeout_ms > 0)
+            asc_usleep(timeout_ms * 1000);
+        return;
+    }
+
+    asc_event_core_poll(timeout_ms);
+}
+
 static void asc_event_subscribe(asc_event_t *event)
 {
     int i;
@@ -457,7 +634,7 @@ void asc_event_close(asc_event_t *event)
  *
  */
 
-typedef struct
+typedef struct asc_event_core_t
 {
     asc_list_t *event_list;
     bool is_changed;
@@ -468,7 +645,7 @@ typedef struct
     fd_set emaster;
 } event_observer_t;
 
-static event_observer_t event_observer;
+static __thread event_observer_t event_observer;
 
 void asc_event_core_init(void)
 {
@@ -476,6 +653,11 @@ void asc_event_core_init(void)
     event_observer.event_list = asc_list_init();
 }
 
+asc_event_core_t * asc_event_core_self(void)
+{
+    return &event_observer;
+}
+
 void asc_event_core_destroy(void)
 {
     asc_event_t *prev_event = NULL;
@@ -496,10 +678,29 @@ void asc_event_core_destroy(void)
     event_observer.event_list = NULL;
 }
 
-void asc_event_core_loop(void)
+#define EV_WAIT_NO_WAKEUP_MS 1
+
+void asc_event_core_wakeup(void)
 {
+    ;
+}
+
+void asc_event_core_notify(asc_event_core_t *core)
+{
+    __uarg(core);
+}
+
+void asc_event_core_wait(int timeout_ms)
+{
+    if(timeout_ms < 0 || timeout_ms > EV_WAIT_NO_WAKEUP_MS)
+        timeout_ms = EV_WAIT_NO_WAKEUP_MS;
+
     if(!asc_list_size(event_observer.event_list))
+    {
+        if(timeout_ms > 0)
+            asc_usleep(timeout_ms * 1000);
         return;
+    }
 
     fd_set rset;
     fd_set wset;
@@ -508,7 +709,7 @@ void asc_event_core_loop(void)
     memcpy(&wset, &event_observer.wmaster, sizeof(wset));
     memcpy(&eset, &event_observer.emaster, sizeof(eset));
 
-    static struct timeval timeout = { .tv_sec = 0, .tv_usec = 0 };
+    struct timeval timeout = { .tv_sec = 0, .tv_usec = timeout_ms * 1000 };
     const int ret = select(event_observer.max_fd + 1, &rset, &wset, &eset, &timeout);
     if(ret == -1)
     {
@@ -522,6 +723,7 @@ void asc_event_core_loop(void)
     }
     else if(ret > 0)
     {
+        asc_now_update();
         event_observer.is_changed = false;
         asc_list_for(event_observer.event_list)
         {
@@ -529,21 +731,21 @@ void asc_event_core_loop(void)
             if(event->on_read && FD_ISSET(event->fd, &rset))
             {
                 is_main_loop_idle = false;
-                event->on_read(event->arg);
+                event_callback(event->on_read, event->arg);
                 if(event_observer.is_changed)
                     break;
             }
             if(event->on_error && FD_ISSET(event->fd, &eset))
             {
                 is_main_loop_idle = false;
-                event->on_error(event->arg);
+                event_callback(event->on_error, event->arg);
                 if(event_observer.is_changed)
                     break;
             }
             if(event->on_write && FD_ISSET(event->fd, &wset))
             {
                 is_main_loop_idle = false;
-                event->on_write(event->arg);
+                event_callback(event->on_write, event->arg);
                 if(event_observer.is_changed)
                     break;
             }
@@ -551,6 +753,11 @@ void asc_event_core_loop(void)
     }
 }
 
+void asc_event_core_loop(void)
+{
+    asc_event_core_wait(0);
+}
+
 static void asc_event_subscribe(asc_event_t *event)
 {
     if(event->on_read)
@@ -24,12 +24,22 @@
 #include "base.h"
 
 typedef struct asc_event_t asc_event_t;
+typedef struct asc_event_core_t asc_event_core_t;
 typedef void (*event_callback_t)(void *);
 
+/* event observer is per-thread: init/loop/destroy work on the caller's one */
 void asc_event_core_init(void);
 void asc_event_core_loop(void);
+void asc_event_core_wait(int timeout_ms);
 void asc_event_core_destroy(void);
 
+/* wake up the main thread observer (async-signal-safe) */
+void asc_event_core_wakeup(void);
+
+/* wake up any observer from any thread */
+asc_event_core_t * asc_event_core_self(void) __wur;
+void asc_event_core_notify(asc_event_core_t *core);
+
 asc_event_t * asc_event_init(int fd, void *arg) __wur;
 void asc_event_set_on_read(asc_event_t *event, event_callback_t on_read);
 void asc_event_set_on_write(asc_event_t *event, event_callback_t on_write);
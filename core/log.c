@@ -19,13 +19,78 @@
  */
 
 #include "log.h"
+#include "clock.h"
 
 #ifndef _WIN32
-#include <syslog.h>
+#   include <syslog.h>
+#   include <sys/uio.h>
+#   include <pthread.h>
+#   include <signal.h>
+#   define LOG_ASYNC 1
 #endif
 #include <sys/stat.h>
 #include <stdarg.h>
 
+/*
+ * Lines are formatted by the caller and queued into the MPSC ring,
+ * the writer thread adds time stamps and writes them out in batches.
+ * Until asc_log_core_init() (and on win32) lines are written in place.
+ */
+
+#define LOG_BUFFER_SIZE 4096
+#define LOG_RING_SIZE 4096
+#define LOG_SLOT_TEXT 480
+#define LOG_BATCH 64
+#define LOG_WAIT_MS 250
+#define LOG_FLUSH_TIMEOUT_MS 1000
+
+#define LOG_SITES_SIZE 1024
+#define LOG_RATE_DEFAULT 200
+#define LOG_BURST_SEC 10
+
+/*
+ * token bucket state: ms since start (40 bits) | tokens in 1/1000 line (24 bits)
+ * 1/1000 line: one ms refills exactly rate_limit units, nothing is truncated.
+ * The burst is capped at LOG_TOKEN_MAX (16777 lines).
+ */
+#define LOG_TOKEN_BITS 24
+#define LOG_TOKEN_UNIT 1000
+#define LOG_TOKEN_MAX ((1ULL << LOG_TOKEN_BITS) - 1)
+
+enum
+{
+    LOG_TYPE_INFO       = 0x00000001,
+    LOG_TYPE_ERROR      = 0x00000002,
+    LOG_TYPE_WARNING    = 0x00000004,
+    LOG_TYPE_DEBUG      = 0x00000008
+};
+
+typedef struct
+{
+    int type;
+    time_t ts;
+    const char *text;
+    size_t len; // with the trailing new line
+} log_line_t;
+
+typedef struct
+{
+    uint64_t seq;
+    int type;
+    time_t ts;
+    size_t len;
+    char *heap; // lines longer than LOG_SLOT_TEXT
+    char text[LOG_SLOT_TEXT];
+} log_slot_t;
+
+typedef struct
+{
+    const char *site; // format string of the call site
+    int type;
+    uint64_t bucket;
+    uint64_t suppressed;
+} log_site_t;
+
 static struct
 {
     int fd;
@@ -40,6 +105,7 @@ static struct
 #ifndef _WIN32
     char *syslog;
 #endif
+    int rate_limit;
 } __log =
 {
     0,
@@ -54,15 +120,41 @@ static struct
 #ifndef _WIN32
     NULL,
 #endif
+    LOG_RATE_DEFAULT,
 };
 
-enum
+static asc_log_stats_t log_stats;
+static log_site_t log_sites[LOG_SITES_SIZE];
+static uint64_t log_start_ms = 0;
+
+/* time stamp prefix, formatted once per second */
+static time_t log_ts_cached = 0;
+static char log_ts_buffer[64];
+static size_t log_ts_size = 0;
+
+#ifdef LOG_ASYNC
+static pthread_mutex_t log_lock = PTHREAD_MUTEX_INITIALIZER;
+#   define LOG_LOCK() pthread_mutex_lock(&log_lock)
+#   define LOG_UNLOCK() pthread_mutex_unlock(&log_lock)
+
+static struct
 {
-    LOG_TYPE_INFO       = 0x00000001,
-    LOG_TYPE_ERROR      = 0x00000002,
-    LOG_TYPE_WARNING    = 0x00000004,
-    LOG_TYPE_DEBUG      = 0x00000008
-};
+    log_slot_t *slots;
+    uint64_t tail; // producers
+    uint64_t head; // writer
+
+    pthread_t thread;
+    pthread_cond_t cond;
+    bool is_running;
+    int is_stop;
+    int is_sleeping;
+    int is_hup;
+    int is_idle;
+} log_ring;
+#else
+#   define LOG_LOCK()
+#   define LOG_UNLOCK()
+#endif
 
 #ifndef _WIN32
 static int _get_type_syslog(int type)
@@ -102,6 +194,49 @@ static int _get_type_level(int type)
     }
 }
 
+/*
+ *   ooooooo  ooooo  oooo ooooooooooo oooooooooo ooooo  oooo ooooooooooo
+ * o888   888o 888    88  88  888  88  888    888 888    88  88  888  88
+ * 888     888 888    88      888      888oooo88  888    88      888
+ * 888o   o888 888    88      888      888        888    88      888
+ *   88ooo88    888oo88      o888o    o888o        888oo88      o888o
+ *
+ */
+
+/* called with log_lock. false and errno on failure */
+static bool log_reopen(void)
+{
+    if(__log.fd > 1)
+    {
+        close(__log.fd);
+        __log.fd = 0;
+    }
+    __log.file_bytes = 0;
+
+    if(!__log.filename)
+        return true;
+
+    __log.fd = open(__log.filename, O_WRONLY | O_CREAT | O_APPEND
+#ifndef _WIN32
+                    , S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+#else
+                    , S_IRUSR | S_IWUSR);
+#endif
+
+    if(__log.fd == -1)
+    {
+        __log.fd = 0;
+        __log.sout = true;
+        return false;
+    }
+
+    struct stat st;
+    if(fstat(__log.fd, &st) == 0 && st.st_size > 0)
+        __log.file_bytes = (size_t)st.st_size;
+
+    return true;
+}
+
 static bool _log_rotate_try(void)
 {
     if(!__log.filename || __log.fd <= 1)
@@ -121,94 +256,151 @@ static bool _log_rotate_try(void)
 
     // Rotate: <file> -> <file>.1 -> <file>.2 -> ... -> <file>.<keep>
     const size_t base_len = strlen(__log.filename);
-    for(int i = __log.rotate_keep - 1; i >= 1; --i)
+    const size_t name_len = base_len + 1 + 20 + 1;
+    char *src = malloc(name_len);
+    char *dst = malloc(name_len);
+    if(!src || !dst)
     {
-        const size_t src_len = base_len + 1 + 20 + 1;
-        char *src = malloc(src_len);
-        char *dst = malloc(src_len);
-        if(!src || !dst)
-        {
-            free(src);
-            free(dst);
-            __log.rotate_fail_ts = now;
-            asc_log_hup();
-            return false;
-        }
-        snprintf(src, src_len, "%s.%d", __log.filename, i);
-        snprintf(dst, src_len, "%s.%d", __log.filename, i + 1);
-        if(rename(src, dst) == -1 && errno != ENOENT)
-            __log.rotate_fail_ts = now;
         free(src);
         free(dst);
+        __log.rotate_fail_ts = now;
+        if(!log_reopen())
+            fprintf(stderr, "[log] failed to open %s [%s]\n", __log.filename, strerror(errno));
+        return false;
     }
 
-    const size_t first_len = base_len + 1 + 20 + 1;
-    char *first = malloc(first_len);
-    if(!first)
+    for(int i = __log.rotate_keep - 1; i >= 1; --i)
     {
-        __log.rotate_fail_ts = now;
-        asc_log_hup();
-        return false;
+        snprintf(src, name_len, "%s.%d", __log.filename, i);
+        snprintf(dst, name_len, "%s.%d", __log.filename, i + 1);
+        if(rename(src, dst) == -1 && errno != ENOENT)
+            __log.rotate_fail_ts = now;
     }
-    snprintf(first, first_len, "%s.%d", __log.filename, 1);
-    if(rename(__log.filename, first) == -1 && errno != ENOENT)
+
+    snprintf(dst, name_len, "%s.%d", __log.filename, 1);
+    if(rename(__log.filename, dst) == -1 && errno != ENOENT)
         __log.rotate_fail_ts = now;
-    free(first);
+    free(src);
+    free(dst);
 
-    asc_log_hup();
+    if(!log_reopen())
+        fprintf(stderr, "[log] failed to open %s [%s]\n", __log.filename, strerror(errno));
     if(__log.rotate_fail_ts != now)
         __log.rotate_fail_ts = 0;
     return __log.fd > 1;
 }
 
-__fmt_printf(2, 0)
-static void _log(int type, const char *msg, va_list ap)
+static void log_ts_update(time_t ts)
 {
-    if(_get_type_level(type) > __log.level)
+    if(ts == log_ts_cached && log_ts_size)
         return;
 
-    char buffer[4096];
+    struct tm sct;
+#ifndef _WIN32
+    localtime_r(&ts, &sct);
+#else
+    sct = *localtime(&ts);
+#endif
+    log_ts_size = strftime(log_ts_buffer, sizeof(log_ts_buffer), "%b %d %X: ", &sct);
+    log_ts_cached = ts;
+}
 
-    size_t len_1 = 0; // to skip time stamp
-    time_t ct = time(NULL);
-    struct tm *sct = localtime(&ct);
-    len_1 = strftime(buffer, sizeof(buffer), "%b %d %X: ", sct);
+#ifndef _WIN32
+static bool log_writev(int fd, struct iovec *iov, int count)
+{
+    while(count > 0)
+    {
+        ssize_t r = writev(fd, iov, count);
+        if(r == -1)
+        {
+            if(errno == EINTR)
+                continue;
+            return false;
+        }
+
+        // partial write: skip written buffers
+        while(count > 0 && (size_t)r >= iov->iov_len)
+        {
+            r -= iov->iov_len;
+            ++iov;
+            --count;
+        }
+        if(count > 0)
+        {
+            iov->iov_base = (char *)iov->iov_base + r;
+            iov->iov_len -= r;
+        }
+    }
 
-    size_t len_2 = len_1;
-    const char *type_str = _get_type_str(type);
-    len_2 += snprintf(&buffer[len_2], sizeof(buffer) - len_2, "%s: ", type_str);
-    len_2 += vsnprintf(&buffer[len_2], sizeof(buffer) - len_2, msg, ap);
+    return true;
+}
+
+#define LOG_IOV(_iov, _n, _ptr, _len) \
+    do { \
+        _iov[_n].iov_base = (void *)(_ptr); \
+        _iov[_n].iov_len = (_len); \
+        ++_n; \
+    } while(0)
+#endif
+
+/* called with log_lock. count <= LOG_BATCH */
+static void log_output(const log_line_t *lines, size_t count)
+{
+    char prefix[LOG_BATCH][96];
+    size_t prefix_size[LOG_BATCH];
+    size_t total = 0;
+
+    for(size_t i = 0; i < count; ++i)
+    {
+        log_ts_update(lines[i].ts);
+        memcpy(prefix[i], log_ts_buffer, log_ts_size);
+        prefix_size[i] = log_ts_size;
+        prefix_size[i] += snprintf(&prefix[i][log_ts_size], sizeof(prefix[i]) - log_ts_size
+                                   , "%s: ", _get_type_str(lines[i].type));
+        total += prefix_size[i] + lines[i].len;
 
 #ifndef _WIN32
-    if(__log.syslog)
-        syslog(_get_type_syslog(type), "%s", &buffer[len_1]);
+        if(__log.syslog)
+        {
+            syslog(_get_type_syslog(lines[i].type), "%s%.*s"
+                   , &prefix[i][log_ts_size], (int)(lines[i].len - 1), lines[i].text);
+        }
 #endif
+    }
 
-    buffer[len_2] = '\n';
-    ++len_2;
+#ifndef _WIN32
+    struct iovec iov[LOG_BATCH * 4];
+    int iov_count = 0;
 
     if(__log.sout)
     {
-        bool reset_color = false;
-        if(__log.color && isatty(STDOUT_FILENO))
+        const bool is_color = __log.color && isatty(STDOUT_FILENO);
+        for(size_t i = 0; i < count; ++i)
         {
-            switch(type)
+            bool reset_color = false;
+            if(is_color)
             {
-                case LOG_TYPE_WARNING:
-                    if(write(STDOUT_FILENO, "\x1b[33m", 5) != -1)
+                switch(lines[i].type)
+                {
+                    case LOG_TYPE_WARNING:
+                        LOG_IOV(iov, iov_count, "\x1b[33m", 5);
                         reset_color = true;
-                    break;
-                case LOG_TYPE_ERROR:
-                    if(write(STDOUT_FILENO, "\x1b[31m", 5) != -1)
+                        break;
+                    case LOG_TYPE_ERROR:
+                        LOG_IOV(iov, iov_count, "\x1b[31m", 5);
                         reset_color = true;
-                    break;
-                default:
-                    break;
+                        break;
+                    default:
+                        break;
+                }
             }
+            LOG_IOV(iov, iov_count, prefix[i], prefix_size[i]);
+            LOG_IOV(iov, iov_count, lines[i].text, lines[i].len);
+            if(reset_color)
+                LOG_IOV(iov, iov_count, "\x1b[0m", 4);
         }
-        const int r = write(1, buffer, len_2);
-        if(reset_color && write(STDOUT_FILENO, "\x1b[0m", 4) != -1) {};
-        if(r == -1)
+
+        if(!log_writev(STDOUT_FILENO, iov, iov_count))
             fprintf(stderr, "[log] failed to write to the stdout [%s]\n", strerror(errno));
     }
 
@@ -218,23 +410,336 @@ static void _log(int type, const char *msg, va_list ap)
             _log_rotate_try();
         if(__log.fd > 1)
         {
-            if(write(__log.fd, buffer, len_2) == -1)
+            iov_count = 0;
+            for(size_t i = 0; i < count; ++i)
             {
-                fprintf(stderr, "[log] failed to write to the file [%s]\n", strerror(errno));
+                LOG_IOV(iov, iov_count, prefix[i], prefix_size[i]);
+                LOG_IOV(iov, iov_count, lines[i].text, lines[i].len);
             }
+
+            if(!log_writev(__log.fd, iov, iov_count))
+                fprintf(stderr, "[log] failed to write to the file [%s]\n", strerror(errno));
             else
+                __log.file_bytes += total;
+        }
+    }
+#else
+    for(size_t i = 0; i < count; ++i)
+    {
+        if(__log.sout)
+        {
+            if(write(1, prefix[i], prefix_size[i]) == -1
+               || write(1, lines[i].text, lines[i].len) == -1)
             {
-                __log.file_bytes += len_2;
+                fprintf(stderr, "[log] failed to write to the stdout [%s]\n", strerror(errno));
+            }
+        }
+
+        if(__log.fd > 1)
+        {
+            if(__log.rotate_max_bytes > 0 && __log.rotate_keep > 0)
+                _log_rotate_try();
+            if(__log.fd > 1)
+            {
+                if(write(__log.fd, prefix[i], prefix_size[i]) == -1
+                   || write(__log.fd, lines[i].text, lines[i].len) == -1)
+                {
+                    fprintf(stderr, "[log] failed to write to the file [%s]\n", strerror(errno));
+                }
+                else
+                {
+                    __log.file_bytes += prefix_size[i] + lines[i].len;
+                }
             }
         }
     }
+#endif
+}
+
+/*
+ *  oooooooo8 ooooo ooooooooooo ooooooooooo  oooooooo8
+ * 888         888  88  888  88  888    88  888
+ *  888oooooo  888      888      888ooo8     888oooooo
+ *         888 888      888      888    oo          888
+ * o88oooo888 o888o    o888o    o888ooo8888 o88oooo888
+ *
+ */
+
+static log_site_t * log_site_get(const char *site, int type)
+{
+    size_t index = ((size_t)site >> 3) % LOG_SITES_SIZE;
+
+    for(size_t i = 0; i < LOG_SITES_SIZE; ++i)
+    {
+        log_site_t *const item = &log_sites[index];
+        const char *current = __atomic_load_n(&item->site, __ATOMIC_ACQUIRE);
+
+        if(!current)
+        {
+            const char *expected = NULL;
+            if(__atomic_compare_exchange_n(&item->site, &expected, site
+                                           , false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+            {
+                __atomic_store_n(&item->type, type, __ATOMIC_RELAXED);
+                return item;
+            }
+            current = expected;
+        }
+
+        if(current == site)
+            return item;
+
+        index = (index + 1) % LOG_SITES_SIZE;
+    }
+
+    // table is full, site is not limited
+    return NULL;
+}
+
+/* token bucket: rate_limit lines per second, burst of LOG_BURST_SEC seconds */
+static bool log_site_pass(const char *site, int type)
+{
+    const int rate = __atomic_load_n(&__log.rate_limit, __ATOMIC_RELAXED);
+    if(rate <= 0 || !site)
+        return true;
+
+    log_site_t *const item = log_site_get(site, type);
+    if(!item)
+        return true;
+
+    uint64_t burst = (uint64_t)rate * LOG_BURST_SEC * LOG_TOKEN_UNIT;
+    if(burst > LOG_TOKEN_MAX)
+        burst = LOG_TOKEN_MAX;
+
+    // +1: state 0 marks the first line of the site
+    const uint64_t now = asc_utime() / 1000 - log_start_ms + 1;
+    uint64_t state = __atomic_load_n(&item->bucket, __ATOMIC_RELAXED);
+
+    while(true)
+    {
+        uint64_t tokens;
+        uint64_t last = now;
+        if(!state)
+        {
+            // first line of the site
+            tokens = burst;
+        }
+        else
+        {
+            // another thread may have stored a later time, keep it
+            last = state >> LOG_TOKEN_BITS;
+            tokens = state & LOG_TOKEN_MAX;
+            if(now > last)
+            {
+                const uint64_t elapsed = now - last;
+                if(elapsed >= LOG_BURST_SEC * 1000)
+                    tokens = burst;
+                else
+                    tokens += elapsed * (uint64_t)rate * LOG_TOKEN_UNIT / 1000;
+                if(tokens > burst)
+                    tokens = burst;
+                last = now;
+            }
+        }
+
+        const bool is_pass = (tokens >= LOG_TOKEN_UNIT);
+        if(is_pass)
+            tokens -= LOG_TOKEN_UNIT;
+
+        const uint64_t next = (last << LOG_TOKEN_BITS) | tokens;
+        if(__atomic_compare_exchange_n(&item->bucket, &state, next
+                                       , false, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        {
+            if(!is_pass)
+            {
+                __atomic_fetch_add(&item->suppressed, 1, __ATOMIC_RELAXED);
+                __atomic_fetch_add(&log_stats.suppressed, 1, __ATOMIC_RELAXED);
+            }
+            return is_pass;
+        }
+    }
+}
+
+/*
+ * oooooooooo  ooooo oooo   oooo   oooooooo8
+ *  888    888  888   8888o  88  o888     88
+ *  888oooo88   888   88 888o88  888    oooo
+ *  888  88o    888   88   8888  888o    88
+ * o888o  88o8 o888o o88o    88   888ooo888
+ *
+ */
+
+#ifdef LOG_ASYNC
+
+static bool log_ring_push(int type, time_t ts, const char *text, size_t len)
+{
+    uint64_t pos = __atomic_load_n(&log_ring.tail, __ATOMIC_RELAXED);
+    log_slot_t *slot;
+
+    while(true)
+    {
+        slot = &log_ring.slots[pos & (LOG_RING_SIZE - 1)];
+        const uint64_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+
+        if(seq == pos)
+        {
+            if(__atomic_compare_exchange_n(&log_ring.tail, &pos, pos + 1
+                                           , true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            {
+                break;
+            }
+        }
+        else if(seq < pos)
+        {
+            // ring is full
+            return false;
+        }
+        else
+        {
+            pos = __atomic_load_n(&log_ring.tail, __ATOMIC_RELAXED);
+        }
+    }
+
+    slot->type = type;
+    slot->ts = ts;
+    slot->len = len;
+    slot->heap = NULL;
+    if(len <= LOG_SLOT_TEXT)
+    {
+        memcpy(slot->text, text, len);
+    }
+    else
+    {
+        slot->heap = (char *)malloc(len);
+        if(slot->heap)
+            memcpy(slot->heap, text, len);
+        else
+            slot->len = 0;
+    }
+
+    __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+
+    // writer sleeps only when the ring is empty
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if(__atomic_load_n(&log_ring.is_sleeping, __ATOMIC_RELAXED))
+    {
+        LOG_LOCK();
+        pthread_cond_signal(&log_ring.cond);
+        LOG_UNLOCK();
+    }
+
+    return true;
+}
+
+static bool log_ring_is_empty(void)
+{
+    const uint64_t pos = log_ring.head;
+    const log_slot_t *slot = &log_ring.slots[pos & (LOG_RING_SIZE - 1)];
+    return __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != pos + 1;
+}
+
+/* writer thread only. returns number of lines */
+static size_t log_ring_drain(void)
+{
+    log_line_t lines[LOG_BATCH];
+    size_t count = 0;
+    uint64_t pos = log_ring.head;
+
+    while(count < LOG_BATCH)
+    {
+        log_slot_t *const slot = &log_ring.slots[pos & (LOG_RING_SIZE - 1)];
+        if(__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != pos + 1)
+            break;
+
+        if(slot->len)
+        {
+            lines[count].type = slot->type;
+            lines[count].ts = slot->ts;
+            lines[count].text = (slot->heap) ? slot->heap : slot->text;
+            lines[count].len = slot->len;
+            ++count;
+        }
+        ++pos;
+    }
+
+    if(pos == log_ring.head)
+        return 0;
+
+    if(count > 0)
+    {
+        LOG_LOCK();
+        log_output(lines, count);
+        LOG_UNLOCK();
+    }
+
+    // release slots
+    for(uint64_t i = log_ring.head; i < pos; ++i)
+    {
+        log_slot_t *const slot = &log_ring.slots[i & (LOG_RING_SIZE - 1)];
+        if(slot->heap)
+        {
+            free(slot->heap);
+            slot->heap = NULL;
+        }
+        __atomic_store_n(&slot->seq, i + LOG_RING_SIZE, __ATOMIC_RELEASE);
+    }
+    log_ring.head = pos;
+
+    return count;
+}
+
+#endif /* LOG_ASYNC */
+
+__fmt_printf(3, 0)
+static void _log(int type, const char *site, const char *msg, va_list ap)
+{
+    if(_get_type_level(type) > __log.level)
+        return;
+
+    if(!log_site_pass(site, type))
+        return;
+
+    char buffer[LOG_BUFFER_SIZE];
+    int len = vsnprintf(buffer, sizeof(buffer) - 1, msg, ap);
+    if(len < 0)
+        len = 0;
+    else if(len > (int)sizeof(buffer) - 2)
+        len = sizeof(buffer) - 2;
+    buffer[len] = '\n';
+    ++len;
+
+    __atomic_fetch_add(&log_stats.lines, 1, __ATOMIC_RELAXED);
+    const time_t ts = time(NULL);
+
+#ifdef LOG_ASYNC
+    if(__atomic_load_n(&log_ring.is_running, __ATOMIC_ACQUIRE))
+    {
+        if(!log_ring_push(type, ts, buffer, (size_t)len))
+            __atomic_fetch_add(&log_stats.dropped, 1, __ATOMIC_RELAXED);
+        return;
+    }
+#endif
+
+    const log_line_t line = { type, ts, buffer, (size_t)len };
+    LOG_LOCK();
+    log_output(&line, 1);
+    LOG_UNLOCK();
+}
+
+static void log_printf(int type, const char *msg, ...) __fmt_printf(2, 3);
+static void log_printf(int type, const char *msg, ...)
+{
+    va_list ap;
+    va_start(ap, msg);
+    _log(type, NULL, msg, ap);
+    va_end(ap);
 }
 
 void asc_log_info(const char *msg, ...)
 {
     va_list ap;
     va_start(ap, msg);
-    _log(LOG_TYPE_INFO, msg, ap);
+    _log(LOG_TYPE_INFO, msg, msg, ap);
     va_end(ap);
 }
 
@@ -242,7 +747,7 @@ void asc_log_error(const char *msg, ...)
 {
     va_list ap;
     va_start(ap, msg);
-    _log(LOG_TYPE_ERROR, msg, ap);
+    _log(LOG_TYPE_ERROR, msg, msg, ap);
     va_end(ap);
 }
 
@@ -250,7 +755,7 @@ void asc_log_warning(const char *msg, ...)
 {
     va_list ap;
     va_start(ap, msg);
-    _log(LOG_TYPE_WARNING, msg, ap);
+    _log(LOG_TYPE_WARNING, msg, msg, ap);
     va_end(ap);
 }
 
@@ -258,49 +763,257 @@ void asc_log_debug(const char *msg, ...)
 {
     va_list ap;
     va_start(ap, msg);
-    _log(LOG_TYPE_DEBUG, msg, ap);
+    _log(LOG_TYPE_DEBUG, msg, msg, ap);
     va_end(ap);
 }
 
+static void log_message(int level, const char *site, const char *fmt, ...) __fmt_printf(3, 4);
+static void log_message(int level, const char *site, const char *fmt, ...)
+{
+    int type;
+    switch(level)
+    {
+        case ASC_LOG_LEVEL_ERROR: type = LOG_TYPE_ERROR; break;
+        case ASC_LOG_LEVEL_WARNING: type = LOG_TYPE_WARNING; break;
+        case ASC_LOG_LEVEL_DEBUG: type = LOG_TYPE_DEBUG; break;
+        case ASC_LOG_LEVEL_INFO:
+        default: type = LOG_TYPE_INFO; break;
+    }
+
+    va_list ap;
+    va_start(ap, fmt);
+    _log(type, site, fmt, ap);
+    va_end(ap);
+}
+
+void asc_log_message(int level, const char *text)
+{
+    log_message(level, NULL, "%s", text);
+}
+
+void asc_log_message_site(int level, const char *site, const char *text)
+{
+    log_message(level, site, "%s", text);
+}
+
 bool asc_log_is_debug(void)
 {
     return __log.level >= ASC_LOG_LEVEL_DEBUG;
 }
 
-void asc_log_hup(void)
+void asc_log_stats(asc_log_stats_t *stats)
 {
-    if(__log.fd > 1)
+    stats->lines = __atomic_load_n(&log_stats.lines, __ATOMIC_RELAXED);
+    stats->dropped = __atomic_load_n(&log_stats.dropped, __ATOMIC_RELAXED);
+    stats->suppressed = __atomic_load_n(&log_stats.suppressed, __ATOMIC_RELAXED);
+}
+
+/*
+ * oooo     oooo oooooooooo  ooooo ooooooooooo ooooooooooo oooooooooo
+ *  88   88  88   888    888  888  88  888  88  888    88   888    888
+ *   88 888 88    888oooo88   888      888      888ooo8     888oooo88
+ *    888 888     888  88o    888      888      888    oo   888  88o
+ *     8   8     o888o  88o8 o888o    o888o    o888ooo8888 o888o  88o8
+ *
+ */
+
+/* summaries of suppressed sites and dropped lines, once per second */
+static void log_sweep(void)
+{
+    static uint64_t dropped_reported = 0;
+
+    for(size_t i = 0; i < LOG_SITES_SIZE; ++i)
     {
-        close(__log.fd);
-        __log.fd = 0;
+        log_site_t *const item = &log_sites[i];
+        if(!__atomic_load_n(&item->suppressed, __ATOMIC_RELAXED))
+            continue;
+
+        const uint64_t count = __atomic_exchange_n(&item->suppressed, 0, __ATOMIC_RELAXED);
+        const char *site = __atomic_load_n(&item->site, __ATOMIC_ACQUIRE);
+        if(count && site)
+        {
+            log_printf(__atomic_load_n(&item->type, __ATOMIC_RELAXED)
+                       , "[core/log] suppressed %llu messages: %s"
+                       , (unsigned long long)count, site);
+        }
     }
-    __log.file_bytes = 0;
 
-    if(!__log.filename)
+    const uint64_t dropped = __atomic_load_n(&log_stats.dropped, __ATOMIC_RELAXED);
+    if(dropped != dropped_reported)
+    {
+        log_printf(LOG_TYPE_WARNING, "[core/log] dropped %llu lines (log ring is full)"
+                   , (unsigned long long)(dropped - dropped_reported));
+        dropped_reported = dropped;
+    }
+}
+
+#ifdef LOG_ASYNC
+
+static void * log_writer_thread(void *arg)
+{
+    __uarg(arg);
+
+    uint64_t sweep_time = asc_utime();
+
+    while(true)
+    {
+        if(__atomic_exchange_n(&log_ring.is_hup, 0, __ATOMIC_ACQ_REL))
+        {
+            LOG_LOCK();
+            const bool is_ok = log_reopen();
+            LOG_UNLOCK();
+            if(!is_ok)
+                asc_log_error("[core/log] failed to open %s (%s)", __log.filename, strerror(errno));
+        }
+
+        const size_t count = log_ring_drain();
+
+        const uint64_t now = asc_utime();
+        if(now - sweep_time >= 1000000)
+        {
+            sweep_time = now;
+            log_sweep();
+        }
+
+        if(count > 0)
+            continue;
+
+        LOG_LOCK();
+        __atomic_store_n(&log_ring.is_sleeping, 1, __ATOMIC_SEQ_CST);
+        if(log_ring_is_empty())
+        {
+            if(__atomic_load_n(&log_ring.is_stop, __ATOMIC_ACQUIRE))
+            {
+                __atomic_store_n(&log_ring.is_sleeping, 0, __ATOMIC_RELAXED);
+                LOG_UNLOCK();
+                break;
+            }
+
+            __atomic_store_n(&log_ring.is_idle, 1, __ATOMIC_RELEASE);
+
+            struct timespec ts;
+            clock_gettime(CLOCK_REALTIME, &ts);
+            ts.tv_nsec += LOG_WAIT_MS * 1000000L;
+            if(ts.tv_nsec >= 1000000000L)
+            {
+                ts.tv_sec += 1;
+                ts.tv_nsec -= 1000000000L;
+            }
+            pthread_cond_timedwait(&log_ring.cond, &log_lock, &ts);
+
+            __atomic_store_n(&log_ring.is_idle, 0, __ATOMIC_RELEASE);
+        }
+        __atomic_store_n(&log_ring.is_sleeping, 0, __ATOMIC_RELAXED);
+        LOG_UNLOCK();
+    }
+
+    return NULL;
+}
+
+#endif /* LOG_ASYNC */
+
+void asc_log_core_init(void)
+{
+    if(!log_start_ms)
+        log_start_ms = asc_utime() / 1000;
+
+#ifdef LOG_ASYNC
+    if(log_ring.is_running)
         return;
 
-    __log.fd = open(__log.filename, O_WRONLY | O_CREAT | O_APPEND
-#ifndef _WIN32
-                    , S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
-#else
-                    , S_IRUSR | S_IWUSR);
+    log_ring.slots = (log_slot_t *)calloc(LOG_RING_SIZE, sizeof(log_slot_t));
+    if(!log_ring.slots)
+        return;
+    for(uint64_t i = 0; i < LOG_RING_SIZE; ++i)
+        log_ring.slots[i].seq = i;
+    log_ring.head = 0;
+    log_ring.tail = 0;
+    log_ring.is_stop = 0;
+    log_ring.is_hup = 0;
+    pthread_cond_init(&log_ring.cond, NULL);
+
+    // signals are handled by the main thread
+    sigset_t mask;
+    sigset_t mask_prev;
+    sigfillset(&mask);
+    pthread_sigmask(SIG_SETMASK, &mask, &mask_prev);
+    const int ret = pthread_create(&log_ring.thread, NULL, log_writer_thread, NULL);
+    pthread_sigmask(SIG_SETMASK, &mask_prev, NULL);
+
+    if(ret != 0)
+    {
+        pthread_cond_destroy(&log_ring.cond);
+        free(log_ring.slots);
+        log_ring.slots = NULL;
+        return;
+    }
+
+    __atomic_store_n(&log_ring.is_running, true, __ATOMIC_RELEASE);
 #endif
+}
 
-    if(__log.fd == -1)
+void asc_log_flush(void)
+{
+#ifdef LOG_ASYNC
+    if(!__atomic_load_n(&log_ring.is_running, __ATOMIC_ACQUIRE))
+        return;
+
+    for(int i = 0; i < LOG_FLUSH_TIMEOUT_MS; ++i)
     {
-        __log.fd = 0;
-        __log.sout = true;
-        asc_log_error("[core/log] failed to open %s (%s)", __log.filename, strerror(errno));
+        if(__atomic_load_n(&log_ring.tail, __ATOMIC_ACQUIRE) == log_ring.head
+           && __atomic_load_n(&log_ring.is_idle, __ATOMIC_ACQUIRE))
+        {
+            return;
+        }
+
+        LOG_LOCK();
+        pthread_cond_signal(&log_ring.cond);
+        LOG_UNLOCK();
+        asc_usleep(1000);
+    }
+#endif
+}
+
+void asc_log_hup(void)
+{
+#ifdef LOG_ASYNC
+    // called from the signal handler: the writer thread reopens the file
+    if(__atomic_load_n(&log_ring.is_running, __ATOMIC_ACQUIRE))
+    {
+        __atomic_store_n(&log_ring.is_hup, 1, __ATOMIC_RELEASE);
         return;
     }
+#endif
 
-    struct stat st;
-    if(fstat(__log.fd, &st) == 0 && st.st_size > 0)
-        __log.file_bytes = (size_t)st.st_size;
+    if(!log_reopen())
+        asc_log_error("[core/log] failed to open %s (%s)", __log.filename, strerror(errno));
 }
 
 void asc_log_core_destroy(void)
 {
+#ifdef LOG_ASYNC
+    if(__atomic_load_n(&log_ring.is_running, __ATOMIC_ACQUIRE))
+    {
+        LOG_LOCK();
+        __atomic_store_n(&log_ring.is_stop, 1, __ATOMIC_RELEASE);
+        pthread_cond_signal(&log_ring.cond);
+        LOG_UNLOCK();
+
+        pthread_join(log_ring.thread, NULL);
+        __atomic_store_n(&log_ring.is_running, false, __ATOMIC_RELEASE);
+
+        // lines queued while the writer was stopping
+        while(log_ring_drain() > 0)
+            ;
+
+        pthread_cond_destroy(&log_ring.cond);
+        free(log_ring.slots);
+        log_ring.slots = NULL;
+    }
+#endif
+
+    LOG_LOCK();
+
     if(__log.fd > 1)
     {
         close(__log.fd);
@@ -319,16 +1032,21 @@ void asc_log_core_destroy(void)
     __log.color = false;
     __log.level = ASC_LOG_LEVEL_INFO;
     __log.sout = true;
+    __log.rate_limit = LOG_RATE_DEFAULT;
     if(__log.filename)
     {
         free(__log.filename);
         __log.filename = NULL;
     }
+
+    LOG_UNLOCK();
 }
 
 void asc_log_set_stdout(bool val)
 {
+    LOG_LOCK();
     __log.sout = val;
+    LOG_UNLOCK();
 }
 
 void asc_log_set_debug(bool val)
@@ -355,11 +1073,15 @@ void asc_log_set_level(int val)
 
 void asc_log_set_color(bool val)
 {
+    LOG_LOCK();
     __log.color = val;
+    LOG_UNLOCK();
 }
 
 void asc_log_set_file(const char *val)
 {
+    LOG_LOCK();
+
     if(__log.filename)
     {
         free(__log.filename);
@@ -369,22 +1091,38 @@ void asc_log_set_file(const char *val)
     if(val)
         __log.filename = strdup(val);
 
-    asc_log_hup();
+    const bool is_ok = log_reopen();
+
+    LOG_UNLOCK();
+
+    if(!is_ok)
+        asc_log_error("[core/log] failed to open %s (%s)", val, strerror(errno));
 }
 
 void asc_log_set_rotate(size_t max_bytes, int keep)
 {
+    LOG_LOCK();
     __log.rotate_max_bytes = max_bytes;
     __log.rotate_keep = keep;
     if(__log.rotate_keep < 0)
         __log.rotate_keep = 0;
     if(__log.rotate_max_bytes == 0 || __log.rotate_keep == 0)
         __log.rotate_fail_ts = 0;
+    LOG_UNLOCK();
+}
+
+void asc_log_set_rate_limit(int lines_per_sec)
+{
+    if(lines_per_sec < 0)
+        lines_per_sec = 0;
+    __atomic_store_n(&__log.rate_limit, lines_per_sec, __ATOMIC_RELAXED);
 }
 
 #ifndef _WIN32
 void asc_log_set_syslog(const char *val)
 {
+    LOG_LOCK();
+
     if(__log.syslog)
     {
         closelog();
@@ -392,10 +1130,12 @@ void asc_log_set_syslog(const char *val)
         __log.syslog = NULL;
     }
 
-    if(!val)
-        return;
+    if(val)
+    {
+        __log.syslog = strdup(val);
+        openlog(__log.syslog, LOG_PID | LOG_CONS, LOG_USER);
+    }
 
-    __log.syslog = strdup(val);
-    openlog(__log.syslog, LOG_PID | LOG_CONS, LOG_USER);
+    LOG_UNLOCK();
 }
 #endif
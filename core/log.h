@@ -37,17 +37,35 @@ void asc_log_set_level(int);
 void asc_log_set_color(bool);
 void asc_log_set_file(const char *);
 void asc_log_set_rotate(size_t max_bytes, int keep);
+/* per call site (format string) lines per second, 0 - unlimited */
+void asc_log_set_rate_limit(int lines_per_sec);
 #ifndef _WIN32
 void asc_log_set_syslog(const char *);
 #endif
 
-void asc_log_hup(void);
+typedef struct
+{
+    uint64_t lines;
+    uint64_t dropped;    // log ring is full
+    uint64_t suppressed; // rate limit
+} asc_log_stats_t;
+
+/* starts the writer thread, lines are written in place until that */
+void asc_log_core_init(void);
 void asc_log_core_destroy(void);
+void asc_log_hup(void);
+/* wait for the writer thread to write queued lines out */
+void asc_log_flush(void);
+void asc_log_stats(asc_log_stats_t *stats);
 
 void asc_log_info(const char *, ...) __fmt_printf(1, 2);
 void asc_log_error(const char *, ...) __fmt_printf(1, 2);
 void asc_log_warning(const char *, ...) __fmt_printf(1, 2);
 void asc_log_debug(const char *, ...) __fmt_printf(1, 2);
+/* text as is, not rate limited */
+void asc_log_message(int level, const char *text);
+/* text as is, rate limited per site; the site string is kept until exit (Lua log.*) */
+void asc_log_message_site(int level, const char *site, const char *text);
 
 bool asc_log_is_debug(void) __func_pure;
 
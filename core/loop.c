@@ -0,0 +1,578 @@
+/*
+ * Astra Core
+ * http://cesbo.com/astra
+ *
+ * Copyright (C) 2012-2015, Andrey Dyldin <and@cesbo.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "assert.h"
+#include "clock.h"
+#include "event.h"
+#include "list.h"
+#include "log.h"
+#include "loop.h"
+#include "loopctl.h"
+#include "thread.h"
+#include "timer.h"
+
+#ifndef _WIN32
+#   include <pthread.h>
+#   include <signal.h>
+#   define LOOP_LOCK(_loop) pthread_mutex_lock(&(_loop)->lock)
+#   define LOOP_UNLOCK(_loop) pthread_mutex_unlock(&(_loop)->lock)
+#else
+    /* no data loops: the queue is used by the control loop only */
+#   define LOOP_LOCK(_loop) {}
+#   define LOOP_UNLOCK(_loop) {}
+#endif
+
+#define MSG(_msg) "[core/loop] " _msg
+
+#define LOOP_COUNT_MAX 64
+#define LOOP_WAIT_MAX_MS 1000
+
+typedef struct loop_call_t loop_call_t;
+
+struct loop_call_t
+{
+    loop_call_t *next;
+
+    loop_callback_t callback;
+    void *arg;
+
+    bool is_wait; // on the caller stack, the caller waits for is_done
+    bool is_done;
+};
+
+struct asc_loop_reader_t
+{
+    asc_loop_t *loop;
+    asc_thread_buffer_t *buffer;
+    loop_callback_t on_read;
+    void *arg;
+};
+
+struct asc_loop_t
+{
+    int index;
+    asc_event_core_t *event_core;
+
+#ifndef _WIN32
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+#endif
+
+    bool is_started;
+    int is_running;
+
+    loop_call_t *call_head;
+    loop_call_t *call_tail;
+
+    asc_list_t *reader_list;
+    bool is_changed;
+
+    // written by the loop thread only
+    uint64_t iterations;
+    uint64_t calls;
+    uint32_t readers;
+};
+
+static asc_loop_t loop_control;
+static asc_loop_t *loop_data = NULL;
+static int loop_data_count = 0;
+
+static __thread asc_loop_t *loop_self = NULL;
+
+static void loop_init(asc_loop_t *loop, int index)
+{
+    memset(loop, 0, sizeof(asc_loop_t));
+    loop->index = index;
+    loop->reader_list = asc_list_init();
+
+#ifndef _WIN32
+    pthread_mutex_init(&loop->lock, NULL);
+    pthread_cond_init(&loop->cond, NULL);
+#endif
+}
+
+static bool loop_is_running(asc_loop_t *loop)
+{
+    return __atomic_load_n(&loop->is_running, __ATOMIC_ACQUIRE) != 0;
+}
+
+static void loop_clear(asc_loop_t *loop)
+{
+    loop_call_t *call = loop->call_head;
+    while(call)
+    {
+        loop_call_t *next = call->next;
+        if(!call->is_wait)
+            free(call);
+        call = next;
+    }
+    loop->call_head = NULL;
+    loop->call_tail = NULL;
+
+    for(asc_list_first(loop->reader_list)
+        ; !asc_list_eol(loop->reader_list)
+        ; asc_list_first(loop->reader_list))
+    {
+        asc_loop_reader_t *reader = (asc_loop_reader_t *)asc_list_data(loop->reader_list);
+        asc_log_error(MSG("loop %d: reader %p is not destroyed"), loop->index, (void *)reader);
+        asc_thread_buffer_set_reader(reader->buffer, NULL);
+        free(reader);
+        asc_list_remove_current(loop->reader_list);
+    }
+    asc_list_destroy(loop->reader_list);
+    loop->reader_list = NULL;
+
+#ifndef _WIN32
+    pthread_cond_destroy(&loop->cond);
+    pthread_mutex_destroy(&loop->lock);
+#endif
+}
+
+/*
+ * false - the loop is stopping, the call is not queued.
+ * The stop flag is cleared under the same lock, so a queued call is always
+ * seen by the last loop_run() of the loop thread.
+ */
+static bool loop_push(asc_loop_t *loop, loop_call_t *call)
+{
+    call->next = NULL;
+
+    LOOP_LOCK(loop);
+    if(!loop_is_running(loop))
+    {
+        LOOP_UNLOCK(loop);
+        return false;
+    }
+    if(loop->call_tail)
+        loop->call_tail->next = call;
+    else
+        __atomic_store_n(&loop->call_head, call, __ATOMIC_RELEASE);
+    loop->call_tail = call;
+
+    // under the lock: the loop thread releases its event core under it too
+    asc_event_core_notify(loop->event_core);
+    LOOP_UNLOCK(loop);
+
+    return true;
+}
+
+static void loop_run(asc_loop_t *loop)
+{
+    // lock-free check, the queue is empty almost always
+    if(__atomic_load_n(&loop->call_head, __ATOMIC_ACQUIRE))
+    {
+        LOOP_LOCK(loop);
+        loop_call_t *call = loop->call_head;
+        loop->call_head = NULL;
+        loop->call_tail = NULL;
+        LOOP_UNLOCK(loop);
+
+        is_main_loop_idle = false;
+
+        while(call)
+        {
+            loop_call_t *next = call->next;
+            call->callback(call->arg);
+            __atomic_store_n(&loop->calls, loop->calls + 1, __ATOMIC_RELAXED);
+
+            if(call->is_wait)
+            {
+                // the call is released by the caller as soon as is_done is set
+                LOOP_LOCK(loop);
+                call->is_done = true;
+#ifndef _WIN32
+                pthread_cond_broadcast(&loop->cond);
+#endif
+                LOOP_UNLOCK(loop);
+            }
+            else
+                free(call);
+
+            call = next;
+        }
+    }
+
+    loop->is_changed = false;
+    asc_list_for(loop->reader_list)
+    {
+        asc_loop_reader_t *reader = (asc_loop_reader_t *)asc_list_data(loop->reader_list);
+        if(asc_thread_buffer_count(reader->buffer) > 0)
+        {
+            is_main_loop_idle = false;
+            reader->on_read(reader->arg);
+            if(loop->is_changed)
+                break;
+        }
+    }
+}
+
+/*
+ *   oooooooo8   ooooooo  oooo   oooo ooooooooooo oooooooooo    ooooooo  ooooo
+ * o888     88 o888   888o 8888o  88  88  888  88  888    888 o888   888o 888
+ * 888         888     888 88 888o88      888      888oooo88  888     888 888
+ * 888o     oo 888o   o888 88   8888      888      888  88o   888o   o888 888      o
+ *  888oooo88    88ooo88  o88o    88     o888o    o888o  88o8   88ooo88  o888ooooo88
+ *
+ */
+
+void asc_loop_core_init(void)
+{
+    loop_init(&loop_control, 0);
+    loop_control.event_core = asc_event_core_self();
+#ifndef _WIN32
+    loop_control.thread = pthread_self();
+#endif
+    loop_control.is_started = true;
+    loop_control.is_running = 1;
+
+    loop_self = &loop_control;
+}
+
+void asc_loop_core_loop(void)
+{
+    loop_run(&loop_control);
+    __atomic_store_n(&loop_control.iterations, loop_control.iterations + 1, __ATOMIC_RELAXED);
+}
+
+/*
+ * ooooooooo      o   ooooooooooo   o
+ *  888    88o   888  88  888  88  888
+ *  888    888  8  88     888     8  88
+ *  888    888 8oooo88    888    8oooo88
+ * o888ooo88 o88o  o888o o888o o88o  o888o
+ *
+ */
+
+#ifndef _WIN32
+
+static int loop_wait_ms(void)
+{
+    const uint64_t timer_shot = asc_timer_core_next_shot();
+    if(timer_shot == 0)
+        return LOOP_WAIT_MAX_MS;
+
+    const uint64_t now = asc_utime();
+    if(timer_shot <= now)
+        return 0;
+
+    // round up: timers are fired only when the deadline is reached
+    const uint64_t wait_ms = (timer_shot - now + 999) / 1000;
+    return (wait_ms > LOOP_WAIT_MAX_MS) ? LOOP_WAIT_MAX_MS : (int)wait_ms;
+}
+
+static void * loop_thread(void *arg)
+{
+    asc_loop_t *loop = (asc_loop_t *)arg;
+    loop_self = loop;
+
+    asc_thread_core_init();
+    asc_timer_core_init();
+    asc_event_core_init();
+
+    LOOP_LOCK(loop);
+    loop->event_core = asc_event_core_self();
+    loop->is_started = true;
+    pthread_cond_broadcast(&loop->cond);
+    LOOP_UNLOCK(loop);
+
+    int wait_ms = 0;
+    while(loop_is_running(loop))
+    {
+        is_main_loop_idle = true;
+
+        asc_event_core_wait(wait_ms);
+        asc_timer_core_loop();
+        asc_thread_core_loop();
+        loop_run(loop);
+
+        __atomic_store_n(&loop->iterations, loop->iterations + 1, __ATOMIC_RELAXED);
+        wait_ms = (is_main_loop_idle) ? loop_wait_ms() : 0;
+    }
+
+    // calls queued before the stop request
+    loop_run(loop);
+
+    LOOP_LOCK(loop);
+    loop->event_core = NULL;
+    LOOP_UNLOCK(loop);
+
+    asc_event_core_destroy();
+    asc_timer_core_destroy();
+    asc_thread_core_destroy();
+
+    return NULL;
+}
+
+bool asc_loop_core_start(int count)
+{
+    if(count <= 0)
+        return false;
+
+    if(loop_data)
+    {
+        if(count != loop_data_count)
+        {
+            asc_log_warning(MSG("%d data loops are running, restart required to change it")
+                            , loop_data_count);
+        }
+        return (count == loop_data_count);
+    }
+
+    if(count > LOOP_COUNT_MAX)
+        count = LOOP_COUNT_MAX;
+
+    loop_data = (asc_loop_t *)calloc(count, sizeof(asc_loop_t));
+    asc_assert(loop_data != NULL, MSG("calloc() failed"));
+
+    // signals are handled by the main thread only
+    sigset_t sig_all;
+    sigset_t sig_prev;
+    sigfillset(&sig_all);
+    pthread_sigmask(SIG_SETMASK, &sig_all, &sig_prev);
+
+    for(int i = 0; i < count; ++i)
+    {
+        asc_loop_t *loop = &loop_data[i];
+        loop_init(loop, i + 1);
+        loop->is_running = 1;
+
+        const int ret = pthread_create(&loop->thread, NULL, loop_thread, loop);
+        asc_assert(ret == 0, MSG("failed to start data loop [%s]"), strerror(ret));
+    }
+
+    pthread_sigmask(SIG_SETMASK, &sig_prev, NULL);
+
+    for(int i = 0; i < count; ++i)
+    {
+        asc_loop_t *loop = &loop_data[i];
+        LOOP_LOCK(loop);
+        while(!loop->is_started)
+            pthread_cond_wait(&loop->cond, &loop->lock);
+        LOOP_UNLOCK(loop);
+    }
+
+    loop_data_count = count;
+    asc_log_info(MSG("started %d data loops"), count);
+
+    return true;
+}
+
+static void loop_data_destroy(void)
+{
+    for(int i = 0; i < loop_data_count; ++i)
+    {
+        asc_loop_t *loop = &loop_data[i];
+        LOOP_LOCK(loop);
+        __atomic_store_n(&loop->is_running, 0, __ATOMIC_RELEASE);
+        asc_event_core_notify(loop->event_core);
+        LOOP_UNLOCK(loop);
+        pthread_join(loop->thread, NULL);
+    }
+
+    // the loops still running above may have taken the lock of a stopped one
+    for(int i = 0; i < loop_data_count; ++i)
+        loop_clear(&loop_data[i]);
+
+    free(loop_data);
+    loop_data = NULL;
+    loop_data_count = 0;
+}
+
+#else /* _WIN32 */
+
+bool asc_loop_core_start(int count)
+{
+    if(count > 0)
+        asc_log_warning(MSG("data loops are not supported on this platform"));
+    return false;
+}
+
+static void loop_data_destroy(void)
+{
+    ;
+}
+
+#endif /* !_WIN32 */
+
+void asc_loop_core_destroy(void)
+{
+    loop_data_destroy();
+
+    LOOP_LOCK(&loop_control);
+    __atomic_store_n(&loop_control.is_running, 0, __ATOMIC_RELEASE);
+    LOOP_UNLOCK(&loop_control);
+    loop_clear(&loop_control);
+    loop_self = NULL;
+}
+
+int asc_loop_core_count(void)
+{
+    return loop_data_count;
+}
+
+/*
+ *      o      oooooooooo ooooo
+ *     888      888    888 888
+ *    8  88     888oooo88  888
+ *   8oooo88    888        888
+ * o88o  o888o o888o      o888o
+ *
+ */
+
+asc_loop_t * asc_loop_get(int index)
+{
+    if(index == 0)
+        return &loop_control;
+    if(index < 0 || index > loop_data_count)
+        return NULL;
+    return &loop_data[index - 1];
+}
+
+asc_loop_t * asc_loop_self(void)
+{
+    return loop_self;
+}
+
+int asc_loop_index(const asc_loop_t *loop)
+{
+    return (loop) ? loop->index : 0;
+}
+
+bool asc_loop_is_self(const asc_loop_t *loop)
+{
+    if(!loop)
+        loop = &loop_control;
+    return (loop == loop_self);
+}
+
+void asc_loop_stats(const asc_loop_t *loop, asc_loop_stats_t *stats)
+{
+    if(!loop)
+        loop = &loop_control;
+
+    memset(stats, 0, sizeof(asc_loop_stats_t));
+    stats->iterations = __atomic_load_n(&loop->iterations, __ATOMIC_RELAXED);
+    stats->calls = __atomic_load_n(&loop->calls, __ATOMIC_RELAXED);
+    stats->readers = __atomic_load_n(&loop->readers, __ATOMIC_RELAXED);
+
+#ifdef __linux__
+    clockid_t cid;
+    struct timespec ts;
+    if(loop->is_started
+       && pthread_getcpuclockid(loop->thread, &cid) == 0
+       && clock_gettime(cid, &ts) == 0)
+    {
+        stats->cpu_us = (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+    }
+#endif
+}
+
+void asc_loop_call(asc_loop_t *loop, loop_callback_t callback, void *arg)
+{
+    if(!loop)
+        loop = &loop_control;
+
+    if(loop_is_running(loop))
+    {
+        loop_call_t *call = (loop_call_t *)calloc(1, sizeof(loop_call_t));
+        asc_assert(call != NULL, MSG("calloc() failed"));
+        call->callback = callback;
+        call->arg = arg;
+        if(loop_push(loop, call))
+            return;
+        free(call);
+    }
+
+    // stopped data loop: its objects are owned by the caller now
+    callback(arg);
+}
+
+void asc_loop_call_wait(asc_loop_t *loop, loop_callback_t callback, void *arg)
+{
+    if(!loop)
+        loop = &loop_control;
+
+    if(loop == loop_self || !loop_is_running(loop))
+    {
+        callback(arg);
+        return;
+    }
+
+    asc_assert(loop_self == NULL || loop_self->index == 0
+               , MSG("loop %d: data loops should not wait for other loops")
+               , loop_self->index);
+
+#ifndef _WIN32
+    loop_call_t call;
+    memset(&call, 0, sizeof(call));
+    call.callback = callback;
+    call.arg = arg;
+    call.is_wait = true;
+    if(!loop_push(loop, &call))
+    {
+        callback(arg);
+        return;
+    }
+
+    LOOP_LOCK(loop);
+    while(!call.is_done)
+        pthread_cond_wait(&loop->cond, &loop->lock);
+    LOOP_UNLOCK(loop);
+#endif
+}
+
+asc_loop_reader_t * asc_loop_reader_init(  asc_thread_buffer_t *buffer
+                                         , loop_callback_t on_read, void *arg)
+{
+    asc_loop_t *loop = loop_self;
+    asc_assert(loop != NULL, MSG("reader should be created on a loop thread"));
+
+    asc_loop_reader_t *reader = (asc_loop_reader_t *)calloc(1, sizeof(asc_loop_reader_t));
+    reader->loop = loop;
+    reader->buffer = buffer;
+    reader->on_read = on_read;
+    reader->arg = arg;
+
+    asc_list_insert_tail(loop->reader_list, reader);
+    loop->is_changed = true;
+    __atomic_store_n(&loop->readers, loop->readers + 1, __ATOMIC_RELAXED);
+
+    asc_thread_buffer_set_reader(buffer, loop->event_core);
+
+    return reader;
+}
+
+void asc_loop_reader_destroy(asc_loop_reader_t *reader)
+{
+    if(!reader)
+        return;
+
+    asc_loop_t *loop = reader->loop;
+    asc_assert(loop == loop_self, MSG("reader should be destroyed on its loop"));
+
+    asc_thread_buffer_set_reader(reader->buffer, NULL);
+
+    asc_list_remove_item(loop->reader_list, reader);
+    loop->is_changed = true;
+    __atomic_store_n(&loop->readers, loop->readers - 1, __ATOMIC_RELAXED);
+
+    free(reader);
+}
@@ -0,0 +1,76 @@
+/*
+ * Astra Core
+ * http://cesbo.com/astra
+ *
+ * Copyright (C) 2012-2015, Andrey Dyldin <and@cesbo.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _ASC_LOOP_H_
+#define _ASC_LOOP_H_ 1
+
+#include "base.h"
+#include "thread.h"
+
+/*
+ * Control loop: the main thread with Lua.
+ * Data loops: N threads, each one with its own event, timer and thread
+ * observers. Objects of a data loop (sockets, timers, stream dispatch)
+ * are touched only by the loop thread, other threads talk to the loop
+ * through its call queue.
+ */
+
+typedef struct asc_loop_t asc_loop_t;
+typedef struct asc_loop_reader_t asc_loop_reader_t;
+typedef void (*loop_callback_t)(void *);
+
+typedef struct
+{
+    uint64_t iterations;
+    uint64_t calls;
+    uint64_t cpu_us; // 0 if not available on this platform
+    uint32_t readers;
+} asc_loop_stats_t;
+
+void asc_loop_core_init(void);
+void asc_loop_core_loop(void);
+void asc_loop_core_destroy(void);
+
+/* start data loops, once per run. false if not supported or already started */
+bool asc_loop_core_start(int count);
+int asc_loop_core_count(void) __wur;
+
+/* 0 - control loop, 1..count - data loops, NULL if out of range */
+asc_loop_t * asc_loop_get(int index) __wur;
+asc_loop_t * asc_loop_self(void) __wur;
+int asc_loop_index(const asc_loop_t *loop) __wur;
+bool asc_loop_is_self(const asc_loop_t *loop) __wur;
+void asc_loop_stats(const asc_loop_t *loop, asc_loop_stats_t *stats);
+
+/*
+ * NULL loop is the control loop.
+ * asc_loop_call() queues the callback and returns.
+ * asc_loop_call_wait() returns when the callback is done, runs it in place
+ * when called on the loop itself. Data loops never wait for other loops.
+ */
+void asc_loop_call(asc_loop_t *loop, loop_callback_t callback, void *arg);
+void asc_loop_call_wait(asc_loop_t *loop, loop_callback_t callback, void *arg);
+
+/* on_read is called by the caller's loop while the buffer is not empty */
+asc_loop_reader_t * asc_loop_reader_init(  asc_thread_buffer_t *buffer
+                                         , loop_callback_t on_read, void *arg) __wur;
+void asc_loop_reader_destroy(asc_loop_reader_t *reader);
+
+#endif /* _ASC_LOOP_H_ */
@@ -23,7 +23,7 @@
 #include "log.h"
 
 jmp_buf main_loop;
-bool is_main_loop_idle = true;
+__thread bool is_main_loop_idle = true;
 
 #ifdef WITH_LUA
 lua_State *lua = NULL;
@@ -61,6 +61,7 @@ void astra_abort(void)
     }
 #endif /* WITH_LUA */
 
+    asc_log_flush();
     abort();
 }
 
@@ -25,7 +25,8 @@
 #include "base.h"
 
 extern jmp_buf main_loop;
-extern bool is_main_loop_idle;
+/* per-thread: each loop (main and data loops) tracks its own idle state */
+extern __thread bool is_main_loop_idle;
 
 #ifdef WITH_LUA
 extern lua_State *lua;
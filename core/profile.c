@@ -0,0 +1,336 @@
+/*
+ * Astra Core
+ * http://cesbo.com/astra
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "profile.h"
+#include "clock.h"
+#include "log.h"
+
+#define MSG(_msg) "[core/profile] " _msg
+
+/*
+ * Owner table: open addressing, keys and values are separate words.
+ * Each owner is looked up only by its own loop, other loops may probe
+ * through its slot, so keys and values are atomic.
+ */
+
+#define PROFILE_OWNERS_SIZE 16384
+#define PROFILE_OWNER_FREE ((const void *)0)
+#define PROFILE_OWNER_DELETED ((const void *)1)
+
+#define PROFILE_SAMPLE_DEFAULT 8
+
+bool asc_profile_enabled = false;
+
+static unsigned int profile_sample = PROFILE_SAMPLE_DEFAULT;
+static uint32_t profile_epoch = 0;
+
+static const void *profile_keys[PROFILE_OWNERS_SIZE];
+static asc_profile_t *profile_values[PROFILE_OWNERS_SIZE];
+
+typedef struct
+{
+    uint32_t depth;
+    uint32_t counter;
+    bool is_timed;
+    uint64_t nested; // time of the profiled callbacks nested in the current one
+} profile_thread_t;
+
+static __thread profile_thread_t profile_thread;
+
+/*
+ * Clock of the frames: TSC on x86 (constant rate on all CPUs of the last
+ * decade), converted to nanoseconds on read by the rate measured since
+ * enable. CLOCK_MONOTONIC elsewhere
+ */
+
+#if defined(__x86_64__) || defined(__i386__)
+#   define PROFILE_TSC 1
+#endif
+
+static inline uint64_t profile_clock_ns(void)
+{
+#ifdef HAVE_CLOCK_GETTIME
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000) + (uint64_t)ts.tv_nsec;
+#else
+    return asc_utime() * 1000;
+#endif
+}
+
+static inline uint64_t profile_now(void)
+{
+#ifdef PROFILE_TSC
+    uint32_t lo, hi;
+    __asm__ __volatile__("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+#else
+    return profile_clock_ns();
+#endif
+}
+
+static uint64_t profile_start_ns = 0;
+static uint64_t profile_start_ticks = 0;
+
+/* ticks to nanoseconds, rate since enable */
+static uint64_t profile_ticks_ns(uint64_t ticks)
+{
+#ifdef PROFILE_TSC
+    const uint64_t ns = profile_clock_ns() - __atomic_load_n(&profile_start_ns, __ATOMIC_RELAXED);
+    const uint64_t total = profile_now() - __atomic_load_n(&profile_start_ticks, __ATOMIC_RELAXED);
+    if(!ns || !total)
+        return 0;
+    return (uint64_t)((double)ticks * (double)ns / (double)total);
+#else
+    return ticks;
+#endif
+}
+
+static inline size_t profile_hash(const void *owner)
+{
+    uintptr_t x = (uintptr_t)owner;
+    x ^= x >> 17;
+    x *= 0x9E3779B1U;
+    return (size_t)(x ^ (x >> 15)) % PROFILE_OWNERS_SIZE;
+}
+
+/*
+ *   oooooooo8  ooooooooooo ooooooooooo
+ *  888          888    88  88  888  88
+ *   888oooooo   888ooo8        888
+ *          888  888    oo      888
+ *  o88oooo888  o888ooo8888    o888o
+ *
+ */
+
+void asc_profile_set(bool enabled, unsigned int sample)
+{
+    if(sample == 0)
+        sample = PROFILE_SAMPLE_DEFAULT;
+    __atomic_store_n(&profile_sample, sample, __ATOMIC_RELAXED);
+
+    if(enabled && !asc_profile_enabled)
+    {
+        // counters of the previous run are cleared by the owner's loop
+        __atomic_add_fetch(&profile_epoch, 1, __ATOMIC_RELAXED);
+        __atomic_store_n(&profile_start_ns, profile_clock_ns(), __ATOMIC_RELAXED);
+        __atomic_store_n(&profile_start_ticks, profile_now(), __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&asc_profile_enabled, enabled, __ATOMIC_RELAXED);
+}
+
+unsigned int asc_profile_sample(void)
+{
+    return __atomic_load_n(&profile_sample, __ATOMIC_RELAXED);
+}
+
+uint64_t asc_profile_elapsed(void)
+{
+    if(!__atomic_load_n(&asc_profile_enabled, __ATOMIC_RELAXED))
+        return 0;
+    return (profile_clock_ns() - __atomic_load_n(&profile_start_ns, __ATOMIC_RELAXED)) / 1000;
+}
+
+/*
+ *   ooooooo  oooo     oooo oooo   oooo ooooooooooo oooooooooo
+ * o888   888o 88   88  88   8888o  88   888    88   888    888
+ * 888     888  88 888 88    88 888o88   888ooo8     888oooo88
+ * 888o   o888   888 888     88   8888   888    oo   888  88o
+ *   88ooo88      8   8     o88o    88  o888ooo8888 o888o  88o8
+ *
+ */
+
+bool asc_profile_register(const void *owner, asc_profile_t *profile)
+{
+    size_t index = profile_hash(owner);
+    for(size_t i = 0; i < PROFILE_OWNERS_SIZE; ++i)
+    {
+        const void *key = __atomic_load_n(&profile_keys[index], __ATOMIC_ACQUIRE);
+        if(key == PROFILE_OWNER_FREE || key == PROFILE_OWNER_DELETED)
+        {
+            __atomic_store_n(&profile_values[index], profile, __ATOMIC_RELAXED);
+            if(__atomic_compare_exchange_n(&profile_keys[index], &key, owner
+                                           , false, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+            {
+                return true;
+            }
+            continue;
+        }
+        index = (index + 1) % PROFILE_OWNERS_SIZE;
+    }
+
+    static bool is_warned = false;
+    if(!is_warned)
+    {
+        is_warned = true;
+        asc_log_warning(MSG("owner table is full, callbacks are not accounted"));
+    }
+    return false;
+}
+
+static size_t profile_find(const void *owner)
+{
+    size_t index = profile_hash(owner);
+    for(size_t i = 0; i < PROFILE_OWNERS_SIZE; ++i)
+    {
+        const void *key = __atomic_load_n(&profile_keys[index], __ATOMIC_ACQUIRE);
+        if(key == owner)
+            return index;
+        if(key == PROFILE_OWNER_FREE)
+            break;
+        index = (index + 1) % PROFILE_OWNERS_SIZE;
+    }
+    return PROFILE_OWNERS_SIZE;
+}
+
+void asc_profile_unregister(const void *owner)
+{
+    const size_t index = profile_find(owner);
+    if(index == PROFILE_OWNERS_SIZE)
+        return;
+
+    __atomic_store_n(&profile_values[index], NULL, __ATOMIC_RELAXED);
+    __atomic_store_n(&profile_keys[index], PROFILE_OWNER_DELETED, __ATOMIC_RELEASE);
+}
+
+/*
+ *   oooooooo8   ooooooo  ooooo  oooo oooo   oooo ooooooooooo
+ * o888     88 o888   888o 888    88   8888o  88  88  888  88
+ * 888         888     888 888    88   88 888o88      888
+ * 888o     oo 888o   o888 888    88   88   8888      888
+ *  888oooo88    88ooo88    888oo88   o88o    88     o888o
+ *
+ */
+
+static inline void profile_store(uint64_t *counter, uint64_t value)
+{
+    __atomic_store_n(counter, value, __ATOMIC_RELAXED);
+}
+
+static void profile_add(asc_profile_t *profile, uint64_t calls, uint64_t packets, uint64_t ns)
+{
+    // single writer: the owner's loop
+    const uint32_t epoch = __atomic_load_n(&profile_epoch, __ATOMIC_RELAXED);
+    if(profile->epoch != epoch)
+    {
+        profile_store(&profile->calls, 0);
+        profile_store(&profile->packets, 0);
+        profile_store(&profile->cpu_ns, 0);
+        profile_store(&profile->max_ns, 0);
+        __atomic_store_n(&profile->epoch, epoch, __ATOMIC_RELEASE);
+    }
+
+    profile_store(&profile->calls, profile->calls + calls);
+    if(packets)
+        profile_store(&profile->packets, profile->packets + packets);
+    if(ns)
+    {
+        profile_store(&profile->cpu_ns, profile->cpu_ns + ns * asc_profile_sample());
+        if(ns > profile->max_ns)
+            profile_store(&profile->max_ns, ns);
+    }
+}
+
+void asc_profile_read(const asc_profile_t *profile, asc_profile_t *result)
+{
+    const uint32_t epoch = __atomic_load_n(&profile_epoch, __ATOMIC_RELAXED);
+    result->epoch = __atomic_load_n(&profile->epoch, __ATOMIC_ACQUIRE);
+    if(result->epoch != epoch)
+    {
+        // not written since enable
+        result->calls = 0;
+        result->packets = 0;
+        result->cpu_ns = 0;
+        result->max_ns = 0;
+        return;
+    }
+
+    result->calls = __atomic_load_n(&profile->calls, __ATOMIC_RELAXED);
+    result->packets = __atomic_load_n(&profile->packets, __ATOMIC_RELAXED);
+    result->cpu_ns = profile_ticks_ns(__atomic_load_n(&profile->cpu_ns, __ATOMIC_RELAXED));
+    result->max_ns = profile_ticks_ns(__atomic_load_n(&profile->max_ns, __ATOMIC_RELAXED));
+}
+
+void asc_profile_enter(asc_profile_frame_t *frame)
+{
+    profile_thread_t *const t = &profile_thread;
+    if(t->depth++ == 0)
+    {
+        // the sampling decision is made by the outermost callback
+        if(++t->counter >= asc_profile_sample())
+        {
+            t->counter = 0;
+            t->is_timed = true;
+        }
+        else
+            t->is_timed = false;
+    }
+
+    frame->is_timed = t->is_timed;
+    if(frame->is_timed)
+    {
+        frame->nested = t->nested;
+        t->nested = 0;
+        frame->start = profile_now();
+    }
+}
+
+static uint64_t profile_leave(asc_profile_frame_t *frame)
+{
+    profile_thread_t *const t = &profile_thread;
+    --t->depth;
+    if(!frame->is_timed)
+        return 0;
+
+    const uint64_t elapsed = profile_now() - frame->start;
+    const uint64_t self = (elapsed > t->nested) ? elapsed - t->nested : 0;
+    t->nested = frame->nested + elapsed;
+
+    // 0 is "not timed"
+    return (self > 0) ? self : 1;
+}
+
+void asc_profile_leave(asc_profile_frame_t *frame, asc_profile_t *profile, size_t packets)
+{
+    const uint64_t ns = profile_leave(frame);
+    if(profile)
+        profile_add(profile, 1, packets, ns);
+}
+
+void asc_profile_leave_owner(asc_profile_frame_t *frame, const void *owner)
+{
+    const uint64_t ns = profile_leave(frame);
+    if(!ns)
+        return;
+
+    // event and timer calls are counted by samples
+    const size_t index = profile_find(owner);
+    if(index == PROFILE_OWNERS_SIZE)
+        return;
+    asc_profile_t *const profile = __atomic_load_n(&profile_values[index], __ATOMIC_RELAXED);
+    if(profile)
+        profile_add(profile, asc_profile_sample(), 0, ns);
+}
+
+void asc_profile_call(void (*callback)(void *), void *arg)
+{
+    asc_profile_frame_t frame;
+    asc_profile_enter(&frame);
+    callback(arg);
+    asc_profile_leave_owner(&frame, arg);
+}
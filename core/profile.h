@@ -0,0 +1,75 @@
+/*
+ * Astra Core
+ * http://cesbo.com/astra
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _ASC_PROFILE_H_
+#define _ASC_PROFILE_H_ 1
+
+#include "base.h"
+
+/*
+ * Callback profiler, disabled by default.
+ * CPU time of event, timer and stream callbacks is attributed to the owner
+ * of the callback argument (module instance). Time is self time: nested
+ * profiled callbacks are subtracted from the caller.
+ * One of `sample` outermost callbacks of the thread is timed together with
+ * everything nested in it, cpu_ns is scaled back by the sample rate.
+ */
+
+typedef struct
+{
+    uint64_t calls;
+    uint64_t packets;
+    uint64_t cpu_ns; // clock ticks in the counters, asc_profile_read() converts
+    uint64_t max_ns;
+    uint32_t epoch; // counters are cleared on the first write after enable
+} asc_profile_t;
+
+typedef struct
+{
+    uint64_t start;
+    uint64_t nested;
+    bool is_timed;
+} asc_profile_frame_t;
+
+extern bool asc_profile_enabled;
+
+void asc_profile_set(bool enabled, unsigned int sample);
+unsigned int asc_profile_sample(void) __wur;
+/* microseconds since the profiler was enabled, 0 if disabled */
+uint64_t asc_profile_elapsed(void) __wur;
+
+/*
+ * owner table: counters of the event and timer callbacks, looked up by
+ * the callback argument. register on the control loop, unregister on
+ * the owner's loop. event and timer calls are estimated from samples
+ */
+bool asc_profile_register(const void *owner, asc_profile_t *profile);
+void asc_profile_unregister(const void *owner);
+
+/* counters are written by the owner's loop, read by any thread */
+void asc_profile_read(const asc_profile_t *profile, asc_profile_t *result);
+
+/* every enter has a leave, NULL profile - the owner is gone */
+void asc_profile_enter(asc_profile_frame_t *frame);
+void asc_profile_leave(asc_profile_frame_t *frame, asc_profile_t *profile, size_t packets);
+void asc_profile_leave_owner(asc_profile_frame_t *frame, const void *owner);
+
+/* callback(arg) in a frame of the arg owner, used if asc_profile_enabled */
+void asc_profile_call(void (*callback)(void *), void *arg);
+
+#endif /* _ASC_PROFILE_H_ */
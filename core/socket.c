@@ -22,6 +22,7 @@
 #include "socket.h"
 #include "event.h"
 #include "log.h"
+#include "profile.h"
 
 #ifdef _WIN32
 #   include <ws2tcpip.h>
@@ -94,7 +95,7 @@ void asc_socket_core_destroy(void)
 
 const char * asc_socket_error(void)
 {
-    static char buffer[1024];
+    static __thread char buffer[1024];
 
 #ifdef _WIN32
     const int err = WSAGetLastError();
@@ -151,6 +152,29 @@ asc_socket_t * asc_socket_open_udp4(void * arg)
     return __socket_open(PF_INET, SOCK_DGRAM, IPPROTO_UDP, arg);
 }
 
+asc_socket_t * asc_socket_dup(asc_socket_t *sock, void * arg)
+{
+#ifdef _WIN32
+    __uarg(sock);
+    __uarg(arg);
+    return NULL;
+#else
+    const int fd = dup(sock->fd);
+    if(fd == -1)
+        return NULL;
+
+    asc_socket_t *dup_sock = (asc_socket_t *)calloc(1, sizeof(asc_socket_t));
+    dup_sock->fd = fd;
+    dup_sock->mreq.imr_multiaddr.s_addr = INADDR_NONE;
+    dup_sock->family = sock->family;
+    dup_sock->type = sock->type;
+    dup_sock->protocol = sock->protocol;
+    dup_sock->addr = sock->addr;
+    dup_sock->arg = arg;
+    return dup_sock;
+#endif
+}
+
 asc_socket_t * asc_socket_open_sctp4(void * arg)
 {
 #ifndef IPPROTO_SCTP
@@ -216,11 +240,20 @@ void asc_socket_close(asc_socket_t *sock)
  *
  */
 
+/* the event argument is the socket, the profiler owner is the socket argument */
+static inline void __asc_socket_callback(event_callback_t callback, void *arg)
+{
+    if(asc_profile_enabled)
+        asc_profile_call(callback, arg);
+    else
+        callback(arg);
+}
+
 static void __asc_socket_on_close(void *arg)
 {
     asc_socket_t *sock = (asc_socket_t *)arg;
     if(sock->on_close)
-        sock->on_close(sock->arg);
+        __asc_socket_callback(sock->on_close, sock->arg);
 }
 
 static void __asc_socket_on_connect(void *arg)
@@ -228,7 +261,7 @@ static void __asc_socket_on_connect(void *arg)
     asc_socket_t *sock = (asc_socket_t *)arg;
     asc_event_set_on_write(sock->event, NULL);
     event_callback_t __on_ready = sock->on_ready;
-    sock->on_ready(sock->arg);
+    __asc_socket_callback(sock->on_ready, sock->arg);
     if(__on_ready == sock->on_ready)
         sock->on_ready = NULL;
 }
@@ -236,21 +269,21 @@ static void __asc_socket_on_connect(void *arg)
 static void __asc_socket_on_accept(void *arg)
 {
     asc_socket_t *sock = (asc_socket_t *)arg;
-    sock->on_read(sock->arg);
+    __asc_socket_callback(sock->on_read, sock->arg);
 }
 
 static void __asc_socket_on_read(void *arg)
 {
     asc_socket_t *sock = (asc_socket_t *)arg;
     if(sock->on_read)
-        sock->on_read(sock->arg);
+        __asc_socket_callback(sock->on_read, sock->arg);
 }
 
 static void __asc_socket_on_ready(void *arg)
 {
     asc_socket_t *sock = (asc_socket_t *)arg;
     if(sock->on_ready)
-        sock->on_ready(sock->arg);
+        __asc_socket_callback(sock->on_ready, sock->arg);
 }
 
 static bool __asc_socket_check_event(asc_socket_t *sock)
@@ -556,6 +589,20 @@ ssize_t asc_socket_send(asc_socket_t *sock, const void *buffer, size_t size)
     return ret;
 }
 
+ssize_t asc_socket_sendv(asc_socket_t *sock, const struct iovec *iov, int count)
+{
+#ifdef _WIN32
+    if(count <= 0)
+        return 0;
+    return asc_socket_send(sock, iov[0].iov_base, iov[0].iov_len);
+#else
+    const ssize_t ret = writev(sock->fd, iov, count);
+    if(ret == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        return 0;
+    return ret;
+#endif
+}
+
 ssize_t asc_socket_sendto(asc_socket_t *sock, const void *buffer, size_t size)
 {
     const socklen_t slen = sizeof(struct sockaddr_in);
@@ -653,6 +700,17 @@ void asc_socket_set_reuseaddr(asc_socket_t *sock, int is_on)
     setsockopt(sock->fd, SOL_SOCKET, SO_REUSEADDR, (void *)&is_on, sizeof(is_on));
 }
 
+bool asc_socket_set_reuseport(asc_socket_t *sock, int is_on)
+{
+#ifdef SO_REUSEPORT
+    return setsockopt(sock->fd, SOL_SOCKET, SO_REUSEPORT, (void *)&is_on, sizeof(is_on)) == 0;
+#else
+    __uarg(sock);
+    __uarg(is_on);
+    return false;
+#endif
+}
+
 void asc_socket_set_non_delay(asc_socket_t *sock, int is_on)
 {
     switch(sock->protocol)
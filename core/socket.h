@@ -24,6 +24,16 @@
 #include "base.h"
 #include "event.h"
 
+#ifndef _WIN32
+#   include <sys/uio.h>
+#else
+struct iovec
+{
+    void *iov_base;
+    size_t iov_len;
+};
+#endif
+
 typedef struct asc_socket_t asc_socket_t;
 
 void asc_socket_core_init(void);
@@ -34,6 +44,8 @@ const char * asc_socket_error(void);
 asc_socket_t * asc_socket_open_tcp4(void * arg) __wur;
 asc_socket_t * asc_socket_open_udp4(void * arg) __wur;
 asc_socket_t * asc_socket_open_sctp4(void * arg) __wur;
+/* the same connection on a new descriptor, NULL on error or _WIN32 */
+asc_socket_t * asc_socket_dup(asc_socket_t *sock, void * arg) __wur;
 
 void asc_socket_set_on_read(asc_socket_t * sock, event_callback_t on_read);
 void asc_socket_set_on_close(asc_socket_t * sock, event_callback_t on_close);
@@ -56,6 +68,8 @@ ssize_t asc_socket_recvfrom(asc_socket_t *sock, void *buffer, size_t size) __wur
 
 ssize_t asc_socket_send(asc_socket_t *sock, const void *buffer, size_t size) __wur;
 ssize_t asc_socket_sendto(asc_socket_t *sock, const void *buffer, size_t size) __wur;
+/* gathered send, 0 on EAGAIN like asc_socket_send(). _WIN32: the first buffer only */
+ssize_t asc_socket_sendv(asc_socket_t *sock, const struct iovec *iov, int count) __wur;
 
 int asc_socket_fd(asc_socket_t *sock) __wur;
 const char * asc_socket_addr(asc_socket_t *sock) __wur;
@@ -66,6 +80,8 @@ int asc_socket_recv_port(asc_socket_t *sock) __wur;
 void asc_socket_set_nonblock(asc_socket_t *sock, bool is_nonblock);
 void asc_socket_set_sockaddr(asc_socket_t *sock, const char *addr, int port);
 void asc_socket_set_reuseaddr(asc_socket_t *sock, int is_on);
+/* false if SO_REUSEPORT is not available */
+bool asc_socket_set_reuseport(asc_socket_t *sock, int is_on);
 void asc_socket_set_non_delay(asc_socket_t *sock, int is_on);
 void asc_socket_set_keep_alive(asc_socket_t *sock, int is_on);
 void asc_socket_set_broadcast(asc_socket_t *sock, int is_on);
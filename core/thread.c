@@ -19,6 +19,7 @@
  */
 
 #include "assert.h"
+#include "event.h"
 #include "thread.h"
 #include "list.h"
 #include "log.h"
@@ -32,19 +33,40 @@
 
 #define MSG(_msg) "[core/thread] " _msg
 
+/*
+ * single producer / single consumer ring.
+ * head is written only by the writer, tail only by the reader,
+ * both are free-running byte positions (offset = position % size).
+ * each side keeps a private copy of the other index and reloads it
+ * only when the cached value is not enough.
+ */
+
+#define THREAD_BUFFER_CACHE_LINE 64
+
 struct asc_thread_buffer_t
 {
     uint8_t *buffer;
-    size_t size;
-    size_t read;
-    size_t write;
-    size_t count;
+    uint64_t size;
 
-#ifdef _WIN32
-    HANDLE mutex;
-#else
-    pthread_mutex_t mutex;
-#endif
+    asc_event_core_t *reader; // wake up the reader loop on write
+
+    uint8_t __pad_w[THREAD_BUFFER_CACHE_LINE];
+
+    // writer
+    uint64_t head;
+    uint64_t tail_cache;
+
+    uint8_t __pad_r[THREAD_BUFFER_CACHE_LINE];
+
+    // reader
+    uint64_t tail;
+    uint64_t head_cache;
+
+    uint8_t __pad_f[THREAD_BUFFER_CACHE_LINE];
+
+    // flush request, applied by the reader
+    uint64_t flush_head;
+    int flush_request;
 };
 
 struct asc_thread_t
@@ -56,6 +78,8 @@ struct asc_thread_t
     asc_thread_buffer_t *buffer; // on_read
     void *arg;
 
+    asc_event_core_t *event_core; // observer of the starting loop
+
     bool is_started;
     bool is_closed;
 
@@ -72,19 +96,8 @@ typedef struct
     bool is_changed;
 } thread_observer_t;
 
-static thread_observer_t thread_observer;
-
-#ifdef _WIN32
-#   define asc_thread_mutex_init(_mutex) _mutex = CreateMutex(NULL, FALSE, NULL)
-#   define asc_thread_mutex_destroy(_mutex) CloseHandle(_mutex)
-#   define asc_thread_mutex_lock(_mutex) WaitForSingleObject(_mutex, INFINITE)
-#   define asc_thread_mutex_unlock(_mutex) ReleaseMutex(_mutex)
-#else
-#   define asc_thread_mutex_init(_mutex) pthread_mutex_init(&_mutex, NULL)
-#   define asc_thread_mutex_destroy(_mutex) pthread_mutex_destroy(&_mutex)
-#   define asc_thread_mutex_lock(_mutex) pthread_mutex_lock(&_mutex)
-#   define asc_thread_mutex_unlock(_mutex) pthread_mutex_unlock(&_mutex)
-#endif
+/* one observer per loop thread, threads are checked by the loop that started them */
+static __thread thread_observer_t thread_observer;
 
 void asc_thread_core_init(void)
 {
@@ -123,7 +136,7 @@ void asc_thread_core_loop(void)
 
         if(thread->on_read)
         {
-            if(thread->buffer->count > 0)
+            if(asc_thread_buffer_count(thread->buffer) > 0)
             {
                 is_main_loop_idle = false;
                 thread->on_read(thread->arg);
@@ -165,6 +178,7 @@ static void * asc_thread_loop(void *arg)
     thread->is_started = true;
     thread->loop(thread->arg);
     thread->is_closed = true;
+    asc_event_core_notify(thread->event_core);
 
 #ifdef _WIN32
     return 0;
@@ -182,11 +196,14 @@ void asc_thread_start(  asc_thread_t *thread
     thread->loop = loop;
     asc_assert(thread->loop != NULL, MSG("loop required"));
 
+    thread->event_core = asc_event_core_self();
+
     thread->on_read = on_read;
     if(on_read)
     {
         thread->buffer = buffer;
         asc_assert(thread->buffer != NULL, MSG("buffer required"));
+        asc_thread_buffer_set_reader(thread->buffer, thread->event_core);
     }
 
     thread->on_close = on_close;
@@ -235,92 +252,180 @@ asc_thread_buffer_t * asc_thread_buffer_init(size_t size)
     asc_thread_buffer_t *buffer = (asc_thread_buffer_t *)calloc(1, sizeof(asc_thread_buffer_t));
     buffer->size = size;
     buffer->buffer = (uint8_t *)malloc(size);
-    asc_thread_mutex_init(buffer->mutex);
     return buffer;
 }
 
+void asc_thread_buffer_set_reader(asc_thread_buffer_t *buffer, asc_event_core_t *reader)
+{
+    __atomic_store_n(&buffer->reader, reader, __ATOMIC_RELEASE);
+}
+
 void asc_thread_buffer_destroy(asc_thread_buffer_t *buffer)
 {
     if(!buffer)
         return;
     free(buffer->buffer);
-    asc_thread_mutex_destroy(buffer->mutex);
     free(buffer);
 }
 
-void asc_thread_buffer_flush(asc_thread_buffer_t *buffer)
+/*
+ * reader side
+ */
+
+static void thread_buffer_apply_flush(asc_thread_buffer_t *buffer)
 {
-    asc_thread_mutex_lock(buffer->mutex);
-    buffer->count = 0;
-    buffer->read = 0;
-    buffer->write = 0;
-    asc_thread_mutex_unlock(buffer->mutex);
+    if(!__atomic_load_n(&buffer->flush_request, __ATOMIC_RELAXED))
+        return;
+    if(!__atomic_exchange_n(&buffer->flush_request, 0, __ATOMIC_ACQUIRE))
+        return;
+
+    const uint64_t flush_head = __atomic_load_n(&buffer->flush_head, __ATOMIC_RELAXED);
+    const uint64_t head = __atomic_load_n(&buffer->head, __ATOMIC_ACQUIRE);
+    if(flush_head > buffer->tail && flush_head <= head)
+        __atomic_store_n(&buffer->tail, flush_head, __ATOMIC_RELEASE);
+
+    // the tail may have passed the cached head, read() must not trust it
+    buffer->head_cache = head;
 }
 
-ssize_t asc_thread_buffer_read(asc_thread_buffer_t *buffer, void *data, size_t size)
+size_t asc_thread_buffer_count(asc_thread_buffer_t *buffer)
 {
-    asc_thread_mutex_lock(buffer->mutex);
-    if(size > buffer->count)
-        size = buffer->count;
+    const uint64_t tail = __atomic_load_n(&buffer->tail, __ATOMIC_ACQUIRE);
+    const uint64_t head = __atomic_load_n(&buffer->head, __ATOMIC_ACQUIRE);
+    return (size_t)(head - tail);
+}
 
-    if(!size)
-    {
-        asc_thread_mutex_unlock(buffer->mutex);
+size_t asc_thread_buffer_peek(asc_thread_buffer_t *buffer, const uint8_t **data)
+{
+    thread_buffer_apply_flush(buffer);
+
+    buffer->head_cache = __atomic_load_n(&buffer->head, __ATOMIC_ACQUIRE);
+    const uint64_t count = buffer->head_cache - buffer->tail;
+    if(!count)
         return 0;
-    }
 
-    const size_t next_read = buffer->read + size;
-    if(next_read < buffer->size)
+    const uint64_t offset = buffer->tail % buffer->size;
+    const uint64_t block = buffer->size - offset;
+
+    *data = &buffer->buffer[offset];
+    return (size_t)((count < block) ? count : block);
+}
+
+void asc_thread_buffer_consume(asc_thread_buffer_t *buffer, size_t size)
+{
+    __atomic_store_n(&buffer->tail, buffer->tail + size, __ATOMIC_RELEASE);
+}
+
+ssize_t asc_thread_buffer_read(asc_thread_buffer_t *buffer, void *data, size_t size)
+{
+    thread_buffer_apply_flush(buffer);
+
+    const uint64_t tail = buffer->tail;
+    if(tail > buffer->head_cache || size > buffer->head_cache - tail)
     {
-        memcpy(data, &buffer->buffer[buffer->read], size);
-        buffer->read += size;
+        buffer->head_cache = __atomic_load_n(&buffer->head, __ATOMIC_ACQUIRE);
+        if(size > buffer->head_cache - tail)
+            size = (size_t)(buffer->head_cache - tail);
     }
-    else if(next_read > buffer->size)
+
+    if(!size)
+        return 0;
+
+    const uint64_t offset = tail % buffer->size;
+    const uint64_t block = buffer->size - offset;
+    if(size <= block)
     {
-        const size_t tail = buffer->size - buffer->read;
-        memcpy(data, &buffer->buffer[buffer->read], tail);
-        buffer->read = size - tail;
-        memcpy(&((uint8_t *)data)[tail], buffer->buffer, buffer->read);
+        memcpy(data, &buffer->buffer[offset], size);
     }
     else
     {
-        memcpy(data, &buffer->buffer[buffer->read], size);
-        buffer->read = 0;
+        memcpy(data, &buffer->buffer[offset], block);
+        memcpy(&((uint8_t *)data)[block], buffer->buffer, size - block);
     }
 
-    buffer->count -= size;
-    asc_thread_mutex_unlock(buffer->mutex);
+    __atomic_store_n(&buffer->tail, tail + size, __ATOMIC_RELEASE);
 
     return size;
 }
 
+/*
+ * writer side
+ */
+
+size_t asc_thread_buffer_reserve(asc_thread_buffer_t *buffer, uint8_t **data)
+{
+    const uint64_t head = buffer->head;
+    uint64_t space = buffer->size - (head - buffer->tail_cache);
+    if(!space)
+    {
+        buffer->tail_cache = __atomic_load_n(&buffer->tail, __ATOMIC_ACQUIRE);
+        space = buffer->size - (head - buffer->tail_cache);
+        if(!space)
+            return 0;
+    }
+
+    const uint64_t offset = head % buffer->size;
+    const uint64_t block = buffer->size - offset;
+
+    *data = &buffer->buffer[offset];
+    return (size_t)((space < block) ? space : block);
+}
+
+void asc_thread_buffer_commit(asc_thread_buffer_t *buffer, size_t size)
+{
+    if(!size)
+        return;
+
+    __atomic_store_n(&buffer->head, buffer->head + size, __ATOMIC_RELEASE);
+
+    asc_event_core_t *const reader = __atomic_load_n(&buffer->reader, __ATOMIC_ACQUIRE);
+    if(reader)
+        asc_event_core_notify(reader);
+}
+
 ssize_t asc_thread_buffer_write(asc_thread_buffer_t *buffer, const void *data, size_t size)
 {
     if(!size)
         return 0;
 
-    asc_thread_mutex_lock(buffer->mutex);
-    if(buffer->count + size > buffer->size)
+    const uint64_t head = buffer->head;
+    if(size > buffer->size - (head - buffer->tail_cache))
     {
-        asc_thread_mutex_unlock(buffer->mutex);
-        return -1; // buffer overflow
+        buffer->tail_cache = __atomic_load_n(&buffer->tail, __ATOMIC_ACQUIRE);
+        if(size > buffer->size - (head - buffer->tail_cache))
+            return -1; // buffer overflow
     }
 
-    if(buffer->write + size >= buffer->size)
+    const uint64_t offset = head % buffer->size;
+    const uint64_t block = buffer->size - offset;
+    if(size <= block)
     {
-        const size_t tail = buffer->size - buffer->write;
-        memcpy(&buffer->buffer[buffer->write], data, tail);
-        buffer->write = size - tail;
-        if(buffer->write > 0)
-            memcpy(buffer->buffer, &((uint8_t *)data)[tail], buffer->write);
+        memcpy(&buffer->buffer[offset], data, size);
     }
     else
     {
-        memcpy(&buffer->buffer[buffer->write], data, size);
-        buffer->write += size;
+        memcpy(&buffer->buffer[offset], data, block);
+        memcpy(buffer->buffer, &((const uint8_t *)data)[block], size - block);
     }
-    buffer->count += size;
-    asc_thread_mutex_unlock(buffer->mutex);
+
+    __atomic_store_n(&buffer->head, head + size, __ATOMIC_RELEASE);
+
+    asc_event_core_t *const reader = __atomic_load_n(&buffer->reader, __ATOMIC_ACQUIRE);
+    if(reader)
+        asc_event_core_notify(reader);
 
     return size;
 }
+
+/*
+ * drops all buffered data. may be called from any side: the reader
+ * moves its tail on the next read/peek, until then the space is not
+ * available for the writer
+ */
+
+void asc_thread_buffer_flush(asc_thread_buffer_t *buffer)
+{
+    const uint64_t head = __atomic_load_n(&buffer->head, __ATOMIC_ACQUIRE);
+    __atomic_store_n(&buffer->flush_head, head, __ATOMIC_RELAXED);
+    __atomic_store_n(&buffer->flush_request, 1, __ATOMIC_RELEASE);
+}
@@ -22,6 +22,7 @@
 #define _ASC_THREAD_H_ 1
 
 #include "base.h"
+#include "event.h"
 
 typedef struct asc_thread_t asc_thread_t;
 typedef struct asc_thread_buffer_t asc_thread_buffer_t;
@@ -41,9 +42,23 @@ void asc_thread_destroy(asc_thread_t *thread);
 asc_thread_buffer_t * asc_thread_buffer_init(size_t buffer_size) __wur;
 void asc_thread_buffer_destroy(asc_thread_buffer_t *buffer);
 
+/* event observer of the reader loop, woken up on each write (NULL - none) */
+void asc_thread_buffer_set_reader(asc_thread_buffer_t *buffer, asc_event_core_t *reader);
+
 void asc_thread_buffer_flush(asc_thread_buffer_t *buffer);
+size_t asc_thread_buffer_count(asc_thread_buffer_t *buffer) __wur;
+
+/* one writer thread and one reader thread per buffer */
 
 ssize_t asc_thread_buffer_read(asc_thread_buffer_t *buffer, void *data, size_t size) __wur;
 ssize_t asc_thread_buffer_write(asc_thread_buffer_t *buffer, const void *data, size_t size) __wur;
 
+/* writer: contiguous free space, fill it and commit */
+size_t asc_thread_buffer_reserve(asc_thread_buffer_t *buffer, uint8_t **data) __wur;
+void asc_thread_buffer_commit(asc_thread_buffer_t *buffer, size_t size);
+
+/* reader: contiguous buffered data, process it and consume */
+size_t asc_thread_buffer_peek(asc_thread_buffer_t *buffer, const uint8_t **data) __wur;
+void asc_thread_buffer_consume(asc_thread_buffer_t *buffer, size_t size);
+
 #endif /* _ASC_THREAD_H_ */
@@ -21,6 +21,30 @@
 #include "clock.h"
 #include "timer.h"
 #include "loopctl.h"
+#include "profile.h"
+
+/*
+ * Timers with a deadline within TIMER_WHEEL_SPAN ticks live in a hashed
+ * hierarchical wheel (O(1) arm/cancel), far-future timers in a binary heap.
+ * Wheel tick is 1ms, the callback is called on the first tick not earlier
+ * than next_shot.
+ */
+
+#define TIMER_TICK_US 1000
+#define TIMER_WHEEL_BITS 6
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_MASK (TIMER_WHEEL_SLOTS - 1)
+#define TIMER_WHEEL_LEVELS 4
+#define TIMER_WHEEL_SPAN (1ULL << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS))
+
+#define TIMER_STATS_SIZE 1024
+
+typedef enum
+{
+    TIMER_IDLE = 0,
+    TIMER_IN_HEAP,
+    TIMER_IN_WHEEL,
+} timer_place_t;
 
 struct asc_timer_t
 {
@@ -30,21 +54,46 @@ struct asc_timer_t
     uint64_t interval;
     uint64_t next_shot;
 
+    timer_place_t place;
     size_t heap_index;
-    bool active;
+
+    uint64_t expire_tick;
+    asc_timer_t *next;
+    asc_timer_t **pprev;
+    uint8_t wheel_level;
+    uint8_t wheel_index;
+
+    asc_timer_stat_t *stat;
+
     bool in_callback;
     bool free_after_callback;
 };
 
-static asc_timer_t **timer_heap = NULL;
-static size_t timer_heap_size = 0;
-static size_t timer_heap_cap = 0;
-static uint64_t timer_next_due = 0;
-
-static void timer_update_next_due(void)
+typedef struct
 {
-    timer_next_due = (timer_heap_size > 0) ? timer_heap[0]->next_shot : 0;
-}
+    bool is_started;
+    uint64_t tick;
+    uint64_t mask[TIMER_WHEEL_LEVELS];
+    asc_timer_t *slot[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+} timer_wheel_t;
+
+/* timers are per-thread: the main loop and each data loop (core/loop.c) */
+static __thread timer_wheel_t timer_wheel;
+static __thread asc_timer_t **timer_heap = NULL;
+static __thread size_t timer_heap_size = 0;
+static __thread size_t timer_heap_cap = 0;
+
+/* callback accounting is shared by all loops, entries are never removed */
+static asc_timer_stat_t timer_stats[TIMER_STATS_SIZE];
+
+/*
+ * ooooo   ooooo ooooooooooo      o      oooooooooo
+ *  888     888   888    88      888      888    888
+ *  888ooooo888   888ooo8       8  88     888oooo88
+ *  888     888   888    oo    8oooo88    888
+ * o888o   o888o o888ooo8888 o88o  o888o o888o
+ *
+ */
 
 static void timer_heap_swap(size_t a, size_t b)
 {
@@ -109,10 +158,9 @@ static void timer_heap_push(asc_timer_t *timer)
 {
     timer_heap_reserve(timer_heap_size + 1);
     timer->heap_index = timer_heap_size;
-    timer->active = true;
+    timer->place = TIMER_IN_HEAP;
     timer_heap[timer_heap_size++] = timer;
     timer_heap_sift_up(timer->heap_index);
-    timer_update_next_due();
 }
 
 static asc_timer_t *timer_heap_remove_at(size_t index)
@@ -139,21 +187,291 @@ static asc_timer_t *timer_heap_remove_at(size_t index)
     }
 
     removed->heap_index = 0;
-    removed->active = false;
-    timer_update_next_due();
+    removed->place = TIMER_IDLE;
     return removed;
 }
 
+/*
+ * oooo     oooo ooooo   ooooo ooooooooooo ooooooooooo ooooo
+ *  88   88  88   888     888   888    88   888    88   888
+ *   88 888 88    888ooooo888   888ooo8     888ooo8     888
+ *    888 888     888     888   888    oo   888    oo   888      o
+ *     8   8     o888o   o888o o888ooo8888 o888ooo8888 o888ooooo88
+ *
+ */
+
+static uint64_t timer_wheel_now(uint64_t now)
+{
+    const uint64_t tick = now / TIMER_TICK_US;
+    if(!timer_wheel.is_started)
+    {
+        // wheel is started lazily: threads may arm timers before the first loop
+        timer_wheel.is_started = true;
+        timer_wheel.tick = tick;
+    }
+    return tick;
+}
+
+static void timer_wheel_link(asc_timer_t *timer, int level, size_t index)
+{
+    asc_timer_t **head = &timer_wheel.slot[level][index];
+
+    timer->next = *head;
+    if(timer->next)
+        timer->next->pprev = &timer->next;
+    timer->pprev = head;
+    *head = timer;
+
+    timer_wheel.mask[level] |= 1ULL << index;
+    timer->wheel_level = (uint8_t)level;
+    timer->wheel_index = (uint8_t)index;
+    timer->place = TIMER_IN_WHEEL;
+}
+
+static void timer_wheel_unlink(asc_timer_t *timer)
+{
+    *timer->pprev = timer->next;
+    if(timer->next)
+        timer->next->pprev = timer->pprev;
+
+    const int level = timer->wheel_level;
+    const size_t index = timer->wheel_index;
+    if(!timer_wheel.slot[level][index])
+        timer_wheel.mask[level] &= ~(1ULL << index);
+
+    timer->next = NULL;
+    timer->pprev = NULL;
+    timer->place = TIMER_IDLE;
+}
+
+/* expire_tick >= tick, equal only on cascade (fired right after it) */
+static void timer_wheel_insert(asc_timer_t *timer)
+{
+    const uint64_t delta = timer->expire_tick - timer_wheel.tick;
+    int level = 0;
+    while(delta >> (TIMER_WHEEL_BITS * (level + 1)))
+        ++level;
+
+    const size_t index = (size_t)(timer->expire_tick >> (TIMER_WHEEL_BITS * level))
+                       & TIMER_WHEEL_MASK;
+    timer_wheel_link(timer, level, index);
+}
+
+static void timer_wheel_cascade(int level)
+{
+    const size_t index = (size_t)(timer_wheel.tick >> (TIMER_WHEEL_BITS * level))
+                       & TIMER_WHEEL_MASK;
+
+    asc_timer_t *timer = timer_wheel.slot[level][index];
+    timer_wheel.slot[level][index] = NULL;
+    timer_wheel.mask[level] &= ~(1ULL << index);
+
+    while(timer)
+    {
+        asc_timer_t *const next = timer->next;
+        timer_wheel_insert(timer);
+        timer = next;
+    }
+}
+
+/* lower bound of the next expiration, in ticks. 0 if the wheel is empty */
+static uint64_t timer_wheel_next_tick(void)
+{
+    uint64_t result = 0;
+
+    for(int level = 0; level < TIMER_WHEEL_LEVELS; ++level)
+    {
+        const uint64_t mask = timer_wheel.mask[level];
+        if(!mask)
+            continue;
+
+        // first occupied slot after the current one
+        const int shift = TIMER_WHEEL_BITS * level;
+        const unsigned int from = (unsigned int)((timer_wheel.tick >> shift) + 1)
+                                & TIMER_WHEEL_MASK;
+        const uint64_t rotated = (from) ? ((mask >> from) | (mask << (TIMER_WHEEL_SLOTS - from)))
+                                        : mask;
+        const uint64_t offset = (uint64_t)__builtin_ctzll(rotated);
+
+        // level 0 slot is the expiration tick, upper slots are cascaded
+        // at the beginning of their block
+        const uint64_t tick = ((timer_wheel.tick >> shift) + 1 + offset) << shift;
+        if(!result || tick < result)
+            result = tick;
+    }
+
+    return result;
+}
+
+/*
+ *  oooooooo8 ooooooooooo   o   ooooooooooo  oooooooo8
+ * 888        88  888  88  888  88  888  88 888
+ *  888oooooo     888     8  88     888      888oooooo
+ *         888    888    8oooo88    888             888
+ * o88oooo888    o888o o88o  o888o o888o    o88oooo888
+ *
+ */
+
+static asc_timer_stat_t * timer_stat_get(timer_callback_t callback, const char *name)
+{
+    size_t index = ((size_t)callback >> 4) % TIMER_STATS_SIZE;
+
+    for(size_t i = 0; i < TIMER_STATS_SIZE; ++i)
+    {
+        asc_timer_stat_t *const stat = &timer_stats[index];
+        timer_callback_t current = __atomic_load_n(&stat->callback, __ATOMIC_ACQUIRE);
+
+        if(!current)
+        {
+            timer_callback_t expected = NULL;
+            if(__atomic_compare_exchange_n(&stat->callback, &expected, callback
+                                           , false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+            {
+                __atomic_store_n(&stat->name, name, __ATOMIC_RELEASE);
+                return stat;
+            }
+            current = expected;
+        }
+
+        if(current == callback)
+            return stat;
+
+        index = (index + 1) % TIMER_STATS_SIZE;
+    }
+
+    // table is full, callback is not accounted
+    return NULL;
+}
+
+static void timer_stat_add(asc_timer_stat_t *stat, uint64_t runtime)
+{
+    if(!stat)
+        return;
+
+    __atomic_fetch_add(&stat->calls, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&stat->runtime_us, runtime, __ATOMIC_RELAXED);
+    if(runtime > __atomic_load_n(&stat->max_us, __ATOMIC_RELAXED))
+        __atomic_store_n(&stat->max_us, runtime, __ATOMIC_RELAXED);
+}
+
+size_t asc_timer_stats(asc_timer_stat_t *list, size_t size)
+{
+    size_t count = 0;
+
+    for(size_t i = 0; i < TIMER_STATS_SIZE && count < size; ++i)
+    {
+        const asc_timer_stat_t *const stat = &timer_stats[i];
+        const timer_callback_t callback = __atomic_load_n(&stat->callback, __ATOMIC_ACQUIRE);
+        if(!callback)
+            continue;
+
+        const char *name = __atomic_load_n(&stat->name, __ATOMIC_ACQUIRE);
+
+        list[count].callback = callback;
+        list[count].name = (name) ? name : "";
+        list[count].calls = __atomic_load_n(&stat->calls, __ATOMIC_RELAXED);
+        list[count].runtime_us = __atomic_load_n(&stat->runtime_us, __ATOMIC_RELAXED);
+        list[count].max_us = __atomic_load_n(&stat->max_us, __ATOMIC_RELAXED);
+        ++count;
+    }
+
+    return count;
+}
+
+/*
+ *   oooooooo8    ooooooo  oooooooooo  ooooooooooo
+ * o888     88  o888   888o 888    888  888    88
+ * 888          888     888 888oooo88   888ooo8
+ * 888o     oo  888o   o888 888  88o    888    oo
+ *  888oooo88     88ooo88  o888o  88o8 o888ooo8888
+ *
+ */
+
+static void timer_arm(asc_timer_t *timer)
+{
+    if(!timer_wheel.is_started)
+        (void)timer_wheel_now(asc_utime());
+
+    // round up: the wheel never fires before next_shot.
+    // current tick is already processed, so the nearest one is the next tick
+    timer->expire_tick = (timer->next_shot + TIMER_TICK_US - 1) / TIMER_TICK_US;
+    if(timer->expire_tick <= timer_wheel.tick)
+        timer->expire_tick = timer_wheel.tick + 1;
+
+    if(timer->expire_tick - timer_wheel.tick < TIMER_WHEEL_SPAN)
+        timer_wheel_insert(timer);
+    else
+        timer_heap_push(timer);
+}
+
+static void timer_disarm(asc_timer_t *timer)
+{
+    if(timer->place == TIMER_IN_WHEEL)
+        timer_wheel_unlink(timer);
+    else if(timer->place == TIMER_IN_HEAP)
+        timer_heap_remove_at(timer->heap_index);
+}
+
+static void timer_fire(asc_timer_t *timer, uint64_t now)
+{
+    if(!timer->callback)
+    {
+        free(timer);
+        return;
+    }
+
+    is_main_loop_idle = false;
+    timer->in_callback = true;
+
+    // periodic timers keep their own grid: the wheel fires on tick boundaries,
+    // re-arm from "now" would stretch the period by up to one tick.
+    // missed periods are skipped, not fired in a burst
+    const bool is_one_shot = (timer->interval == 0);
+    if(!is_one_shot)
+    {
+        timer->next_shot += timer->interval;
+        if(timer->next_shot <= now)
+            timer->next_shot = now + timer->interval;
+    }
+
+    if(asc_profile_enabled)
+        asc_profile_call(timer->callback, timer->arg);
+    else
+        timer->callback(timer->arg);
+    timer->in_callback = false;
+    timer_stat_add(timer->stat, asc_utime() - now);
+
+    if(is_one_shot || timer->free_after_callback || !timer->callback)
+        free(timer);
+    else
+        timer_arm(timer);
+}
+
 void asc_timer_core_init(void)
 {
+    memset(&timer_wheel, 0, sizeof(timer_wheel));
     timer_heap = NULL;
     timer_heap_size = 0;
     timer_heap_cap = 0;
-    timer_next_due = 0;
 }
 
 void asc_timer_core_destroy(void)
 {
+    for(int level = 0; level < TIMER_WHEEL_LEVELS; ++level)
+    {
+        for(size_t index = 0; index < TIMER_WHEEL_SLOTS; ++index)
+        {
+            asc_timer_t *timer = timer_wheel.slot[level][index];
+            while(timer)
+            {
+                asc_timer_t *const next = timer->next;
+                free(timer);
+                timer = next;
+            }
+        }
+    }
+    memset(&timer_wheel, 0, sizeof(timer_wheel));
+
     while(timer_heap_size > 0)
     {
         asc_timer_t *timer = timer_heap_remove_at(0);
@@ -163,72 +481,98 @@ void asc_timer_core_destroy(void)
     free(timer_heap);
     timer_heap = NULL;
     timer_heap_cap = 0;
-    timer_next_due = 0;
 }
 
 void asc_timer_core_loop(void)
 {
-    const uint64_t cur = asc_utime();
-    if(timer_next_due != 0 && cur < timer_next_due)
-        return;
+    // callbacks see the coarse clock of their start
+    uint64_t now = asc_now_update();
+    const uint64_t now_tick = timer_wheel_now(now);
 
-    while(timer_heap_size > 0)
+    while(timer_wheel.tick < now_tick)
     {
-        const uint64_t now = asc_utime();
-        asc_timer_t *timer = timer_heap[0];
-        if(now < timer->next_shot)
-            break;
+        if(!timer_wheel.mask[0])
+        {
+            // nothing to fire until the next cascade
+            const uint64_t block_end = timer_wheel.tick | TIMER_WHEEL_MASK;
+            if(block_end >= now_tick)
+            {
+                timer_wheel.tick = now_tick;
+                break;
+            }
+            timer_wheel.tick = block_end;
+        }
 
-        timer = timer_heap_remove_at(0);
-        if(!timer)
-            continue;
+        ++timer_wheel.tick;
 
-        if(!timer->callback)
+        if(!(timer_wheel.tick & TIMER_WHEEL_MASK))
         {
-            free(timer);
-            continue;
+            int level = 1;
+            while(level < TIMER_WHEEL_LEVELS - 1
+                  && !((timer_wheel.tick >> (TIMER_WHEEL_BITS * level)) & TIMER_WHEEL_MASK))
+            {
+                ++level;
+            }
+            for(; level > 0; --level)
+                timer_wheel_cascade(level);
         }
 
-        is_main_loop_idle = false;
-        timer->in_callback = true;
-
-        if(timer->interval == 0)
+        // timers armed by callbacks are never placed into the current slot
+        const size_t index = (size_t)timer_wheel.tick & TIMER_WHEEL_MASK;
+        asc_timer_t *timer;
+        while((timer = timer_wheel.slot[0][index]) != NULL)
         {
-            // one shot timer
-            timer->callback(timer->arg);
-            timer->in_callback = false;
-            free(timer);
-            continue;
+            timer_wheel_unlink(timer);
+            timer_fire(timer, now);
+            now = asc_now_update();
         }
+    }
 
-        timer->next_shot = now + timer->interval;
-        timer->callback(timer->arg);
-        timer->in_callback = false;
+    while(timer_heap_size > 0)
+    {
+        if(now < timer_heap[0]->next_shot)
+            break;
 
-        if(timer->free_after_callback || !timer->callback)
-            free(timer);
-        else
-            timer_heap_push(timer);
+        asc_timer_t *const timer = timer_heap_remove_at(0);
+        timer_fire(timer, now);
+        now = asc_now_update();
     }
 }
 
-asc_timer_t * asc_timer_init(unsigned int ms, void (*callback)(void *), void *arg)
+uint64_t asc_timer_core_next_shot(void)
+{
+    uint64_t result = timer_wheel_next_tick() * TIMER_TICK_US;
+
+    if(timer_heap_size > 0)
+    {
+        const uint64_t heap_shot = timer_heap[0]->next_shot;
+        if(!result || heap_shot < result)
+            result = heap_shot;
+    }
+
+    return result;
+}
+
+asc_timer_t * __asc_timer_init(  unsigned int ms, timer_callback_t callback, void *arg
+                               , const char *name)
 {
     asc_timer_t *const timer = (asc_timer_t *)calloc(1, sizeof(asc_timer_t));
     timer->interval = ms * 1000;
     timer->callback = callback;
     timer->arg = arg;
+    timer->stat = timer_stat_get(callback, name);
 
     timer->next_shot = asc_utime() + timer->interval;
 
-    timer_heap_push(timer);
+    timer_arm(timer);
 
     return timer;
 }
 
-asc_timer_t * asc_timer_one_shot(unsigned int ms, void (*callback)(void *), void *arg)
+asc_timer_t * __asc_timer_one_shot(  unsigned int ms, timer_callback_t callback, void *arg
+                                   , const char *name)
 {
-    asc_timer_t *const timer = asc_timer_init(ms, callback, arg);
+    asc_timer_t *const timer = __asc_timer_init(ms, callback, arg, name);
     timer->interval = 0;
 
     return timer;
@@ -240,8 +584,7 @@ void asc_timer_destroy(asc_timer_t *timer)
         return;
 
     timer->callback = NULL;
-    if(timer->active)
-        timer_heap_remove_at(timer->heap_index);
+    timer_disarm(timer);
 
     if(timer->in_callback)
     {
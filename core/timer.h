@@ -26,12 +26,33 @@
 typedef struct asc_timer_t asc_timer_t;
 typedef void (*timer_callback_t)(void *);
 
+/* per-callback accounting, shared by all loops */
+typedef struct
+{
+    timer_callback_t callback;
+    const char *name; // "file.c:callback"
+    uint64_t calls;
+    uint64_t runtime_us;
+    uint64_t max_us;
+} asc_timer_stat_t;
+
 void asc_timer_core_init(void);
 void asc_timer_core_loop(void);
 void asc_timer_core_destroy(void);
+uint64_t asc_timer_core_next_shot(void) __wur;
 
-asc_timer_t * asc_timer_init(unsigned int ms, timer_callback_t callback, void *arg) __wur;
-asc_timer_t * asc_timer_one_shot(unsigned int ms, timer_callback_t callback, void *arg);
+asc_timer_t * __asc_timer_init(  unsigned int ms, timer_callback_t callback, void *arg
+                               , const char *name) __wur;
+asc_timer_t * __asc_timer_one_shot(  unsigned int ms, timer_callback_t callback, void *arg
+                                   , const char *name);
 void asc_timer_destroy(asc_timer_t *timer);
 
+#define asc_timer_init(_ms, _callback, _arg) \
+    __asc_timer_init(_ms, _callback, _arg, __FILE__ ":" #_callback)
+#define asc_timer_one_shot(_ms, _callback, _arg) \
+    __asc_timer_one_shot(_ms, _callback, _arg, __FILE__ ":" #_callback)
+
+/* copy up to size entries into list, returns number of entries */
+size_t asc_timer_stats(asc_timer_stat_t *list, size_t size);
+
 #endif /* _ASC_TIMER_H_ */
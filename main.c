@@ -61,6 +61,7 @@ static void signal_handler(int signum)
         case SIGHUP:
             asc_log_hup();
             is_sighup = true;
+            asc_event_core_wakeup();
             return;
         case SIGPIPE:
             return;
@@ -86,6 +87,27 @@ static bool WINAPI signal_handler(DWORD signum)
 }
 #endif
 
+/*
+ * Blocking main loop: sleep in the event observer until the nearest deadline
+ * (timer heap, GC schedule) instead of polling every millisecond.
+ * Thread buffers and signals wake the loop up through asc_event_core_wakeup().
+ */
+#define MAIN_LOOP_WAIT_MAX_MS 1000
+
+static int main_loop_wait_ms(uint64_t now, uint64_t deadline)
+{
+    const uint64_t timer_shot = asc_timer_core_next_shot();
+    if(timer_shot != 0 && timer_shot < deadline)
+        deadline = timer_shot;
+
+    if(deadline <= now)
+        return 0;
+
+    // round up: timers are fired only when the deadline is reached
+    const uint64_t wait_ms = (deadline - now + 999) / 1000;
+    return (wait_ms > MAIN_LOOP_WAIT_MAX_MS) ? MAIN_LOOP_WAIT_MAX_MS : (int)wait_ms;
+}
+
 static void asc_srand(void)
 {
     unsigned long a = clock();
@@ -123,11 +145,13 @@ int main(int argc, const char **argv)
 
 astra_reload_entry:
 
+    asc_log_core_init();
     asc_srand();
     asc_thread_core_init();
     asc_timer_core_init();
     asc_socket_core_init();
     asc_event_core_init();
+    asc_loop_core_init();
 
     lua = luaL_newstate();
     luaL_openlibs(lua);
@@ -173,6 +197,8 @@ astra_reload_entry:
     volatile uint64_t gc_full_collect_interval = GC_FULL_COLLECT_DEFAULT_US;
     volatile uint64_t gc_step_interval = GC_STEP_DEFAULT_US;
     volatile unsigned int gc_step_units = GC_STEP_DEFAULT_UNITS;
+    volatile bool main_loop_blocking = false;
+    volatile int main_loop_wait = 0;
 
     /* start */
     const int main_loop_status = setjmp(main_loop);
@@ -214,9 +240,11 @@ astra_reload_entry:
         {
             is_main_loop_idle = true;
 
-            asc_event_core_loop();
+            asc_event_core_wait(main_loop_wait);
+            main_loop_wait = 0;
             asc_timer_core_loop();
             asc_thread_core_loop();
+            asc_loop_core_loop();
 
             if(is_sighup)
             {
@@ -240,6 +268,7 @@ astra_reload_entry:
                 unsigned int full_ms = lua_read_global_uint("__astra_gc_full_collect_interval_ms", 1000);
                 unsigned int step_ms = lua_read_global_uint("__astra_gc_step_interval_ms", 250);
                 unsigned int step_units = lua_read_global_uint("__astra_gc_step_units", 0);
+                main_loop_blocking = (lua_read_global_uint("__astra_main_loop_blocking", 0) != 0);
 
                 full_ms = clamp_uint(full_ms, 100, 60000);
                 step_ms = clamp_uint(step_ms, 50, 10000);
@@ -264,7 +293,18 @@ astra_reload_entry:
                     lua_gc(lua, LUA_GCCOLLECT, 0);
                 }
 
-                asc_usleep(1000);
+                if(main_loop_blocking)
+                {
+                    uint64_t deadline = gc_tune_timeout + GC_TUNE_REFRESH_US;
+                    if(gc_full_collect_timeout + gc_full_collect_interval < deadline)
+                        deadline = gc_full_collect_timeout + gc_full_collect_interval;
+                    if(gc_step_units > 0 && gc_step_timeout + gc_step_interval < deadline)
+                        deadline = gc_step_timeout + gc_step_interval;
+
+                    main_loop_wait = main_loop_wait_ms(current_time, deadline);
+                }
+                else
+                    asc_usleep(1000);
             }
         }
     }
@@ -272,6 +312,7 @@ astra_reload_entry:
     /* destroy */
     lua_close(lua);
 
+    asc_loop_core_destroy();
     asc_event_core_destroy();
     asc_socket_core_destroy();
     asc_timer_core_destroy();
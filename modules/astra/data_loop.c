@@ -0,0 +1,94 @@
+/*
+ * Astra Module: Data Loop
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Data loops: stream pipelines on N threads, Lua stays on the control loop
+ *
+ * Methods:
+ *      data_loop.start(count)
+ *                  - start data loops, once per run.
+ *                    return true if count loops are running
+ *      data_loop.count()
+ *                  - return number, count of running data loops (0 - disabled)
+ *      data_loop.stats()
+ *                  - return table, per-loop counters, index 0 is the control loop:
+ *                    { { index, iterations, calls, readers, cpu_us }, ... }
+ */
+
+#include <astra.h>
+
+static int lua_data_loop_start(lua_State *L)
+{
+    const int count = luaL_checkinteger(L, 1);
+    lua_pushboolean(L, asc_loop_core_start(count));
+    return 1;
+}
+
+static int lua_data_loop_count(lua_State *L)
+{
+    lua_pushinteger(L, asc_loop_core_count());
+    return 1;
+}
+
+static int lua_data_loop_stats(lua_State *L)
+{
+    lua_newtable(L);
+
+    const int count = asc_loop_core_count();
+    for(int i = 0; i <= count; ++i)
+    {
+        asc_loop_stats_t stats;
+        asc_loop_stats(asc_loop_get(i), &stats);
+
+        lua_newtable(L);
+
+        lua_pushinteger(L, i);
+        lua_setfield(L, -2, "index");
+
+        lua_pushnumber(L, (lua_Number)stats.iterations);
+        lua_setfield(L, -2, "iterations");
+
+        lua_pushnumber(L, (lua_Number)stats.calls);
+        lua_setfield(L, -2, "calls");
+
+        lua_pushinteger(L, (lua_Integer)stats.readers);
+        lua_setfield(L, -2, "readers");
+
+        lua_pushnumber(L, (lua_Number)stats.cpu_us);
+        lua_setfield(L, -2, "cpu_us");
+
+        lua_rawseti(L, -2, i + 1);
+    }
+
+    return 1;
+}
+
+LUA_API int luaopen_data_loop(lua_State *L)
+{
+    static const luaL_Reg api[] =
+    {
+        { "start", lua_data_loop_start },
+        { "count", lua_data_loop_count },
+        { "stats", lua_data_loop_stats },
+        { NULL, NULL }
+    };
+
+    luaL_newlib(L, api);
+    lua_setglobal(L, "data_loop");
+
+    return 0;
+}
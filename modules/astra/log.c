@@ -32,16 +32,22 @@
  *                    syslog    - string, sending log to the syslog,
  *                                is not available under the windows
  *                    stdout    - boolean, writing log to the stdout, true by default
+ *                    rate_limit - number, lines per second for each call site
+ *                                (format string in C, chunk:line in Lua), 0 - unlimited
  *      log.get()
  *                  - get current log options (best-effort snapshot)
- *      log.error(message)
+ *      log.stats()
+ *                  - counters since start: { lines, dropped, suppressed }
+ *      log.error(message [, level])
  *                  - error message
- *      log.warning(message)
+ *      log.warning(message [, level])
  *                  - warning message
- *      log.info(message)
+ *      log.info(message [, level])
  *                  - information message
- *      log.debug(message)
+ *      log.debug(message [, level])
  *                  - debug message
+ *                    level - number, stack level of the rate limit site,
+ *                            1 (caller) by default, 2 for a wrapper's caller
  */
 
 #include <astra.h>
@@ -52,6 +58,11 @@ static int rotate_keep = 0;
 static bool opt_stdout = true;
 static bool opt_color = false;
 static int opt_level = ASC_LOG_LEVEL_INFO;
+
+/* rate limit sites of log.* calls: "chunk:line", kept until exit */
+#define LUA_LOG_SITES 1024
+static char *lua_sites[LUA_LOG_SITES];
+static int opt_rate_limit = -1;
 static char *opt_filename = NULL;
 #ifndef _WIN32
 static char *opt_syslog = NULL;
@@ -167,6 +178,12 @@ static int lua_log_set(lua_State *L)
             opt_color = lua_toboolean(L, -1);
             asc_log_set_color(opt_color);
         }
+        else if(!strcmp(var, "rate_limit"))
+        {
+            const lua_Integer val = luaL_checkinteger(L, -1);
+            opt_rate_limit = (val > 0) ? (int)val : 0;
+            asc_log_set_rate_limit(opt_rate_limit);
+        }
     }
 
     return 0;
@@ -202,31 +219,88 @@ static int lua_log_get(lua_State *L)
     lua_pushinteger(L, (lua_Integer)rotate_keep);
     lua_setfield(L, -2, "rotate_keep");
 
+    if(opt_rate_limit >= 0)
+    {
+        lua_pushinteger(L, (lua_Integer)opt_rate_limit);
+        lua_setfield(L, -2, "rate_limit");
+    }
+
     return 1;
 }
 
+static int lua_log_stats(lua_State *L)
+{
+    asc_log_stats_t stats;
+    asc_log_stats(&stats);
+
+    lua_newtable(L);
+
+    lua_pushnumber(L, (lua_Number)stats.lines);
+    lua_setfield(L, -2, "lines");
+
+    lua_pushnumber(L, (lua_Number)stats.dropped);
+    lua_setfield(L, -2, "dropped");
+
+    lua_pushnumber(L, (lua_Number)stats.suppressed);
+    lua_setfield(L, -2, "suppressed");
+
+    return 1;
+}
+
+/* the caller of log.* (or the level from the 2nd argument), sites over LUA_LOG_SITES share one */
+static const char * lua_log_site(lua_State *L)
+{
+    const int level = lua_isnumber(L, 2) ? (int)lua_tointeger(L, 2) : 1;
+
+    lua_Debug ar;
+    if(level < 1 || !lua_getstack(L, level, &ar) || !lua_getinfo(L, "Sl", &ar))
+        return "lua";
+
+    char site[LUA_IDSIZE + 16];
+    snprintf(site, sizeof(site), "%s:%d", ar.short_src, ar.currentline);
+
+    uint32_t hash = 2166136261u;
+    for(const char *c = site; *c; ++c)
+        hash = (hash ^ (uint8_t)*c) * 16777619u;
+
+    size_t index = hash % LUA_LOG_SITES;
+    for(size_t i = 0; i < LUA_LOG_SITES; ++i)
+    {
+        if(!lua_sites[index])
+        {
+            lua_sites[index] = strdup(site);
+            return (lua_sites[index]) ? lua_sites[index] : "lua";
+        }
+        if(!strcmp(lua_sites[index], site))
+            return lua_sites[index];
+        index = (index + 1) % LUA_LOG_SITES;
+    }
+
+    return "lua";
+}
+
 static int lua_log_error(lua_State *L)
 {
-    asc_log_error("%s", luaL_checkstring(L, 1));
+    asc_log_message_site(ASC_LOG_LEVEL_ERROR, lua_log_site(L), luaL_checkstring(L, 1));
     return 0;
 }
 
 static int lua_log_warning(lua_State *L)
 {
-    asc_log_warning("%s", luaL_checkstring(L, 1));
+    asc_log_message_site(ASC_LOG_LEVEL_WARNING, lua_log_site(L), luaL_checkstring(L, 1));
     return 0;
 }
 
 static int lua_log_info(lua_State *L)
 {
-    asc_log_info("%s", luaL_checkstring(L, 1));
+    asc_log_message_site(ASC_LOG_LEVEL_INFO, lua_log_site(L), luaL_checkstring(L, 1));
     return 0;
 }
 
 static int lua_log_debug(lua_State *L)
 {
     if(is_debug)
-        asc_log_debug("%s", luaL_checkstring(L, 1));
+        asc_log_message_site(ASC_LOG_LEVEL_DEBUG, lua_log_site(L), luaL_checkstring(L, 1));
     return 0;
 }
 
@@ -239,6 +313,7 @@ LUA_API int luaopen_log(lua_State *L)
     {
         { "set", lua_log_set },
         { "get", lua_log_get },
+        { "stats", lua_log_stats },
         { "error", lua_log_error },
         { "warning", lua_log_warning },
         { "info", lua_log_info },
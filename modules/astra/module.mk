@@ -1,8 +1,8 @@
 
-SOURCES="module_lua.c module_stream.c crc32b.c"
+SOURCES="module_lua.c module_stream.c ts_chunk.c crc32b.c"
 SOURCES="$SOURCES sha1.c base64.c md5.c rc4.c strhex.c"
-SOURCES="$SOURCES astra.c log.c timer.c utils.c json.c iso8859.c"
-MODULES="astra log timer utils json base64 sha1 md5 rc4 str2hex iso8859"
+SOURCES="$SOURCES astra.c data_loop.c log.c profiler.c timer.c utils.c json.c iso8859.c"
+MODULES="astra data_loop log profiler timer utils json base64 sha1 md5 rc4 str2hex iso8859"
 
 if [ "$OS" != "mingw" ] ; then
     SOURCES="$SOURCES pidfile.c"
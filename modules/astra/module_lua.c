@@ -20,6 +20,8 @@
 
 #include <astra.h>
 
+const char *module_lua_type = NULL;
+
 bool module_option_number(const char *name, int *number)
 {
     if(lua_type(lua, MODULE_OPTIONS_IDX) != LUA_TTABLE)
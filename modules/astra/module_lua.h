@@ -89,7 +89,10 @@ typedef struct
             lua_pushvalue(L, MODULE_OPTIONS_IDX);                                               \
             lua_setfield(L, 3, "__options");                                                    \
         }                                                                                       \
+        const char *__type = module_lua_type;                                                   \
+        module_lua_type = __module_name;                                                        \
         module_init(mod);                                                                       \
+        module_lua_type = __type;                                                               \
         return 1;                                                                               \
     }                                                                                           \
     LUA_API int luaopen_##_name(lua_State *L)                                                   \
@@ -108,6 +111,9 @@ typedef struct
         return 1;                                                                               \
     }
 
+/* name of the module in module_init(), NULL outside */
+extern const char *module_lua_type;
+
 bool module_option_number(const char *name, int *number);
 bool module_option_string(const char *name, const char **string, size_t *length);
 bool module_option_boolean(const char *name, bool *boolean);
@@ -20,40 +20,590 @@
 
 #include <astra.h>
 
-void __module_stream_detach(module_stream_t *stream, module_stream_t *child)
+static module_stream_childs_t * module_stream_childs_alloc(size_t count)
+{
+    module_stream_childs_t *childs = (module_stream_childs_t *)malloc(
+        sizeof(module_stream_childs_t) + count * sizeof(module_stream_t *));
+    asc_assert(childs != NULL, "[module_stream] malloc() failed");
+    childs->retired = NULL;
+    childs->count = count;
+    return childs;
+}
+
+static void module_stream_childs_release(module_stream_t *stream)
+{
+    while(stream->childs_retired)
+    {
+        module_stream_childs_t *next = stream->childs_retired->retired;
+        free(stream->childs_retired);
+        stream->childs_retired = next;
+    }
+}
+
+static void module_stream_childs_replace(  module_stream_t *stream
+                                         , module_stream_childs_t *childs)
+{
+    module_stream_childs_t *prev = stream->childs;
+    stream->childs = childs;
+    if(!prev)
+        return;
+
+    if(stream->send_depth > 0)
+    {
+        // the array is iterated right now, free it after the dispatch
+        prev->retired = stream->childs_retired;
+        stream->childs_retired = prev;
+    }
+    else
+        free(prev);
+}
+
+static void module_stream_insert(module_stream_t *stream, module_stream_t *child)
+{
+    module_stream_childs_t *prev = stream->childs;
+    const size_t count = (prev) ? prev->count : 0;
+
+    module_stream_childs_t *childs = module_stream_childs_alloc(count + 1);
+    if(count > 0)
+        memcpy(childs->item, prev->item, count * sizeof(module_stream_t *));
+    childs->item[count] = child;
+
+    module_stream_childs_replace(stream, childs);
+}
+
+static void module_stream_remove(module_stream_t *stream, module_stream_t *child)
+{
+    module_stream_childs_t *prev = stream->childs;
+    if(!prev)
+        return;
+
+    size_t idx = 0;
+    while(idx < prev->count && prev->item[idx] != child)
+        ++idx;
+    if(idx == prev->count)
+        return;
+
+    module_stream_childs_t *childs = NULL;
+    if(prev->count > 1)
+    {
+        childs = module_stream_childs_alloc(prev->count - 1);
+        memcpy(childs->item, prev->item, idx * sizeof(module_stream_t *));
+        memcpy(&childs->item[idx], &prev->item[idx + 1]
+               , (prev->count - idx - 1) * sizeof(module_stream_t *));
+    }
+
+    // detached child should not receive the rest of the current dispatch
+    prev->item[idx] = NULL;
+    module_stream_childs_replace(stream, childs);
+}
+
+/*
+ * attach/detach/destroy are called on the control loop. the childs array
+ * of a data loop stream is changed on its loop, via asc_loop_call_wait()
+ */
+
+typedef struct
 {
-    asc_list_for(stream->childs)
+    module_stream_t *stream;
+    module_stream_t *child;
+} module_stream_link_t;
+
+static void module_stream_insert_call(void *arg)
+{
+    module_stream_link_t *link = (module_stream_link_t *)arg;
+    module_stream_insert(link->stream, link->child);
+
+    // loop_safe child is attached at the end of module_init(),
+    // pass pids joined before to the upstream
+    module_stream_t *child = link->child;
+    module_stream_t *stream = link->stream;
+    if(child->loop_safe && child->pid_list && stream->join_pid)
     {
-        if(child == asc_list_data(stream->childs))
+        for(int pid = 0; pid < MAX_PID; ++pid)
         {
-            asc_list_remove_current(stream->childs);
-            break;
+            if(child->pid_list[pid])
+                stream->join_pid(stream->self, (uint16_t)pid);
         }
     }
+}
+
+static void module_stream_remove_call(void *arg)
+{
+    module_stream_link_t *link = (module_stream_link_t *)arg;
+    module_stream_remove(link->stream, link->child);
+}
+
+/*
+ * mirror: the stream of a data loop delivers packets to the control loop
+ * children through a ring. the mirror is a child of the origin stream
+ * on the data loop and the parent of the children on the control loop
+ */
+
+#define MIRROR_BUFFER_SIZE (TS_PACKET_SIZE * 7 * 1024)
+
+struct module_stream_mirror_t
+{
+    module_stream_t stream;
+    module_stream_t *origin;
+
+    asc_thread_buffer_t *buffer;
+    asc_loop_reader_t *reader;
+
+    uint64_t dropped; // written by the origin loop
+
+    bool is_idle; // no childs, close after the dispatch
+    bool is_closed; // free after the dispatch
+};
+
+static void module_stream_mirror_on_ts_batch(  module_data_t *arg
+                                             , const uint8_t *ts, size_t count)
+{
+    module_stream_mirror_t *mirror = (module_stream_mirror_t *)arg;
+    const size_t size = count * TS_PACKET_SIZE;
+    if(asc_thread_buffer_write(mirror->buffer, ts, size) != (ssize_t)size)
+        __atomic_store_n(&mirror->dropped, mirror->dropped + count, __ATOMIC_RELAXED);
+}
+
+static void module_stream_mirror_on_ts(module_data_t *arg, const uint8_t *ts)
+{
+    module_stream_mirror_on_ts_batch(arg, ts, 1);
+}
+
+static void module_stream_mirror_free(module_stream_mirror_t *mirror)
+{
+    const uint64_t dropped = __atomic_load_n(&mirror->dropped, __ATOMIC_RELAXED);
+    if(dropped > 0)
+        asc_log_warning("[module_stream] control loop mirror dropped %" PRIu64 " packets", dropped);
+
+    asc_loop_reader_destroy(mirror->reader);
+    asc_thread_buffer_destroy(mirror->buffer);
+    module_stream_childs_release(&mirror->stream);
+    free(mirror);
+}
+
+static void module_stream_mirror_close(module_stream_mirror_t *mirror)
+{
+    module_stream_t *origin = mirror->origin;
+    if(origin)
+    {
+        module_stream_link_t link = { origin, &mirror->stream };
+        asc_loop_call_wait(origin->loop, module_stream_remove_call, &link);
+        origin->mirror = NULL;
+        mirror->origin = NULL;
+        mirror->stream.parent = NULL;
+
+        // children lose the upstream, the rest of the current dispatch is skipped
+        module_stream_childs_t *childs = mirror->stream.childs;
+        if(childs)
+        {
+            for(size_t n = 0; n < childs->count; ++n)
+            {
+                if(childs->item[n])
+                {
+                    childs->item[n]->parent = NULL;
+                    childs->item[n] = NULL;
+                }
+            }
+            module_stream_childs_replace(&mirror->stream, NULL);
+        }
+    }
+
+    if(mirror->stream.send_depth > 0)
+        mirror->is_closed = true;
+    else
+        module_stream_mirror_free(mirror);
+}
+
+static void module_stream_mirror_on_read(void *arg)
+{
+    module_stream_mirror_t *mirror = (module_stream_mirror_t *)arg;
+
+    const uint8_t *ts = NULL;
+    size_t size = asc_thread_buffer_peek(mirror->buffer, &ts);
+    size -= size % TS_PACKET_SIZE;
+    if(size > 0)
+        __module_stream_send_batch(&mirror->stream, ts, size / TS_PACKET_SIZE);
+
+    if(mirror->is_closed)
+    {
+        module_stream_mirror_free(mirror);
+        return;
+    }
+
+    asc_thread_buffer_consume(mirror->buffer, size);
+
+    if(mirror->is_idle && !mirror->stream.childs)
+        module_stream_mirror_close(mirror);
+}
+
+static module_stream_mirror_t * module_stream_mirror_open(module_stream_t *origin)
+{
+    module_stream_mirror_t *mirror =
+        (module_stream_mirror_t *)calloc(1, sizeof(module_stream_mirror_t));
+    asc_assert(mirror != NULL, "[module_stream] calloc() failed");
+
+    mirror->stream.self = (module_data_t *)mirror;
+    mirror->stream.on_ts = module_stream_mirror_on_ts;
+    mirror->stream.on_ts_batch = module_stream_mirror_on_ts_batch;
+    __module_stream_init(&mirror->stream);
+    mirror->stream.parent = origin;
+    mirror->origin = origin;
+
+    mirror->buffer = asc_thread_buffer_init(MIRROR_BUFFER_SIZE);
+    mirror->reader = asc_loop_reader_init(mirror->buffer, module_stream_mirror_on_read, mirror);
+
+    origin->mirror = mirror;
+
+    module_stream_link_t link = { origin, &mirror->stream };
+    asc_loop_call_wait(origin->loop, module_stream_insert_call, &link);
+
+    return mirror;
+}
+
+void __module_stream_detach(module_stream_t *stream, module_stream_t *child)
+{
     child->parent = NULL;
+
+    module_stream_link_t link = { stream, child };
+    asc_loop_call_wait(stream->loop, module_stream_remove_call, &link);
+
+    if(stream->on_ts == module_stream_mirror_on_ts && !stream->childs)
+    {
+        module_stream_mirror_t *mirror = (module_stream_mirror_t *)stream->self;
+        if(stream->send_depth > 0)
+            mirror->is_idle = true;
+        else
+            module_stream_mirror_close(mirror);
+    }
 }
 
 void __module_stream_attach(module_stream_t *stream, module_stream_t *child)
 {
     if(child->parent)
         __module_stream_detach(child->parent, child);
+
+    if(child->loop_safe)
+        child->loop = stream->loop;
+    else if(asc_loop_index(stream->loop) > 0)
+    {
+        // control loop child of the data loop stream
+        module_stream_mirror_t *mirror = stream->mirror;
+        if(!mirror)
+            mirror = module_stream_mirror_open(stream);
+        mirror->is_idle = false;
+        stream = &mirror->stream;
+    }
+
     child->parent = stream;
-    asc_list_insert_tail(stream->childs, child);
+
+    module_stream_link_t link = { stream, child };
+    asc_loop_call_wait(stream->loop, module_stream_insert_call, &link);
 }
 
-void __module_stream_send(module_stream_t *stream, const uint8_t *ts)
+/*
+ * profiled dispatch: the same as below, each child call is a profiler frame.
+ * detached child may be freed by its callback, its counters are skipped
+ */
+
+static void module_stream_send_profile(  module_stream_childs_t *childs
+                                       , const uint8_t *ts, size_t count, bool is_batch)
 {
-    asc_list_for(stream->childs)
+    for(size_t n = 0; n < childs->count; ++n)
     {
-        module_stream_t *i = (module_stream_t *)asc_list_data(stream->childs);
-        if(i->on_ts)
+        module_stream_t *const i = childs->item[n];
+        if(!i || !(i->on_ts || (is_batch && i->on_ts_batch)))
+            continue;
+
+        asc_profile_frame_t frame;
+        asc_profile_enter(&frame);
+        if(!is_batch)
             i->on_ts(i->self, ts);
+        else if(i->on_ts_batch)
+            i->on_ts_batch(i->self, ts, count);
+        else
+        {
+            for(size_t k = 0; k < count; ++k)
+            {
+                i->on_ts(i->self, &ts[k * TS_PACKET_SIZE]);
+                if(!childs->item[n])
+                    break;
+            }
+        }
+        asc_profile_leave(&frame, (childs->item[n] == i) ? &i->profile : NULL, count);
+    }
+}
+
+/*
+ * chunks: packets of the ingest chunk are referenced in place by the
+ * modules of the dispatch and the nested dispatches (channel forwards the
+ * input packets as is). other packets (remapped, mirror ring, generated)
+ * are copied into the writer chunk of the thread once per dispatch level:
+ * the copy is shared by the children of the stream until the level returns
+ */
+
+#define STREAM_CHUNK_DEPTH 32
+
+typedef struct
+{
+    const uint8_t *ts;
+    size_t size;
+    ts_chunk_t *chunk;
+    const uint8_t *data;
+} stream_chunk_copy_t;
+
+typedef struct
+{
+    uint32_t depth;
+    ts_chunk_t *ingest;
+    ts_chunk_t *writer;
+    stream_chunk_copy_t copy[STREAM_CHUNK_DEPTH];
+} stream_chunk_thread_t;
+
+static __thread stream_chunk_thread_t chunk_thread;
+
+static inline void stream_chunk_leave(void)
+{
+    const uint32_t depth = chunk_thread.depth--;
+    if(depth < STREAM_CHUNK_DEPTH && chunk_thread.copy[depth].chunk)
+    {
+        ts_chunk_unref(chunk_thread.copy[depth].chunk);
+        chunk_thread.copy[depth].chunk = NULL;
+    }
+}
+
+ts_chunk_t * module_stream_chunk(const uint8_t *ts, size_t count, const uint8_t **data)
+{
+    stream_chunk_thread_t *const t = &chunk_thread;
+    const size_t size = count * TS_PACKET_SIZE;
+
+    if(t->ingest && ts_chunk_contains(t->ingest, ts, size))
+    {
+        ts_chunk_ref(t->ingest);
+        *data = ts;
+        return t->ingest;
+    }
+
+    stream_chunk_copy_t *const copy = (t->depth > 0 && t->depth < STREAM_CHUNK_DEPTH)
+                                    ? &t->copy[t->depth]
+                                    : NULL;
+    if(copy && copy->chunk && ts >= copy->ts && ts + size <= copy->ts + copy->size)
+    {
+        ts_chunk_ref(copy->chunk);
+        *data = &copy->data[ts - copy->ts];
+        return copy->chunk;
+    }
+
+    ts_chunk_t *writer = t->writer;
+    if(!writer || ts_chunk_space(writer) < size)
+    {
+        if(writer)
+            ts_chunk_unref(writer);
+        writer = ts_chunk_alloc((size > TS_CHUNK_LARGE_SIZE) ? size : TS_CHUNK_LARGE_SIZE);
+        t->writer = writer;
+    }
+
+    uint8_t *const dst = ts_chunk_tail(writer);
+    memcpy(dst, ts, size);
+    writer->size += size;
+    ts_chunk_count_copies(count);
+
+    if(copy)
+    {
+        if(copy->chunk)
+            ts_chunk_unref(copy->chunk);
+        ts_chunk_ref(writer);
+        copy->ts = ts;
+        copy->size = size;
+        copy->chunk = writer;
+        copy->data = dst;
+    }
+
+    ts_chunk_ref(writer);
+    *data = dst;
+    return writer;
+}
+
+void __module_stream_send_chunk(  module_stream_t *stream, ts_chunk_t *chunk
+                                , const uint8_t *ts, size_t count)
+{
+    ts_chunk_t *const prev = chunk_thread.ingest;
+    chunk_thread.ingest = chunk;
+    __module_stream_send_batch(stream, ts, count);
+    chunk_thread.ingest = prev;
+}
+
+void __module_stream_send(module_stream_t *stream, const uint8_t *ts)
+{
+    module_stream_childs_t *const childs = stream->childs;
+    if(!childs)
+        return;
+
+    ++stream->send_depth;
+    ++chunk_thread.depth;
+    if(asc_profile_enabled)
+        module_stream_send_profile(childs, ts, 1, false);
+    else
+    {
+        const size_t count = childs->count;
+        for(size_t n = 0; n < count; ++n)
+        {
+            module_stream_t *const i = childs->item[n];
+            if(i && i->on_ts)
+                i->on_ts(i->self, ts);
+        }
+    }
+    stream_chunk_leave();
+    if(--stream->send_depth == 0 && stream->childs_retired)
+        module_stream_childs_release(stream);
+}
+
+void __module_stream_send_batch(module_stream_t *stream, const uint8_t *ts, size_t count)
+{
+    module_stream_childs_t *const childs = stream->childs;
+    if(!childs)
+        return;
+
+    ++stream->send_depth;
+    ++chunk_thread.depth;
+    if(asc_profile_enabled)
+    {
+        module_stream_send_profile(childs, ts, count, true);
+        stream_chunk_leave();
+        if(--stream->send_depth == 0 && stream->childs_retired)
+            module_stream_childs_release(stream);
+        return;
     }
+
+    for(size_t n = 0; n < childs->count; ++n)
+    {
+        module_stream_t *const i = childs->item[n];
+        if(!i)
+            continue;
+
+        if(i->on_ts_batch)
+            i->on_ts_batch(i->self, ts, count);
+        else if(i->on_ts)
+        {
+            for(size_t k = 0; k < count; ++k)
+            {
+                i->on_ts(i->self, &ts[k * TS_PACKET_SIZE]);
+                // detached in the middle of the batch
+                if(!childs->item[n])
+                    break;
+            }
+        }
+    }
+    stream_chunk_leave();
+    if(--stream->send_depth == 0 && stream->childs_retired)
+        module_stream_childs_release(stream);
 }
 
 void __module_stream_init(module_stream_t *stream)
 {
-    stream->childs = asc_list_init();
+    stream->childs = NULL;
+    stream->childs_retired = NULL;
+    stream->send_depth = 0;
+
+    stream->loop = NULL;
+    stream->loop_safe = false;
+    stream->mirror = NULL;
+
+    memset(&stream->profile, 0, sizeof(stream->profile));
+    stream->profile_type = NULL;
+    stream->profile_name = NULL;
+    stream->profile_next = NULL;
+    stream->profile_prev = NULL;
+}
+
+/*
+ * profiler: list of the module instances, control loop only
+ */
+
+static module_stream_t *profile_list = NULL;
+
+void __module_stream_profile_init(module_stream_t *stream)
+{
+    if(!module_lua_type)
+        return;
+
+    stream->profile_type = module_lua_type;
+    const char *name = NULL;
+    if(module_option_string("name", &name, NULL) && name[0])
+        stream->profile_name = strdup(name);
+
+    stream->profile_prev = NULL;
+    stream->profile_next = profile_list;
+    if(profile_list)
+        profile_list->profile_prev = stream;
+    profile_list = stream;
+
+    asc_profile_register(stream->self, &stream->profile);
+}
+
+static void module_stream_profile_destroy(module_stream_t *stream)
+{
+    if(!stream->profile_type)
+        return;
+
+    if(stream->profile_prev)
+        stream->profile_prev->profile_next = stream->profile_next;
+    else
+        profile_list = stream->profile_next;
+    if(stream->profile_next)
+        stream->profile_next->profile_prev = stream->profile_prev;
+
+    stream->profile_type = NULL;
+    ASC_FREE(stream->profile_name, free);
+}
+
+size_t module_stream_profile_list(module_stream_profile_t *list, size_t size)
+{
+    size_t count = 0;
+    for(module_stream_t *i = profile_list; i && count < size; i = i->profile_next)
+    {
+        module_stream_profile_t *const item = &list[count++];
+        item->type = i->profile_type;
+        item->loop = asc_loop_index(i->loop);
+
+        // modules without name belong to the stream of the upstream
+        item->name = NULL;
+        const module_stream_t *s = i;
+        for(int depth = 0; s && depth < 32; ++depth)
+        {
+            if(s->profile_name)
+            {
+                item->name = s->profile_name;
+                break;
+            }
+            // the parent of the mirror is the origin stream
+            s = s->parent;
+        }
+
+        asc_profile_read(&i->profile, &item->profile);
+    }
+    return count;
+}
+
+static void module_stream_destroy_call(void *arg)
+{
+    module_stream_t *stream = (module_stream_t *)arg;
+
+    module_stream_childs_t *childs = stream->childs;
+    if(childs)
+    {
+        for(size_t n = 0; n < childs->count; ++n)
+        {
+            if(childs->item[n])
+                childs->item[n]->parent = NULL;
+        }
+        stream->childs = NULL;
+        free(childs);
+    }
+    module_stream_childs_release(stream);
+
+    // removed on the loop of the module: its callbacks are not running now
+    if(stream->profile_type)
+        asc_profile_unregister(stream->self);
 }
 
 void __module_stream_destroy(module_stream_t *stream)
@@ -61,13 +611,9 @@ void __module_stream_destroy(module_stream_t *stream)
     if(stream->parent)
         __module_stream_detach(stream->parent, stream);
 
-    asc_list_first(stream->childs);
-    while(!asc_list_eol(stream->childs))
-    {
-        module_stream_t *i = (module_stream_t *)asc_list_data(stream->childs);
-        i->parent = NULL;
-        asc_list_remove_current(stream->childs);
-    }
-    asc_list_destroy(stream->childs);
-    stream->childs = NULL;
+    if(stream->mirror)
+        module_stream_mirror_close(stream->mirror);
+
+    asc_loop_call_wait(stream->loop, module_stream_destroy_call, stream);
+    module_stream_profile_destroy(stream);
 }
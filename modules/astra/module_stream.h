@@ -23,9 +23,22 @@
 
 #include "base.h"
 #include "module_lua.h"
+#include "ts_chunk.h"
 #include <core/asc.h>
 
 typedef struct module_stream_t module_stream_t;
+typedef struct module_stream_mirror_t module_stream_mirror_t;
+
+// children of the stream. the array is never modified in place:
+// attach/detach publish a new copy, so dispatch is a plain loop
+typedef struct module_stream_childs_t module_stream_childs_t;
+struct module_stream_childs_t
+{
+    module_stream_childs_t *retired;
+    size_t count;
+    module_stream_t *item[];
+};
+
 struct module_stream_t
 {
     module_data_t *self;
@@ -33,30 +46,63 @@ struct module_stream_t
 
     // stream
     void (*on_ts)(module_data_t *mod, const uint8_t *ts);
+    // optional: count contiguous TS packets in one call.
+    // children without it receive the batch packet by packet via on_ts
+    void (*on_ts_batch)(module_data_t *mod, const uint8_t *ts, size_t count);
+
+    module_stream_childs_t *childs;
+    module_stream_childs_t *childs_retired;
+    uint32_t send_depth;
 
-    asc_list_t *childs;
+    // loop (core/loop.h) of the stream dispatch, NULL - control loop.
+    // loop_safe streams follow the loop of the upstream, others are fed
+    // on the control loop through the mirror of a data loop upstream
+    asc_loop_t *loop;
+    bool loop_safe;
+    module_stream_mirror_t *mirror;
 
     // demux
     void (*join_pid)(module_data_t *mod, uint16_t pid);
     void (*leave_pid)(module_data_t *mod, uint16_t pid);
 
     uint8_t *pid_list;
+
+    // profiler (core/profile.h): stream callbacks of the module, events and
+    // timers with the module as argument. instances created by Lua are listed
+    asc_profile_t profile;
+    const char *profile_type;
+    char *profile_name; // NULL - name of the upstream
+    module_stream_t *profile_next;
+    module_stream_t *profile_prev;
 };
 
+typedef struct
+{
+    const char *type;
+    const char *name;
+    int loop;
+    asc_profile_t profile;
+} module_stream_profile_t;
+
 #define MODULE_STREAM_DATA() module_stream_t __stream
 
 // stream
 
 void __module_stream_init(module_stream_t *stream);
+void __module_stream_profile_init(module_stream_t *stream);
 void __module_stream_destroy(module_stream_t *stream);
 void __module_stream_attach(module_stream_t *stream, module_stream_t *child);
 void __module_stream_send(module_stream_t *stream, const uint8_t *ts);
+void __module_stream_send_batch(module_stream_t *stream, const uint8_t *ts, size_t count);
+void __module_stream_send_chunk(  module_stream_t *stream, ts_chunk_t *chunk
+                                , const uint8_t *ts, size_t count);
 
 #define module_stream_init(_mod, _on_ts)                                                        \
     {                                                                                           \
         _mod->__stream.self = _mod;                                                             \
         _mod->__stream.on_ts = _on_ts;                                                          \
         __module_stream_init(&_mod->__stream);                                                  \
+        __module_stream_profile_init(&_mod->__stream);                                          \
         lua_getfield(lua, MODULE_OPTIONS_IDX, "upstream");                                      \
         if(lua_type(lua, -1) == LUA_TLIGHTUSERDATA)                                             \
         {                                                                                       \
@@ -66,6 +112,32 @@ void __module_stream_send(module_stream_t *stream, const uint8_t *ts);
         lua_pop(lua, 1);                                                                        \
     }
 
+// the module may run on the data loop of its upstream: stream callbacks,
+// timers and events of the module don't touch Lua and control loop objects.
+// use it at the end of module_init(), when the module is ready for data
+#define module_stream_init_loop(_mod, _on_ts)                                                   \
+    {                                                                                           \
+        _mod->__stream.self = _mod;                                                             \
+        _mod->__stream.on_ts = _on_ts;                                                          \
+        __module_stream_init(&_mod->__stream);                                                  \
+        __module_stream_profile_init(&_mod->__stream);                                          \
+        _mod->__stream.loop_safe = true;                                                        \
+        lua_getfield(lua, MODULE_OPTIONS_IDX, "upstream");                                      \
+        if(lua_type(lua, -1) == LUA_TLIGHTUSERDATA)                                             \
+        {                                                                                       \
+            module_stream_t *_stream = (module_stream_t *)lua_touserdata(lua, -1);              \
+            __module_stream_attach(_stream, &_mod->__stream);                                   \
+        }                                                                                       \
+        lua_pop(lua, 1);                                                                        \
+    }
+
+#define module_stream_loop(_mod) (_mod->__stream.loop)
+
+#define module_stream_batch_set(_mod, _on_ts_batch)                                             \
+    {                                                                                           \
+        _mod->__stream.on_ts_batch = _on_ts_batch;                                              \
+    }
+
 #define module_stream_demux_set(_mod, _join_pid, _leave_pid)                                    \
     {                                                                                           \
         _mod->__stream.pid_list = (uint8_t *)calloc(MAX_PID, sizeof(uint8_t));                  \
@@ -97,6 +169,28 @@ void __module_stream_send(module_stream_t *stream, const uint8_t *ts);
 #define module_stream_send(_mod, _ts)                                                           \
     __module_stream_send(&_mod->__stream, _ts)
 
+#define module_stream_send_batch(_mod, _ts, _count)                                             \
+    __module_stream_send_batch(&_mod->__stream, _ts, _count)
+
+// packets in the written part of the chunk, the caller keeps its reference
+// until return. consumers take references instead of copying
+#define module_stream_send_chunk(_mod, _chunk, _ts, _count)                                     \
+    __module_stream_send_chunk(&_mod->__stream, _chunk, _ts, _count)
+
+/*
+ * zero-copy consumer, stream callbacks only: reference to count packets
+ * at ts, *data is the location of the packets in the chunk.
+ * packets of the ingest chunk are referenced in place, others are copied
+ * once per dispatch for all children of the stream
+ */
+ts_chunk_t * module_stream_chunk(const uint8_t *ts, size_t count, const uint8_t **data) __wur;
+
+/*
+ * copy up to size instances into list, returns number of instances.
+ * control loop only, names are valid until the next return to the loop
+ */
+size_t module_stream_profile_list(module_stream_profile_t *list, size_t size);
+
 // demux
 
 #define module_stream_demux_check_pid(_mod, _pid)                                               \
@@ -0,0 +1,134 @@
+/*
+ * Astra Module: Profiler
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Per-module-instance CPU profiler (core/profile.h), disabled by default
+ *
+ * Methods:
+ *      profiler.set({ options })
+ *                  - set options:
+ *                    enabled - boolean, counters are cleared on enable
+ *                    sample - number, time one of N callbacks, default 8
+ *      profiler.get()
+ *                  - return table: { enabled, sample, elapsed_us }
+ *      profiler.stats()
+ *                  - return table, per module instance since enable:
+ *                    { { type, name, loop, calls, packets, cpu_ns, max_ns }, ... }
+ *                    name is the "name" option of the module or its upstream,
+ *                    cpu_ns is self time, without the downstream modules
+ */
+
+#include <astra.h>
+
+#define PROFILER_STATS_MAX 16384
+
+static int lua_profiler_set(lua_State *L)
+{
+    luaL_checktype(L, 1, LUA_TTABLE);
+
+    bool enabled = asc_profile_enabled;
+    unsigned int sample = asc_profile_sample();
+
+    lua_getfield(L, 1, "enabled");
+    if(!lua_isnil(L, -1))
+        enabled = lua_toboolean(L, -1);
+    lua_pop(L, 1);
+
+    lua_getfield(L, 1, "sample");
+    if(lua_isnumber(L, -1))
+    {
+        const lua_Number value = lua_tonumber(L, -1);
+        sample = (value >= 1) ? (unsigned int)value : 1;
+    }
+    lua_pop(L, 1);
+
+    asc_profile_set(enabled, sample);
+    return 0;
+}
+
+static int lua_profiler_get(lua_State *L)
+{
+    lua_newtable(L);
+
+    lua_pushboolean(L, asc_profile_enabled);
+    lua_setfield(L, -2, "enabled");
+
+    lua_pushinteger(L, (lua_Integer)asc_profile_sample());
+    lua_setfield(L, -2, "sample");
+
+    lua_pushnumber(L, (lua_Number)asc_profile_elapsed());
+    lua_setfield(L, -2, "elapsed_us");
+
+    return 1;
+}
+
+static int lua_profiler_stats(lua_State *L)
+{
+    module_stream_profile_t *const list = (module_stream_profile_t *)malloc(
+        sizeof(module_stream_profile_t) * PROFILER_STATS_MAX);
+    asc_assert(list != NULL, "[profiler] malloc() failed");
+    const size_t count = module_stream_profile_list(list, PROFILER_STATS_MAX);
+
+    lua_newtable(L);
+    for(size_t i = 0; i < count; ++i)
+    {
+        const module_stream_profile_t *const item = &list[i];
+        lua_newtable(L);
+
+        lua_pushstring(L, item->type);
+        lua_setfield(L, -2, "type");
+
+        lua_pushstring(L, (item->name) ? item->name : "");
+        lua_setfield(L, -2, "name");
+
+        lua_pushinteger(L, item->loop);
+        lua_setfield(L, -2, "loop");
+
+        lua_pushnumber(L, (lua_Number)item->profile.calls);
+        lua_setfield(L, -2, "calls");
+
+        lua_pushnumber(L, (lua_Number)item->profile.packets);
+        lua_setfield(L, -2, "packets");
+
+        lua_pushnumber(L, (lua_Number)item->profile.cpu_ns);
+        lua_setfield(L, -2, "cpu_ns");
+
+        lua_pushnumber(L, (lua_Number)item->profile.max_ns);
+        lua_setfield(L, -2, "max_ns");
+
+        lua_rawseti(L, -2, (int)i + 1);
+    }
+
+    free(list);
+    return 1;
+}
+
+LUA_API int luaopen_profiler(lua_State *L)
+{
+    static const luaL_Reg api[] =
+    {
+        { "set", lua_profiler_set },
+        { "get", lua_profiler_get },
+        { "stats", lua_profiler_stats },
+        { NULL, NULL }
+    };
+
+    luaL_newlib(L, api);
+    lua_setglobal(L, "profiler");
+
+    return 0;
+}
@@ -0,0 +1,194 @@
+/*
+ * Astra Module: TS Chunk Pool
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ts_chunk.h"
+
+#ifndef _WIN32
+#   include <pthread.h>
+#   define CHUNK_LOCK(_c) pthread_mutex_lock(&(_c)->lock)
+#   define CHUNK_UNLOCK(_c) pthread_mutex_unlock(&(_c)->lock)
+#   define CHUNK_LOCK_INIT , PTHREAD_MUTEX_INITIALIZER
+#else
+    /* no data loops: chunks are used by the control loop only */
+#   define CHUNK_LOCK(_c) {}
+#   define CHUNK_UNLOCK(_c) {}
+#   define CHUNK_LOCK_INIT
+#endif
+
+#define MSG(_msg) "[ts_chunk] " _msg
+
+#define TS_CHUNK_SLAB 64 // chunks per slab
+#define TS_CHUNK_STATS_BATCH 256 // counters of the thread are published by batches
+
+typedef struct
+{
+    size_t capacity;
+    ts_chunk_t *free_list;
+#ifndef _WIN32
+    pthread_mutex_t lock;
+#endif
+} ts_chunk_class_t;
+
+static ts_chunk_class_t chunk_class[] =
+{
+    { TS_CHUNK_SMALL_SIZE, NULL CHUNK_LOCK_INIT },
+    { TS_CHUNK_LARGE_SIZE, NULL CHUNK_LOCK_INIT },
+};
+
+#define TS_CHUNK_CLASSES (int)(sizeof(chunk_class) / sizeof(chunk_class[0]))
+
+static ts_chunk_stats_t chunk_stats;
+
+static __thread uint32_t thread_refs = 0;
+static __thread uint32_t thread_copies = 0;
+
+static inline void stats_add(uint64_t *counter, uint64_t value)
+{
+    __atomic_add_fetch(counter, value, __ATOMIC_RELAXED);
+}
+
+static void stats_in_use(int64_t delta)
+{
+    const uint64_t in_use = __atomic_add_fetch(&chunk_stats.in_use, (uint64_t)delta, __ATOMIC_RELAXED);
+    if(delta < 0)
+        return;
+
+    uint64_t high_water = __atomic_load_n(&chunk_stats.high_water, __ATOMIC_RELAXED);
+    while(in_use > high_water
+          && !__atomic_compare_exchange_n(&chunk_stats.high_water, &high_water, in_use
+                                          , true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    {
+        ;
+    }
+}
+
+/* class lock is held */
+static void chunk_slab_alloc(int type)
+{
+    ts_chunk_class_t *const c = &chunk_class[type];
+    const size_t item_size = sizeof(ts_chunk_t) + c->capacity;
+    uint8_t *const slab = (uint8_t *)malloc(item_size * TS_CHUNK_SLAB);
+    asc_assert(slab != NULL, MSG("malloc() failed"));
+
+    for(int i = TS_CHUNK_SLAB - 1; i >= 0; --i)
+    {
+        ts_chunk_t *const chunk = (ts_chunk_t *)&slab[item_size * (size_t)i];
+        chunk->capacity = (uint32_t)c->capacity;
+        chunk->type = type;
+        chunk->data = (uint8_t *)(chunk + 1);
+        chunk->next = c->free_list;
+        c->free_list = chunk;
+    }
+
+    stats_add(&chunk_stats.slabs, 1);
+    stats_add(&chunk_stats.chunks, TS_CHUNK_SLAB);
+    stats_add(&chunk_stats.bytes, item_size * TS_CHUNK_SLAB);
+}
+
+ts_chunk_t * ts_chunk_alloc(size_t size)
+{
+    ts_chunk_t *chunk = NULL;
+
+    int type = 0;
+    while(type < TS_CHUNK_CLASSES && chunk_class[type].capacity < size)
+        ++type;
+
+    if(type < TS_CHUNK_CLASSES)
+    {
+        ts_chunk_class_t *const c = &chunk_class[type];
+        CHUNK_LOCK(c);
+        if(!c->free_list)
+            chunk_slab_alloc(type);
+        chunk = c->free_list;
+        c->free_list = chunk->next;
+        CHUNK_UNLOCK(c);
+    }
+    else
+    {
+        chunk = (ts_chunk_t *)malloc(sizeof(ts_chunk_t) + size);
+        asc_assert(chunk != NULL, MSG("malloc() failed"));
+        chunk->capacity = (uint32_t)size;
+        chunk->type = -1;
+        chunk->data = (uint8_t *)(chunk + 1);
+        stats_add(&chunk_stats.bytes, sizeof(ts_chunk_t) + size);
+    }
+
+    chunk->next = NULL;
+    chunk->refcount = 1;
+    chunk->size = 0;
+
+    stats_add(&chunk_stats.allocs, 1);
+    stats_in_use(1);
+
+    return chunk;
+}
+
+void ts_chunk_ref(ts_chunk_t *chunk)
+{
+    __atomic_add_fetch(&chunk->refcount, 1, __ATOMIC_RELAXED);
+
+    if(++thread_refs == TS_CHUNK_STATS_BATCH)
+    {
+        stats_add(&chunk_stats.refs, thread_refs);
+        thread_refs = 0;
+    }
+}
+
+void ts_chunk_unref(ts_chunk_t *chunk)
+{
+    // the last reference sees all writes of the owner
+    if(__atomic_sub_fetch(&chunk->refcount, 1, __ATOMIC_ACQ_REL) > 0)
+        return;
+
+    stats_in_use(-1);
+
+    if(chunk->type < 0)
+    {
+        stats_add(&chunk_stats.bytes, (uint64_t)0 - (sizeof(ts_chunk_t) + chunk->capacity));
+        free(chunk);
+        return;
+    }
+
+    ts_chunk_class_t *const c = &chunk_class[chunk->type];
+    CHUNK_LOCK(c);
+    chunk->next = c->free_list;
+    c->free_list = chunk;
+    CHUNK_UNLOCK(c);
+}
+
+void ts_chunk_count_copies(size_t count)
+{
+    thread_copies += (uint32_t)count;
+    if(thread_copies >= TS_CHUNK_STATS_BATCH)
+    {
+        stats_add(&chunk_stats.copies, thread_copies);
+        thread_copies = 0;
+    }
+}
+
+void ts_chunk_stats(ts_chunk_stats_t *stats)
+{
+    stats->slabs = __atomic_load_n(&chunk_stats.slabs, __ATOMIC_RELAXED);
+    stats->chunks = __atomic_load_n(&chunk_stats.chunks, __ATOMIC_RELAXED);
+    stats->in_use = __atomic_load_n(&chunk_stats.in_use, __ATOMIC_RELAXED);
+    stats->high_water = __atomic_load_n(&chunk_stats.high_water, __ATOMIC_RELAXED);
+    stats->bytes = __atomic_load_n(&chunk_stats.bytes, __ATOMIC_RELAXED);
+    stats->allocs = __atomic_load_n(&chunk_stats.allocs, __ATOMIC_RELAXED);
+    // published by batches of the threads
+    stats->refs = __atomic_load_n(&chunk_stats.refs, __ATOMIC_RELAXED);
+    stats->copies = __atomic_load_n(&chunk_stats.copies, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,72 @@
+/*
+ * Astra Module: TS Chunk Pool
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _TS_CHUNK_H_
+#define _TS_CHUNK_H_ 1
+
+#include <core/asc.h>
+
+/*
+ * Refcounted chunks of TS packets. The input fills a chunk once, the
+ * consumers keep references to the packets instead of copying them.
+ * Written bytes (0..size) are immutable, only the owner of the first
+ * reference appends to the free space behind them.
+ * Chunks are allocated from slabs and never returned to the system,
+ * chunks bigger than the large class are allocated one by one.
+ */
+
+#define TS_CHUNK_SMALL_SIZE 1472 // one UDP datagram: 7 packets with RTP header
+#define TS_CHUNK_LARGE_SIZE (64 * 188)
+
+typedef struct ts_chunk_t ts_chunk_t;
+struct ts_chunk_t
+{
+    ts_chunk_t *next; // free list of the class
+    uint32_t refcount;
+    uint32_t size;
+    uint32_t capacity;
+    int type; // pool class, -1 - not pooled
+    uint8_t *data;
+};
+
+typedef struct
+{
+    uint64_t slabs;
+    uint64_t chunks; // allocated in slabs
+    uint64_t in_use; // pooled and not pooled
+    uint64_t high_water;
+    uint64_t bytes; // memory of the slabs and not pooled chunks in use
+
+    uint64_t allocs;
+    uint64_t refs; // references taken by the consumers
+    uint64_t copies; // packets copied into a chunk by the consumer side
+} ts_chunk_stats_t;
+
+/* refcount 1, size 0. capacity is at least size */
+ts_chunk_t * ts_chunk_alloc(size_t size) __wur;
+void ts_chunk_ref(ts_chunk_t *chunk);
+void ts_chunk_unref(ts_chunk_t *chunk);
+
+#define ts_chunk_space(_chunk) ((_chunk)->capacity - (_chunk)->size)
+#define ts_chunk_tail(_chunk) (&(_chunk)->data[(_chunk)->size])
+#define ts_chunk_contains(_chunk, _ptr, _size)                                                  \
+    ((_ptr) >= (_chunk)->data && (_ptr) + (_size) <= (_chunk)->data + (_chunk)->size)
+
+void ts_chunk_count_copies(size_t count);
+void ts_chunk_stats(ts_chunk_stats_t *stats);
+
+#endif /* _TS_CHUNK_H_ */
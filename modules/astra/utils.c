@@ -30,6 +30,13 @@
  *                  - file/folder information
  *      utils.readdir(path)
  *                  - iterator to scan directory located by path
+ *      utils.timer_stats()
+ *                  - per-callback timer accounting, since process start:
+ *                    { { name, calls, runtime_us, max_us }, ... }
+ *      utils.ts_pool_stats()
+ *                  - TS chunk pool (modules/astra/ts_chunk.h):
+ *                    { slabs, chunks, in_use, high_water, bytes,
+ *                      allocs, refs, copies }
  */
 
 #include <astra.h>
@@ -379,6 +386,76 @@ static int utils_readder_gc(lua_State *L)
     return 0;
 }
 
+/* timer_stats */
+
+#define TIMER_STATS_MAX 1024
+
+static int utils_timer_stats(lua_State *L)
+{
+    asc_timer_stat_t *const list =
+        (asc_timer_stat_t *)malloc(sizeof(asc_timer_stat_t) * TIMER_STATS_MAX);
+    const size_t count = asc_timer_stats(list, TIMER_STATS_MAX);
+
+    lua_newtable(L);
+    for(size_t i = 0; i < count; ++i)
+    {
+        lua_newtable(L);
+
+        lua_pushstring(L, list[i].name);
+        lua_setfield(L, -2, "name");
+
+        lua_pushnumber(L, (lua_Number)list[i].calls);
+        lua_setfield(L, -2, "calls");
+
+        lua_pushnumber(L, (lua_Number)list[i].runtime_us);
+        lua_setfield(L, -2, "runtime_us");
+
+        lua_pushnumber(L, (lua_Number)list[i].max_us);
+        lua_setfield(L, -2, "max_us");
+
+        lua_rawseti(L, -2, (int)i + 1);
+    }
+
+    free(list);
+    return 1;
+}
+
+/* ts_pool_stats */
+
+static int utils_ts_pool_stats(lua_State *L)
+{
+    ts_chunk_stats_t stats;
+    ts_chunk_stats(&stats);
+
+    lua_newtable(L);
+
+    lua_pushnumber(L, (lua_Number)stats.slabs);
+    lua_setfield(L, -2, "slabs");
+
+    lua_pushnumber(L, (lua_Number)stats.chunks);
+    lua_setfield(L, -2, "chunks");
+
+    lua_pushnumber(L, (lua_Number)stats.in_use);
+    lua_setfield(L, -2, "in_use");
+
+    lua_pushnumber(L, (lua_Number)stats.high_water);
+    lua_setfield(L, -2, "high_water");
+
+    lua_pushnumber(L, (lua_Number)stats.bytes);
+    lua_setfield(L, -2, "bytes");
+
+    lua_pushnumber(L, (lua_Number)stats.allocs);
+    lua_setfield(L, -2, "allocs");
+
+    lua_pushnumber(L, (lua_Number)stats.refs);
+    lua_setfield(L, -2, "refs");
+
+    lua_pushnumber(L, (lua_Number)stats.copies);
+    lua_setfield(L, -2, "copies");
+
+    return 1;
+}
+
 /* utils */
 
 LUA_API int luaopen_utils(lua_State *L)
@@ -395,6 +472,8 @@ LUA_API int luaopen_utils(lua_State *L)
         { "embedded_enabled", utils_embedded_enabled },
         { "embedded_exists", utils_embedded_exists },
         { "embedded_read", utils_embedded_read },
+        { "timer_stats", utils_timer_stats },
+        { "ts_pool_stats", utils_ts_pool_stats },
         { NULL, NULL }
     };
 
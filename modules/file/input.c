@@ -332,12 +332,14 @@ static void on_thread_read(void *arg)
 {
     module_data_t *mod = (module_data_t *)arg;
 
-    uint8_t ts[TS_PACKET_SIZE];
-    const ssize_t r = asc_thread_buffer_read(mod->thread_output, ts, TS_PACKET_SIZE);
-    if(r != TS_PACKET_SIZE)
+    const uint8_t *ts = NULL;
+    size_t size = asc_thread_buffer_peek(mod->thread_output, &ts);
+    size -= size % TS_PACKET_SIZE;
+    if(!size)
         return;
 
-    module_stream_send(mod, ts);
+    module_stream_send_batch(mod, ts, size / TS_PACKET_SIZE);
+    asc_thread_buffer_consume(mod->thread_output, size);
 }
 
 static void timer_skip_set(void *arg)
@@ -419,7 +421,9 @@ static void module_init(module_data_t *mod)
     }
 
     mod->thread = asc_thread_init(mod);
-    mod->thread_output = asc_thread_buffer_init(mod->buffer_size);
+    // packet aligned: peek always returns whole packets
+    mod->thread_output = asc_thread_buffer_init(  mod->buffer_size
+                                                - mod->buffer_size % TS_PACKET_SIZE);
     asc_thread_start(  mod->thread
                      , thread_loop
                      , on_thread_read, mod->thread_output
@@ -889,7 +889,7 @@ static void hls_finish_segment(module_data_t *mod)
     mod->segment_elapsed_us = 0;
     mod->segment_packets = 0;
     mod->segment_open = false;
-    mod->wall_last = asc_utime();
+    mod->wall_last = asc_now_us();
 }
 
 static void hls_open_segment(module_data_t *mod)
@@ -932,7 +932,7 @@ static void hls_open_segment(module_data_t *mod)
 
         mod->segment_elapsed_us = 0;
         mod->segment_packets = 0;
-        mod->wall_last = asc_utime();
+        mod->wall_last = asc_now_us();
         return;
     }
 
@@ -948,7 +948,7 @@ static void hls_open_segment(module_data_t *mod)
 
     mod->segment_elapsed_us = 0;
     mod->segment_packets = 0;
-    mod->wall_last = asc_utime();
+    mod->wall_last = asc_now_us();
 }
 
 static void hls_mark_discontinuity(module_data_t *mod)
@@ -1197,7 +1197,7 @@ static void on_ts(module_data_t *mod, const uint8_t *ts)
     uint64_t delta_us = 0;
     if(mod->use_wall)
     {
-        uint64_t now = asc_utime();
+        uint64_t now = asc_now_us();
         if(mod->wall_last == 0)
             mod->wall_last = now;
         if(now > mod->wall_last)
@@ -1228,6 +1228,15 @@ static void on_ts(module_data_t *mod, const uint8_t *ts)
     }
 }
 
+static void on_ts_batch(module_data_t *mod, const uint8_t *ts, size_t count)
+{
+    if(mod->storage_mode == HLS_STORAGE_MEMFD && !mod->hls_active)
+        return;
+
+    for(size_t i = 0; i < count; ++i)
+        on_ts(mod, &ts[i * TS_PACKET_SIZE]);
+}
+
 bool hls_memfd_touch(const char *stream_id)
 {
     module_data_t *mod = hls_memfd_find_stream(stream_id);
@@ -1364,6 +1373,7 @@ void hls_memfd_sweep(uint64_t now_us, int idle_timeout_sec)
 static void module_init(module_data_t *mod)
 {
     module_stream_init(mod, on_ts);
+    module_stream_batch_set(mod, on_ts_batch);
 
     mod->storage_mode = HLS_STORAGE_DISK;
     const char *storage = NULL;
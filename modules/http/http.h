@@ -9,6 +9,7 @@
 
 typedef struct http_response_t http_response_t;
 typedef struct http_client_t http_client_t;
+typedef struct http_worker_t http_worker_t;
 
 struct http_client_t
 {
@@ -39,6 +40,12 @@ struct http_client_t
     http_response_t *response;
 
     int idx_content;
+
+    // accepted by the worker of the server (workers option), NULL - control loop
+    http_worker_t *worker;
+    asc_loop_t *loop;
+    uint64_t accept_time;
+    TAILQ_ENTRY(http_client_t) worker_entry;
 };
 
 // HTTP Server API
@@ -54,6 +61,9 @@ void http_client_close(http_client_t *client);
 void http_client_redirect(http_client_t *client, int code, const char *location);
 void http_client_abort(http_client_t *client, int code, const char *text);
 
+/* long-lived response of the worker client is served on client->loop */
+void http_client_worker_stream(http_client_t *client, bool is_started);
+
 // Utils
 
 void lua_string_to_lower(const char *str, size_t size);
@@ -23,122 +23,697 @@
 
 #define DEFAULT_BUFFER_SIZE (1024 * 1024)
 #define DEFAULT_BUFFER_FILL (128 * 1024)
+#define SEND_IOV_MAX 64
+#define LAG_CHECK_INTERVAL 1000
+#define TAP_BUFFER_RECORDS 4096
 
 struct module_data_t
 {
     int idx_callback;
 };
 
-struct http_response_t
+/*
+ * Clients of one upstream share a ring: the stream is attached once, the
+ * packets are referenced once (modules/astra/ts_chunk.h) and every client
+ * keeps only its position in the stream. Dispatch and memory don't depend
+ * on the number of clients: the ring wakes only the clients that have
+ * buffer_fill bytes to send, a slow client is noticed when it is writable
+ * (or by the lag timer) and skips to the last keyframe or is disconnected.
+ *
+ * Clients accepted by a worker of the http_server (client->loop) are served
+ * on the worker loop. The ring of the upstream passes the references of its
+ * segments through a tap (SPSC buffer) to the ring of the worker loop, the
+ * worker sends them to a duplicate of the client socket. The control loop
+ * keeps the socket to detect the disconnect, the worker shuts the connection
+ * down on a send error or a lag disconnect.
+ */
+
+typedef struct upstream_ring_t upstream_ring_t;
+typedef struct upstream_tap_t upstream_tap_t;
+
+typedef struct
 {
-    MODULE_STREAM_DATA();
+    ts_chunk_t *chunk;
+    const uint8_t *data;
+    size_t size;
+    uint64_t pos;
+} upstream_segment_t;
 
+struct http_response_t
+{
     module_data_t *mod;
+    http_client_t *client;
+
+    upstream_ring_t *ring;
+    TAILQ_ENTRY(http_response_t) entry;
+    TAILQ_ENTRY(http_response_t) idle_entry;
 
-    uint8_t *buffer;
-    size_t buffer_count;
-    size_t buffer_read;
-    size_t buffer_write;
+    asc_socket_t *sock; // client->sock or its duplicate on the worker loop
+    upstream_tap_t *tap; // served on the worker loop
+
+    uint64_t cursor; // position in the stream of the next byte to send
+    uint64_t wake; // idle: position of the ring tail to wake at
+    size_t pad; // bytes to complete the packet interrupted by a skip
 
     size_t buffer_size;
     size_t buffer_fill;
+    bool lag_disconnect;
 
     bool is_socket_busy;
+
+    // client is served by the udp_relay worker (modules/udp/relay.c)
+    int idx_relay;
+    int relay_id;
 };
 
+TAILQ_HEAD(upstream_clients_t, http_response_t);
+
+struct upstream_ring_t
+{
+    MODULE_STREAM_DATA();
+
+    module_stream_t *upstream;
+
+    // references to the packets in the pool chunks, pos - stream position of data
+    upstream_segment_t *queue;
+    size_t queue_size;
+    size_t queue_head;
+    size_t queue_count;
+
+    uint64_t tail; // bytes received
+    size_t buffer_max; // the largest buffer_size of the clients
+
+    // packet with payload_unit_start_indicator and random_access_indicator
+    uint64_t checkpoint;
+    bool is_checkpoint;
+
+    struct upstream_clients_t clients;
+    struct upstream_clients_t idle; // sorted by wake
+    bool is_checking;
+
+    asc_timer_t *timer;
+
+    // the ring of the upstream: taps by the loop index, the ring of a worker loop: its tap
+    upstream_tap_t **taps;
+    int tap_count;
+    upstream_tap_t *tap;
+
+    TAILQ_ENTRY(upstream_ring_t) entry;
+};
+
+struct upstream_tap_t
+{
+    upstream_ring_t *origin;
+    asc_loop_t *loop;
+    int clients; // control loop
+
+    asc_thread_buffer_t *buffer; // upstream_segment_t, a reference per record
+    asc_loop_reader_t *reader;
+    upstream_ring_t ring; // worker loop
+};
+
+static TAILQ_HEAD(, upstream_ring_t) ring_list = TAILQ_HEAD_INITIALIZER(ring_list);
+
+// completes the packet interrupted by a skip, the client resyncs on the next one
+static uint8_t ts_pad[TS_PACKET_SIZE];
+
 /*
  * client->mod - http_server module
  * client->response->mod - http_upstream module
  */
 
-static void on_upstream_ready(void *arg)
+static inline uint64_t ring_head_pos(const upstream_ring_t *ring)
 {
-    http_client_t *client = (http_client_t *)arg;
-    http_response_t *response = client->response;
+    return (ring->queue_count > 0) ? ring->queue[ring->queue_head].pos : ring->tail;
+}
 
-    if(response->buffer_count > 0)
-    {
-        size_t block_size = (response->buffer_write > response->buffer_read)
-                          ? (response->buffer_write - response->buffer_read)
-                          : (response->buffer_size - response->buffer_read);
+static void ring_drop_head(upstream_ring_t *ring)
+{
+    ts_chunk_unref(ring->queue[ring->queue_head].chunk);
+    ring->queue_head = (ring->queue_head + 1) % ring->queue_size;
+    --ring->queue_count;
+}
 
-        if(block_size > response->buffer_count)
-            block_size = response->buffer_count;
+/* a segment is one packet at least */
+static void ring_resize(upstream_ring_t *ring, size_t buffer_size)
+{
+    const size_t queue_size = buffer_size / TS_PACKET_SIZE + 2;
+    void *queue = calloc(queue_size, sizeof(*ring->queue));
+    asc_assert(queue != NULL, "[http_upstream] calloc() failed");
+
+    for(size_t n = 0; n < ring->queue_count; ++n)
+        memcpy(  (uint8_t *)queue + n * sizeof(*ring->queue)
+               , &ring->queue[(ring->queue_head + n) % ring->queue_size]
+               , sizeof(*ring->queue));
+    free(ring->queue);
+
+    ring->queue = queue;
+    ring->queue_size = queue_size;
+    ring->queue_head = 0;
+    ring->buffer_max = buffer_size;
+}
 
-        const ssize_t send_size = asc_socket_send(  client->sock
-                                                  , &response->buffer[response->buffer_read]
-                                                  , block_size);
+static void ring_idle_insert(upstream_ring_t *ring, http_response_t *response)
+{
+    // clients of the same buffer_fill go idle in the order of wake
+    http_response_t *prev = TAILQ_LAST(&ring->idle, upstream_clients_t);
+    while(prev && prev->wake > response->wake)
+        prev = TAILQ_PREV(prev, upstream_clients_t, idle_entry);
 
-        if(send_size > 0)
+    if(prev)
+        TAILQ_INSERT_AFTER(&ring->idle, prev, response, idle_entry);
+    else
+        TAILQ_INSERT_HEAD(&ring->idle, response, idle_entry);
+}
+
+static void on_upstream_ready(void *arg);
+static void on_tap_ready(void *arg);
+
+/* takes the reference of the chunk */
+static void ring_push(upstream_ring_t *ring, ts_chunk_t *chunk, const uint8_t *data, size_t size)
+{
+    for(size_t i = size / TS_PACKET_SIZE; i > 0; --i)
+    {
+        const uint8_t *const p = &data[(i - 1) * TS_PACKET_SIZE];
+        if(TS_IS_PAYLOAD_START(p) && TS_IS_AF(p) && p[4] > 0 && (p[5] & 0x40))
         {
-            response->buffer_count -= send_size;
-            response->buffer_read += send_size;
-            if(response->buffer_read >= response->buffer_size)
-                response->buffer_read = 0;
+            ring->checkpoint = ring->tail + (i - 1) * TS_PACKET_SIZE;
+            ring->is_checkpoint = true;
+            break;
         }
-        else if(send_size == -1)
+    }
+
+    // the next packets of the last segment: one more reference is not needed
+    const size_t last = (ring->queue_head + ring->queue_count + ring->queue_size - 1)
+                      % ring->queue_size;
+    if(   ring->queue_count > 0
+       && ring->queue[last].chunk == chunk
+       && &ring->queue[last].data[ring->queue[last].size] == data)
+    {
+        ring->queue[last].size += size;
+        ts_chunk_unref(chunk);
+    }
+    else
+    {
+        if(ring->queue_count == ring->queue_size)
+            ring_drop_head(ring);
+        const size_t tail = (ring->queue_head + ring->queue_count) % ring->queue_size;
+        ring->queue[tail].chunk = chunk;
+        ring->queue[tail].data = data;
+        ring->queue[tail].size = size;
+        ring->queue[tail].pos = ring->tail;
+        ++ring->queue_count;
+    }
+    ring->tail += size;
+
+    // segments out of the buffer of any client
+    while(ring->queue_count > 0)
+    {
+        const size_t head = ring->queue_head;
+        if(ring->queue[head].pos + ring->queue[head].size + ring->buffer_max > ring->tail)
+            break;
+        ring_drop_head(ring);
+    }
+
+    http_response_t *response;
+    while((response = TAILQ_FIRST(&ring->idle)) != NULL && response->wake <= ring->tail)
+    {
+        TAILQ_REMOVE(&ring->idle, response, idle_entry);
+        asc_socket_set_on_ready(response->sock, (ring->tap) ? on_tap_ready : on_upstream_ready);
+        response->is_socket_busy = true;
+    }
+}
+
+static void on_ring_ts_batch(void *arg, const uint8_t *ts, size_t count)
+{
+    upstream_ring_t *ring = (upstream_ring_t *)arg;
+    const size_t size = count * TS_PACKET_SIZE;
+
+    const uint8_t *data = NULL;
+    ts_chunk_t *const chunk = module_stream_chunk(ts, count, &data);
+
+    // a record lost on overflow is a gap of the stream position for the worker ring
+    for(int i = 0; i < ring->tap_count; ++i)
+    {
+        upstream_tap_t *const tap = ring->taps[i];
+        if(!tap)
+            continue;
+
+        const upstream_segment_t record = { chunk, data, size, ring->tail };
+        ts_chunk_ref(chunk);
+        if(asc_thread_buffer_write(tap->buffer, &record, sizeof(record)) != sizeof(record))
+            ts_chunk_unref(chunk);
+    }
+
+    ring_push(ring, chunk, data, size);
+}
+
+static void on_ring_ts(void *arg, const uint8_t *ts)
+{
+    on_ring_ts_batch(arg, ts, 1);
+}
+
+static bool ring_is_lagging(const upstream_ring_t *ring, const http_response_t *response)
+{
+    return response->cursor < ring_head_pos(ring)
+        || ring->tail - response->cursor >= response->buffer_size;
+}
+
+/* the last keyframe if it is in the first half of the client buffer, otherwise the ring tail */
+static void ring_skip(upstream_ring_t *ring, http_response_t *response)
+{
+    const size_t offset = response->cursor % TS_PACKET_SIZE;
+    if(offset > 0)
+        response->pad = TS_PACKET_SIZE - offset;
+
+    if(   ring->is_checkpoint
+       && ring->checkpoint >= ring_head_pos(ring)
+       && ring->tail - ring->checkpoint <= response->buffer_size / 2)
+    {
+        response->cursor = ring->checkpoint;
+    }
+    else
+        response->cursor = ring->tail;
+}
+
+static void on_ring_timer(void *arg);
+
+static bool ring_is_unused(const upstream_ring_t *ring)
+{
+    if(!TAILQ_EMPTY(&ring->clients) || ring->is_checking)
+        return false;
+
+    for(int i = 0; i < ring->tap_count; ++i)
+    {
+        if(ring->taps[i])
+            return false;
+    }
+    return true;
+}
+
+static upstream_ring_t * ring_open(module_stream_t *upstream, size_t buffer_size)
+{
+    upstream_ring_t *ring;
+    TAILQ_FOREACH(ring, &ring_list, entry)
+    {
+        // detached ring: the upstream is destroyed, its address may be reused
+        if(ring->upstream == upstream && ring->__stream.parent)
+            break;
+    }
+
+    if(!ring)
+    {
+        ring = (upstream_ring_t *)calloc(1, sizeof(upstream_ring_t));
+        asc_assert(ring != NULL, "[http_upstream] calloc() failed");
+        ring->upstream = upstream;
+        TAILQ_INIT(&ring->clients);
+        TAILQ_INIT(&ring->idle);
+        ring_resize(ring, buffer_size);
+
+        // like module_stream_init()
+        ring->__stream.self = (void *)ring;
+        ring->__stream.on_ts = (void (*)(module_data_t *, const uint8_t *))on_ring_ts;
+        ring->__stream.on_ts_batch =
+            (void (*)(module_data_t *, const uint8_t *, size_t))on_ring_ts_batch;
+        __module_stream_init(&ring->__stream);
+        __module_stream_attach(upstream, &ring->__stream);
+
+        ring->timer = asc_timer_init(LAG_CHECK_INTERVAL, on_ring_timer, ring);
+        TAILQ_INSERT_TAIL(&ring_list, ring, entry);
+    }
+    else if(buffer_size > ring->buffer_max)
+        ring_resize(ring, buffer_size);
+
+    return ring;
+}
+
+static void ring_attach(upstream_ring_t *ring, http_response_t *response)
+{
+    TAILQ_INSERT_TAIL(&ring->clients, response, entry);
+    response->ring = ring;
+    response->sock = response->client->sock;
+    response->cursor = ring->tail;
+}
+
+static void ring_destroy(upstream_ring_t *ring)
+{
+    TAILQ_REMOVE(&ring_list, ring, entry);
+    asc_timer_destroy(ring->timer);
+    module_stream_destroy(ring);
+
+    while(ring->queue_count > 0)
+        ring_drop_head(ring);
+    free(ring->queue);
+    free(ring->taps);
+    free(ring);
+}
+
+/* the loop of the ring */
+static void ring_remove(http_response_t *response)
+{
+    upstream_ring_t *ring = response->ring;
+    response->ring = NULL;
+
+    TAILQ_REMOVE(&ring->clients, response, entry);
+    if(!response->is_socket_busy)
+        TAILQ_REMOVE(&ring->idle, response, idle_entry);
+}
+
+static void ring_detach(http_response_t *response)
+{
+    upstream_ring_t *ring = response->ring;
+    ring_remove(response);
+
+    if(ring_is_unused(ring))
+        ring_destroy(ring);
+}
+
+/*
+ * ooooooooooo      o      oooooooooo
+ * 88  888  88     888      888    888
+ *     888        8  88     888oooo88
+ *     888       8oooo88    888
+ *    o888o    o88o  o888o o888o
+ *
+ */
+
+static void on_tap_close(void *arg);
+
+static void on_tap_read(void *arg)
+{
+    upstream_tap_t *tap = (upstream_tap_t *)arg;
+    upstream_ring_t *ring = &tap->ring;
+
+    upstream_segment_t record;
+    while(asc_thread_buffer_read(tap->buffer, &record, sizeof(record)) == sizeof(record))
+    {
+        if(record.pos != ring->tail)
         {
-            http_client_error(  client, "failed to send ts (%d bytes) [%s]"
-                              , block_size, asc_socket_error());
-            http_client_close(client);
-            return;
+            // records are lost: the clients skip to the next keyframe
+            while(ring->queue_count > 0)
+                ring_drop_head(ring);
+            ring->tail = record.pos;
+            ring->is_checkpoint = false;
         }
+        ring_push(ring, record.chunk, record.data, record.size);
     }
+}
 
-    if(response->buffer_count == 0)
+static void on_tap_start(void *arg)
+{
+    upstream_tap_t *tap = (upstream_tap_t *)arg;
+    tap->reader = asc_loop_reader_init(tap->buffer, on_tap_read, tap);
+    tap->ring.timer = asc_timer_init(LAG_CHECK_INTERVAL, on_ring_timer, &tap->ring);
+}
+
+static void on_tap_stop(void *arg)
+{
+    upstream_tap_t *tap = (upstream_tap_t *)arg;
+    upstream_ring_t *ring = &tap->ring;
+
+    asc_loop_reader_destroy(tap->reader);
+    tap->reader = NULL;
+    asc_timer_destroy(ring->timer);
+    ring->timer = NULL;
+
+    while(ring->queue_count > 0)
+        ring_drop_head(ring);
+}
+
+static upstream_tap_t * tap_open(upstream_ring_t *origin, asc_loop_t *loop)
+{
+    const int index = asc_loop_index(loop);
+    if(index >= origin->tap_count)
     {
-        asc_socket_set_on_ready(client->sock, NULL);
-        response->is_socket_busy = false;
+        const int tap_count = asc_loop_core_count() + 1;
+        upstream_tap_t **taps = (upstream_tap_t **)calloc(tap_count, sizeof(upstream_tap_t *));
+        asc_assert(taps != NULL, "[http_upstream] calloc() failed");
+        if(origin->taps)
+            memcpy(taps, origin->taps, origin->tap_count * sizeof(upstream_tap_t *));
+        free(origin->taps);
+        origin->taps = taps;
+        origin->tap_count = tap_count;
     }
+
+    upstream_tap_t *tap = origin->taps[index];
+    if(tap)
+        return tap;
+
+    tap = (upstream_tap_t *)calloc(1, sizeof(upstream_tap_t));
+    asc_assert(tap != NULL, "[http_upstream] calloc() failed");
+    tap->origin = origin;
+    tap->loop = loop;
+    tap->buffer = asc_thread_buffer_init(TAP_BUFFER_RECORDS * sizeof(upstream_segment_t));
+
+    upstream_ring_t *ring = &tap->ring;
+    ring->tap = tap;
+    ring->tail = origin->tail;
+    TAILQ_INIT(&ring->clients);
+    TAILQ_INIT(&ring->idle);
+    ring_resize(ring, origin->buffer_max);
+
+    asc_loop_call(loop, on_tap_start, tap);
+    origin->taps[index] = tap;
+    return tap;
 }
 
-static void on_ts(void *arg, const uint8_t *ts)
+static void tap_close(upstream_tap_t *tap)
+{
+    upstream_ring_t *origin = tap->origin;
+    origin->taps[asc_loop_index(tap->loop)] = NULL;
+
+    asc_loop_call_wait(tap->loop, on_tap_stop, tap);
+
+    // records not read by the worker
+    upstream_segment_t record;
+    while(asc_thread_buffer_read(tap->buffer, &record, sizeof(record)) == sizeof(record))
+        ts_chunk_unref(record.chunk);
+    asc_thread_buffer_destroy(tap->buffer);
+
+    free(tap->ring.queue);
+    free(tap);
+}
+
+/* worker loop: the client starts from the tail of the worker ring */
+static void on_tap_attach(void *arg)
+{
+    http_response_t *response = (http_response_t *)arg;
+    upstream_ring_t *ring = &response->tap->ring;
+
+    if(response->buffer_size > ring->buffer_max)
+        ring_resize(ring, response->buffer_size);
+
+    TAILQ_INSERT_TAIL(&ring->clients, response, entry);
+    response->ring = ring;
+    response->cursor = ring->tail;
+    response->is_socket_busy = true;
+
+    asc_socket_set_on_close(response->sock, on_tap_close);
+    asc_socket_set_on_ready(response->sock, on_tap_ready);
+}
+
+/* worker loop */
+static void on_tap_detach(void *arg)
+{
+    http_response_t *response = (http_response_t *)arg;
+    if(response->ring)
+        ring_remove(response);
+    asc_socket_close(response->sock);
+    response->sock = NULL;
+}
+
+/* control loop: the header is sent, the stream goes to the worker */
+static void on_tap_send(void *arg)
 {
     http_client_t *client = (http_client_t *)arg;
     http_response_t *response = client->response;
 
-    if(response->buffer_count + TS_PACKET_SIZE >= response->buffer_size)
+    client->on_ready = NULL;
+    asc_socket_set_on_ready(client->sock, NULL);
+
+    response->sock = asc_socket_dup(client->sock, response);
+    if(!response->sock)
     {
-        // overflow
-        response->buffer_count = 0;
-        response->buffer_read = 0;
-        response->buffer_write = 0;
-        if(response->is_socket_busy)
-        {
-            asc_socket_set_on_ready(client->sock, NULL);
-            response->is_socket_busy = false;
-        }
+        http_client_error(client, "failed to duplicate socket [%s]", asc_socket_error());
+        http_client_close(client);
         return;
     }
 
-    const size_t buffer_write = response->buffer_write + TS_PACKET_SIZE;
-    if(buffer_write < response->buffer_size)
+    http_client_worker_stream(client, true);
+    asc_loop_call(response->tap->loop, on_tap_attach, response);
+}
+
+static void tap_detach(http_response_t *response)
+{
+    upstream_tap_t *tap = response->tap;
+    upstream_ring_t *origin = tap->origin;
+    response->tap = NULL;
+
+    if(response->sock)
     {
-        memcpy(&response->buffer[response->buffer_write], ts, TS_PACKET_SIZE);
-        response->buffer_write = buffer_write;
+        asc_loop_call_wait(tap->loop, on_tap_detach, response);
+        http_client_worker_stream(response->client, false);
     }
-    else if(buffer_write > response->buffer_size)
+
+    if(--tap->clients == 0)
+        tap_close(tap);
+
+    if(ring_is_unused(origin))
+        ring_destroy(origin);
+}
+
+/*
+ * worker loop: the control loop gets EOF of the client socket and detaches it,
+ * the response is not touched after that
+ */
+static void tap_client_fail(http_response_t *response)
+{
+    ring_remove(response);
+    asc_socket_set_on_ready(response->sock, NULL);
+    asc_socket_set_on_close(response->sock, NULL);
+    asc_socket_shutdown_both(response->sock);
+}
+
+/* the client of the ring is closed by the loop of the ring */
+static void ring_client_close(http_response_t *response)
+{
+    if(response->ring->tap)
+        tap_client_fail(response);
+    else
+        http_client_close(response->client);
+}
+
+/* clients with lag_policy=disconnect that are not writable */
+static void on_ring_timer(void *arg)
+{
+    upstream_ring_t *ring = (upstream_ring_t *)arg;
+
+    ring->is_checking = true;
+    http_response_t *response, *next;
+    TAILQ_FOREACH_SAFE(response, &ring->clients, entry, next)
     {
-        const size_t ts_head = response->buffer_size - response->buffer_write;
-        memcpy(&response->buffer[response->buffer_write], ts, ts_head);
-        response->buffer_write = TS_PACKET_SIZE - ts_head;
-        memcpy(response->buffer, &ts[ts_head], response->buffer_write);
+        if(response->lag_disconnect && ring_is_lagging(ring, response))
+        {
+            http_client_warning(  response->client, "client is too slow (%llu bytes behind)"
+                                , (unsigned long long)(ring->tail - response->cursor));
+            ring_client_close(response);
+        }
     }
-    else
+    ring->is_checking = false;
+
+    if(!ring->tap && ring_is_unused(ring))
+        ring_destroy(ring);
+}
+
+static void ring_send(http_response_t *response)
+{
+    http_client_t *client = response->client;
+    upstream_ring_t *ring = response->ring;
+
+    if(ring_is_lagging(ring, response))
     {
-        memcpy(&response->buffer[response->buffer_write], ts, TS_PACKET_SIZE);
-        response->buffer_write = 0;
+        if(response->lag_disconnect)
+        {
+            http_client_warning(  client, "client is too slow (%llu bytes behind)"
+                                , (unsigned long long)(ring->tail - response->cursor));
+            ring_client_close(response);
+            return;
+        }
+        ring_skip(ring, response);
     }
-    response->buffer_count += TS_PACKET_SIZE;
 
-    if(   response->is_socket_busy == false
-       && response->buffer_count >= response->buffer_fill)
+    if(response->pad > 0 || response->cursor < ring->tail)
     {
-        asc_socket_set_on_ready(client->sock, on_upstream_ready);
-        response->is_socket_busy = true;
+        struct iovec iov[SEND_IOV_MAX];
+        int iov_count = 0;
+        size_t block_size = 0;
+
+        if(response->pad > 0)
+        {
+            iov[0].iov_base = (void *)ts_pad;
+            iov[0].iov_len = response->pad;
+            block_size += response->pad;
+            ++iov_count;
+        }
+
+        if(response->cursor < ring->tail)
+        {
+            // the segment of the cursor: the last one that starts not after it
+            size_t lo = 0, hi = ring->queue_count;
+            while(hi - lo > 1)
+            {
+                const size_t mid = (lo + hi) / 2;
+                if(ring->queue[(ring->queue_head + mid) % ring->queue_size].pos <= response->cursor)
+                    lo = mid;
+                else
+                    hi = mid;
+            }
+
+            size_t index = (ring->queue_head + lo) % ring->queue_size;
+            size_t skip = (size_t)(response->cursor - ring->queue[index].pos);
+            for(  size_t n = lo
+                ; n < ring->queue_count && iov_count < SEND_IOV_MAX
+                ; ++n, index = (index + 1) % ring->queue_size)
+            {
+                iov[iov_count].iov_base = (void *)&ring->queue[index].data[skip];
+                iov[iov_count].iov_len = ring->queue[index].size - skip;
+                block_size += iov[iov_count].iov_len;
+                ++iov_count;
+                skip = 0;
+            }
+        }
+
+        const ssize_t send_size = asc_socket_sendv(response->sock, iov, iov_count);
+
+        if(send_size > 0)
+        {
+            size_t size = (size_t)send_size;
+            if(response->pad > 0)
+            {
+                const size_t pad = (size < response->pad) ? size : response->pad;
+                response->pad -= pad;
+                size -= pad;
+            }
+            response->cursor += size;
+        }
+        else if(send_size == -1)
+        {
+            http_client_error(  client, "failed to send ts (%d bytes) [%s]"
+                              , block_size, asc_socket_error());
+            ring_client_close(response);
+            return;
+        }
+    }
+
+    if(response->pad == 0 && response->cursor == ring->tail)
+    {
+        asc_socket_set_on_ready(response->sock, NULL);
+        response->is_socket_busy = false;
+        response->wake = response->cursor + response->buffer_fill;
+        ring_idle_insert(ring, response);
     }
 }
 
+static void on_upstream_ready(void *arg)
+{
+    http_client_t *client = (http_client_t *)arg;
+    ring_send(client->response);
+}
+
+/* worker loop: the duplicate socket */
+static void on_tap_ready(void *arg)
+{
+    http_response_t *response = (http_response_t *)arg;
+    ring_send(response);
+}
+
+static void on_tap_close(void *arg)
+{
+    http_response_t *response = (http_response_t *)arg;
+    if(response->ring)
+        tap_client_fail(response);
+}
+
 static void on_upstream_read(void *arg)
 {
     http_client_t *client = (http_client_t *)arg;
@@ -148,11 +723,91 @@ static void on_upstream_read(void *arg)
         http_client_close(client);
 }
 
+/*
+ * { relay = udp_relay handle }: the socket is passed to the relay worker,
+ * it sends the response header and the datagrams of the stream itself.
+ * The main loop keeps the socket to detect the disconnect.
+ */
+static void on_upstream_send_relay(http_client_t *client, const char *content_type)
+{
+    http_response_code(client, 200, NULL);
+    http_response_header(client, "Cache-Control: no-cache");
+    http_response_header(client, "Pragma: no-cache");
+    http_response_header(client, "Content-Type: %s", content_type);
+    http_response_header(client, "Connection: close");
+    client->buffer[client->chunk_left + 0] = '\r';
+    client->buffer[client->chunk_left + 1] = '\n';
+    client->chunk_left += 2;
+
+    const int fd = dup(asc_socket_fd(client->sock));
+    if(fd == -1)
+    {
+        client->chunk_left = 0;
+        http_client_error(client, "dup() failed [%s]", strerror(errno));
+        http_client_abort(client, 503, NULL);
+        return;
+    }
+
+    lua_getfield(lua, 3, "relay");
+    lua_getfield(lua, -1, "play_attach");
+    lua_pushvalue(lua, -2);
+    lua_newtable(lua);
+    lua_pushinteger(lua, fd);
+    lua_setfield(lua, -2, "fd");
+    lua_pushlstring(lua, client->buffer, client->chunk_left);
+    lua_setfield(lua, -2, "header");
+    lua_pushinteger(lua, client->response->buffer_size / 1024);
+    lua_setfield(lua, -2, "buffer_kb");
+    lua_pushinteger(lua, client->response->buffer_fill / 1024);
+    lua_setfield(lua, -2, "backlog_kb");
+    client->chunk_left = 0;
+
+    const int ret = lua_pcall(lua, 2, 2, 0);
+    if(ret != 0 || !lua_isnumber(lua, -2))
+    {
+        // call error: relay, err; rejected attach: relay, nil, err
+        const char *err = lua_tostring(lua, -1);
+        http_client_error(client, "relay:play_attach() failed [%s]", err ? err : "unknown error");
+        lua_pop(lua, (ret != 0) ? 2 : 3);
+        close(fd);
+        http_client_abort(client, 503, NULL);
+        return;
+    }
+
+    client->response->relay_id = lua_tointeger(lua, -2);
+    lua_pop(lua, 2);
+    client->response->idx_relay = luaL_ref(lua, LUA_REGISTRYINDEX);
+
+    client->on_read = on_upstream_read;
+    client->on_ready = NULL;
+    asc_socket_set_on_read(client->sock, on_upstream_read);
+    asc_socket_set_on_ready(client->sock, NULL);
+}
+
+static void on_upstream_detach_relay(http_response_t *response)
+{
+    lua_rawgeti(lua, LUA_REGISTRYINDEX, response->idx_relay);
+    lua_getfield(lua, -1, "play_detach");
+    lua_pushvalue(lua, -2);
+    lua_pushinteger(lua, response->relay_id);
+    if(lua_pcall(lua, 2, 0, 0) != 0)
+    {
+        const char *err = lua_tostring(lua, -1);
+        asc_log_error("[http_upstream] relay:play_detach() failed: %s", err ? err : "unknown error");
+        lua_pop(lua, 1);
+    }
+    lua_pop(lua, 1);
+
+    luaL_unref(lua, LUA_REGISTRYINDEX, response->idx_relay);
+    response->idx_relay = 0;
+}
+
 static void on_upstream_send(void *arg)
 {
     http_client_t *client = (http_client_t *)arg;
 
     module_stream_t *upstream = NULL;
+    bool is_relay = false;
 
     client->response->buffer_size = DEFAULT_BUFFER_SIZE;
     client->response->buffer_fill = DEFAULT_BUFFER_FILL;
@@ -164,6 +819,10 @@ static void on_upstream_send(void *arg)
             upstream = (module_stream_t *)lua_touserdata(lua, -1);
         lua_pop(lua, 1);
 
+        lua_getfield(lua, 3, "relay");
+        is_relay = lua_isuserdata(lua, -1) && !lua_islightuserdata(lua, -1);
+        lua_pop(lua, 1);
+
         lua_getfield(lua, 3, "buffer_size");
         if(lua_isnumber(lua, -1))
         {
@@ -182,6 +841,22 @@ static void on_upstream_send(void *arg)
         }
         lua_pop(lua, 1);
 
+        lua_getfield(lua, 3, "lag_policy");
+        if(lua_isstring(lua, -1))
+        {
+            const char *lag_policy = lua_tostring(lua, -1);
+            if(!strcmp(lag_policy, "disconnect"))
+                client->response->lag_disconnect = true;
+            else if(strcmp(lag_policy, "skip") != 0)
+            {
+                http_client_error(client, "unknown lag_policy: %s", lag_policy);
+                lua_pop(lua, 1);
+                http_client_abort(client, 500, "server configuration error");
+                return;
+            }
+        }
+        lua_pop(lua, 1);
+
         if(client->response->buffer_size <= client->response->buffer_fill)
         {
             http_client_error(client, "buffer_size must be greater than buffer_fill");
@@ -194,26 +869,38 @@ static void on_upstream_send(void *arg)
         upstream = (module_stream_t *)lua_touserdata(lua, 3);
     }
 
+    const char *content_type = lua_isstring(lua, 4)
+                             ? lua_tostring(lua, 4)
+                             : "application/octet-stream";
+
+    if(is_relay)
+    {
+        on_upstream_send_relay(client, content_type);
+        return;
+    }
+
     if(!upstream)
     {
         http_client_abort(client, 500, ":send() client instance required");
         return;
     }
 
-    client->response->buffer = (uint8_t *)malloc(client->response->buffer_size);
-
-    // like module_stream_init()
-    client->response->__stream.self = (void *)client;
-    client->response->__stream.on_ts = (void (*)(module_data_t *, const uint8_t *))on_ts;
-    __module_stream_init(&client->response->__stream);
-    __module_stream_attach(upstream, &client->response->__stream);
+    upstream_ring_t *ring = ring_open(upstream, client->response->buffer_size);
 
+    // the ring is sent after the response header
     client->on_read = on_upstream_read;
-    client->on_ready = NULL;
-
-    const char *content_type = lua_isstring(lua, 4)
-                             ? lua_tostring(lua, 4)
-                             : "application/octet-stream";
+    if(client->loop)
+    {
+        client->response->tap = tap_open(ring, client->loop);
+        ++client->response->tap->clients;
+        client->on_ready = on_tap_send;
+    }
+    else
+    {
+        ring_attach(ring, client->response);
+        client->on_ready = on_upstream_ready;
+        client->response->is_socket_busy = true;
+    }
 
     http_response_code(client, 200, NULL);
     http_response_header(client, "Cache-Control: no-cache");
@@ -244,9 +931,14 @@ static int module_call(module_data_t *mod)
                     http_client_abort(client, 500, "handler error");
             }
 
-            module_stream_destroy(client->response);
+            if(client->response->idx_relay)
+                on_upstream_detach_relay(client->response);
+
+            if(client->response->tap)
+                tap_detach(client->response);
+            else if(client->response->ring)
+                ring_detach(client->response);
 
-            free(client->response->buffer);
             free(client->response);
             client->response = NULL;
         }
@@ -255,6 +947,7 @@ static int module_call(module_data_t *mod)
 
     client->response = (http_response_t *)calloc(1, sizeof(http_response_t));
     client->response->mod = mod;
+    client->response->client = client;
 
     client->on_send = on_upstream_send;
 
@@ -286,6 +979,8 @@ static void module_init(module_data_t *mod)
     asc_assert(lua_isfunction(lua, -1), "[http_upstream] option 'callback' is required");
     mod->idx_callback = luaL_ref(lua, LUA_REGISTRYINDEX);
 
+    memset(ts_pad, 0xFF, sizeof(ts_pad));
+
     // Deprecated
     bool is_deprecated = false;
 
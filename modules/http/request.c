@@ -695,10 +695,14 @@ static void on_thread_read(void *arg)
 {
     module_data_t *mod = (module_data_t *)arg;
 
-    uint8_t ts[TS_PACKET_SIZE];
-    const ssize_t r = asc_thread_buffer_read(mod->thread_output, ts, sizeof(ts));
-    if(r == sizeof(ts))
-        module_stream_send(mod, ts);
+    const uint8_t *ts = NULL;
+    size_t size = asc_thread_buffer_peek(mod->thread_output, &ts);
+    size -= size % TS_PACKET_SIZE;
+    if(!size)
+        return;
+
+    module_stream_send_batch(mod, ts, size / TS_PACKET_SIZE);
+    asc_thread_buffer_consume(mod->thread_output, size);
 }
 
 static void thread_loop(void *arg)
@@ -1198,7 +1202,8 @@ static void on_read(void *arg)
                 asc_socket_set_on_close(mod->sock, NULL);
 
                 mod->thread = asc_thread_init(mod);
-                mod->thread_output = asc_thread_buffer_init(mod->sync.buffer_size);
+                mod->thread_output = asc_thread_buffer_init(  mod->sync.buffer_size
+                                                            - mod->sync.buffer_size % TS_PACKET_SIZE);
                 asc_thread_start(  mod->thread
                                  , thread_loop
                                  , on_thread_read, mod->thread_output
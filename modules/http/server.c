@@ -34,6 +34,7 @@
  *      max_clients        - number, hard limit of active clients (0 = unlimited)
  *      max_clients_per_ip - number, hard limit per remote IP (0 = unlimited)
  *      accept_backoff_ms  - number, temporary accept pause on transient errors (default: 100)
+ *      workers      - number, accept on N data loops with SO_REUSEPORT (default: 0 - main loop)
  *      sctp         - boolean, use sctp instead of tcp
  *      route        - list, format: { { "/path", callback }, ... }
  *
@@ -50,12 +51,15 @@
  *                    * content - string, response body from the string
  *      data(client)
  *                  - return table, client data
+ *      stats()     - return table, counters of the server and its workers
  */
 
 #include "http.h"
 
 #define MSG(_msg) "[http_server %s:%d] " _msg, mod->addr, mod->port
 
+typedef struct http_workers_t http_workers_t;
+
 struct module_data_t
 {
     int idx_self;
@@ -71,6 +75,10 @@ struct module_data_t
     int max_clients;
     int max_clients_per_ip;
     int accept_backoff_ms;
+    bool is_sctp;
+
+    int workers_count;
+    http_workers_t *workers;
 
     uint64_t rejected_connections;
     uint64_t accept_errors;
@@ -92,6 +100,61 @@ typedef struct
     int idx_callback;
 } route_t;
 
+/*
+ * Workers (option workers = N): every data loop of 1..N listens on its own
+ * socket of the server port (SO_REUSEPORT), the kernel spreads connections
+ * between them. The worker reads the request head, checks the limits and
+ * the route and answers the errors itself. The control loop gets only the
+ * clients with a route, the Lua callback decides the response. Long-lived
+ * responses are served back on the worker loop (http_upstream).
+ */
+
+#define WORKER_ACCEPT_BURST 64
+
+#define WORKER_GET(_v) __atomic_load_n(&(_v), __ATOMIC_RELAXED)
+#define WORKER_ADD(_v, _x) __atomic_add_fetch(&(_v), (_x), __ATOMIC_RELAXED)
+#define WORKER_SUB(_v, _x) __atomic_sub_fetch(&(_v), (_x), __ATOMIC_RELAXED)
+
+TAILQ_HEAD(http_pending_t, http_client_t);
+
+struct http_worker_t
+{
+    http_workers_t *set;
+    module_data_t *mod; // options only, the worker is stopped before the module
+    asc_loop_t *loop;
+    int index;
+
+    // worker loop
+    asc_socket_t *sock;
+    struct http_pending_t pending; // clients reading the request head
+    asc_timer_t *resume_timer;
+    uint64_t accept_last_error_log_ts;
+    uint64_t accept_suppressed_errors;
+
+    // published
+    uint64_t accepted;
+    uint64_t active;
+    uint64_t streams;
+    uint64_t dispatched;
+    uint64_t rejected;
+    uint64_t not_found;
+    uint64_t bad_requests;
+    uint64_t accept_errors;
+
+    // control loop: accept to the route callback
+    uint64_t latency_us; // EWMA 1/8
+    uint64_t latency_max_us;
+};
+
+struct http_workers_t
+{
+    module_data_t *mod; // control loop, NULL if the server is closed
+    int refcount; // the server and the clients queued to the control loop
+    int count;
+    char **routes; // paths of the routes, NULL-terminated
+    http_worker_t item[];
+};
+
 static const char __method[] = "method";
 static const char __version[] = "version";
 static const char __path[] = "path";
@@ -106,6 +169,8 @@ static const char __connection_close[] = "Connection: close";
 
 static void on_server_accept(void *arg);
 static void on_accept_resume(void *arg);
+static void http_workers_stop(module_data_t *mod);
+static void http_workers_release(module_data_t *mod);
 
 /*
  * Важно: для диагностики 500 в проде логируем traceback.
@@ -137,6 +202,46 @@ static size_t find_line_end(const char *buf, size_t size)
     return 0;
 }
 
+/* end of the request head, 0 if the empty line is not received */
+static size_t find_head_end(const char *buf, size_t size)
+{
+    for(size_t skip = 0; skip + 3 < size; ++skip)
+    {
+        if(   buf[skip + 0] == '\r'
+           && buf[skip + 1] == '\n'
+           && buf[skip + 2] == '\r'
+           && buf[skip + 3] == '\n')
+        {
+            return skip + 4;
+        }
+    }
+    return 0;
+}
+
+/* limits of the request head while it is received: 0, 414 or 431 */
+static int check_head_limits(const module_data_t *mod, const http_client_t *client)
+{
+    if(mod->request_line_max > 0)
+    {
+        const size_t line_end = find_line_end(client->buffer, client->buffer_skip);
+        if(line_end == 0 && client->buffer_skip > (size_t)mod->request_line_max)
+            return 414;
+        if(line_end > 0 && line_end > (size_t)mod->request_line_max)
+            return 414;
+    }
+    if(mod->headers_max > 0)
+    {
+        size_t total_max = (size_t)mod->headers_max;
+        if(mod->request_line_max > 0)
+            total_max += (size_t)mod->request_line_max;
+        if(total_max > HTTP_BUFFER_SIZE)
+            total_max = HTTP_BUFFER_SIZE;
+        if(client->buffer_skip > total_max)
+            return 431;
+    }
+    return 0;
+}
+
 /*
  *   oooooooo8 ooooo       ooooo ooooooooooo oooo   oooo ooooooooooo
  * o888     88  888         888   888    88   8888o  88  88  888  88
@@ -234,6 +339,8 @@ static void on_client_close(void *arg)
 
     if(mod->clients)
         asc_list_remove_item(mod->clients, client);
+    if(client->worker)
+        WORKER_SUB(client->worker->active, 1);
     free(client);
 }
 
@@ -273,80 +380,36 @@ static bool routecmp(const char *path, const char *route)
  *
  */
 
-static void on_client_read(void *arg)
+/* received data in client->buffer: the request head, then the content */
+static void on_client_request(http_client_t *client)
 {
-    http_client_t *client = (http_client_t *)arg;
     module_data_t *mod = client->mod;
 
-    ssize_t size = asc_socket_recv(  client->sock
-                                   , &client->buffer[client->buffer_skip]
-                                   , HTTP_BUFFER_SIZE - client->buffer_skip);
-    if(size <= 0)
-    {
-        on_client_close(client);
-        return;
-    }
-
-    if(client->status == 3)
-    {
-        asc_log_warning(MSG("received data after request"));
-        return;
-    }
-
     char *uri_host = NULL;
     size_t uri_host_size = 0;
 
     size_t eoh = 0; // end of headers
     size_t skip = 0;
-    client->buffer_skip += size;
 
     if(client->status == 0)
     {
-        if(mod->request_line_max > 0)
+        switch(check_head_limits(mod, client))
         {
-            const size_t line_end = find_line_end(client->buffer, client->buffer_skip);
-            if(line_end == 0 && client->buffer_skip > (size_t)mod->request_line_max)
-            {
-                http_client_abort(client, 414, "request line too long");
-                return;
-            }
-            if(line_end > 0 && line_end > (size_t)mod->request_line_max)
-            {
+            case 414:
                 http_client_abort(client, 414, "request line too long");
                 return;
-            }
-        }
-        if(mod->headers_max > 0)
-        {
-            size_t total_max = (size_t)mod->headers_max;
-            if(mod->request_line_max > 0)
-                total_max += (size_t)mod->request_line_max;
-            if(total_max > HTTP_BUFFER_SIZE)
-                total_max = HTTP_BUFFER_SIZE;
-            if(client->buffer_skip > total_max)
-            {
+            case 431:
                 http_client_abort(client, 431, "request headers too large");
                 return;
-            }
-        }
-
-        // check empty line
-        while(skip < client->buffer_skip)
-        {
-            if(   client->buffer[skip + 0] == '\r'
-               && client->buffer[skip + 1] == '\n'
-               && client->buffer[skip + 2] == '\r'
-               && client->buffer[skip + 3] == '\n')
-            {
-                eoh = skip + 4;
-                client->status = 1; // empty line is found
+            default:
                 break;
-            }
-            ++skip;
         }
 
-        if(client->status != 1)
+        // check empty line
+        eoh = find_head_end(client->buffer, client->buffer_skip);
+        if(eoh == 0)
             return;
+        client->status = 1; // empty line is found
     }
 
     if(client->status == 1)
@@ -602,6 +665,30 @@ static void on_client_read(void *arg)
     }
 }
 
+static void on_client_read(void *arg)
+{
+    http_client_t *client = (http_client_t *)arg;
+    module_data_t *mod = client->mod;
+
+    ssize_t size = asc_socket_recv(  client->sock
+                                   , &client->buffer[client->buffer_skip]
+                                   , HTTP_BUFFER_SIZE - client->buffer_skip);
+    if(size <= 0)
+    {
+        on_client_close(client);
+        return;
+    }
+
+    if(client->status == 3)
+    {
+        asc_log_warning(MSG("received data after request"));
+        return;
+    }
+
+    client->buffer_skip += size;
+    on_client_request(client);
+}
+
 /*
  *  oooooooo8 ooooooooooo oooo   oooo ooooooooo
  * 888         888    88   8888o  88   888    88o
@@ -941,14 +1028,20 @@ static void on_server_close(void *arg)
     }
     mod->accept_paused = false;
 
-    if(!mod->sock)
+    if(!mod->sock && !mod->workers)
     {
         mod->closing = false;
         return;
     }
 
-    asc_socket_close(mod->sock);
-    mod->sock = NULL;
+    if(mod->workers)
+        http_workers_stop(mod);
+
+    if(mod->sock)
+    {
+        asc_socket_close(mod->sock);
+        mod->sock = NULL;
+    }
 
     if(mod->clients)
     {
@@ -969,6 +1062,9 @@ static void on_server_close(void *arg)
         asc_list_destroy(clients);
     }
 
+    if(mod->workers)
+        http_workers_release(mod);
+
     if(mod->routes)
     {
         for(  asc_list_first(mod->routes)
@@ -1012,27 +1108,29 @@ static bool is_accept_error_transient(int err)
     }
 }
 
-static void log_accept_error(module_data_t *mod, int err)
+/* last_ts and suppressed belong to the loop of the listener */
+static void log_accept_error(  module_data_t *mod, uint64_t *last_ts, uint64_t *suppressed
+                             , int err)
 {
     const uint64_t now = asc_utime();
-    if(mod->accept_last_error_log_ts == 0 || (now - mod->accept_last_error_log_ts) >= 1000000ULL)
+    if(*last_ts == 0 || (now - *last_ts) >= 1000000ULL)
     {
-        if(mod->accept_suppressed_errors > 0)
+        if(*suppressed > 0)
         {
             asc_log_warning(MSG("accept failed: %s (%llu similar errors suppressed)"),
                             strerror(err),
-                            (unsigned long long)mod->accept_suppressed_errors);
-            mod->accept_suppressed_errors = 0;
+                            (unsigned long long)*suppressed);
+            *suppressed = 0;
         }
         else
         {
             asc_log_warning(MSG("accept failed: %s"), strerror(err));
         }
-        mod->accept_last_error_log_ts = now;
+        *last_ts = now;
     }
     else
     {
-        ++mod->accept_suppressed_errors;
+        ++*suppressed;
     }
 }
 
@@ -1118,7 +1216,7 @@ static void on_server_accept(void *arg)
         const int err = errno;
         ++mod->accept_errors;
         free(client);
-        log_accept_error(mod, err);
+        log_accept_error(mod, &mod->accept_last_error_log_ts, &mod->accept_suppressed_errors, err);
         if(is_accept_error_transient(err))
             pause_accept_temporarily(mod);
         return;
@@ -1155,6 +1253,493 @@ static void on_server_accept(void *arg)
     asc_socket_set_on_close(client->sock, on_client_close);
 }
 
+/*
+ * oooo     oooo  ooooooo  oooooooooo  oooo   oooo ooooooooooo oooooooooo   oooooooo8
+ *  88   88  88 o888   888o 888    888  888  o88    888    88   888    888 888
+ *   88 888 88  888     888 888oooo88   888888      888ooo8     888oooo88   888oooooo
+ *    888 888   888o   o888 888  88o    888  88o    888    oo   888  88o           888
+ *     8   8      88ooo88  o888o  88o8 o888o o888o o888ooo8888 o888o  88o8 o88oooo888
+ *
+ */
+
+static uint64_t http_workers_active(const http_workers_t *set)
+{
+    uint64_t active = 0;
+    for(int i = 0; i < set->count; ++i)
+        active += WORKER_GET(set->item[i].active);
+    return active;
+}
+
+static void http_workers_unref(http_workers_t *set)
+{
+    if(__atomic_sub_fetch(&set->refcount, 1, __ATOMIC_ACQ_REL) > 0)
+        return;
+
+    for(int i = 0; set->routes[i]; ++i)
+        free(set->routes[i]);
+    free(set->routes);
+    free(set);
+}
+
+static void worker_client_free(http_worker_t *worker, http_client_t *client)
+{
+    asc_socket_close(client->sock);
+    WORKER_SUB(worker->active, 1);
+    free(client);
+}
+
+static void worker_client_drop(http_worker_t *worker, http_client_t *client)
+{
+    TAILQ_REMOVE(&worker->pending, client, worker_entry);
+    worker_client_free(worker, client);
+}
+
+/* static response of the worker, the request is not passed to the control loop */
+static void worker_reply(http_worker_t *worker, http_client_t *client, int code)
+{
+    module_data_t *mod = worker->mod;
+
+    char response[512];
+    const int size = snprintf(  response, sizeof(response)
+                              , "%s %d %s\r\n"
+                                "Server: %s\r\n"
+                                "Content-Length: 0\r\n"
+                                "%s\r\n\r\n"
+                              , mod->http_version, code, http_code(code)
+                              , mod->server_name, __connection_close);
+    if(size > 0 && size < (int)sizeof(response))
+    {
+        if(asc_socket_send(client->sock, response, (size_t)size) < 0)
+        {
+            /* соединение может быть уже закрыто клиентом */
+        }
+    }
+    worker_client_free(worker, client);
+}
+
+static void on_worker_dispatch(void *arg)
+{
+    http_client_t *client = (http_client_t *)arg;
+    http_worker_t *worker = client->worker;
+    http_workers_t *set = worker->set;
+    module_data_t *mod = set->mod;
+
+    if(!mod || mod->closing || !mod->clients)
+    {
+        asc_socket_close(client->sock);
+        free(client);
+        http_workers_unref(set);
+        return;
+    }
+    http_workers_unref(set);
+
+    const uint64_t now = asc_utime();
+    const uint64_t latency = (now > client->accept_time) ? now - client->accept_time : 0;
+    if(worker->latency_us == 0)
+        worker->latency_us = latency;
+    else
+        worker->latency_us = worker->latency_us - worker->latency_us / 8 + latency / 8;
+    if(latency > worker->latency_max_us)
+        worker->latency_max_us = latency;
+
+    client->mod = mod;
+    client->idx_server = mod->idx_self;
+
+    if(mod->max_clients_per_ip > 0)
+    {
+        const char *client_ip = asc_socket_addr(client->sock);
+        if(   client_ip && client_ip[0]
+           && count_clients_by_ip(mod, client_ip) >= (size_t)mod->max_clients_per_ip)
+        {
+            WORKER_ADD(worker->rejected, 1);
+            WORKER_SUB(worker->active, 1);
+            reject_new_connection(mod, client, "max_clients_per_ip");
+            return;
+        }
+    }
+
+    asc_list_insert_tail(mod->clients, client);
+
+    asc_socket_set_on_read(client->sock, on_client_read);
+    asc_socket_set_on_close(client->sock, on_client_close);
+
+    on_client_request(client);
+}
+
+static void on_worker_client_close(void *arg)
+{
+    http_client_t *client = (http_client_t *)arg;
+    worker_client_drop(client->worker, client);
+}
+
+static void on_worker_client_read(void *arg)
+{
+    http_client_t *client = (http_client_t *)arg;
+    http_worker_t *worker = client->worker;
+    module_data_t *mod = worker->mod;
+
+    const ssize_t size = asc_socket_recv(  client->sock
+                                         , &client->buffer[client->buffer_skip]
+                                         , HTTP_BUFFER_SIZE - client->buffer_skip);
+    if(size <= 0)
+    {
+        worker_client_drop(worker, client);
+        return;
+    }
+    client->buffer_skip += size;
+
+    int code = check_head_limits(mod, client);
+    const size_t eoh = find_head_end(client->buffer, client->buffer_skip);
+    if(code == 0 && eoh == 0)
+        return;
+
+    parse_match_t r[4];
+    parse_match_t m[4];
+    char *const buffer = client->buffer;
+
+    do
+    {
+        if(code != 0)
+            break;
+
+        if(!http_parse_request(buffer, eoh, r))
+        {
+            code = 400;
+            break;
+        }
+
+        if(mod->headers_max > 0 && (eoh - r[0].eo) > (size_t)mod->headers_max)
+        {
+            code = 431;
+            break;
+        }
+
+        size_t skip = r[0].eo;
+        while(skip < eoh)
+        {
+            if(!http_parse_header(&buffer[skip], eoh - skip, m))
+            {
+                code = 400;
+                break;
+            }
+            if(mod->header_max > 0 && m[0].eo > (size_t)mod->header_max)
+            {
+                code = 431;
+                break;
+            }
+            if(m[1].eo == 0)
+                break;
+            skip += m[0].eo;
+        }
+        if(code != 0)
+            break;
+
+        // absolute URI: scheme://host/path
+        size_t path_skip = r[2].so;
+        if(buffer[path_skip] != '/' && buffer[path_skip] != '*')
+        {
+            while(path_skip < r[2].eo && buffer[path_skip] != ':')
+                ++path_skip;
+            if(buffer[path_skip + 1] != '/' || buffer[path_skip + 2] != '/')
+            {
+                code = 400;
+                break;
+            }
+            path_skip += 3;
+            while(path_skip < r[2].eo && buffer[path_skip] != '/')
+                ++path_skip;
+        }
+
+        size_t path_end = path_skip;
+        while(path_end < r[2].eo && buffer[path_end] != '?')
+            ++path_end;
+
+        // "/.." is redirected to the safe path by the control loop
+        const char saved = buffer[path_end];
+        buffer[path_end] = '\0';
+        bool is_route = (strstr(&buffer[path_skip], "/..") != NULL);
+        for(int i = 0; !is_route && worker->set->routes[i]; ++i)
+            is_route = routecmp(&buffer[path_skip], worker->set->routes[i]);
+        buffer[path_end] = saved;
+
+        if(!is_route)
+            code = 404;
+    } while(0);
+
+    if(code == 400)
+    {
+        WORKER_ADD(worker->bad_requests, 1);
+        asc_log_debug(MSG("worker %d: bad request from %s"), worker->index, asc_socket_addr(client->sock));
+        worker_client_drop(worker, client);
+        return;
+    }
+
+    if(code != 0)
+    {
+        if(code == 404)
+            WORKER_ADD(worker->not_found, 1);
+        else
+            WORKER_ADD(worker->bad_requests, 1);
+        TAILQ_REMOVE(&worker->pending, client, worker_entry);
+        worker_reply(worker, client, code);
+        return;
+    }
+
+    // the socket event is opened again by the control loop
+    TAILQ_REMOVE(&worker->pending, client, worker_entry);
+    asc_socket_set_on_read(client->sock, NULL);
+    asc_socket_set_on_close(client->sock, NULL);
+
+    WORKER_ADD(worker->dispatched, 1);
+    __atomic_add_fetch(&worker->set->refcount, 1, __ATOMIC_ACQ_REL);
+    asc_loop_call(NULL, on_worker_dispatch, client);
+}
+
+static void on_worker_accept(void *arg);
+
+static void on_worker_resume(void *arg)
+{
+    http_worker_t *worker = (http_worker_t *)arg;
+    worker->resume_timer = NULL;
+    if(worker->sock)
+        asc_socket_set_on_read(worker->sock, on_worker_accept);
+}
+
+static void on_worker_accept(void *arg)
+{
+    http_worker_t *worker = (http_worker_t *)arg;
+    module_data_t *mod = worker->mod;
+
+    // the connections of a storm are taken in bursts, not one per wakeup
+    bool is_pause = false;
+    for(int n = 0; n < WORKER_ACCEPT_BURST && !is_pause; ++n)
+    {
+        http_client_t *client = (http_client_t *)calloc(1, sizeof(http_client_t));
+        if(!client)
+        {
+            asc_log_error(MSG("worker %d: accept failed: out of memory"), worker->index);
+            is_pause = true;
+            break;
+        }
+
+        if(!asc_socket_accept(worker->sock, &client->sock, client))
+        {
+            const int err = errno;
+            free(client);
+            if(err == EAGAIN || err == EWOULDBLOCK)
+                return;
+
+            WORKER_ADD(worker->accept_errors, 1);
+            log_accept_error(  mod, &worker->accept_last_error_log_ts
+                             , &worker->accept_suppressed_errors, err);
+            is_pause = is_accept_error_transient(err);
+            break;
+        }
+
+        client->worker = worker;
+        client->loop = worker->loop;
+        client->accept_time = asc_utime();
+        WORKER_ADD(worker->accepted, 1);
+        WORKER_ADD(worker->active, 1);
+
+        if(mod->max_clients > 0 && http_workers_active(worker->set) > (uint64_t)mod->max_clients)
+        {
+            WORKER_ADD(worker->rejected, 1);
+            worker_reply(worker, client, 503);
+            continue;
+        }
+
+        TAILQ_INSERT_TAIL(&worker->pending, client, worker_entry);
+        asc_socket_set_on_read(client->sock, on_worker_client_read);
+        asc_socket_set_on_close(client->sock, on_worker_client_close);
+    }
+
+    // out of memory or descriptors: accept is paused like on the main loop
+    if(is_pause && !worker->resume_timer)
+    {
+        asc_socket_set_on_read(worker->sock, NULL);
+        worker->resume_timer = asc_timer_one_shot(  (unsigned int)mod->accept_backoff_ms
+                                                  , on_worker_resume, worker);
+    }
+}
+
+static void on_worker_close(void *arg)
+{
+    http_worker_t *worker = (http_worker_t *)arg;
+    module_data_t *mod = worker->mod;
+
+    asc_log_error(MSG("worker %d: listener failed [%s]"), worker->index, asc_socket_error());
+    if(worker->resume_timer)
+    {
+        asc_timer_destroy(worker->resume_timer);
+        worker->resume_timer = NULL;
+    }
+    asc_socket_close(worker->sock);
+    worker->sock = NULL;
+}
+
+static void on_worker_start(void *arg)
+{
+    http_worker_t *worker = (http_worker_t *)arg;
+    module_data_t *mod = worker->mod;
+
+    TAILQ_INIT(&worker->pending);
+
+    worker->sock = (mod->is_sctp)
+                 ? asc_socket_open_sctp4(worker)
+                 : asc_socket_open_tcp4(worker);
+    asc_socket_set_reuseaddr(worker->sock, 1);
+    if(   !asc_socket_set_reuseport(worker->sock, 1)
+       || !asc_socket_bind(worker->sock, mod->addr, mod->port))
+    {
+        asc_log_error(MSG("worker %d: failed to listen [%s]"), worker->index, asc_socket_error());
+        asc_socket_close(worker->sock);
+        worker->sock = NULL;
+        return;
+    }
+    asc_socket_listen(worker->sock, on_worker_accept, on_worker_close);
+}
+
+static void on_worker_stop(void *arg)
+{
+    http_worker_t *worker = (http_worker_t *)arg;
+
+    if(worker->resume_timer)
+    {
+        asc_timer_destroy(worker->resume_timer);
+        worker->resume_timer = NULL;
+    }
+
+    if(worker->sock)
+    {
+        asc_socket_close(worker->sock);
+        worker->sock = NULL;
+    }
+
+    http_client_t *client;
+    while((client = TAILQ_FIRST(&worker->pending)) != NULL)
+        worker_client_drop(worker, client);
+}
+
+/* false if the server accepts on the main loop */
+static bool http_workers_start(module_data_t *mod)
+{
+    const int loops = asc_loop_core_count();
+    if(loops <= 0)
+    {
+        asc_log_warning(MSG("workers: data loops are not started, accepting on the main loop"));
+        return false;
+    }
+
+    const int count = (mod->workers_count < loops) ? mod->workers_count : loops;
+    http_workers_t *set = (http_workers_t *)calloc(  1
+                                                   , sizeof(http_workers_t)
+                                                   + (size_t)count * sizeof(http_worker_t));
+    asc_assert(set != NULL, MSG("calloc() failed"));
+    set->mod = mod;
+    set->refcount = 1;
+    set->count = count;
+
+    // the worker threads don't touch Lua: paths of the routes are copied
+    set->routes = (char **)calloc(asc_list_size(mod->routes) + 1, sizeof(char *));
+    int route_count = 0;
+    asc_list_for(mod->routes)
+    {
+        route_t *route = (route_t *)asc_list_data(mod->routes);
+        set->routes[route_count++] = strdup(route->path);
+    }
+
+    int started = 0;
+    for(int i = 0; i < count; ++i)
+    {
+        http_worker_t *worker = &set->item[i];
+        worker->set = set;
+        worker->mod = mod;
+        worker->index = i + 1;
+        worker->loop = asc_loop_get(worker->index);
+        asc_loop_call_wait(worker->loop, on_worker_start, worker);
+        if(worker->sock)
+            ++started;
+    }
+
+    mod->workers = set;
+    if(started == 0)
+    {
+        asc_log_warning(MSG("workers: failed to start, accepting on the main loop"));
+        http_workers_stop(mod);
+        http_workers_release(mod);
+        return false;
+    }
+
+    asc_log_info(MSG("accepting on %d workers"), started);
+    return true;
+}
+
+static void http_workers_stop(module_data_t *mod)
+{
+    http_workers_t *set = mod->workers;
+    for(int i = 0; i < set->count; ++i)
+        asc_loop_call_wait(set->item[i].loop, on_worker_stop, &set->item[i]);
+}
+
+/* after the clients are closed: the clients queued to the control loop are dropped */
+static void http_workers_release(module_data_t *mod)
+{
+    http_workers_t *set = mod->workers;
+    mod->workers = NULL;
+    set->mod = NULL;
+    http_workers_unref(set);
+}
+
+void http_client_worker_stream(http_client_t *client, bool is_started)
+{
+    if(!client->worker)
+        return;
+
+    if(is_started)
+        WORKER_ADD(client->worker->streams, 1);
+    else
+        WORKER_SUB(client->worker->streams, 1);
+}
+
+static void http_workers_push_stats(module_data_t *mod)
+{
+    http_workers_t *set = mod->workers;
+
+    lua_newtable(lua);
+    for(int i = 0; i < set->count; ++i)
+    {
+        http_worker_t *worker = &set->item[i];
+
+        lua_newtable(lua);
+        lua_pushinteger(lua, worker->index);
+        lua_setfield(lua, -2, "loop");
+        lua_pushboolean(lua, worker->sock != NULL);
+        lua_setfield(lua, -2, "listening");
+        lua_pushinteger(lua, (lua_Integer)WORKER_GET(worker->accepted));
+        lua_setfield(lua, -2, "accepted");
+        lua_pushinteger(lua, (lua_Integer)WORKER_GET(worker->active));
+        lua_setfield(lua, -2, "active");
+        lua_pushinteger(lua, (lua_Integer)WORKER_GET(worker->streams));
+        lua_setfield(lua, -2, "streams");
+        lua_pushinteger(lua, (lua_Integer)WORKER_GET(worker->dispatched));
+        lua_setfield(lua, -2, "dispatched");
+        lua_pushinteger(lua, (lua_Integer)WORKER_GET(worker->rejected));
+        lua_setfield(lua, -2, "rejected");
+        lua_pushinteger(lua, (lua_Integer)WORKER_GET(worker->not_found));
+        lua_setfield(lua, -2, "not_found");
+        lua_pushinteger(lua, (lua_Integer)WORKER_GET(worker->bad_requests));
+        lua_setfield(lua, -2, "bad_requests");
+        lua_pushinteger(lua, (lua_Integer)WORKER_GET(worker->accept_errors));
+        lua_setfield(lua, -2, "accept_errors");
+        lua_pushinteger(lua, (lua_Integer)worker->latency_us);
+        lua_setfield(lua, -2, "accept_latency_us");
+        lua_pushinteger(lua, (lua_Integer)worker->latency_max_us);
+        lua_setfield(lua, -2, "accept_latency_max_us");
+        lua_rawseti(lua, -2, i + 1);
+    }
+}
+
 /*
  * oooo     oooo  ooooooo  ooooooooo  ooooo  oooo ooooo       ooooooooooo
  *  8888o   888 o888   888o 888    88o 888    88   888         888    88
@@ -1228,6 +1813,11 @@ static int method_stats(module_data_t *mod)
     lua_setfield(lua, -2, "max_clients");
     lua_pushinteger(lua, (lua_Integer)mod->max_clients_per_ip);
     lua_setfield(lua, -2, "max_clients_per_ip");
+    if(mod->workers)
+    {
+        http_workers_push_stats(mod);
+        lua_setfield(lua, -2, "workers");
+    }
     return 1;
 }
 
@@ -1307,6 +1897,11 @@ static void module_init(module_data_t *mod)
         mod->accept_backoff_ms = 5000;
     mod->closing = false;
 
+    mod->workers_count = 0;
+    module_option_number("workers", &mod->workers_count);
+    if(mod->workers_count < 0)
+        mod->workers_count = 0;
+
     // store routes in registry
     mod->routes = asc_list_init();
     lua_getfield(lua, MODULE_OPTIONS_IDX, "route");
@@ -1347,9 +1942,13 @@ static void module_init(module_data_t *mod)
 
     mod->clients = asc_list_init();
 
-    bool sctp = false;
-    module_option_boolean("sctp", &sctp);
-    if(sctp == true)
+    mod->is_sctp = false;
+    module_option_boolean("sctp", &mod->is_sctp);
+
+    if(mod->workers_count > 0 && http_workers_start(mod))
+        return;
+
+    if(mod->is_sctp == true)
         mod->sock = asc_socket_open_sctp4(mod);
     else
         mod->sock = asc_socket_open_tcp4(mod);
@@ -22,6 +22,7 @@
 
 #include <arpa/inet.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <netdb.h>
 #include <pthread.h>
 #include <signal.h>
@@ -36,6 +37,17 @@
 
 #include "../mpegts/mpegts.h"
 
+#if defined(WITH_KQUEUE)
+#   include <sys/event.h>
+#else
+#   include <sys/epoll.h>
+#   include <sys/eventfd.h>
+#endif
+
+#ifndef MSG_NOSIGNAL
+#   define MSG_NOSIGNAL 0
+#endif
+
 #define MSG(_msg) "[http_buffer] " _msg
 
 #define BUFFER_MIN_BYTES (2 * 1024 * 1024)
@@ -45,6 +57,17 @@
 #define BUFFER_READ_CHUNK 65536
 #define IDR_SCAN_LIMIT (256 * 1024)
 
+#define BUFFER_SENDERS_MAX 32
+#define BUFFER_SENDERS_AUTO 4
+#define BUFFER_SEND_PACKETS 64
+#define BUFFER_WAKE_PACKETS 64
+#define BUFFER_WAKE_US 20000
+#define BUFFER_START_RETRY_US 200000
+#define BUFFER_PCR_JUMP_US 1000000
+#define BUFFER_ACCEPT_BURST 64
+#define BUFFER_PUMP_ROUNDS 4
+#define BUFFER_EVENTS 256
+
 #define START_FLAG_PAT 0x01
 #define START_FLAG_PMT 0x02
 #define START_FLAG_PCR 0x04
@@ -170,7 +193,6 @@ typedef struct buffer_resource_t
     int input_count;
 
     pthread_mutex_t lock;
-    pthread_cond_t cond;
 
     uint8_t *ts_packets;
     ts_meta_t *meta;
@@ -214,6 +236,10 @@ typedef struct buffer_resource_t
     uint64_t bytes_in;
     uint32_t clients_connected;
 
+    uint32_t waiters;
+    uint64_t notify_index;
+    uint64_t notify_us;
+
     uint32_t reconnects;
     int active_input_index;
 
@@ -233,6 +259,8 @@ typedef struct buffer_resource_t
     struct module_data_t *owner;
 } buffer_resource_t;
 
+typedef struct buffer_sender_t buffer_sender_t;
+
 struct module_data_t
 {
     bool enabled;
@@ -241,23 +269,49 @@ struct module_data_t
     char *source_bind_interface;
     int max_clients_total;
     int client_read_timeout_sec;
+    int sender_threads;
 
     int listener_fd;
-    pthread_t listener_thread;
     bool listener_running;
+    buffer_sender_t *senders;
+    int sender_count;
 
     pthread_mutex_t lock;
     uint32_t clients_total;
 
     asc_list_t *resources;
     asc_list_t *allow_rules;
+
+    buffer_resource_t **routes;
+    int route_count;
 };
 
-typedef struct
+#define CLIENT_STATE_REQUEST 0
+#define CLIENT_STATE_REPLY 1
+#define CLIENT_STATE_START 2
+#define CLIENT_STATE_STREAM 3
+
+#define CLIENT_QUEUE_NONE 0
+#define CLIENT_QUEUE_READY 1
+#define CLIENT_QUEUE_IDLE 2
+#define CLIENT_QUEUE_TIMED 3
+#define CLIENT_QUEUE_WAIT 4
+
+typedef struct buffer_client_t
 {
     int fd;
     module_data_t *mod;
+    buffer_sender_t *sender;
     buffer_resource_t *resource;
+    uint32_t ip;
+
+    int state;
+    int queue;
+    TAILQ_ENTRY(buffer_client_t) entry;
+
+    char *request;
+    size_t request_len;
+
     uint64_t read_index;
     uint64_t generation;
     uint8_t *cc_map;
@@ -266,8 +320,49 @@ typedef struct
     uint64_t last_pcr_90k;
     uint64_t last_pcr_wall_us;
     uint64_t last_activity_us;
+    uint64_t start_deadline_us;
+    uint64_t wake_us;
+
+    size_t out_pos;
+    size_t out_len;
+    uint8_t out[BUFFER_SEND_PACKETS * TS_PACKET_SIZE];
 } buffer_client_t;
 
+typedef TAILQ_HEAD(buffer_client_list_t, buffer_client_t) buffer_client_list_t;
+
+/*
+ * Fixed pool of sender threads. Every sender owns a poller (epoll on Linux,
+ * kqueue on BSD and macOS) and the clients it serves; sender 0 also polls the
+ * nonblocking listener and hands accepted sockets out to the least loaded
+ * sender. A client is a cursor into the resource ring: caught up clients are
+ * parked on the idle queue and the reader wakes the senders through the wake
+ * descriptor (eventfd, or a pipe with kqueue) once BUFFER_WAKE_PACKETS are
+ * stored or BUFFER_WAKE_US has passed since the last wake.
+ */
+struct buffer_sender_t
+{
+    module_data_t *mod;
+    int index;
+    int poll_fd;
+    int wake_fd[2];
+    int wake_pending;
+    pthread_t thread;
+    bool thread_running;
+    bool thread_stop;
+
+    pthread_mutex_t lock;
+    buffer_client_list_t incoming;
+
+    buffer_client_list_t ready;
+    buffer_client_list_t idle;
+    buffer_client_list_t timed;
+    buffer_client_list_t waiting;
+    uint32_t clients;
+
+    uint64_t last_accept_error_us;
+    uint64_t accept_resume_us;
+};
+
 static uint32_t hash_update(uint32_t h, const void *data, size_t len)
 {
     const uint8_t *p = (const uint8_t *)data;
@@ -426,15 +521,36 @@ static buffer_resource_t *resource_find_by_path(module_data_t *mod, const char *
 {
     if(!mod || !path)
         return NULL;
-    asc_list_for(mod->resources)
+    for(int i = 0; i < mod->route_count; ++i)
     {
-        buffer_resource_t *res = (buffer_resource_t *)asc_list_data(mod->resources);
-        if(res && res->path && strcmp(res->path, path) == 0)
+        buffer_resource_t *res = mod->routes[i];
+        if(res->path && strcmp(res->path, path) == 0)
             return res;
     }
     return NULL;
 }
 
+/* mod->lock is held: senders look paths up in this snapshot, not in mod->resources */
+static void resource_update_routes(module_data_t *mod)
+{
+    free(mod->routes);
+    mod->routes = NULL;
+    mod->route_count = 0;
+
+    const size_t count = mod->resources ? asc_list_size(mod->resources) : 0;
+    if(count == 0)
+        return;
+    mod->routes = (buffer_resource_t **)calloc(count, sizeof(buffer_resource_t *));
+    if(!mod->routes)
+        return;
+    asc_list_for(mod->resources)
+    {
+        buffer_resource_t *res = (buffer_resource_t *)asc_list_data(mod->resources);
+        if(res)
+            mod->routes[mod->route_count++] = res;
+    }
+}
+
 static void free_inputs(buffer_input_t *inputs, int count)
 {
     if(!inputs)
@@ -610,10 +726,172 @@ static void resource_destroy(buffer_resource_t *res)
     if(res->pmt)
         mpegts_psi_destroy(res->pmt);
     pthread_mutex_destroy(&res->lock);
-    pthread_cond_destroy(&res->cond);
     free(res);
 }
 
+/*
+ * sender poller: level triggered read interest for requests, the listener and
+ * the wake descriptor, edge triggered write interest for streaming clients
+ */
+
+typedef struct
+{
+    void *ptr;
+    bool error;
+} buffer_poll_event_t;
+
+static void set_nonblock_cloexec(int fd)
+{
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+}
+
+static bool sender_poll_add(buffer_sender_t *sender, int fd, void *ptr)
+{
+#if defined(WITH_KQUEUE)
+    struct kevent ed;
+    EV_SET(&ed, fd, EVFILT_READ, EV_ADD, 0, 0, ptr);
+    return kevent(sender->poll_fd, &ed, 1, NULL, 0, NULL) == 0;
+#else
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.ptr = ptr;
+    return epoll_ctl(sender->poll_fd, EPOLL_CTL_ADD, fd, &ev) == 0;
+#endif
+}
+
+static void sender_poll_del(buffer_sender_t *sender, int fd)
+{
+#if defined(WITH_KQUEUE)
+    struct kevent ed;
+    EV_SET(&ed, fd, EVFILT_READ, EV_DELETE, 0, 0, NULL);
+    kevent(sender->poll_fd, &ed, 1, NULL, 0, NULL);
+#else
+    epoll_ctl(sender->poll_fd, EPOLL_CTL_DEL, fd, NULL);
+#endif
+}
+
+/* the request is read: from now on the client only waits for the socket to drain */
+static bool sender_poll_set_write(buffer_sender_t *sender, int fd, void *ptr)
+{
+#if defined(WITH_KQUEUE)
+    struct kevent ed[2];
+    EV_SET(&ed[0], fd, EVFILT_READ, EV_DELETE, 0, 0, ptr);
+    EV_SET(&ed[1], fd, EVFILT_WRITE, EV_ADD | EV_CLEAR, 0, 0, ptr);
+    return kevent(sender->poll_fd, ed, 2, NULL, 0, NULL) == 0;
+#else
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLOUT | EPOLLET;
+    ev.data.ptr = ptr;
+    return epoll_ctl(sender->poll_fd, EPOLL_CTL_MOD, fd, &ev) == 0;
+#endif
+}
+
+static int sender_poll_wait(buffer_sender_t *sender, buffer_poll_event_t *events, int timeout_ms)
+{
+#if defined(WITH_KQUEUE)
+    struct kevent list[BUFFER_EVENTS];
+    struct timespec ts;
+    ts.tv_sec = timeout_ms / 1000;
+    ts.tv_nsec = (timeout_ms % 1000) * 1000000L;
+    const int count = kevent(sender->poll_fd, NULL, 0, list, BUFFER_EVENTS
+                             , (timeout_ms < 0) ? NULL : &ts);
+    for(int i = 0; i < count; ++i)
+    {
+        events[i].ptr = (void *)list[i].udata;
+        events[i].error = (list[i].flags & EV_ERROR)
+                       || (list[i].filter == EVFILT_WRITE && (list[i].flags & EV_EOF));
+    }
+#else
+    struct epoll_event list[BUFFER_EVENTS];
+    const int count = epoll_wait(sender->poll_fd, list, BUFFER_EVENTS, timeout_ms);
+    for(int i = 0; i < count; ++i)
+    {
+        events[i].ptr = list[i].data.ptr;
+        events[i].error = (list[i].events & (EPOLLERR | EPOLLHUP)) != 0;
+    }
+#endif
+    return count;
+}
+
+static bool sender_poll_open(buffer_sender_t *sender)
+{
+#if defined(WITH_KQUEUE)
+    sender->poll_fd = kqueue();
+    if(sender->poll_fd < 0)
+        return false;
+    fcntl(sender->poll_fd, F_SETFD, FD_CLOEXEC);
+    if(pipe(sender->wake_fd) != 0)
+    {
+        sender->wake_fd[0] = -1;
+        sender->wake_fd[1] = -1;
+        return false;
+    }
+    set_nonblock_cloexec(sender->wake_fd[0]);
+    set_nonblock_cloexec(sender->wake_fd[1]);
+#else
+    sender->poll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if(sender->poll_fd < 0)
+        return false;
+    sender->wake_fd[0] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    sender->wake_fd[1] = sender->wake_fd[0];
+    if(sender->wake_fd[0] < 0)
+        return false;
+#endif
+    /* the wake descriptor is reported with a NULL pointer */
+    return sender_poll_add(sender, sender->wake_fd[0], NULL);
+}
+
+static void sender_poll_close(buffer_sender_t *sender)
+{
+    if(sender->poll_fd >= 0)
+        close(sender->poll_fd);
+    if(sender->wake_fd[1] >= 0 && sender->wake_fd[1] != sender->wake_fd[0])
+        close(sender->wake_fd[1]);
+    if(sender->wake_fd[0] >= 0)
+        close(sender->wake_fd[0]);
+    sender->poll_fd = -1;
+    sender->wake_fd[0] = -1;
+    sender->wake_fd[1] = -1;
+}
+
+static void sender_wake(buffer_sender_t *sender)
+{
+    if(__atomic_exchange_n(&sender->wake_pending, 1, __ATOMIC_ACQ_REL))
+        return;
+    const uint64_t value = 1;
+    if(write(sender->wake_fd[1], &value, sizeof(value)) == -1)
+        __atomic_store_n(&sender->wake_pending, 0, __ATOMIC_RELEASE);
+}
+
+/* res->lock is held: wakes the senders with clients parked on this resource */
+static void resource_notify(buffer_resource_t *res, bool force)
+{
+    if(!res->waiters)
+        return;
+    const uint64_t now = now_us();
+    if(!force
+       && res->write_index - res->notify_index < BUFFER_WAKE_PACKETS
+       && now - res->notify_us < BUFFER_WAKE_US)
+    {
+        return;
+    }
+
+    module_data_t *mod = res->owner;
+    const uint32_t waiters = res->waiters;
+    res->waiters = 0;
+    res->notify_index = res->write_index;
+    res->notify_us = now;
+
+    for(int i = 0; i < mod->sender_count; ++i)
+    {
+        if(waiters & (1u << i))
+            sender_wake(&mod->senders[i]);
+    }
+}
+
 static bool allow_check(module_data_t *mod, uint32_t ip)
 {
     if(!mod || !mod->allow_rules)
@@ -1835,7 +2113,7 @@ static bool read_http_stream(buffer_resource_t *res, buffer_input_t *input, cons
                                     mark_input_state(input, INPUT_STATE_OK, NULL);
                                 resource_update_state(res);
                             }
-                            pthread_cond_broadcast(&res->cond);
+                            resource_notify(res, false);
                             pthread_mutex_unlock(&res->lock);
                             if(!ok_feed)
                             {
@@ -1885,7 +2163,7 @@ static bool read_http_stream(buffer_resource_t *res, buffer_input_t *input, cons
                             mark_input_state(input, INPUT_STATE_OK, NULL);
                         resource_update_state(res);
                     }
-                    pthread_cond_broadcast(&res->cond);
+                    resource_notify(res, false);
                     pthread_mutex_unlock(&res->lock);
                     if(!ok_feed)
                     {
@@ -2020,7 +2298,7 @@ static void *resource_thread(void *arg)
 
         pthread_mutex_lock(&res->lock);
         resource_clear_packets(res);
-        pthread_cond_broadcast(&res->cond);
+        resource_notify(res, true);
         pthread_mutex_unlock(&res->lock);
 
         bool ok = read_http_stream(res, input, mod->source_bind_interface);
@@ -2097,8 +2375,19 @@ static void resource_stop(buffer_resource_t *res)
     }
     pthread_join(res->thread, NULL);
     res->thread_running = false;
+
+    pthread_mutex_lock(&res->lock);
+    resource_notify(res, true);
+    pthread_mutex_unlock(&res->lock);
 }
 
+static const char *buffer_reply_headers =
+    "HTTP/1.1 200 OK\r\n"
+    "Cache-Control: no-cache\r\n"
+    "Pragma: no-cache\r\n"
+    "Content-Type: application/octet-stream\r\n"
+    "Connection: close\r\n\r\n";
+
 static void client_release(buffer_client_t *client)
 {
     if(!client)
@@ -2116,16 +2405,17 @@ static void client_release(buffer_client_t *client)
             res->clients_connected -= 1;
         destroy = res->delete_pending && res->clients_connected == 0;
         pthread_mutex_unlock(&res->lock);
-    }
 
-    if(mod)
-    {
         pthread_mutex_lock(&mod->lock);
         if(mod->clients_total > 0)
             mod->clients_total -= 1;
         pthread_mutex_unlock(&mod->lock);
     }
 
+    if(client->sender)
+        __atomic_sub_fetch(&client->sender->clients, 1, __ATOMIC_RELAXED);
+
+    free(client->request);
     free(client->cc_map);
     free(client);
 
@@ -2133,45 +2423,162 @@ static void client_release(buffer_client_t *client)
         resource_destroy(res);
 }
 
-static void *client_thread(void *arg)
+static buffer_client_list_t *sender_queue(buffer_sender_t *sender, int queue)
 {
-    buffer_client_t *client = (buffer_client_t *)arg;
-    buffer_resource_t *res = client->resource;
-    client->last_activity_us = now_us();
+    switch(queue)
+    {
+        case CLIENT_QUEUE_READY:
+            return &sender->ready;
+        case CLIENT_QUEUE_IDLE:
+            return &sender->idle;
+        case CLIENT_QUEUE_TIMED:
+            return &sender->timed;
+        case CLIENT_QUEUE_WAIT:
+            return &sender->waiting;
+        default:
+            return NULL;
+    }
+}
 
-    uint64_t start_index = 0;
-    buffer_start_debug_t dbg;
-    memset(&dbg, 0, sizeof(dbg));
+static void client_queue(buffer_client_t *client, int queue)
+{
+    buffer_sender_t *sender = client->sender;
+    if(client->queue != CLIENT_QUEUE_NONE)
+        TAILQ_REMOVE(sender_queue(sender, client->queue), client, entry);
+    client->queue = queue;
+    if(queue != CLIENT_QUEUE_NONE)
+        TAILQ_INSERT_TAIL(sender_queue(sender, queue), client, entry);
+}
 
-    pthread_mutex_lock(&res->lock);
-    uint64_t deadline = now_us() + (uint64_t)res->smart_wait_ready_ms * 1000ULL;
-    bool picked = false;
-    while(!picked && !res->thread_stop)
+static void client_close(buffer_client_t *client)
+{
+    client_queue(client, CLIENT_QUEUE_NONE);
+    client_release(client);
+}
+
+static void client_reply(buffer_client_t *client, const char *reply)
+{
+    const size_t len = strlen(reply);
+    memcpy(client->out, reply, len);
+    client->out_pos = 0;
+    client->out_len = len;
+    client->state = CLIENT_STATE_REPLY;
+}
+
+static void client_on_request(buffer_client_t *client)
+{
+    module_data_t *mod = client->mod;
+    const char *reply = NULL;
+
+    char method[8] = { 0 };
+    char path[256] = { 0 };
+    if(sscanf(client->request, "%7s %255s", method, path) != 2)
     {
-        if(res->smart_start_enabled)
+        reply = "HTTP/1.1 400 Bad Request\r\nConnection: close\r\n\r\n";
+    }
+    else if(strcmp(method, "GET") != 0)
+    {
+        reply = "HTTP/1.1 405 Method Not Allowed\r\nConnection: close\r\n\r\n";
+    }
+    else
+    {
+        char *query = strchr(path, '?');
+        if(query)
+            *query = '\0';
+
+        pthread_mutex_lock(&mod->lock);
+        buffer_resource_t *res = resource_find_by_path(mod, path);
+        if(!res || !res->enable)
         {
-            picked = buffer_select_start(res, &start_index, &dbg);
-            if(picked)
-                break;
+            reply = "HTTP/1.1 404 Not Found\r\nConnection: close\r\n\r\n";
+        }
+        else if(!allow_check(mod, client->ip))
+        {
+            reply = "HTTP/1.1 403 Forbidden\r\nConnection: close\r\n\r\n";
         }
         else
         {
-            picked = true;
-            break;
+            mod->clients_total += 1;
+            pthread_mutex_lock(&res->lock);
+            res->clients_connected += 1;
+            client->start_deadline_us = now_us() + (uint64_t)res->smart_wait_ready_ms * 1000ULL;
+            pthread_mutex_unlock(&res->lock);
+            client->resource = res;
         }
+        pthread_mutex_unlock(&mod->lock);
+    }
 
-        if(now_us() >= deadline)
-            break;
+    free(client->request);
+    client->request = NULL;
+    client->request_len = 0;
+
+    if(!sender_poll_set_write(client->sender, client->fd, client))
+    {
+        client_close(client);
+        return;
+    }
 
-        struct timespec ts;
-        uint64_t wait_us = 200000;
-        uint64_t now = now_us();
-        if(deadline > now && deadline - now < wait_us)
-            wait_us = deadline - now;
-        uint64_t target = now + wait_us;
-        ts.tv_sec = (time_t)(target / 1000000ULL);
-        ts.tv_nsec = (long)((target % 1000000ULL) * 1000ULL);
-        pthread_cond_timedwait(&res->cond, &res->lock, &ts);
+    if(reply)
+        client_reply(client, reply);
+    else
+        client->state = CLIENT_STATE_START;
+    client_queue(client, CLIENT_QUEUE_READY);
+}
+
+static void client_on_read(buffer_client_t *client)
+{
+    if(!client->request)
+    {
+        client->request = (char *)malloc(BUFFER_HEADER_MAX);
+        if(!client->request)
+        {
+            client_close(client);
+            return;
+        }
+    }
+
+    const ssize_t len = recv(client->fd, client->request + client->request_len
+                             , BUFFER_HEADER_MAX - 1 - client->request_len, 0);
+    if(len < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+        return;
+    if(len <= 0)
+    {
+        client_close(client);
+        return;
+    }
+
+    client->request_len += (size_t)len;
+    client->request[client->request_len] = '\0';
+    if(client->request_len < BUFFER_HEADER_MAX - 1
+       && !strstr(client->request, "\r\n\r\n")
+       && !strstr(client->request, "\n\n"))
+    {
+        return;
+    }
+
+    client_on_request(client);
+}
+
+/* the start position: smart start, retried until smart_wait_ready_ms, or the fallback offset */
+static int client_start(buffer_client_t *client, uint64_t now)
+{
+    buffer_resource_t *res = client->resource;
+    uint64_t start_index = 0;
+    buffer_start_debug_t dbg;
+    memset(&dbg, 0, sizeof(dbg));
+
+    pthread_mutex_lock(&res->lock);
+    bool picked = true;
+    if(res->smart_start_enabled)
+        picked = !res->thread_stop && buffer_select_start(res, &start_index, &dbg);
+
+    if(!picked && !res->thread_stop && now < client->start_deadline_us)
+    {
+        pthread_mutex_unlock(&res->lock);
+        client->wake_us = now + BUFFER_START_RETRY_US;
+        if(client->wake_us > client->start_deadline_us)
+            client->wake_us = client->start_deadline_us;
+        return CLIENT_QUEUE_TIMED;
     }
 
     if(!picked)
@@ -2200,261 +2607,601 @@ static void *client_thread(void *arg)
     client->generation = res->generation;
     if(res->start_debug_enabled)
         res->last_start_debug = dbg;
-
+    client->rewrite_cc = res->ts_rewrite_cc_enabled;
+    client->pacing_pcr = strcmp(res->pacing_mode, "pcr") == 0;
     pthread_mutex_unlock(&res->lock);
 
-    const char *headers =
-        "HTTP/1.1 200 OK\r\n"
-        "Cache-Control: no-cache\r\n"
-        "Pragma: no-cache\r\n"
-        "Content-Type: application/octet-stream\r\n"
-        "Connection: close\r\n\r\n";
-
-    if(!send_all(client->fd, headers, strlen(headers)))
+    if(client->rewrite_cc)
     {
-        client_release(client);
-        return NULL;
+        client->cc_map = (uint8_t *)calloc(MAX_PID, sizeof(uint8_t));
+        if(!client->cc_map)
+            return CLIENT_QUEUE_NONE;
     }
 
-    client->rewrite_cc = res->ts_rewrite_cc_enabled;
-    client->pacing_pcr = strcmp(res->pacing_mode, "pcr") == 0;
-    if(client->rewrite_cc)
-        client->cc_map = (uint8_t *)calloc(MAX_PID, sizeof(uint8_t));
+    const size_t len = strlen(buffer_reply_headers);
+    memcpy(client->out, buffer_reply_headers, len);
+    client->out_len = len;
+    client->state = CLIENT_STATE_STREAM;
+    client->last_activity_us = now;
+    return CLIENT_QUEUE_READY;
+}
 
-    while(!res->thread_stop)
+/*
+ * Copies the next packets from the ring into client->out. Returns the queue
+ * for the client: READY with data, IDLE when caught up (the sender is
+ * registered as a waiter), TIMED for PCR pacing, NONE to disconnect.
+ */
+static int client_fill(buffer_client_t *client, uint64_t now)
+{
+    if(client->state == CLIENT_STATE_START)
+        return client_start(client, now);
+
+    buffer_resource_t *res = client->resource;
+    pthread_mutex_lock(&res->lock);
+    if(res->thread_stop)
     {
-        pthread_mutex_lock(&res->lock);
-        if(client->generation != res->generation)
-        {
-            client->read_index = res->write_index;
-            client->generation = res->generation;
-        }
+        pthread_mutex_unlock(&res->lock);
+        return CLIENT_QUEUE_NONE;
+    }
 
-        if(res->write_index == 0 || client->read_index >= res->write_index)
-        {
-            struct timespec ts;
-            uint64_t now = now_us();
-            ts.tv_sec = (time_t)(now / 1000000ULL + 1);
-            ts.tv_nsec = (long)((now % 1000000ULL) * 1000ULL);
-            pthread_cond_timedwait(&res->cond, &res->lock, &ts);
-            pthread_mutex_unlock(&res->lock);
-            int timeout_sec = client->mod ? client->mod->client_read_timeout_sec : 20;
-            if((now_us() - client->last_activity_us) / 1000000ULL > (uint64_t)timeout_sec)
-                break;
-            continue;
-        }
+    if(client->generation != res->generation)
+    {
+        client->read_index = res->write_index;
+        client->generation = res->generation;
+    }
+
+    if(res->write_index == 0 || client->read_index >= res->write_index)
+    {
+        res->waiters |= 1u << client->sender->index;
+        pthread_mutex_unlock(&res->lock);
+        return CLIENT_QUEUE_IDLE;
+    }
 
-        uint64_t min_index = (res->write_index > res->capacity_packets)
-            ? (res->write_index - res->capacity_packets)
-            : 0;
+    uint64_t min_index = (res->write_index > res->capacity_packets)
+        ? (res->write_index - res->capacity_packets)
+        : 0;
 
-        uint64_t lag_packets = 0;
-        if(res->max_client_lag_ms > 0)
-            lag_packets = packets_for_ms(res, res->max_client_lag_ms);
-        uint64_t min_allowed = (lag_packets > 0 && res->write_index > lag_packets)
-            ? (res->write_index - lag_packets)
-            : min_index;
+    uint64_t lag_packets = 0;
+    if(res->max_client_lag_ms > 0)
+        lag_packets = packets_for_ms(res, res->max_client_lag_ms);
+    uint64_t min_allowed = (lag_packets > 0 && res->write_index > lag_packets)
+        ? (res->write_index - lag_packets)
+        : min_index;
 
-        if(client->read_index < min_allowed)
-        {
-            client->read_index = min_allowed;
-            asc_log_warning(MSG("CLIENT_LAG_DROP %s"), res->id);
-        }
+    if(client->read_index < min_allowed)
+    {
+        client->read_index = min_allowed;
+        asc_log_warning(MSG("CLIENT_LAG_DROP %s"), res->id);
+    }
 
+    int queue = CLIENT_QUEUE_READY;
+    bool fail = false;
+    size_t len = 0;
+    while(len < sizeof(client->out) && client->read_index < res->write_index)
+    {
         const uint64_t idx = client->read_index % res->capacity_packets;
-        uint8_t packet[TS_PACKET_SIZE];
-        memcpy(packet, &res->ts_packets[idx * TS_PACKET_SIZE], TS_PACKET_SIZE);
-        ts_meta_t meta = res->meta[idx];
-        pthread_mutex_unlock(&res->lock);
+        const uint8_t *packet = &res->ts_packets[idx * TS_PACKET_SIZE];
+        const ts_meta_t *meta = &res->meta[idx];
 
         if(packet[0] != 0x47)
         {
             if(!res->ts_resync_enabled)
+            {
+                fail = true;
                 break;
+            }
             client->read_index += 1;
             continue;
         }
 
-        if(client->rewrite_cc)
-        {
-            uint16_t pid = meta.pid;
-            uint8_t cc = client->cc_map[pid] & 0x0F;
-            TS_SET_CC(packet, cc);
-            client->cc_map[pid] = (cc + 1) & 0x0F;
-        }
-
-        if(client->pacing_pcr && meta.has_pcr)
+        if(client->pacing_pcr && meta->has_pcr)
         {
-            if(client->last_pcr_90k != 0)
+            const uint64_t delta_pcr = meta->pcr_90k - client->last_pcr_90k;
+            if(client->last_pcr_90k != 0 && delta_pcr < 90000ULL * BUFFER_PCR_JUMP_US / 1000000ULL)
             {
-                uint64_t delta_pcr = meta.pcr_90k - client->last_pcr_90k;
-                uint64_t delta_us = (delta_pcr * 1000000ULL) / 90000ULL;
-                uint64_t now = now_us();
-                uint64_t expected = client->last_pcr_wall_us + delta_us;
+                const uint64_t expected = client->last_pcr_wall_us + (delta_pcr * 1000000ULL) / 90000ULL;
                 if(expected > now)
-                    usleep(expected - now);
+                {
+                    if(len == 0)
+                    {
+                        client->wake_us = expected;
+                        queue = CLIENT_QUEUE_TIMED;
+                    }
+                    break;
+                }
             }
-            client->last_pcr_90k = meta.pcr_90k;
-            client->last_pcr_wall_us = now_us();
+            client->last_pcr_90k = meta->pcr_90k;
+            client->last_pcr_wall_us = now;
         }
 
-        if(!send_all(client->fd, packet, TS_PACKET_SIZE))
-            break;
+        uint8_t *ts = &client->out[len];
+        memcpy(ts, packet, TS_PACKET_SIZE);
+        if(client->rewrite_cc)
+        {
+            const uint16_t pid = meta->pid;
+            const uint8_t cc = client->cc_map[pid] & 0x0F;
+            TS_SET_CC(ts, cc);
+            client->cc_map[pid] = (cc + 1) & 0x0F;
+        }
 
+        len += TS_PACKET_SIZE;
         client->read_index += 1;
-        client->last_activity_us = now_us();
     }
 
-    client_release(client);
-    return NULL;
+    if(len == 0 && !fail && queue == CLIENT_QUEUE_READY)
+    {
+        res->waiters |= 1u << client->sender->index;
+        queue = CLIENT_QUEUE_IDLE;
+    }
+    pthread_mutex_unlock(&res->lock);
+
+    if(len == 0)
+        return fail ? CLIENT_QUEUE_NONE : queue;
+    client->out_len = len;
+    return CLIENT_QUEUE_READY;
 }
 
-static void *listener_thread(void *arg)
+static void client_pump(buffer_client_t *client, uint64_t now)
 {
-    module_data_t *mod = (module_data_t *)arg;
-    struct sockaddr_in addr;
-    int fd = socket(AF_INET, SOCK_STREAM, 0);
-    if(fd < 0)
-        return NULL;
-
-    int reuse = 1;
-    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    for(int round = 0; round < BUFFER_PUMP_ROUNDS; ++round)
+    {
+        if(client->out_pos >= client->out_len)
+        {
+            if(client->state == CLIENT_STATE_REPLY)
+            {
+                client_close(client);
+                return;
+            }
+            client->out_pos = 0;
+            client->out_len = 0;
+            const int queue = client_fill(client, now);
+            if(queue == CLIENT_QUEUE_NONE)
+            {
+                client_close(client);
+                return;
+            }
+            if(queue != CLIENT_QUEUE_READY)
+            {
+                client_queue(client, queue);
+                return;
+            }
+        }
 
-    memset(&addr, 0, sizeof(addr));
-    addr.sin_family = AF_INET;
-    addr.sin_port = htons(mod->listen_port);
-    if(!mod->listen_host || strcmp(mod->listen_host, "0.0.0.0") == 0)
-        addr.sin_addr.s_addr = htonl(INADDR_ANY);
-    else
-        inet_aton(mod->listen_host, &addr.sin_addr);
+        const ssize_t len = send(client->fd, &client->out[client->out_pos]
+                                 , client->out_len - client->out_pos, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if(len < 0)
+        {
+            if(errno == EINTR)
+                continue;
+            if(errno == EAGAIN || errno == EWOULDBLOCK)
+                client_queue(client, CLIENT_QUEUE_WAIT);
+            else
+                client_close(client);
+            return;
+        }
 
-    if(bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0)
-    {
-        asc_log_error(MSG("bind failed: %s"), strerror(errno));
-        close(fd);
-        return NULL;
+        client->out_pos += (size_t)len;
+        client->last_activity_us = now;
     }
 
-    if(listen(fd, 128) != 0)
+    /* round robin: the client goes to the tail of the ready queue */
+    client_queue(client, CLIENT_QUEUE_READY);
+}
+
+static void sender_attach(buffer_sender_t *sender, buffer_client_t *client)
+{
+    if(!sender_poll_add(sender, client->fd, client))
     {
-        asc_log_error(MSG("listen failed: %s"), strerror(errno));
-        close(fd);
-        return NULL;
+        client_release(client);
+        return;
     }
+    client_queue(client, CLIENT_QUEUE_WAIT);
+}
 
-    mod->listener_fd = fd;
+static void sender_accept(buffer_sender_t *sender)
+{
+    module_data_t *mod = sender->mod;
 
-    while(mod->listener_running)
+    for(int i = 0; i < BUFFER_ACCEPT_BURST; ++i)
     {
-        struct sockaddr_in client_addr;
-        socklen_t client_len = sizeof(client_addr);
-        int client_fd = accept(fd, (struct sockaddr *)&client_addr, &client_len);
-        if(client_fd < 0)
+        struct sockaddr_in addr;
+        socklen_t addr_len = sizeof(addr);
+#ifdef SOCK_NONBLOCK
+        const int fd = accept4(mod->listener_fd, (struct sockaddr *)&addr, &addr_len
+                               , SOCK_NONBLOCK | SOCK_CLOEXEC);
+#else
+        const int fd = accept(mod->listener_fd, (struct sockaddr *)&addr, &addr_len);
+        if(fd >= 0)
+            set_nonblock_cloexec(fd);
+#endif
+        if(fd < 0)
         {
-            if(errno == EINTR)
+            if(errno == EINTR || errno == ECONNABORTED)
                 continue;
-            if(!mod->listener_running)
-                break;
-            continue;
+            if(errno == EAGAIN || errno == EWOULDBLOCK)
+                return;
+
+            /* out of descriptors or memory: the listener stays readable, pause it */
+            const uint64_t now = now_us();
+            if(now - sender->last_accept_error_us >= 1000000ULL)
+            {
+                sender->last_accept_error_us = now;
+                asc_log_error(MSG("accept failed: %s"), strerror(errno));
+            }
+            sender_poll_del(sender, mod->listener_fd);
+            sender->accept_resume_us = now + 100000ULL;
+            return;
         }
 
         pthread_mutex_lock(&mod->lock);
-        bool over_limit = mod->clients_total >= (uint32_t)mod->max_clients_total;
+        const bool over_limit = mod->clients_total >= (uint32_t)mod->max_clients_total;
         pthread_mutex_unlock(&mod->lock);
 
         if(over_limit)
         {
             const char *reply = "HTTP/1.1 503 Service Unavailable\r\nConnection: close\r\n\r\n";
-            send_all(client_fd, reply, strlen(reply));
-            close(client_fd);
+            send_all(fd, reply, strlen(reply));
+            close(fd);
             continue;
         }
 
-        char header[BUFFER_HEADER_MAX];
-        ssize_t read_len = recv(client_fd, header, sizeof(header) - 1, 0);
-        if(read_len <= 0)
+        buffer_client_t *client = (buffer_client_t *)calloc(1, sizeof(buffer_client_t));
+        if(!client)
         {
-            close(client_fd);
+            close(fd);
             continue;
         }
-        header[read_len] = '\0';
+        client->fd = fd;
+        client->mod = mod;
+        client->ip = ntohl(addr.sin_addr.s_addr);
+        client->state = CLIENT_STATE_REQUEST;
+        client->last_activity_us = now_us();
 
-        char method[8] = { 0 };
-        char path[256] = { 0 };
-        if(sscanf(header, "%7s %255s", method, path) != 2)
+        buffer_sender_t *target = sender;
+        uint32_t target_clients = __atomic_load_n(&sender->clients, __ATOMIC_RELAXED);
+        for(int s = 0; s < mod->sender_count; ++s)
         {
-            const char *reply = "HTTP/1.1 400 Bad Request\r\nConnection: close\r\n\r\n";
-            send_all(client_fd, reply, strlen(reply));
-            close(client_fd);
-            continue;
+            const uint32_t clients = __atomic_load_n(&mod->senders[s].clients, __ATOMIC_RELAXED);
+            if(clients < target_clients)
+            {
+                target = &mod->senders[s];
+                target_clients = clients;
+            }
         }
+        client->sender = target;
+        __atomic_add_fetch(&target->clients, 1, __ATOMIC_RELAXED);
 
-        if(strcmp(method, "GET") != 0)
+        if(target == sender)
         {
-            const char *reply = "HTTP/1.1 405 Method Not Allowed\r\nConnection: close\r\n\r\n";
-            send_all(client_fd, reply, strlen(reply));
-            close(client_fd);
-            continue;
+            sender_attach(sender, client);
+        }
+        else
+        {
+            pthread_mutex_lock(&target->lock);
+            TAILQ_INSERT_TAIL(&target->incoming, client, entry);
+            pthread_mutex_unlock(&target->lock);
+            sender_wake(target);
         }
+    }
+}
 
-        char *query = strchr(path, '?');
-        if(query)
-            *query = '\0';
+static void sender_check_timeouts(buffer_sender_t *sender, uint64_t now)
+{
+    const int timeout_sec = sender->mod->client_read_timeout_sec;
+    buffer_client_list_t *lists[2] = { &sender->idle, &sender->waiting };
 
-        buffer_resource_t *res = resource_find_by_path(mod, path);
-        if(!res || !res->enable)
+    for(int i = 0; i < 2; ++i)
+    {
+        buffer_client_t *client, *next;
+        TAILQ_FOREACH_SAFE(client, lists[i], entry, next)
         {
-            const char *reply = "HTTP/1.1 404 Not Found\r\nConnection: close\r\n\r\n";
-            send_all(client_fd, reply, strlen(reply));
-            close(client_fd);
-            continue;
+            if((now - client->last_activity_us) / 1000000ULL > (uint64_t)timeout_sec)
+                client_close(client);
         }
+    }
+}
+
+static int sender_timeout(buffer_sender_t *sender, uint64_t now, uint64_t next_check_us)
+{
+    if(!TAILQ_EMPTY(&sender->ready))
+        return 0;
+
+    uint64_t wake_us = next_check_us;
+    if(sender->accept_resume_us && sender->accept_resume_us < wake_us)
+        wake_us = sender->accept_resume_us;
+
+    buffer_client_t *client;
+    TAILQ_FOREACH(client, &sender->timed, entry)
+    {
+        if(client->wake_us < wake_us)
+            wake_us = client->wake_us;
+    }
+
+    if(wake_us <= now)
+        return 0;
+    return (int)((wake_us - now + 999) / 1000);
+}
 
-        uint32_t ip = ntohl(client_addr.sin_addr.s_addr);
-        if(!allow_check(mod, ip))
+static void *sender_thread(void *arg)
+{
+    buffer_sender_t *sender = (buffer_sender_t *)arg;
+    module_data_t *mod = sender->mod;
+    buffer_poll_event_t events[BUFFER_EVENTS];
+    uint64_t next_check_us = now_us() + 1000000ULL;
+
+    while(!__atomic_load_n(&sender->thread_stop, __ATOMIC_ACQUIRE))
+    {
+        const int timeout = sender_timeout(sender, now_us(), next_check_us);
+        const int count = sender_poll_wait(sender, events, timeout);
+        if(count < 0 && errno != EINTR)
         {
-            const char *reply = "HTTP/1.1 403 Forbidden\r\nConnection: close\r\n\r\n";
-            send_all(client_fd, reply, strlen(reply));
-            close(client_fd);
-            continue;
+            asc_log_error(MSG("sender %d: poll failed: %s"), sender->index, strerror(errno));
+            break;
         }
 
-        buffer_client_t *client = (buffer_client_t *)calloc(1, sizeof(buffer_client_t));
-        client->fd = client_fd;
-        client->mod = mod;
-        client->resource = res;
+        bool woken = false;
+        for(int i = 0; i < count; ++i)
+        {
+            void *ptr = events[i].ptr;
+            if(ptr == NULL)
+            {
+                woken = true;
+                continue;
+            }
+            if(ptr == (void *)mod)
+            {
+                sender_accept(sender);
+                continue;
+            }
 
-        pthread_mutex_lock(&mod->lock);
-        mod->clients_total += 1;
-        pthread_mutex_unlock(&mod->lock);
+            buffer_client_t *client = (buffer_client_t *)ptr;
+            if(events[i].error)
+                client_close(client);
+            else if(client->state == CLIENT_STATE_REQUEST)
+                client_on_read(client);
+            else if(client->queue == CLIENT_QUEUE_WAIT)
+                client_queue(client, CLIENT_QUEUE_READY);
+        }
 
-        pthread_mutex_lock(&res->lock);
-        res->clients_connected += 1;
-        pthread_mutex_unlock(&res->lock);
+        if(woken)
+        {
+            __atomic_store_n(&sender->wake_pending, 0, __ATOMIC_RELEASE);
+            uint64_t value;
+            while(read(sender->wake_fd[0], &value, sizeof(value)) > 0)
+                continue;
 
-        pthread_t thread;
-        if(pthread_create(&thread, NULL, client_thread, client) == 0)
+            buffer_client_list_t incoming;
+            TAILQ_INIT(&incoming);
+            pthread_mutex_lock(&sender->lock);
+            TAILQ_CONCAT(&incoming, &sender->incoming, entry);
+            pthread_mutex_unlock(&sender->lock);
+            while(!TAILQ_EMPTY(&incoming))
+            {
+                buffer_client_t *client = TAILQ_FIRST(&incoming);
+                TAILQ_REMOVE(&incoming, client, entry);
+                sender_attach(sender, client);
+            }
+
+            while(!TAILQ_EMPTY(&sender->idle))
+                client_queue(TAILQ_FIRST(&sender->idle), CLIENT_QUEUE_READY);
+        }
+
+        const uint64_t now = now_us();
+
+        if(sender->accept_resume_us && now >= sender->accept_resume_us)
         {
-            pthread_detach(thread);
+            sender_poll_add(sender, mod->listener_fd, mod);
+            sender->accept_resume_us = 0;
         }
-        else
+
+        buffer_client_t *client, *next;
+        TAILQ_FOREACH_SAFE(client, &sender->timed, entry, next)
         {
-            client_release(client);
+            if(client->wake_us <= now)
+                client_queue(client, CLIENT_QUEUE_READY);
+        }
+
+        /* every ready client gets one turn, pumped clients requeue at the tail */
+        int ready = 0;
+        TAILQ_FOREACH(client, &sender->ready, entry)
+            ++ready;
+        while(ready-- > 0 && !TAILQ_EMPTY(&sender->ready))
+            client_pump(TAILQ_FIRST(&sender->ready), now);
+
+        if(now >= next_check_us)
+        {
+            sender_check_timeouts(sender, now);
+            next_check_us = now + 1000000ULL;
         }
     }
 
-    close(fd);
-    mod->listener_fd = -1;
     return NULL;
 }
 
+static void sender_release_list(buffer_client_list_t *list)
+{
+    while(!TAILQ_EMPTY(list))
+    {
+        buffer_client_t *client = TAILQ_FIRST(list);
+        TAILQ_REMOVE(list, client, entry);
+        client_release(client);
+    }
+}
+
+static void buffer_stop_senders(module_data_t *mod)
+{
+    if(!mod->senders)
+        return;
+
+    for(int i = 0; i < mod->sender_count; ++i)
+    {
+        buffer_sender_t *sender = &mod->senders[i];
+        if(!sender->thread_running)
+            continue;
+        __atomic_store_n(&sender->thread_stop, true, __ATOMIC_RELEASE);
+        sender_wake(sender);
+    }
+    for(int i = 0; i < mod->sender_count; ++i)
+    {
+        buffer_sender_t *sender = &mod->senders[i];
+        if(sender->thread_running)
+            pthread_join(sender->thread, NULL);
+        sender->thread_running = false;
+    }
+
+    for(int i = 0; i < mod->sender_count; ++i)
+    {
+        buffer_sender_t *sender = &mod->senders[i];
+        sender_release_list(&sender->incoming);
+        sender_release_list(&sender->ready);
+        sender_release_list(&sender->idle);
+        sender_release_list(&sender->timed);
+        sender_release_list(&sender->waiting);
+    }
+
+    /* no sender is left to register, the readers must not wake the closed descriptor */
+    if(mod->resources)
+    {
+        asc_list_for(mod->resources)
+        {
+            buffer_resource_t *res = (buffer_resource_t *)asc_list_data(mod->resources);
+            if(!res)
+                continue;
+            pthread_mutex_lock(&res->lock);
+            res->waiters = 0;
+            pthread_mutex_unlock(&res->lock);
+        }
+    }
+
+    for(int i = 0; i < mod->sender_count; ++i)
+    {
+        buffer_sender_t *sender = &mod->senders[i];
+        sender_poll_close(sender);
+        pthread_mutex_destroy(&sender->lock);
+    }
+
+    free(mod->senders);
+    mod->senders = NULL;
+    mod->sender_count = 0;
+}
+
+static bool buffer_start_senders(module_data_t *mod)
+{
+    int count = mod->sender_threads;
+    if(count <= 0)
+    {
+        const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        count = (cpus > 0 && cpus < BUFFER_SENDERS_AUTO) ? (int)cpus : BUFFER_SENDERS_AUTO;
+    }
+    if(count > BUFFER_SENDERS_MAX)
+        count = BUFFER_SENDERS_MAX;
+
+    mod->senders = (buffer_sender_t *)calloc(count, sizeof(buffer_sender_t));
+    if(!mod->senders)
+        return false;
+    mod->sender_count = count;
+
+    for(int i = 0; i < count; ++i)
+    {
+        buffer_sender_t *sender = &mod->senders[i];
+        sender->mod = mod;
+        sender->index = i;
+        sender->poll_fd = -1;
+        sender->wake_fd[0] = -1;
+        sender->wake_fd[1] = -1;
+        pthread_mutex_init(&sender->lock, NULL);
+        TAILQ_INIT(&sender->incoming);
+        TAILQ_INIT(&sender->ready);
+        TAILQ_INIT(&sender->idle);
+        TAILQ_INIT(&sender->timed);
+        TAILQ_INIT(&sender->waiting);
+    }
+
+    for(int i = 0; i < count; ++i)
+    {
+        buffer_sender_t *sender = &mod->senders[i];
+        bool ok = sender_poll_open(sender);
+        if(ok && i == 0)
+            ok = sender_poll_add(sender, mod->listener_fd, mod);
+        if(!ok)
+        {
+            asc_log_error(MSG("sender %d: failed to init poller: %s"), i, strerror(errno));
+            buffer_stop_senders(mod);
+            return false;
+        }
+    }
+
+    for(int i = 0; i < count; ++i)
+    {
+        buffer_sender_t *sender = &mod->senders[i];
+        if(pthread_create(&sender->thread, NULL, sender_thread, sender) != 0)
+        {
+            asc_log_error(MSG("sender %d: failed to start thread"), i);
+            buffer_stop_senders(mod);
+            return false;
+        }
+        sender->thread_running = true;
+    }
+
+    return true;
+}
+
+static int buffer_open_listener(module_data_t *mod)
+{
+    struct sockaddr_in addr;
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if(fd < 0)
+        return -1;
+    set_nonblock_cloexec(fd);
+
+    int reuse = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(mod->listen_port);
+    if(!mod->listen_host || strcmp(mod->listen_host, "0.0.0.0") == 0)
+        addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    else
+        inet_aton(mod->listen_host, &addr.sin_addr);
+
+    if(bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+    {
+        asc_log_error(MSG("bind failed: %s"), strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    if(listen(fd, 1024) != 0)
+    {
+        asc_log_error(MSG("listen failed: %s"), strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
 static void buffer_start_listener(module_data_t *mod)
 {
     if(mod->listener_running)
         return;
+
+    mod->listener_fd = buffer_open_listener(mod);
+    if(mod->listener_fd < 0)
+        return;
+
+    if(!buffer_start_senders(mod))
+    {
+        close(mod->listener_fd);
+        mod->listener_fd = -1;
+        return;
+    }
+
     mod->listener_running = true;
-    if(pthread_create(&mod->listener_thread, NULL, listener_thread, mod) != 0)
-        mod->listener_running = false;
+    asc_log_info(MSG("listening on %s:%d, %d sender threads")
+                 , mod->listen_host ? mod->listen_host : "0.0.0.0", mod->listen_port
+                 , mod->sender_count);
 }
 
 static void buffer_stop_listener(module_data_t *mod)
@@ -2462,13 +3209,9 @@ static void buffer_stop_listener(module_data_t *mod)
     if(!mod->listener_running)
         return;
     mod->listener_running = false;
-    if(mod->listener_fd >= 0)
-    {
-        shutdown(mod->listener_fd, SHUT_RDWR);
-        close(mod->listener_fd);
-        mod->listener_fd = -1;
-    }
-    pthread_join(mod->listener_thread, NULL);
+    buffer_stop_senders(mod);
+    close(mod->listener_fd);
+    mod->listener_fd = -1;
 }
 
 static buffer_resource_t *resource_from_lua(module_data_t *mod, lua_State *L, int idx)
@@ -2640,7 +3383,6 @@ static buffer_resource_t *resource_from_lua(module_data_t *mod, lua_State *L, in
         qsort(res->inputs, res->input_count, sizeof(buffer_input_t), compare_inputs);
 
     pthread_mutex_init(&res->lock, NULL);
-    pthread_cond_init(&res->cond, NULL);
 
     res->checkpoints = (start_checkpoint_t *)calloc(BUFFER_CHECKPOINTS, sizeof(start_checkpoint_t));
     res->checkpoint_size = BUFFER_CHECKPOINTS;
@@ -2661,6 +3403,7 @@ static int method_apply_config(module_data_t *mod)
     luaL_checktype(lua, 2, LUA_TTABLE);
     bool was_enabled = mod->enabled;
     int old_port = mod->listen_port;
+    int old_sender_threads = mod->sender_threads;
     char *old_host = mod->listen_host ? strdup(mod->listen_host) : NULL;
 
     lua_getfield(lua, 2, "settings");
@@ -2696,6 +3439,10 @@ static int method_apply_config(module_data_t *mod)
         lua_getfield(lua, -1, "client_read_timeout_sec");
         mod->client_read_timeout_sec = (int)lua_tointeger(lua, -1);
         lua_pop(lua, 1);
+
+        lua_getfield(lua, -1, "sender_threads");
+        mod->sender_threads = (int)lua_tointeger(lua, -1);
+        lua_pop(lua, 1);
     }
     lua_pop(lua, 1);
 
@@ -2705,12 +3452,13 @@ static int method_apply_config(module_data_t *mod)
     else if(old_host && mod->listen_host && strcmp(old_host, mod->listen_host) != 0)
         host_changed = true;
     bool port_changed = mod->listen_port != old_port;
+    bool senders_changed = mod->sender_threads != old_sender_threads;
     if(old_host)
         free(old_host);
 
     if(mod->enabled)
     {
-        if(mod->listener_running && (host_changed || port_changed || !was_enabled))
+        if(mod->listener_running && (host_changed || port_changed || senders_changed || !was_enabled))
         {
             buffer_stop_listener(mod);
             buffer_start_listener(mod);
@@ -2728,22 +3476,7 @@ static int method_apply_config(module_data_t *mod)
     lua_getfield(lua, 2, "allow");
     if(lua_istable(lua, -1))
     {
-        if(mod->allow_rules)
-        {
-            asc_list_for(mod->allow_rules)
-            {
-                buffer_allow_rule_t *rule = (buffer_allow_rule_t *)asc_list_data(mod->allow_rules);
-                if(rule)
-                {
-                    free(rule->id);
-                    free(rule->kind);
-                    free(rule->value);
-                    free(rule);
-                }
-            }
-            asc_list_destroy(mod->allow_rules);
-        }
-        mod->allow_rules = asc_list_init();
+        asc_list_t *next_rules = asc_list_init();
         int count = (int)lua_rawlen(lua, -1);
         for(int i = 0; i < count; ++i)
         {
@@ -2787,7 +3520,7 @@ static int method_apply_config(module_data_t *mod)
                 {
                     rule->ip_from = ip_from;
                     rule->ip_to = ip_to;
-                    asc_list_insert_tail(mod->allow_rules, rule);
+                    asc_list_insert_tail(next_rules, rule);
                 }
                 else
                 {
@@ -2800,6 +3533,27 @@ static int method_apply_config(module_data_t *mod)
             }
             lua_pop(lua, 1);
         }
+
+        pthread_mutex_lock(&mod->lock);
+        asc_list_t *prev_rules = mod->allow_rules;
+        mod->allow_rules = next_rules;
+        pthread_mutex_unlock(&mod->lock);
+
+        if(prev_rules)
+        {
+            asc_list_for(prev_rules)
+            {
+                buffer_allow_rule_t *rule = (buffer_allow_rule_t *)asc_list_data(prev_rules);
+                if(rule)
+                {
+                    free(rule->id);
+                    free(rule->kind);
+                    free(rule->value);
+                    free(rule);
+                }
+            }
+            asc_list_destroy(prev_rules);
+        }
     }
     lua_pop(lua, 1);
 
@@ -2824,6 +3578,7 @@ static int method_apply_config(module_data_t *mod)
                         if(existing->config_hash != new_hash)
                         {
                             resource_stop(existing);
+                            pthread_mutex_lock(&mod->lock);
                             free(existing->name);
                             free(existing->path);
                             free(existing->backup_type);
@@ -2872,10 +3627,12 @@ static int method_apply_config(module_data_t *mod)
                             parsed->pacing_mode = NULL;
                             parsed->inputs = NULL;
                             parsed->input_count = 0;
+                            pthread_mutex_unlock(&mod->lock);
 
-                            resource_realloc_packets(existing);
                             pthread_mutex_lock(&existing->lock);
+                            resource_realloc_packets(existing);
                             resource_clear_packets(existing);
+                            resource_notify(existing, true);
                             pthread_mutex_unlock(&existing->lock);
                             if(mod->enabled && existing->enable)
                                 resource_start(existing);
@@ -2896,24 +3653,32 @@ static int method_apply_config(module_data_t *mod)
             lua_pop(lua, 1);
         }
 
-        if(mod->resources)
+        pthread_mutex_lock(&mod->lock);
+        asc_list_t *prev_resources = mod->resources;
+        mod->resources = next_resources;
+        resource_update_routes(mod);
+        pthread_mutex_unlock(&mod->lock);
+
+        if(prev_resources)
         {
-            asc_list_for(mod->resources)
+            asc_list_for(prev_resources)
             {
-                buffer_resource_t *res = (buffer_resource_t *)asc_list_data(mod->resources);
+                buffer_resource_t *res = (buffer_resource_t *)asc_list_data(prev_resources);
                 if(!res)
                     continue;
                 if(!resource_find_by_id_list(next_resources, res->id))
                 {
                     resource_stop(res);
+                    pthread_mutex_lock(&res->lock);
                     res->delete_pending = true;
-                    if(res->clients_connected == 0)
+                    const bool destroy = res->clients_connected == 0;
+                    pthread_mutex_unlock(&res->lock);
+                    if(destroy)
                         resource_destroy(res);
                 }
             }
-            asc_list_destroy(mod->resources);
+            asc_list_destroy(prev_resources);
         }
-        mod->resources = next_resources;
     }
     lua_pop(lua, 1);
 
@@ -3128,6 +3893,7 @@ static void module_init(module_data_t *mod)
     mod->listen_port = 8089;
     mod->max_clients_total = 2000;
     mod->client_read_timeout_sec = 20;
+    mod->sender_threads = 0;
     mod->listener_fd = -1;
     mod->listener_running = false;
     mod->resources = asc_list_init();
@@ -3158,6 +3924,9 @@ static void module_destroy(module_data_t *mod)
         asc_list_destroy(mod->resources);
         mod->resources = NULL;
     }
+    free(mod->routes);
+    mod->routes = NULL;
+    mod->route_count = 0;
     if(mod->allow_rules)
     {
         asc_list_for(mod->allow_rules)
@@ -1162,7 +1162,7 @@ static void on_ts(module_data_t *mod, const uint8_t *ts)
         ++mod->ts_count;
 
         uint64_t diff_interval = 0;
-        const uint64_t cur = asc_utime() / 10000;
+        const uint64_t cur = asc_now_us() / 10000;
 
         if(cur != mod->last_ts)
         {
@@ -1227,7 +1227,7 @@ static void on_ts(module_data_t *mod, const uint8_t *ts)
 
     if(mod->pcr_pid != 0 && pid == mod->pcr_pid && TS_IS_PCR(ts))
     {
-        const uint64_t now_us = asc_utime();
+        const uint64_t now_us = asc_now_us();
         const uint64_t pcr_value = TS_GET_PCR(ts);
         if(mod->last_pcr != 0 && mod->last_pcr_wall_us != 0)
         {
@@ -1280,7 +1280,7 @@ static void on_ts(module_data_t *mod, const uint8_t *ts)
             if(PES_BUFFER_GET_HEADER(payload) != 0x000001)
                 ++item->pes_error;
 
-            const uint64_t now_ms = asc_utime() / 1000;
+            const uint64_t now_ms = asc_now_us() / 1000;
             uint64_t pts_ms = 0;
             const bool has_pts = parse_pes_pts_ms(payload, payload_len, &pts_ms);
 
@@ -177,6 +177,21 @@ static void on_si_timer(void *arg)
         mpegts_psi_demux(mod->custom_sdt, (ts_callback_t)__module_stream_send, &mod->__stream);
 }
 
+/* si_timer lives on the loop of the stream */
+
+static void si_timer_start(void *arg)
+{
+    module_data_t *mod = (module_data_t *)arg;
+    mod->si_timer = asc_timer_init(500, on_si_timer, mod);
+}
+
+static void si_timer_stop(void *arg)
+{
+    module_data_t *mod = (module_data_t *)arg;
+    asc_timer_destroy(mod->si_timer);
+    mod->si_timer = NULL;
+}
+
 /*
  * oooooooooo   o   ooooooooooo
  *  888    888 888  88  888  88
@@ -924,6 +939,36 @@ static void on_ts(module_data_t *mod, const uint8_t *ts)
     module_stream_send(mod, ts);
 }
 
+static void on_ts_batch(module_data_t *mod, const uint8_t *ts, size_t count)
+{
+    // runs of PES packets without remapping are forwarded as is,
+    // everything else goes through on_ts() in the original order
+    size_t run = 0;
+    for(size_t i = 0; i < count; ++i)
+    {
+        const uint8_t *const item = &ts[i * TS_PACKET_SIZE];
+        const uint16_t pid = TS_GET_PID(item);
+        if(   mod->stream[pid] == MPEGTS_PACKET_PES
+           && mod->pid_map[pid] == 0
+           && pid != NULL_TS_PID
+           && module_stream_demux_check_pid(mod, pid))
+        {
+            ++run;
+            continue;
+        }
+
+        if(run > 0)
+        {
+            module_stream_send_batch(mod, item - run * TS_PACKET_SIZE, run);
+            run = 0;
+        }
+        on_ts(mod, item);
+    }
+
+    if(run > 0)
+        module_stream_send_batch(mod, &ts[(count - run) * TS_PACKET_SIZE], run);
+}
+
 /*
  * oooo     oooo  ooooooo  ooooooooo  ooooo  oooo ooooo       ooooooooooo
  *  8888o   888 o888   888o 888    88o 888    88   888         888    88
@@ -935,7 +980,7 @@ static void on_ts(module_data_t *mod, const uint8_t *ts)
 
 static void module_init(module_data_t *mod)
 {
-    module_stream_init(mod, on_ts);
+    module_stream_batch_set(mod, on_ts_batch);
     module_stream_demux_set(mod, NULL, NULL);
 
     module_option_string("name", &mod->config.name, NULL);
@@ -1002,8 +1047,6 @@ static void module_init(module_data_t *mod)
         }
 
         module_option_boolean("no_reload", &mod->config.no_reload);
-        if(mod->config.no_reload)
-            mod->si_timer = asc_timer_init(500, on_si_timer, mod);
     }
     else
     {
@@ -1074,10 +1117,19 @@ static void module_init(module_data_t *mod)
         }
     }
     lua_pop(lua, 1); // filter~
+
+    // channel follows the loop of the upstream
+    module_stream_init_loop(mod, on_ts);
+
+    if(mod->config.no_reload)
+        asc_loop_call_wait(module_stream_loop(mod), si_timer_start, mod);
 }
 
 static void module_destroy(module_data_t *mod)
 {
+    if(mod->si_timer)
+        asc_loop_call_wait(module_stream_loop(mod), si_timer_stop, mod);
+
     module_stream_destroy(mod);
 
     mpegts_psi_destroy(mod->pat);
@@ -1111,9 +1163,6 @@ static void module_destroy(module_data_t *mod)
         }
         asc_list_destroy(mod->map);
     }
-
-    if(mod->si_timer)
-        asc_timer_destroy(mod->si_timer);
 }
 
 MODULE_STREAM_METHODS()
@@ -74,7 +74,7 @@ static void jitter_flush(module_data_t *mod)
     if(mod->capacity == 0 || mod->config.jitter_ms == 0)
         return;
 
-    const uint64_t now = asc_utime();
+    const uint64_t now = asc_now_us();
 
     while(mod->count > 0)
     {
@@ -168,7 +168,7 @@ static void on_ts(module_data_t *mod, const uint8_t *ts)
         return;
     }
 
-    const uint64_t now = asc_utime();
+    const uint64_t now = asc_now_us();
     jitter_update_bitrate(mod, now);
 
     if(mod->count >= mod->capacity)
@@ -258,7 +258,7 @@ static void playout_flush(module_data_t *mod)
     if(mod->capacity == 0)
         return;
 
-    const uint64_t now = asc_utime();
+    const uint64_t now = asc_now_us();
     const uint64_t target_bps = playout_get_target_bps(mod);
     mod->last_target_bps = target_bps;
 
@@ -301,7 +301,7 @@ static void on_ts(module_data_t *mod, const uint8_t *ts)
         return;
     }
 
-    const uint64_t now = asc_utime();
+    const uint64_t now = asc_now_us();
     playout_update_in_bitrate(mod, now);
 
     if(mod->count >= mod->capacity)
@@ -32,14 +32,35 @@
  *      read_burst  - number, how many datagrams to drain per on_read callback (default: 1)
  *      use_recvmmsg- boolean, use recvmmsg() for batched receive (Linux only, default: off)
  *      rx_batch    - number, max datagrams per recvmmsg() call (default: 32, range: 1..64)
+ *      gro         - boolean, UDP_GRO: datagrams coalesced by the kernel are received
+ *                            in one buffer and split (Linux only, default: off,
+ *                            the main socket only)
+ *      loop        - number, data loop to receive on (1..N, see data_loop.start()),
+ *                            default: 0 - control loop
+ *      merge       - table, SMPTE 2022-7: more legs of the same RTP stream
+ *                            { { addr=, port=, localaddr= }, ... } (up to 3),
+ *                            the first arrival of each sequence number is passed
+ *      merge_window- number, sequence numbers to deduplicate (default: 512)
+ *      mdi         - boolean, RFC 4445 MDI (DF:MLR) and inter-arrival histogram
+ *                            of the main socket by kernel receive timestamps
+ *                            (SO_TIMESTAMPNS, Linux; turns use_recvmmsg on)
+ *      fec         - boolean, SMPTE 2022-1: recover lost RTP packets by the column
+ *                            FEC (port + 2) and the row FEC (port + 4), requires rtp
  *
  * Module Methods:
  *      port()      - return number, random port number
+ *      merge_stats() - return table, merged stream and per-leg counters
+ *      mdi_stats() - return table, MDI of the last second, nil - mdi is off
+ *      fec_stats() - return table, recovered and unrecoverable packets, nil - fec is off
  */
 
 #include <astra.h>
+#include "rtp_merge.h"
+#include "udp_mdi.h"
+#include "rtp_fec.h"
 #ifdef __linux__
 #include <sys/socket.h>
+#include "udp_gso.h"
 #endif
 
 #define UDP_BUFFER_SIZE 1460
@@ -51,6 +72,15 @@
 
 #define MSG(_msg) "[udp_input %s:%d] " _msg, mod->config.addr, mod->config.port
 
+typedef struct
+{
+    module_data_t *mod;
+    int index; // leg of the merge, 0 - the main socket
+    char *source;
+    asc_socket_t *sock;
+    ts_chunk_t *chunk;
+} udp_input_leg_t;
+
 struct module_data_t
 {
     MODULE_STREAM_DATA();
@@ -64,6 +94,7 @@ struct module_data_t
         int read_burst;
         bool use_recvmmsg;
         int rx_batch;
+        int renew;
     } config;
 
     bool is_error_message;
@@ -71,16 +102,40 @@ struct module_data_t
     asc_socket_t *sock;
     asc_timer_t *timer_renew;
 
-    uint8_t buffer[UDP_BUFFER_SIZE];
+    rtp_merge_t *merge;
+    udp_input_leg_t legs[RTP_MERGE_LEGS_MAX - 1];
+    int leg_count;
+
+    // datagrams are received into pool chunks (modules/astra/ts_chunk.h),
+    // a chunk referenced by the consumers is replaced by a new one
+    ts_chunk_t *chunk;
+
+    // MDI: время приёма датаграммы из ядра (SO_TIMESTAMPNS), 0 - нет
+    udp_mdi_t *mdi;
+    uint64_t rx_stamp_ns;
+
+    // SMPTE 2022-1: датаграммы главного сокета идут через декодер, FEC - с портов +2 и +4
+    rtp_fec_decoder_t *fec;
+    asc_socket_t *fec_sock[2];
+    uint8_t fec_buffer[UDP_BUFFER_SIZE];
 
 #ifdef __linux__
     struct
     {
         struct mmsghdr *msgs;
         struct iovec *iov;
-        uint8_t *buffers;
+        ts_chunk_t **chunks;
+        uint8_t *cmsg; // mdi: SCM_TIMESTAMPNS
         int capacity;
     } rxmmsg;
+
+    // UDP_GRO: буфер до 64 KiB, сегменты уходят ссылками на один chunk
+    struct
+    {
+        bool enabled;
+        ts_chunk_t *chunk;
+        uint8_t cmsg[UDP_GRO_CMSG_SIZE + UDP_MDI_CMSG_SIZE];
+    } gro;
 #endif
 };
 
@@ -101,11 +156,53 @@ static void on_close(void *arg)
         mod->timer_renew = NULL;
     }
 
+    for(int i = 0; i < mod->leg_count; ++i)
+    {
+        udp_input_leg_t *const leg = &mod->legs[i];
+        if(leg->sock)
+        {
+            asc_socket_multicast_leave(leg->sock);
+            asc_socket_close(leg->sock);
+            leg->sock = NULL;
+        }
+        if(leg->chunk)
+        {
+            ts_chunk_unref(leg->chunk);
+            leg->chunk = NULL;
+        }
+    }
+
+    for(int kind = RTP_FEC_COLUMN; kind <= RTP_FEC_ROW; ++kind)
+    {
+        if(mod->fec_sock[kind])
+        {
+            asc_socket_multicast_leave(mod->fec_sock[kind]);
+            asc_socket_close(mod->fec_sock[kind]);
+            mod->fec_sock[kind] = NULL;
+        }
+    }
+
+    if(mod->chunk)
+    {
+        ts_chunk_unref(mod->chunk);
+        mod->chunk = NULL;
+    }
+
 #ifdef __linux__
-    if(mod->rxmmsg.buffers)
+    if(mod->rxmmsg.chunks)
+    {
+        for(int i = 0; i < mod->rxmmsg.capacity; ++i)
+        {
+            if(mod->rxmmsg.chunks[i])
+                ts_chunk_unref(mod->rxmmsg.chunks[i]);
+        }
+        free(mod->rxmmsg.chunks);
+        mod->rxmmsg.chunks = NULL;
+    }
+    if(mod->rxmmsg.cmsg)
     {
-        free(mod->rxmmsg.buffers);
-        mod->rxmmsg.buffers = NULL;
+        free(mod->rxmmsg.cmsg);
+        mod->rxmmsg.cmsg = NULL;
     }
     if(mod->rxmmsg.iov)
     {
@@ -118,9 +215,172 @@ static void on_close(void *arg)
         mod->rxmmsg.msgs = NULL;
     }
     mod->rxmmsg.capacity = 0;
+
+    if(mod->gro.chunk)
+    {
+        ts_chunk_unref(mod->gro.chunk);
+        mod->gro.chunk = NULL;
+    }
 #endif
 }
 
+static inline ts_chunk_t * rx_chunk(ts_chunk_t **slot)
+{
+    if(!*slot)
+        *slot = ts_chunk_alloc(UDP_BUFFER_SIZE);
+    return *slot;
+}
+
+/* datagram at buffer inside the chunk, chunk->size covers it. false - nothing is sent */
+static bool on_payload(module_data_t *mod, ts_chunk_t *chunk, const uint8_t *buffer, int len, int leg)
+{
+    int i = 0;
+    if(mod->config.rtp)
+    {
+        if(len < RTP_HEADER_SIZE)
+            return false;
+
+        i = RTP_HEADER_SIZE;
+        if(RTP_IS_EXT(buffer))
+        {
+            if(len < RTP_HEADER_SIZE + 4)
+                return false;
+            i += RTP_EXT_SIZE(buffer);
+        }
+    }
+
+    const int count = (len > i) ? (len - i) / TS_PACKET_SIZE : 0;
+
+    // MDI главного сокета: все его датаграммы, до отбора копий merge
+    if(mod->mdi && leg == 0 && count > 0)
+        udp_mdi_packet(mod->mdi, mod->rx_stamp_ns, asc_utime(), &buffer[i], (size_t)count);
+
+    // пакеты уходят из декодера по порядку, вместе с восстановленными (копией, не chunk)
+    if(mod->fec)
+    {
+        rtp_fec_decoder_media(mod->fec, buffer, (size_t)len);
+        return false;
+    }
+
+    // the copy of another leg is already passed
+    if(mod->config.rtp && mod->merge
+       && !rtp_merge_accept(mod->merge, leg, (uint16_t)((buffer[2] << 8) | buffer[3]), asc_now_us()))
+        return false;
+
+    // датаграмма целиком уходит одним вызовом по графу
+    if(count > 0)
+        module_stream_send_chunk(mod, chunk, &buffer[i], (size_t)count);
+    i += count * TS_PACKET_SIZE;
+
+    if(i != len && !mod->is_error_message)
+    {
+        asc_log_error(MSG("wrong stream format. drop %d bytes"), len - i);
+        mod->is_error_message = true;
+    }
+    return count > 0;
+}
+
+/* media RTP packet released by the FEC decoder */
+static void on_fec_media(void *arg, const uint8_t *packet, size_t size)
+{
+    module_data_t *mod = (module_data_t *)arg;
+
+    size_t i = RTP_HEADER_SIZE;
+    if(RTP_IS_EXT(packet))
+    {
+        if(size < RTP_HEADER_SIZE + 4)
+            return;
+        i += RTP_EXT_SIZE(packet);
+    }
+
+    const size_t count = (size > i) ? (size - i) / TS_PACKET_SIZE : 0;
+    if(count > 0)
+        module_stream_send_batch(mod, &packet[i], count);
+    i += count * TS_PACKET_SIZE;
+
+    if(i != size && !mod->is_error_message)
+    {
+        asc_log_error(MSG("wrong stream format. drop %d bytes"), (int)(size - i));
+        mod->is_error_message = true;
+    }
+}
+
+/* nobody keeps the packets: receive the next datagram into the same chunk */
+static void rx_chunk_release(ts_chunk_t **slot)
+{
+    ts_chunk_t *const chunk = *slot;
+    if(__atomic_load_n(&chunk->refcount, __ATOMIC_ACQUIRE) == 1)
+        chunk->size = 0;
+    else
+    {
+        ts_chunk_unref(chunk);
+        *slot = NULL;
+    }
+}
+
+static void on_datagram(module_data_t *mod, ts_chunk_t **slot, int len, int leg)
+{
+    ts_chunk_t *const chunk = *slot;
+    chunk->size = (uint32_t)len;
+    if(on_payload(mod, chunk, chunk->data, len, leg))
+        rx_chunk_release(slot);
+    else
+        chunk->size = 0;
+}
+
+#ifdef __linux__
+/* UDP_GRO: буфер - серия датаграмм по segment байт (последняя короче), без cmsg - одна */
+static bool on_read_gro(module_data_t *mod, int burst)
+{
+    const int fd = asc_socket_fd(mod->sock);
+
+    for(int n = 0; n < burst; ++n)
+    {
+        if(!mod->gro.chunk)
+            mod->gro.chunk = ts_chunk_alloc(UDP_GRO_BUFFER_SIZE);
+        ts_chunk_t *const chunk = mod->gro.chunk;
+
+        struct iovec iov;
+        iov.iov_base = chunk->data;
+        iov.iov_len = UDP_GRO_BUFFER_SIZE;
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = mod->gro.cmsg;
+        msg.msg_controllen = sizeof(mod->gro.cmsg);
+
+        const ssize_t len = recvmsg(fd, &msg, MSG_DONTWAIT);
+        if(len <= 0)
+        {
+            if(len == 0 || errno == EAGAIN || errno == EWOULDBLOCK)
+                return true;
+            return false;
+        }
+        // сегменты серии получают время приёма буфера
+        mod->rx_stamp_ns = mod->mdi ? udp_mdi_timestamp(&msg) : 0;
+
+        int segment = udp_gro_segment(&msg);
+        if(segment <= 0 || segment > (int)len)
+            segment = (int)len;
+
+        chunk->size = (uint32_t)len;
+        bool sent = false;
+        for(int off = 0; off < (int)len; off += segment)
+        {
+            const int size = ((int)len - off < segment) ? (int)len - off : segment;
+            if(on_payload(mod, chunk, &chunk->data[off], size, 0))
+                sent = true;
+        }
+        if(sent)
+            rx_chunk_release(&mod->gro.chunk);
+        else
+            chunk->size = 0;
+    }
+    return true;
+}
+#endif
+
 static void on_read(void *arg)
 {
     module_data_t *mod = (module_data_t *)arg;
@@ -130,7 +390,14 @@ static void on_read(void *arg)
         burst = 1;
 
 #ifdef __linux__
-    if(mod->config.use_recvmmsg && mod->rxmmsg.msgs && mod->rxmmsg.iov && mod->rxmmsg.buffers)
+    if(mod->gro.enabled)
+    {
+        if(!on_read_gro(mod, burst))
+            on_close(mod);
+        return;
+    }
+
+    if(mod->config.use_recvmmsg && mod->rxmmsg.msgs && mod->rxmmsg.iov && mod->rxmmsg.chunks)
     {
         int processed = 0;
         const int fd = asc_socket_fd(mod->sock);
@@ -143,6 +410,14 @@ static void on_read(void *arg)
             if(want <= 0)
                 break;
 
+            for(int n = 0; n < want; ++n)
+                mod->rxmmsg.iov[n].iov_base = rx_chunk(&mod->rxmmsg.chunks[n])->data;
+            if(mod->rxmmsg.cmsg)
+            {
+                for(int n = 0; n < want; ++n)
+                    mod->rxmmsg.msgs[n].msg_hdr.msg_controllen = UDP_MDI_CMSG_SIZE;
+            }
+
             errno = 0;
             const int r = recvmmsg(fd, mod->rxmmsg.msgs, want, MSG_DONTWAIT, NULL);
             if(r <= 0)
@@ -158,30 +433,10 @@ static void on_read(void *arg)
             for(int n = 0; n < r; ++n)
             {
                 const int len = mod->rxmmsg.msgs[n].msg_len;
-                const uint8_t *buffer = (const uint8_t *)mod->rxmmsg.iov[n].iov_base;
-                if(len <= 0)
-                    continue;
-
-                int i = 0;
-                if(mod->config.rtp)
-                {
-                    i = RTP_HEADER_SIZE;
-                    if(RTP_IS_EXT(buffer))
-                    {
-                        if(len < RTP_HEADER_SIZE + 4)
-                            continue;
-                        i += RTP_EXT_SIZE(buffer);
-                    }
-                }
-
-                for(; i <= len - TS_PACKET_SIZE; i += TS_PACKET_SIZE)
-                    module_stream_send(mod, &buffer[i]);
-
-                if(i != len && !mod->is_error_message)
-                {
-                    asc_log_error(MSG("wrong stream format. drop %d bytes"), len - i);
-                    mod->is_error_message = true;
-                }
+                if(mod->rxmmsg.cmsg)
+                    mod->rx_stamp_ns = udp_mdi_timestamp(&mod->rxmmsg.msgs[n].msg_hdr);
+                if(len > 0)
+                    on_datagram(mod, &mod->rxmmsg.chunks[n], len, 0);
             }
 
             if(r < want)
@@ -193,7 +448,7 @@ static void on_read(void *arg)
 
     for(int n = 0; n < burst; ++n)
     {
-        int len = asc_socket_recv(mod->sock, mod->buffer, UDP_BUFFER_SIZE);
+        int len = asc_socket_recv(mod->sock, rx_chunk(&mod->chunk)->data, UDP_BUFFER_SIZE);
         if(len <= 0)
         {
             if(len == 0 || errno == EAGAIN || errno == EWOULDBLOCK)
@@ -202,33 +457,118 @@ static void on_read(void *arg)
             return;
         }
 
-        int i = 0;
-        if(mod->config.rtp)
+        on_datagram(mod, &mod->chunk, len, 0);
+    }
+}
+
+static void on_leg_close(void *arg)
+{
+    udp_input_leg_t *leg = (udp_input_leg_t *)arg;
+    module_data_t *mod = leg->mod;
+
+    asc_log_error(MSG("merge leg %s failed"), leg->source);
+    if(leg->sock)
+    {
+        asc_socket_multicast_leave(leg->sock);
+        asc_socket_close(leg->sock);
+        leg->sock = NULL;
+    }
+}
+
+static void on_leg_read(void *arg)
+{
+    udp_input_leg_t *leg = (udp_input_leg_t *)arg;
+    module_data_t *mod = leg->mod;
+
+    // recvmmsg is used by the main socket only, the legs drain the same burst
+    int burst = mod->config.read_burst;
+    if(burst <= 0)
+        burst = 1;
+
+    for(int n = 0; n < burst; ++n)
+    {
+        int len = asc_socket_recv(leg->sock, rx_chunk(&leg->chunk)->data, UDP_BUFFER_SIZE);
+        if(len <= 0)
         {
-            i = RTP_HEADER_SIZE;
-            if(RTP_IS_EXT(mod->buffer))
-            {
-                if(len < RTP_HEADER_SIZE + 4)
-                    continue;
-                i += RTP_EXT_SIZE(mod->buffer);
-            }
+            if(len == 0 || errno == EAGAIN || errno == EWOULDBLOCK)
+                return;
+            on_leg_close(leg);
+            return;
         }
 
-        for(; i <= len - TS_PACKET_SIZE; i += TS_PACKET_SIZE)
-            module_stream_send(mod, &mod->buffer[i]);
+        on_datagram(mod, &leg->chunk, len, leg->index);
+    }
+}
 
-        if(i != len && !mod->is_error_message)
+static void on_fec_read(module_data_t *mod, int kind)
+{
+    for(int n = 0; n < RTP_FEC_COLS_MAX + 1; ++n)
+    {
+        const int len = asc_socket_recv(mod->fec_sock[kind], mod->fec_buffer, sizeof(mod->fec_buffer));
+        if(len <= 0)
         {
-            asc_log_error(MSG("wrong stream format. drop %d bytes"), len - i);
-            mod->is_error_message = true;
+            if(len == 0 || errno == EAGAIN || errno == EWOULDBLOCK)
+                return;
+            asc_log_error(MSG("fec socket failed [%s]"), asc_socket_error());
+            asc_socket_multicast_leave(mod->fec_sock[kind]);
+            asc_socket_close(mod->fec_sock[kind]);
+            mod->fec_sock[kind] = NULL;
+            return;
         }
+        rtp_fec_decoder_fec(mod->fec, mod->fec_buffer, (size_t)len);
     }
 }
 
+static void on_fec_column_read(void *arg)
+{
+    on_fec_read((module_data_t *)arg, RTP_FEC_COLUMN);
+}
+
+static void on_fec_row_read(void *arg)
+{
+    on_fec_read((module_data_t *)arg, RTP_FEC_ROW);
+}
+
 static void timer_renew_callback(void *arg)
 {
     module_data_t *mod = (module_data_t *)arg;
     asc_socket_multicast_renew(mod->sock);
+    for(int i = 0; i < mod->leg_count; ++i)
+    {
+        if(mod->legs[i].sock)
+            asc_socket_multicast_renew(mod->legs[i].sock);
+    }
+    for(int kind = RTP_FEC_COLUMN; kind <= RTP_FEC_ROW; ++kind)
+    {
+        if(mod->fec_sock[kind])
+            asc_socket_multicast_renew(mod->fec_sock[kind]);
+    }
+}
+
+/* socket events and the renew timer live on the loop of the stream */
+
+static void on_loop_start(void *arg)
+{
+    module_data_t *mod = (module_data_t *)arg;
+
+    asc_socket_set_on_read(mod->sock, on_read);
+    asc_socket_set_on_close(mod->sock, on_close);
+
+    for(int i = 0; i < mod->leg_count; ++i)
+    {
+        if(!mod->legs[i].sock)
+            continue;
+        asc_socket_set_on_read(mod->legs[i].sock, on_leg_read);
+        asc_socket_set_on_close(mod->legs[i].sock, on_leg_close);
+    }
+
+    if(mod->fec_sock[RTP_FEC_COLUMN])
+        asc_socket_set_on_read(mod->fec_sock[RTP_FEC_COLUMN], on_fec_column_read);
+    if(mod->fec_sock[RTP_FEC_ROW])
+        asc_socket_set_on_read(mod->fec_sock[RTP_FEC_ROW], on_fec_row_read);
+
+    if(mod->config.renew > 0)
+        mod->timer_renew = asc_timer_init(mod->config.renew * 1000, timer_renew_callback, mod);
 }
 
 static int method_port(module_data_t *mod)
@@ -238,6 +578,189 @@ static int method_port(module_data_t *mod)
     return 1;
 }
 
+static int method_merge_stats(module_data_t *mod)
+{
+    if(!mod->merge)
+    {
+        lua_pushnil(lua);
+        return 1;
+    }
+
+    char source[128];
+    snprintf(source, sizeof(source), "rtp://%s:%d", mod->config.addr, mod->config.port);
+    const char *sources[RTP_MERGE_LEGS_MAX] = { source };
+    for(int i = 0; i < mod->leg_count; ++i)
+        sources[i + 1] = mod->legs[i].source;
+
+    rtp_merge_push_stats(lua, mod->merge, sources, asc_utime());
+    return 1;
+}
+
+static int method_mdi_stats(module_data_t *mod)
+{
+    if(!mod->mdi)
+    {
+        lua_pushnil(lua);
+        return 1;
+    }
+
+    udp_mdi_push_stats(lua, mod->mdi);
+    return 1;
+}
+
+static int method_fec_stats(module_data_t *mod)
+{
+    if(!mod->fec)
+    {
+        lua_pushnil(lua);
+        return 1;
+    }
+
+    rtp_fec_decoder_push_stats(lua, mod->fec);
+    return 1;
+}
+
+/* FEC sockets: port + 2 (columns) and port + 4 (rows), bound and joined like the main one */
+static void fec_init(module_data_t *mod)
+{
+    bool fec = false;
+    module_option_boolean("fec", &fec);
+    if(!fec)
+        return;
+
+    if(!mod->config.rtp)
+    {
+        asc_log_error(MSG("option 'fec' requires rtp, ignored"));
+        return;
+    }
+    if(mod->merge)
+    {
+        asc_log_error(MSG("option 'fec' is not supported with merge, ignored"));
+        return;
+    }
+
+    mod->fec = (rtp_fec_decoder_t *)malloc(sizeof(rtp_fec_decoder_t));
+    asc_assert(mod->fec != NULL, MSG("malloc() failed"));
+    rtp_fec_decoder_init(mod->fec, on_fec_media, mod);
+
+    for(int kind = RTP_FEC_COLUMN; kind <= RTP_FEC_ROW; ++kind)
+    {
+        const int port = mod->config.port + ((kind == RTP_FEC_COLUMN) ? RTP_FEC_PORT_COLUMN : RTP_FEC_PORT_ROW);
+        asc_socket_t *const sock = asc_socket_open_udp4(mod);
+        asc_socket_set_reuseaddr(sock, 1);
+#ifdef _WIN32
+        if(!asc_socket_bind(sock, NULL, port))
+#else
+        if(!asc_socket_bind(sock, mod->config.addr, port))
+#endif
+        {
+            asc_log_error(MSG("fec: failed to bind port %d"), port);
+            asc_socket_close(sock);
+            continue;
+        }
+        asc_socket_multicast_join(sock, mod->config.addr, mod->config.localaddr);
+        mod->fec_sock[kind] = sock;
+    }
+}
+
+/* merge legs: the sockets are bound and joined like the main one */
+static void merge_init(module_data_t *mod)
+{
+    lua_getfield(lua, MODULE_OPTIONS_IDX, "merge");
+    if(!lua_istable(lua, -1))
+    {
+        lua_pop(lua, 1);
+        return;
+    }
+
+    if(!mod->config.rtp)
+    {
+        asc_log_error(MSG("option 'merge' requires rtp, ignored"));
+        lua_pop(lua, 1);
+        return;
+    }
+
+    int count = luaL_len(lua, -1);
+    if(count > RTP_MERGE_LEGS_MAX - 1)
+    {
+        asc_log_warning(MSG("merge: %d legs at most"), RTP_MERGE_LEGS_MAX);
+        count = RTP_MERGE_LEGS_MAX - 1;
+    }
+
+    for(int i = 1; i <= count; ++i)
+    {
+        lua_rawgeti(lua, -1, i);
+        if(!lua_istable(lua, -1))
+        {
+            lua_pop(lua, 1);
+            continue;
+        }
+
+        lua_getfield(lua, -1, "addr");
+        lua_getfield(lua, -2, "port");
+        lua_getfield(lua, -3, "localaddr");
+        const char *addr = lua_isstring(lua, -3) ? lua_tostring(lua, -3) : NULL;
+        const lua_Number port_value = lua_isnumber(lua, -2) ? lua_tonumber(lua, -2) : mod->config.port;
+        const char *localaddr = lua_isstring(lua, -1) ? lua_tostring(lua, -1) : mod->config.localaddr;
+
+        if(!addr)
+        {
+            lua_pop(lua, 4);
+            continue;
+        }
+        if(!(port_value >= 1 && port_value <= 65535))
+        {
+            asc_log_error(MSG("merge: leg %d: wrong port, skipped"), i);
+            lua_pop(lua, 4);
+            continue;
+        }
+        const int port = (int)port_value;
+
+        udp_input_leg_t *const leg = &mod->legs[mod->leg_count];
+        const size_t source_size = strlen(addr) + sizeof("rtp://:65535");
+        leg->source = (char *)malloc(source_size);
+        asc_assert(leg->source != NULL, MSG("malloc() failed"));
+        snprintf(leg->source, source_size, "rtp://%s:%d", addr, port);
+
+        leg->sock = asc_socket_open_udp4(leg);
+        asc_socket_set_reuseaddr(leg->sock, 1);
+#ifdef _WIN32
+        if(!asc_socket_bind(leg->sock, NULL, port))
+#else
+        if(!asc_socket_bind(leg->sock, addr, port))
+#endif
+        {
+            asc_log_error(MSG("merge: leg %s: bind failed, skipped"), leg->source);
+            asc_socket_close(leg->sock);
+            leg->sock = NULL;
+            free(leg->source);
+            leg->source = NULL;
+            lua_pop(lua, 4);
+            continue;
+        }
+
+        int value;
+        if(module_option_number("socket_size", &value))
+            asc_socket_set_buffer(leg->sock, value, 0);
+        asc_socket_multicast_join(leg->sock, addr, localaddr);
+
+        leg->mod = mod;
+        leg->index = mod->leg_count + 1;
+        ++mod->leg_count;
+        lua_pop(lua, 4);
+    }
+    lua_pop(lua, 1);
+
+    if(mod->leg_count == 0)
+        return;
+
+    int window = RTP_MERGE_WINDOW_DEFAULT;
+    module_option_number("merge_window", &window);
+    mod->merge = (rtp_merge_t *)malloc(sizeof(rtp_merge_t));
+    asc_assert(mod->merge != NULL, MSG("malloc() failed"));
+    rtp_merge_init(mod->merge, mod->leg_count + 1, window);
+}
+
 static void module_init(module_data_t *mod)
 {
     module_stream_init(mod, NULL);
@@ -274,6 +797,25 @@ static void module_init(module_data_t *mod)
     if(mod->config.rx_batch > 64)
         mod->config.rx_batch = 64;
 
+    bool gro = false;
+    module_option_boolean("gro", &gro);
+
+    bool mdi = false;
+    module_option_boolean("mdi", &mdi);
+    if(mdi)
+    {
+        mod->mdi = (udp_mdi_t *)malloc(sizeof(udp_mdi_t));
+        asc_assert(mod->mdi != NULL, MSG("malloc() failed"));
+        udp_mdi_init(mod->mdi);
+        // время приёма приходит в cmsg: recvmsg/recvmmsg вместо recv
+        if(!udp_mdi_timestamps_set(asc_socket_fd(mod->sock)))
+            asc_log_warning(MSG("kernel receive timestamps are not supported; MDI uses the read time"));
+#ifdef __linux__
+        else
+            mod->config.use_recvmmsg = true;
+#endif
+    }
+
 #ifdef __linux__
     if(mod->config.use_recvmmsg)
     {
@@ -285,9 +827,9 @@ static void module_init(module_data_t *mod)
         mod->rxmmsg.capacity = mod->config.rx_batch;
         mod->rxmmsg.msgs = (struct mmsghdr *)calloc(mod->rxmmsg.capacity, sizeof(struct mmsghdr));
         mod->rxmmsg.iov = (struct iovec *)calloc(mod->rxmmsg.capacity, sizeof(struct iovec));
-        mod->rxmmsg.buffers = (uint8_t *)malloc((size_t)mod->rxmmsg.capacity * UDP_BUFFER_SIZE);
+        mod->rxmmsg.chunks = (ts_chunk_t **)calloc(mod->rxmmsg.capacity, sizeof(ts_chunk_t *));
 
-        if(!mod->rxmmsg.msgs || !mod->rxmmsg.iov || !mod->rxmmsg.buffers)
+        if(!mod->rxmmsg.msgs || !mod->rxmmsg.iov || !mod->rxmmsg.chunks)
         {
             asc_log_error(MSG("failed to allocate recvmmsg buffers"));
             on_close(mod);
@@ -296,32 +838,85 @@ static void module_init(module_data_t *mod)
 
         for(int i = 0; i < mod->rxmmsg.capacity; ++i)
         {
-            mod->rxmmsg.iov[i].iov_base = mod->rxmmsg.buffers + ((size_t)i * UDP_BUFFER_SIZE);
             mod->rxmmsg.iov[i].iov_len = UDP_BUFFER_SIZE;
             mod->rxmmsg.msgs[i].msg_hdr.msg_iov = &mod->rxmmsg.iov[i];
             mod->rxmmsg.msgs[i].msg_hdr.msg_iovlen = 1;
         }
+
+        if(mod->mdi)
+        {
+            mod->rxmmsg.cmsg = (uint8_t *)calloc(mod->rxmmsg.capacity, UDP_MDI_CMSG_SIZE);
+            for(int i = 0; mod->rxmmsg.cmsg && i < mod->rxmmsg.capacity; ++i)
+            {
+                mod->rxmmsg.msgs[i].msg_hdr.msg_control = &mod->rxmmsg.cmsg[(size_t)i * UDP_MDI_CMSG_SIZE];
+                mod->rxmmsg.msgs[i].msg_hdr.msg_controllen = UDP_MDI_CMSG_SIZE;
+            }
+        }
+    }
+
+    if(gro)
+    {
+        // буфер на серию вместо batch датаграмм, read_burst - буферов за on_read
+        mod->gro.enabled = udp_gro_set(asc_socket_fd(mod->sock), true);
+        if(!mod->gro.enabled)
+            asc_log_warning(MSG("UDP_GRO is not supported by kernel; ignored"));
+        else if(mod->config.read_burst <= 1)
+            mod->config.read_burst = 4;
     }
 #else
     if(mod->config.use_recvmmsg)
         asc_log_warning(MSG("use_recvmmsg is not supported on this platform; ignored"));
+    if(gro)
+        asc_log_warning(MSG("gro is not supported on this platform; ignored"));
 #endif
 
-    asc_socket_set_on_read(mod->sock, on_read);
-    asc_socket_set_on_close(mod->sock, on_close);
-
     module_option_string("localaddr", &mod->config.localaddr, NULL);
     asc_socket_multicast_join(mod->sock, mod->config.addr, mod->config.localaddr);
 
-    if(module_option_number("renew", &value))
-        mod->timer_renew = asc_timer_init(value * 1000, timer_renew_callback, mod);
+    merge_init(mod);
+    fec_init(mod);
+
+    module_option_number("renew", &mod->config.renew);
+
+    value = 0;
+    if(module_option_number("loop", &value) && value > 0)
+    {
+        asc_loop_t *loop = asc_loop_get(value);
+        if(loop)
+            mod->__stream.loop = loop;
+        else
+            asc_log_warning(MSG("data loop %d is not started, use the control loop"), value);
+    }
+
+    asc_loop_call_wait(module_stream_loop(mod), on_loop_start, mod);
 }
 
 static void module_destroy(module_data_t *mod)
 {
+    asc_loop_t *loop = module_stream_loop(mod);
+
     module_stream_destroy(mod);
 
-    on_close(mod);
+    asc_loop_call_wait(loop, on_close, mod);
+
+    for(int i = 0; i < mod->leg_count; ++i)
+        free(mod->legs[i].source);
+    mod->leg_count = 0;
+    if(mod->merge)
+    {
+        free(mod->merge);
+        mod->merge = NULL;
+    }
+    if(mod->mdi)
+    {
+        free(mod->mdi);
+        mod->mdi = NULL;
+    }
+    if(mod->fec)
+    {
+        free(mod->fec);
+        mod->fec = NULL;
+    }
 }
 
 MODULE_STREAM_METHODS()
@@ -330,5 +925,8 @@ MODULE_LUA_METHODS()
 {
     MODULE_STREAM_METHODS_REF(),
     { "port", method_port },
+    { "merge_stats", method_merge_stats },
+    { "mdi_stats", method_mdi_stats },
+    { "fec_stats", method_fec_stats },
 };
 MODULE_LUA_REGISTER(udp_input)
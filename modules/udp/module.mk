@@ -1,2 +1,6 @@
-SOURCES="input.c output.c switch.c relay.c"
+SOURCES="input.c output.c switch.c relay.c rtp_merge.c udp_mdi.c rtp_fec.c"
 MODULES="udp_input udp_output udp_switch udp_relay"
+
+if [ "$OS" = "linux" ] ; then
+    SOURCES="$SOURCES packet_ring.c udp_gso.c udp_pacer.c"
+fi
@@ -35,19 +35,34 @@
  *      cbr         - number, constant bitrate
  *      use_sendmmsg- boolean, use sendmmsg() for batched send (Linux only, default: off)
  *      tx_batch    - number, max datagrams per sendmmsg() call (default: 8, range: 2..64)
+ *      gso         - boolean, UDP_SEGMENT: datagrams of the batch go as one send
+ *                            (Linux only, default: off, turns use_sendmmsg on)
+ *      pacer_threads - number, sync/cbr pacing threads shared by all outputs
+ *                            (Linux only, default: 0 - auto, up to 4)
+ *      fec         - string, "LxD" - SMPTE 2022-1 FEC of the RTP stream, L columns,
+ *                            D rows (column FEC to port + 2, row FEC to port + 4)
+ *      fec_row     - boolean, row FEC (2D), otherwise columns only (default: true)
+ *
+ * Module Methods:
+ *      stats()     - table, sync pacing: deviation from the target send time,
+ *                            fec: FEC packets sent
  */
 
 #include <astra.h>
 #include <errno.h>
+#include "rtp_fec.h"
 #ifdef __linux__
 #include <arpa/inet.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include "udp_gso.h"
+#include "udp_pacer.h"
 #endif
 
 #define MSG(_msg) "[udp_output %s:%d] " _msg, mod->addr, mod->port
 
 #define UDP_BUFFER_SIZE 1460
+#define UDP_TS_PER_DATAGRAM (UDP_BUFFER_SIZE / TS_PACKET_SIZE)
 
 struct module_data_t
 {
@@ -62,12 +77,22 @@ struct module_data_t
 
     asc_socket_t *sock;
 
+    // SMPTE 2022-1: encoder of the RTP datagrams, column and row FEC sockets
+    rtp_fec_encoder_t *fec;
+    asc_socket_t *fec_sock[2];
+    uint64_t fec_send_errors;
+
     struct
     {
         uint32_t skip;
         uint8_t buffer[UDP_BUFFER_SIZE];
     } packet;
 
+#ifdef __linux__
+    // sync/cbr: общий пул потоков пейсинга вместо потока на каждый output
+    udp_pacer_job_t *pacer;
+#endif
+
     bool is_thread_started;
     asc_thread_t *thread;
     asc_thread_buffer_t *thread_input;
@@ -104,13 +129,71 @@ struct module_data_t
         uint8_t *buffers;
         struct sockaddr_in dst;
         socklen_t dst_len;
+
+        // GSO: серия датаграмм одного размера - один msghdr с UDP_SEGMENT
+        bool gso;
+        struct mmsghdr *gso_msgs;
+        uint8_t *gso_cmsg;
     } txmmsg;
 #endif
 };
 
-static const uint8_t null_ts[TS_PACKET_SIZE] = { 0x47, 0x1F, 0xFF, 0x10, 0x00 };
-
 #ifdef __linux__
+/*
+ * batch одним sendmmsg по сериям: датаграммы одного размера (последняя может быть короче)
+ * уходят одним msghdr, ядро режет их по UDP_SEGMENT. Возвращает отправленные датаграммы
+ * или -1 (errno). Путь без GSO (udp_gso_unsupported) - txmmsg.gso сбрасывается.
+ */
+static int udp_send_gso(module_data_t *mod, int fd)
+{
+    const int total = mod->txmmsg.count;
+    int runs = 0;
+    for(int i = 0; i < total; ++runs)
+    {
+        const size_t size = mod->txmmsg.iov[i].iov_len;
+        const int max = udp_gso_segments(size);
+        int n = 1;
+        while(i + n < total && n < max && mod->txmmsg.iov[i + n].iov_len <= size)
+        {
+            ++n;
+            if(mod->txmmsg.iov[i + n - 1].iov_len < size)
+                break;
+        }
+
+        struct msghdr *hdr = &mod->txmmsg.gso_msgs[runs].msg_hdr;
+        hdr->msg_name = &mod->txmmsg.dst;
+        hdr->msg_namelen = mod->txmmsg.dst_len;
+        hdr->msg_iov = &mod->txmmsg.iov[i];
+        hdr->msg_iovlen = (size_t)n;
+        if(n > 1)
+            udp_gso_set(hdr, &mod->txmmsg.gso_cmsg[(size_t)runs * UDP_GSO_CMSG_SIZE], (uint16_t)size);
+        else
+        {
+            hdr->msg_control = NULL;
+            hdr->msg_controllen = 0;
+        }
+        i += n;
+    }
+
+    const int r = sendmmsg(fd, mod->txmmsg.gso_msgs, (unsigned int)runs, MSG_DONTWAIT);
+    if(r < 0)
+    {
+        const int err = errno;
+        if(udp_gso_unsupported(err))
+        {
+            asc_log_warning(MSG("GSO send failed [%s], sending without GSO"), asc_socket_error());
+            mod->txmmsg.gso = false;
+        }
+        errno = err;
+        return -1;
+    }
+
+    int sent = 0;
+    for(int k = 0; k < r; ++k)
+        sent += (int)mod->txmmsg.gso_msgs[k].msg_hdr.msg_iovlen;
+    return sent;
+}
+
 static void udp_flush_mmsg(module_data_t *mod)
 {
     if(!mod->txmmsg.enabled || mod->txmmsg.count <= 0)
@@ -120,7 +203,14 @@ static void udp_flush_mmsg(module_data_t *mod)
 
     errno = 0;
     const int total = mod->txmmsg.count;
-    const int r = sendmmsg(fd, mod->txmmsg.msgs, (unsigned int)total, MSG_DONTWAIT);
+    int r = -1;
+    if(mod->txmmsg.gso)
+        r = udp_send_gso(mod, fd);
+    if(!mod->txmmsg.gso && r < 0)
+    {
+        errno = 0;
+        r = sendmmsg(fd, mod->txmmsg.msgs, (unsigned int)total, MSG_DONTWAIT);
+    }
     const int err_raw = errno;
 
     if(r == total)
@@ -169,7 +259,7 @@ static void udp_flush_mmsg(module_data_t *mod)
 }
 #endif
 
-static void udp_send_packet(module_data_t *mod, const uint8_t *buffer, size_t size)
+static void udp_send_datagram(module_data_t *mod, const uint8_t *buffer, size_t size)
 {
 #ifdef __linux__
     if(mod->txmmsg.enabled)
@@ -231,6 +321,21 @@ static void udp_send_packet(module_data_t *mod, const uint8_t *buffer, size_t si
     }
 }
 
+static void udp_send_packet(module_data_t *mod, const uint8_t *buffer, size_t size)
+{
+    udp_send_datagram(mod, buffer, size);
+    if(!mod->fec)
+        return;
+
+    const int count = rtp_fec_encode(mod->fec, buffer, &buffer[12], size - 12);
+    for(int i = 0; i < count; ++i)
+    {
+        const rtp_fec_packet_t *const p = &mod->fec->out[i];
+        if(asc_socket_sendto(mod->fec_sock[p->kind], p->data, p->size) == -1)
+            ++mod->fec_send_errors;
+    }
+}
+
 static void on_ts(module_data_t *mod, const uint8_t *ts)
 {
     if(mod->is_rtp && mod->packet.skip == 0)
@@ -262,16 +367,76 @@ static void on_ts(module_data_t *mod, const uint8_t *ts)
     }
 }
 
-static void thread_input_push(module_data_t *mod, const uint8_t *ts)
+static void on_ts_batch(module_data_t *mod, const uint8_t *ts, size_t count)
+{
+    while(count > 0)
+    {
+        if(mod->packet.skip == 0)
+        {
+            if(!mod->is_rtp && count >= UDP_TS_PER_DATAGRAM)
+            {
+                // полная датаграмма отправляется прямо из буфера источника
+                udp_send_packet(mod, ts, UDP_TS_PER_DATAGRAM * TS_PACKET_SIZE);
+                ts += UDP_TS_PER_DATAGRAM * TS_PACKET_SIZE;
+                count -= UDP_TS_PER_DATAGRAM;
+                continue;
+            }
+
+            // первый пакет (и RTP заголовок) через on_ts()
+            on_ts(mod, ts);
+            ts += TS_PACKET_SIZE;
+            --count;
+            continue;
+        }
+
+        size_t n = (UDP_BUFFER_SIZE - mod->packet.skip) / TS_PACKET_SIZE;
+        if(n > count)
+            n = count;
+
+        memcpy(&mod->packet.buffer[mod->packet.skip], ts, n * TS_PACKET_SIZE);
+        mod->packet.skip += n * TS_PACKET_SIZE;
+        ts += n * TS_PACKET_SIZE;
+        count -= n;
+
+        if(mod->packet.skip > UDP_BUFFER_SIZE - TS_PACKET_SIZE)
+        {
+            udp_send_packet(mod, mod->packet.buffer, mod->packet.skip);
+            mod->packet.skip = 0;
+        }
+    }
+}
+
+#ifdef __linux__
+static void pacer_push_batch(module_data_t *mod, const uint8_t *ts, size_t count)
+{
+    if(!udp_pacer_push(mod->pacer, ts, count))
+        asc_log_debug(MSG("sync buffer overflow"));
+}
+
+static void pacer_push(module_data_t *mod, const uint8_t *ts)
+{
+    pacer_push_batch(mod, ts, 1);
+}
+#else
+/* без Linux: поток синхронизации на каждый output */
+static const uint8_t null_ts[TS_PACKET_SIZE] = { 0x47, 0x1F, 0xFF, 0x10, 0x00 };
+
+static void thread_input_push_batch(module_data_t *mod, const uint8_t *ts, size_t count)
 {
-    const ssize_t r = asc_thread_buffer_write(mod->thread_input, ts, TS_PACKET_SIZE);
-    if(r != TS_PACKET_SIZE)
+    const size_t size = count * TS_PACKET_SIZE;
+    const ssize_t r = asc_thread_buffer_write(mod->thread_input, ts, size);
+    if(r != (ssize_t)size)
     {
         asc_log_debug(MSG("sync buffer overflow"));
         asc_thread_buffer_flush(mod->thread_input);
     }
 }
 
+static void thread_input_push(module_data_t *mod, const uint8_t *ts)
+{
+    thread_input_push_batch(mod, ts, 1);
+}
+
 static bool seek_pcr(module_data_t *mod,
     size_t *block_size, size_t *next_block, uint64_t *pcr)
 {
@@ -489,6 +654,91 @@ static void thread_loop(void *arg)
         }
     }
 }
+#endif
+
+static int method_stats(module_data_t *mod)
+{
+    lua_newtable(lua);
+
+    lua_pushboolean(lua, mod->sync.buffer_size > 0);
+    lua_setfield(lua, -2, "sync");
+
+#ifdef __linux__
+    udp_pacer_stats_t stats;
+    if(mod->pacer)
+        udp_pacer_stats(mod->pacer, &stats);
+#endif
+
+    int fec_cols = 0;
+    int fec_rows = 0;
+    uint64_t fec_packets[2] = { 0, 0 };
+    uint64_t fec_errors = 0;
+    if(mod->fec)
+    {
+        fec_cols = mod->fec->cols;
+        fec_rows = mod->fec->rows;
+        fec_packets[RTP_FEC_COLUMN] = RTP_FEC_GET(mod->fec->packets[RTP_FEC_COLUMN]);
+        fec_packets[RTP_FEC_ROW] = RTP_FEC_GET(mod->fec->packets[RTP_FEC_ROW]);
+        fec_errors = mod->fec_send_errors;
+    }
+#ifdef __linux__
+    else if(mod->pacer)
+    {
+        fec_cols = stats.fec_cols;
+        fec_rows = stats.fec_rows;
+        fec_packets[RTP_FEC_COLUMN] = stats.fec_packets[RTP_FEC_COLUMN];
+        fec_packets[RTP_FEC_ROW] = stats.fec_packets[RTP_FEC_ROW];
+        fec_errors = stats.fec_send_errors;
+    }
+#endif
+    if(fec_cols > 0)
+    {
+        lua_newtable(lua);
+        lua_pushinteger(lua, fec_cols);
+        lua_setfield(lua, -2, "columns");
+        lua_pushinteger(lua, fec_rows);
+        lua_setfield(lua, -2, "rows");
+        lua_pushnumber(lua, (lua_Number)fec_packets[RTP_FEC_COLUMN]);
+        lua_setfield(lua, -2, "column_packets");
+        lua_pushnumber(lua, (lua_Number)fec_packets[RTP_FEC_ROW]);
+        lua_setfield(lua, -2, "row_packets");
+        lua_pushnumber(lua, (lua_Number)fec_errors);
+        lua_setfield(lua, -2, "send_errors");
+        lua_setfield(lua, -2, "fec");
+    }
+
+#ifdef __linux__
+    if(!mod->pacer)
+        return 1;
+
+    lua_pushnumber(lua, stats.thread);
+    lua_setfield(lua, -2, "pacer_thread");
+    lua_pushnumber(lua, stats.thread_jobs);
+    lua_setfield(lua, -2, "pacer_thread_outputs");
+    lua_pushnumber(lua, (lua_Number)stats.datagrams);
+    lua_setfield(lua, -2, "datagrams");
+    lua_pushnumber(lua, (lua_Number)stats.null_packets);
+    lua_setfield(lua, -2, "null_packets");
+    lua_pushnumber(lua, (lua_Number)stats.rebuffers);
+    lua_setfield(lua, -2, "rebuffers");
+    lua_pushnumber(lua, (lua_Number)stats.overflows);
+    lua_setfield(lua, -2, "overflows");
+    lua_pushnumber(lua, (lua_Number)stats.send_errors);
+    lua_setfield(lua, -2, "send_errors");
+    lua_pushnumber(lua, (lua_Number)stats.late);
+    lua_setfield(lua, -2, "late");
+    lua_pushnumber(lua, stats.deviation_avg_us);
+    lua_setfield(lua, -2, "deviation_avg_us");
+    lua_pushnumber(lua, stats.deviation_max_us);
+    lua_setfield(lua, -2, "deviation_max_us");
+    lua_pushnumber(lua, stats.deviation_peak_us);
+    lua_setfield(lua, -2, "deviation_peak_us");
+    lua_pushnumber(lua, stats.buffer_bytes);
+    lua_setfield(lua, -2, "buffer_bytes");
+#endif
+
+    return 1;
+}
 
 static void module_init(module_data_t *mod)
 {
@@ -499,9 +749,10 @@ static void module_init(module_data_t *mod)
     module_option_number("port", &mod->port);
 
     module_option_boolean("rtp", &mod->is_rtp);
+    uint32_t rtpssrc = 0;
     if(mod->is_rtp)
     {
-        const uint32_t rtpssrc = (uint32_t)rand();
+        rtpssrc = (uint32_t)rand();
 
 #define RTP_PT_H261     31      /* RFC2032 */
 #define RTP_PT_MP2T     33      /* RFC2250 */
@@ -535,11 +786,60 @@ static void module_init(module_data_t *mod)
     asc_socket_multicast_join(mod->sock, mod->addr, NULL);
     asc_socket_set_sockaddr(mod->sock, mod->addr, mod->port);
 
+    int fec_cols = 0;
+    int fec_rows = 0;
+    bool fec_row = true;
+    const char *fec = NULL;
+    module_option_string("fec", &fec, NULL);
+    module_option_boolean("fec_row", &fec_row);
+    if(fec && !rtp_fec_parse(fec, &fec_cols, &fec_rows))
+        asc_log_error(MSG("fec: wrong matrix \"%s\", expected LxD (L 1..20, D 4..20, L*D <= 100)"), fec);
+    else if(fec && !mod->is_rtp)
+        asc_log_error(MSG("fec: RTP output is required"));
+    else if(fec)
+    {
+        asc_log_info(MSG("SMPTE 2022-1 FEC %dx%d%s"), fec_cols, fec_rows, fec_row ? "" : ", columns only");
+
+        bool paced = false;
+#ifdef __linux__
+        // sync/cbr: FEC is encoded and sent by the pacing thread
+        value = 0;
+        module_option_number("sync", &value);
+        paced = (value > 0);
+#endif
+        if(!paced)
+        {
+            mod->fec = (rtp_fec_encoder_t *)malloc(sizeof(rtp_fec_encoder_t));
+            rtp_fec_encoder_init(mod->fec, fec_cols, fec_rows, fec_row);
+
+            for(int kind = RTP_FEC_COLUMN; kind <= RTP_FEC_ROW; ++kind)
+            {
+                asc_socket_t *const sock = asc_socket_open_udp4(mod);
+                asc_socket_set_reuseaddr(sock, 1);
+                if(!asc_socket_bind(sock, NULL, 0))
+                    astra_abort();
+                if(localaddr)
+                    asc_socket_set_multicast_if(sock, localaddr);
+                value = 32;
+                module_option_number("ttl", &value);
+                asc_socket_set_multicast_ttl(sock, value);
+                asc_socket_set_sockaddr(sock, mod->addr
+                    , mod->port + ((kind == RTP_FEC_COLUMN) ? RTP_FEC_PORT_COLUMN : RTP_FEC_PORT_ROW));
+                mod->fec_sock[kind] = sock;
+            }
+        }
+    }
+
 #ifdef __linux__
     {
         bool use_sendmmsg = false;
         module_option_boolean("use_sendmmsg", &use_sendmmsg);
 
+        bool gso = false;
+        module_option_boolean("gso", &gso);
+        if(gso)
+            use_sendmmsg = true;
+
         int tx_batch = 8;
         module_option_number("tx_batch", &tx_batch);
 
@@ -572,6 +872,20 @@ static void module_init(module_data_t *mod)
                 mod->txmmsg.count = 0;
             }
         }
+
+        if(!mod->txmmsg.enabled)
+            gso = false;
+        if(gso && !udp_gso_probe(asc_socket_fd(mod->sock)))
+        {
+            asc_log_warning(MSG("UDP_SEGMENT is not supported by kernel; sending without GSO"));
+            gso = false;
+        }
+        if(gso)
+        {
+            mod->txmmsg.gso_msgs = (struct mmsghdr *)calloc((size_t)tx_batch, sizeof(struct mmsghdr));
+            mod->txmmsg.gso_cmsg = (uint8_t *)calloc((size_t)tx_batch, UDP_GSO_CMSG_SIZE);
+            mod->txmmsg.gso = (mod->txmmsg.gso_msgs && mod->txmmsg.gso_cmsg);
+        }
     }
 #endif
 
@@ -579,24 +893,62 @@ static void module_init(module_data_t *mod)
     module_option_number("sync", &value);
     if(value > 0)
     {
-        module_stream_init(mod, thread_input_push);
-
         mod->sync.buffer_size = value * 1024 * 1024;
         mod->sync.buffer_size -= mod->sync.buffer_size % TS_PACKET_SIZE;
-        mod->sync.buffer = (uint8_t *)malloc(mod->sync.buffer_size);
 
         value = 0;
         module_option_number("cbr", &value);
         if(value > 0)
             mod->cbr = (value * 1000 * 1000) / (8 * TS_PACKET_SIZE); // ts/s
 
+#ifdef __linux__
+        value = 0;
+        if(module_option_number("pacer_threads", &value))
+            udp_pacer_configure(value);
+
+        char name[128];
+        snprintf(name, sizeof(name), "%s:%d", mod->addr, mod->port);
+
+        udp_pacer_config_t config;
+        memset(&config, 0, sizeof(config));
+        config.name = name;
+        config.fd = asc_socket_fd(mod->sock);
+        config.dst.sin_family = AF_INET;
+        config.dst.sin_addr.s_addr = inet_addr(mod->addr);
+        config.dst.sin_port = htons(mod->port);
+        config.rtp = mod->is_rtp;
+        config.rtp_ssrc = rtpssrc;
+        config.buffer_size = mod->sync.buffer_size;
+        config.cbr = mod->cbr;
+        if(fec_cols > 0 && mod->is_rtp)
+        {
+            config.fec_cols = fec_cols;
+            config.fec_rows = fec_rows;
+            config.fec_row = fec_row;
+        }
+
+        mod->pacer = udp_pacer_add(&config);
+        asc_assert(mod->pacer != NULL, MSG("failed to start sync pacing"));
+
+        // udp_output follows the loop of the upstream
+        module_stream_batch_set(mod, pacer_push_batch);
+        module_stream_init_loop(mod, pacer_push);
+#else
+        mod->sync.buffer = (uint8_t *)malloc(mod->sync.buffer_size);
+
         mod->thread = asc_thread_init(mod);
         mod->thread_input = asc_thread_buffer_init(mod->sync.buffer_size * 2);
         asc_thread_start(mod->thread, thread_loop, NULL, NULL, on_thread_close);
+
+        // udp_output follows the loop of the upstream
+        module_stream_batch_set(mod, thread_input_push_batch);
+        module_stream_init_loop(mod, thread_input_push);
+#endif
     }
     else
     {
-        module_stream_init(mod, on_ts);
+        module_stream_batch_set(mod, on_ts_batch);
+        module_stream_init_loop(mod, on_ts);
     }
 }
 
@@ -604,8 +956,16 @@ static void module_destroy(module_data_t *mod)
 {
     module_stream_destroy(mod);
 
+#ifdef __linux__
+    if(mod->pacer)
+    {
+        udp_pacer_remove(mod->pacer);
+        mod->pacer = NULL;
+    }
+#else
     if(mod->thread)
         on_thread_close(mod);
+#endif
 
     if(mod->sync.buffer)
     {
@@ -630,6 +990,11 @@ static void module_destroy(module_data_t *mod)
         free(mod->txmmsg.msgs);
         mod->txmmsg.msgs = NULL;
     }
+    free(mod->txmmsg.gso_msgs);
+    mod->txmmsg.gso_msgs = NULL;
+    free(mod->txmmsg.gso_cmsg);
+    mod->txmmsg.gso_cmsg = NULL;
+    mod->txmmsg.gso = false;
     mod->txmmsg.enabled = false;
     mod->txmmsg.capacity = 0;
     mod->txmmsg.count = 0;
@@ -640,11 +1005,23 @@ static void module_destroy(module_data_t *mod)
         asc_socket_close(mod->sock);
         mod->sock = NULL;
     }
+
+    for(int kind = RTP_FEC_COLUMN; kind <= RTP_FEC_ROW; ++kind)
+    {
+        if(mod->fec_sock[kind])
+        {
+            asc_socket_close(mod->fec_sock[kind]);
+            mod->fec_sock[kind] = NULL;
+        }
+    }
+    free(mod->fec);
+    mod->fec = NULL;
 }
 
 MODULE_STREAM_METHODS()
 MODULE_LUA_METHODS()
 {
+    { "stats", method_stats },
     MODULE_STREAM_METHODS_REF()
 };
 MODULE_LUA_REGISTER(udp_output)
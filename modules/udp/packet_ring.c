@@ -0,0 +1,308 @@
+/*
+ * Astra Module: UDP: AF_PACKET TPACKET_V3 receive ring
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "packet_ring.h"
+
+#include <errno.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include <linux/filter.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <net/if.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define MSG(_msg) "[packet_ring] " _msg
+
+#define IPV4_HEADER_MIN 20
+#define UDP_HEADER_SIZE 8
+#define IPPROTO_UDP_NUM 17
+#define IPV4_FRAG_MASK 0x3FFF // MF + fragment offset
+
+// instructions before the destination list and per destination
+#define FILTER_HEAD 11
+#define FILTER_PER_DST 5
+
+static inline void counter_add(uint64_t *counter, uint64_t value)
+{
+    __atomic_fetch_add(counter, value, __ATOMIC_RELAXED);
+}
+
+static inline struct sock_filter insn(uint16_t code, uint8_t jt, uint8_t jf, uint32_t k)
+{
+    const struct sock_filter f = { code, jt, jf, k };
+    return f;
+}
+
+int packet_ring_filter_build(struct sock_filter *code, int max, const packet_ring_dst_t *dst, int count)
+{
+    if(!dst || count <= 0)
+    {
+        if(max < 1)
+            return -1;
+        code[0] = insn(BPF_RET | BPF_K, 0, 0, 0);
+        return 1;
+    }
+    if(max < FILTER_HEAD + 1)
+        return -1;
+
+    int n = 0;
+    // loopback also delivers the outgoing copy
+    code[n++] = insn(BPF_LD | BPF_W | BPF_ABS, 0, 0, (uint32_t)(SKF_AD_OFF + SKF_AD_PKTTYPE));
+    code[n++] = insn(BPF_JMP | BPF_JEQ | BPF_K, 0, 1, PACKET_OUTGOING);
+    code[n++] = insn(BPF_RET | BPF_K, 0, 0, 0);
+    code[n++] = insn(BPF_LD | BPF_B | BPF_ABS, 0, 0, 9);
+    code[n++] = insn(BPF_JMP | BPF_JEQ | BPF_K, 1, 0, IPPROTO_UDP_NUM);
+    code[n++] = insn(BPF_RET | BPF_K, 0, 0, 0);
+    code[n++] = insn(BPF_LD | BPF_H | BPF_ABS, 0, 0, 6);
+    code[n++] = insn(BPF_JMP | BPF_JSET | BPF_K, 0, 1, IPV4_FRAG_MASK);
+    code[n++] = insn(BPF_RET | BPF_K, 0, 0, 0);
+    code[n++] = insn(BPF_LDX | BPF_B | BPF_MSH, 0, 0, 0);
+    code[n++] = insn(BPF_LD | BPF_W | BPF_ABS, 0, 0, 16);
+
+    // the list does not fit: pass all UDP, the reader drops the rest
+    if(n + count * FILTER_PER_DST + 1 > max)
+    {
+        code[n++] = insn(BPF_RET | BPF_K, 0, 0, 0xFFFF);
+        return n;
+    }
+
+    // jump offsets are 8 bit: every destination has its own ret
+    for(int i = 0; i < count; ++i)
+    {
+        code[n++] = insn(BPF_JMP | BPF_JEQ | BPF_K, 0, 3, ntohl(dst[i].addr));
+        code[n++] = insn(BPF_LD | BPF_H | BPF_IND, 0, 0, 2);
+        code[n++] = insn(BPF_JMP | BPF_JEQ | BPF_K, 0, 1, dst[i].port);
+        code[n++] = insn(BPF_RET | BPF_K, 0, 0, 0xFFFF);
+        code[n++] = insn(BPF_LD | BPF_W | BPF_ABS, 0, 0, 16);
+    }
+    code[n++] = insn(BPF_RET | BPF_K, 0, 0, 0);
+    return n;
+}
+
+int packet_ring_parse(const uint8_t *frame, int size, packet_ring_dst_t *dst, const uint8_t **payload)
+{
+    if(size < IPV4_HEADER_MIN || (frame[0] >> 4) != 4)
+        return -1;
+    const int ihl = (frame[0] & 0x0F) * 4;
+    const int total = (frame[2] << 8) | frame[3];
+    if(ihl < IPV4_HEADER_MIN || total > size || total < ihl + UDP_HEADER_SIZE)
+        return -1;
+    if(frame[9] != IPPROTO_UDP_NUM || (((frame[6] << 8) | frame[7]) & IPV4_FRAG_MASK))
+        return -1;
+
+    const uint8_t *udp = frame + ihl;
+    const int udp_size = (udp[4] << 8) | udp[5];
+    if(udp_size < UDP_HEADER_SIZE || udp_size > total - ihl)
+        return -1;
+
+    memcpy(&dst->addr, frame + 16, sizeof(dst->addr));
+    dst->port = (uint16_t)((udp[2] << 8) | udp[3]);
+    *payload = udp + UDP_HEADER_SIZE;
+    return udp_size - UDP_HEADER_SIZE;
+}
+
+static bool attach_filter(int fd, struct sock_filter *code, int size)
+{
+    struct sock_fprog prog;
+    memset(&prog, 0, sizeof(prog));
+    prog.len = (unsigned short)size;
+    prog.filter = code;
+    return setsockopt(fd, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof(prog)) == 0;
+}
+
+bool packet_ring_socket_drop_all(int fd)
+{
+    struct sock_filter code[1];
+    const int size = packet_ring_filter_build(code, 1, NULL, 0);
+    return attach_filter(fd, code, size);
+}
+
+bool packet_ring_set_filter(packet_ring_t *ring, const packet_ring_dst_t *dst, int count)
+{
+    struct sock_filter *code = (struct sock_filter *)malloc(PACKET_RING_FILTER_MAX * sizeof(struct sock_filter));
+    if(!code)
+        return false;
+
+    const int size = packet_ring_filter_build(code, PACKET_RING_FILTER_MAX, dst, count);
+    const bool ok = size > 0 && attach_filter(ring->fd, code, size);
+    if(ok)
+        __atomic_store_n(&ring->filter_size, (dst && count > 0) ? size : 0, __ATOMIC_RELAXED);
+    else
+        asc_log_error(MSG("failed to attach filter: %s"), strerror(errno));
+    free(code);
+    return ok;
+}
+
+bool packet_ring_open(packet_ring_t *ring, const char *ifname, int blocks)
+{
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = -1;
+    ring->block_size = PACKET_RING_BLOCK_SIZE;
+    ring->blocks = (blocks > 0) ? blocks : PACKET_RING_BLOCKS_DEFAULT;
+    if(ring->blocks > PACKET_RING_BLOCKS_MAX)
+        ring->blocks = PACKET_RING_BLOCKS_MAX;
+
+    ring->ifindex = (int)if_nametoindex(ifname);
+    if(ring->ifindex <= 0)
+    {
+        asc_log_error(MSG("interface %s not found"), ifname);
+        return false;
+    }
+
+    // SOCK_DGRAM: frames start at the IPv4 header, VLAN tag is already stripped
+    ring->fd = socket(AF_PACKET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, htons(ETH_P_IP));
+    if(ring->fd < 0)
+    {
+        asc_log_error(MSG("socket(AF_PACKET) failed on %s: %s"), ifname, strerror(errno));
+        return false;
+    }
+
+    // before bind: nothing is queued until the destinations are set
+    if(!packet_ring_socket_drop_all(ring->fd))
+    {
+        asc_log_error(MSG("failed to attach filter on %s: %s"), ifname, strerror(errno));
+        packet_ring_close(ring);
+        return false;
+    }
+
+    const int version = TPACKET_V3;
+    if(setsockopt(ring->fd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) != 0)
+    {
+        asc_log_error(MSG("TPACKET_V3 is not supported: %s"), strerror(errno));
+        packet_ring_close(ring);
+        return false;
+    }
+
+    struct tpacket_req3 req;
+    memset(&req, 0, sizeof(req));
+    req.tp_block_size = (unsigned int)ring->block_size;
+    req.tp_block_nr = (unsigned int)ring->blocks;
+    req.tp_frame_size = TPACKET_ALIGNMENT << 7; // 2048, V3 only checks the geometry
+    req.tp_frame_nr = (req.tp_block_size / req.tp_frame_size) * req.tp_block_nr;
+    req.tp_retire_blk_tov = PACKET_RING_BLOCK_TIMEOUT_MS;
+    if(setsockopt(ring->fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) != 0)
+    {
+        asc_log_error(MSG("failed to set up %d blocks ring on %s: %s")
+                      , ring->blocks, ifname, strerror(errno));
+        packet_ring_close(ring);
+        return false;
+    }
+
+    ring->map_size = (size_t)ring->block_size * (size_t)ring->blocks;
+    void *map = mmap(NULL, ring->map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, 0);
+    if(map == MAP_FAILED)
+    {
+        asc_log_error(MSG("mmap() of %zu bytes failed: %s"), ring->map_size, strerror(errno));
+        ring->map_size = 0;
+        packet_ring_close(ring);
+        return false;
+    }
+    ring->map = (uint8_t *)map;
+
+    struct sockaddr_ll sll;
+    memset(&sll, 0, sizeof(sll));
+    sll.sll_family = AF_PACKET;
+    sll.sll_protocol = htons(ETH_P_IP);
+    sll.sll_ifindex = ring->ifindex;
+    if(bind(ring->fd, (struct sockaddr *)&sll, sizeof(sll)) != 0)
+    {
+        asc_log_error(MSG("bind() to %s failed: %s"), ifname, strerror(errno));
+        packet_ring_close(ring);
+        return false;
+    }
+
+    return true;
+}
+
+void packet_ring_close(packet_ring_t *ring)
+{
+    if(ring->map)
+        munmap(ring->map, ring->map_size);
+    ring->map = NULL;
+    ring->map_size = 0;
+    if(ring->fd >= 0)
+        close(ring->fd);
+    ring->fd = -1;
+}
+
+int packet_ring_read(packet_ring_t *ring, packet_ring_frame_t on_frame, packet_ring_block_t on_block
+                     , void *arg, int max_blocks)
+{
+    int count = 0;
+    while(count < max_blocks)
+    {
+        struct tpacket_block_desc *block =
+            (struct tpacket_block_desc *)(ring->map + (size_t)ring->cursor * (size_t)ring->block_size);
+        if(!(__atomic_load_n(&block->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER))
+            break;
+
+        const uint32_t num = block->hdr.bh1.num_pkts;
+        const uint8_t *ptr = (const uint8_t *)block + block->hdr.bh1.offset_to_first_pkt;
+        uint64_t frames = 0;
+        uint64_t bytes = 0;
+        uint64_t invalid = 0;
+        for(uint32_t i = 0; i < num; ++i)
+        {
+            const struct tpacket3_hdr *hdr = (const struct tpacket3_hdr *)ptr;
+            packet_ring_dst_t dst;
+            const uint8_t *payload = NULL;
+            const int size = packet_ring_parse(ptr + hdr->tp_net, (int)hdr->tp_snaplen, &dst, &payload);
+            if(size < 0)
+            {
+                ++invalid;
+            }
+            else
+            {
+                ++frames;
+                bytes += (uint64_t)size;
+                on_frame(arg, &dst, payload, size
+                         , (uint64_t)hdr->tp_sec * 1000000000ULL + hdr->tp_nsec);
+            }
+            ptr += hdr->tp_next_offset;
+        }
+        if(on_block)
+            on_block(arg);
+
+        __atomic_store_n(&block->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+        ring->cursor = (ring->cursor + 1) % ring->blocks;
+        ++count;
+
+        counter_add(&ring->blocks_read, 1);
+        counter_add(&ring->frames, frames);
+        counter_add(&ring->bytes, bytes);
+        if(invalid)
+            counter_add(&ring->invalid, invalid);
+    }
+    return count;
+}
+
+void packet_ring_update_stats(packet_ring_t *ring)
+{
+    struct tpacket_stats_v3 st;
+    socklen_t len = sizeof(st);
+    memset(&st, 0, sizeof(st));
+    // the kernel resets the counters on read
+    if(ring->fd < 0 || getsockopt(ring->fd, SOL_PACKET, PACKET_STATISTICS, &st, &len) != 0)
+        return;
+    if(st.tp_drops)
+        counter_add(&ring->drops, st.tp_drops);
+    if(st.tp_freeze_q_cnt)
+        counter_add(&ring->freezes, st.tp_freeze_q_cnt);
+}
@@ -0,0 +1,103 @@
+/*
+ * Astra Module: UDP: AF_PACKET TPACKET_V3 receive ring
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _PACKET_RING_H_
+#define _PACKET_RING_H_ 1
+
+#include <astra.h>
+
+/*
+ * Memory-mapped block ring of an AF_PACKET socket (Linux only). The kernel
+ * fills blocks with IPv4 frames of one interface that pass a classic BPF
+ * filter built from the list of destinations. The reader demultiplexes
+ * frames in user space and hands payload pointers into the block to the
+ * callback, the block goes back to the kernel after its last frame.
+ * CAP_NET_RAW is required.
+ * Only the reading thread calls packet_ring_read(), the counters are
+ * updated with relaxed atomics and may be read from any thread.
+ */
+
+#define PACKET_RING_BLOCK_SIZE (256 * 1024)
+#define PACKET_RING_BLOCKS_DEFAULT 64
+#define PACKET_RING_BLOCKS_MAX 1024
+#define PACKET_RING_BLOCK_TIMEOUT_MS 1 // partially filled block is retired
+#define PACKET_RING_FILTER_MAX 4096 // BPF_MAXINSNS
+
+typedef struct
+{
+    uint32_t addr; // network byte order
+    uint16_t port;
+} packet_ring_dst_t;
+
+typedef struct
+{
+    int fd;
+    int ifindex;
+    uint8_t *map;
+    size_t map_size;
+    int block_size;
+    int blocks;
+    int cursor; // reading thread only
+    int filter_size; // instructions, 0 - drop all
+
+    // published
+    uint64_t blocks_read;
+    uint64_t frames;
+    uint64_t bytes; // UDP payload
+    uint64_t invalid; // not a complete IPv4/UDP datagram
+    uint64_t drops; // ring full, PACKET_STATISTICS
+    uint64_t freezes;
+} packet_ring_t;
+
+/* frame: UDP payload inside the block, valid until the end of the block,
+ * stamp_ns - kernel receive time (CLOCK_REALTIME) */
+typedef void (*packet_ring_frame_t)(void *arg, const packet_ring_dst_t *dst
+                                    , const uint8_t *payload, int size, uint64_t stamp_ns);
+/* all frames of the block are passed, the block is returned after the call */
+typedef void (*packet_ring_block_t)(void *arg);
+
+/* blocks of PACKET_RING_BLOCK_SIZE, the filter drops everything until set */
+bool packet_ring_open(packet_ring_t *ring, const char *ifname, int blocks);
+void packet_ring_close(packet_ring_t *ring);
+
+/* replaces the filter: UDP to any of dst, dst == NULL or count == 0 - drop all */
+bool packet_ring_set_filter(packet_ring_t *ring, const packet_ring_dst_t *dst, int count);
+
+/* returns number of blocks read, up to max_blocks */
+int packet_ring_read(packet_ring_t *ring, packet_ring_frame_t on_frame, packet_ring_block_t on_block
+                     , void *arg, int max_blocks);
+
+/* moves kernel drop counters to ring->drops and ring->freezes */
+void packet_ring_update_stats(packet_ring_t *ring);
+
+/*
+ * Building blocks, exposed for tests
+ */
+
+struct sock_filter;
+
+/* classic BPF for IPv4 frames without link header (SOCK_DGRAM),
+ * returns the number of instructions or -1 if max is too small */
+int packet_ring_filter_build(struct sock_filter *code, int max, const packet_ring_dst_t *dst, int count);
+
+/* IPv4 header at frame, returns payload size or -1, *payload - UDP payload */
+int packet_ring_parse(const uint8_t *frame, int size, packet_ring_dst_t *dst, const uint8_t **payload);
+
+/* the socket keeps its port and group membership but receives nothing */
+bool packet_ring_socket_drop_all(int fd);
+
+#endif /* _PACKET_RING_H_ */
@@ -8,21 +8,31 @@
  *
  * Важно:
  * - по умолчанию не используется (включается настройкой в Lua/runtime)
- * - поддерживает только "простые" конфиги (UDP input -> UDP outputs)
+ * - поддерживает только "простые" конфиги (UDP/RTP input -> UDP/RTP outputs)
  */
 
 #include <astra.h>
+#include "rtp_merge.h"
 
 #ifdef __linux__
 
+#include "packet_ring.h"
+#include "udp_gso.h"
+#include "udp_mdi.h"
+#include "rtp_fec.h"
+
 #include <errno.h>
+#include <ifaddrs.h>
 #include <pthread.h>
 #include <sched.h>
 #include <string.h>
 #include <arpa/inet.h>
+#include <net/if.h>
 #include <netinet/in.h>
 #include <sys/epoll.h>
 #include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
 #define RELAY_MAX_EVENTS 64
@@ -33,6 +43,70 @@
 // ограничиваем объём работы за один epoll event.
 #define RELAY_READ_BUDGET_LOOPS 4
 
+// RTP (RFC 3550): заголовок снимается и добавляется прямо в воркере.
+#define RTP_HEADER_SIZE 12
+#define RTP_PT_MP2T 33 // RFC 2250
+// Пороги как в RFC 3550 A.1: большой скачок вперёд или далёкий "старый" номер
+// считаем рестартом источника, а не потерями.
+#define RELAY_RTP_MAX_DROPOUT 3000
+#define RELAY_RTP_MAX_MISORDER 100
+// окно потерянных seq за rtp_max_seq: степень двойки >= MAX_MISORDER, делит 65536
+#define RELAY_RTP_MISSING_BITS 128
+
+// TS метрики в воркере: компактная таблица PID (больше - считаем в pid_overflow).
+#define RELAY_PID_MAX 64
+#define RELAY_METER_WINDOW_US 1000000
+// PCR интервал больше 1 с (или назад) - разрыв, не интервал.
+#define RELAY_PCR_GAP_US 1000000
+
+// HTTP /play из воркера: кольцо последних датаграмм стрима, клиенты пишутся sendmsg(iov).
+#define RELAY_PLAY_CLIENTS_MAX 1024
+#define RELAY_PLAY_DATAGRAM_SIZE (7 * TS_PACKET_SIZE) // для перевода buffer_kb в слоты кольца
+#define RELAY_PLAY_IOV_MAX 64
+#define RELAY_PLAY_PENDING_SIZE 512 // HTTP заголовок ответа или хвост недописанного TS пакета
+#define RELAY_PLAY_WRITE_LOOPS 4
+#define RELAY_PLAY_RING_KB_DEFAULT 512
+#define RELAY_PLAY_BACKLOG_KB_DEFAULT 32
+
+// Pacing outputs: очередь и слот в датаграммах
+#define RELAY_PACE_QUEUE_DEFAULT 128
+#define RELAY_PACE_QUEUE_MAX 4096
+#define RELAY_PACE_BURST_DEFAULT 4
+#define RELAY_PACE_BURST_MAX 64 // датаграмм на sendmmsg
+#define RELAY_PACE_SLOT_MIN_US 250 // при высоком bitrate растёт слот, а не частота таймера
+#define RELAY_PACE_WINDOW_US 500000 // окно оценки входного bitrate
+
+// AF_PACKET ingest: кольцо на (воркер, интерфейс), размер задаёт первый вход
+#define RELAY_RING_MB_DEFAULT 16
+
+// UDP_GRO ingest: буферов по UDP_GRO_BUFFER_SIZE на recvmmsg
+#define RELAY_GRO_MSGS 4
+// cmsg буфера серии: размер сегмента и время приёма (mdi)
+#define RELAY_GRO_CMSG_SIZE (UDP_GRO_CMSG_SIZE + UDP_MDI_CMSG_SIZE)
+
+// Балансировка воркеров (main loop): перенос потоков с самого загруженного воркера
+#define RELAY_BALANCE_THRESHOLD_DEFAULT 20 // разница busy% горячего и холодного воркера
+#define RELAY_BALANCE_MAX_MOVES_DEFAULT 2 // переносов за интервал
+#define RELAY_BALANCE_CONFIRM 2 // интервалов подряд с перекосом до первого переноса
+#define RELAY_BALANCE_COOLDOWN 6 // интервалов, пока перенесённый поток остаётся на месте
+#define RELAY_BALANCE_LOG 16 // последние решения в engine_stats
+
+// epoll data.ptr: первое поле relay_ingest_t, relay_play_client_t, relay_ring_t и relay_worker_t.pace_event
+enum
+{
+    RELAY_EVENT_INGEST = 0,
+    RELAY_EVENT_PLAY = 1,
+    RELAY_EVENT_PACE = 2,
+    RELAY_EVENT_RING = 3,
+};
+
+enum
+{
+    RELAY_PACE_OFF = 0,
+    RELAY_PACE_BITRATE = 1, // скорость входа, окно RELAY_PACE_WINDOW_US
+    RELAY_PACE_PCR = 2, // скорость по PCR (до первых двух PCR - как bitrate)
+};
+
 #define RELAY_MSG_PREFIX "[udp_relay]"
 
 typedef struct relay_output_t
@@ -45,9 +119,192 @@ typedef struct relay_output_t
     uint64_t dropped_packets;
     uint64_t last_log_us;
     int last_errno;
+
+    // RTP encapsulation: свой seq/SSRC, timestamp 90 kHz от времени отправки.
+    bool rtp;
+    uint16_t rtp_seq;
+    uint32_t rtp_ssrc;
+
+    // UDP_SEGMENT: batch одним msghdr. Воркер сбрасывает, если путь не принял GSO (published).
+    bool gso;
+
+    // SMPTE 2022-1 FEC RTP выхода: колонки на порт + 2, строки на порт + 4 (счётчики published).
+    rtp_fec_encoder_t *fec;
+    struct sockaddr_in fec_sa[2];
+    uint64_t fec_send_errors;
+
+    // Pacing (под ctx->lock): очередь - датаграммы ctx->pace_ring от pace_cursor до pace_head.
+    int pace; // RELAY_PACE_*
+    int pace_queue; // лимит очереди
+    int pace_burst; // датаграмм на слот
+    uint64_t pace_cursor;
+    uint64_t pace_due_us; // следующий слот, 0 - очередь пуста
+    uint64_t pace_last_us;
+    uint64_t pace_credit; // байт
+
+    // published (relaxed atomics)
+    uint32_t pace_depth;
+    uint32_t pace_depth_max;
+    uint32_t pace_burst_last;
+    uint32_t pace_burst_max;
+    uint64_t pace_sends; // sendmmsg
+    uint64_t pace_datagrams;
+    uint64_t pace_overflows; // очередь заполнена: отправлено сразу
 } relay_output_t;
 
+/*
+ * Счётчики PID: пишет только воркер, stats читает без лока (relaxed atomics).
+ * Поля "worker" читаются только воркером.
+ */
+typedef struct
+{
+    // worker
+    uint64_t last_pcr;
+    uint64_t last_pcr_us;
+    uint64_t window_packets;
+    uint8_t cc;
+    bool cc_valid;
+
+    // published
+    uint16_t pid;
+    uint8_t scrambled;
+    uint8_t pmt; // PID указан в PAT как PMT
+    uint64_t packets;
+    uint64_t cc_errors;
+    uint64_t pcr_count;
+    uint32_t bitrate; // бит/с за последнее окно RELAY_METER_WINDOW_US
+    uint32_t pcr_interval_us; // последний
+    uint32_t pcr_interval_max_us;
+    uint32_t pcr_jitter_max_us; // |интервал прихода - интервал PCR|, время прихода - время batch
+} relay_pid_t;
+
 typedef struct relay_ctx_t relay_ctx_t;
+typedef struct relay_ingest_t relay_ingest_t;
+typedef struct relay_ring_t relay_ring_t;
+
+typedef struct
+{
+    relay_ctx_t *ctx;
+    int leg; // 0 - основной вход ctx, иначе merge leg
+} relay_ingest_sub_t;
+
+/*
+ * Общий вход: один сокет (и один join) на (localaddr, addr, port) в воркере.
+ * batch читает воркер и раздаёт подписчикам из тех же буферов, без копий.
+ * Список ingests и refcount - под g_ingest_mu, подписчики - под lock.
+ */
+struct relay_ingest_t
+{
+    int event_type; // RELAY_EVENT_INGEST
+    relay_ingest_t *next; // g_ingests или reap воркера
+    char *key;
+    int worker_index;
+    int refcount; // входы ctx, открытые на этом ingest
+
+    // packet: сокет только держит join (и порт unicast), датаграммы приходят из ring
+    asc_socket_t *sock;
+    int fd; // -1 для packet
+    relay_ring_t *ring;
+    packet_ring_dst_t dst;
+
+    // socket - буферы recvmmsg, packet и gro - iov указывают в блок ring или буфер gro
+    int rx_batch;
+    struct mmsghdr *rx_msgs;
+    struct iovec *rx_iov;
+    uint8_t *rx_buffers;
+
+    // MDI: время приёма датаграммы n (ns, CLOCK_REALTIME), 0 - нет, берётся время чтения.
+    // socket - SO_TIMESTAMPNS после первого входа с mdi, packet - всегда из кадра ring
+    bool timestamps;
+    uint64_t *rx_stamp;
+    uint8_t *rx_cmsg;
+
+    // UDP_GRO: recvmmsg в RELAY_GRO_MSGS буферов, серии режутся на датаграммы в rx_iov
+    bool gro;
+    struct mmsghdr *gro_msgs;
+    struct iovec *gro_iov;
+    uint8_t *gro_buffers;
+    uint8_t *gro_cmsg;
+    int pending; // packet: датаграмм в rx_iov, только воркер
+    bool pending_linked;
+    relay_ingest_t *pending_next;
+
+    pthread_mutex_t lock;
+    relay_ingest_sub_t *subs;
+    int sub_count; // published
+    int sub_slots;
+
+    // published
+    uint64_t datagrams;
+    uint64_t bytes;
+    uint64_t reads; // recvmmsg
+    uint64_t gro_coalesced; // буферов с несколькими датаграммами
+    uint64_t gro_datagrams; // датаграмм в них
+};
+
+/* вход ctx: параметры сокета и ingest после ctx_register_in_engine */
+typedef struct
+{
+    char *addr;
+    int port;
+    char *localaddr;
+    int socket_size;
+    bool packet; // AF_PACKET ring вместо сокета
+    char *ifname; // packet: интерфейс, иначе по localaddr
+    int ring_mb;
+    bool gro; // socket: UDP_GRO, общий ingest - как у первого входа
+    bool mdi; // время приёма из ядра для MDI ctx
+    relay_ingest_t *ingest;
+} relay_source_t;
+
+/*
+ * AF_PACKET ring воркера на интерфейсе (packet_ring.c): BPF пропускает адреса
+ * ingests, воркер раскладывает кадры по ingests и раздаёт их batch подписчикам.
+ * Кольцо живёт до конца процесса, без ingests фильтр отбрасывает всё.
+ * Таблица пишется под g_ingest_mu и lock, воркер читает её под lock.
+ */
+struct relay_ring_t
+{
+    int event_type; // RELAY_EVENT_RING
+    relay_ring_t *next; // rings воркера
+    char *ifname;
+    int worker_index;
+    packet_ring_t ring;
+
+    pthread_mutex_t lock;
+    relay_ingest_t **table; // по (addr, port)
+    int count;
+    int slots;
+    relay_ingest_t *pending; // ingests с датаграммами текущего блока, только воркер
+
+    uint64_t unmatched; // published, прошли BPF, но не наши (фильтр на весь UDP)
+};
+
+/* SMPTE 2022-7: дополнительный вход того же RTP потока (leg 0 - основной вход ctx) */
+typedef struct
+{
+    relay_source_t in;
+    char *source;
+} relay_leg_t;
+
+/*
+ * HTTP клиент, переданный воркеру. Слот живёт до free_ctx (epoll события могут
+ * прийти уже после отключения), fd=-1 - слот свободен. Всё под ctx->lock.
+ */
+typedef struct
+{
+    int event_type; // RELAY_EVENT_PLAY
+    relay_ctx_t *ctx;
+    int fd;
+    int id;
+    bool blocked; // ждём EPOLLOUT
+
+    uint64_t cursor; // следующая датаграмма кольца
+    size_t skip; // отправлено байт датаграммы cursor, всегда кратно 188
+    uint8_t pending[RELAY_PLAY_PENDING_SIZE];
+    size_t pending_size;
+    size_t pending_skip;
+} relay_play_client_t;
 
 typedef struct
 {
@@ -56,8 +313,71 @@ typedef struct
     int index;
     int pinned_cpu;
     int active_streams;
+
+    // Pacing: один timerfd на воркер, ctx с paced outputs в pace_list.
+    int pace_event; // RELAY_EVENT_PACE, epoll data.ptr
+    int pace_fd;
+    uint64_t pace_armed_us; // только воркер, 0 - не взведён
+    pthread_mutex_t pace_mu;
+    relay_ctx_t **pace_list;
+    int pace_count;
+    int pace_slots;
+
+    // ingests без подписчиков: закрывает воркер, его epoll batch мог их ещё вернуть
+    pthread_mutex_t reap_mu;
+    relay_ingest_t *reap;
+
+    relay_ring_t *rings; // под g_ingest_mu
+
+    // Нагрузка, published: время обработки epoll batch и датаграммы ingests воркера
+    uint64_t busy_us;
+    uint64_t datagrams;
+
+    // Балансировщик (main loop): значения за последний интервал
+    uint64_t sample_busy_us;
+    uint64_t sample_datagrams;
+    double busy_pct;
+    double pps;
+    double load_pps; // сумма load_pps потоков воркера
 } relay_worker_t;
 
+/* решение балансировщика: поток id перенесён с воркера from на to */
+typedef struct
+{
+    uint64_t at; // unix time
+    char id[64];
+    int from;
+    int to;
+    double load_pps;
+    double from_busy_pct;
+    double to_busy_pct;
+} relay_balance_move_t;
+
+/*
+ * Балансировщик воркеров: таймер main loop раз в interval_ms сравнивает busy%
+ * воркеров и переносит потоки между epoll воркеров (ingest сокеты, play клиенты,
+ * пейсинг). Сокет не закрывается, датаграммы ждут в его буфере. Всё - main loop.
+ */
+typedef struct
+{
+    asc_timer_t *timer;
+    int interval_ms; // 0 - выключен
+    int threshold_pct;
+    int max_moves;
+
+    uint64_t sample_us;
+    int imbalance_runs; // интервалов подряд с перекосом
+    double imbalance_pct;
+
+    uint64_t runs;
+    uint64_t migrations;
+    uint64_t failures;
+    uint64_t skipped; // кандидаты, которые переносить нельзя (общий ingest, AF_PACKET)
+
+    relay_balance_move_t log[RELAY_BALANCE_LOG];
+    uint64_t log_count;
+} relay_balancer_t;
+
 typedef struct
 {
     pthread_mutex_t mu;
@@ -68,6 +388,10 @@ typedef struct
 } relay_engine_t;
 
 static relay_engine_t g_engine;
+static relay_balancer_t g_balancer;
+
+// воркер текущего потока, NULL - main loop
+static __thread relay_worker_t *relay_current_worker = NULL;
 
 struct relay_ctx_t
 {
@@ -75,29 +399,100 @@ struct relay_ctx_t
     char *id;
     char *input_url;
 
-    asc_socket_t *in_sock;
-    int in_fd;
+    relay_source_t in;
     relay_output_t *outs;
     int out_count;
 
-    // Receive batching
+    // Receive batching: recvmmsg делает ingest, rx_batch - для нового ingest
     int rx_batch;
-    struct mmsghdr *rx_msgs;
-    struct iovec *rx_iov;
-    uint8_t *rx_buffers;
 
     // Transmit batching:
     // Linux sendmmsg() fast-path для типичного TS datagram size=1316 (7*188).
+    // tx_iov[n] - payload n-й датаграммы batch ingest (без RTP заголовка), iov_len=0 - отброшена.
+    // Размер RELAY_RX_BATCH_MAX: batch общего ingest задаёт первый ctx.
     struct mmsghdr *tx_msgs;
     struct iovec *tx_iov;
 
+    // RTP outputs: пара iovec {заголовок, payload} на датаграмму.
+    int rtp_out_count;
+    struct mmsghdr *tx_rtp_msgs;
+    struct iovec *tx_rtp_iov;
+    uint8_t *tx_rtp_hdr;
+
+    // GSO outputs: msghdr на серию из tx_iov (или tx_rtp_iov) и UDP_SEGMENT cmsg.
+    int gso_out_count;
+    struct mmsghdr *tx_gso_msgs;
+    uint8_t *tx_gso_cmsg;
+
+    // RTP input: состояние принадлежит воркеру (под ctx->lock).
+    bool rtp;
+    bool rtp_seq_valid;
+    uint16_t rtp_max_seq;
+    uint32_t rtp_ssrc;
+    // бит seq % RELAY_RTP_MISSING_BITS: номер посчитан в rtp_lost и ещё не пришёл
+    uint64_t rtp_missing[RELAY_RTP_MISSING_BITS / 64];
+
+    // SMPTE 2022-7 merge: legs[i] - leg i + 1, дедупликация по RTP seq вместо rtp_track
+    rtp_merge_t *merge;
+    relay_leg_t *legs;
+    int leg_count;
+
     // TS repacketization (как в udp_output: по 7 TS в датаграмму)
     uint8_t packet[RELAY_UDP_BUFFER_SIZE];
     size_t packet_skip;
 
+    // RFC 4445 MDI основного входа (mdi), до дедупликации копий
+    udp_mdi_t *mdi;
+
+    // TS метрики (ts_meter). pid_count публикуется после заполнения записи.
+    bool ts_meter;
+    int pid_count;
+    uint64_t meter_window_us;
+    uint8_t pid_slot[MAX_PID]; // 0 - PID не в таблице, иначе индекс + 1
+    relay_pid_t pids[RELAY_PID_MAX];
+
+    // HTTP /play (под ctx->lock). Кольцо создаётся первым клиентом и дальше пишется всегда,
+    // чтобы новый клиент сразу получил историю. Датаграмма n лежит в слоте n % play_ring_slots.
+    uint8_t *play_ring;
+    uint16_t *play_ring_size;
+    int play_ring_slots;
+    int play_backlog; // датаграмм истории для нового клиента
+    uint64_t play_head; // записано датаграмм
+    relay_play_client_t **play_clients;
+    int play_clients_slots;
+    int play_clients_active;
+    int play_next_id;
+
+    // Pacing outputs (под ctx->lock): общее кольцо, датаграмма n лежит в слоте n % pace_ring_slots.
+    int pace_out_count;
+    int fec_out_count;
+    bool pace_pcr; // есть output с pace=pcr
+    uint8_t *pace_ring;
+    uint16_t *pace_ring_size;
+    int pace_ring_slots;
+    uint64_t pace_head;
+    uint64_t pace_due_us; // ближайший слот outputs, 0 - нечего отправлять
+    struct mmsghdr *pace_msgs; // RELAY_PACE_BURST_MAX
+    struct iovec *pace_iov; // пара {RTP заголовок, payload} на датаграмму
+    uint8_t *pace_hdr;
+    uint64_t pace_window_us;
+    uint64_t pace_window_bytes;
+    int pace_pcr_pid; // -1 - PCR ещё не найден
+    uint64_t pace_pcr_last;
+    uint64_t pace_pcr_bytes; // от предыдущего PCR пакета
+    uint64_t pace_rate; // bit/s, published
+    uint64_t pace_pcr_rate; // bit/s, published
+
     // Worker assignment
-    int worker_index;
+    int worker_index; // пишет main loop под ctx->lock
     bool worker_least_loaded;
+    relay_ctx_t *engine_next; // g_ctx_list, под g_ingest_mu
+
+    // Балансировщик (main loop)
+    uint64_t balance_sample; // datagrams_in + datagrams_out на прошлом интервале
+    double load_pps;
+    uint64_t balance_moved_run; // runs балансировщика на момент переноса
+    uint64_t migrations;
 
     // Lifetime
     pthread_mutex_t lock;
@@ -113,8 +508,22 @@ struct relay_ctx_t
     uint64_t datagrams_in;
     uint64_t datagrams_out;
     uint64_t send_drops;
+    uint64_t tx_syscalls; // sendmmsg/sendmsg/sendto outputs
+    uint64_t gso_sends; // msghdr с UDP_SEGMENT
+    uint64_t gso_datagrams;
+    uint64_t gso_fallbacks; // outputs, переведённые на sendmmsg без GSO
     uint64_t bad_datagrams;
     uint64_t ok_datagrams;
+    uint64_t rtp_datagrams;
+    uint64_t rtp_lost;
+    uint64_t rtp_gaps;
+    uint64_t rtp_reordered;
+    uint64_t rtp_duplicates;
+    uint64_t rtp_resyncs;
+    uint64_t pid_overflow;
+    uint64_t play_bytes;
+    uint64_t play_skips; // клиент отстал больше кольца: перешёл на live
+    uint64_t play_disconnects;
 };
 
 static bool g_sendmmsg_available = true;
@@ -182,6 +591,228 @@ static void relay_log_send_error(const char *id, relay_output_t *out, const char
     }
 }
 
+/*
+ * RTP
+ */
+
+/* payload offset (CSRC, extension и padding учтены), -1 - не RTP датаграмма */
+static int relay_rtp_payload(const uint8_t *buf, int len, int *payload_len)
+{
+    if(len < RTP_HEADER_SIZE || (buf[0] & 0xC0) != 0x80)
+        return -1;
+
+    int skip = RTP_HEADER_SIZE + (buf[0] & 0x0F) * 4;
+    if(buf[0] & 0x10)
+    {
+        if(len < skip + 4)
+            return -1;
+        skip += 4 + ((buf[skip + 2] << 8) | buf[skip + 3]) * 4;
+    }
+
+    int end = len;
+    if(buf[0] & 0x20)
+        end -= buf[len - 1];
+
+    if(end < skip)
+        return -1;
+
+    *payload_len = end - skip;
+    return skip;
+}
+
+/* rtp_max_seq += delta: пропущенные номера отмечаются в окне, seq - принят */
+static void relay_rtp_advance(relay_ctx_t *ctx, uint16_t seq, uint16_t delta)
+{
+    const unsigned marks = (delta < RELAY_RTP_MISSING_BITS) ? delta : RELAY_RTP_MISSING_BITS;
+    for(unsigned i = marks; i > 0; --i)
+    {
+        const unsigned bit = (uint16_t)(seq - i + 1) % RELAY_RTP_MISSING_BITS;
+        const uint64_t mask = 1ULL << (bit % 64);
+        if(i > 1)
+            ctx->rtp_missing[bit / 64] |= mask;
+        else
+            ctx->rtp_missing[bit / 64] &= ~mask;
+    }
+    ctx->rtp_max_seq = seq;
+}
+
+/* false - дубликат, датаграмма отбрасывается */
+static bool relay_rtp_track(relay_ctx_t *ctx, const uint8_t *buf)
+{
+    const uint16_t seq = (uint16_t)((buf[2] << 8) | buf[3]);
+    const uint32_t ssrc = ((uint32_t)buf[8] << 24) | ((uint32_t)buf[9] << 16)
+                        | ((uint32_t)buf[10] << 8) | (uint32_t)buf[11];
+
+    if(!ctx->rtp_seq_valid || ssrc != ctx->rtp_ssrc)
+    {
+        if(ctx->rtp_seq_valid)
+            __atomic_fetch_add(&ctx->rtp_resyncs, 1, __ATOMIC_RELAXED);
+        ctx->rtp_seq_valid = true;
+        ctx->rtp_ssrc = ssrc;
+        ctx->rtp_max_seq = seq;
+        memset(ctx->rtp_missing, 0, sizeof(ctx->rtp_missing));
+        return true;
+    }
+
+    const uint16_t delta = (uint16_t)(seq - ctx->rtp_max_seq);
+    if(delta == 0)
+    {
+        __atomic_fetch_add(&ctx->rtp_duplicates, 1, __ATOMIC_RELAXED);
+        return false;
+    }
+
+    if(delta < RELAY_RTP_MAX_DROPOUT)
+    {
+        if(delta > 1)
+        {
+            __atomic_fetch_add(&ctx->rtp_lost, (uint64_t)(delta - 1), __ATOMIC_RELAXED);
+            __atomic_fetch_add(&ctx->rtp_gaps, 1, __ATOMIC_RELAXED);
+        }
+        relay_rtp_advance(ctx, seq, delta);
+        return true;
+    }
+
+    if(delta > (uint16_t)(65536 - RELAY_RTP_MAX_MISORDER))
+    {
+        const unsigned bit = seq % RELAY_RTP_MISSING_BITS;
+        const uint64_t mask = 1ULL << (bit % 64);
+        if(!(ctx->rtp_missing[bit / 64] & mask))
+        {
+            // Этот номер уже был принят: дубликат из окна.
+            __atomic_fetch_add(&ctx->rtp_duplicates, 1, __ATOMIC_RELAXED);
+            return false;
+        }
+
+        // Опоздавший пакет: его номер посчитан в rtp_lost при скачке.
+        // Пишет только воркер, поэтому sub без гонки.
+        ctx->rtp_missing[bit / 64] &= ~mask;
+        __atomic_fetch_add(&ctx->rtp_reordered, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_sub(&ctx->rtp_lost, 1, __ATOMIC_RELAXED);
+        return true;
+    }
+
+    __atomic_fetch_add(&ctx->rtp_resyncs, 1, __ATOMIC_RELAXED);
+    ctx->rtp_max_seq = seq;
+    memset(ctx->rtp_missing, 0, sizeof(ctx->rtp_missing));
+    return true;
+}
+
+static uint32_t relay_rtp_clock(void)
+{
+    // 90 kHz (RFC 2250)
+    return (uint32_t)(asc_now_us() * 9 / 100);
+}
+
+static void relay_rtp_header(relay_output_t *out, uint8_t *hdr, uint32_t ts)
+{
+    hdr[0] = 0x80;
+    hdr[1] = RTP_PT_MP2T;
+    hdr[2] = (uint8_t)(out->rtp_seq >> 8);
+    hdr[3] = (uint8_t)(out->rtp_seq);
+    hdr[4] = (uint8_t)(ts >> 24);
+    hdr[5] = (uint8_t)(ts >> 16);
+    hdr[6] = (uint8_t)(ts >> 8);
+    hdr[7] = (uint8_t)(ts);
+    hdr[8] = (uint8_t)(out->rtp_ssrc >> 24);
+    hdr[9] = (uint8_t)(out->rtp_ssrc >> 16);
+    hdr[10] = (uint8_t)(out->rtp_ssrc >> 8);
+    hdr[11] = (uint8_t)(out->rtp_ssrc);
+    ++out->rtp_seq;
+}
+
+/* FEC датаграммы RTP выхода: считается и по не ушедшим, их может восстановить приёмник */
+static void relay_output_fec(relay_output_t *out, const uint8_t *hdr, const uint8_t *payload, size_t size)
+{
+    const int count = rtp_fec_encode(out->fec, hdr, payload, size);
+    for(int k = 0; k < count; ++k)
+    {
+        const rtp_fec_packet_t *const p = &out->fec->out[k];
+        if(sendto(asc_socket_fd(out->sock), p->data, p->size, MSG_DONTWAIT
+                  , (const struct sockaddr *)&out->fec_sa[p->kind], sizeof(out->fec_sa[p->kind])) < 0)
+        {
+            __atomic_fetch_add(&out->fec_send_errors, 1, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+static ssize_t relay_output_send(relay_output_t *out, const uint8_t *data, size_t size)
+{
+    if(!out->rtp)
+        return asc_socket_sendto(out->sock, data, size);
+
+    uint8_t hdr[RTP_HEADER_SIZE];
+    relay_rtp_header(out, hdr, relay_rtp_clock());
+    if(out->fec)
+        relay_output_fec(out, hdr, data, size);
+
+    struct iovec iov[2];
+    iov[0].iov_base = hdr;
+    iov[0].iov_len = sizeof(hdr);
+    iov[1].iov_base = (void *)data;
+    iov[1].iov_len = size;
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name = (void *)&out->dst_sa;
+    msg.msg_namelen = out->dst_sa_len;
+    msg.msg_iov = iov;
+    msg.msg_iovlen = 2;
+    return sendmsg(asc_socket_fd(out->sock), &msg, 0);
+}
+
+/*
+ * Send
+ */
+
+/*
+ * GSO: count датаграмм одного размера сериями до udp_gso_segments() в msghdr с UDP_SEGMENT,
+ * один sendmmsg на batch. Возвращает отправленные датаграммы или -1 (errno).
+ * Путь без GSO (udp_gso_unsupported) - out->gso сбрасывается, batch отправит вызывающий.
+ */
+static int relay_send_gso(relay_ctx_t *ctx, relay_output_t *out, int count, size_t out_size)
+{
+    struct iovec *iov = out->rtp ? ctx->tx_rtp_iov : ctx->tx_iov;
+    const int iov_per = out->rtp ? 2 : 1;
+    const int max = udp_gso_segments(out_size);
+
+    int runs = 0;
+    for(int n = 0; n < count; n += max, ++runs)
+    {
+        const int k = (count - n < max) ? count - n : max;
+        struct msghdr *hdr = &ctx->tx_gso_msgs[runs].msg_hdr;
+        hdr->msg_name = (void *)&out->dst_sa;
+        hdr->msg_namelen = out->dst_sa_len;
+        hdr->msg_iov = &iov[n * iov_per];
+        hdr->msg_iovlen = (size_t)(k * iov_per);
+        udp_gso_set(hdr, &ctx->tx_gso_cmsg[(size_t)runs * UDP_GSO_CMSG_SIZE], (uint16_t)out_size);
+    }
+
+    const int sent = sendmmsg(asc_socket_fd(out->sock), ctx->tx_gso_msgs, (unsigned int)runs, 0);
+    __atomic_fetch_add(&ctx->tx_syscalls, 1, __ATOMIC_RELAXED);
+    if(sent < 0)
+    {
+        const int err = errno;
+        if(udp_gso_unsupported(err))
+        {
+            __atomic_store_n(&out->gso, false, __ATOMIC_RELAXED);
+            __atomic_fetch_add(&ctx->gso_fallbacks, 1, __ATOMIC_RELAXED);
+            asc_log_warning("%s[%s] GSO send failed: dst=%s:%d [%s]; sending without GSO",
+                RELAY_MSG_PREFIX, ctx->id ? ctx->id : "stream",
+                out->dst_addr ? out->dst_addr : "?", out->dst_port,
+                asc_socket_error());
+        }
+        errno = err;
+        return -1;
+    }
+
+    int datagrams = 0;
+    for(int r = 0; r < sent; ++r)
+        datagrams += (int)ctx->tx_gso_msgs[r].msg_hdr.msg_iovlen / iov_per;
+    __atomic_fetch_add(&ctx->gso_sends, (uint64_t)sent, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&ctx->gso_datagrams, (uint64_t)datagrams, __ATOMIC_RELAXED);
+    return datagrams;
+}
+
 static void relay_send_to_outputs_mmsg(relay_ctx_t *ctx, int count)
 {
     if(!ctx || count <= 0)
@@ -191,35 +822,60 @@ static void relay_send_to_outputs_mmsg(relay_ctx_t *ctx, int count)
     {
         // Fallback: старый путь sendto.
         for(int n = 0; n < count; ++n)
-        {
-            const uint8_t *buf = (const uint8_t *)ctx->rx_buffers + ((size_t)n * RELAY_UDP_BUFFER_SIZE);
-            relay_send_to_outputs(ctx, buf, (size_t)(TS_PACKET_SIZE * 7));
-        }
+            relay_send_to_outputs(ctx, (const uint8_t *)ctx->tx_iov[n].iov_base, ctx->tx_iov[n].iov_len);
         return;
     }
 
     // Условия этого fast-path гарантируют, что у всех msg одинаковый размер 1316.
     const size_t msg_size = (size_t)(TS_PACKET_SIZE * 7);
 
+    // RTP outputs: payload тот же, заголовки у каждого выхода свои.
+    const uint32_t rtp_ts = (ctx->rtp_out_count > 0) ? relay_rtp_clock() : 0;
+    if(ctx->rtp_out_count > 0)
+    {
+        for(int n = 0; n < count; ++n)
+            ctx->tx_rtp_iov[n * 2 + 1] = ctx->tx_iov[n];
+    }
+
     for(int i = 0; i < ctx->out_count; ++i)
     {
         relay_output_t *out = &ctx->outs[i];
-        if(!out->sock)
+        if(!out->sock || out->pace)
             continue;
 
-        // Подставляем destination sockaddr в каждый mmsghdr. Это дешевле, чем sendto() на каждый датаграмм.
-        for(int n = 0; n < count; ++n)
+        struct mmsghdr *msgs = ctx->tx_msgs;
+        size_t out_size = msg_size;
+        if(out->rtp)
         {
-            ctx->tx_msgs[n].msg_hdr.msg_name = (void *)&out->dst_sa;
-            ctx->tx_msgs[n].msg_hdr.msg_namelen = out->dst_sa_len;
+            msgs = ctx->tx_rtp_msgs;
+            out_size += RTP_HEADER_SIZE;
+            for(int n = 0; n < count; ++n)
+                relay_rtp_header(out, &ctx->tx_rtp_hdr[n * RTP_HEADER_SIZE], rtp_ts);
+            for(int n = 0; out->fec && n < count; ++n)
+                relay_output_fec(out, &ctx->tx_rtp_hdr[n * RTP_HEADER_SIZE]
+                                 , (const uint8_t *)ctx->tx_iov[n].iov_base, ctx->tx_iov[n].iov_len);
         }
 
         errno = 0;
-        const int fd = asc_socket_fd(out->sock);
-        const int sent = sendmmsg(fd, ctx->tx_msgs, (unsigned int)count, 0);
+        int sent = -1;
+        if(out->gso)
+            sent = relay_send_gso(ctx, out, count, out_size);
+        if(!out->gso && sent < 0)
+        {
+            // Подставляем destination sockaddr в каждый mmsghdr. Это дешевле, чем sendto() на каждый датаграмм.
+            for(int n = 0; n < count; ++n)
+            {
+                msgs[n].msg_hdr.msg_name = (void *)&out->dst_sa;
+                msgs[n].msg_hdr.msg_namelen = out->dst_sa_len;
+            }
+
+            errno = 0;
+            sent = sendmmsg(asc_socket_fd(out->sock), msgs, (unsigned int)count, 0);
+            __atomic_fetch_add(&ctx->tx_syscalls, 1, __ATOMIC_RELAXED);
+        }
         if(sent > 0)
         {
-            __atomic_fetch_add(&ctx->bytes_out, (uint64_t)msg_size * (uint64_t)sent, __ATOMIC_RELAXED);
+            __atomic_fetch_add(&ctx->bytes_out, (uint64_t)out_size * (uint64_t)sent, __ATOMIC_RELAXED);
             __atomic_fetch_add(&ctx->datagrams_out, (uint64_t)sent, __ATOMIC_RELAXED);
         }
 
@@ -238,10 +894,7 @@ static void relay_send_to_outputs_mmsg(relay_ctx_t *ctx, int count)
             asc_log_warning("%s sendmmsg() not supported by kernel; falling back to sendto()", RELAY_MSG_PREFIX);
 
             for(int n = 0; n < count; ++n)
-            {
-                const uint8_t *buf = (const uint8_t *)ctx->rx_buffers + ((size_t)n * RELAY_UDP_BUFFER_SIZE);
-                relay_send_to_outputs(ctx, buf, msg_size);
-            }
+                relay_send_to_outputs(ctx, (const uint8_t *)ctx->tx_iov[n].iov_base, msg_size);
             continue;
         }
 
@@ -254,12 +907,14 @@ static void relay_send_to_outputs(relay_ctx_t *ctx, const uint8_t *data, size_t
     for(int i = 0; i < ctx->out_count; ++i)
     {
         relay_output_t *out = &ctx->outs[i];
-        if(!out->sock)
+        if(!out->sock || out->pace)
             continue;
 
-        if(asc_socket_sendto(out->sock, data, size) != -1)
+        __atomic_fetch_add(&ctx->tx_syscalls, 1, __ATOMIC_RELAXED);
+        if(relay_output_send(out, data, size) != -1)
         {
-            __atomic_fetch_add(&ctx->bytes_out, (uint64_t)size, __ATOMIC_RELAXED);
+            const size_t out_size = out->rtp ? size + RTP_HEADER_SIZE : size;
+            __atomic_fetch_add(&ctx->bytes_out, (uint64_t)out_size, __ATOMIC_RELAXED);
             __atomic_fetch_add(&ctx->datagrams_out, 1, __ATOMIC_RELAXED);
             continue;
         }
@@ -271,379 +926,1961 @@ static void relay_send_to_outputs(relay_ctx_t *ctx, const uint8_t *data, size_t
     }
 }
 
-static void relay_process_datagram(relay_ctx_t *ctx, const uint8_t *buf, int len, uint64_t now_us)
+
+/*
+ * Pacing
+ *
+ * recvmmsg batch уходит в paced output не одним всплеском, а слотами по pace_burst
+ * датаграмм (один sendmmsg на слот) со скоростью входа. Слоты планирует timerfd воркера.
+ */
+
+static void relay_pace_send(relay_ctx_t *ctx, relay_output_t *out, int count)
 {
-    if(len < (int)TS_PACKET_SIZE)
+    while(count > 0)
     {
-        __atomic_fetch_add(&ctx->bad_datagrams, 1, __ATOMIC_RELAXED);
-        return;
-    }
+        const int n = (count > RELAY_PACE_BURST_MAX) ? RELAY_PACE_BURST_MAX : count;
+        const uint32_t rtp_ts = out->rtp ? relay_rtp_clock() : 0;
+        for(int k = 0; k < n; ++k)
+        {
+            const int slot = (int)((out->pace_cursor + (uint64_t)k) % (uint64_t)ctx->pace_ring_slots);
+            struct iovec *iov = &ctx->pace_iov[k * 2];
+            struct msghdr *hdr = &ctx->pace_msgs[k].msg_hdr;
+            iov[1].iov_base = &ctx->pace_ring[(size_t)slot * RELAY_UDP_BUFFER_SIZE];
+            iov[1].iov_len = ctx->pace_ring_size[slot];
+            if(out->rtp)
+            {
+                relay_rtp_header(out, &ctx->pace_hdr[k * RTP_HEADER_SIZE], rtp_ts);
+                if(out->fec && out->sock)
+                    relay_output_fec(out, &ctx->pace_hdr[k * RTP_HEADER_SIZE]
+                                     , (const uint8_t *)iov[1].iov_base, iov[1].iov_len);
+                hdr->msg_iov = iov;
+                hdr->msg_iovlen = 2;
+            }
+            else
+            {
+                hdr->msg_iov = &iov[1];
+                hdr->msg_iovlen = 1;
+            }
+            hdr->msg_name = (void *)&out->dst_sa;
+            hdr->msg_namelen = out->dst_sa_len;
+        }
+        out->pace_cursor += (uint64_t)n;
+        count -= n;
+        if(!out->sock)
+            continue;
 
-    // Ожидаем ровный TS (без RTP) и размер кратный 188.
-    if((len % TS_PACKET_SIZE) != 0)
-    {
-        __atomic_fetch_add(&ctx->bad_datagrams, 1, __ATOMIC_RELAXED);
-        return;
-    }
+        errno = 0;
+        const int fd = asc_socket_fd(out->sock);
+        int sent = 0;
+        if(g_sendmmsg_available)
+        {
+            sent = sendmmsg(fd, ctx->pace_msgs, (unsigned int)n, 0);
+            __atomic_fetch_add(&ctx->tx_syscalls, 1, __ATOMIC_RELAXED);
+        }
+        else
+        {
+            while(sent < n && sendmsg(fd, &ctx->pace_msgs[sent].msg_hdr, 0) != -1)
+                ++sent;
+            __atomic_fetch_add(&ctx->tx_syscalls, (uint64_t)((sent < n) ? sent + 1 : sent), __ATOMIC_RELAXED);
+            if(sent == 0)
+                sent = -1;
+        }
 
-    // Проверяем sync byte на каждой границе 188, чтобы не пропускать мусор/не-T S в dataplane.
-    // Это важно для устойчивости: watchdog может корректно уйти в legacy pipeline.
-    if(!relay_ts_sync_ok(buf, len))
-    {
-        __atomic_fetch_add(&ctx->bad_datagrams, 1, __ATOMIC_RELAXED);
-        return;
-    }
+        if(sent > 0)
+        {
+            uint64_t bytes = 0;
+            for(int k = 0; k < sent; ++k)
+                bytes += ctx->pace_iov[k * 2 + 1].iov_len + (out->rtp ? RTP_HEADER_SIZE : 0);
+            __atomic_fetch_add(&ctx->bytes_out, bytes, __ATOMIC_RELAXED);
+            __atomic_fetch_add(&ctx->datagrams_out, (uint64_t)sent, __ATOMIC_RELAXED);
+        }
+        __atomic_fetch_add(&out->pace_sends, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&out->pace_datagrams, (uint64_t)n, __ATOMIC_RELAXED);
+        __atomic_store_n(&out->pace_burst_last, (uint32_t)n, __ATOMIC_RELAXED);
+        if((uint32_t)n > out->pace_burst_max)
+            __atomic_store_n(&out->pace_burst_max, (uint32_t)n, __ATOMIC_RELAXED);
 
-    __atomic_fetch_add(&ctx->ok_datagrams, 1, __ATOMIC_RELAXED);
-    __atomic_store_n(&ctx->last_ok_us, now_us, __ATOMIC_RELAXED);
+        if(sent == n)
+            continue;
 
-    // Fast path: большинство UDP multicast TS приходят уже как 7*188 (1316).
-    // Если буфер выровнен и у нас нет накопленного хвоста - можно отправить datagram как есть,
-    // избегая memcpy на каждый TS пакет.
-    if(ctx->packet_skip == 0 && len == (int)(TS_PACKET_SIZE * 7))
-    {
-        relay_send_to_outputs(ctx, buf, (size_t)len);
-        return;
+        const int err = (sent < 0) ? errno : EAGAIN;
+        const int dropped = (sent < 0) ? n : (n - sent);
+        __atomic_fetch_add(&ctx->send_drops, (uint64_t)dropped, __ATOMIC_RELAXED);
+        if(err == ENOSYS)
+        {
+            g_sendmmsg_available = false;
+            asc_log_warning("%s sendmmsg() not supported by kernel; falling back to sendto()", RELAY_MSG_PREFIX);
+            continue;
+        }
+        relay_log_send_error(ctx->id, out, out->dst_addr, out->dst_port, err, (uint64_t)dropped);
     }
+}
 
-    int i = 0;
-    for(; i <= len - (int)TS_PACKET_SIZE; i += TS_PACKET_SIZE)
+/* скорость потока по PCR: байт между PCR пакетами одного PID */
+static void relay_pace_pcr(relay_ctx_t *ctx, const uint8_t *data, size_t size)
+{
+    for(size_t i = 0; i + TS_PACKET_SIZE <= size; i += TS_PACKET_SIZE)
     {
-        memcpy(&ctx->packet[ctx->packet_skip], &buf[i], TS_PACKET_SIZE);
-        ctx->packet_skip += TS_PACKET_SIZE;
+        const uint8_t *ts = &data[i];
+        ctx->pace_pcr_bytes += TS_PACKET_SIZE;
+        if(!TS_IS_PCR(ts))
+            continue;
 
-        if(ctx->packet_skip > RELAY_UDP_BUFFER_SIZE - TS_PACKET_SIZE)
+        const int pid = TS_GET_PID(ts);
+        if(ctx->pace_pcr_pid < 0)
+            ctx->pace_pcr_pid = pid;
+        else if(pid != ctx->pace_pcr_pid)
+            continue;
+
+        // PCR 27 MHz, base 33 бит. Первый PCR (last=0), разрыв или скачок назад - начинаем заново
+        const uint64_t pcr = TS_GET_PCR(ts);
+        const uint64_t pcr_max = ((uint64_t)1 << 33) * 300;
+        const uint64_t delta = (pcr + pcr_max - ctx->pace_pcr_last) % pcr_max;
+        if(ctx->pace_pcr_last != 0 && delta > 0 && delta / 27 <= RELAY_PCR_GAP_US)
         {
-            relay_send_to_outputs(ctx, ctx->packet, ctx->packet_skip);
-            ctx->packet_skip = 0;
+            const uint64_t rate = ctx->pace_pcr_bytes * 8 * 27000000 / delta;
+            const uint64_t prev = ctx->pace_pcr_rate;
+            __atomic_store_n(&ctx->pace_pcr_rate, prev ? (prev * 3 + rate) / 4 : rate, __ATOMIC_RELAXED);
         }
+        ctx->pace_pcr_last = pcr;
+        ctx->pace_pcr_bytes = 0;
     }
 }
 
-static void relay_ctx_on_read(relay_ctx_t *ctx)
+static void relay_pace_push(relay_ctx_t *ctx, const uint8_t *data, size_t size)
 {
-    // Блокируем контекст, чтобы destroy мог безопасно дождаться окончания обработки.
-    pthread_mutex_lock(&ctx->lock);
-    if(ctx->closing)
+    const uint64_t now_us = asc_now_us();
+    if(ctx->pace_window_us == 0)
+        ctx->pace_window_us = now_us;
+    else if(now_us >= ctx->pace_window_us + RELAY_PACE_WINDOW_US)
     {
-        pthread_mutex_unlock(&ctx->lock);
-        return;
+        const uint64_t rate = ctx->pace_window_bytes * 8 * 1000000 / (now_us - ctx->pace_window_us);
+        const uint64_t prev = ctx->pace_rate;
+        __atomic_store_n(&ctx->pace_rate, prev ? (prev * 3 + rate) / 4 : rate, __ATOMIC_RELAXED);
+        ctx->pace_window_bytes = 0;
+        ctx->pace_window_us = now_us;
     }
+    ctx->pace_window_bytes += size;
+
+    if(ctx->pace_pcr)
+        relay_pace_pcr(ctx, data, size);
 
-    int loops = 0;
-    for(; loops < RELAY_READ_BUDGET_LOOPS; ++loops)
+    // очередь output заполнена: слот уходит сразу, без ожидания
+    for(int i = 0; i < ctx->out_count; ++i)
     {
-        errno = 0;
-        const int r = recvmmsg(ctx->in_fd, ctx->rx_msgs, (unsigned int)ctx->rx_batch, MSG_DONTWAIT, NULL);
-        if(r <= 0)
+        relay_output_t *out = &ctx->outs[i];
+        if(out->pace && ctx->pace_head - out->pace_cursor >= (uint64_t)out->pace_queue)
         {
-            if(r == 0 || errno == EAGAIN || errno == EWOULDBLOCK)
-                break;
-            // read error: считаем вход мёртвым, но не падаем процессом.
-            __atomic_fetch_add(&ctx->bad_datagrams, 1, __ATOMIC_RELAXED);
-            break;
+            relay_pace_send(ctx, out, out->pace_burst);
+            __atomic_fetch_add(&out->pace_overflows, (uint64_t)out->pace_burst, __ATOMIC_RELAXED);
         }
+    }
 
-        const uint64_t now_us = asc_utime();
-        __atomic_store_n(&ctx->last_rx_us, now_us, __ATOMIC_RELAXED);
-
-        // Super fast-path:
-        // типичный TS multicast уже приходит как 1316 bytes (7*188). Если у нас нет хвоста,
-        // то можно отправить весь batch через sendmmsg(), снизив число syscalls в ~count раз.
-        if(ctx->packet_skip == 0 && r >= 2)
-        {
-            bool can_batch = true;
-            uint64_t in_bytes = 0;
-            for(int n = 0; n < r; ++n)
-            {
-                const int len = (int)ctx->rx_msgs[n].msg_len;
-                if(len != (int)(TS_PACKET_SIZE * 7))
-                {
-                    can_batch = false;
-                    break;
-                }
-                const uint8_t *buf = (const uint8_t *)ctx->rx_iov[n].iov_base;
-                if(!relay_ts_sync_ok(buf, len))
-                {
-                    can_batch = false;
-                    break;
-                }
-                in_bytes += (uint64_t)len;
-            }
+    const int slot = (int)(ctx->pace_head % (uint64_t)ctx->pace_ring_slots);
+    memcpy(&ctx->pace_ring[(size_t)slot * RELAY_UDP_BUFFER_SIZE], data, size);
+    ctx->pace_ring_size[slot] = (uint16_t)size;
+    ++ctx->pace_head;
 
-            if(can_batch)
-            {
-                __atomic_fetch_add(&ctx->bytes_in, in_bytes, __ATOMIC_RELAXED);
-                __atomic_fetch_add(&ctx->datagrams_in, (uint64_t)r, __ATOMIC_RELAXED);
-                __atomic_fetch_add(&ctx->ok_datagrams, (uint64_t)r, __ATOMIC_RELAXED);
-                __atomic_store_n(&ctx->last_ok_us, now_us, __ATOMIC_RELAXED);
+    for(int i = 0; i < ctx->out_count; ++i)
+    {
+        relay_output_t *out = &ctx->outs[i];
+        if(!out->pace)
+            continue;
+        const uint32_t depth = (uint32_t)(ctx->pace_head - out->pace_cursor);
+        __atomic_store_n(&out->pace_depth, depth, __ATOMIC_RELAXED);
+        if(depth > out->pace_depth_max)
+            __atomic_store_n(&out->pace_depth_max, depth, __ATOMIC_RELAXED);
+    }
+}
 
-                relay_send_to_outputs_mmsg(ctx, r);
+/* слот output: отправляет, на сколько хватает кредита. Время следующего слота, 0 - очередь пуста */
+static uint64_t relay_pace_output(relay_ctx_t *ctx, relay_output_t *out, uint64_t now_us)
+{
+    const uint64_t queued = ctx->pace_head - out->pace_cursor;
+    const uint64_t limit = (uint64_t)out->pace_queue;
+    uint64_t rate = (out->pace == RELAY_PACE_PCR && ctx->pace_pcr_rate) ? ctx->pace_pcr_rate : ctx->pace_rate;
+    // очередь растёт: оценка отстала от входа, догоняем (до +50%)
+    if(queued > limit / 2)
+        rate += rate * (queued - limit / 2) / limit;
+
+    uint64_t elapsed = (out->pace_last_us != 0 && now_us > out->pace_last_us) ? now_us - out->pace_last_us : 0;
+    if(elapsed > 1000000)
+        elapsed = 1000000;
+    out->pace_last_us = now_us;
+
+    // скорость ещё не известна: без пейсинга
+    uint64_t count = queued;
+    uint64_t slot_bytes = 0;
+    if(rate > 0)
+    {
+        slot_bytes = (uint64_t)out->pace_burst * RELAY_PLAY_DATAGRAM_SIZE;
+        const uint64_t min_bytes = rate * RELAY_PACE_SLOT_MIN_US / 8000000;
+        if(slot_bytes < min_bytes)
+            slot_bytes = min_bytes;
 
-                if(r < ctx->rx_batch)
-                    break;
-                continue;
-            }
-        }
+        out->pace_credit += elapsed * rate / 8000000;
+        if(out->pace_credit > slot_bytes * 2)
+            out->pace_credit = slot_bytes * 2;
 
-        for(int n = 0; n < r; ++n)
+        count = 0;
+        while(count < queued)
         {
-            const int len = (int)ctx->rx_msgs[n].msg_len;
-            const uint8_t *buf = (const uint8_t *)ctx->rx_iov[n].iov_base;
-            if(len <= 0)
-                continue;
-
-            __atomic_fetch_add(&ctx->bytes_in, (uint64_t)len, __ATOMIC_RELAXED);
-            __atomic_fetch_add(&ctx->datagrams_in, 1, __ATOMIC_RELAXED);
-
-            relay_process_datagram(ctx, buf, len, now_us);
+            const int slot = (int)((out->pace_cursor + count) % (uint64_t)ctx->pace_ring_slots);
+            const uint64_t size = ctx->pace_ring_size[slot];
+            if(out->pace_credit < size)
+                break;
+            out->pace_credit -= size;
+            ++count;
         }
-
-        if(r < ctx->rx_batch)
-            break;
     }
 
-    pthread_mutex_unlock(&ctx->lock);
+    if(count > 0)
+        relay_pace_send(ctx, out, (int)count);
+
+    const uint64_t left = queued - count;
+    __atomic_store_n(&out->pace_depth, (uint32_t)left, __ATOMIC_RELAXED);
+    if(left == 0)
+        return 0;
+
+    uint64_t need = left * RELAY_PLAY_DATAGRAM_SIZE;
+    if(need > slot_bytes)
+        need = slot_bytes;
+    uint64_t wait_us = (need > out->pace_credit) ? (need - out->pace_credit) * 8000000 / rate : 0;
+    if(wait_us < RELAY_PACE_SLOT_MIN_US)
+        wait_us = RELAY_PACE_SLOT_MIN_US;
+    return now_us + wait_us;
 }
 
-static void *relay_worker_loop(void *arg)
+/* ctx->lock захвачен. Ближайший слот ctx, 0 - нечего отправлять */
+static uint64_t relay_pace_run(relay_ctx_t *ctx, uint64_t now_us)
 {
-    relay_worker_t *w = (relay_worker_t *)arg;
-    struct epoll_event events[RELAY_MAX_EVENTS];
-
-    for(;;)
+    uint64_t due_us = 0;
+    for(int i = 0; i < ctx->out_count; ++i)
     {
-        const int n = epoll_wait(w->epoll_fd, events, RELAY_MAX_EVENTS, -1);
-        if(n < 0)
-        {
-            if(errno == EINTR)
-                continue;
-            asc_usleep(1000);
+        relay_output_t *out = &ctx->outs[i];
+        if(!out->pace)
             continue;
-        }
-
-        for(int i = 0; i < n; ++i)
+        if(ctx->pace_head == out->pace_cursor)
         {
-            relay_ctx_t *ctx = (relay_ctx_t *)events[i].data.ptr;
-            if(!ctx)
-                continue;
-
-            __atomic_fetch_add(&ctx->refcount, 1, __ATOMIC_RELAXED);
-            relay_ctx_on_read(ctx);
-            __atomic_fetch_sub(&ctx->refcount, 1, __ATOMIC_RELAXED);
+            out->pace_due_us = 0;
+            continue;
         }
+        if(out->pace_due_us == 0 || out->pace_due_us <= now_us)
+            out->pace_due_us = relay_pace_output(ctx, out, now_us);
+        if(out->pace_due_us != 0 && (due_us == 0 || out->pace_due_us < due_us))
+            due_us = out->pace_due_us;
     }
-
-    return NULL;
+    ctx->pace_due_us = due_us;
+    return due_us;
 }
 
-static int clamp_int(int value, int min_value, int max_value)
+/* только воркер: взводит timerfd, если слот раньше уже взведённого */
+static void relay_pace_arm(relay_worker_t *w, uint64_t due_us, uint64_t now_us)
 {
-    if(value < min_value)
-        return min_value;
-    if(value > max_value)
-        return max_value;
-    return value;
+    if(due_us == 0 || (w->pace_armed_us != 0 && w->pace_armed_us <= due_us))
+        return;
+
+    const uint64_t delay_us = (due_us > now_us) ? due_us - now_us : 1;
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_sec = (time_t)(delay_us / 1000000);
+    its.it_value.tv_nsec = (long)((delay_us % 1000000) * 1000);
+    if(timerfd_settime(w->pace_fd, 0, &its, NULL) == 0)
+        w->pace_armed_us = due_us;
 }
 
-static int detect_default_workers(void)
+/* любой поток: воркер проснётся таймером пейсинга и перевзведёт его по своим ctx */
+static void relay_worker_wake(relay_worker_t *w)
 {
-    long n = sysconf(_SC_NPROCESSORS_ONLN);
-    if(n < 1)
-        return 1;
-    // Оставляем 1 ядро под control plane (Lua/UI/HTTP), остальное под data plane.
-    if(n > 1)
-        n = n - 1;
-    if(n > 32)
-        n = 32;
-    return (int)n;
+    if(w->pace_fd < 0)
+        return;
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_nsec = 1;
+    timerfd_settime(w->pace_fd, 0, &its, NULL);
 }
 
-static int detect_allowed_cpus(int *out, int out_cap)
+static void relay_pace_on_timer(relay_worker_t *w)
 {
-    if(!out || out_cap <= 0)
-        return 0;
+    // EAGAIN: уже прочитан, результат не нужен
+    uint64_t expirations = 0;
+    const ssize_t r = read(w->pace_fd, &expirations, sizeof(expirations));
+    __uarg(r);
+    w->pace_armed_us = 0;
 
-    cpu_set_t set;
-    CPU_ZERO(&set);
-    if(sched_getaffinity(0, sizeof(set), &set) != 0)
-        return 0;
+    const uint64_t now_us = asc_now_us();
+    uint64_t next_us = 0;
 
-    int n = 0;
-    for(int cpu = 0; cpu < CPU_SETSIZE && n < out_cap; ++cpu)
+    pthread_mutex_lock(&w->pace_mu);
+    for(int i = 0; i < w->pace_count; ++i)
     {
-        if(CPU_ISSET(cpu, &set))
-            out[n++] = cpu;
+        relay_ctx_t *ctx = w->pace_list[i];
+        pthread_mutex_lock(&ctx->lock);
+        uint64_t due_us = ctx->closing ? 0 : ctx->pace_due_us;
+        if(due_us != 0 && due_us <= now_us)
+            due_us = relay_pace_run(ctx, now_us);
+        pthread_mutex_unlock(&ctx->lock);
+        if(due_us != 0 && (next_us == 0 || due_us < next_us))
+            next_us = due_us;
     }
-    return n;
+    pthread_mutex_unlock(&w->pace_mu);
+
+    relay_pace_arm(w, next_us, now_us);
 }
 
-static int maybe_pin_thread(pthread_t thread, int worker_index, bool enable_affinity, int workers_count)
-{
-    if(!enable_affinity)
-        return -1;
+/*
+ * TS metering
+ */
 
-    // Учитываем ограничения контейнера/cpuset: берём список разрешённых CPU.
-    int allowed[CPU_SETSIZE];
-    const int allowed_n = detect_allowed_cpus(allowed, (int)(sizeof(allowed) / sizeof(allowed[0])));
-    if(allowed_n <= 1)
-        return -1;
+static relay_pid_t *relay_meter_pid(relay_ctx_t *ctx, uint16_t pid)
+{
+    const uint8_t slot = ctx->pid_slot[pid];
+    if(slot)
+        return &ctx->pids[slot - 1];
 
-    // По умолчанию стараемся не трогать первый CPU из allowed списка, оставляя его под control plane.
-    // Но если воркеров >= доступных CPU, то используем весь список (иначе получим коллизию и 100% одного ядра).
-    int start = 0;
-    int target_n = allowed_n;
-    if(allowed_n > 1 && workers_count <= (allowed_n - 1))
+    const int count = ctx->pid_count;
+    if(count >= RELAY_PID_MAX)
     {
-        start = 1;
-        target_n = allowed_n - 1;
+        __atomic_fetch_add(&ctx->pid_overflow, 1, __ATOMIC_RELAXED);
+        return NULL;
     }
-    if(target_n <= 0)
-        return -1;
-    const int cpu = allowed[start + (worker_index % target_n)];
 
-    cpu_set_t mask;
-    CPU_ZERO(&mask);
-    CPU_SET(cpu, &mask);
+    relay_pid_t *p = &ctx->pids[count];
+    memset(p, 0, sizeof(*p));
+    p->pid = pid;
+    ctx->pid_slot[pid] = (uint8_t)(count + 1);
+    // stats видит запись только заполненной
+    __atomic_store_n(&ctx->pid_count, count + 1, __ATOMIC_RELEASE);
+    return p;
+}
 
-    const int rc = pthread_setaffinity_np(thread, sizeof(mask), &mask);
-    if(rc != 0)
+/* PMT PID из PAT (секция в одном пакете, как у SPTS) */
+static void relay_meter_pat(relay_ctx_t *ctx, const uint8_t *ts)
+{
+    const uint8_t *payload = TS_GET_PAYLOAD(ts);
+    if(!payload)
+        return;
+
+    const uint8_t *const end = ts + TS_PACKET_SIZE;
+    const uint8_t *psi = payload + 1 + payload[0]; // pointer_field
+    if(psi + 8 > end || psi[0] != 0x00)
+        return;
+
+    const int section_length = ((psi[1] & 0x0F) << 8) | psi[2];
+    const uint8_t *items_end = psi + 3 + section_length - 4; // без CRC
+    if(items_end > end)
+        items_end = end;
+
+    for(const uint8_t *item = psi + 8; item + 4 <= items_end; item += 4)
     {
-        // Не критично: продолжаем работать без affinity.
-        asc_log_warning("%s worker[%d/%d] setaffinity(cpu=%d) failed: %s",
-            RELAY_MSG_PREFIX, worker_index, workers_count, cpu, strerror(rc));
-        return -1;
+        const uint16_t pnr = (uint16_t)((item[0] << 8) | item[1]);
+        if(pnr == 0)
+            continue; // NIT
+        relay_pid_t *p = relay_meter_pid(ctx, (uint16_t)(((item[2] & 0x1F) << 8) | item[3]));
+        if(p && !p->pmt)
+            __atomic_store_n(&p->pmt, 1, __ATOMIC_RELAXED);
     }
-
-    return cpu;
 }
 
-static bool engine_ensure_started(int requested_workers, bool affinity)
+static void relay_meter_pcr(relay_pid_t *p, const uint8_t *ts, uint64_t now_us)
 {
-    pthread_mutex_lock(&g_engine.mu);
-    if(g_engine.started)
+    const uint64_t pcr = TS_GET_PCR(ts);
+    __atomic_store_n(&p->pcr_count, p->pcr_count + 1, __ATOMIC_RELAXED);
+
+    if(p->last_pcr_us != 0)
     {
-        pthread_mutex_unlock(&g_engine.mu);
-        return true;
+        // PCR 27 MHz, base 33 бит
+        const uint64_t pcr_max = ((uint64_t)1 << 33) * 300;
+        const uint64_t delta_us = ((pcr + pcr_max - p->last_pcr) % pcr_max) / 27;
+        if(delta_us <= RELAY_PCR_GAP_US)
+        {
+            const uint64_t arrival_us = now_us - p->last_pcr_us;
+            const uint32_t jitter = (uint32_t)((arrival_us > delta_us) ? arrival_us - delta_us : delta_us - arrival_us);
+
+            __atomic_store_n(&p->pcr_interval_us, (uint32_t)delta_us, __ATOMIC_RELAXED);
+            if((uint32_t)delta_us > p->pcr_interval_max_us)
+                __atomic_store_n(&p->pcr_interval_max_us, (uint32_t)delta_us, __ATOMIC_RELAXED);
+            if(jitter > p->pcr_jitter_max_us)
+                __atomic_store_n(&p->pcr_jitter_max_us, jitter, __ATOMIC_RELAXED);
+        }
     }
 
-    int requested = requested_workers;
-    if(requested <= 0)
-        requested = detect_default_workers();
-    requested = clamp_int(requested, 1, 64);
+    p->last_pcr = pcr;
+    p->last_pcr_us = now_us;
+}
 
-    g_engine.workers = (relay_worker_t *)calloc((size_t)requested, sizeof(relay_worker_t));
-    if(!g_engine.workers)
+static void relay_meter_window(relay_ctx_t *ctx, uint64_t now_us)
+{
+    const uint64_t elapsed = now_us - ctx->meter_window_us;
+    const int count = ctx->pid_count;
+    for(int i = 0; i < count; ++i)
     {
-        pthread_mutex_unlock(&g_engine.mu);
-        return false;
+        relay_pid_t *p = &ctx->pids[i];
+        const uint64_t bits = (p->packets - p->window_packets) * TS_PACKET_SIZE * 8;
+        __atomic_store_n(&p->bitrate, (uint32_t)(bits * 1000000 / elapsed), __ATOMIC_RELAXED);
+        p->window_packets = p->packets;
     }
+    ctx->meter_window_us = now_us;
+}
 
-    g_engine.affinity = affinity;
-    int started = 0;
-    for(int i = 0; i < requested; ++i)
+/* buf - проверенный TS (sync на каждой границе 188) */
+static void relay_meter(relay_ctx_t *ctx, const uint8_t *buf, int len, uint64_t now_us)
+{
+    if(ctx->meter_window_us == 0)
+        ctx->meter_window_us = now_us;
+    else if(now_us >= ctx->meter_window_us + RELAY_METER_WINDOW_US)
+        relay_meter_window(ctx, now_us);
+
+    for(int i = 0; i <= len - (int)TS_PACKET_SIZE; i += TS_PACKET_SIZE)
     {
-        relay_worker_t *w = &g_engine.workers[i];
-        w->index = i;
-        w->pinned_cpu = -1;
-        w->epoll_fd = epoll_create1(0);
-        if(w->epoll_fd < 0)
-        {
-            asc_log_error("%s failed to create epoll_fd for worker[%d/%d]: %s",
-                RELAY_MSG_PREFIX, i, requested, strerror(errno));
-            break;
-        }
-        const int rc = pthread_create(&w->thread, NULL, relay_worker_loop, w);
-        if(rc != 0)
+        const uint8_t *ts = &buf[i];
+        const uint16_t pid = TS_GET_PID(ts);
+        relay_pid_t *p = relay_meter_pid(ctx, pid);
+        if(!p)
+            continue;
+
+        __atomic_store_n(&p->packets, p->packets + 1, __ATOMIC_RELAXED);
+
+        if(TS_IS_SCRAMBLED(ts) && !p->scrambled)
+            __atomic_store_n(&p->scrambled, 1, __ATOMIC_RELAXED);
+
+        if(TS_IS_AF(ts) && ts[4] > 0 && (ts[5] & 0x80))
+            p->cc_valid = false; // discontinuity_indicator
+
+        // CC растёт только с payload, один повтор допустим
+        if(TS_IS_PAYLOAD(ts) && pid != NULL_TS_PID)
         {
-            asc_log_error("%s failed to create worker thread[%d/%d]: %s",
-                RELAY_MSG_PREFIX, i, requested, strerror(rc));
-            close(w->epoll_fd);
-            w->epoll_fd = -1;
-            break;
+            const uint8_t cc = TS_GET_CC(ts);
+            if(p->cc_valid && cc != ((p->cc + 1) & 0x0F) && cc != p->cc)
+                __atomic_store_n(&p->cc_errors, p->cc_errors + 1, __ATOMIC_RELAXED);
+            p->cc = cc;
+            p->cc_valid = true;
         }
 
-        // Опционально пиним воркеры, чтобы scheduler не складывал их на одно ядро
-        // (это типичная причина "одно ядро 100% и дергания").
-        w->pinned_cpu = maybe_pin_thread(w->thread, i, affinity, requested);
-        started = i + 1;
-    }
+        if(TS_IS_PCR(ts))
+            relay_meter_pcr(p, ts, now_us);
 
-    if(started <= 0)
-    {
-        free(g_engine.workers);
-        g_engine.workers = NULL;
-        pthread_mutex_unlock(&g_engine.mu);
-        return false;
+        if(pid == 0 && TS_IS_PAYLOAD_START(ts))
+            relay_meter_pat(ctx, ts);
     }
+}
 
-    g_engine.workers_count = started;
-    g_engine.started = true;
-    pthread_mutex_unlock(&g_engine.mu);
+static void relay_meter_reset(relay_ctx_t *ctx)
+{
+    memset(ctx->pid_slot, 0, sizeof(ctx->pid_slot));
+    __atomic_store_n(&ctx->pid_count, 0, __ATOMIC_RELEASE);
+    __atomic_store_n(&ctx->pid_overflow, 0, __ATOMIC_RELAXED);
+    ctx->meter_window_us = 0;
+}
 
-    if(started != requested)
-    {
-        asc_log_warning("%s started with fewer workers: requested=%d started=%d affinity=%s",
-            RELAY_MSG_PREFIX, requested, started, affinity ? "on" : "off");
-    }
-    else
-    {
-        asc_log_info("%s started: workers=%d affinity=%s",
-            RELAY_MSG_PREFIX, started, affinity ? "on" : "off");
-    }
-    return true;
+/*
+ * HTTP /play
+ */
+
+static void relay_play_push(relay_ctx_t *ctx, const uint8_t *data, size_t size)
+{
+    const int slot = (int)(ctx->play_head % (uint64_t)ctx->play_ring_slots);
+    memcpy(&ctx->play_ring[(size_t)slot * RELAY_UDP_BUFFER_SIZE], data, size);
+    ctx->play_ring_size[slot] = (uint16_t)size;
+    ++ctx->play_head;
 }
 
-static int pick_worker_index(const char *id)
+static void relay_emit(relay_ctx_t *ctx, const uint8_t *data, size_t size)
 {
-    const int n = g_engine.workers_count;
-    if(n <= 1)
-        return 0;
-    const uint32_t h = fnv1a_32(id ? id : "");
-    return (int)(h % (uint32_t)n);
+    relay_send_to_outputs(ctx, data, size);
+    if(ctx->pace_ring)
+        relay_pace_push(ctx, data, size);
+    if(ctx->play_ring)
+        relay_play_push(ctx, data, size);
 }
 
-static int pick_worker_index_least_loaded(void)
+/* ctx->lock захвачен */
+static void relay_play_drop(relay_ctx_t *ctx, relay_play_client_t *c)
 {
-    const int n = g_engine.workers_count;
-    if(n <= 1)
-        return 0;
+    if(c->fd < 0)
+        return;
 
-    int best = 0;
-    int best_load = __atomic_load_n(&g_engine.workers[0].active_streams, __ATOMIC_RELAXED);
-    for(int i = 1; i < n; ++i)
+    // fd - dup() сокета http_server: без EPOLL_CTL_DEL регистрация переживёт close(),
+    // shutdown() закрывает соединение и для main loop (там сработает on_read и Lua cleanup).
+    if(ctx->worker_index >= 0 && ctx->worker_index < g_engine.workers_count)
+        epoll_ctl(g_engine.workers[ctx->worker_index].epoll_fd, EPOLL_CTL_DEL, c->fd, NULL);
+    shutdown(c->fd, SHUT_RDWR);
+    close(c->fd);
+    c->fd = -1;
+    --ctx->play_clients_active;
+}
+
+/* n байт ушло в сокет: сдвигаем pending и cursor */
+static void relay_play_consume(relay_ctx_t *ctx, relay_play_client_t *c, size_t n)
+{
+    const size_t pending = c->pending_size - c->pending_skip;
+    if(pending > 0)
     {
-        const int load = __atomic_load_n(&g_engine.workers[i].active_streams, __ATOMIC_RELAXED);
-        if(load < best_load)
+        if(n < pending)
         {
-            best = i;
-            best_load = load;
+            c->pending_skip += n;
+            return;
         }
+        n -= pending;
+        c->pending_size = 0;
+        c->pending_skip = 0;
+    }
+
+    while(n > 0)
+    {
+        const int slot = (int)(c->cursor % (uint64_t)ctx->play_ring_slots);
+        const uint8_t *data = &ctx->play_ring[(size_t)slot * RELAY_UDP_BUFFER_SIZE];
+        const size_t size = ctx->play_ring_size[slot];
+        const size_t left = size - c->skip;
+        if(n >= left)
+        {
+            n -= left;
+            ++c->cursor;
+            c->skip = 0;
+            continue;
+        }
+
+        // Конец записи внутри TS пакета: хвост пакета копируем в pending, чтобы
+        // cursor всегда стоял на границе пакета (слот может быть перезаписан).
+        const size_t offset = c->skip + n;
+        size_t boundary = ((offset + TS_PACKET_SIZE - 1) / TS_PACKET_SIZE) * TS_PACKET_SIZE;
+        if(boundary > size)
+            boundary = size;
+        memcpy(c->pending, &data[offset], boundary - offset);
+        c->pending_size = boundary - offset;
+        c->pending_skip = 0;
+        c->skip = boundary;
+        if(c->skip == size)
+        {
+            ++c->cursor;
+            c->skip = 0;
+        }
+        n = 0;
     }
-    return best;
 }
 
-static bool ctx_register_in_engine(relay_ctx_t *ctx)
+/* false - клиент отключен */
+static bool relay_play_write(relay_ctx_t *ctx, relay_play_client_t *c)
 {
-    if(!g_engine.started || !g_engine.workers || g_engine.workers_count <= 0)
-        return false;
+    for(int loops = 0; loops < RELAY_PLAY_WRITE_LOOPS; ++loops)
+    {
+        // Отстал больше кольца: история потеряна, продолжаем с live (как overflow в http_upstream).
+        if(ctx->play_head - c->cursor > (uint64_t)ctx->play_ring_slots)
+        {
+            c->cursor = ctx->play_head;
+            c->skip = 0;
+            __atomic_fetch_add(&ctx->play_skips, 1, __ATOMIC_RELAXED);
+        }
 
-    const int widx = ctx->worker_least_loaded ? pick_worker_index_least_loaded() : pick_worker_index(ctx->id);
-    if(widx < 0 || widx >= g_engine.workers_count)
-        return false;
+        struct iovec iov[RELAY_PLAY_IOV_MAX];
+        int iov_count = 0;
+        size_t total = 0;
 
-    relay_worker_t *w = &g_engine.workers[widx];
-    struct epoll_event ev;
-    memset(&ev, 0, sizeof(ev));
-    ev.events = EPOLLIN;
-    ev.data.ptr = ctx;
+        if(c->pending_size > c->pending_skip)
+        {
+            iov[0].iov_base = &c->pending[c->pending_skip];
+            iov[0].iov_len = c->pending_size - c->pending_skip;
+            total += iov[0].iov_len;
+            ++iov_count;
+        }
 
-    if(epoll_ctl(w->epoll_fd, EPOLL_CTL_ADD, ctx->in_fd, &ev) != 0)
-        return false;
+        size_t skip = c->skip;
+        for(uint64_t seq = c->cursor; seq < ctx->play_head && iov_count < RELAY_PLAY_IOV_MAX; ++seq)
+        {
+            const int slot = (int)(seq % (uint64_t)ctx->play_ring_slots);
+            iov[iov_count].iov_base = &ctx->play_ring[(size_t)slot * RELAY_UDP_BUFFER_SIZE + skip];
+            iov[iov_count].iov_len = ctx->play_ring_size[slot] - skip;
+            total += iov[iov_count].iov_len;
+            ++iov_count;
+            skip = 0;
+        }
 
-    ctx->worker_index = widx;
-    __atomic_fetch_add(&w->active_streams, 1, __ATOMIC_RELAXED);
-    return true;
+        if(iov_count == 0)
+            return true;
+
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = (size_t)iov_count;
+        const ssize_t sent = sendmsg(c->fd, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if(sent < 0)
+        {
+            if(errno == EINTR)
+                continue;
+            if(errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                c->blocked = true;
+                return true;
+            }
+            return false;
+        }
+
+        __atomic_fetch_add(&ctx->play_bytes, (uint64_t)sent, __ATOMIC_RELAXED);
+        relay_play_consume(ctx, c, (size_t)sent);
+
+        if((size_t)sent < total)
+        {
+            // буфер сокета заполнен, EPOLLOUT (edge) придёт когда освободится
+            c->blocked = true;
+            return true;
+        }
+    }
+    return true;
+}
+
+/* после каждого batch: новые датаграммы всем клиентам, которые не ждут EPOLLOUT */
+static void relay_play_flush(relay_ctx_t *ctx)
+{
+    for(int i = 0; i < ctx->play_clients_slots; ++i)
+    {
+        relay_play_client_t *c = ctx->play_clients[i];
+        if(!c || c->fd < 0 || c->blocked)
+            continue;
+        if(!relay_play_write(ctx, c))
+        {
+            __atomic_fetch_add(&ctx->play_disconnects, 1, __ATOMIC_RELAXED);
+            relay_play_drop(ctx, c);
+        }
+    }
+}
+
+static void relay_play_on_event(relay_play_client_t *c, uint32_t events)
+{
+    relay_ctx_t *ctx = c->ctx;
+
+    pthread_mutex_lock(&ctx->lock);
+    if(!ctx->closing && c->fd >= 0)
+    {
+        if(events & (EPOLLERR | EPOLLHUP))
+        {
+            __atomic_fetch_add(&ctx->play_disconnects, 1, __ATOMIC_RELAXED);
+            relay_play_drop(ctx, c);
+        }
+        else if(events & EPOLLOUT)
+        {
+            c->blocked = false;
+            if(!relay_play_write(ctx, c))
+            {
+                __atomic_fetch_add(&ctx->play_disconnects, 1, __ATOMIC_RELAXED);
+                relay_play_drop(ctx, c);
+            }
+        }
+    }
+    pthread_mutex_unlock(&ctx->lock);
+}
+
+static void relay_process_datagram(relay_ctx_t *ctx, const uint8_t *buf, int len, uint64_t now_us)
+{
+    if(len < (int)TS_PACKET_SIZE)
+    {
+        __atomic_fetch_add(&ctx->bad_datagrams, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    // Ожидаем ровный TS (RTP заголовок уже снят) и размер кратный 188.
+    if((len % TS_PACKET_SIZE) != 0)
+    {
+        __atomic_fetch_add(&ctx->bad_datagrams, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    // Проверяем sync byte на каждой границе 188, чтобы не пропускать мусор/не-T S в dataplane.
+    // Это важно для устойчивости: watchdog может корректно уйти в legacy pipeline.
+    if(!relay_ts_sync_ok(buf, len))
+    {
+        __atomic_fetch_add(&ctx->bad_datagrams, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    __atomic_fetch_add(&ctx->ok_datagrams, 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&ctx->last_ok_us, now_us, __ATOMIC_RELAXED);
+
+    if(ctx->ts_meter)
+        relay_meter(ctx, buf, len, now_us);
+
+    // Fast path: большинство UDP multicast TS приходят уже как 7*188 (1316).
+    // Если буфер выровнен и у нас нет накопленного хвоста - можно отправить datagram как есть,
+    // избегая memcpy на каждый TS пакет.
+    if(ctx->packet_skip == 0 && len == (int)(TS_PACKET_SIZE * 7))
+    {
+        relay_emit(ctx, buf, (size_t)len);
+        return;
+    }
+
+    int i = 0;
+    for(; i <= len - (int)TS_PACKET_SIZE; i += TS_PACKET_SIZE)
+    {
+        memcpy(&ctx->packet[ctx->packet_skip], &buf[i], TS_PACKET_SIZE);
+        ctx->packet_skip += TS_PACKET_SIZE;
+
+        if(ctx->packet_skip > RELAY_UDP_BUFFER_SIZE - TS_PACKET_SIZE)
+        {
+            relay_emit(ctx, ctx->packet, ctx->packet_skip);
+            ctx->packet_skip = 0;
+        }
+    }
+}
+
+/* payload датаграммы в iov, iov_len=0 - датаграмма отброшена */
+static void relay_datagram_payload(relay_ctx_t *ctx, int leg, uint8_t *buf, int len, uint64_t now_us
+                                   , uint64_t stamp_ns, struct iovec *iov)
+{
+    iov->iov_base = buf;
+    iov->iov_len = (len > 0) ? (size_t)len : 0;
+    if(len <= 0)
+        return;
+    if(!ctx->rtp)
+    {
+        if(ctx->mdi && leg == 0)
+            udp_mdi_packet(ctx->mdi, stamp_ns, asc_utime(), buf, (size_t)len / TS_PACKET_SIZE);
+        return;
+    }
+
+    int payload_len = 0;
+    const int skip = relay_rtp_payload(buf, len, &payload_len);
+    if(skip < 0)
+    {
+        __atomic_fetch_add(&ctx->bad_datagrams, 1, __ATOMIC_RELAXED);
+        iov->iov_len = 0;
+        return;
+    }
+
+    // все датаграммы основного сокета, копии других legs ещё не отброшены
+    if(ctx->mdi && leg == 0)
+        udp_mdi_packet(ctx->mdi, stamp_ns, asc_utime(), buf + skip, (size_t)payload_len / TS_PACKET_SIZE);
+
+    __atomic_fetch_add(&ctx->rtp_datagrams, 1, __ATOMIC_RELAXED);
+    const bool is_first = ctx->merge
+        ? rtp_merge_accept(ctx->merge, leg, (uint16_t)((buf[2] << 8) | buf[3]), now_us)
+        : relay_rtp_track(ctx, buf);
+    if(!is_first)
+    {
+        iov->iov_len = 0;
+        return;
+    }
+
+    iov->iov_base = buf + skip;
+    iov->iov_len = (size_t)payload_len;
+}
+
+/*
+ * batch ingest для подписчика: r датаграмм в in->rx_iov. Буферы общие для всех
+ * подписчиков и только читаются, payload датаграммы n - в ctx->tx_iov[n].
+ */
+static void relay_ctx_on_batch(relay_ctx_t *ctx, int leg, const relay_ingest_t *in, int r, uint64_t now_us)
+{
+    // Блокируем контекст, чтобы destroy мог безопасно дождаться окончания обработки.
+    pthread_mutex_lock(&ctx->lock);
+    if(ctx->closing)
+    {
+        pthread_mutex_unlock(&ctx->lock);
+        return;
+    }
+
+    __atomic_store_n(&ctx->last_rx_us, now_us, __ATOMIC_RELAXED);
+
+    // Снимаем RTP заголовки: payload каждой датаграммы batch лежит в tx_iov[n].
+    uint64_t in_bytes = 0;
+    int in_count = 0;
+    for(int n = 0; n < r; ++n)
+    {
+        const int len = (int)in->rx_msgs[n].msg_len;
+        if(len > 0)
+        {
+            in_bytes += (uint64_t)len;
+            ++in_count;
+        }
+        relay_datagram_payload(ctx, leg, (uint8_t *)in->rx_iov[n].iov_base, len, now_us
+                               , in->rx_stamp[n], &ctx->tx_iov[n]);
+    }
+    __atomic_fetch_add(&ctx->bytes_in, in_bytes, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&ctx->datagrams_in, (uint64_t)in_count, __ATOMIC_RELAXED);
+
+    // Super fast-path:
+    // типичный TS multicast уже приходит как 1316 bytes (7*188), с RTP или без. Если у нас нет хвоста,
+    // то можно отправить весь batch через sendmmsg(), снизив число syscalls в ~count раз.
+    bool can_batch = (ctx->packet_skip == 0 && r >= 2);
+    for(int n = 0; can_batch && n < r; ++n)
+    {
+        const int len = (int)ctx->tx_iov[n].iov_len;
+        if(len != (int)(TS_PACKET_SIZE * 7)
+           || !relay_ts_sync_ok((const uint8_t *)ctx->tx_iov[n].iov_base, len))
+        {
+            can_batch = false;
+        }
+    }
+
+    if(can_batch)
+    {
+        __atomic_fetch_add(&ctx->ok_datagrams, (uint64_t)r, __ATOMIC_RELAXED);
+        __atomic_store_n(&ctx->last_ok_us, now_us, __ATOMIC_RELAXED);
+
+        if(ctx->ts_meter)
+        {
+            for(int n = 0; n < r; ++n)
+                relay_meter(ctx, (const uint8_t *)ctx->tx_iov[n].iov_base, (int)ctx->tx_iov[n].iov_len, now_us);
+        }
+
+        relay_send_to_outputs_mmsg(ctx, r);
+        if(ctx->pace_ring)
+        {
+            for(int n = 0; n < r; ++n)
+                relay_pace_push(ctx, (const uint8_t *)ctx->tx_iov[n].iov_base, ctx->tx_iov[n].iov_len);
+        }
+        if(ctx->play_ring)
+        {
+            for(int n = 0; n < r; ++n)
+                relay_play_push(ctx, (const uint8_t *)ctx->tx_iov[n].iov_base, ctx->tx_iov[n].iov_len);
+        }
+    }
+    else
+    {
+        for(int n = 0; n < r; ++n)
+        {
+            // отброшенные (битый RTP, дубликаты) уже посчитаны
+            if(ctx->tx_iov[n].iov_len == 0)
+                continue;
+            relay_process_datagram(ctx, (const uint8_t *)ctx->tx_iov[n].iov_base
+                                   , (int)ctx->tx_iov[n].iov_len, now_us);
+        }
+    }
+
+    if(ctx->play_clients_active > 0)
+        relay_play_flush(ctx);
+
+    if(ctx->pace_ring && ctx->worker_index >= 0)
+    {
+        relay_worker_t *w = &g_engine.workers[ctx->worker_index];
+        const uint64_t due_us = relay_pace_run(ctx, now_us);
+        // ctx перенесён, а старый воркер дораздаёт batch: таймер взводит владелец
+        if(w == relay_current_worker)
+            relay_pace_arm(w, due_us, now_us);
+        else if(due_us != 0)
+            relay_worker_wake(w);
+    }
+
+    pthread_mutex_unlock(&ctx->lock);
+}
+
+/* in->lock захвачен: r датаграмм в rx_msgs/rx_iov всем подписчикам */
+static void relay_ingest_dispatch(relay_ingest_t *in, int r, uint64_t now_us)
+{
+    uint64_t bytes = 0;
+    for(int n = 0; n < r; ++n)
+        bytes += in->rx_msgs[n].msg_len;
+    __atomic_fetch_add(&in->datagrams, (uint64_t)r, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&in->bytes, bytes, __ATOMIC_RELAXED);
+    if(relay_current_worker)
+        __atomic_fetch_add(&relay_current_worker->datagrams, (uint64_t)r, __ATOMIC_RELAXED);
+
+    for(int i = 0; i < in->sub_count; ++i)
+        relay_ctx_on_batch(in->subs[i].ctx, in->subs[i].leg, in, r, now_us);
+}
+
+/*
+ * in->lock захвачен: буферы UDP_GRO режутся по сегменту в rx_iov и раздаются batch
+ * по rx_batch датаграмм. Возвращает результат recvmmsg (буферов).
+ */
+static int relay_ingest_read_gro(relay_ingest_t *in)
+{
+    for(int i = 0; i < RELAY_GRO_MSGS; ++i)
+        in->gro_msgs[i].msg_hdr.msg_controllen = RELAY_GRO_CMSG_SIZE;
+
+    errno = 0;
+    const int r = recvmmsg(in->fd, in->gro_msgs, RELAY_GRO_MSGS, MSG_DONTWAIT, NULL);
+    if(r <= 0)
+        return r;
+
+    const uint64_t now_us = asc_now_us();
+    int pending = 0;
+    for(int i = 0; i < r; ++i)
+    {
+        const int len = (int)in->gro_msgs[i].msg_len;
+        if(len <= 0)
+            continue;
+        uint8_t *buf = (uint8_t *)in->gro_iov[i].iov_base;
+        // сегменты серии получают время приёма буфера
+        const uint64_t stamp_ns = in->timestamps ? udp_mdi_timestamp(&in->gro_msgs[i].msg_hdr) : 0;
+        int segment = udp_gro_segment(&in->gro_msgs[i].msg_hdr);
+        if(segment <= 0 || segment >= len)
+            segment = len;
+        else
+        {
+            __atomic_fetch_add(&in->gro_coalesced, 1, __ATOMIC_RELAXED);
+            __atomic_fetch_add(&in->gro_datagrams, (uint64_t)((len + segment - 1) / segment), __ATOMIC_RELAXED);
+        }
+
+        for(int off = 0; off < len; off += segment)
+        {
+            int size = (len - off < segment) ? len - off : segment;
+            if(size > RELAY_UDP_BUFFER_SIZE)
+                size = RELAY_UDP_BUFFER_SIZE; // как усечённый recvmmsg
+            in->rx_iov[pending].iov_base = buf + off;
+            in->rx_msgs[pending].msg_len = (unsigned int)size;
+            in->rx_stamp[pending] = stamp_ns;
+            if(++pending == in->rx_batch)
+            {
+                relay_ingest_dispatch(in, pending, now_us);
+                pending = 0;
+            }
+        }
+    }
+    if(pending > 0)
+        relay_ingest_dispatch(in, pending, now_us);
+    return r;
+}
+
+static void relay_ingest_on_read(relay_ingest_t *in)
+{
+    // подписка и отписка ждут конца раздачи
+    pthread_mutex_lock(&in->lock);
+
+    for(int loops = 0; loops < RELAY_READ_BUDGET_LOOPS; ++loops)
+    {
+        if(in->timestamps && !in->gro)
+        {
+            for(int i = 0; i < in->rx_batch; ++i)
+                in->rx_msgs[i].msg_hdr.msg_controllen = UDP_MDI_CMSG_SIZE;
+        }
+
+        errno = 0;
+        const int r = in->gro
+            ? relay_ingest_read_gro(in)
+            : recvmmsg(in->fd, in->rx_msgs, (unsigned int)in->rx_batch, MSG_DONTWAIT, NULL);
+        __atomic_fetch_add(&in->reads, 1, __ATOMIC_RELAXED);
+        if(r <= 0)
+        {
+            if(r == 0 || errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+            // read error: считаем вход мёртвым, но не падаем процессом.
+            for(int i = 0; i < in->sub_count; ++i)
+                __atomic_fetch_add(&in->subs[i].ctx->bad_datagrams, 1, __ATOMIC_RELAXED);
+            break;
+        }
+
+        if(in->gro)
+        {
+            if(r < RELAY_GRO_MSGS)
+                break;
+            continue;
+        }
+
+        if(in->timestamps)
+        {
+            for(int n = 0; n < r; ++n)
+                in->rx_stamp[n] = udp_mdi_timestamp(&in->rx_msgs[n].msg_hdr);
+        }
+        relay_ingest_dispatch(in, r, asc_now_us());
+
+        if(r < in->rx_batch)
+            break;
+    }
+
+    pthread_mutex_unlock(&in->lock);
+}
+
+/* воркер, ring->lock захвачен */
+static relay_ingest_t *relay_ring_find(const relay_ring_t *ring, const packet_ring_dst_t *dst)
+{
+    int lo = 0;
+    int hi = ring->count - 1;
+    while(lo <= hi)
+    {
+        const int mid = (lo + hi) / 2;
+        const relay_ingest_t *in = ring->table[mid];
+        if(in->dst.addr == dst->addr && in->dst.port == dst->port)
+            return ring->table[mid];
+        if(in->dst.addr < dst->addr || (in->dst.addr == dst->addr && in->dst.port < dst->port))
+            lo = mid + 1;
+        else
+            hi = mid - 1;
+    }
+    return NULL;
+}
+
+static void relay_ring_flush(relay_ingest_t *in)
+{
+    if(in->pending <= 0)
+        return;
+    pthread_mutex_lock(&in->lock);
+    relay_ingest_dispatch(in, in->pending, asc_now_us());
+    pthread_mutex_unlock(&in->lock);
+    in->pending = 0;
+}
+
+static void relay_ring_on_frame(void *arg, const packet_ring_dst_t *dst, const uint8_t *payload, int size
+                                , uint64_t stamp_ns)
+{
+    relay_ring_t *ring = (relay_ring_t *)arg;
+    relay_ingest_t *in = relay_ring_find(ring, dst);
+    if(!in)
+    {
+        __atomic_fetch_add(&ring->unmatched, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    if(size > RELAY_UDP_BUFFER_SIZE)
+        size = RELAY_UDP_BUFFER_SIZE; // как усечённый recvmmsg
+
+    // payload в блоке ring: живёт до on_block, подписчики получают его без копии
+    in->rx_iov[in->pending].iov_base = (void *)payload;
+    in->rx_msgs[in->pending].msg_len = (unsigned int)size;
+    in->rx_stamp[in->pending] = stamp_ns;
+    ++in->pending;
+    if(!in->pending_linked)
+    {
+        in->pending_linked = true;
+        in->pending_next = ring->pending;
+        ring->pending = in;
+    }
+    if(in->pending == in->rx_batch)
+        relay_ring_flush(in);
+}
+
+static void relay_ring_on_block(void *arg)
+{
+    relay_ring_t *ring = (relay_ring_t *)arg;
+    relay_ingest_t *in = ring->pending;
+    ring->pending = NULL;
+    while(in)
+    {
+        relay_ingest_t *next = in->pending_next;
+        relay_ring_flush(in);
+        in->pending_linked = false;
+        in->pending_next = NULL;
+        in = next;
+    }
+}
+
+static void relay_ring_on_read(relay_ring_t *ring)
+{
+    // таблица не меняется, пока блок раздаётся
+    pthread_mutex_lock(&ring->lock);
+    packet_ring_read(&ring->ring, relay_ring_on_frame, relay_ring_on_block, ring, RELAY_READ_BUDGET_LOOPS);
+    pthread_mutex_unlock(&ring->lock);
+}
+
+/* группу покидает тот, кто отпустил ingest (main loop), здесь только close */
+static void relay_ingest_free(relay_ingest_t *in)
+{
+    if(in->sock)
+        asc_socket_close(in->sock);
+    free(in->rx_msgs);
+    free(in->rx_iov);
+    free(in->rx_buffers);
+    free(in->rx_stamp);
+    free(in->rx_cmsg);
+    free(in->gro_msgs);
+    free(in->gro_iov);
+    free(in->gro_buffers);
+    free(in->gro_cmsg);
+    free(in->subs);
+    free(in->key);
+    pthread_mutex_destroy(&in->lock);
+    free(in);
+}
+
+/* ingests, отпущенные после прошлого epoll batch, событий больше не получат */
+static void relay_worker_reap(relay_worker_t *w)
+{
+    pthread_mutex_lock(&w->reap_mu);
+    relay_ingest_t *in = w->reap;
+    w->reap = NULL;
+    pthread_mutex_unlock(&w->reap_mu);
+
+    while(in)
+    {
+        relay_ingest_t *next = in->next;
+        relay_ingest_free(in);
+        in = next;
+    }
+}
+
+static void *relay_worker_loop(void *arg)
+{
+    relay_worker_t *w = (relay_worker_t *)arg;
+    struct epoll_event events[RELAY_MAX_EVENTS];
+    relay_current_worker = w;
+
+    for(;;)
+    {
+        if(__atomic_load_n(&w->reap, __ATOMIC_RELAXED))
+            relay_worker_reap(w);
+
+        const int n = epoll_wait(w->epoll_fd, events, RELAY_MAX_EVENTS, -1);
+        if(n < 0)
+        {
+            if(errno == EINTR)
+                continue;
+            asc_usleep(1000);
+            continue;
+        }
+        // coarse clock of the batch (core/clock.h)
+        asc_now_update();
+        const uint64_t busy_start_us = asc_now_us();
+
+        for(int i = 0; i < n; ++i)
+        {
+            void *ptr = events[i].data.ptr;
+            if(!ptr)
+                continue;
+
+            if(*(const int *)ptr == RELAY_EVENT_PLAY)
+            {
+                relay_play_client_t *c = (relay_play_client_t *)ptr;
+                relay_ctx_t *ctx = c->ctx;
+                __atomic_fetch_add(&ctx->refcount, 1, __ATOMIC_RELAXED);
+                relay_play_on_event(c, events[i].events);
+                __atomic_fetch_sub(&ctx->refcount, 1, __ATOMIC_RELAXED);
+                continue;
+            }
+
+            if(*(const int *)ptr == RELAY_EVENT_PACE)
+            {
+                relay_pace_on_timer(w);
+                continue;
+            }
+
+            if(*(const int *)ptr == RELAY_EVENT_RING)
+            {
+                relay_ring_on_read((relay_ring_t *)ptr);
+                continue;
+            }
+
+            relay_ingest_on_read((relay_ingest_t *)ptr);
+        }
+
+        __atomic_fetch_add(&w->busy_us, asc_utime() - busy_start_us, __ATOMIC_RELAXED);
+    }
+
+    return NULL;
+}
+
+static int clamp_int(int value, int min_value, int max_value)
+{
+    if(value < min_value)
+        return min_value;
+    if(value > max_value)
+        return max_value;
+    return value;
+}
+
+static int detect_default_workers(void)
+{
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    if(n < 1)
+        return 1;
+    // Оставляем 1 ядро под control plane (Lua/UI/HTTP), остальное под data plane.
+    if(n > 1)
+        n = n - 1;
+    if(n > 32)
+        n = 32;
+    return (int)n;
+}
+
+static int detect_allowed_cpus(int *out, int out_cap)
+{
+    if(!out || out_cap <= 0)
+        return 0;
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if(sched_getaffinity(0, sizeof(set), &set) != 0)
+        return 0;
+
+    int n = 0;
+    for(int cpu = 0; cpu < CPU_SETSIZE && n < out_cap; ++cpu)
+    {
+        if(CPU_ISSET(cpu, &set))
+            out[n++] = cpu;
+    }
+    return n;
+}
+
+static int maybe_pin_thread(pthread_t thread, int worker_index, bool enable_affinity, int workers_count)
+{
+    if(!enable_affinity)
+        return -1;
+
+    // Учитываем ограничения контейнера/cpuset: берём список разрешённых CPU.
+    int allowed[CPU_SETSIZE];
+    const int allowed_n = detect_allowed_cpus(allowed, (int)(sizeof(allowed) / sizeof(allowed[0])));
+    if(allowed_n <= 1)
+        return -1;
+
+    // По умолчанию стараемся не трогать первый CPU из allowed списка, оставляя его под control plane.
+    // Но если воркеров >= доступных CPU, то используем весь список (иначе получим коллизию и 100% одного ядра).
+    int start = 0;
+    int target_n = allowed_n;
+    if(allowed_n > 1 && workers_count <= (allowed_n - 1))
+    {
+        start = 1;
+        target_n = allowed_n - 1;
+    }
+    if(target_n <= 0)
+        return -1;
+    const int cpu = allowed[start + (worker_index % target_n)];
+
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    CPU_SET(cpu, &mask);
+
+    const int rc = pthread_setaffinity_np(thread, sizeof(mask), &mask);
+    if(rc != 0)
+    {
+        // Не критично: продолжаем работать без affinity.
+        asc_log_warning("%s worker[%d/%d] setaffinity(cpu=%d) failed: %s",
+            RELAY_MSG_PREFIX, worker_index, workers_count, cpu, strerror(rc));
+        return -1;
+    }
+
+    return cpu;
+}
+
+static bool engine_ensure_started(int requested_workers, bool affinity)
+{
+    pthread_mutex_lock(&g_engine.mu);
+    if(g_engine.started)
+    {
+        pthread_mutex_unlock(&g_engine.mu);
+        return true;
+    }
+
+    int requested = requested_workers;
+    if(requested <= 0)
+        requested = detect_default_workers();
+    requested = clamp_int(requested, 1, 64);
+
+    g_engine.workers = (relay_worker_t *)calloc((size_t)requested, sizeof(relay_worker_t));
+    if(!g_engine.workers)
+    {
+        pthread_mutex_unlock(&g_engine.mu);
+        return false;
+    }
+
+    g_engine.affinity = affinity;
+    int started = 0;
+    for(int i = 0; i < requested; ++i)
+    {
+        relay_worker_t *w = &g_engine.workers[i];
+        w->index = i;
+        w->pinned_cpu = -1;
+        w->epoll_fd = epoll_create1(0);
+        if(w->epoll_fd < 0)
+        {
+            asc_log_error("%s failed to create epoll_fd for worker[%d/%d]: %s",
+                RELAY_MSG_PREFIX, i, requested, strerror(errno));
+            break;
+        }
+
+        w->pace_event = RELAY_EVENT_PACE;
+        pthread_mutex_init(&w->pace_mu, NULL);
+        pthread_mutex_init(&w->reap_mu, NULL);
+        w->pace_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if(w->pace_fd >= 0)
+        {
+            struct epoll_event ev;
+            memset(&ev, 0, sizeof(ev));
+            ev.events = EPOLLIN;
+            ev.data.ptr = &w->pace_event;
+            if(epoll_ctl(w->epoll_fd, EPOLL_CTL_ADD, w->pace_fd, &ev) != 0)
+            {
+                close(w->pace_fd);
+                w->pace_fd = -1;
+            }
+        }
+        if(w->pace_fd < 0)
+        {
+            // стримы с paced outputs на этот воркер не встанут (relay_pace_register)
+            asc_log_warning("%s failed to create pacing timer for worker[%d/%d]: %s",
+                RELAY_MSG_PREFIX, i, requested, strerror(errno));
+        }
+        const int rc = pthread_create(&w->thread, NULL, relay_worker_loop, w);
+        if(rc != 0)
+        {
+            asc_log_error("%s failed to create worker thread[%d/%d]: %s",
+                RELAY_MSG_PREFIX, i, requested, strerror(rc));
+            close(w->epoll_fd);
+            w->epoll_fd = -1;
+            if(w->pace_fd >= 0)
+                close(w->pace_fd);
+            w->pace_fd = -1;
+            break;
+        }
+
+        // Опционально пиним воркеры, чтобы scheduler не складывал их на одно ядро
+        // (это типичная причина "одно ядро 100% и дергания").
+        w->pinned_cpu = maybe_pin_thread(w->thread, i, affinity, requested);
+        started = i + 1;
+    }
+
+    if(started <= 0)
+    {
+        free(g_engine.workers);
+        g_engine.workers = NULL;
+        pthread_mutex_unlock(&g_engine.mu);
+        return false;
+    }
+
+    g_engine.workers_count = started;
+    g_engine.started = true;
+    pthread_mutex_unlock(&g_engine.mu);
+
+    if(started != requested)
+    {
+        asc_log_warning("%s started with fewer workers: requested=%d started=%d affinity=%s",
+            RELAY_MSG_PREFIX, requested, started, affinity ? "on" : "off");
+    }
+    else
+    {
+        asc_log_info("%s started: workers=%d affinity=%s",
+            RELAY_MSG_PREFIX, started, affinity ? "on" : "off");
+    }
+    return true;
+}
+
+static int pick_worker_index(const char *id)
+{
+    const int n = g_engine.workers_count;
+    if(n <= 1)
+        return 0;
+    const uint32_t h = fnv1a_32(id ? id : "");
+    return (int)(h % (uint32_t)n);
+}
+
+/* main loop. С включённым балансировщиком - по busy% прошлого интервала, затем по числу потоков */
+static int pick_worker_index_least_loaded(void)
+{
+    const int n = g_engine.workers_count;
+    if(n <= 1)
+        return 0;
+
+    const bool measured = (g_balancer.runs > 0);
+    int best = 0;
+    int best_load = __atomic_load_n(&g_engine.workers[0].active_streams, __ATOMIC_RELAXED);
+    double best_busy = g_engine.workers[0].busy_pct;
+    for(int i = 1; i < n; ++i)
+    {
+        const int load = __atomic_load_n(&g_engine.workers[i].active_streams, __ATOMIC_RELAXED);
+        const double busy = g_engine.workers[i].busy_pct;
+        const bool better = measured
+            ? (busy < best_busy || (busy == best_busy && load < best_load))
+            : (load < best_load);
+        if(better)
+        {
+            best = i;
+            best_load = load;
+            best_busy = busy;
+        }
+    }
+    return best;
+}
+
+static bool relay_pace_register(relay_worker_t *w, relay_ctx_t *ctx)
+{
+    if(w->pace_fd < 0)
+        return false;
+
+    pthread_mutex_lock(&w->pace_mu);
+    if(w->pace_count == w->pace_slots)
+    {
+        const int slots = w->pace_slots ? w->pace_slots * 2 : 16;
+        relay_ctx_t **list = (relay_ctx_t **)realloc(w->pace_list, (size_t)slots * sizeof(relay_ctx_t *));
+        if(!list)
+        {
+            pthread_mutex_unlock(&w->pace_mu);
+            return false;
+        }
+        w->pace_list = list;
+        w->pace_slots = slots;
+    }
+    w->pace_list[w->pace_count++] = ctx;
+    pthread_mutex_unlock(&w->pace_mu);
+    return true;
+}
+
+/* после возврата таймер воркера ctx не трогает */
+static void relay_pace_unregister(relay_worker_t *w, relay_ctx_t *ctx)
+{
+    pthread_mutex_lock(&w->pace_mu);
+    for(int i = 0; i < w->pace_count; ++i)
+    {
+        if(w->pace_list[i] == ctx)
+        {
+            w->pace_list[i] = w->pace_list[--w->pace_count];
+            break;
+        }
+    }
+    pthread_mutex_unlock(&w->pace_mu);
+}
+
+static asc_socket_t *open_input_socket(const char *addr, int port, const char *localaddr, int socket_size)
+{
+    asc_socket_t *sock = asc_socket_open_udp4(NULL);
+    if(!sock)
+        return NULL;
+    asc_socket_set_reuseaddr(sock, 1);
+    if(!asc_socket_bind(sock, addr, port))
+    {
+        asc_socket_close(sock);
+        return NULL;
+    }
+    if(socket_size > 0)
+        asc_socket_set_buffer(sock, socket_size, 0);
+    asc_socket_multicast_join(sock, addr, localaddr);
+    return sock;
+}
+
+/*
+ * Ingest registry
+ */
+
+static pthread_mutex_t g_ingest_mu = PTHREAD_MUTEX_INITIALIZER;
+static relay_ingest_t *g_ingests = NULL;
+static relay_ctx_t *g_ctx_list = NULL; // потоки в воркерах, для балансировщика
+
+static char *relay_source_key(const relay_source_t *src)
+{
+    const char *localaddr = src->localaddr ? src->localaddr : "";
+    char *key = (char *)malloc(strlen(localaddr) + strlen(src->addr) + 16);
+    if(key)
+        sprintf(key, "%s@%s:%d", localaddr, src->addr, src->port);
+    return key;
+}
+
+/* g_ingest_mu захвачен. widx < 0 - любой воркер, packet < 0 - любой backend */
+static relay_ingest_t *relay_ingest_find(const char *key, int widx, int packet)
+{
+    for(relay_ingest_t *in = g_ingests; in; in = in->next)
+    {
+        if((widx < 0 || in->worker_index == widx)
+           && (packet < 0 || (in->ring != NULL) == (packet > 0))
+           && !strcmp(in->key, key))
+        {
+            return in;
+        }
+    }
+    return NULL;
+}
+
+/* интерфейс с адресом localaddr */
+static char *relay_ifname_by_addr(const char *localaddr)
+{
+    if(!localaddr || !localaddr[0])
+        return NULL;
+    const in_addr_t addr = inet_addr(localaddr);
+    struct ifaddrs *ifa_list = NULL;
+    if(getifaddrs(&ifa_list) != 0)
+        return NULL;
+    char *ifname = NULL;
+    for(struct ifaddrs *ifa = ifa_list; ifa && !ifname; ifa = ifa->ifa_next)
+    {
+        if(ifa->ifa_addr && ifa->ifa_addr->sa_family == AF_INET
+           && ((const struct sockaddr_in *)ifa->ifa_addr)->sin_addr.s_addr == addr)
+        {
+            ifname = strdup(ifa->ifa_name);
+        }
+    }
+    freeifaddrs(ifa_list);
+    return ifname;
+}
+
+/* g_ingest_mu захвачен. Кольцо воркера на интерфейсе, создаётся один раз */
+static relay_ring_t *relay_ring_get(relay_worker_t *w, const char *ifname, int ring_mb)
+{
+    for(relay_ring_t *ring = w->rings; ring; ring = ring->next)
+    {
+        if(!strcmp(ring->ifname, ifname))
+            return ring;
+    }
+
+    relay_ring_t *ring = (relay_ring_t *)calloc(1, sizeof(relay_ring_t));
+    if(!ring)
+        return NULL;
+    ring->event_type = RELAY_EVENT_RING;
+    ring->worker_index = w->index;
+    ring->ifname = strdup(ifname);
+    const int blocks = (int)(((int64_t)(ring_mb > 0 ? ring_mb : RELAY_RING_MB_DEFAULT) << 20)
+                             / PACKET_RING_BLOCK_SIZE);
+    if(!ring->ifname || !packet_ring_open(&ring->ring, ifname, blocks))
+    {
+        free(ring->ifname);
+        free(ring);
+        return NULL;
+    }
+    pthread_mutex_init(&ring->lock, NULL);
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.ptr = ring;
+    if(epoll_ctl(w->epoll_fd, EPOLL_CTL_ADD, ring->ring.fd, &ev) != 0)
+    {
+        packet_ring_close(&ring->ring);
+        pthread_mutex_destroy(&ring->lock);
+        free(ring->ifname);
+        free(ring);
+        return NULL;
+    }
+
+    ring->next = w->rings;
+    w->rings = ring;
+    asc_log_info("%s worker[%d]: packet ring on %s, %d blocks of %d KiB",
+        RELAY_MSG_PREFIX, w->index, ifname, ring->ring.blocks, PACKET_RING_BLOCK_SIZE / 1024);
+    return ring;
+}
+
+/* g_ingest_mu захвачен: фильтр ядра по текущей таблице */
+static void relay_ring_update_filter(relay_ring_t *ring)
+{
+    packet_ring_dst_t *dst = NULL;
+    if(ring->count > 0)
+    {
+        dst = (packet_ring_dst_t *)calloc((size_t)ring->count, sizeof(packet_ring_dst_t));
+        if(!dst)
+            return;
+        for(int i = 0; i < ring->count; ++i)
+            dst[i] = ring->table[i]->dst;
+    }
+    packet_ring_set_filter(&ring->ring, dst, ring->count);
+    free(dst);
+}
+
+/* g_ingest_mu захвачен */
+static bool relay_ring_add(relay_ring_t *ring, relay_ingest_t *in)
+{
+    if(relay_ring_find(ring, &in->dst))
+    {
+        asc_log_error("%s packet ring on %s: %s is already received by another ingest",
+            RELAY_MSG_PREFIX, ring->ifname, in->key);
+        return false;
+    }
+
+    pthread_mutex_lock(&ring->lock);
+    if(ring->count == ring->slots)
+    {
+        const int slots = ring->slots ? ring->slots * 2 : 16;
+        relay_ingest_t **table = (relay_ingest_t **)realloc(ring->table, (size_t)slots * sizeof(relay_ingest_t *));
+        if(!table)
+        {
+            pthread_mutex_unlock(&ring->lock);
+            return false;
+        }
+        ring->table = table;
+        ring->slots = slots;
+    }
+    int pos = ring->count;
+    while(pos > 0)
+    {
+        const relay_ingest_t *prev = ring->table[pos - 1];
+        if(prev->dst.addr < in->dst.addr || (prev->dst.addr == in->dst.addr && prev->dst.port < in->dst.port))
+            break;
+        ring->table[pos] = ring->table[pos - 1];
+        --pos;
+    }
+    ring->table[pos] = in;
+    ++ring->count;
+    pthread_mutex_unlock(&ring->lock);
+
+    relay_ring_update_filter(ring);
+    return true;
+}
+
+/* g_ingest_mu захвачен. После возврата воркер больше не видит in */
+static void relay_ring_remove(relay_ring_t *ring, relay_ingest_t *in)
+{
+    pthread_mutex_lock(&ring->lock);
+    for(int i = 0; i < ring->count; ++i)
+    {
+        if(ring->table[i] == in)
+        {
+            memmove(&ring->table[i], &ring->table[i + 1], (size_t)(ring->count - i - 1) * sizeof(relay_ingest_t *));
+            --ring->count;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&ring->lock);
+
+    relay_ring_update_filter(ring);
+}
+
+/* g_ingest_mu захвачен. packet ingest: join (и порт unicast) держит сокет, в который ничего не попадает */
+static bool relay_ingest_open_packet(relay_ingest_t *in, const relay_source_t *src, relay_worker_t *w)
+{
+    char *ifname = src->ifname ? strdup(src->ifname) : relay_ifname_by_addr(src->localaddr);
+    if(!ifname)
+    {
+        asc_log_warning("%s %s: ingest=packet requires ifname or localaddr, using socket",
+            RELAY_MSG_PREFIX, in->key);
+        return false;
+    }
+    relay_ring_t *ring = relay_ring_get(w, ifname, src->ring_mb);
+    if(!ring)
+    {
+        asc_log_warning("%s %s: packet ring on %s is not available, using socket",
+            RELAY_MSG_PREFIX, in->key, ifname);
+        free(ifname);
+        return false;
+    }
+    free(ifname);
+
+    // multicast: join на эфемерном порту, датаграммы группы до сокета не доходят;
+    // unicast: порт занят (без ICMP unreachable), фильтр сокета всё отбрасывает
+    const in_addr_t addr = inet_addr(src->addr);
+    const bool multicast = IN_MULTICAST(ntohl(addr));
+    in->sock = open_input_socket(src->addr, multicast ? 0 : src->port, src->localaddr, 0);
+    if(!in->sock)
+        return false;
+    if(!packet_ring_socket_drop_all(asc_socket_fd(in->sock)))
+    {
+        asc_socket_multicast_leave(in->sock);
+        asc_socket_close(in->sock);
+        in->sock = NULL;
+        return false;
+    }
+
+    in->dst.addr = addr;
+    in->dst.port = (uint16_t)src->port;
+    in->ring = ring;
+    if(!relay_ring_add(ring, in))
+    {
+        in->ring = NULL;
+        asc_socket_multicast_leave(in->sock);
+        asc_socket_close(in->sock);
+        in->sock = NULL;
+        return false;
+    }
+    return true;
+}
+
+/* сокет ingest открыт: UDP_GRO и буферы серий, false - ingest остаётся без GRO */
+static bool relay_ingest_open_gro(relay_ingest_t *in)
+{
+    if(!udp_gro_set(in->fd, true))
+        return false;
+
+    in->gro_msgs = (struct mmsghdr *)calloc(RELAY_GRO_MSGS, sizeof(struct mmsghdr));
+    in->gro_iov = (struct iovec *)calloc(RELAY_GRO_MSGS, sizeof(struct iovec));
+    in->gro_buffers = (uint8_t *)malloc((size_t)RELAY_GRO_MSGS * UDP_GRO_BUFFER_SIZE);
+    in->gro_cmsg = (uint8_t *)calloc(RELAY_GRO_MSGS, RELAY_GRO_CMSG_SIZE);
+    if(!in->gro_msgs || !in->gro_iov || !in->gro_buffers || !in->gro_cmsg)
+    {
+        // сокет уже отдаёт серии: без буферов под них только выключить
+        udp_gro_set(in->fd, false);
+        return false;
+    }
+    for(int i = 0; i < RELAY_GRO_MSGS; ++i)
+    {
+        in->gro_iov[i].iov_base = in->gro_buffers + ((size_t)i * UDP_GRO_BUFFER_SIZE);
+        in->gro_iov[i].iov_len = UDP_GRO_BUFFER_SIZE;
+        in->gro_msgs[i].msg_hdr.msg_iov = &in->gro_iov[i];
+        in->gro_msgs[i].msg_hdr.msg_iovlen = 1;
+        in->gro_msgs[i].msg_hdr.msg_control = &in->gro_cmsg[(size_t)i * RELAY_GRO_CMSG_SIZE];
+        in->gro_msgs[i].msg_hdr.msg_controllen = RELAY_GRO_CMSG_SIZE;
+    }
+    in->gro = true;
+    return true;
+}
+
+/*
+ * g_ingest_mu захвачен: SO_TIMESTAMPNS на сокете ingest для MDI. Воркер может
+ * читать общий ingest, cmsg буферы подключаются под in->lock.
+ */
+static void relay_ingest_open_stamps(relay_ingest_t *in)
+{
+    if(in->timestamps || in->fd < 0)
+        return; // packet: время приёма есть в кадре ring
+
+    uint8_t *cmsg = (uint8_t *)calloc((size_t)in->rx_batch, UDP_MDI_CMSG_SIZE);
+    if(!cmsg || !udp_mdi_timestamps_set(in->fd))
+    {
+        free(cmsg);
+        asc_log_warning("%s %s: kernel receive timestamps are not supported, MDI uses the read time",
+            RELAY_MSG_PREFIX, in->key);
+        return;
+    }
+
+    pthread_mutex_lock(&in->lock);
+    in->rx_cmsg = cmsg;
+    for(int i = 0; i < in->rx_batch; ++i)
+    {
+        in->rx_msgs[i].msg_hdr.msg_control = &in->rx_cmsg[(size_t)i * UDP_MDI_CMSG_SIZE];
+        in->rx_msgs[i].msg_hdr.msg_controllen = UDP_MDI_CMSG_SIZE;
+    }
+    in->timestamps = true;
+    pthread_mutex_unlock(&in->lock);
+}
+
+/* g_ingest_mu захвачен. Общий ingest воркера widx или новый сокет */
+static relay_ingest_t *relay_ingest_acquire(const relay_source_t *src, int widx, int rx_batch)
+{
+    char *key = relay_source_key(src);
+    if(!key)
+        return NULL;
+
+    relay_ingest_t *in = relay_ingest_find(key, widx, src->packet ? 1 : 0);
+    if(!in && src->packet)
+        in = relay_ingest_find(key, widx, 0); // packet не поднялся: общий сокет
+    if(in)
+    {
+        free(key);
+        ++in->refcount;
+        if(src->mdi)
+            relay_ingest_open_stamps(in);
+        return in;
+    }
+
+    in = (relay_ingest_t *)calloc(1, sizeof(relay_ingest_t));
+    if(!in)
+    {
+        free(key);
+        return NULL;
+    }
+    in->event_type = RELAY_EVENT_INGEST;
+    in->key = key;
+    in->worker_index = widx;
+    in->refcount = 1;
+    in->fd = -1;
+    in->rx_batch = rx_batch;
+    pthread_mutex_init(&in->lock, NULL);
+
+    in->rx_msgs = (struct mmsghdr *)calloc((size_t)rx_batch, sizeof(struct mmsghdr));
+    in->rx_iov = (struct iovec *)calloc((size_t)rx_batch, sizeof(struct iovec));
+    in->rx_stamp = (uint64_t *)calloc((size_t)rx_batch, sizeof(uint64_t));
+    if(!in->rx_msgs || !in->rx_iov || !in->rx_stamp)
+    {
+        relay_ingest_free(in);
+        return NULL;
+    }
+    for(int i = 0; i < rx_batch; ++i)
+    {
+        in->rx_msgs[i].msg_hdr.msg_iov = &in->rx_iov[i];
+        in->rx_msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    relay_worker_t *w = &g_engine.workers[widx];
+    if(!(src->packet && relay_ingest_open_packet(in, src, w)))
+    {
+        in->sock = open_input_socket(src->addr, src->port, src->localaddr, src->socket_size);
+        if(!in->sock)
+        {
+            relay_ingest_free(in);
+            return NULL;
+        }
+        in->fd = asc_socket_fd(in->sock);
+        if(src->mdi)
+            relay_ingest_open_stamps(in);
+        if(src->gro && !relay_ingest_open_gro(in))
+        {
+            asc_log_warning("%s %s: UDP_GRO is not supported by kernel, receiving without GRO",
+                RELAY_MSG_PREFIX, in->key);
+        }
+        if(!in->gro)
+        {
+            in->rx_buffers = (uint8_t *)malloc((size_t)rx_batch * RELAY_UDP_BUFFER_SIZE);
+            if(!in->rx_buffers)
+            {
+                asc_socket_multicast_leave(in->sock);
+                relay_ingest_free(in);
+                return NULL;
+            }
+            for(int i = 0; i < rx_batch; ++i)
+            {
+                in->rx_iov[i].iov_base = in->rx_buffers + ((size_t)i * RELAY_UDP_BUFFER_SIZE);
+                in->rx_iov[i].iov_len = RELAY_UDP_BUFFER_SIZE;
+            }
+        }
+
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.ptr = in;
+        if(epoll_ctl(w->epoll_fd, EPOLL_CTL_ADD, in->fd, &ev) != 0)
+        {
+            asc_socket_multicast_leave(in->sock);
+            relay_ingest_free(in);
+            return NULL;
+        }
+    }
+
+    in->next = g_ingests;
+    g_ingests = in;
+    return in;
+}
+
+/* g_ingest_mu захвачен. Последний вход: группа покинута сразу, сокет закроет воркер */
+static void relay_ingest_release(relay_ingest_t *in)
+{
+    if(--in->refcount > 0)
+        return;
+
+    for(relay_ingest_t **p = &g_ingests; *p; p = &(*p)->next)
+    {
+        if(*p == in)
+        {
+            *p = in->next;
+            break;
+        }
+    }
+
+    relay_worker_t *w = &g_engine.workers[in->worker_index];
+    if(in->ring)
+        relay_ring_remove(in->ring, in);
+    else
+        epoll_ctl(w->epoll_fd, EPOLL_CTL_DEL, in->fd, NULL);
+    asc_socket_multicast_leave(in->sock);
+
+    pthread_mutex_lock(&w->reap_mu);
+    in->next = w->reap;
+    w->reap = in;
+    pthread_mutex_unlock(&w->reap_mu);
+
+    // будим воркер таймером пейсинга: сокет закроется сейчас, а не со следующим событием
+    relay_worker_wake(w);
+}
+
+static bool relay_ingest_subscribe(relay_ingest_t *in, relay_ctx_t *ctx, int leg)
+{
+    pthread_mutex_lock(&in->lock);
+    if(in->sub_count == in->sub_slots)
+    {
+        const int slots = in->sub_slots ? in->sub_slots * 2 : 4;
+        relay_ingest_sub_t *subs = (relay_ingest_sub_t *)realloc(in->subs, (size_t)slots * sizeof(relay_ingest_sub_t));
+        if(!subs)
+        {
+            pthread_mutex_unlock(&in->lock);
+            return false;
+        }
+        in->subs = subs;
+        in->sub_slots = slots;
+    }
+    in->subs[in->sub_count].ctx = ctx;
+    in->subs[in->sub_count].leg = leg;
+    __atomic_store_n(&in->sub_count, in->sub_count + 1, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&in->lock);
+    return true;
+}
+
+/* после возврата воркер не раздаёт ctx датаграммы этого ingest */
+static void relay_ingest_unsubscribe(relay_ingest_t *in, relay_ctx_t *ctx, int leg)
+{
+    pthread_mutex_lock(&in->lock);
+    for(int i = 0; i < in->sub_count; ++i)
+    {
+        if(in->subs[i].ctx == ctx && in->subs[i].leg == leg)
+        {
+            in->subs[i] = in->subs[in->sub_count - 1];
+            __atomic_store_n(&in->sub_count, in->sub_count - 1, __ATOMIC_RELAXED);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&in->lock);
+}
+
+/* g_ingest_mu захвачен */
+static void relay_source_close(relay_source_t *src, relay_ctx_t *ctx, int leg, bool subscribed)
+{
+    if(!src->ingest)
+        return;
+    if(subscribed)
+        relay_ingest_unsubscribe(src->ingest, ctx, leg);
+    relay_ingest_release(src->ingest);
+    src->ingest = NULL;
+}
+
+static void relay_source_clear(relay_source_t *src)
+{
+    free(src->addr);
+    free(src->localaddr);
+    free(src->ifname);
+    src->addr = NULL;
+    src->localaddr = NULL;
+    src->ifname = NULL;
+}
+
+/* g_ingest_mu захвачен. Воркер, где уже открыт вход потока или любой его leg */
+static int pick_worker_index_shared(relay_ctx_t *ctx)
+{
+    for(int i = -1; i < ctx->leg_count; ++i)
+    {
+        const relay_source_t *src = (i < 0) ? &ctx->in : &ctx->legs[i].in;
+        char *key = relay_source_key(src);
+        if(!key)
+            continue;
+        const relay_ingest_t *in = relay_ingest_find(key, -1, -1);
+        free(key);
+        if(in)
+            return in->worker_index;
+    }
+    return -1;
+}
+
+static bool ctx_register_in_engine(relay_ctx_t *ctx)
+{
+    if(!g_engine.started || !g_engine.workers || g_engine.workers_count <= 0)
+        return false;
+
+    pthread_mutex_lock(&g_ingest_mu);
+
+    int widx = pick_worker_index_shared(ctx);
+    if(widx < 0)
+        widx = ctx->worker_least_loaded ? pick_worker_index_least_loaded() : pick_worker_index(ctx->id);
+    if(widx < 0 || widx >= g_engine.workers_count)
+    {
+        pthread_mutex_unlock(&g_ingest_mu);
+        return false;
+    }
+
+    relay_worker_t *w = &g_engine.workers[widx];
+
+    // до подписки: первая датаграмма уже взводит таймер воркера
+    if(ctx->pace_ring && !relay_pace_register(w, ctx))
+    {
+        pthread_mutex_unlock(&g_ingest_mu);
+        return false;
+    }
+    ctx->worker_index = widx;
+
+    bool ok = true;
+    ctx->in.ingest = relay_ingest_acquire(&ctx->in, widx, ctx->rx_batch);
+    if(!ctx->in.ingest)
+        ok = false;
+    for(int i = 0; ok && i < ctx->leg_count; ++i)
+    {
+        ctx->legs[i].in.ingest = relay_ingest_acquire(&ctx->legs[i].in, widx, ctx->rx_batch);
+        if(!ctx->legs[i].in.ingest)
+            ok = false;
+    }
+
+    // подписка последней: без неё ingest не раздаёт потоку датаграммы
+    const bool main_subscribed = ok && relay_ingest_subscribe(ctx->in.ingest, ctx, 0);
+    ok = main_subscribed;
+    int subscribed = 0;
+    while(ok && subscribed < ctx->leg_count)
+    {
+        if(relay_ingest_subscribe(ctx->legs[subscribed].in.ingest, ctx, subscribed + 1))
+            ++subscribed;
+        else
+            ok = false;
+    }
+
+    if(!ok)
+    {
+        for(int i = 0; i < ctx->leg_count; ++i)
+            relay_source_close(&ctx->legs[i].in, ctx, i + 1, i < subscribed);
+        relay_source_close(&ctx->in, ctx, 0, main_subscribed);
+        pthread_mutex_unlock(&g_ingest_mu);
+        if(ctx->pace_ring)
+            relay_pace_unregister(w, ctx);
+        ctx->worker_index = -1;
+        return false;
+    }
+
+    ctx->engine_next = g_ctx_list;
+    g_ctx_list = ctx;
+    pthread_mutex_unlock(&g_ingest_mu);
+
+    __atomic_fetch_add(&w->active_streams, 1, __ATOMIC_RELAXED);
+    return true;
 }
 
 static void ctx_unregister_from_engine(relay_ctx_t *ctx)
@@ -655,9 +2892,298 @@ static void ctx_unregister_from_engine(relay_ctx_t *ctx)
     if(widx < 0 || widx >= g_engine.workers_count)
         return;
 
-    relay_worker_t *w = &g_engine.workers[widx];
-    epoll_ctl(w->epoll_fd, EPOLL_CTL_DEL, ctx->in_fd, NULL);
-    __atomic_fetch_sub(&w->active_streams, 1, __ATOMIC_RELAXED);
+    relay_worker_t *w = &g_engine.workers[widx];
+    pthread_mutex_lock(&g_ingest_mu);
+    for(relay_ctx_t **p = &g_ctx_list; *p; p = &(*p)->engine_next)
+    {
+        if(*p == ctx)
+        {
+            *p = ctx->engine_next;
+            break;
+        }
+    }
+    relay_source_close(&ctx->in, ctx, 0, true);
+    for(int i = 0; i < ctx->leg_count; ++i)
+        relay_source_close(&ctx->legs[i].in, ctx, i + 1, true);
+    pthread_mutex_unlock(&g_ingest_mu);
+    if(ctx->pace_ring)
+        relay_pace_unregister(w, ctx);
+
+    pthread_mutex_lock(&ctx->lock);
+    for(int i = 0; i < ctx->play_clients_slots; ++i)
+    {
+        if(ctx->play_clients[i])
+            relay_play_drop(ctx, ctx->play_clients[i]);
+    }
+    pthread_mutex_unlock(&ctx->lock);
+
+    __atomic_fetch_sub(&w->active_streams, 1, __ATOMIC_RELAXED);
+}
+
+/*
+ * Балансировка воркеров
+ */
+
+/* leg 0 - основной вход, иначе merge leg */
+static relay_ingest_t *relay_ctx_ingest(const relay_ctx_t *ctx, int leg)
+{
+    return (leg == 0) ? ctx->in.ingest : ctx->legs[leg - 1].in.ingest;
+}
+
+/* g_ingest_mu захвачен */
+static bool relay_ctx_movable(const relay_ctx_t *ctx)
+{
+    for(int leg = 0; leg <= ctx->leg_count; ++leg)
+    {
+        const relay_ingest_t *in = relay_ctx_ingest(ctx, leg);
+        // общий ingest держит чужие потоки на этом воркере, кольцо AF_PACKET у каждого воркера своё
+        if(in && (in->refcount > 1 || in->ring))
+            return false;
+    }
+    return true;
+}
+
+/* g_ingest_mu захвачен: пока старый epoll не отпустил сокет, его слушают оба */
+static bool relay_ingest_move(relay_ingest_t *in, relay_worker_t *from, relay_worker_t *to)
+{
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.ptr = in;
+    if(epoll_ctl(to->epoll_fd, EPOLL_CTL_ADD, in->fd, &ev) != 0)
+        return false;
+    epoll_ctl(from->epoll_fd, EPOLL_CTL_DEL, in->fd, NULL);
+    in->worker_index = to->index;
+    return true;
+}
+
+/*
+ * g_ingest_mu захвачен. Перенос потока на воркер to без закрытия сокетов: ingests
+ * и play клиенты переходят в epoll воркера to, пейсинг - в его таймер. Датаграммы
+ * ждут в буфере сокета. Событие, уже полученное старым воркером, он дообработает
+ * под in->lock и ctx->lock, порядок датаграмм сохраняется.
+ */
+static bool ctx_migrate(relay_ctx_t *ctx, int to_index)
+{
+    relay_worker_t *from = &g_engine.workers[ctx->worker_index];
+    relay_worker_t *to = &g_engine.workers[to_index];
+
+    if(ctx->pace_ring && !relay_pace_register(to, ctx))
+        return false;
+
+    int moved = 0;
+    while(moved <= ctx->leg_count)
+    {
+        relay_ingest_t *in = relay_ctx_ingest(ctx, moved);
+        if(in && !relay_ingest_move(in, from, to))
+            break;
+        ++moved;
+    }
+    if(moved <= ctx->leg_count)
+    {
+        while(moved-- > 0)
+        {
+            relay_ingest_t *in = relay_ctx_ingest(ctx, moved);
+            if(in)
+                relay_ingest_move(in, to, from);
+        }
+        if(ctx->pace_ring)
+            relay_pace_unregister(to, ctx);
+        return false;
+    }
+
+    pthread_mutex_lock(&ctx->lock);
+    ctx->worker_index = to_index;
+    for(int i = 0; i < ctx->play_clients_slots; ++i)
+    {
+        relay_play_client_t *c = ctx->play_clients[i];
+        if(!c || c->fd < 0)
+            continue;
+        epoll_ctl(from->epoll_fd, EPOLL_CTL_DEL, c->fd, NULL);
+        // ADD сразу сообщает EPOLLOUT, если в сокет можно писать
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLOUT | EPOLLET;
+        ev.data.ptr = c;
+        if(epoll_ctl(to->epoll_fd, EPOLL_CTL_ADD, c->fd, &ev) != 0)
+            relay_play_drop(ctx, c);
+    }
+    pthread_mutex_unlock(&ctx->lock);
+
+    if(ctx->pace_ring)
+    {
+        relay_pace_unregister(from, ctx);
+        relay_worker_wake(to);
+    }
+
+    __atomic_fetch_sub(&from->active_streams, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&to->active_streams, 1, __ATOMIC_RELAXED);
+    ++ctx->migrations;
+    return true;
+}
+
+static double relay_abs(double value)
+{
+    return (value < 0.0) ? -value : value;
+}
+
+/* g_ingest_mu захвачен: busy% воркеров и pps потоков за интервал */
+static void relay_balance_sample(uint64_t interval_us)
+{
+    for(int i = 0; i < g_engine.workers_count; ++i)
+    {
+        relay_worker_t *w = &g_engine.workers[i];
+        const uint64_t busy_us = __atomic_load_n(&w->busy_us, __ATOMIC_RELAXED);
+        const uint64_t datagrams = __atomic_load_n(&w->datagrams, __ATOMIC_RELAXED);
+        if(interval_us > 0)
+        {
+            w->busy_pct = (double)(busy_us - w->sample_busy_us) * 100.0 / (double)interval_us;
+            w->pps = (double)(datagrams - w->sample_datagrams) * 1000000.0 / (double)interval_us;
+        }
+        w->sample_busy_us = busy_us;
+        w->sample_datagrams = datagrams;
+        w->load_pps = 0.0;
+    }
+
+    // нагрузка потока: принятые и отправленные датаграммы, fan-out стоит воркеру как приём
+    for(relay_ctx_t *ctx = g_ctx_list; ctx; ctx = ctx->engine_next)
+    {
+        const uint64_t sample = __atomic_load_n(&ctx->datagrams_in, __ATOMIC_RELAXED)
+                              + __atomic_load_n(&ctx->datagrams_out, __ATOMIC_RELAXED);
+        if(interval_us > 0)
+            ctx->load_pps = (double)(sample - ctx->balance_sample) * 1000000.0 / (double)interval_us;
+        ctx->balance_sample = sample;
+        if(ctx->worker_index >= 0 && ctx->worker_index < g_engine.workers_count)
+            g_engine.workers[ctx->worker_index].load_pps += ctx->load_pps;
+    }
+}
+
+static void relay_balance_log(const relay_ctx_t *ctx, int from, int to, double from_busy, double to_busy)
+{
+    relay_balance_move_t *m = &g_balancer.log[g_balancer.log_count % RELAY_BALANCE_LOG];
+    ++g_balancer.log_count;
+    m->at = (uint64_t)time(NULL);
+    snprintf(m->id, sizeof(m->id), "%s", ctx->id);
+    m->from = from;
+    m->to = to;
+    m->load_pps = ctx->load_pps;
+    m->from_busy_pct = from_busy;
+    m->to_busy_pct = to_busy;
+
+    asc_log_info("%s rebalance: %s worker[%d] -> worker[%d], %.0f pps, busy %.1f%% / %.1f%%",
+        RELAY_MSG_PREFIX, ctx->id, from, to, ctx->load_pps, from_busy, to_busy);
+}
+
+/*
+ * Таймер main loop. Самый загруженный воркер отдаёт самому свободному поток, перенос
+ * которого сильнее всего сокращает разницу их busy%. Доля потока в busy% воркера -
+ * по его доле pps. Гистерезис: разница не меньше threshold_pct RELAY_BALANCE_CONFIRM
+ * интервалов подряд, поток дешевле разницы (без обратного перекоса), перенесённый поток
+ * RELAY_BALANCE_COOLDOWN интервалов не трогаем.
+ */
+static void relay_balance_on_timer(void *arg)
+{
+    __uarg(arg);
+    if(!g_engine.started || g_engine.workers_count <= 0)
+        return;
+
+    const uint64_t now_us = asc_utime();
+    const uint64_t interval_us = (g_balancer.sample_us != 0 && now_us > g_balancer.sample_us)
+        ? now_us - g_balancer.sample_us
+        : 0;
+    g_balancer.sample_us = now_us;
+
+    pthread_mutex_lock(&g_ingest_mu);
+    relay_balance_sample(interval_us);
+    if(interval_us == 0 || g_engine.workers_count <= 1)
+    {
+        pthread_mutex_unlock(&g_ingest_mu);
+        return;
+    }
+    ++g_balancer.runs;
+
+    // оценка после переносов этого интервала
+    double busy[64];
+    double load[64];
+    for(int i = 0; i < g_engine.workers_count; ++i)
+    {
+        busy[i] = g_engine.workers[i].busy_pct;
+        load[i] = g_engine.workers[i].load_pps;
+    }
+
+    const double threshold = (double)g_balancer.threshold_pct;
+    int moves = 0;
+    while(moves < g_balancer.max_moves)
+    {
+        int hot = 0;
+        int cold = 0;
+        for(int i = 1; i < g_engine.workers_count; ++i)
+        {
+            if(busy[i] > busy[hot])
+                hot = i;
+            if(busy[i] < busy[cold])
+                cold = i;
+        }
+        const double gap = busy[hot] - busy[cold];
+        if(moves == 0)
+        {
+            g_balancer.imbalance_pct = gap;
+            if(gap < threshold)
+                g_balancer.imbalance_runs = 0;
+            else
+                ++g_balancer.imbalance_runs;
+            if(g_balancer.imbalance_runs < RELAY_BALANCE_CONFIRM)
+                break;
+        }
+        else if(gap < threshold)
+            break;
+
+        relay_ctx_t *best = NULL;
+        double best_share = 0.0;
+        double best_gain = threshold / 2.0; // мелкие переносы не окупаются
+        for(relay_ctx_t *ctx = g_ctx_list; ctx && load[hot] > 0.0; ctx = ctx->engine_next)
+        {
+            if(ctx->worker_index != hot || ctx->load_pps <= 0.0)
+                continue;
+            if(ctx->migrations > 0 && g_balancer.runs - ctx->balance_moved_run < RELAY_BALANCE_COOLDOWN)
+                continue;
+            const double share = busy[hot] * ctx->load_pps / load[hot];
+            const double gain = gap - relay_abs(gap - 2.0 * share);
+            if(gain <= best_gain)
+                continue;
+            if(!relay_ctx_movable(ctx))
+            {
+                ++g_balancer.skipped;
+                continue;
+            }
+            best = ctx;
+            best_share = share;
+            best_gain = gain;
+        }
+        if(!best)
+            break;
+
+        if(!ctx_migrate(best, cold))
+        {
+            ++g_balancer.failures;
+            asc_log_warning("%s rebalance: failed to move %s worker[%d] -> worker[%d]",
+                RELAY_MSG_PREFIX, best->id, hot, cold);
+            break;
+        }
+        best->balance_moved_run = g_balancer.runs;
+        ++g_balancer.migrations;
+        relay_balance_log(best, hot, cold, busy[hot], busy[cold]);
+
+        busy[hot] -= best_share;
+        busy[cold] += best_share;
+        load[hot] -= best->load_pps;
+        load[cold] += best->load_pps;
+        ++moves;
+    }
+    if(moves > 0)
+        g_balancer.imbalance_runs = 0;
+
+    pthread_mutex_unlock(&g_ingest_mu);
 }
 
 static void free_ctx(relay_ctx_t *ctx)
@@ -665,11 +3191,28 @@ static void free_ctx(relay_ctx_t *ctx)
     if(!ctx)
         return;
 
-    if(ctx->in_sock)
+    relay_source_clear(&ctx->in);
+
+    if(ctx->legs)
+    {
+        for(int i = 0; i < ctx->leg_count; ++i)
+        {
+            relay_source_clear(&ctx->legs[i].in);
+            free(ctx->legs[i].source);
+        }
+        free(ctx->legs);
+        ctx->legs = NULL;
+        ctx->leg_count = 0;
+    }
+    if(ctx->merge)
     {
-        asc_socket_multicast_leave(ctx->in_sock);
-        asc_socket_close(ctx->in_sock);
-        ctx->in_sock = NULL;
+        free(ctx->merge);
+        ctx->merge = NULL;
+    }
+    if(ctx->mdi)
+    {
+        free(ctx->mdi);
+        ctx->mdi = NULL;
     }
 
     if(ctx->outs)
@@ -686,27 +3229,68 @@ static void free_ctx(relay_ctx_t *ctx)
                 free(ctx->outs[i].dst_addr);
                 ctx->outs[i].dst_addr = NULL;
             }
+            free(ctx->outs[i].fec);
+            ctx->outs[i].fec = NULL;
         }
         free(ctx->outs);
         ctx->outs = NULL;
         ctx->out_count = 0;
     }
 
-    if(ctx->rx_buffers)
+    if(ctx->play_clients)
+    {
+        for(int i = 0; i < ctx->play_clients_slots; ++i)
+        {
+            relay_play_client_t *c = ctx->play_clients[i];
+            if(!c)
+                continue;
+            if(c->fd >= 0)
+            {
+                shutdown(c->fd, SHUT_RDWR);
+                close(c->fd);
+            }
+            free(c);
+        }
+        free(ctx->play_clients);
+        ctx->play_clients = NULL;
+    }
+    if(ctx->play_ring)
+    {
+        free(ctx->play_ring);
+        ctx->play_ring = NULL;
+    }
+    if(ctx->play_ring_size)
+    {
+        free(ctx->play_ring_size);
+        ctx->play_ring_size = NULL;
+    }
+
+    if(ctx->pace_ring)
+    {
+        free(ctx->pace_ring);
+        ctx->pace_ring = NULL;
+    }
+    if(ctx->pace_ring_size)
     {
-        free(ctx->rx_buffers);
-        ctx->rx_buffers = NULL;
+        free(ctx->pace_ring_size);
+        ctx->pace_ring_size = NULL;
     }
-    if(ctx->rx_iov)
+    if(ctx->pace_msgs)
     {
-        free(ctx->rx_iov);
-        ctx->rx_iov = NULL;
+        free(ctx->pace_msgs);
+        ctx->pace_msgs = NULL;
     }
-    if(ctx->rx_msgs)
+    if(ctx->pace_iov)
     {
-        free(ctx->rx_msgs);
-        ctx->rx_msgs = NULL;
+        free(ctx->pace_iov);
+        ctx->pace_iov = NULL;
     }
+    if(ctx->pace_hdr)
+    {
+        free(ctx->pace_hdr);
+        ctx->pace_hdr = NULL;
+    }
+
     if(ctx->tx_iov)
     {
         free(ctx->tx_iov);
@@ -717,6 +3301,31 @@ static void free_ctx(relay_ctx_t *ctx)
         free(ctx->tx_msgs);
         ctx->tx_msgs = NULL;
     }
+    if(ctx->tx_rtp_msgs)
+    {
+        free(ctx->tx_rtp_msgs);
+        ctx->tx_rtp_msgs = NULL;
+    }
+    if(ctx->tx_rtp_iov)
+    {
+        free(ctx->tx_rtp_iov);
+        ctx->tx_rtp_iov = NULL;
+    }
+    if(ctx->tx_rtp_hdr)
+    {
+        free(ctx->tx_rtp_hdr);
+        ctx->tx_rtp_hdr = NULL;
+    }
+    if(ctx->tx_gso_msgs)
+    {
+        free(ctx->tx_gso_msgs);
+        ctx->tx_gso_msgs = NULL;
+    }
+    if(ctx->tx_gso_cmsg)
+    {
+        free(ctx->tx_gso_cmsg);
+        ctx->tx_gso_cmsg = NULL;
+    }
 
     if(ctx->id)
     {
@@ -758,23 +3367,6 @@ static int table_get_int(lua_State *L, int idx, const char *key, int fallback)
     return out;
 }
 
-static asc_socket_t *open_input_socket(const char *addr, int port, const char *localaddr, int socket_size)
-{
-    asc_socket_t *sock = asc_socket_open_udp4(NULL);
-    if(!sock)
-        return NULL;
-    asc_socket_set_reuseaddr(sock, 1);
-    if(!asc_socket_bind(sock, addr, port))
-    {
-        asc_socket_close(sock);
-        return NULL;
-    }
-    if(socket_size > 0)
-        asc_socket_set_buffer(sock, socket_size, 0);
-    asc_socket_multicast_join(sock, addr, localaddr);
-    return sock;
-}
-
 static asc_socket_t *open_output_socket(const char *addr, int port, const char *localaddr, int ttl, int socket_size)
 {
     asc_socket_t *sock = asc_socket_open_udp4(NULL);
@@ -797,6 +3389,21 @@ static asc_socket_t *open_output_socket(const char *addr, int port, const char *
     return sock;
 }
 
+/* { ingest = "packet", ifname, ring_mb, gro } входа или merge leg */
+static bool relay_source_backend(lua_State *L, int idx, relay_source_t *src)
+{
+    src->gro = table_get_int(L, idx, "gro", 0) ? true : false;
+    src->mdi = table_get_int(L, idx, "mdi", 0) ? true : false;
+    const char *ingest = table_get_string(L, idx, "ingest");
+    if(!ingest || strcmp(ingest, "packet") != 0)
+        return true;
+    const char *ifname = table_get_string(L, idx, "ifname");
+    src->packet = true;
+    src->ring_mb = table_get_int(L, idx, "ring_mb", RELAY_RING_MB_DEFAULT);
+    src->ifname = (ifname && ifname[0]) ? strdup(ifname) : NULL;
+    return !ifname || !ifname[0] || src->ifname;
+}
+
 static relay_ctx_t *create_ctx(lua_State *L, int opts_idx)
 {
     const char *id = table_get_string(L, opts_idx, "id");
@@ -805,6 +3412,7 @@ static relay_ctx_t *create_ctx(lua_State *L, int opts_idx)
 
     const char *worker_policy = table_get_string(L, opts_idx, "worker_policy");
     const bool probe_only = table_get_int(L, opts_idx, "probe_only", 0) ? true : false;
+    const bool ts_meter = table_get_int(L, opts_idx, "ts_meter", 1) ? true : false;
 
     // input
     lua_getfield(L, opts_idx, "input");
@@ -819,10 +3427,17 @@ static relay_ctx_t *create_ctx(lua_State *L, int opts_idx)
     const char *in_local = table_get_string(L, input_idx, "localaddr");
     const int in_socket_size = table_get_int(L, input_idx, "socket_size", 0);
     const char *input_url = table_get_string(L, input_idx, "source_url");
+    const bool in_rtp = table_get_int(L, input_idx, "rtp", 0) ? true : false;
+    relay_source_t in_backend;
+    memset(&in_backend, 0, sizeof(in_backend));
+    const bool in_backend_ok = relay_source_backend(L, input_idx, &in_backend);
     lua_pop(L, 1); // input
 
-    if(!in_addr || !in_addr[0] || in_port <= 0 || in_port > 65535)
+    if(!in_backend_ok || !in_addr || !in_addr[0] || in_port <= 0 || in_port > 65535)
+    {
+        relay_source_clear(&in_backend);
         return NULL;
+    }
 
     // outputs
     lua_getfield(L, opts_idx, "outputs");
@@ -847,6 +3462,7 @@ static relay_ctx_t *create_ctx(lua_State *L, int opts_idx)
     relay_ctx_t *ctx = (relay_ctx_t *)calloc(1, sizeof(relay_ctx_t));
     if(!ctx)
     {
+        relay_source_clear(&in_backend);
         lua_pop(L, 1);
         return NULL;
     }
@@ -858,6 +3474,8 @@ static relay_ctx_t *create_ctx(lua_State *L, int opts_idx)
     ctx->started_us = asc_utime();
     ctx->last_rx_us = 0;
     ctx->packet_skip = 0;
+    ctx->rtp = in_rtp;
+    ctx->ts_meter = ts_meter;
 
     ctx->id = strdup(id);
     ctx->input_url = input_url ? strdup(input_url) : NULL;
@@ -865,14 +3483,87 @@ static relay_ctx_t *create_ctx(lua_State *L, int opts_idx)
     ctx->rx_batch = table_get_int(L, opts_idx, "rx_batch", RELAY_RX_BATCH_DEFAULT);
     ctx->rx_batch = clamp_int(ctx->rx_batch, 1, RELAY_RX_BATCH_MAX);
 
-    ctx->in_sock = open_input_socket(in_addr, in_port, in_local, in_socket_size);
-    if(!ctx->in_sock)
+    // сокет входа открывает (или находит общий) ctx_register_in_engine
+    ctx->in.addr = strdup(in_addr);
+    ctx->in.port = in_port;
+    ctx->in.localaddr = (in_local && in_local[0]) ? strdup(in_local) : NULL;
+    ctx->in.socket_size = in_socket_size;
+    ctx->in.packet = in_backend.packet;
+    ctx->in.ifname = in_backend.ifname;
+    ctx->in.ring_mb = in_backend.ring_mb;
+    ctx->in.gro = in_backend.gro;
+    ctx->in.mdi = in_backend.mdi;
+    if(ctx->in.mdi)
+    {
+        ctx->mdi = (udp_mdi_t *)malloc(sizeof(udp_mdi_t));
+        if(ctx->mdi)
+            udp_mdi_init(ctx->mdi);
+    }
+    if(!ctx->in.addr || (in_local && in_local[0] && !ctx->in.localaddr) || (ctx->in.mdi && !ctx->mdi))
     {
         free_ctx(ctx);
         lua_pop(L, 1);
         return NULL;
     }
-    ctx->in_fd = asc_socket_fd(ctx->in_sock);
+
+    // merge = { { addr, port, localaddr, socket_size }, ... } - остальные legs 2022-7 (только RTP)
+    lua_getfield(L, opts_idx, "merge");
+    if(lua_type(L, -1) == LUA_TTABLE)
+    {
+        const int merge_idx = lua_gettop(L);
+        int leg_count = (int)luaL_len(L, merge_idx);
+        if(leg_count > RTP_MERGE_LEGS_MAX - 1)
+            leg_count = RTP_MERGE_LEGS_MAX - 1;
+
+        if(leg_count > 0)
+        {
+            ctx->legs = (relay_leg_t *)calloc((size_t)leg_count, sizeof(relay_leg_t));
+            ctx->merge = (rtp_merge_t *)malloc(sizeof(rtp_merge_t));
+            if(!in_rtp || !ctx->legs || !ctx->merge)
+            {
+                lua_pop(L, 1);
+                free_ctx(ctx);
+                lua_pop(L, 1);
+                return NULL;
+            }
+            rtp_merge_init(ctx->merge, leg_count + 1
+                           , table_get_int(L, opts_idx, "merge_window", RTP_MERGE_WINDOW_DEFAULT));
+        }
+
+        for(int i = 0; i < leg_count; ++i)
+        {
+            lua_rawgeti(L, merge_idx, i + 1);
+            const int leg_idx = lua_gettop(L);
+            const char *leg_addr = (lua_type(L, leg_idx) == LUA_TTABLE) ? table_get_string(L, leg_idx, "addr") : NULL;
+            const int leg_port = leg_addr ? table_get_int(L, leg_idx, "port", 0) : 0;
+            relay_leg_t *leg = &ctx->legs[i];
+            bool leg_ok = false;
+            if(leg_addr && leg_addr[0] && leg_port > 0 && leg_port <= 65535)
+            {
+                const char *leg_local = table_get_string(L, leg_idx, "localaddr");
+                leg->in.addr = strdup(leg_addr);
+                leg->in.port = leg_port;
+                leg->in.localaddr = (leg_local && leg_local[0]) ? strdup(leg_local) : NULL;
+                leg->in.socket_size = table_get_int(L, leg_idx, "socket_size", 0);
+                leg->source = (char *)malloc(strlen(leg_addr) + 16);
+                if(leg->source)
+                    sprintf(leg->source, "rtp://%s:%d", leg_addr, leg_port);
+                leg_ok = leg->in.addr && leg->source && (!leg_local || !leg_local[0] || leg->in.localaddr)
+                    && relay_source_backend(L, leg_idx, &leg->in);
+            }
+            lua_pop(L, 1);
+            ++ctx->leg_count;
+
+            if(!leg_ok)
+            {
+                lua_pop(L, 1);
+                free_ctx(ctx);
+                lua_pop(L, 1);
+                return NULL;
+            }
+        }
+    }
+    lua_pop(L, 1); // merge
 
     if(out_len > 0)
     {
@@ -902,6 +3593,9 @@ static relay_ctx_t *create_ctx(lua_State *L, int opts_idx)
         const char *out_local = table_get_string(L, out_idx, "localaddr");
         const int out_ttl = table_get_int(L, out_idx, "ttl", 32);
         const int out_socket_size = table_get_int(L, out_idx, "socket_size", 0);
+        const bool out_rtp = table_get_int(L, out_idx, "rtp", 0) ? true : false;
+        const char *out_pace = table_get_string(L, out_idx, "pace");
+        const bool out_gso = table_get_int(L, out_idx, "gso", 0) ? true : false;
 
         if(!out_addr || !out_addr[0] || out_port <= 0 || out_port > 65535)
         {
@@ -919,6 +3613,49 @@ static relay_ctx_t *create_ctx(lua_State *L, int opts_idx)
         ctx->outs[i - 1].dst_sa.sin_addr.s_addr = inet_addr(out_addr);
         ctx->outs[i - 1].dst_sa.sin_port = htons(out_port);
         ctx->outs[i - 1].dst_sa_len = sizeof(struct sockaddr_in);
+        if(out_rtp)
+        {
+            ctx->outs[i - 1].rtp = true;
+            ctx->outs[i - 1].rtp_seq = (uint16_t)rand();
+            ctx->outs[i - 1].rtp_ssrc = (uint32_t)rand();
+            ++ctx->rtp_out_count;
+
+            const int fec_cols = table_get_int(L, out_idx, "fec_cols", 0);
+            const int fec_rows = table_get_int(L, out_idx, "fec_rows", 0);
+            if(fec_cols >= 1 && fec_cols <= RTP_FEC_COLS_MAX && fec_rows >= RTP_FEC_ROWS_MIN
+               && fec_rows <= RTP_FEC_ROWS_MAX && fec_cols * fec_rows <= RTP_FEC_MATRIX_MAX)
+            {
+                relay_output_t *out = &ctx->outs[i - 1];
+                out->fec = (rtp_fec_encoder_t *)malloc(sizeof(rtp_fec_encoder_t));
+                if(!out->fec)
+                {
+                    lua_pop(L, 1);
+                    free_ctx(ctx);
+                    lua_pop(L, 1);
+                    return NULL;
+                }
+                rtp_fec_encoder_init(out->fec, fec_cols, fec_rows, table_get_int(L, out_idx, "fec_row", 1) != 0);
+                out->fec_sa[RTP_FEC_COLUMN] = out->dst_sa;
+                out->fec_sa[RTP_FEC_COLUMN].sin_port = htons(out_port + RTP_FEC_PORT_COLUMN);
+                out->fec_sa[RTP_FEC_ROW] = out->dst_sa;
+                out->fec_sa[RTP_FEC_ROW].sin_port = htons(out_port + RTP_FEC_PORT_ROW);
+                ++ctx->fec_out_count;
+            }
+        }
+        if(out_pace && (!strcmp(out_pace, "bitrate") || !strcmp(out_pace, "pcr")))
+        {
+            relay_output_t *out = &ctx->outs[i - 1];
+            out->pace = !strcmp(out_pace, "pcr") ? RELAY_PACE_PCR : RELAY_PACE_BITRATE;
+            out->pace_queue = clamp_int(table_get_int(L, out_idx, "pace_queue", RELAY_PACE_QUEUE_DEFAULT)
+                                        , RELAY_PACE_BURST_MAX, RELAY_PACE_QUEUE_MAX);
+            out->pace_burst = clamp_int(table_get_int(L, out_idx, "pace_burst", RELAY_PACE_BURST_DEFAULT)
+                                        , 1, RELAY_PACE_BURST_MAX);
+            if(out->pace == RELAY_PACE_PCR)
+                ctx->pace_pcr = true;
+            if(out->pace_queue > ctx->pace_ring_slots)
+                ctx->pace_ring_slots = out->pace_queue;
+            ++ctx->pace_out_count;
+        }
         lua_pop(L, 1);
         if(!ctx->outs[i - 1].sock || !ctx->outs[i - 1].dst_addr)
         {
@@ -926,41 +3663,93 @@ static relay_ctx_t *create_ctx(lua_State *L, int opts_idx)
             lua_pop(L, 1);
             return NULL;
         }
+        // paced output отправляет слоты по pace_burst, GSO там не нужен
+        if(out_gso && !ctx->outs[i - 1].pace)
+        {
+            if(udp_gso_probe(asc_socket_fd(ctx->outs[i - 1].sock)))
+            {
+                ctx->outs[i - 1].gso = true;
+                ++ctx->gso_out_count;
+            }
+            else
+            {
+                asc_log_warning("%s[%s] UDP_SEGMENT is not supported by kernel; dst=%s:%d sends without GSO",
+                    RELAY_MSG_PREFIX, id, out_addr, out_port);
+            }
+        }
     }
 
-    // allocate recvmmsg buffers
-    ctx->rx_msgs = (struct mmsghdr *)calloc((size_t)ctx->rx_batch, sizeof(struct mmsghdr));
-    ctx->rx_iov = (struct iovec *)calloc((size_t)ctx->rx_batch, sizeof(struct iovec));
-    ctx->rx_buffers = (uint8_t *)malloc((size_t)ctx->rx_batch * RELAY_UDP_BUFFER_SIZE);
-    if(!ctx->rx_msgs || !ctx->rx_iov || !ctx->rx_buffers)
+    // sendmmsg: iov указывает в буферы общего ingest, batch которого может быть
+    // больше rx_batch этого потока - массивы на RELAY_RX_BATCH_MAX
+    ctx->tx_msgs = (struct mmsghdr *)calloc(RELAY_RX_BATCH_MAX, sizeof(struct mmsghdr));
+    ctx->tx_iov = (struct iovec *)calloc(RELAY_RX_BATCH_MAX, sizeof(struct iovec));
+    if(!ctx->tx_msgs || !ctx->tx_iov)
     {
         free_ctx(ctx);
         lua_pop(L, 1);
         return NULL;
     }
-    for(int i = 0; i < ctx->rx_batch; ++i)
+    for(int i = 0; i < RELAY_RX_BATCH_MAX; ++i)
     {
-        ctx->rx_iov[i].iov_base = ctx->rx_buffers + ((size_t)i * RELAY_UDP_BUFFER_SIZE);
-        ctx->rx_iov[i].iov_len = RELAY_UDP_BUFFER_SIZE;
-        ctx->rx_msgs[i].msg_hdr.msg_iov = &ctx->rx_iov[i];
-        ctx->rx_msgs[i].msg_hdr.msg_iovlen = 1;
+        ctx->tx_iov[i].iov_len = (size_t)(TS_PACKET_SIZE * 7);
+        ctx->tx_msgs[i].msg_hdr.msg_iov = &ctx->tx_iov[i];
+        ctx->tx_msgs[i].msg_hdr.msg_iovlen = 1;
     }
 
-    // allocate sendmmsg buffers (fast-path only for 1316)
-    ctx->tx_msgs = (struct mmsghdr *)calloc((size_t)ctx->rx_batch, sizeof(struct mmsghdr));
-    ctx->tx_iov = (struct iovec *)calloc((size_t)ctx->rx_batch, sizeof(struct iovec));
-    if(!ctx->tx_msgs || !ctx->tx_iov)
+    // RTP outputs: {заголовок, payload}, payload подставляется на каждый batch
+    if(ctx->rtp_out_count > 0)
     {
-        free_ctx(ctx);
-        lua_pop(L, 1);
-        return NULL;
+        ctx->tx_rtp_msgs = (struct mmsghdr *)calloc(RELAY_RX_BATCH_MAX, sizeof(struct mmsghdr));
+        ctx->tx_rtp_iov = (struct iovec *)calloc(RELAY_RX_BATCH_MAX * 2, sizeof(struct iovec));
+        ctx->tx_rtp_hdr = (uint8_t *)calloc(RELAY_RX_BATCH_MAX, RTP_HEADER_SIZE);
+        if(!ctx->tx_rtp_msgs || !ctx->tx_rtp_iov || !ctx->tx_rtp_hdr)
+        {
+            free_ctx(ctx);
+            lua_pop(L, 1);
+            return NULL;
+        }
+        for(int i = 0; i < RELAY_RX_BATCH_MAX; ++i)
+        {
+            ctx->tx_rtp_iov[i * 2].iov_base = &ctx->tx_rtp_hdr[i * RTP_HEADER_SIZE];
+            ctx->tx_rtp_iov[i * 2].iov_len = RTP_HEADER_SIZE;
+            ctx->tx_rtp_msgs[i].msg_hdr.msg_iov = &ctx->tx_rtp_iov[i * 2];
+            ctx->tx_rtp_msgs[i].msg_hdr.msg_iovlen = 2;
+        }
     }
-    for(int i = 0; i < ctx->rx_batch; ++i)
+
+    // GSO outputs: серий в batch не больше, чем датаграмм
+    if(ctx->gso_out_count > 0)
     {
-        ctx->tx_iov[i].iov_base = ctx->rx_buffers + ((size_t)i * RELAY_UDP_BUFFER_SIZE);
-        ctx->tx_iov[i].iov_len = (size_t)(TS_PACKET_SIZE * 7);
-        ctx->tx_msgs[i].msg_hdr.msg_iov = &ctx->tx_iov[i];
-        ctx->tx_msgs[i].msg_hdr.msg_iovlen = 1;
+        ctx->tx_gso_msgs = (struct mmsghdr *)calloc(RELAY_RX_BATCH_MAX, sizeof(struct mmsghdr));
+        ctx->tx_gso_cmsg = (uint8_t *)calloc(RELAY_RX_BATCH_MAX, UDP_GSO_CMSG_SIZE);
+        if(!ctx->tx_gso_msgs || !ctx->tx_gso_cmsg)
+        {
+            free_ctx(ctx);
+            lua_pop(L, 1);
+            return NULL;
+        }
+    }
+
+    // paced outputs: кольцо на самую длинную очередь, sendmmsg слота
+    if(ctx->pace_out_count > 0)
+    {
+        ctx->pace_pcr_pid = -1;
+        ctx->pace_ring = (uint8_t *)malloc((size_t)ctx->pace_ring_slots * RELAY_UDP_BUFFER_SIZE);
+        ctx->pace_ring_size = (uint16_t *)calloc((size_t)ctx->pace_ring_slots, sizeof(uint16_t));
+        ctx->pace_msgs = (struct mmsghdr *)calloc(RELAY_PACE_BURST_MAX, sizeof(struct mmsghdr));
+        ctx->pace_iov = (struct iovec *)calloc(RELAY_PACE_BURST_MAX * 2, sizeof(struct iovec));
+        ctx->pace_hdr = (uint8_t *)calloc(RELAY_PACE_BURST_MAX, RTP_HEADER_SIZE);
+        if(!ctx->pace_ring || !ctx->pace_ring_size || !ctx->pace_msgs || !ctx->pace_iov || !ctx->pace_hdr)
+        {
+            free_ctx(ctx);
+            lua_pop(L, 1);
+            return NULL;
+        }
+        for(int i = 0; i < RELAY_PACE_BURST_MAX; ++i)
+        {
+            ctx->pace_iov[i * 2].iov_base = &ctx->pace_hdr[i * RTP_HEADER_SIZE];
+            ctx->pace_iov[i * 2].iov_len = RTP_HEADER_SIZE;
+        }
     }
 
     lua_pop(L, 1); // outputs (или nil)
@@ -969,58 +3758,409 @@ static relay_ctx_t *create_ctx(lua_State *L, int opts_idx)
 
 // Lua bindings
 
-#define RELAY_MT "udp_relay.handle"
+#define RELAY_MT "udp_relay.handle"
+
+static relay_ctx_t *check_handle(lua_State *L)
+{
+    relay_ctx_t **p = (relay_ctx_t **)luaL_checkudata(L, 1, RELAY_MT);
+    return p ? *p : NULL;
+}
+
+static void destroy_handle(relay_ctx_t *ctx)
+{
+    if(!ctx)
+        return;
+
+    pthread_mutex_lock(&ctx->lock);
+    ctx->closing = true;
+    pthread_mutex_unlock(&ctx->lock);
+
+    ctx_unregister_from_engine(ctx);
+
+    // Дожидаемся завершения возможного обработчика epoll-события.
+    for(int i = 0; i < 200; ++i)
+    {
+        const int rc = __atomic_load_n(&ctx->refcount, __ATOMIC_RELAXED);
+        if(rc <= 0)
+            break;
+        asc_usleep(1000);
+    }
+
+    free_ctx(ctx);
+}
+
+static int relay_handle_close(lua_State *L)
+{
+    relay_ctx_t **p = (relay_ctx_t **)luaL_checkudata(L, 1, RELAY_MT);
+    if(p && *p)
+    {
+        destroy_handle(*p);
+        *p = NULL;
+    }
+    lua_pushboolean(L, 1);
+    return 1;
+}
+
+static int relay_handle_gc(lua_State *L)
+{
+    relay_ctx_t **p = (relay_ctx_t **)luaL_checkudata(L, 1, RELAY_MT);
+    if(p && *p)
+    {
+        destroy_handle(*p);
+        *p = NULL;
+    }
+    return 0;
+}
+
+/* stats.ts: без лока, воркер продолжает писать счётчики */
+static void relay_push_ts_stats(lua_State *L, relay_ctx_t *ctx, bool on_air)
+{
+    const int count = __atomic_load_n(&ctx->pid_count, __ATOMIC_ACQUIRE);
+
+    uint64_t cc_errors = 0;
+    bool pat_seen = false;
+    bool pmt_seen = false;
+    bool scrambled = false;
+    int pcr_pid = -1;
+
+    lua_newtable(L); // ts
+    lua_newtable(L); // pids
+    for(int i = 0; i < count; ++i)
+    {
+        relay_pid_t *p = &ctx->pids[i];
+        const uint64_t packets = __atomic_load_n(&p->packets, __ATOMIC_RELAXED);
+        const uint64_t p_cc_errors = __atomic_load_n(&p->cc_errors, __ATOMIC_RELAXED);
+        const uint64_t pcr_count = __atomic_load_n(&p->pcr_count, __ATOMIC_RELAXED);
+        const bool p_scrambled = __atomic_load_n(&p->scrambled, __ATOMIC_RELAXED) != 0;
+        const bool is_pmt = __atomic_load_n(&p->pmt, __ATOMIC_RELAXED) != 0;
+
+        cc_errors += p_cc_errors;
+        if(p->pid == 0 && packets > 0)
+            pat_seen = true;
+        if(is_pmt && packets > 0)
+            pmt_seen = true;
+        if(p_scrambled)
+            scrambled = true;
+        if(pcr_count > 0 && pcr_pid < 0)
+            pcr_pid = p->pid;
+
+        lua_newtable(L);
+
+        lua_pushinteger(L, (lua_Integer)p->pid);
+        lua_setfield(L, -2, "pid");
+
+        lua_pushinteger(L, (lua_Integer)packets);
+        lua_setfield(L, -2, "packets");
+
+        lua_pushinteger(L, (lua_Integer)p_cc_errors);
+        lua_setfield(L, -2, "cc_errors");
+
+        lua_pushinteger(L, on_air ? (lua_Integer)__atomic_load_n(&p->bitrate, __ATOMIC_RELAXED) : 0);
+        lua_setfield(L, -2, "bitrate");
+
+        lua_pushboolean(L, p_scrambled ? 1 : 0);
+        lua_setfield(L, -2, "scrambled");
+
+        if(is_pmt)
+        {
+            lua_pushboolean(L, 1);
+            lua_setfield(L, -2, "pmt");
+        }
+
+        if(pcr_count > 0)
+        {
+            lua_pushinteger(L, (lua_Integer)pcr_count);
+            lua_setfield(L, -2, "pcr_count");
+
+            lua_pushinteger(L, (lua_Integer)__atomic_load_n(&p->pcr_interval_us, __ATOMIC_RELAXED));
+            lua_setfield(L, -2, "pcr_interval_us");
+
+            lua_pushinteger(L, (lua_Integer)__atomic_load_n(&p->pcr_interval_max_us, __ATOMIC_RELAXED));
+            lua_setfield(L, -2, "pcr_interval_max_us");
+
+            lua_pushinteger(L, (lua_Integer)__atomic_load_n(&p->pcr_jitter_max_us, __ATOMIC_RELAXED));
+            lua_setfield(L, -2, "pcr_jitter_max_us");
+        }
+
+        lua_rawseti(L, -2, i + 1);
+    }
+    lua_setfield(L, -2, "pids");
+
+    lua_pushinteger(L, (lua_Integer)cc_errors);
+    lua_setfield(L, -2, "cc_errors");
+
+    lua_pushboolean(L, pat_seen ? 1 : 0);
+    lua_setfield(L, -2, "pat_seen");
+
+    lua_pushboolean(L, pmt_seen ? 1 : 0);
+    lua_setfield(L, -2, "pmt_seen");
+
+    lua_pushboolean(L, scrambled ? 1 : 0);
+    lua_setfield(L, -2, "scrambled");
+
+    if(pcr_pid >= 0)
+    {
+        lua_pushinteger(L, (lua_Integer)pcr_pid);
+        lua_setfield(L, -2, "pcr_pid");
+    }
+
+    lua_pushinteger(L, (lua_Integer)__atomic_load_n(&ctx->pid_overflow, __ATOMIC_RELAXED));
+    lua_setfield(L, -2, "pid_overflow");
+
+    lua_setfield(L, -2, "ts");
+}
+
+/* ingest: общий сокет входа, счётчики - все датаграммы до раздачи подписчикам */
+static void relay_push_ingest_stats(lua_State *L, const relay_ingest_t *in)
+{
+    const int subscribers = __atomic_load_n(&in->sub_count, __ATOMIC_RELAXED);
+
+    lua_newtable(L);
+
+    lua_pushstring(L, in->key);
+    lua_setfield(L, -2, "key");
+
+    lua_pushinteger(L, (lua_Integer)in->worker_index);
+    lua_setfield(L, -2, "worker");
+
+    lua_pushinteger(L, (lua_Integer)subscribers);
+    lua_setfield(L, -2, "subscribers");
+
+    lua_pushboolean(L, subscribers > 1 ? 1 : 0);
+    lua_setfield(L, -2, "shared");
+
+    lua_pushinteger(L, (lua_Integer)__atomic_load_n(&in->datagrams, __ATOMIC_RELAXED));
+    lua_setfield(L, -2, "datagrams");
+
+    lua_pushinteger(L, (lua_Integer)__atomic_load_n(&in->bytes, __ATOMIC_RELAXED));
+    lua_setfield(L, -2, "bytes");
+
+    lua_pushstring(L, in->ring ? "packet" : "socket");
+    lua_setfield(L, -2, "backend");
+
+    if(!in->ring)
+    {
+        lua_pushinteger(L, (lua_Integer)__atomic_load_n(&in->reads, __ATOMIC_RELAXED));
+        lua_setfield(L, -2, "reads");
+
+        lua_pushboolean(L, in->gro ? 1 : 0);
+        lua_setfield(L, -2, "gro");
+
+        lua_pushboolean(L, in->timestamps ? 1 : 0);
+        lua_setfield(L, -2, "timestamps");
+    }
+
+    if(in->gro)
+    {
+        lua_pushinteger(L, (lua_Integer)__atomic_load_n(&in->gro_coalesced, __ATOMIC_RELAXED));
+        lua_setfield(L, -2, "gro_coalesced");
+
+        lua_pushinteger(L, (lua_Integer)__atomic_load_n(&in->gro_datagrams, __ATOMIC_RELAXED));
+        lua_setfield(L, -2, "gro_datagrams");
+    }
+
+    if(in->ring)
+    {
+        lua_pushstring(L, in->ring->ifname);
+        lua_setfield(L, -2, "ifname");
+    }
+}
+
+/* кольцо AF_PACKET: drops ядра забираются при каждом чтении stats */
+static void relay_push_ring_stats(lua_State *L, relay_ring_t *ring)
+{
+    packet_ring_t *r = &ring->ring;
+    packet_ring_update_stats(r);
+
+    lua_newtable(L);
+
+    lua_pushstring(L, ring->ifname);
+    lua_setfield(L, -2, "ifname");
+
+    lua_pushinteger(L, (lua_Integer)ring->worker_index);
+    lua_setfield(L, -2, "worker");
+
+    lua_pushinteger(L, (lua_Integer)ring->count);
+    lua_setfield(L, -2, "ingests");
+
+    lua_pushinteger(L, (lua_Integer)r->blocks);
+    lua_setfield(L, -2, "blocks");
+
+    lua_pushinteger(L, (lua_Integer)r->block_size);
+    lua_setfield(L, -2, "block_size");
+
+    lua_pushinteger(L, (lua_Integer)__atomic_load_n(&r->filter_size, __ATOMIC_RELAXED));
+    lua_setfield(L, -2, "filter_size");
+
+    lua_pushinteger(L, (lua_Integer)__atomic_load_n(&r->blocks_read, __ATOMIC_RELAXED));
+    lua_setfield(L, -2, "blocks_read");
+
+    lua_pushinteger(L, (lua_Integer)__atomic_load_n(&r->frames, __ATOMIC_RELAXED));
+    lua_setfield(L, -2, "frames");
+
+    lua_pushinteger(L, (lua_Integer)__atomic_load_n(&r->bytes, __ATOMIC_RELAXED));
+    lua_setfield(L, -2, "bytes");
+
+    lua_pushinteger(L, (lua_Integer)__atomic_load_n(&r->invalid, __ATOMIC_RELAXED));
+    lua_setfield(L, -2, "invalid");
+
+    lua_pushinteger(L, (lua_Integer)__atomic_load_n(&ring->unmatched, __ATOMIC_RELAXED));
+    lua_setfield(L, -2, "unmatched");
+
+    lua_pushinteger(L, (lua_Integer)__atomic_load_n(&r->drops, __ATOMIC_RELAXED));
+    lua_setfield(L, -2, "drops");
+
+    lua_pushinteger(L, (lua_Integer)__atomic_load_n(&r->freezes, __ATOMIC_RELAXED));
+    lua_setfield(L, -2, "freezes");
+}
 
-static relay_ctx_t *check_handle(lua_State *L)
+/* stats.merge: счётчики rtp_merge (relaxed atomics), без лока воркера */
+static void relay_push_merge_stats(lua_State *L, relay_ctx_t *ctx, uint64_t now_us)
 {
-    relay_ctx_t **p = (relay_ctx_t **)luaL_checkudata(L, 1, RELAY_MT);
-    return p ? *p : NULL;
+    const char *sources[RTP_MERGE_LEGS_MAX] = { ctx->input_url };
+    for(int i = 0; i < ctx->leg_count; ++i)
+        sources[i + 1] = ctx->legs[i].source;
+
+    rtp_merge_push_stats(L, ctx->merge, sources, now_us);
+    lua_setfield(L, -2, "merge");
 }
 
-static void destroy_handle(relay_ctx_t *ctx)
+/* stats.pacing: без лока, как stats.ts */
+static void relay_push_pace_stats(lua_State *L, relay_ctx_t *ctx)
 {
-    if(!ctx)
-        return;
+    static const char *const modes[] = { "off", "bitrate", "pcr" };
 
-    pthread_mutex_lock(&ctx->lock);
-    ctx->closing = true;
-    pthread_mutex_unlock(&ctx->lock);
+    lua_newtable(L);
 
-    ctx_unregister_from_engine(ctx);
+    lua_pushinteger(L, (lua_Integer)__atomic_load_n(&ctx->pace_rate, __ATOMIC_RELAXED));
+    lua_setfield(L, -2, "rate_bps");
 
-    // Дожидаемся завершения возможного обработчика epoll-события.
-    for(int i = 0; i < 200; ++i)
+    if(ctx->pace_pcr)
     {
-        const int rc = __atomic_load_n(&ctx->refcount, __ATOMIC_RELAXED);
-        if(rc <= 0)
-            break;
-        asc_usleep(1000);
+        lua_pushinteger(L, (lua_Integer)__atomic_load_n(&ctx->pace_pcr_rate, __ATOMIC_RELAXED));
+        lua_setfield(L, -2, "pcr_rate_bps");
     }
 
-    free_ctx(ctx);
+    lua_newtable(L);
+    int n = 0;
+    for(int i = 0; i < ctx->out_count; ++i)
+    {
+        relay_output_t *out = &ctx->outs[i];
+        if(!out->pace)
+            continue;
+
+        const uint64_t sends = __atomic_load_n(&out->pace_sends, __ATOMIC_RELAXED);
+        const uint64_t datagrams = __atomic_load_n(&out->pace_datagrams, __ATOMIC_RELAXED);
+
+        lua_newtable(L);
+
+        lua_pushfstring(L, "%s:%d", out->dst_addr, out->dst_port);
+        lua_setfield(L, -2, "dst");
+
+        lua_pushstring(L, modes[out->pace]);
+        lua_setfield(L, -2, "mode");
+
+        lua_pushinteger(L, (lua_Integer)out->pace_queue);
+        lua_setfield(L, -2, "queue_limit");
+
+        lua_pushinteger(L, (lua_Integer)__atomic_load_n(&out->pace_depth, __ATOMIC_RELAXED));
+        lua_setfield(L, -2, "queue");
+
+        lua_pushinteger(L, (lua_Integer)__atomic_load_n(&out->pace_depth_max, __ATOMIC_RELAXED));
+        lua_setfield(L, -2, "queue_max");
+
+        lua_pushinteger(L, (lua_Integer)out->pace_burst);
+        lua_setfield(L, -2, "burst");
+
+        lua_pushinteger(L, (lua_Integer)__atomic_load_n(&out->pace_burst_last, __ATOMIC_RELAXED));
+        lua_setfield(L, -2, "burst_last");
+
+        lua_pushinteger(L, (lua_Integer)__atomic_load_n(&out->pace_burst_max, __ATOMIC_RELAXED));
+        lua_setfield(L, -2, "burst_max");
+
+        lua_pushnumber(L, sends ? (lua_Number)datagrams / (lua_Number)sends : 0);
+        lua_setfield(L, -2, "burst_avg");
+
+        lua_pushinteger(L, (lua_Integer)sends);
+        lua_setfield(L, -2, "sends");
+
+        lua_pushinteger(L, (lua_Integer)datagrams);
+        lua_setfield(L, -2, "datagrams");
+
+        lua_pushinteger(L, (lua_Integer)__atomic_load_n(&out->pace_overflows, __ATOMIC_RELAXED));
+        lua_setfield(L, -2, "overflows");
+
+        lua_rawseti(L, -2, ++n);
+    }
+    lua_setfield(L, -2, "outputs");
+
+    lua_setfield(L, -2, "pacing");
 }
 
-static int relay_handle_close(lua_State *L)
+/* FEC outputs: FEC пакеты колонок и строк по выходам */
+static void relay_push_fec_stats(lua_State *L, relay_ctx_t *ctx)
 {
-    relay_ctx_t **p = (relay_ctx_t **)luaL_checkudata(L, 1, RELAY_MT);
-    if(p && *p)
+    lua_newtable(L);
+    int n = 0;
+    for(int i = 0; i < ctx->out_count; ++i)
     {
-        destroy_handle(*p);
-        *p = NULL;
+        relay_output_t *out = &ctx->outs[i];
+        if(!out->fec)
+            continue;
+
+        lua_newtable(L);
+
+        lua_pushfstring(L, "%s:%d", out->dst_addr, out->dst_port);
+        lua_setfield(L, -2, "dst");
+
+        lua_pushinteger(L, (lua_Integer)out->fec->cols);
+        lua_setfield(L, -2, "columns");
+
+        lua_pushinteger(L, (lua_Integer)out->fec->rows);
+        lua_setfield(L, -2, "rows");
+
+        lua_pushinteger(L, (lua_Integer)RTP_FEC_GET(out->fec->packets[RTP_FEC_COLUMN]));
+        lua_setfield(L, -2, "column_packets");
+
+        lua_pushinteger(L, (lua_Integer)RTP_FEC_GET(out->fec->packets[RTP_FEC_ROW]));
+        lua_setfield(L, -2, "row_packets");
+
+        lua_pushinteger(L, (lua_Integer)__atomic_load_n(&out->fec_send_errors, __ATOMIC_RELAXED));
+        lua_setfield(L, -2, "send_errors");
+
+        lua_rawseti(L, -2, ++n);
     }
-    lua_pushboolean(L, 1);
-    return 1;
+    lua_setfield(L, -2, "fec");
 }
 
-static int relay_handle_gc(lua_State *L)
+/* GSO outputs: active - ещё на UDP_SEGMENT, fallbacks - переведены на sendmmsg */
+static void relay_push_gso_stats(lua_State *L, relay_ctx_t *ctx)
 {
-    relay_ctx_t **p = (relay_ctx_t **)luaL_checkudata(L, 1, RELAY_MT);
-    if(p && *p)
+    int active = 0;
+    for(int i = 0; i < ctx->out_count; ++i)
     {
-        destroy_handle(*p);
-        *p = NULL;
+        if(__atomic_load_n(&ctx->outs[i].gso, __ATOMIC_RELAXED))
+            ++active;
     }
-    return 0;
+
+    lua_newtable(L);
+
+    lua_pushinteger(L, (lua_Integer)ctx->gso_out_count);
+    lua_setfield(L, -2, "outputs");
+
+    lua_pushinteger(L, (lua_Integer)active);
+    lua_setfield(L, -2, "active");
+
+    lua_pushinteger(L, (lua_Integer)__atomic_load_n(&ctx->gso_sends, __ATOMIC_RELAXED));
+    lua_setfield(L, -2, "sends");
+
+    lua_pushinteger(L, (lua_Integer)__atomic_load_n(&ctx->gso_datagrams, __ATOMIC_RELAXED));
+    lua_setfield(L, -2, "datagrams");
+
+    lua_pushinteger(L, (lua_Integer)__atomic_load_n(&ctx->gso_fallbacks, __ATOMIC_RELAXED));
+    lua_setfield(L, -2, "fallbacks");
+
+    lua_setfield(L, -2, "gso");
 }
 
 static int relay_handle_stats(lua_State *L)
@@ -1073,6 +4213,9 @@ static int relay_handle_stats(lua_State *L)
     lua_pushinteger(L, (lua_Integer)drops);
     lua_setfield(L, -2, "send_drops");
 
+    lua_pushinteger(L, (lua_Integer)__atomic_load_n(&ctx->tx_syscalls, __ATOMIC_RELAXED));
+    lua_setfield(L, -2, "tx_syscalls");
+
     lua_pushinteger(L, (lua_Integer)bad);
     lua_setfield(L, -2, "bad_datagrams");
 
@@ -1085,18 +4228,96 @@ static int relay_handle_stats(lua_State *L)
     lua_pushinteger(L, (lua_Integer)ctx->worker_index);
     lua_setfield(L, -2, "worker_index");
 
+    lua_pushinteger(L, (lua_Integer)ctx->migrations);
+    lua_setfield(L, -2, "migrations");
+
+    lua_pushnumber(L, (lua_Number)ctx->load_pps);
+    lua_setfield(L, -2, "load_pps");
+
     lua_pushinteger(L, (lua_Integer)ctx->out_count);
     lua_setfield(L, -2, "out_count");
 
     lua_pushboolean(L, g_sendmmsg_available ? 1 : 0);
     lua_setfield(L, -2, "sendmmsg_available");
 
+    lua_pushboolean(L, ctx->rtp ? 1 : 0);
+    lua_setfield(L, -2, "rtp");
+
+    lua_pushinteger(L, (lua_Integer)ctx->rtp_out_count);
+    lua_setfield(L, -2, "rtp_out_count");
+
+    if(ctx->rtp)
+    {
+        lua_pushinteger(L, (lua_Integer)__atomic_load_n(&ctx->rtp_datagrams, __ATOMIC_RELAXED));
+        lua_setfield(L, -2, "rtp_datagrams");
+
+        lua_pushinteger(L, (lua_Integer)__atomic_load_n(&ctx->rtp_lost, __ATOMIC_RELAXED));
+        lua_setfield(L, -2, "rtp_lost");
+
+        lua_pushinteger(L, (lua_Integer)__atomic_load_n(&ctx->rtp_gaps, __ATOMIC_RELAXED));
+        lua_setfield(L, -2, "rtp_gaps");
+
+        lua_pushinteger(L, (lua_Integer)__atomic_load_n(&ctx->rtp_reordered, __ATOMIC_RELAXED));
+        lua_setfield(L, -2, "rtp_reordered");
+
+        lua_pushinteger(L, (lua_Integer)__atomic_load_n(&ctx->rtp_duplicates, __ATOMIC_RELAXED));
+        lua_setfield(L, -2, "rtp_duplicates");
+
+        lua_pushinteger(L, (lua_Integer)__atomic_load_n(&ctx->rtp_resyncs, __ATOMIC_RELAXED));
+        lua_setfield(L, -2, "rtp_resyncs");
+    }
+
+    lua_pushinteger(L, (lua_Integer)__atomic_load_n(&ctx->play_clients_active, __ATOMIC_RELAXED));
+    lua_setfield(L, -2, "play_clients");
+
+    lua_pushinteger(L, (lua_Integer)__atomic_load_n(&ctx->play_bytes, __ATOMIC_RELAXED));
+    lua_setfield(L, -2, "play_bytes");
+
+    lua_pushinteger(L, (lua_Integer)__atomic_load_n(&ctx->play_skips, __ATOMIC_RELAXED));
+    lua_setfield(L, -2, "play_skips");
+
+    lua_pushinteger(L, (lua_Integer)__atomic_load_n(&ctx->play_disconnects, __ATOMIC_RELAXED));
+    lua_setfield(L, -2, "play_disconnects");
+
     if(ctx->input_url)
     {
         lua_pushstring(L, ctx->input_url);
         lua_setfield(L, -2, "input_url");
     }
 
+    // ingest держит ссылка ctx, отпускает его только main loop
+    if(ctx->in.ingest)
+    {
+        relay_push_ingest_stats(L, ctx->in.ingest);
+        if(ctx->in.ingest->ring)
+        {
+            relay_push_ring_stats(L, ctx->in.ingest->ring);
+            lua_setfield(L, -2, "ring");
+        }
+        lua_setfield(L, -2, "ingest");
+    }
+
+    if(ctx->merge)
+        relay_push_merge_stats(L, ctx, now_us);
+
+    if(ctx->mdi)
+    {
+        udp_mdi_push_stats(L, ctx->mdi);
+        lua_setfield(L, -2, "mdi");
+    }
+
+    if(ctx->pace_out_count > 0)
+        relay_push_pace_stats(L, ctx);
+
+    if(ctx->gso_out_count > 0)
+        relay_push_gso_stats(L, ctx);
+
+    if(ctx->fec_out_count > 0)
+        relay_push_fec_stats(L, ctx);
+
+    if(ctx->ts_meter)
+        relay_push_ts_stats(L, ctx, on_air);
+
     return 1;
 }
 
@@ -1121,6 +4342,7 @@ static int relay_handle_switch_input(lua_State *L)
     const char *in_local = table_get_string(L, 2, "localaddr");
     const int in_socket_size = table_get_int(L, 2, "socket_size", 0);
     const char *input_url = table_get_string(L, 2, "source_url");
+    const bool in_rtp = table_get_int(L, 2, "rtp", 0) ? true : false;
 
     if(!in_addr || !in_addr[0] || in_port <= 0 || in_port > 65535)
     {
@@ -1128,85 +4350,320 @@ static int relay_handle_switch_input(lua_State *L)
         lua_pushstring(L, "invalid input addr/port");
         return 2;
     }
-
-    asc_socket_t *new_sock = open_input_socket(in_addr, in_port, in_local, in_socket_size);
-    if(!new_sock)
+    if(ctx->merge)
     {
+        // 2022-7: все legs принимаются одновременно, переключать нечего
         lua_pushnil(L);
-        lua_pushstring(L, "failed to open new input socket");
+        lua_pushstring(L, "switch_input is not supported in merge mode");
         return 2;
     }
-    const int new_fd = asc_socket_fd(new_sock);
 
     pthread_mutex_lock(&ctx->lock);
-    if(ctx->closing)
+    const bool closing = ctx->closing;
+    pthread_mutex_unlock(&ctx->lock);
+    if(closing)
     {
-        pthread_mutex_unlock(&ctx->lock);
-        asc_socket_multicast_leave(new_sock);
-        asc_socket_close(new_sock);
         lua_pushnil(L);
         lua_pushstring(L, "handle is closing");
         return 2;
     }
-
     if(ctx->worker_index < 0 || ctx->worker_index >= g_engine.workers_count)
     {
-        pthread_mutex_unlock(&ctx->lock);
-        asc_socket_multicast_leave(new_sock);
-        asc_socket_close(new_sock);
         lua_pushnil(L);
         lua_pushstring(L, "worker index out of range");
         return 2;
     }
 
-    relay_worker_t *w = &g_engine.workers[ctx->worker_index];
-    struct epoll_event ev;
-    memset(&ev, 0, sizeof(ev));
-    ev.events = EPOLLIN;
-    ev.data.ptr = ctx;
-
-    const int old_fd = ctx->in_fd;
-    asc_socket_t *old_sock = ctx->in_sock;
-    char *old_url = ctx->input_url;
-
-    // Удаляем старый fd из epoll, добавляем новый.
-    if(old_fd >= 0)
-        epoll_ctl(w->epoll_fd, EPOLL_CTL_DEL, old_fd, NULL);
-    if(epoll_ctl(w->epoll_fd, EPOLL_CTL_ADD, new_fd, &ev) != 0)
+    relay_source_t src;
+    memset(&src, 0, sizeof(src));
+    src.addr = strdup(in_addr);
+    src.port = in_port;
+    src.localaddr = (in_local && in_local[0]) ? strdup(in_local) : NULL;
+    src.socket_size = in_socket_size;
+    relay_source_backend(L, 2, &src);
+    src.mdi = (ctx->mdi != NULL); // метр потока переходит на новый вход
+    char *new_url = input_url ? strdup(input_url) : NULL;
+
+    // новый вход на том же воркере: общий ingest, если группа уже открыта там
+    pthread_mutex_lock(&g_ingest_mu);
+    if(src.addr)
+        src.ingest = relay_ingest_acquire(&src, ctx->worker_index, ctx->rx_batch);
+    if(!src.ingest)
     {
-        // Best-effort rollback: пробуем вернуть старый fd обратно.
-        if(old_fd >= 0)
-            epoll_ctl(w->epoll_fd, EPOLL_CTL_ADD, old_fd, &ev);
-        pthread_mutex_unlock(&ctx->lock);
-        asc_socket_multicast_leave(new_sock);
-        asc_socket_close(new_sock);
+        pthread_mutex_unlock(&g_ingest_mu);
+        relay_source_clear(&src);
+        free(new_url);
         lua_pushnil(L);
-        lua_pushstring(L, "failed to register new input in engine");
+        lua_pushstring(L, "failed to open new input socket");
         return 2;
     }
+    relay_source_close(&ctx->in, ctx, 0, true);
 
-    ctx->in_sock = new_sock;
-    ctx->in_fd = new_fd;
+    pthread_mutex_lock(&ctx->lock);
+    relay_source_clear(&ctx->in);
+    ctx->in = src;
     ctx->packet_skip = 0;
+    ctx->rtp = in_rtp;
+    ctx->rtp_seq_valid = false;
+    relay_meter_reset(ctx);
+    if(ctx->mdi)
+        udp_mdi_restart(ctx->mdi);
+    // PCR нового входа: скорость оставляем, база и PID - заново
+    ctx->pace_pcr_pid = -1;
+    ctx->pace_pcr_last = 0;
     __atomic_store_n(&ctx->last_rx_us, 0, __ATOMIC_RELAXED);
     __atomic_store_n(&ctx->last_ok_us, 0, __ATOMIC_RELAXED);
 
-    ctx->input_url = input_url ? strdup(input_url) : NULL;
-
+    char *old_url = ctx->input_url;
+    ctx->input_url = new_url;
     pthread_mutex_unlock(&ctx->lock);
 
-    if(old_sock)
+    if(!relay_ingest_subscribe(ctx->in.ingest, ctx, 0))
     {
-        asc_socket_multicast_leave(old_sock);
-        asc_socket_close(old_sock);
+        // вход без подписчика не держим: поток остаётся без данных до следующего switch
+        relay_ingest_release(ctx->in.ingest);
+        ctx->in.ingest = NULL;
     }
-    if(old_url)
-        free(old_url);
+    pthread_mutex_unlock(&g_ingest_mu);
+
+    free(old_url);
 
     lua_pushboolean(L, 1);
     return 1;
 }
 
+/*
+ * handle:play_attach({ fd=, header=, buffer_kb=, backlog_kb= }) -> id | nil, err
+ * fd переходит во владение воркера (и закрывается им), header - HTTP заголовок ответа.
+ */
+static int relay_handle_play_attach(lua_State *L)
+{
+    relay_ctx_t *ctx = check_handle(L);
+    if(!ctx)
+    {
+        lua_pushnil(L);
+        lua_pushstring(L, "invalid handle");
+        return 2;
+    }
+    if(lua_type(L, 2) != LUA_TTABLE)
+    {
+        lua_pushnil(L);
+        lua_pushstring(L, "play options table required");
+        return 2;
+    }
+
+    const int fd = table_get_int(L, 2, "fd", -1);
+    const int buffer_kb = table_get_int(L, 2, "buffer_kb", RELAY_PLAY_RING_KB_DEFAULT);
+    const int backlog_kb = table_get_int(L, 2, "backlog_kb", RELAY_PLAY_BACKLOG_KB_DEFAULT);
+    size_t header_size = 0;
+    const char *header = NULL;
+    lua_getfield(L, 2, "header");
+    if(lua_type(L, -1) == LUA_TSTRING)
+        header = lua_tolstring(L, -1, &header_size);
+    lua_pop(L, 1);
+
+    if(fd < 0)
+    {
+        lua_pushnil(L);
+        lua_pushstring(L, "fd required");
+        return 2;
+    }
+    if(header_size > RELAY_PLAY_PENDING_SIZE)
+    {
+        lua_pushnil(L);
+        lua_pushstring(L, "header too long");
+        return 2;
+    }
+
+    const char *error = NULL;
+    int id = 0;
+
+    pthread_mutex_lock(&ctx->lock);
+
+    if(ctx->closing)
+        error = "handle is closing";
+    else if(ctx->worker_index < 0 || ctx->worker_index >= g_engine.workers_count)
+        error = "handle is not attached to a worker";
+
+    if(!error && !ctx->play_ring)
+    {
+        const int slots = clamp_int(buffer_kb * 1024 / (int)RELAY_PLAY_DATAGRAM_SIZE, 16, 65536);
+        ctx->play_ring = (uint8_t *)malloc((size_t)slots * RELAY_UDP_BUFFER_SIZE);
+        ctx->play_ring_size = (uint16_t *)calloc((size_t)slots, sizeof(uint16_t));
+        ctx->play_clients = (relay_play_client_t **)calloc(RELAY_PLAY_CLIENTS_MAX, sizeof(relay_play_client_t *));
+        if(!ctx->play_ring || !ctx->play_ring_size || !ctx->play_clients)
+        {
+            free(ctx->play_ring);
+            free(ctx->play_ring_size);
+            free(ctx->play_clients);
+            ctx->play_ring = NULL;
+            ctx->play_ring_size = NULL;
+            ctx->play_clients = NULL;
+            error = "out of memory";
+        }
+        else
+        {
+            ctx->play_ring_slots = slots;
+            ctx->play_clients_slots = 0;
+            ctx->play_backlog = clamp_int(backlog_kb * 1024 / (int)RELAY_PLAY_DATAGRAM_SIZE, 0, slots);
+            // история до первого клиента не писалась
+            ctx->play_head = 0;
+        }
+    }
+
+    relay_play_client_t *c = NULL;
+    if(!error)
+    {
+        int slot = 0;
+        while(slot < ctx->play_clients_slots && ctx->play_clients[slot] && ctx->play_clients[slot]->fd >= 0)
+            ++slot;
+
+        if(slot >= RELAY_PLAY_CLIENTS_MAX)
+            error = "too many clients";
+        else if(!ctx->play_clients[slot])
+        {
+            ctx->play_clients[slot] = (relay_play_client_t *)calloc(1, sizeof(relay_play_client_t));
+            if(!ctx->play_clients[slot])
+                error = "out of memory";
+            else if(slot == ctx->play_clients_slots)
+                ++ctx->play_clients_slots;
+        }
+        if(!error)
+            c = ctx->play_clients[slot];
+    }
+
+    if(c)
+    {
+        const uint64_t backlog = ((uint64_t)ctx->play_backlog < ctx->play_head)
+            ? (uint64_t)ctx->play_backlog
+            : ctx->play_head;
+
+        memset(c, 0, sizeof(*c));
+        c->event_type = RELAY_EVENT_PLAY;
+        c->ctx = ctx;
+        c->fd = fd;
+        c->id = ++ctx->play_next_id;
+        c->cursor = ctx->play_head - backlog;
+        if(header_size > 0)
+            memcpy(c->pending, header, header_size);
+        c->pending_size = header_size;
+        // до первого EPOLLOUT: заголовок и история уходят в первом flush
+        c->blocked = true;
+
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLOUT | EPOLLET;
+        ev.data.ptr = c;
+        if(epoll_ctl(g_engine.workers[ctx->worker_index].epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0)
+        {
+            c->fd = -1;
+            error = strerror(errno);
+        }
+        else
+        {
+            ++ctx->play_clients_active;
+            id = c->id;
+        }
+    }
+
+    pthread_mutex_unlock(&ctx->lock);
+
+    if(error)
+    {
+        lua_pushnil(L);
+        lua_pushstring(L, error);
+        return 2;
+    }
+
+    lua_pushinteger(L, (lua_Integer)id);
+    return 1;
+}
+
+static int relay_handle_play_detach(lua_State *L)
+{
+    relay_ctx_t *ctx = check_handle(L);
+    const int id = (int)luaL_checkinteger(L, 2);
+    bool found = false;
+
+    if(ctx)
+    {
+        pthread_mutex_lock(&ctx->lock);
+        for(int i = 0; i < ctx->play_clients_slots; ++i)
+        {
+            relay_play_client_t *c = ctx->play_clients[i];
+            if(c && c->fd >= 0 && c->id == id)
+            {
+                relay_play_drop(ctx, c);
+                found = true;
+                break;
+            }
+        }
+        pthread_mutex_unlock(&ctx->lock);
+    }
+
+    lua_pushboolean(L, found ? 1 : 0);
+    return 1;
+}
+
+static void relay_push_balancer_stats(lua_State *L)
+{
+    lua_newtable(L);
+
+    lua_pushboolean(L, (g_balancer.interval_ms > 0) ? 1 : 0);
+    lua_setfield(L, -2, "enabled");
+
+    lua_pushinteger(L, (lua_Integer)g_balancer.interval_ms);
+    lua_setfield(L, -2, "interval_ms");
+
+    lua_pushinteger(L, (lua_Integer)g_balancer.threshold_pct);
+    lua_setfield(L, -2, "threshold_pct");
+
+    lua_pushinteger(L, (lua_Integer)g_balancer.max_moves);
+    lua_setfield(L, -2, "max_moves");
+
+    lua_pushinteger(L, (lua_Integer)g_balancer.runs);
+    lua_setfield(L, -2, "runs");
+
+    lua_pushnumber(L, (lua_Number)g_balancer.imbalance_pct);
+    lua_setfield(L, -2, "imbalance_pct");
+
+    lua_pushinteger(L, (lua_Integer)g_balancer.migrations);
+    lua_setfield(L, -2, "migrations");
+
+    lua_pushinteger(L, (lua_Integer)g_balancer.failures);
+    lua_setfield(L, -2, "failures");
+
+    lua_pushinteger(L, (lua_Integer)g_balancer.skipped);
+    lua_setfield(L, -2, "skipped");
+
+    // решения, от старых к новым
+    lua_newtable(L);
+    const uint64_t count = g_balancer.log_count;
+    const uint64_t first = (count > RELAY_BALANCE_LOG) ? count - RELAY_BALANCE_LOG : 0;
+    int n = 0;
+    for(uint64_t i = first; i < count; ++i)
+    {
+        const relay_balance_move_t *m = &g_balancer.log[i % RELAY_BALANCE_LOG];
+        lua_newtable(L);
+        lua_pushinteger(L, (lua_Integer)m->at);
+        lua_setfield(L, -2, "at");
+        lua_pushstring(L, m->id);
+        lua_setfield(L, -2, "id");
+        lua_pushinteger(L, (lua_Integer)m->from);
+        lua_setfield(L, -2, "from");
+        lua_pushinteger(L, (lua_Integer)m->to);
+        lua_setfield(L, -2, "to");
+        lua_pushnumber(L, (lua_Number)m->load_pps);
+        lua_setfield(L, -2, "load_pps");
+        lua_pushnumber(L, (lua_Number)m->from_busy_pct);
+        lua_setfield(L, -2, "from_busy_pct");
+        lua_pushnumber(L, (lua_Number)m->to_busy_pct);
+        lua_setfield(L, -2, "to_busy_pct");
+        lua_rawseti(L, -2, ++n);
+    }
+    lua_setfield(L, -2, "decisions");
+}
+
 static int relay_engine_stats(lua_State *L)
 {
     lua_newtable(L);
@@ -1240,14 +4697,90 @@ static int relay_engine_stats(lua_State *L)
             lua_pushinteger(L, (lua_Integer)w->pinned_cpu);
             lua_setfield(L, -2, "pinned_cpu");
 
+            lua_pushinteger(L, (lua_Integer)__atomic_load_n(&w->busy_us, __ATOMIC_RELAXED));
+            lua_setfield(L, -2, "busy_us");
+
+            lua_pushinteger(L, (lua_Integer)__atomic_load_n(&w->datagrams, __ATOMIC_RELAXED));
+            lua_setfield(L, -2, "datagrams");
+
+            // за последний интервал балансировщика
+            lua_pushnumber(L, (lua_Number)w->busy_pct);
+            lua_setfield(L, -2, "busy_pct");
+
+            lua_pushnumber(L, (lua_Number)w->pps);
+            lua_setfield(L, -2, "pps");
+
+            lua_pushnumber(L, (lua_Number)w->load_pps);
+            lua_setfield(L, -2, "load_pps");
+
             lua_rawseti(L, -2, i + 1);
         }
     }
     lua_setfield(L, -2, "workers");
 
+    lua_newtable(L);
+    pthread_mutex_lock(&g_ingest_mu);
+    int n = 0;
+    for(const relay_ingest_t *in = g_ingests; in; in = in->next)
+    {
+        relay_push_ingest_stats(L, in);
+        lua_rawseti(L, -2, ++n);
+    }
+    lua_setfield(L, -2, "ingests");
+
+    lua_newtable(L);
+    n = 0;
+    for(int i = 0; g_engine.started && i < g_engine.workers_count; ++i)
+    {
+        for(relay_ring_t *ring = g_engine.workers[i].rings; ring; ring = ring->next)
+        {
+            relay_push_ring_stats(L, ring);
+            lua_rawseti(L, -2, ++n);
+        }
+    }
+    pthread_mutex_unlock(&g_ingest_mu);
+    lua_setfield(L, -2, "rings");
+
+    relay_push_balancer_stats(L);
+    lua_setfield(L, -2, "balancer");
+
     return 1;
 }
 
+/*
+ * relay_start({ rebalance_interval_ms=, rebalance_threshold=, rebalance_max_moves= }).
+ * Без rebalance_interval_ms (probe) настройки не меняются, 0 - выключен.
+ */
+static void relay_balance_configure(lua_State *L, int idx)
+{
+    const int interval_ms = table_get_int(L, idx, "rebalance_interval_ms", -1);
+    if(interval_ms < 0)
+        return;
+
+    g_balancer.threshold_pct = clamp_int(table_get_int(L, idx, "rebalance_threshold",
+        RELAY_BALANCE_THRESHOLD_DEFAULT), 1, 100);
+    g_balancer.max_moves = clamp_int(table_get_int(L, idx, "rebalance_max_moves",
+        RELAY_BALANCE_MAX_MOVES_DEFAULT), 1, 64);
+
+    const int interval = (interval_ms > 0) ? clamp_int(interval_ms, 100, 3600000) : 0;
+    if(interval == g_balancer.interval_ms)
+        return;
+    if(g_balancer.timer)
+    {
+        asc_timer_destroy(g_balancer.timer);
+        g_balancer.timer = NULL;
+    }
+    g_balancer.interval_ms = interval;
+    g_balancer.sample_us = 0;
+    g_balancer.imbalance_runs = 0;
+    if(interval > 0)
+    {
+        g_balancer.timer = asc_timer_init((unsigned int)interval, relay_balance_on_timer, NULL);
+        asc_log_info("%s rebalance: interval=%dms threshold=%d%% max_moves=%d",
+            RELAY_MSG_PREFIX, interval, g_balancer.threshold_pct, g_balancer.max_moves);
+    }
+}
+
 static int relay_start(lua_State *L)
 {
     if(lua_type(L, 1) != LUA_TTABLE)
@@ -1270,6 +4803,7 @@ static int relay_start(lua_State *L)
         lua_pushstring(L, "failed to start relay engine");
         return 2;
     }
+    relay_balance_configure(L, 1);
 
     relay_ctx_t *ctx = create_ctx(L, 1);
     if(!ctx)
@@ -1297,6 +4831,10 @@ static int relay_start(lua_State *L)
 
 LUA_API int luaopen_udp_relay(lua_State *L)
 {
+    // таймер балансировщика уничтожен вместе с main loop (reload), воркеры остаются
+    g_balancer.timer = NULL;
+    g_balancer.interval_ms = 0;
+
     static const luaL_Reg api[] =
     {
         { "start", relay_start },
@@ -1308,6 +4846,8 @@ LUA_API int luaopen_udp_relay(lua_State *L)
     {
         { "stats", relay_handle_stats },
         { "switch_input", relay_handle_switch_input },
+        { "play_attach", relay_handle_play_attach },
+        { "play_detach", relay_handle_play_detach },
         { "close", relay_handle_close },
         { "__gc", relay_handle_gc },
         { NULL, NULL }
@@ -0,0 +1,503 @@
+/*
+ * Astra Module: UDP: RTP FEC (SMPTE 2022-1, Pro-MPEG CoP3)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "rtp_fec.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#define SLOT_MASK (RTP_FEC_SLOTS - 1)
+#define HOLD_MAX (RTP_FEC_SLOTS - 64)
+#define RECOVER_DEPTH 2 // a lost packet of the group rebuilt through another group first
+
+static inline void counter_add(uint64_t *counter, uint64_t value)
+{
+    __atomic_fetch_add(counter, value, __ATOMIC_RELAXED);
+}
+
+static inline uint16_t get_u16(const uint8_t *p)
+{
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static inline uint32_t get_u32(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static inline void put_u16(uint8_t *p, uint16_t v)
+{
+    p[0] = (uint8_t)(v >> 8);
+    p[1] = (uint8_t)v;
+}
+
+static inline void put_u32(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)(v >> 24);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);
+    p[3] = (uint8_t)v;
+}
+
+void rtp_fec_xor(uint8_t *dst, const uint8_t *src, size_t size)
+{
+#if defined(__SSE2__)
+    for(; size >= 64; size -= 64, dst += 64, src += 64)
+    {
+        const __m128i a0 = _mm_xor_si128(_mm_loadu_si128((const __m128i *)dst), _mm_loadu_si128((const __m128i *)src));
+        const __m128i a1 = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(dst + 16))
+                                         , _mm_loadu_si128((const __m128i *)(src + 16)));
+        const __m128i a2 = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(dst + 32))
+                                         , _mm_loadu_si128((const __m128i *)(src + 32)));
+        const __m128i a3 = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(dst + 48))
+                                         , _mm_loadu_si128((const __m128i *)(src + 48)));
+        _mm_storeu_si128((__m128i *)dst, a0);
+        _mm_storeu_si128((__m128i *)(dst + 16), a1);
+        _mm_storeu_si128((__m128i *)(dst + 32), a2);
+        _mm_storeu_si128((__m128i *)(dst + 48), a3);
+    }
+    for(; size >= 16; size -= 16, dst += 16, src += 16)
+    {
+        _mm_storeu_si128((__m128i *)dst
+                         , _mm_xor_si128(_mm_loadu_si128((const __m128i *)dst), _mm_loadu_si128((const __m128i *)src)));
+    }
+#elif defined(__ARM_NEON)
+    for(; size >= 16; size -= 16, dst += 16, src += 16)
+        vst1q_u8(dst, veorq_u8(vld1q_u8(dst), vld1q_u8(src)));
+#endif
+    for(; size >= 8; size -= 8, dst += 8, src += 8)
+    {
+        uint64_t a, b;
+        memcpy(&a, dst, 8);
+        memcpy(&b, src, 8);
+        a ^= b;
+        memcpy(dst, &a, 8);
+    }
+    for(; size > 0; --size)
+        *dst++ ^= *src++;
+}
+
+bool rtp_fec_parse(const char *value, int *cols, int *rows)
+{
+    if(!value)
+        return false;
+
+    char *end = NULL;
+    const long l = strtol(value, &end, 10);
+    if(end == value || (*end != 'x' && *end != 'X'))
+        return false;
+    const char *next = end + 1;
+    const long d = strtol(next, &end, 10);
+    if(end == next || *end != '\0')
+        return false;
+
+    if(l < 1 || l > RTP_FEC_COLS_MAX || d < RTP_FEC_ROWS_MIN || d > RTP_FEC_ROWS_MAX || l * d > RTP_FEC_MATRIX_MAX)
+        return false;
+
+    *cols = (int)l;
+    *rows = (int)d;
+    return true;
+}
+
+static void sum_add(rtp_fec_sum_t *sum, bool first, const uint8_t *header, const uint8_t *payload, size_t size)
+{
+    if(first)
+    {
+        sum->snbase = get_u16(&header[2]);
+        sum->length = (uint16_t)size;
+        sum->pt = header[1] & 0x7F;
+        sum->ts = get_u32(&header[4]);
+        sum->size = (uint16_t)size;
+        memcpy(sum->payload, payload, size);
+        return;
+    }
+
+    if(size > sum->size)
+    {
+        memset(&sum->payload[sum->size], 0, size - sum->size);
+        sum->size = (uint16_t)size;
+    }
+    rtp_fec_xor(sum->payload, payload, size);
+    sum->length ^= (uint16_t)size;
+    sum->pt ^= header[1] & 0x7F;
+    sum->ts ^= get_u32(&header[4]);
+}
+
+/*
+ * Encoder
+ */
+
+void rtp_fec_encoder_init(rtp_fec_encoder_t *enc, int cols, int rows, bool row)
+{
+    memset(enc, 0, sizeof(*enc));
+    enc->cols = cols;
+    enc->rows = rows;
+    enc->row = row;
+    enc->seq[RTP_FEC_COLUMN] = (uint16_t)rand();
+    enc->seq[RTP_FEC_ROW] = (uint16_t)rand();
+}
+
+static void encoder_emit(rtp_fec_encoder_t *enc, int kind, const rtp_fec_sum_t *sum, int offset, int na)
+{
+    rtp_fec_packet_t *const p = &enc->out[enc->count++];
+    uint8_t *const rtp = p->data;
+    uint8_t *const fec = &p->data[RTP_FEC_RTP_SIZE];
+
+    rtp[0] = 0x80;
+    rtp[1] = RTP_FEC_PT;
+    put_u16(&rtp[2], enc->seq[kind]++);
+    put_u32(&rtp[4], sum->ts);
+    put_u32(&rtp[8], 0); // SSRC is not used by 2022-1
+
+    put_u16(&fec[0], sum->snbase);
+    put_u16(&fec[2], sum->length);
+    fec[4] = 0x80 | sum->pt; // E: extended header, PT recovery
+    fec[5] = fec[6] = fec[7] = 0; // mask
+    put_u32(&fec[8], sum->ts);
+    fec[12] = (kind == RTP_FEC_ROW) ? 0x40 : 0x00; // X=0, D, type=XOR, index=0
+    fec[13] = (uint8_t)offset;
+    fec[14] = (uint8_t)na;
+    fec[15] = 0; // SNBase ext bits
+
+    memcpy(&fec[RTP_FEC_HEADER_SIZE], sum->payload, sum->size);
+    p->kind = kind;
+    p->size = RTP_FEC_RTP_SIZE + RTP_FEC_HEADER_SIZE + sum->size;
+    counter_add(&enc->packets[kind], 1);
+}
+
+int rtp_fec_encode(rtp_fec_encoder_t *enc, const uint8_t *header, const uint8_t *payload, size_t size)
+{
+    enc->count = 0;
+    if(size > RTP_FEC_PAYLOAD_MAX)
+    {
+        // the groups are by sequence numbers: start a new matrix after it
+        enc->index = 0;
+        return 0;
+    }
+
+    const int col = enc->index % enc->cols;
+    const int row = enc->index / enc->cols;
+
+    sum_add(&enc->col_sum[col], row == 0, header, payload, size);
+    if(enc->row)
+    {
+        sum_add(&enc->row_sum, col == 0, header, payload, size);
+        if(col == enc->cols - 1)
+            encoder_emit(enc, RTP_FEC_ROW, &enc->row_sum, 1, enc->cols);
+    }
+
+    if(++enc->index == enc->cols * enc->rows)
+    {
+        for(int i = 0; i < enc->cols; ++i)
+            encoder_emit(enc, RTP_FEC_COLUMN, &enc->col_sum[i], enc->cols, enc->rows);
+        enc->index = 0;
+    }
+
+    return enc->count;
+}
+
+/*
+ * Decoder
+ */
+
+void rtp_fec_decoder_init(rtp_fec_decoder_t *dec, rtp_fec_media_t on_media, void *arg)
+{
+    memset(dec, 0, sizeof(*dec));
+    dec->on_media = on_media;
+    dec->arg = arg;
+}
+
+static inline rtp_fec_slot_t *slot_get(rtp_fec_decoder_t *dec, uint16_t seq)
+{
+    rtp_fec_slot_t *const slot = &dec->slots[seq & SLOT_MASK];
+    return (slot->valid && slot->seq == seq) ? slot : NULL;
+}
+
+/* the slot of seq holds no newer packet */
+static inline bool slot_in_window(const rtp_fec_decoder_t *dec, uint16_t seq)
+{
+    return (uint16_t)(dec->highest - seq) < RTP_FEC_SLOTS;
+}
+
+static void decoder_resync(rtp_fec_decoder_t *dec, uint16_t seq)
+{
+    for(int i = 0; i < RTP_FEC_SLOTS; ++i)
+        dec->slots[i].valid = false;
+    for(int i = 0; i < RTP_FEC_STORE; ++i)
+        dec->store[i].valid = false;
+    dec->next = seq;
+    dec->highest = seq;
+    if(dec->started)
+        counter_add(&dec->resyncs, 1);
+    dec->started = true;
+}
+
+static bool decoder_recover(rtp_fec_decoder_t *dec, uint16_t seq, int depth)
+{
+    if(!slot_in_window(dec, seq))
+        return false;
+
+    for(int i = 0; i < RTP_FEC_STORE; ++i)
+    {
+        const rtp_fec_entry_t *const e = &dec->store[i];
+        if(!e->valid)
+            continue;
+        const uint16_t d = (uint16_t)(seq - e->snbase);
+        if(d % e->offset != 0 || d / e->offset >= e->na)
+            continue;
+
+        // all other packets of the group, one more missing may be rebuilt through its other group
+        int other = -1;
+        bool complete = true;
+        for(int k = 0; k < e->na; ++k)
+        {
+            const uint16_t member = (uint16_t)(e->snbase + k * e->offset);
+            if(member == seq || slot_get(dec, member))
+                continue;
+            if(other >= 0)
+            {
+                complete = false;
+                break;
+            }
+            other = member;
+        }
+        if(!complete)
+            continue;
+        if(other >= 0 && (depth == 0 || !decoder_recover(dec, (uint16_t)other, depth - 1)))
+            continue;
+        if(slot_get(dec, seq))
+            return true; // rebuilt on the way through the other group
+
+        uint8_t *const packet = dec->scratch;
+        uint8_t *const payload = &packet[RTP_FEC_RTP_SIZE];
+        uint16_t length = e->sum.length;
+        uint8_t pt = e->sum.pt;
+        uint32_t ts = e->sum.ts;
+        const uint8_t *ref = NULL; // X, CC and SSRC are taken from another packet of the stream
+        memcpy(payload, e->sum.payload, e->sum.size);
+        for(int k = 0; k < e->na; ++k)
+        {
+            const uint16_t member = (uint16_t)(e->snbase + k * e->offset);
+            if(member == seq)
+                continue;
+            const rtp_fec_slot_t *const m = slot_get(dec, member);
+            size_t size = m->size - RTP_FEC_RTP_SIZE;
+            length ^= (uint16_t)size;
+            pt ^= m->data[1] & 0x7F;
+            ts ^= get_u32(&m->data[4]);
+            ref = m->data;
+            if(size > e->sum.size)
+                size = e->sum.size;
+            rtp_fec_xor(payload, &m->data[RTP_FEC_RTP_SIZE], size);
+        }
+        if(length > e->sum.size)
+            continue; // the group does not match the FEC packet
+
+        packet[0] = ref ? (ref[0] & 0xDF) : 0x80; // no padding: the length is recovered
+        packet[1] = pt;
+        put_u16(&packet[2], seq);
+        put_u32(&packet[4], ts);
+        if(ref)
+            memcpy(&packet[8], &ref[8], 4);
+        else
+            put_u32(&packet[8], 0);
+
+        rtp_fec_slot_t *const slot = &dec->slots[seq & SLOT_MASK];
+        memcpy(slot->data, packet, RTP_FEC_RTP_SIZE + length);
+        slot->size = (uint16_t)(RTP_FEC_RTP_SIZE + length);
+        slot->seq = seq;
+        slot->valid = true;
+        counter_add(&dec->recovered, 1);
+        return true;
+    }
+    return false;
+}
+
+static void decoder_release(rtp_fec_decoder_t *dec)
+{
+    while((uint16_t)(dec->highest - dec->next) < 0x8000)
+    {
+        const rtp_fec_slot_t *slot = slot_get(dec, dec->next);
+        if(!slot && decoder_recover(dec, dec->next, RECOVER_DEPTH))
+            slot = slot_get(dec, dec->next);
+        if(!slot)
+        {
+            if((uint16_t)(dec->highest - dec->next) < dec->hold)
+                break;
+            counter_add(&dec->unrecoverable, 1);
+            ++dec->next;
+            continue;
+        }
+
+        ++dec->next;
+        dec->on_media(dec->arg, slot->data, slot->size);
+    }
+}
+
+void rtp_fec_decoder_media(rtp_fec_decoder_t *dec, const uint8_t *packet, size_t size)
+{
+    if(size < RTP_FEC_RTP_SIZE || size > RTP_FEC_RTP_SIZE + RTP_FEC_PAYLOAD_MAX)
+    {
+        counter_add(&dec->bad, 1);
+        return;
+    }
+
+    const uint16_t seq = get_u16(&packet[2]);
+    bool late = false;
+    if(!dec->started)
+        decoder_resync(dec, seq);
+    else if((uint16_t)(seq - dec->next) >= 0x8000)
+    {
+        // behind the release: kept for the recovery of the others
+        if((uint16_t)(dec->next - seq) >= RTP_FEC_SLOTS)
+            decoder_resync(dec, seq);
+        else
+            late = true;
+    }
+    else if((uint16_t)(seq - dec->next) >= RTP_FEC_SLOTS)
+        decoder_resync(dec, seq);
+    else if((uint16_t)(seq - dec->highest - 1) < 0x7FFF)
+    {
+        // the gap is missing, older packets of these slots are gone
+        for(uint16_t s = (uint16_t)(dec->highest + 1); s != seq; ++s)
+            dec->slots[s & SLOT_MASK].valid = false;
+        dec->highest = seq;
+    }
+
+    if(late && !slot_in_window(dec, seq))
+    {
+        counter_add(&dec->late, 1);
+        return;
+    }
+
+    rtp_fec_slot_t *const slot = &dec->slots[seq & SLOT_MASK];
+    if(slot->valid && slot->seq == seq)
+    {
+        counter_add(&dec->duplicates, 1);
+        return;
+    }
+    memcpy(slot->data, packet, size);
+    slot->size = (uint16_t)size;
+    slot->seq = seq;
+    slot->valid = true;
+    counter_add(&dec->media, 1);
+
+    if(late)
+    {
+        counter_add(&dec->late, 1);
+        return;
+    }
+    decoder_release(dec);
+}
+
+void rtp_fec_decoder_fec(rtp_fec_decoder_t *dec, const uint8_t *packet, size_t size)
+{
+    if(size < RTP_FEC_RTP_SIZE + RTP_FEC_HEADER_SIZE)
+    {
+        counter_add(&dec->bad, 1);
+        return;
+    }
+    size_t skip = RTP_FEC_RTP_SIZE + (size_t)(packet[0] & 0x0F) * 4;
+    if((packet[0] & 0x10) && size >= skip + 4)
+        skip += 4 + (size_t)get_u16(&packet[skip + 2]) * 4;
+    if(size < skip + RTP_FEC_HEADER_SIZE || size - skip - RTP_FEC_HEADER_SIZE > RTP_FEC_PAYLOAD_MAX)
+    {
+        counter_add(&dec->bad, 1);
+        return;
+    }
+
+    const uint8_t *const fec = &packet[skip];
+    const int kind = (fec[12] & 0x40) ? RTP_FEC_ROW : RTP_FEC_COLUMN;
+    const int type = (fec[12] >> 3) & 0x07;
+    const int offset = fec[13];
+    const int na = fec[14];
+    if(type != 0 || offset == 0 || na == 0 || (fec[12] & 0x80))
+    {
+        counter_add(&dec->bad, 1);
+        return;
+    }
+
+    const uint16_t snbase = get_u16(&fec[0]);
+    for(int i = 0; i < RTP_FEC_STORE; ++i)
+    {
+        const rtp_fec_entry_t *const e = &dec->store[i];
+        if(e->valid && e->kind == kind && e->snbase == snbase)
+            return;
+    }
+
+    rtp_fec_entry_t *const e = &dec->store[dec->store_next];
+    dec->store_next = (dec->store_next + 1) % RTP_FEC_STORE;
+    e->valid = true;
+    e->kind = kind;
+    e->snbase = snbase;
+    e->offset = (uint8_t)offset;
+    e->na = (uint8_t)na;
+    e->sum.snbase = snbase;
+    e->sum.length = get_u16(&fec[2]);
+    e->sum.pt = fec[4] & 0x7F;
+    e->sum.ts = get_u32(&fec[8]);
+    e->sum.size = (uint16_t)(size - skip - RTP_FEC_HEADER_SIZE);
+    memcpy(e->sum.payload, &fec[RTP_FEC_HEADER_SIZE], e->sum.size);
+    counter_add(&dec->fec[kind], 1);
+
+    // column FEC of a matrix comes after its last row: wait for two matrices
+    int hold = (kind == RTP_FEC_COLUMN) ? 2 * offset * na : 2 * na;
+    if(hold > HOLD_MAX)
+        hold = HOLD_MAX;
+    if(kind == RTP_FEC_COLUMN && (offset != dec->cols || na != dec->rows))
+    {
+        __atomic_store_n(&dec->cols, offset, __ATOMIC_RELAXED);
+        __atomic_store_n(&dec->rows, na, __ATOMIC_RELAXED);
+        dec->hold = hold;
+    }
+    else if(hold > dec->hold)
+        dec->hold = hold;
+
+    if(dec->started)
+        decoder_release(dec);
+}
+
+void rtp_fec_decoder_push_stats(lua_State *L, rtp_fec_decoder_t *dec)
+{
+    lua_newtable(L);
+
+    lua_pushinteger(L, (lua_Integer)RTP_FEC_GET(dec->cols));
+    lua_setfield(L, -2, "columns");
+    lua_pushinteger(L, (lua_Integer)RTP_FEC_GET(dec->rows));
+    lua_setfield(L, -2, "rows");
+    lua_pushinteger(L, (lua_Integer)RTP_FEC_GET(dec->media));
+    lua_setfield(L, -2, "media");
+    lua_pushinteger(L, (lua_Integer)RTP_FEC_GET(dec->fec[RTP_FEC_COLUMN]));
+    lua_setfield(L, -2, "fec_column");
+    lua_pushinteger(L, (lua_Integer)RTP_FEC_GET(dec->fec[RTP_FEC_ROW]));
+    lua_setfield(L, -2, "fec_row");
+    lua_pushinteger(L, (lua_Integer)RTP_FEC_GET(dec->recovered));
+    lua_setfield(L, -2, "recovered");
+    lua_pushinteger(L, (lua_Integer)RTP_FEC_GET(dec->unrecoverable));
+    lua_setfield(L, -2, "unrecoverable");
+    lua_pushinteger(L, (lua_Integer)RTP_FEC_GET(dec->late));
+    lua_setfield(L, -2, "late");
+    lua_pushinteger(L, (lua_Integer)RTP_FEC_GET(dec->duplicates));
+    lua_setfield(L, -2, "duplicates");
+    lua_pushinteger(L, (lua_Integer)RTP_FEC_GET(dec->resyncs));
+    lua_setfield(L, -2, "resyncs");
+    lua_pushinteger(L, (lua_Integer)RTP_FEC_GET(dec->bad));
+    lua_setfield(L, -2, "bad");
+}
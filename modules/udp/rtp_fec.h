@@ -0,0 +1,169 @@
+/*
+ * Astra Module: UDP: RTP FEC (SMPTE 2022-1, Pro-MPEG CoP3)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _RTP_FEC_H_
+#define _RTP_FEC_H_ 1
+
+#include <astra.h>
+
+/*
+ * Media RTP packets are laid row by row into a matrix of L columns and
+ * D rows. Every column (port + 2) and every row (port + 4) gets a FEC
+ * packet: the XOR of the payloads, lengths, payload types and timestamps
+ * of its media packets. One lost packet of a column or a row is rebuilt
+ * from the others; with both directions a lost packet of a column that
+ * has another loss is rebuilt through its row first.
+ *
+ * The decoder releases media packets in sequence order. A missing packet
+ * holds the release until it is recovered or the sequence moves on by
+ * two matrices, without losses nothing is delayed.
+ *
+ * Only one thread calls the encoder or the decoder, the counters are
+ * updated with relaxed atomics and may be read from any thread.
+ */
+
+#define RTP_FEC_RTP_SIZE 12
+#define RTP_FEC_HEADER_SIZE 16
+#define RTP_FEC_PAYLOAD_MAX 1460
+#define RTP_FEC_PACKET_MAX (RTP_FEC_RTP_SIZE + RTP_FEC_HEADER_SIZE + RTP_FEC_PAYLOAD_MAX)
+
+// 2022-1: 1 <= L <= 20, 4 <= D <= 20, L * D <= 100
+#define RTP_FEC_COLS_MAX 20
+#define RTP_FEC_ROWS_MIN 4
+#define RTP_FEC_ROWS_MAX 20
+#define RTP_FEC_MATRIX_MAX 100
+
+#define RTP_FEC_PT 96
+#define RTP_FEC_PORT_COLUMN 2 // media port + 2
+#define RTP_FEC_PORT_ROW 4 // media port + 4
+
+#define RTP_FEC_SLOTS 512 // decoder: media packets kept for recovery, power of 2
+#define RTP_FEC_STORE 128 // decoder: FEC packets kept
+
+enum
+{
+    RTP_FEC_COLUMN = 0,
+    RTP_FEC_ROW = 1,
+};
+
+/* XOR of the protected fields of a group */
+typedef struct
+{
+    uint16_t snbase;
+    uint16_t length;
+    uint8_t pt;
+    uint32_t ts;
+    uint16_t size; // longest payload, the shorter ones are padded with zeroes
+    uint8_t payload[RTP_FEC_PAYLOAD_MAX];
+} rtp_fec_sum_t;
+
+typedef struct
+{
+    int kind; // RTP_FEC_COLUMN or RTP_FEC_ROW
+    size_t size;
+    uint8_t data[RTP_FEC_PACKET_MAX];
+} rtp_fec_packet_t;
+
+typedef struct
+{
+    int cols;
+    int rows;
+    bool row; // row FEC, otherwise columns only (1D)
+
+    int index; // position in the matrix
+    uint16_t seq[2];
+    rtp_fec_sum_t col_sum[RTP_FEC_COLS_MAX];
+    rtp_fec_sum_t row_sum;
+
+    // FEC packets completed by the last rtp_fec_encode()
+    int count;
+    rtp_fec_packet_t out[RTP_FEC_COLS_MAX + 1];
+
+    // published
+    uint64_t packets[2]; // column, row
+} rtp_fec_encoder_t;
+
+typedef void (*rtp_fec_media_t)(void *arg, const uint8_t *packet, size_t size);
+
+typedef struct
+{
+    bool valid;
+    uint16_t seq;
+    uint16_t size;
+    uint8_t data[RTP_FEC_RTP_SIZE + RTP_FEC_PAYLOAD_MAX];
+} rtp_fec_slot_t;
+
+typedef struct
+{
+    bool valid;
+    int kind;
+    uint16_t snbase;
+    uint8_t offset;
+    uint8_t na;
+    rtp_fec_sum_t sum;
+} rtp_fec_entry_t;
+
+typedef struct
+{
+    rtp_fec_media_t on_media;
+    void *arg;
+
+    bool started;
+    uint16_t next; // next sequence number to release
+    uint16_t highest;
+    int hold; // sequence numbers a missing packet waits for FEC
+    int store_next;
+
+    rtp_fec_slot_t slots[RTP_FEC_SLOTS];
+    rtp_fec_entry_t store[RTP_FEC_STORE];
+    uint8_t scratch[RTP_FEC_RTP_SIZE + RTP_FEC_PAYLOAD_MAX];
+
+    // published
+    int cols; // L and D of the column FEC received
+    int rows;
+    uint64_t media;
+    uint64_t fec[2]; // column, row
+    uint64_t recovered;
+    uint64_t unrecoverable;
+    uint64_t late; // behind the released sequence
+    uint64_t duplicates;
+    uint64_t resyncs;
+    uint64_t bad; // not a media or FEC packet
+} rtp_fec_decoder_t;
+
+/* dst ^= src, vectorized */
+void rtp_fec_xor(uint8_t *dst, const uint8_t *src, size_t size);
+
+/* "LxD" - L columns, D rows, false - not a 2022-1 matrix */
+bool rtp_fec_parse(const char *value, int *cols, int *rows);
+
+void rtp_fec_encoder_init(rtp_fec_encoder_t *enc, int cols, int rows, bool row);
+/* media packet: fixed RTP header and payload, returns FEC packets completed in enc->out */
+int rtp_fec_encode(rtp_fec_encoder_t *enc, const uint8_t *header, const uint8_t *payload, size_t size);
+
+void rtp_fec_decoder_init(rtp_fec_decoder_t *dec, rtp_fec_media_t on_media, void *arg);
+/* media RTP packet, released packets go to on_media in sequence order */
+void rtp_fec_decoder_media(rtp_fec_decoder_t *dec, const uint8_t *packet, size_t size);
+/* FEC packet of the column or the row port */
+void rtp_fec_decoder_fec(rtp_fec_decoder_t *dec, const uint8_t *packet, size_t size);
+
+#define RTP_FEC_GET(_field) __atomic_load_n(&(_field), __ATOMIC_RELAXED)
+
+/* pushes { media, fec_column, fec_row, recovered, unrecoverable, ... } */
+void rtp_fec_decoder_push_stats(lua_State *L, rtp_fec_decoder_t *dec);
+
+#endif /* _RTP_FEC_H_ */
@@ -0,0 +1,240 @@
+/*
+ * Astra Module: UDP: RTP Seamless Merge (SMPTE 2022-7)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "rtp_merge.h"
+
+#define RTP_MERGE_MAX_DROPOUT 3000 // like RFC 3550 A.1
+#define RTP_MERGE_RESYNC_RUN 32
+
+static inline void counter_add(uint64_t *counter, uint64_t value)
+{
+    __atomic_fetch_add(counter, value, __ATOMIC_RELAXED);
+}
+
+static inline void counter_set(uint64_t *counter, uint64_t value)
+{
+    __atomic_store_n(counter, value, __ATOMIC_RELAXED);
+}
+
+static inline bool seen_get(const rtp_merge_t *merge, int slot)
+{
+    return (merge->seen[slot / 64] >> (slot % 64)) & 1;
+}
+
+static inline void seen_set(rtp_merge_t *merge, int slot, bool value)
+{
+    if(value)
+        merge->seen[slot / 64] |= (uint64_t)1 << (slot % 64);
+    else
+        merge->seen[slot / 64] &= ~((uint64_t)1 << (slot % 64));
+}
+
+void rtp_merge_init(rtp_merge_t *merge, int legs, int window)
+{
+    memset(merge, 0, sizeof(*merge));
+
+    if(legs < 1)
+        legs = 1;
+    if(legs > RTP_MERGE_LEGS_MAX)
+        legs = RTP_MERGE_LEGS_MAX;
+    merge->legs = legs;
+
+    if(window <= 0)
+        window = RTP_MERGE_WINDOW_DEFAULT;
+    int size = 64;
+    while(size < window && size < RTP_MERGE_WINDOW_MAX)
+        size *= 2;
+    merge->window = size;
+}
+
+void rtp_merge_reset(rtp_merge_t *merge)
+{
+    merge->seq_valid = false;
+    merge->late_run = 0;
+    for(int i = 0; i < merge->legs; ++i)
+        merge->leg[i].seq_valid = false;
+}
+
+static void merge_start(rtp_merge_t *merge, uint16_t seq)
+{
+    memset(merge->seen, 0, sizeof(merge->seen));
+    merge->seq_valid = true;
+    merge->max_seq = seq;
+    merge->late_run = 0;
+}
+
+static void leg_track(rtp_merge_leg_t *leg, uint16_t seq)
+{
+    if(!leg->seq_valid)
+    {
+        leg->seq_valid = true;
+        leg->max_seq = seq;
+        return;
+    }
+
+    const uint16_t delta = (uint16_t)(seq - leg->max_seq);
+    if(delta == 0)
+        return;
+    if(delta < RTP_MERGE_MAX_DROPOUT)
+    {
+        if(delta > 1)
+            counter_add(&leg->lost, (uint64_t)(delta - 1));
+        leg->max_seq = seq;
+    }
+    else if(delta > (uint16_t)(65536 - RTP_MERGE_MAX_DROPOUT))
+    {
+        // reordered on the leg: already counted as lost
+        if(RTP_MERGE_GET(leg->lost) > 0)
+            counter_add(&leg->lost, (uint64_t)-1);
+    }
+    else
+        leg->max_seq = seq;
+}
+
+bool rtp_merge_accept(rtp_merge_t *merge, int leg_id, uint16_t seq, uint64_t now_us)
+{
+    if(leg_id < 0 || leg_id >= merge->legs)
+        return false;
+
+    rtp_merge_leg_t *const leg = &merge->leg[leg_id];
+    counter_add(&leg->datagrams, 1);
+    counter_set(&leg->last_us, now_us);
+    leg_track(leg, seq);
+
+    const int mask = merge->window - 1;
+    const int slot = seq & mask;
+
+    if(!merge->seq_valid)
+    {
+        merge_start(merge, seq);
+        goto forward;
+    }
+
+    const uint16_t delta = (uint16_t)(seq - merge->max_seq);
+    if(delta == 0 || delta > (uint16_t)(65536 - RTP_MERGE_MAX_DROPOUT))
+    {
+        const int age = (uint16_t)(merge->max_seq - seq);
+        if(age >= merge->window)
+        {
+            counter_add(&leg->late, 1);
+            return false;
+        }
+
+        if(seen_get(merge, slot))
+        {
+            merge->late_run = 0;
+            counter_add(&leg->duplicates, 1);
+            if(merge->first_leg[slot] != leg_id)
+            {
+                const uint64_t skew = (now_us > merge->first_us[slot]) ? now_us - merge->first_us[slot] : 0;
+                counter_set(&leg->skew_us, skew);
+                if(skew > RTP_MERGE_GET(leg->skew_max_us))
+                    counter_set(&leg->skew_max_us, skew);
+                // the first leg leads
+                counter_set(&merge->leg[merge->first_leg[slot]].skew_us, 0);
+            }
+            return false;
+        }
+
+        // missing so far: the leading leg lost it or reordered
+        counter_add(&merge->recovered, 1);
+        if(RTP_MERGE_GET(merge->lost) > 0)
+            counter_add(&merge->lost, (uint64_t)-1);
+        goto forward;
+    }
+
+    if(delta >= RTP_MERGE_MAX_DROPOUT)
+    {
+        // far from the merged sequence: a stray or far lagging leg is dropped,
+        // far on every leg for a while - the source restarted the sequence
+        counter_add(&leg->late, 1);
+        if(++merge->late_run < RTP_MERGE_RESYNC_RUN)
+            return false;
+        counter_add(&merge->resyncs, 1);
+        merge_start(merge, seq);
+        goto forward;
+    }
+
+    // new max: sequence numbers behind it are missing until a leg brings them
+    if(delta > 1)
+        counter_add(&merge->lost, (uint64_t)(delta - 1));
+    if(delta >= merge->window)
+        memset(merge->seen, 0, sizeof(merge->seen));
+    else
+    {
+        for(uint16_t s = (uint16_t)(merge->max_seq + 1); s != seq; ++s)
+            seen_set(merge, s & mask, false);
+    }
+    merge->max_seq = seq;
+
+forward:
+    merge->late_run = 0;
+    seen_set(merge, slot, true);
+    merge->first_us[slot] = now_us;
+    merge->first_leg[slot] = (uint8_t)leg_id;
+    counter_add(&leg->forwarded, 1);
+    counter_add(&merge->forwarded, 1);
+    return true;
+}
+
+void rtp_merge_push_stats(lua_State *L, rtp_merge_t *merge, const char *const *sources, uint64_t now_us)
+{
+    lua_newtable(L);
+
+    lua_pushinteger(L, (lua_Integer)RTP_MERGE_GET(merge->forwarded));
+    lua_setfield(L, -2, "forwarded");
+    lua_pushinteger(L, (lua_Integer)RTP_MERGE_GET(merge->lost));
+    lua_setfield(L, -2, "lost");
+    lua_pushinteger(L, (lua_Integer)RTP_MERGE_GET(merge->recovered));
+    lua_setfield(L, -2, "recovered");
+    lua_pushinteger(L, (lua_Integer)RTP_MERGE_GET(merge->resyncs));
+    lua_setfield(L, -2, "resyncs");
+    lua_pushinteger(L, merge->window);
+    lua_setfield(L, -2, "window");
+
+    lua_newtable(L);
+    for(int i = 0; i < merge->legs; ++i)
+    {
+        rtp_merge_leg_t *const leg = &merge->leg[i];
+        const uint64_t last_us = RTP_MERGE_GET(leg->last_us);
+
+        lua_newtable(L);
+        if(sources && sources[i])
+        {
+            lua_pushstring(L, sources[i]);
+            lua_setfield(L, -2, "source");
+        }
+        lua_pushboolean(L, last_us != 0 && now_us < last_us + 2000000);
+        lua_setfield(L, -2, "on_air");
+        lua_pushinteger(L, (lua_Integer)RTP_MERGE_GET(leg->datagrams));
+        lua_setfield(L, -2, "datagrams");
+        lua_pushinteger(L, (lua_Integer)RTP_MERGE_GET(leg->forwarded));
+        lua_setfield(L, -2, "forwarded");
+        lua_pushinteger(L, (lua_Integer)RTP_MERGE_GET(leg->duplicates));
+        lua_setfield(L, -2, "duplicates");
+        lua_pushinteger(L, (lua_Integer)RTP_MERGE_GET(leg->late));
+        lua_setfield(L, -2, "late");
+        lua_pushinteger(L, (lua_Integer)RTP_MERGE_GET(leg->lost));
+        lua_setfield(L, -2, "lost");
+        lua_pushinteger(L, (lua_Integer)RTP_MERGE_GET(leg->skew_us));
+        lua_setfield(L, -2, "skew_us");
+        lua_pushinteger(L, (lua_Integer)RTP_MERGE_GET(leg->skew_max_us));
+        lua_setfield(L, -2, "skew_max_us");
+        lua_rawseti(L, -2, i + 1);
+    }
+    lua_setfield(L, -2, "legs");
+}
@@ -0,0 +1,88 @@
+/*
+ * Astra Module: UDP: RTP Seamless Merge (SMPTE 2022-7)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _RTP_MERGE_H_
+#define _RTP_MERGE_H_ 1
+
+#include <astra.h>
+
+/*
+ * Two or more RTP legs carry the same stream with the same sequence
+ * numbers. The first arrival of a sequence number is forwarded, later
+ * copies inside the window are dropped. A packet lost on one leg is
+ * taken from the other one without a switch.
+ * Only the receiving thread calls rtp_merge_accept(), the counters are
+ * updated with relaxed atomics and may be read from any thread.
+ */
+
+#define RTP_MERGE_LEGS_MAX 4
+#define RTP_MERGE_WINDOW_MAX 4096 // sequence numbers, power of 2
+#define RTP_MERGE_WINDOW_DEFAULT 512
+
+typedef struct
+{
+    uint64_t datagrams;
+    uint64_t forwarded; // first arrivals
+    uint64_t duplicates; // already forwarded by another leg
+    uint64_t late; // older than the window or far from the merged sequence
+    uint64_t lost; // sequence gaps of the leg itself
+    uint64_t skew_us; // behind the first arrival, last measured
+    uint64_t skew_max_us;
+    uint64_t last_us; // last datagram
+
+    // receiving thread only
+    bool seq_valid;
+    uint16_t max_seq;
+} rtp_merge_leg_t;
+
+typedef struct
+{
+    int window;
+    int legs;
+
+    // receiving thread only
+    bool seq_valid;
+    uint16_t max_seq;
+    int late_run; // far datagrams in a row: the source restarted
+    uint64_t seen[RTP_MERGE_WINDOW_MAX / 64];
+    uint64_t first_us[RTP_MERGE_WINDOW_MAX];
+    uint8_t first_leg[RTP_MERGE_WINDOW_MAX];
+
+    // merged stream
+    uint64_t forwarded;
+    uint64_t lost; // not received on any leg
+    uint64_t recovered; // forwarded behind max_seq: missing on the leading leg
+    uint64_t resyncs;
+
+    rtp_merge_leg_t leg[RTP_MERGE_LEGS_MAX];
+} rtp_merge_t;
+
+/* window is rounded up to a power of 2 and clamped to RTP_MERGE_WINDOW_MAX */
+void rtp_merge_init(rtp_merge_t *merge, int legs, int window);
+/* starts from the next datagram, counters are kept */
+void rtp_merge_reset(rtp_merge_t *merge);
+
+/* true - first arrival, forward the datagram */
+bool rtp_merge_accept(rtp_merge_t *merge, int leg, uint16_t seq, uint64_t now_us);
+
+#define RTP_MERGE_GET(_field) __atomic_load_n(&(_field), __ATOMIC_RELAXED)
+
+/* pushes { forwarded, lost, recovered, resyncs, window, legs = { {...}, ... } },
+ * sources[i] - name of the leg i or NULL */
+void rtp_merge_push_stats(lua_State *L, rtp_merge_t *merge, const char *const *sources, uint64_t now_us);
+
+#endif /* _RTP_MERGE_H_ */
@@ -0,0 +1,92 @@
+/*
+ * Astra Module: UDP: segmentation offload (UDP_SEGMENT) and receive coalescing (UDP_GRO)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "udp_gso.h"
+
+#include <errno.h>
+#include <string.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+
+#ifndef SOL_UDP
+#   define SOL_UDP 17
+#endif
+#ifndef UDP_SEGMENT
+#   define UDP_SEGMENT 103
+#endif
+#ifndef UDP_GRO
+#   define UDP_GRO 104
+#endif
+
+bool udp_gso_probe(int fd)
+{
+    // Linux 4.18+: the option is readable on any UDP socket
+    int value = 0;
+    socklen_t len = sizeof(value);
+    return getsockopt(fd, SOL_UDP, UDP_SEGMENT, &value, &len) == 0;
+}
+
+int udp_gso_segments(size_t segment)
+{
+    if(segment == 0)
+        return 1;
+    const size_t n = UDP_GSO_PAYLOAD_MAX / segment;
+    if(n < 1)
+        return 1;
+    return (n > UDP_GSO_SEGMENTS_MAX) ? UDP_GSO_SEGMENTS_MAX : (int)n;
+}
+
+void udp_gso_set(struct msghdr *msg, uint8_t *cmsg, uint16_t segment)
+{
+    memset(cmsg, 0, UDP_GSO_CMSG_SIZE);
+    msg->msg_control = cmsg;
+    msg->msg_controllen = UDP_GSO_CMSG_SIZE;
+
+    struct cmsghdr *c = CMSG_FIRSTHDR(msg);
+    c->cmsg_level = SOL_UDP;
+    c->cmsg_type = UDP_SEGMENT;
+    c->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+    memcpy(CMSG_DATA(c), &segment, sizeof(segment));
+}
+
+bool udp_gso_unsupported(int err)
+{
+    // EIO - no checksum offload on the route (or IPsec), EINVAL - segment
+    // above the path MTU or too many segments for this kernel
+    return err == EIO || err == EINVAL || err == EOPNOTSUPP || err == ENOPROTOOPT;
+}
+
+bool udp_gro_set(int fd, bool on)
+{
+    // Linux 5.0+
+    const int value = on ? 1 : 0;
+    return setsockopt(fd, SOL_UDP, UDP_GRO, &value, sizeof(value)) == 0;
+}
+
+int udp_gro_segment(const struct msghdr *msg)
+{
+    for(struct cmsghdr *c = CMSG_FIRSTHDR(msg); c; c = CMSG_NXTHDR((struct msghdr *)msg, c))
+    {
+        if(c->cmsg_level == SOL_UDP && c->cmsg_type == UDP_GRO)
+        {
+            int segment = 0;
+            memcpy(&segment, CMSG_DATA(c), sizeof(segment));
+            return segment;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,59 @@
+/*
+ * Astra Module: UDP: segmentation offload (UDP_SEGMENT) and receive coalescing (UDP_GRO)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _UDP_GSO_H_
+#define _UDP_GSO_H_ 1
+
+#include <astra.h>
+#include <sys/socket.h>
+
+/*
+ * Linux only. A GSO send carries a run of datagrams of one size (the last
+ * one may be shorter) in one msghdr with the UDP_SEGMENT control message,
+ * the kernel or the NIC cuts it back into datagrams. A socket with UDP_GRO
+ * receives such runs (and runs coalesced by the NIC) as one buffer, the
+ * segment size comes in the UDP_GRO control message.
+ * Kernels without the option fail the probe, a send rejected by the path
+ * (udp_gso_unsupported) is repeated without GSO.
+ */
+
+#define UDP_GSO_PAYLOAD_MAX 65507 // IPv4 UDP datagram
+#define UDP_GSO_SEGMENTS_MAX 64 // UDP_MAX_SEGMENTS of older kernels, newer allow 128
+#define UDP_GRO_BUFFER_SIZE 65536
+
+#define UDP_GSO_CMSG_SIZE CMSG_SPACE(sizeof(uint16_t))
+#define UDP_GRO_CMSG_SIZE CMSG_SPACE(sizeof(int))
+
+/* true - the kernel segments sends of this UDP socket */
+bool udp_gso_probe(int fd);
+
+/* datagrams of this size in one GSO send */
+int udp_gso_segments(size_t segment);
+
+/* adds UDP_SEGMENT to msg, cmsg - UDP_GSO_CMSG_SIZE bytes kept until the send */
+void udp_gso_set(struct msghdr *msg, uint8_t *cmsg, uint16_t segment);
+
+/* errno of a GSO send refused by the kernel or the device: send without GSO */
+bool udp_gso_unsupported(int err);
+
+/* false - the kernel does not coalesce for this socket */
+bool udp_gro_set(int fd, bool on);
+
+/* segment size of a received buffer, 0 - one datagram */
+int udp_gro_segment(const struct msghdr *msg);
+
+#endif /* _UDP_GSO_H_ */
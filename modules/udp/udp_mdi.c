@@ -0,0 +1,265 @@
+/*
+ * Astra Module: UDP: RFC 4445 Media Delivery Index (DF:MLR)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "udp_mdi.h"
+
+#define MDI_CC_VALID 0x10
+
+#define MDI_GET(_v) __atomic_load_n(&(_v), __ATOMIC_RELAXED)
+#define MDI_SET(_v, _x) __atomic_store_n(&(_v), (_x), __ATOMIC_RELAXED)
+
+// upper bounds of the inter-arrival buckets, the last one is open
+static const uint32_t mdi_iat_bounds_us[UDP_MDI_IAT_BUCKETS - 1] =
+{
+    50, 100, 200, 500, 1000, 2000, 5000, 10000, 20000, 50000, 100000,
+};
+
+void udp_mdi_init(udp_mdi_t *mdi)
+{
+    memset(mdi, 0, sizeof(*mdi));
+}
+
+static inline uint32_t clamp_u32(uint64_t value)
+{
+    return (value > UINT32_MAX) ? UINT32_MAX : (uint32_t)value;
+}
+
+static void mdi_restart(udp_mdi_t *mdi, uint64_t stamp_ns, bool kernel)
+{
+    mdi->started = true;
+    mdi->kernel = kernel;
+    mdi->window_start_ns = stamp_ns;
+    mdi->last_ns = stamp_ns;
+    mdi->window_bytes = 0;
+    mdi->window_lost = 0;
+    mdi->window_iat_max_us = 0;
+    mdi->rate = 0;
+    mdi->vb = 0;
+    mdi->vb_min = 0;
+    mdi->vb_max = 0;
+}
+
+static void mdi_interval(udp_mdi_t *mdi, uint64_t stamp_ns)
+{
+    const uint64_t elapsed = stamp_ns - mdi->window_start_ns;
+
+    if(mdi->rate > 0)
+    {
+        const uint32_t df_us = clamp_u32((uint64_t)((mdi->vb_max - mdi->vb_min) * 1000000.0 / (double)mdi->rate));
+        MDI_SET(mdi->df_us, df_us);
+        if(df_us > mdi->df_max_us)
+            MDI_SET(mdi->df_max_us, df_us);
+    }
+
+    const uint32_t mlr = clamp_u32((mdi->window_lost * UDP_MDI_INTERVAL_NS + elapsed / 2) / elapsed);
+    MDI_SET(mdi->mlr, mlr);
+    if(mlr > mdi->mlr_max)
+        MDI_SET(mdi->mlr_max, mlr);
+    MDI_SET(mdi->iat_max_us, mdi->window_iat_max_us);
+
+    mdi->rate = (uint64_t)((double)mdi->window_bytes * 1000000000.0 / (double)elapsed);
+    MDI_SET(mdi->rate_bps, mdi->rate * 8);
+    MDI_SET(mdi->intervals, mdi->intervals + 1);
+
+    mdi->window_start_ns = stamp_ns;
+    mdi->window_bytes = 0;
+    mdi->window_lost = 0;
+    mdi->window_iat_max_us = 0;
+    mdi->vb = 0;
+    mdi->vb_min = 0;
+    mdi->vb_max = 0;
+}
+
+static void mdi_iat(udp_mdi_t *mdi, uint64_t delta_ns)
+{
+    const uint32_t iat_us = clamp_u32(delta_ns / 1000);
+
+    int bucket = 0;
+    while(bucket < UDP_MDI_IAT_BUCKETS - 1 && iat_us > mdi_iat_bounds_us[bucket])
+        ++bucket;
+    MDI_SET(mdi->iat[bucket], mdi->iat[bucket] + 1);
+
+    if(iat_us > mdi->window_iat_max_us)
+        mdi->window_iat_max_us = iat_us;
+    if(iat_us > mdi->iat_peak_us)
+        MDI_SET(mdi->iat_peak_us, iat_us);
+}
+
+/* TS packets missing by the continuity counters */
+static uint64_t mdi_lost(udp_mdi_t *mdi, const uint8_t *ts, size_t count)
+{
+    uint64_t lost = 0;
+    for(size_t i = 0; i < count; ++i, ts += TS_PACKET_SIZE)
+    {
+        const uint16_t pid = TS_GET_PID(ts);
+        if(pid == NULL_TS_PID)
+            continue;
+
+        uint8_t *const cc = &mdi->cc[pid];
+        if(TS_IS_AF(ts) && ts[4] > 0 && (ts[5] & 0x80))
+            *cc = 0; // discontinuity_indicator
+        if(!TS_IS_PAYLOAD(ts))
+            continue;
+
+        const uint8_t value = TS_GET_CC(ts);
+        if(*cc & MDI_CC_VALID)
+        {
+            const uint8_t last = *cc & 0x0F;
+            // one duplicate is allowed
+            if(value != last)
+                lost += (uint8_t)(value - last - 1) & 0x0F;
+        }
+        *cc = MDI_CC_VALID | value;
+    }
+    return lost;
+}
+
+void udp_mdi_packet(udp_mdi_t *mdi, uint64_t stamp_ns, uint64_t now_us, const uint8_t *ts, size_t count)
+{
+    const bool kernel = (stamp_ns != 0);
+    if(kernel)
+        MDI_SET(mdi->kernel_stamps, mdi->kernel_stamps + 1);
+    else
+    {
+        MDI_SET(mdi->user_stamps, mdi->user_stamps + 1);
+        stamp_ns = now_us * 1000;
+    }
+    MDI_SET(mdi->datagrams, mdi->datagrams + 1);
+
+    const uint64_t lost = mdi_lost(mdi, ts, count);
+    if(lost > 0)
+        MDI_SET(mdi->lost, mdi->lost + lost);
+
+    // the clocks of kernel and user stamps differ, a step back restarts too
+    if(!mdi->started || kernel != mdi->kernel || stamp_ns < mdi->last_ns)
+        mdi_restart(mdi, stamp_ns, kernel);
+    else
+    {
+        if(stamp_ns >= mdi->window_start_ns + UDP_MDI_INTERVAL_NS)
+            mdi_interval(mdi, stamp_ns);
+
+        const uint64_t delta_ns = stamp_ns - mdi->last_ns;
+        mdi_iat(mdi, delta_ns);
+        if(mdi->rate > 0)
+        {
+            mdi->vb -= (double)mdi->rate * (double)delta_ns / 1000000000.0;
+            if(mdi->vb < mdi->vb_min)
+                mdi->vb_min = mdi->vb;
+        }
+    }
+
+    const uint64_t bytes = (uint64_t)count * TS_PACKET_SIZE;
+    mdi->vb += (double)bytes;
+    if(mdi->vb > mdi->vb_max)
+        mdi->vb_max = mdi->vb;
+    mdi->window_bytes += bytes;
+    mdi->window_lost += lost;
+    mdi->last_ns = stamp_ns;
+}
+
+void udp_mdi_restart(udp_mdi_t *mdi)
+{
+    mdi->started = false;
+    memset(mdi->cc, 0, sizeof(mdi->cc));
+}
+
+void udp_mdi_push_stats(lua_State *L, udp_mdi_t *mdi)
+{
+    lua_newtable(L);
+
+    const uint64_t kernel_stamps = MDI_GET(mdi->kernel_stamps);
+    const uint64_t user_stamps = MDI_GET(mdi->user_stamps);
+    lua_pushstring(L, (kernel_stamps >= user_stamps && kernel_stamps > 0) ? "kernel" : "user");
+    lua_setfield(L, -2, "clock");
+
+    const uint32_t df_us = MDI_GET(mdi->df_us);
+    const uint32_t mlr = MDI_GET(mdi->mlr);
+    char mdi_str[48];
+    snprintf(mdi_str, sizeof(mdi_str), "%.2f:%u", (double)df_us / 1000.0, mlr);
+    lua_pushstring(L, mdi_str);
+    lua_setfield(L, -2, "mdi");
+
+    lua_pushnumber(L, (lua_Number)df_us / 1000.0);
+    lua_setfield(L, -2, "df_ms");
+    lua_pushnumber(L, (lua_Number)MDI_GET(mdi->df_max_us) / 1000.0);
+    lua_setfield(L, -2, "df_max_ms");
+    lua_pushinteger(L, (lua_Integer)mlr);
+    lua_setfield(L, -2, "mlr");
+    lua_pushinteger(L, (lua_Integer)MDI_GET(mdi->mlr_max));
+    lua_setfield(L, -2, "mlr_max");
+    lua_pushinteger(L, (lua_Integer)MDI_GET(mdi->lost));
+    lua_setfield(L, -2, "lost");
+    lua_pushinteger(L, (lua_Integer)MDI_GET(mdi->rate_bps));
+    lua_setfield(L, -2, "rate_bps");
+    lua_pushinteger(L, (lua_Integer)MDI_GET(mdi->iat_max_us));
+    lua_setfield(L, -2, "iat_max_us");
+    lua_pushinteger(L, (lua_Integer)MDI_GET(mdi->iat_peak_us));
+    lua_setfield(L, -2, "iat_peak_us");
+    lua_pushinteger(L, (lua_Integer)MDI_GET(mdi->intervals));
+    lua_setfield(L, -2, "intervals");
+    lua_pushinteger(L, (lua_Integer)MDI_GET(mdi->datagrams));
+    lua_setfield(L, -2, "datagrams");
+    lua_pushinteger(L, (lua_Integer)kernel_stamps);
+    lua_setfield(L, -2, "kernel_stamps");
+    lua_pushinteger(L, (lua_Integer)user_stamps);
+    lua_setfield(L, -2, "user_stamps");
+
+    // { { le_us = 50, count = N }, ..., { count = N } } - the last bucket is open
+    lua_newtable(L);
+    for(int i = 0; i < UDP_MDI_IAT_BUCKETS; ++i)
+    {
+        lua_newtable(L);
+        if(i < UDP_MDI_IAT_BUCKETS - 1)
+        {
+            lua_pushinteger(L, (lua_Integer)mdi_iat_bounds_us[i]);
+            lua_setfield(L, -2, "le_us");
+        }
+        lua_pushinteger(L, (lua_Integer)MDI_GET(mdi->iat[i]));
+        lua_setfield(L, -2, "count");
+        lua_rawseti(L, -2, i + 1);
+    }
+    lua_setfield(L, -2, "iat_hist");
+}
+
+#ifdef __linux__
+bool udp_mdi_timestamps_set(int fd)
+{
+    const int on = 1;
+    return setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on)) == 0;
+}
+
+uint64_t udp_mdi_timestamp(const struct msghdr *msg)
+{
+    for(struct cmsghdr *c = CMSG_FIRSTHDR(msg); c; c = CMSG_NXTHDR((struct msghdr *)msg, c))
+    {
+        if(c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_TIMESTAMPNS
+           && c->cmsg_len >= CMSG_LEN(sizeof(struct timespec)))
+        {
+            struct timespec ts;
+            memcpy(&ts, CMSG_DATA(c), sizeof(ts));
+            return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+        }
+    }
+    return 0;
+}
+#else
+bool udp_mdi_timestamps_set(int fd)
+{
+    __uarg(fd);
+    return false;
+}
+#endif
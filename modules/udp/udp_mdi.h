@@ -0,0 +1,100 @@
+/*
+ * Astra Module: UDP: RFC 4445 Media Delivery Index (DF:MLR)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _UDP_MDI_H_
+#define _UDP_MDI_H_ 1
+
+#include <astra.h>
+#ifdef __linux__
+#include <sys/socket.h>
+#include <time.h>
+#endif
+
+/*
+ * Per-second Delay Factor and Media Loss Rate of a received TS stream and
+ * the histogram of datagram inter-arrival times. The arrival time is the
+ * kernel receive timestamp (SO_TIMESTAMPNS) when the datagram carries one,
+ * otherwise the time of the read in user space.
+ *
+ * DF: a virtual buffer gains the TS bytes of every datagram and drains at
+ * the rate measured over the previous interval, DF is the span of the
+ * buffer over the interval in milliseconds of that rate.
+ * MLR: TS packets lost per second by the continuity counters.
+ *
+ * One thread meters (udp_mdi_packet), the published values are updated with
+ * relaxed atomics and may be read from any thread.
+ */
+
+#define UDP_MDI_INTERVAL_NS 1000000000ULL
+#define UDP_MDI_IAT_BUCKETS 12
+
+#ifdef __linux__
+#define UDP_MDI_CMSG_SIZE CMSG_SPACE(sizeof(struct timespec))
+#endif
+
+typedef struct
+{
+    // metering thread only
+    bool started;
+    bool kernel;
+    uint64_t window_start_ns;
+    uint64_t last_ns;
+    uint64_t window_bytes;
+    uint64_t window_lost;
+    uint32_t window_iat_max_us;
+    uint64_t rate; // bytes per second, previous interval
+    double vb;
+    double vb_min;
+    double vb_max;
+    uint8_t cc[MAX_PID]; // 0x10 - valid, low bits - last CC
+
+    // published
+    uint32_t df_us;
+    uint32_t df_max_us;
+    uint32_t mlr;
+    uint32_t mlr_max;
+    uint32_t iat_max_us; // last interval
+    uint32_t iat_peak_us;
+    uint64_t rate_bps;
+    uint64_t lost;
+    uint64_t intervals;
+    uint64_t datagrams;
+    uint64_t kernel_stamps;
+    uint64_t user_stamps;
+    uint64_t iat[UDP_MDI_IAT_BUCKETS];
+} udp_mdi_t;
+
+void udp_mdi_init(udp_mdi_t *mdi);
+
+/* stamp_ns - kernel receive time (CLOCK_REALTIME), 0 - the datagram has none, now_us is used */
+void udp_mdi_packet(udp_mdi_t *mdi, uint64_t stamp_ns, uint64_t now_us, const uint8_t *ts, size_t count);
+
+/* the source is changed: continuity counters and the interval start over, totals are kept */
+void udp_mdi_restart(udp_mdi_t *mdi);
+
+/* pushes the stats table */
+void udp_mdi_push_stats(lua_State *L, udp_mdi_t *mdi);
+
+/* false - the socket gives no receive timestamps */
+bool udp_mdi_timestamps_set(int fd);
+
+#ifdef __linux__
+/* SCM_TIMESTAMPNS of a received message in ns, 0 - none */
+uint64_t udp_mdi_timestamp(const struct msghdr *msg);
+#endif
+
+#endif /* _UDP_MDI_H_ */
@@ -0,0 +1,874 @@
+/*
+ * Astra Module: UDP: shared pacing threads for udp_output sync/cbr
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "udp_pacer.h"
+#include "rtp_fec.h"
+
+#include <errno.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#define MSG(_msg) "[udp_output %s] " _msg, job->name
+
+#define PACER_DATAGRAM_SIZE 1460
+#define PACER_RTP_HEADER_SIZE 12
+#define PACER_TS_PER_DATAGRAM ((PACER_DATAGRAM_SIZE - PACER_RTP_HEADER_SIZE) / TS_PACKET_SIZE)
+#define PACER_THREADS_AUTO_MAX 4
+#define PACER_POLL_US 5000 // buffering: ring fill check
+#define PACER_BLOCK_MAX_US 500000
+#define PACER_DRIFT_MAX_US 100000 // timeline behind the clock, restart it
+
+typedef struct udp_pacer_thread_t udp_pacer_thread_t;
+
+struct udp_pacer_job_t
+{
+    udp_pacer_config_t config;
+    char *name;
+
+    udp_pacer_thread_t *thread;
+    udp_pacer_job_t *next; // incoming/removing list, under thread->mu
+    int heap_index;
+    uint64_t deadline_us;
+    bool removed; // under thread->mu
+
+    // SPSC ring of TS, indexes grow without wrap. Same head/tail protocol
+    // and flush handshake as asc_thread_buffer_t, but indexed by packet:
+    // the pacing thread looks ahead of the tail for the next PCR and walks
+    // the block across the wrap before consuming it, while the thread buffer
+    // only exposes the contiguous bytes at the tail
+    uint8_t *ring;
+    uint64_t ring_packets;
+    uint64_t buffer_packets;
+    uint64_t head; // producer
+    uint64_t tail; // consumer
+    uint64_t flush_head; // producer, the tail jumps here on overflow
+    int flush_request;
+
+    // pacing thread only
+    bool running;
+    bool reset;
+    uint64_t pcr;
+    uint16_t pcr_pid;
+    uint64_t block_end; // ring index of the PCR packet of the next block
+    uint32_t slots_left;
+    uint32_t ts_sync;
+    uint32_t block_tail;
+    uint64_t slot_us; // target time of the next TS slot
+
+    uint8_t datagram[PACER_DATAGRAM_SIZE];
+    size_t datagram_size;
+    uint16_t rtpseq;
+
+    uint64_t window_start_us;
+    uint64_t window_sum_us;
+    uint64_t window_count;
+    uint32_t window_max_us;
+
+    uint64_t send_dropped;
+    uint64_t send_log_us;
+    int send_errno;
+
+    // SMPTE 2022-1 FEC of the sent datagrams
+    rtp_fec_encoder_t *fec;
+    struct sockaddr_in fec_dst[2];
+
+    // published
+    udp_pacer_stats_t stats;
+};
+
+struct udp_pacer_thread_t
+{
+    int index;
+    pthread_t thread;
+    int timer_fd;
+
+    pthread_mutex_t mu;
+    pthread_cond_t cond;
+    udp_pacer_job_t *incoming;
+    udp_pacer_job_t *removing;
+    int jobs;
+
+    // pacing thread only
+    udp_pacer_job_t **heap;
+    int heap_count;
+    int heap_size;
+
+    uint8_t buffers[UDP_PACER_BURST][PACER_DATAGRAM_SIZE];
+    uint64_t targets[UDP_PACER_BURST];
+    struct iovec iov[UDP_PACER_BURST];
+    struct mmsghdr msgs[UDP_PACER_BURST];
+};
+
+static struct
+{
+    pthread_mutex_t mu;
+    int configured;
+    int count;
+    udp_pacer_thread_t *threads;
+} pacer = { PTHREAD_MUTEX_INITIALIZER, 0, 0, NULL };
+
+static const uint8_t null_ts[TS_PACKET_SIZE] = { 0x47, 0x1F, 0xFF, 0x10, 0x00 };
+
+static inline void counter_add(uint64_t *counter, uint64_t value)
+{
+    __atomic_fetch_add(counter, value, __ATOMIC_RELAXED);
+}
+
+static inline void value_set(uint32_t *value, uint32_t v)
+{
+    __atomic_store_n(value, v, __ATOMIC_RELAXED);
+}
+
+/*
+ * timer
+ */
+
+static void pacer_arm(udp_pacer_thread_t *t, uint64_t delay_us)
+{
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    if(delay_us > 0)
+    {
+        its.it_value.tv_sec = (time_t)(delay_us / 1000000);
+        its.it_value.tv_nsec = (long)(delay_us % 1000000) * 1000;
+    }
+    else
+        its.it_value.tv_nsec = 1;
+    timerfd_settime(t->timer_fd, 0, &its, NULL);
+}
+
+static void pacer_disarm(udp_pacer_thread_t *t)
+{
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    timerfd_settime(t->timer_fd, 0, &its, NULL);
+}
+
+/*
+ * EDF heap
+ */
+
+static void heap_swap(udp_pacer_thread_t *t, int a, int b)
+{
+    udp_pacer_job_t *const job = t->heap[a];
+    t->heap[a] = t->heap[b];
+    t->heap[b] = job;
+    t->heap[a]->heap_index = a;
+    t->heap[b]->heap_index = b;
+}
+
+static void heap_up(udp_pacer_thread_t *t, int i)
+{
+    while(i > 0)
+    {
+        const int parent = (i - 1) / 2;
+        if(t->heap[parent]->deadline_us <= t->heap[i]->deadline_us)
+            break;
+        heap_swap(t, i, parent);
+        i = parent;
+    }
+}
+
+static void heap_down(udp_pacer_thread_t *t, int i)
+{
+    for(;;)
+    {
+        const int left = i * 2 + 1;
+        const int right = left + 1;
+        int min = i;
+        if(left < t->heap_count && t->heap[left]->deadline_us < t->heap[min]->deadline_us)
+            min = left;
+        if(right < t->heap_count && t->heap[right]->deadline_us < t->heap[min]->deadline_us)
+            min = right;
+        if(min == i)
+            break;
+        heap_swap(t, i, min);
+        i = min;
+    }
+}
+
+static void heap_push(udp_pacer_thread_t *t, udp_pacer_job_t *job)
+{
+    if(t->heap_count == t->heap_size)
+    {
+        t->heap_size = (t->heap_size > 0) ? t->heap_size * 2 : 16;
+        t->heap = (udp_pacer_job_t **)realloc(t->heap, sizeof(udp_pacer_job_t *) * (size_t)t->heap_size);
+        asc_assert(t->heap != NULL, "[udp_pacer] realloc failed");
+    }
+    job->heap_index = t->heap_count;
+    t->heap[t->heap_count++] = job;
+    heap_up(t, job->heap_index);
+}
+
+static void heap_remove(udp_pacer_thread_t *t, udp_pacer_job_t *job)
+{
+    const int i = job->heap_index;
+    if(i < 0 || i >= t->heap_count || t->heap[i] != job)
+        return;
+
+    --t->heap_count;
+    if(i != t->heap_count)
+    {
+        t->heap[i] = t->heap[t->heap_count];
+        t->heap[i]->heap_index = i;
+        heap_down(t, i);
+        heap_up(t, i);
+    }
+    job->heap_index = -1;
+}
+
+/*
+ * job
+ */
+
+static inline const uint8_t *ring_at(const udp_pacer_job_t *job, uint64_t index)
+{
+    return &job->ring[(index % job->ring_packets) * TS_PACKET_SIZE];
+}
+
+static void job_consume(udp_pacer_job_t *job, uint64_t tail)
+{
+    __atomic_store_n(&job->tail, tail, __ATOMIC_RELEASE);
+}
+
+/* PCR packet of the stream after the first packet of the range */
+static bool job_seek_pcr(udp_pacer_job_t *job, uint64_t head, uint64_t *index, uint64_t *pcr)
+{
+    for(uint64_t i = job->tail + 1; i < head; ++i)
+    {
+        const uint8_t *const ts = ring_at(job, i);
+        if(!TS_IS_PCR(ts))
+            continue;
+
+        const uint16_t pid = TS_GET_PID(ts);
+        if(job->pcr_pid == 0)
+            job->pcr_pid = pid;
+        if(job->pcr_pid == pid)
+        {
+            *index = i;
+            *pcr = TS_GET_PCR(ts);
+            return true;
+        }
+    }
+    return false;
+}
+
+static void job_rebuffer(udp_pacer_job_t *job, uint64_t head)
+{
+    job->running = false;
+    job->slots_left = 0;
+    job_consume(job, head);
+    counter_add(&job->stats.rebuffers, 1);
+    asc_log_info(MSG("buffering..."));
+}
+
+/* the producer overflowed the ring: drop the backlog and buffer again */
+static void job_apply_flush(udp_pacer_job_t *job, uint64_t head)
+{
+    if(!__atomic_load_n(&job->flush_request, __ATOMIC_RELAXED))
+        return;
+    if(!__atomic_exchange_n(&job->flush_request, 0, __ATOMIC_ACQUIRE))
+        return;
+
+    const uint64_t flush_head = __atomic_load_n(&job->flush_head, __ATOMIC_RELAXED);
+    if(flush_head > job->tail && flush_head <= head)
+        job_rebuffer(job, flush_head);
+}
+
+/* true - the job starts from the first PCR of the full buffer */
+static bool job_buffer(udp_pacer_job_t *job, uint64_t head)
+{
+    if(head - job->tail < job->buffer_packets)
+        return false;
+
+    uint64_t index;
+    if(!job_seek_pcr(job, head, &index, &job->pcr))
+    {
+        asc_log_error(MSG("first PCR is not found"));
+        job_rebuffer(job, head);
+        return false;
+    }
+
+    job_consume(job, index);
+    job->running = true;
+    job->reset = true;
+    job->slots_left = 0;
+    return true;
+}
+
+/* false - the next PCR is not buffered, the job goes back to buffering */
+static bool job_block(udp_pacer_job_t *job, uint64_t head, uint64_t now)
+{
+    uint64_t index;
+    uint64_t pcr;
+    if(!job_seek_pcr(job, head, &index, &pcr))
+    {
+        asc_log_error(MSG("next PCR is not found"));
+        job_rebuffer(job, head);
+        return false;
+    }
+
+    const uint64_t block_size = index - job->tail;
+    const uint64_t block_time = mpegts_pcr_block_us(&job->pcr, &pcr);
+    if(block_time == 0 || block_time > PACER_BLOCK_MAX_US)
+    {
+        asc_log_debug(MSG("block time out of range: %"PRIu64"ms block_size:%"PRIu64),
+            block_time / 1000, block_size * TS_PACKET_SIZE);
+        job_consume(job, index);
+        job->reset = true;
+        return true;
+    }
+
+    if(job->reset)
+    {
+        job->reset = false;
+        job->slot_us = now;
+    }
+    else if(now > job->slot_us + PACER_DRIFT_MAX_US)
+    {
+        asc_log_warning(MSG("wrong syncing time. -%"PRIu64"ms"), (now - job->slot_us) / 1000);
+        job->slot_us = now;
+    }
+
+    uint64_t ts_count = block_size;
+    if(job->config.cbr > 0)
+    {
+        const uint64_t cbr_ts_count = (uint64_t)job->config.cbr * block_time / 1000000;
+        if(cbr_ts_count > ts_count)
+            ts_count = cbr_ts_count;
+    }
+
+    job->block_end = index;
+    job->slots_left = (uint32_t)ts_count;
+    job->ts_sync = (uint32_t)(block_time / ts_count);
+    job->block_tail = (uint32_t)(block_time % ts_count);
+    return true;
+}
+
+/* true - the datagram is complete */
+static bool job_append(udp_pacer_job_t *job, const uint8_t *ts)
+{
+    if(job->config.rtp && job->datagram_size == 0)
+    {
+        struct timeval tv;
+        gettimeofday(&tv, NULL);
+        const uint64_t msec = ((tv.tv_sec % 1000000) * 1000) + (tv.tv_usec / 1000);
+
+        uint8_t *const rtp = job->datagram;
+        rtp[0] = 0x80; // RTP version
+        rtp[1] = 33; // MP2T
+        rtp[2] = (job->rtpseq >> 8) & 0xFF;
+        rtp[3] = (job->rtpseq     ) & 0xFF;
+        rtp[4] = (msec >> 24) & 0xFF;
+        rtp[5] = (msec >> 16) & 0xFF;
+        rtp[6] = (msec >>  8) & 0xFF;
+        rtp[7] = (msec      ) & 0xFF;
+        rtp[8] = (job->config.rtp_ssrc >> 24) & 0xFF;
+        rtp[9] = (job->config.rtp_ssrc >> 16) & 0xFF;
+        rtp[10] = (job->config.rtp_ssrc >> 8) & 0xFF;
+        rtp[11] = (job->config.rtp_ssrc     ) & 0xFF;
+        ++job->rtpseq;
+
+        job->datagram_size = PACER_RTP_HEADER_SIZE;
+    }
+
+    memcpy(&job->datagram[job->datagram_size], ts, TS_PACKET_SIZE);
+    job->datagram_size += TS_PACKET_SIZE;
+    return job->datagram_size > PACER_DATAGRAM_SIZE - TS_PACKET_SIZE;
+}
+
+static void job_deviation(udp_pacer_job_t *job, uint64_t now, uint64_t target)
+{
+    const uint64_t deviation = (now > target) ? (now - target) : (target - now);
+    const uint32_t value = (deviation > UINT32_MAX) ? UINT32_MAX : (uint32_t)deviation;
+
+    if(now > target + UDP_PACER_LATE_US)
+        counter_add(&job->stats.late, 1);
+    if(value > job->stats.deviation_peak_us)
+        value_set(&job->stats.deviation_peak_us, value);
+
+    job->window_sum_us += value;
+    ++job->window_count;
+    if(value > job->window_max_us)
+        job->window_max_us = value;
+}
+
+static void job_window(udp_pacer_job_t *job, uint64_t now)
+{
+    if(now < job->window_start_us + UDP_PACER_WINDOW_US)
+        return;
+
+    const uint64_t avg = (job->window_count > 0) ? job->window_sum_us / job->window_count : 0;
+    value_set(&job->stats.deviation_avg_us, (uint32_t)avg);
+    value_set(&job->stats.deviation_max_us, job->window_max_us);
+    job->window_start_us = now;
+    job->window_sum_us = 0;
+    job->window_count = 0;
+    job->window_max_us = 0;
+}
+
+static void job_send(udp_pacer_thread_t *t, udp_pacer_job_t *job, int count)
+{
+    for(int i = 0; i < count; ++i)
+    {
+        struct msghdr *const hdr = &t->msgs[i].msg_hdr;
+        memset(hdr, 0, sizeof(*hdr));
+        hdr->msg_name = &job->config.dst;
+        hdr->msg_namelen = sizeof(job->config.dst);
+        hdr->msg_iov = &t->iov[i];
+        hdr->msg_iovlen = 1;
+    }
+
+    int sent = 0;
+    int err = 0;
+    while(sent < count)
+    {
+        const int r = sendmmsg(job->config.fd, &t->msgs[sent], (unsigned int)(count - sent), MSG_DONTWAIT);
+        if(r <= 0)
+        {
+            err = (r < 0) ? errno : EAGAIN;
+            break;
+        }
+        sent += r;
+    }
+
+    // a dropped datagram is protected too, the receiver may recover it
+    for(int i = 0; job->fec && i < count; ++i)
+    {
+        const uint8_t *const datagram = (const uint8_t *)t->iov[i].iov_base;
+        const size_t size = t->iov[i].iov_len;
+        const int n = rtp_fec_encode(job->fec, datagram, &datagram[PACER_RTP_HEADER_SIZE]
+                                     , size - PACER_RTP_HEADER_SIZE);
+        for(int k = 0; k < n; ++k)
+        {
+            const rtp_fec_packet_t *const p = &job->fec->out[k];
+            if(sendto(job->config.fd, p->data, p->size, MSG_DONTWAIT
+                      , (const struct sockaddr *)&job->fec_dst[p->kind], sizeof(job->fec_dst[p->kind])) < 0)
+            {
+                counter_add(&job->stats.fec_send_errors, 1);
+            }
+        }
+    }
+
+    const uint64_t now = asc_utime();
+    for(int i = 0; i < sent; ++i)
+        job_deviation(job, now, t->targets[i]);
+    job_window(job, now);
+    counter_add(&job->stats.datagrams, (uint64_t)sent);
+
+    if(sent == count)
+        return;
+
+    const uint64_t dropped = (uint64_t)(count - sent);
+    counter_add(&job->stats.send_errors, dropped);
+    job->send_dropped += dropped;
+    if(err != job->send_errno || now >= job->send_log_us + 2000000)
+    {
+        if(err == EAGAIN || err == EWOULDBLOCK || err == ENOBUFS)
+            asc_log_warning(MSG("send queue overflow: dropped %"PRIu64" packets; last error [%s]"),
+                job->send_dropped, strerror(err));
+        else
+            asc_log_warning(MSG("error on send [%s]"), strerror(err));
+        job->send_dropped = 0;
+        job->send_log_us = now;
+        job->send_errno = err;
+    }
+}
+
+/* sends the due datagrams of the job, returns the next deadline */
+static uint64_t job_run(udp_pacer_thread_t *t, udp_pacer_job_t *job, uint64_t now)
+{
+    const uint64_t head = __atomic_load_n(&job->head, __ATOMIC_ACQUIRE);
+    job_apply_flush(job, head);
+
+    if(!job->running && !job_buffer(job, head))
+        return now + PACER_POLL_US;
+
+    int count = 0;
+    uint64_t tail = job->tail;
+    uint64_t null_packets = 0;
+    while(count < UDP_PACER_BURST)
+    {
+        if(job->slots_left == 0)
+        {
+            job_consume(job, tail);
+            if(!job_block(job, head, now))
+                break;
+            tail = job->tail;
+            continue;
+        }
+
+        if(job->slot_us > now + UDP_PACER_SLACK_US)
+            break;
+
+        const uint8_t *ts = null_ts;
+        if(tail != job->block_end)
+            ts = ring_at(job, tail++);
+        else
+            ++null_packets;
+
+        if(job_append(job, ts))
+        {
+            memcpy(t->buffers[count], job->datagram, job->datagram_size);
+            t->iov[count].iov_base = t->buffers[count];
+            t->iov[count].iov_len = job->datagram_size;
+            t->targets[count] = job->slot_us;
+            job->datagram_size = 0;
+            ++count;
+        }
+
+        job->slot_us += job->ts_sync;
+        if(--job->slots_left == 0)
+            job->slot_us += job->block_tail;
+    }
+
+    if(job->running)
+        job_consume(job, tail);
+    if(null_packets)
+        counter_add(&job->stats.null_packets, null_packets);
+    if(count > 0)
+        job_send(t, job, count);
+
+    if(!job->running)
+        return now + PACER_POLL_US;
+    if(job->slots_left == 0)
+        return job->slot_us;
+
+    // wake up when the slot of the last TS of the datagram comes
+    uint32_t left = PACER_TS_PER_DATAGRAM;
+    if(job->datagram_size > 0)
+    {
+        const size_t header = job->config.rtp ? PACER_RTP_HEADER_SIZE : 0;
+        left -= (uint32_t)((job->datagram_size - header) / TS_PACKET_SIZE);
+    }
+    if(left > job->slots_left)
+        left = job->slots_left;
+    return job->slot_us + (uint64_t)(left - 1) * job->ts_sync;
+}
+
+/*
+ * thread
+ */
+
+static void pacer_take_requests(udp_pacer_thread_t *t, uint64_t now)
+{
+    pthread_mutex_lock(&t->mu);
+    udp_pacer_job_t *incoming = t->incoming;
+    udp_pacer_job_t *removing = t->removing;
+    t->incoming = NULL;
+    t->removing = NULL;
+    pthread_mutex_unlock(&t->mu);
+
+    while(incoming)
+    {
+        udp_pacer_job_t *const job = incoming;
+        incoming = job->next;
+        job->next = NULL;
+        job->deadline_us = now;
+        job->window_start_us = now;
+        heap_push(t, job);
+        asc_log_info(MSG("buffering..."));
+    }
+
+    if(!removing)
+        return;
+
+    for(udp_pacer_job_t *job = removing; job; job = job->next)
+        heap_remove(t, job);
+
+    pthread_mutex_lock(&t->mu);
+    while(removing)
+    {
+        udp_pacer_job_t *const job = removing;
+        removing = job->next;
+        job->next = NULL;
+        job->removed = true;
+    }
+    pthread_cond_broadcast(&t->cond);
+    pthread_mutex_unlock(&t->mu);
+}
+
+static void *pacer_thread_loop(void *arg)
+{
+    udp_pacer_thread_t *const t = (udp_pacer_thread_t *)arg;
+
+    for(;;)
+    {
+        uint64_t expirations;
+        if(read(t->timer_fd, &expirations, sizeof(expirations)) < 0 && errno != EINTR)
+        {
+            asc_log_error("[udp_pacer %d] timer read failed [%s]", t->index, strerror(errno));
+            asc_usleep(1000);
+        }
+
+        uint64_t now = asc_utime();
+        pacer_take_requests(t, now);
+
+        while(t->heap_count > 0 && t->heap[0]->deadline_us <= now + UDP_PACER_SLACK_US)
+        {
+            udp_pacer_job_t *const job = t->heap[0];
+            job->deadline_us = job_run(t, job, now);
+            heap_down(t, 0);
+            now = asc_utime();
+        }
+
+        // under the lock: a request arrived after pacer_take_requests() is not lost
+        pthread_mutex_lock(&t->mu);
+        if(t->incoming || t->removing)
+            pacer_arm(t, 0);
+        else if(t->heap_count > 0)
+        {
+            const uint64_t deadline = t->heap[0]->deadline_us;
+            pacer_arm(t, (deadline > now) ? deadline - now : 0);
+        }
+        else
+            pacer_disarm(t);
+        pthread_mutex_unlock(&t->mu);
+    }
+
+    return NULL;
+}
+
+static int pacer_threads_auto(void)
+{
+    const long n = sysconf(_SC_NPROCESSORS_ONLN);
+    if(n < 1)
+        return 1;
+    return (n > PACER_THREADS_AUTO_MAX) ? PACER_THREADS_AUTO_MAX : (int)n;
+}
+
+/* under pacer.mu */
+static bool pacer_start(void)
+{
+    int count = (pacer.configured > 0) ? pacer.configured : pacer_threads_auto();
+    if(count > UDP_PACER_THREADS_MAX)
+        count = UDP_PACER_THREADS_MAX;
+
+    pacer.threads = (udp_pacer_thread_t *)calloc((size_t)count, sizeof(udp_pacer_thread_t));
+    if(!pacer.threads)
+        return false;
+
+    for(int i = 0; i < count; ++i)
+    {
+        udp_pacer_thread_t *const t = &pacer.threads[i];
+        t->index = i;
+        pthread_mutex_init(&t->mu, NULL);
+        pthread_cond_init(&t->cond, NULL);
+        t->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+        if(t->timer_fd < 0)
+        {
+            asc_log_error("[udp_pacer] timerfd_create failed [%s]", strerror(errno));
+            break;
+        }
+        if(pthread_create(&t->thread, NULL, pacer_thread_loop, t) != 0)
+        {
+            asc_log_error("[udp_pacer] failed to start thread %d", i);
+            close(t->timer_fd);
+            break;
+        }
+        pacer.count = i + 1;
+    }
+
+    if(pacer.count == 0)
+    {
+        free(pacer.threads);
+        pacer.threads = NULL;
+        return false;
+    }
+
+    asc_log_info("[udp_pacer] %d pacing threads", pacer.count);
+    return true;
+}
+
+/*
+ * API
+ */
+
+void udp_pacer_configure(int threads)
+{
+    pthread_mutex_lock(&pacer.mu);
+    pacer.configured = (threads > 0) ? threads : 0;
+    if(pacer.count > 0 && pacer.configured > 0 && pacer.configured != pacer.count)
+        asc_log_debug("[udp_pacer] %d pacing threads are running, restart to apply %d",
+            pacer.count, pacer.configured);
+    pthread_mutex_unlock(&pacer.mu);
+}
+
+udp_pacer_job_t *udp_pacer_add(const udp_pacer_config_t *config)
+{
+    pthread_mutex_lock(&pacer.mu);
+    if(pacer.count == 0 && !pacer_start())
+    {
+        pthread_mutex_unlock(&pacer.mu);
+        return NULL;
+    }
+
+    udp_pacer_thread_t *t = &pacer.threads[0];
+    for(int i = 1; i < pacer.count; ++i)
+    {
+        if(__atomic_load_n(&pacer.threads[i].jobs, __ATOMIC_RELAXED)
+           < __atomic_load_n(&t->jobs, __ATOMIC_RELAXED))
+        {
+            t = &pacer.threads[i];
+        }
+    }
+    pthread_mutex_unlock(&pacer.mu);
+
+    udp_pacer_job_t *const job = (udp_pacer_job_t *)calloc(1, sizeof(udp_pacer_job_t));
+    if(!job)
+        return NULL;
+
+    job->config = *config;
+    job->name = strdup(config->name ? config->name : "");
+    job->config.name = job->name;
+    job->buffer_packets = config->buffer_size / TS_PACKET_SIZE;
+    if(job->buffer_packets < PACER_TS_PER_DATAGRAM)
+        job->buffer_packets = PACER_TS_PER_DATAGRAM;
+    job->ring_packets = job->buffer_packets * 2;
+    job->ring = (uint8_t *)malloc(job->ring_packets * TS_PACKET_SIZE);
+    if(!job->name || !job->ring)
+    {
+        free(job->ring);
+        free(job->name);
+        free(job);
+        return NULL;
+    }
+    if(config->rtp && config->fec_cols > 0)
+    {
+        job->fec = (rtp_fec_encoder_t *)malloc(sizeof(rtp_fec_encoder_t));
+        if(!job->fec)
+        {
+            free(job->ring);
+            free(job->name);
+            free(job);
+            return NULL;
+        }
+        rtp_fec_encoder_init(job->fec, config->fec_cols, config->fec_rows, config->fec_row);
+        job->fec_dst[RTP_FEC_COLUMN] = config->dst;
+        job->fec_dst[RTP_FEC_COLUMN].sin_port = htons(ntohs(config->dst.sin_port) + RTP_FEC_PORT_COLUMN);
+        job->fec_dst[RTP_FEC_ROW] = config->dst;
+        job->fec_dst[RTP_FEC_ROW].sin_port = htons(ntohs(config->dst.sin_port) + RTP_FEC_PORT_ROW);
+        job->stats.fec_cols = config->fec_cols;
+        job->stats.fec_rows = config->fec_rows;
+    }
+    job->heap_index = -1;
+    job->thread = t;
+    job->stats.thread = t->index;
+
+    pthread_mutex_lock(&t->mu);
+    job->next = t->incoming;
+    t->incoming = job;
+    __atomic_add_fetch(&t->jobs, 1, __ATOMIC_RELAXED);
+    pacer_arm(t, 0);
+    pthread_mutex_unlock(&t->mu);
+
+    return job;
+}
+
+void udp_pacer_remove(udp_pacer_job_t *job)
+{
+    if(!job)
+        return;
+
+    udp_pacer_thread_t *const t = job->thread;
+    pthread_mutex_lock(&t->mu);
+    __atomic_sub_fetch(&t->jobs, 1, __ATOMIC_RELAXED);
+
+    // not taken by the thread yet
+    for(udp_pacer_job_t **it = &t->incoming; *it; it = &(*it)->next)
+    {
+        if(*it == job)
+        {
+            *it = job->next;
+            job->removed = true;
+            break;
+        }
+    }
+
+    if(!job->removed)
+    {
+        job->next = t->removing;
+        t->removing = job;
+        pacer_arm(t, 0);
+    }
+    while(!job->removed)
+        pthread_cond_wait(&t->cond, &t->mu);
+    pthread_mutex_unlock(&t->mu);
+
+    free(job->fec);
+    free(job->ring);
+    free(job->name);
+    free(job);
+}
+
+bool udp_pacer_push(udp_pacer_job_t *job, const uint8_t *ts, size_t count)
+{
+    const uint64_t tail = __atomic_load_n(&job->tail, __ATOMIC_ACQUIRE);
+    const uint64_t head = job->head;
+    if(head - tail + count > job->ring_packets)
+    {
+        // as the thread buffer of udp_output: the pacing thread flushes
+        // everything pushed so far and starts buffering again
+        counter_add(&job->stats.overflows, count);
+        __atomic_store_n(&job->flush_head, head, __ATOMIC_RELAXED);
+        __atomic_store_n(&job->flush_request, 1, __ATOMIC_RELEASE);
+        return false;
+    }
+
+    const uint64_t pos = head % job->ring_packets;
+    size_t first = (size_t)(job->ring_packets - pos);
+    if(first > count)
+        first = count;
+    memcpy(&job->ring[pos * TS_PACKET_SIZE], ts, first * TS_PACKET_SIZE);
+    if(first < count)
+        memcpy(job->ring, &ts[first * TS_PACKET_SIZE], (count - first) * TS_PACKET_SIZE);
+
+    __atomic_store_n(&job->head, head + count, __ATOMIC_RELEASE);
+    return true;
+}
+
+void udp_pacer_stats(udp_pacer_job_t *job, udp_pacer_stats_t *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    stats->thread = job->stats.thread;
+    stats->thread_jobs = __atomic_load_n(&job->thread->jobs, __ATOMIC_RELAXED);
+    stats->datagrams = __atomic_load_n(&job->stats.datagrams, __ATOMIC_RELAXED);
+    stats->null_packets = __atomic_load_n(&job->stats.null_packets, __ATOMIC_RELAXED);
+    stats->rebuffers = __atomic_load_n(&job->stats.rebuffers, __ATOMIC_RELAXED);
+    stats->overflows = __atomic_load_n(&job->stats.overflows, __ATOMIC_RELAXED);
+    stats->send_errors = __atomic_load_n(&job->stats.send_errors, __ATOMIC_RELAXED);
+    stats->late = __atomic_load_n(&job->stats.late, __ATOMIC_RELAXED);
+    stats->deviation_avg_us = __atomic_load_n(&job->stats.deviation_avg_us, __ATOMIC_RELAXED);
+    stats->deviation_max_us = __atomic_load_n(&job->stats.deviation_max_us, __ATOMIC_RELAXED);
+    stats->deviation_peak_us = __atomic_load_n(&job->stats.deviation_peak_us, __ATOMIC_RELAXED);
+    stats->fec_cols = job->stats.fec_cols;
+    stats->fec_rows = job->stats.fec_rows;
+    if(job->fec)
+    {
+        stats->fec_packets[RTP_FEC_COLUMN] = RTP_FEC_GET(job->fec->packets[RTP_FEC_COLUMN]);
+        stats->fec_packets[RTP_FEC_ROW] = RTP_FEC_GET(job->fec->packets[RTP_FEC_ROW]);
+    }
+    stats->fec_send_errors = __atomic_load_n(&job->stats.fec_send_errors, __ATOMIC_RELAXED);
+
+    const uint64_t head = __atomic_load_n(&job->head, __ATOMIC_RELAXED);
+    const uint64_t tail = __atomic_load_n(&job->tail, __ATOMIC_RELAXED);
+    stats->buffer_bytes = (uint32_t)((head - tail) * TS_PACKET_SIZE);
+}
@@ -0,0 +1,90 @@
+/*
+ * Astra Module: UDP: shared pacing threads for udp_output sync/cbr
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _UDP_PACER_H_
+#define _UDP_PACER_H_ 1
+
+#include <astra.h>
+#include <netinet/in.h>
+
+/*
+ * Linux only. A small pool of threads sends the TS of synced outputs at the
+ * pace of their PCR (and the cbr stuffing). Every thread sleeps on one
+ * timerfd armed to the earliest deadline of its jobs (EDF heap), a job wakes
+ * once per datagram and sends the due datagrams with one sendmmsg().
+ * The stream loop of an output is the single producer of its job: TS go
+ * through a lock-free SPSC ring, the pacing thread is the only consumer.
+ * Counters are updated with relaxed atomics and may be read from any thread.
+ */
+
+#define UDP_PACER_THREADS_MAX 16
+#define UDP_PACER_BURST 64 // datagrams of one job per wakeup
+#define UDP_PACER_SLACK_US 50 // deadlines this close are served in one wakeup
+#define UDP_PACER_LATE_US 1000 // a datagram sent later is counted as late
+#define UDP_PACER_WINDOW_US 1000000 // deviation avg/max window
+
+typedef struct udp_pacer_job_t udp_pacer_job_t;
+
+typedef struct
+{
+    const char *name; // "addr:port" for logs
+    int fd;
+    struct sockaddr_in dst;
+    bool rtp;
+    uint32_t rtp_ssrc;
+    uint32_t buffer_size; // bytes buffered before start, multiple of TS_PACKET_SIZE
+    uint32_t cbr; // ts/s, 0 - no stuffing
+    int fec_cols; // SMPTE 2022-1 FEC of the RTP datagrams, 0 - off
+    int fec_rows;
+    bool fec_row; // FEC packets go from fd to the ports dst + 2 and dst + 4
+} udp_pacer_config_t;
+
+typedef struct
+{
+    int thread;
+    int thread_jobs;
+    uint64_t datagrams;
+    uint64_t null_packets; // cbr stuffing
+    uint64_t rebuffers;
+    uint64_t overflows; // TS dropped by udp_pacer_push(), each overflow flushes the ring
+    uint64_t send_errors; // datagrams
+    uint64_t late; // datagrams sent UDP_PACER_LATE_US after the target time
+    uint32_t deviation_avg_us; // |send time - target time|, last window
+    uint32_t deviation_max_us; // last window
+    uint32_t deviation_peak_us; // since start
+    uint32_t buffer_bytes;
+    int fec_cols; // 0 - no FEC
+    int fec_rows;
+    uint64_t fec_packets[2]; // column, row
+    uint64_t fec_send_errors;
+} udp_pacer_stats_t;
+
+/* pool size, applied when the first job starts the pool, 0 - auto */
+void udp_pacer_configure(int threads);
+
+/* the fd stays open until udp_pacer_remove() */
+udp_pacer_job_t *udp_pacer_add(const udp_pacer_config_t *config);
+
+/* waits for the pacing thread to drop the job, frees it */
+void udp_pacer_remove(udp_pacer_job_t *job);
+
+/* producer side, false - the ring is full: TS are dropped, the ring is flushed and rebuffered */
+bool udp_pacer_push(udp_pacer_job_t *job, const uint8_t *ts, size_t count);
+
+void udp_pacer_stats(udp_pacer_job_t *job, udp_pacer_stats_t *stats);
+
+#endif /* _UDP_PACER_H_ */
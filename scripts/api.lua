@@ -3610,6 +3610,18 @@ local function list_metrics(server, client, request)
         end
     end
 
+    local data_loops = nil
+    if type(data_loop) == "table" and type(data_loop.count) == "function" and data_loop.count() > 0 then
+        data_loops = data_loop.stats()
+    end
+
+    -- Учёт таймеров по callback (calls/runtime) — только по запросу ?timers=1.
+    local timer_stats = nil
+    if request and request.query and request.query.timers == "1"
+        and type(utils) == "table" and type(utils.timer_stats) == "function" then
+        timer_stats = utils.timer_stats()
+    end
+
     local mpts_metrics = nil
     for id, entry in pairs(status) do
         if entry and entry.mpts_stats then
@@ -3658,6 +3670,33 @@ local function list_metrics(server, client, request)
             engine = dataplane_engine,
         }
     end
+    if data_loops then
+        payload.data_loops = data_loops
+    end
+    -- Счётчики http_server: активные клиенты и, при http_workers > 0, по каждому worker.
+    if runtime and type(runtime.http_servers) == "table" then
+        local http_stats = {}
+        for name, instance in pairs(runtime.http_servers) do
+            local ok, st = pcall(function()
+                return instance:stats()
+            end)
+            if ok and type(st) == "table" then
+                http_stats[name] = st
+            end
+        end
+        if next(http_stats) then
+            payload.http = http_stats
+        end
+    end
+    if timer_stats then
+        payload.timers = timer_stats
+    end
+    if log and type(log.stats) == "function" then
+        payload.log = log.stats()
+    end
+    if type(utils) == "table" and type(utils.ts_pool_stats) == "function" then
+        payload.ts_pool = utils.ts_pool_stats()
+    end
     if mpts_metrics then
         payload.mpts = mpts_metrics
     end
@@ -3707,8 +3746,38 @@ local function list_metrics(server, client, request)
                     if w.pinned_cpu ~= nil then
                         table.insert(lines, "stream_dataplane_worker_pinned_cpu" .. label .. " " .. tostring(w.pinned_cpu))
                     end
+                    table.insert(lines, "stream_dataplane_worker_busy_seconds_total" .. label .. " " .. string.format("%.3f", (w.busy_us or 0) / 1000000))
+                    table.insert(lines, "stream_dataplane_worker_datagrams_total" .. label .. " " .. string.format("%.0f", w.datagrams or 0))
                 end
             end
+            local balancer = dataplane_engine.balancer
+            if type(balancer) == "table" then
+                table.insert(lines, "stream_dataplane_rebalance_runs_total " .. string.format("%.0f", balancer.runs or 0))
+                table.insert(lines, "stream_dataplane_rebalance_migrations_total " .. string.format("%.0f", balancer.migrations or 0))
+                table.insert(lines, "stream_dataplane_rebalance_failures_total " .. string.format("%.0f", balancer.failures or 0))
+            end
+        end
+        if payload.log then
+            table.insert(lines, "stream_log_lines_total " .. string.format("%.0f", payload.log.lines or 0))
+            table.insert(lines, "stream_log_dropped_total " .. string.format("%.0f", payload.log.dropped or 0))
+            table.insert(lines, "stream_log_suppressed_total " .. string.format("%.0f", payload.log.suppressed or 0))
+        end
+        if payload.ts_pool then
+            local pool = payload.ts_pool
+            table.insert(lines, "stream_ts_pool_chunks " .. string.format("%.0f", pool.chunks or 0))
+            table.insert(lines, "stream_ts_pool_in_use " .. string.format("%.0f", pool.in_use or 0))
+            table.insert(lines, "stream_ts_pool_high_water " .. string.format("%.0f", pool.high_water or 0))
+            table.insert(lines, "stream_ts_pool_bytes " .. string.format("%.0f", pool.bytes or 0))
+            table.insert(lines, "stream_ts_pool_allocs_total " .. string.format("%.0f", pool.allocs or 0))
+            table.insert(lines, "stream_ts_pool_refs_total " .. string.format("%.0f", pool.refs or 0))
+            table.insert(lines, "stream_ts_pool_copies_total " .. string.format("%.0f", pool.copies or 0))
+        end
+        if timer_stats then
+            for _, t in ipairs(timer_stats) do
+                local label = string.format("{callback=\"%s\"}", tostring(t.name):gsub("\"", "\\\""))
+                table.insert(lines, "stream_timer_calls_total" .. label .. " " .. string.format("%.0f", t.calls or 0))
+                table.insert(lines, "stream_timer_runtime_us_total" .. label .. " " .. string.format("%.0f", t.runtime_us or 0))
+            end
         end
         if mpts_metrics then
             for stream_id, stats in pairs(mpts_metrics) do
@@ -3739,6 +3808,40 @@ local function list_metrics(server, client, request)
     json_response(server, client, 200, payload)
 end
 
+-- Профайлер модулей: CPU по потокам и экземплярам модулей с момента включения.
+function api._get_profiler(server, client, request)
+    if not runtime or not runtime.profiler_snapshot then
+        return error_response(server, client, 501, "profiler is unavailable")
+    end
+    local query = request and request.query or {}
+    local limit = tonumber(query.limit) or 50
+    local snapshot = runtime.profiler_snapshot(limit)
+    if not snapshot then
+        return error_response(server, client, 501, "profiler is unavailable")
+    end
+    json_response(server, client, 200, snapshot)
+end
+
+-- Включение без записи в настройки (до рестарта): { enabled = true, sample = 8 }.
+function api._set_profiler(server, client, request)
+    if not require_admin(request) then
+        return error_response(server, client, 403, "forbidden")
+    end
+    if type(profiler) ~= "table" or type(profiler.set) ~= "function" then
+        return error_response(server, client, 501, "profiler is unavailable")
+    end
+    local body = parse_json_body(request)
+    if type(body) ~= "table" then
+        return error_response(server, client, 400, "invalid json")
+    end
+    local sample = tonumber(body.sample)
+    if sample ~= nil and (sample < 1 or sample > 1024) then
+        return error_response(server, client, 400, "sample must be 1..1024")
+    end
+    profiler.set({ enabled = body.enabled, sample = sample })
+    json_response(server, client, 200, profiler.get())
+end
+
 local function health_summary(server, client)
     local counts = nil
     if config and config.count_streams then
@@ -4330,6 +4433,13 @@ local function apply_log_settings_patch(body)
             log.set(opts)
         end
     end
+
+    if body.runtime_log_rate_limit ~= nil then
+        local rate_limit = tonumber(config.get_setting("runtime_log_rate_limit"))
+        if rate_limit ~= nil then
+            log.set({ rate_limit = math.max(0, math.floor(rate_limit)) })
+        end
+    end
 end
 
 local function set_settings(server, client, request)
@@ -4391,10 +4501,19 @@ local function set_settings(server, client, request)
             if runtime and runtime.configure_gc
                 and (body.lua_gc_full_collect_interval_ms ~= nil
                     or body.lua_gc_step_interval_ms ~= nil
-                    or body.lua_gc_step_units ~= nil)
+                    or body.lua_gc_step_units ~= nil
+                    or body.performance_main_loop_blocking ~= nil)
             then
                 runtime.configure_gc()
             end
+            if body.performance_data_loops ~= nil and runtime and runtime.configure_data_loops then
+                runtime.configure_data_loops()
+            end
+            if (body.performance_profiler ~= nil or body.performance_profiler_sample ~= nil)
+                and runtime and runtime.configure_profiler
+            then
+                runtime.configure_profiler()
+            end
             if body.performance_aggregate_stream_timers ~= nil
                 and type(stream_reconfigure_timer_mode) == "function"
             then
@@ -6925,6 +7044,12 @@ function api.handle_request(server, client, request)
     if path == "/api/v1/metrics" and method == "GET" then
         return list_metrics(server, client, request)
     end
+    if path == "/api/v1/profiler" and method == "GET" then
+        return api._get_profiler(server, client, request)
+    end
+    if path == "/api/v1/profiler" and method == "POST" then
+        return api._set_profiler(server, client, request)
+    end
     if path == "/api/v1/audit" and method == "GET" then
         return list_audit_events(server, client, request)
     end
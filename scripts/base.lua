@@ -234,9 +234,22 @@ local function resolve_udp_input_localaddr(conf, log_warning)
     return localaddr
 end
 
+-- SMPTE 2022-7: вход с merge legs не делится с обычным входом того же адреса.
+local function udp_input_merge_key(conf)
+    if type(conf.merge) ~= "table" then
+        return ""
+    end
+    local key = ""
+    for _, leg in ipairs(conf.merge) do
+        key = key .. "+" .. tostring(leg.addr) .. ":" .. tostring(leg.port)
+    end
+    return key
+end
+
 local function udp_input_instance_id(conf)
     local localaddr = resolve_udp_input_localaddr(conf, false)
     return tostring(localaddr) .. "@" .. tostring(conf.addr) .. ":" .. tostring(conf.port)
+        .. udp_input_merge_key(conf)
 end
 
 local function tool_exists(path)
@@ -2235,10 +2248,29 @@ end
 -- o888o           888oo88   o888ooo88  o888o
 
 udp_input_instance_list = {}
+udp_input_loop_next = 0
+
+-- UDP вход (и channel/udp_output за ним) закрепляется за data loop по кругу.
+-- conf.loop задаёт loop явно, 0 - control loop.
+local function udp_input_pick_loop(conf)
+    if conf.loop ~= nil then
+        return tonumber(conf.loop)
+    end
+    if type(data_loop) ~= "table" or type(data_loop.count) ~= "function" then
+        return nil
+    end
+    local count = data_loop.count()
+    if count <= 0 then
+        return nil
+    end
+    udp_input_loop_next = (udp_input_loop_next % count) + 1
+    return udp_input_loop_next
+end
 
 init_input_module.udp = function(conf)
     local localaddr = resolve_udp_input_localaddr(conf, true)
     local instance_id = tostring(localaddr) .. "@" .. conf.addr .. ":" .. conf.port
+        .. udp_input_merge_key(conf)
     local instance = udp_input_instance_list[instance_id]
 
     if not instance then
@@ -2255,14 +2287,42 @@ init_input_module.udp = function(conf)
             rx_batch = read_setting("performance_udp_rx_batch")
         end
 
+        -- UDP_GRO: серии датаграмм одним буфером (#gro=1 у input важнее настройки)
+        local gro = conf.gro
+        if gro == nil then
+            gro = (read_setting("performance_udp_gro") == true)
+        end
+
+        -- RFC 4445 MDI по времени приёма из ядра (#mdi=1 у input важнее настройки)
+        local mdi = conf.mdi
+        if mdi == nil then
+            mdi = (read_setting("performance_udp_mdi") == true)
+        end
+
+        -- SMPTE 2022-1: #fec у rtp input - восстановление по FEC с портов +2/+4,
+        -- матрица берётся из FEC заголовков (#fec=LxD тоже включает)
+        local fec = conf.fec
+        if fec ~= nil and fec ~= false then
+            local text = tostring(fec):lower()
+            fec = not (text == "0" or text == "false" or text == "off")
+        end
+
         instance.input = udp_input({
+            -- name: для профайлера, общий вход числится за первым потоком
+            name = conf.name,
             addr = conf.addr, port = conf.port, localaddr = localaddr,
             socket_size = conf.socket_size,
             renew = conf.renew,
             rtp = conf.rtp,
+            merge = conf.merge,
+            merge_window = conf.merge_window,
             read_burst = conf.read_burst,
             use_recvmmsg = use_recvmmsg,
             rx_batch = rx_batch,
+            gro = gro,
+            mdi = mdi,
+            fec = (fec == true),
+            loop = udp_input_pick_loop(conf),
         })
     end
 
@@ -2285,6 +2345,18 @@ kill_input_module.udp = function(module, conf)
     end
 end
 
+-- Общий UDP вход потока: ключ сокета и число потоков на нём (nil - вход не открыт).
+function udp_input_instance_info(conf)
+    local instance_id = udp_input_instance_id(conf)
+    local instance = udp_input_instance_list[instance_id]
+    if not instance then
+        return nil
+    end
+    -- ключ как у udp_relay ingest: localaddr@addr:port
+    local key = instance_id:gsub("^nil@", "@")
+    return { key = key, subscribers = instance.clients, shared = instance.clients > 1 }
+end
+
 init_input_module.rtp = function(conf)
     conf.rtp = true
     return init_input_module.udp(conf)
@@ -4776,7 +4848,8 @@ local function wrap_logger(level)
             message = join_log_message(first, ...)
         end
         log_store_add(level, message)
-        return original(message)
+        -- 2: rate limit по месту вызова, а не по этой обёртке
+        return original(message, 2)
     end
 end
 
@@ -118,6 +118,7 @@ function buffer.refresh(opts)
     local source_bind = setting_string("buffer_source_bind_interface", "")
     local max_clients = setting_number("buffer_max_clients_total", 2000)
     local client_timeout = setting_number("buffer_client_read_timeout_sec", 20)
+    local sender_threads = setting_number("buffer_sender_threads", 0)
     local main_port = opts.main_port
     if main_port == nil then
         main_port = setting_number("http_port", -1)
@@ -148,6 +149,7 @@ function buffer.refresh(opts)
         source_bind_interface = source_bind,
         max_clients_total = max_clients,
         client_read_timeout_sec = client_timeout,
+        sender_threads = sender_threads,
     }
 
     local resources = build_resources()
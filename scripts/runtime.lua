@@ -399,6 +399,132 @@ local function collect_metrics_snapshot()
     }
 end
 
+-- Профайлер модулей (profiler.*): CPU по экземплярам модулей, сводка по потокам.
+-- Модули потока называются "<stream> #1", "<stream> output #2", "<stream> svc #1",
+-- модули без имени наследуют имя upstream.
+local function profiler_stream_name(name)
+    if not name or name == "" then
+        return ""
+    end
+    return name:match("^(.-) output #%d+$")
+        or name:match("^(.-) svc #%d+$")
+        or name:match("^(.-) #%d+$")
+        or name
+end
+
+function runtime.profiler_snapshot(limit)
+    if type(profiler) ~= "table" or type(profiler.stats) ~= "function" then
+        return nil
+    end
+    local info = profiler.get()
+    local snapshot = {
+        enabled = info.enabled,
+        sample = info.sample,
+        elapsed_us = info.elapsed_us,
+        streams = {},
+    }
+    if not info.enabled then
+        return snapshot
+    end
+
+    local elapsed_ns = (info.elapsed_us or 0) * 1000
+    local function cpu_pct(cpu_ns)
+        if elapsed_ns <= 0 then
+            return 0
+        end
+        return math.floor(cpu_ns * 10000 / elapsed_ns + 0.5) / 100
+    end
+
+    local by_name = {}
+    for _, item in ipairs(profiler.stats()) do
+        local key = profiler_stream_name(item.name)
+        local entry = by_name[key]
+        if not entry then
+            entry = { name = key, cpu_ns = 0, calls = 0, packets = 0, max_ns = 0, modules = {} }
+            by_name[key] = entry
+            table.insert(snapshot.streams, entry)
+        end
+        entry.cpu_ns = entry.cpu_ns + item.cpu_ns
+        entry.calls = entry.calls + item.calls
+        entry.packets = entry.packets + item.packets
+        if item.max_ns > entry.max_ns then
+            entry.max_ns = item.max_ns
+        end
+        item.cpu_pct = cpu_pct(item.cpu_ns)
+        table.insert(entry.modules, item)
+    end
+
+    table.sort(snapshot.streams, function(a, b) return a.cpu_ns > b.cpu_ns end)
+    local total_ns = 0
+    for _, entry in ipairs(snapshot.streams) do
+        total_ns = total_ns + entry.cpu_ns
+        entry.cpu_pct = cpu_pct(entry.cpu_ns)
+        table.sort(entry.modules, function(a, b) return a.cpu_ns > b.cpu_ns end)
+    end
+    snapshot.cpu_ns = total_ns
+    snapshot.cpu_pct = cpu_pct(total_ns)
+
+    limit = tonumber(limit)
+    if limit and limit > 0 then
+        while #snapshot.streams > limit do
+            table.remove(snapshot.streams)
+        end
+    end
+    return snapshot
+end
+
+function runtime.configure_profiler()
+    if type(profiler) ~= "table" or type(profiler.set) ~= "function" then
+        return
+    end
+    -- Выключен по умолчанию; включение сбрасывает счётчики.
+    profiler.set({
+        enabled = setting_bool("performance_profiler", false),
+        sample = math.floor(clamp_number(setting_number("performance_profiler_sample", 8), 1, 1024)),
+    })
+end
+
+-- Строки "<measurement>_profile,stream=..." для Influx: CPU за интервал экспорта.
+local function influx_profile_lines(cfg, timestamp)
+    local influx = runtime.influx
+    local snapshot = runtime.profiler_snapshot()
+    if not snapshot or not snapshot.enabled then
+        influx.profile_prev = nil
+        return {}
+    end
+
+    local prev = influx.profile_prev
+    if prev and prev.elapsed_us > snapshot.elapsed_us then
+        -- профайлер перезапущен
+        prev = nil
+    end
+    local interval_ns = (snapshot.elapsed_us - (prev and prev.elapsed_us or 0)) * 1000
+    local current = { elapsed_us = snapshot.elapsed_us, cpu_ns = {} }
+
+    local lines = {}
+    for _, entry in ipairs(snapshot.streams) do
+        current.cpu_ns[entry.name] = entry.cpu_ns
+        local delta = entry.cpu_ns - ((prev and prev.cpu_ns[entry.name]) or 0)
+        if delta > 0 and interval_ns > 0 then
+            local tags = { stream = (entry.name ~= "") and entry.name or "-" }
+            if cfg.instance ~= "" then
+                tags.instance = cfg.instance
+            end
+            local line = influx_build_line(cfg.measurement .. "_profile", tags, {
+                cpu_ns = math.floor(delta),
+                cpu_pct = math.floor(delta * 10000 / interval_ns + 0.5) / 100,
+                packets = math.floor(entry.packets),
+                max_ns = math.floor(entry.max_ns),
+            }, timestamp)
+            if line then
+                table.insert(lines, line)
+            end
+        end
+    end
+    influx.profile_prev = current
+    return lines
+end
+
 local function influx_send_snapshot()
     local influx = runtime.influx or {}
     local cfg = influx.config
@@ -413,10 +539,15 @@ local function influx_send_snapshot()
     if cfg.instance ~= "" then
         tags.instance = cfg.instance
     end
-    local line = influx_build_line(cfg.measurement, tags, fields, os.time())
+    local timestamp = os.time()
+    local line = influx_build_line(cfg.measurement, tags, fields, timestamp)
     if not line then
         return
     end
+    local profile_lines = influx_profile_lines(cfg, timestamp)
+    if #profile_lines > 0 then
+        line = line .. "\n" .. table.concat(profile_lines, "\n")
+    end
     local headers = {
         "User-Agent: Stream",
         "Host: " .. cfg.host .. ":" .. cfg.port,
@@ -540,6 +671,24 @@ function runtime.configure_gc()
     rawset(_G, "__astra_gc_full_collect_interval_ms", full_collect_ms)
     rawset(_G, "__astra_gc_step_interval_ms", step_interval_ms)
     rawset(_G, "__astra_gc_step_units", step_units)
+    -- Блокирующий main loop: epoll_wait до ближайшего таймера вместо опроса раз в 1 мс.
+    rawset(_G, "__astra_main_loop_blocking", setting_bool("performance_main_loop_blocking", false) and 1 or 0)
+end
+
+function runtime.configure_data_loops()
+    if type(data_loop) ~= "table" or type(data_loop.start) ~= "function" then
+        return
+    end
+    -- Data loops: udp_input и следующие за ним channel/udp_output работают в отдельных потоках.
+    -- Количество фиксируется при первом запуске, изменение требует рестарта.
+    local count = math.floor(clamp_number(setting_number("performance_data_loops", 0), 0, 64))
+    if count <= 0 then
+        if data_loop.count() > 0 then
+            log.warning("[runtime] data loops are running, restart required to disable them")
+        end
+        return
+    end
+    data_loop.start(count)
 end
 
 local function clock_ms()
@@ -767,6 +916,16 @@ local function collect_input_stats(channel)
             end
         end
 
+        -- legacy udp_input: один сокет на группу, потоки - подписчики
+        if input_data and input_data.input and input_data.config
+            and type(udp_input_instance_info) == "function"
+        then
+            local fmt = tostring(input_data.config.format or ""):lower()
+            if fmt == "udp" or fmt == "rtp" then
+                entry.ingest = udp_input_instance_info(input_data.config)
+            end
+        end
+
         if input_data and input_data.stats and input_data.stats.bitrate then
             entry.bitrate_kbps = tonumber(input_data.stats.bitrate)
         else
@@ -895,6 +1054,20 @@ local function collect_output_status(channel)
                 entry.hls_active = stats.active
             end
         end
+        if (conf.format == "udp" or conf.format == "rtp") and output_data and output_data.output
+            and output_data.output.stats then
+            local ok, stats = pcall(function()
+                return output_data.output:stats()
+            end)
+            -- sync/cbr: точность пейсинга (отклонение от целевого времени отправки)
+            if ok and type(stats) == "table" and stats.datagrams ~= nil then
+                entry.pacing = stats
+            end
+            -- SMPTE 2022-1 (#fec=LxD): отправленные FEC пакеты колонок и строк
+            if ok and type(stats) == "table" and type(stats.fec) == "table" then
+                entry.fec = stats.fec
+            end
+        end
         -- Audio Fix теперь stream-level (channel.audio_fix) и влияет на все outputs.
         local audio_fix = channel and channel.audio_fix or nil
         if audio_fix then
@@ -1029,7 +1202,7 @@ local PASSTHROUGH_DP_RX_BATCH_MAX = 64
 
 -- Watchdog для auto-mode:
 -- если dataplane видит входящие датаграммы, но не выдаёт bytes_out (и растёт bad_datagrams),
--- считаем поток несовместимым (например, RTP/не кратно 188) и откатываемся в legacy.
+-- считаем поток несовместимым (например, не кратно 188 или RTP без rtp://) и откатываемся в legacy.
 local PASSTHROUGH_DP_WATCHDOG_INTERVAL_SEC = 5
 local PASSTHROUGH_DP_WATCHDOG_GRACE_SEC = 3
 local PASSTHROUGH_DP_WATCHDOG_COOLDOWN_SEC = 300
@@ -1073,9 +1246,12 @@ local function parse_udp_url_entry(entry)
     if type(parsed) ~= "table" then
         return nil
     end
-    if tostring(parsed.format or ""):lower() ~= "udp" then
+    local format = tostring(parsed.format or ""):lower()
+    if format ~= "udp" and format ~= "rtp" then
         return nil
     end
+    -- RTP заголовок снимается/добавляется в dataplane воркерах.
+    parsed.rtp = (format == "rtp") or parsed.rtp == true or parsed.rtp == 1
     return parsed
 end
 
@@ -1118,9 +1294,6 @@ local DP_DISALLOWED_INPUT_KEYS = {
     "shift",
     "biss",
 
-    -- RTP encapsulation (dataplane ожидает RAW TS, без RTP header).
-    "rtp",
-
     -- Quality detectors / анализаторы (CPU в Lua, не поддержано в dataplane).
     "cc_limit",
     "no_audio_on",
@@ -1143,13 +1316,15 @@ local DP_DISALLOWED_INPUT_KEYS = {
     "silence_duration",
     "silence_interval",
     "silence_noise",
+
+    -- SMPTE 2022-1 FEC восстанавливает только legacy udp_input.
+    "fec",
 }
 
 local DP_DISALLOWED_OUTPUT_KEYS = {
     -- Пейсинг/CBR/иные режимы udp_output сейчас не реализованы в dataplane.
     "sync",
     "cbr",
-    "rtp",
 }
 
 local function dp_normalize_backup_type(value, has_multiple)
@@ -1172,6 +1347,9 @@ local function dp_normalize_backup_type(value, has_multiple)
     if value == "active_stop_if_all_inactive" or value == "active_stop" or value == "active_stop_if_all" then
         return "active_stop_if_all_inactive"
     end
+    if value == "merge" or value == "2022-7" or value == "seamless" then
+        return has_multiple and "merge" or "disabled"
+    end
     if value == "disabled" or value == "none" or value == "off" then
         return "disabled"
     end
@@ -1181,6 +1359,53 @@ local function dp_normalize_backup_type(value, has_multiple)
     return "disabled"
 end
 
+local function dp_normalize_ingest(value, fallback)
+    if value == nil or value == "" then
+        return fallback
+    end
+    local text = tostring(value):lower()
+    if text == "packet" or text == "socket" then
+        return text
+    end
+    return fallback
+end
+
+-- #gso / #gro у udp URL: "1", "true", "on" или ключ без значения
+local function dp_normalize_flag(value, fallback)
+    if value == nil or value == "" then
+        return fallback
+    end
+    if value == true or value == 1 then
+        return true
+    end
+    local text = tostring(value):lower()
+    return text == "1" or text == "true" or text == "on"
+end
+
+-- "LxD" матрица SMPTE 2022-1: 1 <= L <= 20, 4 <= D <= 20, L * D <= 100
+local function dp_parse_fec(value)
+    local cols, rows = tostring(value):lower():match("^(%d+)x(%d+)$")
+    cols, rows = tonumber(cols), tonumber(rows)
+    if not cols or cols < 1 or cols > 20 or rows < 4 or rows > 20 or cols * rows > 100 then
+        return nil
+    end
+    return cols, rows
+end
+
+local function dp_normalize_pace(value, fallback)
+    if value == nil or value == "" then
+        return fallback
+    end
+    local text = tostring(value):lower()
+    if text == "pcr" then
+        return "pcr"
+    end
+    if text == "bitrate" or text == "1" or text == "true" or text == "on" then
+        return "bitrate"
+    end
+    return nil
+end
+
 local function dp_read_number_opt(obj, key1, key2)
     if type(obj) ~= "table" then
         return nil
@@ -1198,7 +1423,7 @@ local function dp_backup_conf_from_stream_cfg(cfg, inputs_count)
         return nil
     end
     local backup_type = dp_normalize_backup_type(cfg and cfg.backup_type, inputs_count > 1)
-    if backup_type == "disabled" then
+    if backup_type == "disabled" or backup_type == "merge" then
         return nil
     end
 
@@ -1315,12 +1540,23 @@ local function build_udp_relay_opts_if_eligible(stream_id, cfg, cfg_hash)
     if backup and tostring(backup.type or ""):lower() == "active_stop_if_all_inactive" then
         return nil, "backup stop_if_all_inactive not supported"
     end
+    -- SMPTE 2022-7: все входы принимаются воркером одновременно (relay merge legs).
+    local merge = dp_normalize_backup_type(cfg.backup_type, #inputs > 1) == "merge"
 
     -- Без backup: только один input.
-    if not backup and #inputs ~= 1 then
+    if not backup and not merge and #inputs ~= 1 then
         return nil, "single udp input required"
     end
 
+    -- Приём через AF_PACKET (TPACKET_V3 ring) вместо сокета на вход. #ingest=packet&ifname= у input важнее настройки.
+    local ingest_default = dp_normalize_ingest(setting_string("performance_passthrough_ingest", "socket"), "socket")
+    local ingest_ifname = setting_string("performance_passthrough_ingest_ifname", "")
+    local ingest_ring_mb = setting_number("performance_passthrough_ingest_ring_mb", 16)
+    -- UDP_GRO на сокете входа (как у legacy udp_input), #gro= у input важнее настройки.
+    local gro_default = setting_bool("performance_udp_gro", false)
+    -- MDI (DF:MLR) основного входа по времени приёма из ядра, #mdi= у input важнее настройки.
+    local mdi_default = setting_bool("performance_udp_mdi", false)
+
     local input_list = {}
     for _, entry in ipairs(inputs) do
         local input_parsed = parse_udp_url_entry(entry)
@@ -1336,6 +1572,12 @@ local function build_udp_relay_opts_if_eligible(stream_id, cfg, cfg_hash)
             localaddr = input_parsed.localaddr,
             socket_size = tonumber(input_parsed.socket_size) or 0,
             source_url = tostring(input_parsed.source_url or ""),
+            rtp = input_parsed.rtp == true,
+            ingest = dp_normalize_ingest(input_parsed.ingest, ingest_default),
+            ifname = input_parsed.ifname or (ingest_ifname ~= "" and ingest_ifname or nil),
+            ring_mb = tonumber(input_parsed.ring_mb) or ingest_ring_mb,
+            gro = dp_normalize_flag(input_parsed.gro, gro_default),
+            mdi = dp_normalize_flag(input_parsed.mdi, mdi_default),
         })
     end
 
@@ -1344,11 +1586,38 @@ local function build_udp_relay_opts_if_eligible(stream_id, cfg, cfg_hash)
         return nil, "udp input required"
     end
 
+    local merge_legs = nil
+    if merge then
+        merge_legs = {}
+        for i, item in ipairs(input_list) do
+            if item.rtp ~= true then
+                return nil, "backup merge requires rtp inputs"
+            end
+            if i > 1 then
+                table.insert(merge_legs, {
+                    addr = item.addr,
+                    port = item.port,
+                    localaddr = item.localaddr,
+                    socket_size = item.socket_size,
+                    ingest = item.ingest,
+                    ifname = item.ifname,
+                    ring_mb = item.ring_mb,
+                    gro = item.gro,
+                })
+            end
+        end
+    end
+
     local outputs = normalize_io_list(cfg.output)
     if type(outputs) ~= "table" or #outputs == 0 then
         return nil, "at least one udp output required"
     end
 
+    -- Пейсинг выходов в воркере: "bitrate" (скорость входа) или "pcr". #pace= у output важнее настройки.
+    local pacing_default = dp_normalize_pace(setting_string("performance_passthrough_pacing", "off"))
+    -- UDP_SEGMENT: batch одним sendmmsg с GSO (как у legacy udp_output), #gso= у output важнее настройки.
+    local gso_default = setting_bool("performance_udp_gso", false)
+
     local out_list = {}
     for _, entry in ipairs(outputs) do
         local out_parsed = parse_udp_url_entry(entry)
@@ -1358,6 +1627,14 @@ local function build_udp_relay_opts_if_eligible(stream_id, cfg, cfg_hash)
         if has_any_key(out_parsed, DP_DISALLOWED_OUTPUT_KEYS) then
             return nil, "output options require legacy pipeline"
         end
+        -- SMPTE 2022-1 FEC (#fec=LxD) у rtp output считает воркер; иначе udp_output сообщит об ошибке
+        local fec_cols, fec_rows = nil, nil
+        if out_parsed.fec ~= nil then
+            fec_cols, fec_rows = dp_parse_fec(out_parsed.fec)
+            if not fec_cols or out_parsed.rtp ~= true then
+                return nil, "output fec requires legacy pipeline"
+            end
+        end
         -- pkt_size: dataplane всегда выдаёт 1316 (7 TS). Если задано другое - не трогаем, уходим в legacy.
         local pkt = out_parsed.pkt_size or out_parsed.pkt
         if pkt ~= nil then
@@ -1373,6 +1650,14 @@ local function build_udp_relay_opts_if_eligible(stream_id, cfg, cfg_hash)
             localaddr = out_parsed.localaddr,
             ttl = tonumber(out_parsed.ttl) or 32,
             socket_size = tonumber(out_parsed.socket_size) or 0,
+            rtp = out_parsed.rtp == true,
+            pace = dp_normalize_pace(out_parsed.pace, pacing_default),
+            pace_queue = tonumber(out_parsed.pace_queue),
+            pace_burst = tonumber(out_parsed.pace_burst),
+            gso = dp_normalize_flag(out_parsed.gso, gso_default),
+            fec_cols = fec_cols,
+            fec_rows = fec_rows,
+            fec_row = dp_normalize_flag(out_parsed.fec_row, true),
         })
     end
 
@@ -1389,19 +1674,40 @@ local function build_udp_relay_opts_if_eligible(stream_id, cfg, cfg_hash)
         worker_policy = "hash"
     end
 
+    -- TS метрики (CC/PCR/bitrate по PID) в воркере, stats.ts.
+    local ts_meter = setting_bool("performance_passthrough_ts_meter", true)
+
+    -- Балансировка воркеров по busy%: настройки движка, применяются при старте стрима.
+    local rebalance_interval = 0
+    if setting_bool("performance_passthrough_rebalance", false) then
+        rebalance_interval = clamp_number(setting_number("performance_passthrough_rebalance_interval_sec", 5), 1, 3600)
+    end
+
     local opts = {
         id = tostring(stream_id),
         workers = workers,
         rx_batch = rx_batch,
         affinity = affinity and true or false,
         worker_policy = worker_policy,
+        ts_meter = ts_meter and true or false,
+        rebalance_interval_ms = math.floor(rebalance_interval * 1000),
+        rebalance_threshold = clamp_number(setting_number("performance_passthrough_rebalance_threshold_pct", 20), 1, 100),
+        rebalance_max_moves = clamp_number(setting_number("performance_passthrough_rebalance_max_moves", 2), 1, 64),
         input = {
             addr = active_input.addr,
             port = tonumber(active_input.port),
             localaddr = active_input.localaddr,
             socket_size = tonumber(active_input.socket_size) or 0,
             source_url = tostring(active_input.source_url or ""),
+            rtp = active_input.rtp == true,
+            ingest = active_input.ingest,
+            ifname = active_input.ifname,
+            ring_mb = active_input.ring_mb,
+            gro = active_input.gro,
+            mdi = active_input.mdi,
         },
+        merge = merge_legs,
+        merge_window = merge_legs and tonumber(cfg.merge_window) or nil,
         outputs = out_list,
     }
 
@@ -1734,6 +2040,7 @@ local function dataplane_backup_tick_stream(id, entry)
                     affinity = affinity and true or false,
                     worker_policy = worker_policy,
                     probe_only = true,
+                    ts_meter = false,
                     input = target_input,
                 }
                 local ok3, res3, err3 = pcall(function()
@@ -2425,6 +2732,8 @@ local function build_stream_status_entry(id, stream, clients_count, lite)
             clients = clients_count,
             updated_at = os.time(),
             dataplane = st,
+            -- SMPTE 2022-7 (backup_type merge): счётчики legs
+            merge = st.merge,
         }
 
         entry.active_input_id = 1
@@ -2492,6 +2801,35 @@ local function build_stream_status_entry(id, stream, clients_count, lite)
     if not lite then
         entry.outputs_status = collect_output_status(channel)
         attach_hls_totals(entry)
+        -- SMPTE 2022-7 (backup_type merge): legs принимает первый udp_input.
+        local first = channel and type(channel.input) == "table" and channel.input[1] or nil
+        local udp_in = first and first.input and first.input.input or nil
+        if udp_in and first.config and type(first.config.merge) == "table" then
+            local ok, merge = pcall(function()
+                return udp_in:merge_stats()
+            end)
+            if ok and type(merge) == "table" then
+                entry.merge = merge
+            end
+        end
+        -- RFC 4445 MDI первого udp_input (#mdi=1 или performance_udp_mdi)
+        if udp_in and first.config and (first.config.format == "udp" or first.config.format == "rtp") then
+            local ok, mdi = pcall(function()
+                return udp_in:mdi_stats()
+            end)
+            if ok and type(mdi) == "table" then
+                entry.mdi = mdi
+            end
+        end
+        -- SMPTE 2022-1 первого rtp udp_input (#fec): восстановленные и потерянные пакеты
+        if udp_in and first.config and first.config.format == "rtp" and first.config.fec ~= nil then
+            local ok, fec = pcall(function()
+                return udp_in:fec_stats()
+            end)
+            if ok and type(fec) == "table" then
+                entry.fec = fec
+            end
+        end
         if channel and channel.is_mpts and channel.mpts_mux and channel.mpts_mux.stats then
             local ok, mpts_stats = pcall(function()
                 return channel.mpts_mux:stats()
@@ -1124,6 +1124,12 @@ local function apply_log_settings()
             log.set(opts)
         end
     end
+
+    -- Lines per second for each log call site in C modules (0 = unlimited).
+    local rate_limit_raw = config.get_setting("runtime_log_rate_limit")
+    if rate_limit_raw ~= nil and tonumber(rate_limit_raw) ~= nil then
+        log.set({ rate_limit = math.max(0, math.floor(tonumber(rate_limit_raw))) })
+    end
 end
 
 local function escape_m3u_value(value)
@@ -1581,6 +1587,12 @@ WantedBy=multi-user.target
     if runtime and runtime.configure_gc then
         runtime.configure_gc()
     end
+    if runtime and runtime.configure_data_loops then
+        runtime.configure_data_loops()
+    end
+    if runtime and runtime.configure_profiler then
+        runtime.configure_profiler()
+    end
     if telegram and telegram.configure then
         telegram.configure()
     end
@@ -1969,6 +1981,15 @@ WantedBy=multi-user.target
     -- downstream HTTP clients (ffmpeg/http input) to time out.
     local http_play_buffer_fill_kb = setting_number("http_play_buffer_fill_kb", 32)
     local http_play_buffer_cap_kb = setting_number("http_play_buffer_cap_kb", 512)
+    -- Отставший /play клиент общего кольца http_upstream: "skip" - к последнему ключевому кадру,
+    -- "disconnect" - закрыть соединение.
+    local http_play_lag_policy = setting_string("http_play_lag_policy", "skip")
+    if http_play_lag_policy ~= "disconnect" then
+        http_play_lag_policy = "skip"
+    end
+    -- /play dataplane-потоков отдаёт воркер udp_relay (кольцо датаграмм, writev), без shadow channel.
+    -- Включается явно, по умолчанию /play идёт через shadow channel.
+    local http_play_dataplane = setting_bool("http_play_dataplane", false)
     -- Buffer defaults for internal /input loopback (ffmpeg/transcode).
     -- Keep it small to reduce bursty delivery and avoid timeouts in HTTP consumers.
     local transcode_loopback_buf_kb = setting_number("transcode_loopback_buf_kb", 512)
@@ -1985,6 +2006,8 @@ WantedBy=multi-user.target
     local http_max_clients = math.max(0, math.floor(setting_number("http_max_clients", 0) or 0))
     local http_max_clients_per_ip = math.max(0, math.floor(setting_number("http_max_clients_per_ip", 0) or 0))
     local http_accept_backoff_ms = math.max(10, math.min(5000, math.floor(setting_number("http_accept_backoff_ms", 100) or 100)))
+    -- Приём соединений на data loop (SO_REUSEPORT), 0 = основной цикл.
+    local http_workers = math.max(0, math.floor(setting_number("http_workers", 0) or 0))
 
     if buffer and buffer.refresh then
         buffer.refresh({
@@ -2390,6 +2413,7 @@ WantedBy=multi-user.target
                                 upstream = self:stream(),
                                 buffer_size = buffer_size,
                                 buffer_fill = buffer_fill,
+                                lag_policy = http_play_lag_policy,
                             }, "video/MP2T")
                         end,
                     })
@@ -2434,6 +2458,13 @@ WantedBy=multi-user.target
             return nil
         end
         local channel = entry.channel
+        local play_relay = nil
+        if http_play_dataplane and entry.kind == "dataplane" and entry.relay
+            and type(entry.relay.play_attach) == "function"
+        then
+            play_relay = entry.relay
+            channel = nil
+        end
 
         -- /play is "stream output". If a transcode job exists (even for regular streams with a base channel),
         -- prefer its encoded output over the raw channel output.
@@ -2474,7 +2505,7 @@ WantedBy=multi-user.target
                 return nil
             end
         end
-        if not channel and not transcode_upstream then
+        if not channel and not transcode_upstream and not play_relay then
             server:abort(client, 404)
             return nil
         end
@@ -2543,8 +2574,10 @@ WantedBy=multi-user.target
             end
             server:send(client, {
                 upstream = upstream,
+                relay = play_relay,
                 buffer_size = buffer_size,
                 buffer_fill = buffer_fill,
+                lag_policy = http_play_lag_policy,
             }, "video/MP2T")
 	        end
 
@@ -3025,6 +3058,7 @@ WantedBy=multi-user.target
                                     upstream = self:stream(),
                                     buffer_size = buffer_size,
                                     buffer_fill = buffer_fill,
+                                    lag_policy = http_play_lag_policy,
                                 }, "video/MP2T")
                             end,
                         })
@@ -3168,6 +3202,7 @@ WantedBy=multi-user.target
                     upstream = upstream,
                     buffer_size = buffer_size,
                     buffer_fill = buffer_fill,
+                    lag_policy = http_play_lag_policy,
                 }, "video/MP2T")
             end
 
@@ -4033,7 +4068,8 @@ WantedBy=multi-user.target
     table.insert(main_routes, { "/", safe_callback("web_index", web_index) })
     table.insert(main_routes, { "/*", safe_callback("web_index", web_index) })
 
-    http_server({
+    runtime.http_servers = {}
+    runtime.http_servers.main = http_server({
         addr = opt.addr,
         port = opt.port,
         server_name = "Stream Hub",
@@ -4045,10 +4081,11 @@ WantedBy=multi-user.target
         max_clients = http_max_clients,
         max_clients_per_ip = http_max_clients_per_ip,
         accept_backoff_ms = http_accept_backoff_ms,
+        workers = http_workers,
     })
 
     if http_play_enabled and http_play_port ~= opt.port then
-        http_server({
+        runtime.http_servers.play = http_server({
             addr = opt.addr,
             port = http_play_port,
             server_name = "Stream HTTP Play",
@@ -4060,6 +4097,7 @@ WantedBy=multi-user.target
             max_clients = http_max_clients,
             max_clients_per_ip = http_max_clients_per_ip,
             accept_backoff_ms = http_accept_backoff_ms,
+            workers = http_workers,
         })
         log.info("[server] http play on " .. opt.addr .. ":" .. http_play_port)
     end
@@ -791,6 +791,9 @@ local function normalize_backup_type(value, has_multiple)
     if value == "active_stop_if_all_inactive" or value == "active_stop" or value == "active_stop_if_all" then
         return "active_stop_if_all_inactive"
     end
+    if value == "merge" or value == "2022-7" or value == "seamless" then
+        return has_multiple and "merge" or "disabled"
+    end
     if value == "disabled" or value == "none" or value == "off" then
         return "disabled"
     end
@@ -800,6 +803,29 @@ local function normalize_backup_type(value, has_multiple)
     return "disabled"
 end
 
+-- SMPTE 2022-7: все RTP входы принимает первый udp_input (option merge), без переключений.
+-- Возвращает false, если входы не RTP: тогда остаётся обычный Active Backup.
+local function merge_rtp_inputs(channel_config, channel_data)
+    local legs = {}
+    for n, item in ipairs(channel_data.input) do
+        local conf = item.config
+        local is_rtp = conf and (conf.format == "rtp" or (conf.format == "udp" and conf.rtp == true))
+        if not is_rtp then
+            log.warning("[" .. channel_config.name .. "] backup_type merge requires rtp inputs, "
+                .. "input #" .. n .. " is not rtp. Use active backup")
+            return false
+        end
+        if n > 1 then
+            table.insert(legs, { addr = conf.addr, port = conf.port, localaddr = conf.localaddr })
+        end
+    end
+    local first = channel_data.input[1]
+    first.config.merge = legs
+    first.config.merge_window = tonumber(channel_config.merge_window)
+    channel_data.input = { first }
+    return true
+end
+
 local function is_active_backup_mode(mode)
     return mode == "active" or mode == "active_stop_if_all_inactive"
 end
@@ -3022,6 +3048,18 @@ init_output_module.udp = function(channel_data, output_id)
         tx_batch = get_setting("performance_udp_tx_batch")
     end
 
+    -- UDP_SEGMENT поверх sendmmsg batch (#gso=1 у output важнее настройки)
+    local gso = output_data.config.gso
+    if gso == nil then
+        gso = setting_bool("performance_udp_gso", false)
+    end
+
+    -- sync/cbr: размер общего пула потоков пейсинга (0 - авто), применяется при старте пула
+    local pacer_threads = nil
+    if (tonumber(output_data.config.sync) or 0) > 0 then
+        pacer_threads = setting_number("performance_udp_pacer_threads", 0)
+    end
+
     output_data.output = udp_output({
         upstream = channel_data.tail:stream(),
         addr = output_data.config.addr,
@@ -3034,6 +3072,11 @@ init_output_module.udp = function(channel_data, output_id)
         cbr = output_data.config.cbr,
         use_sendmmsg = use_sendmmsg,
         tx_batch = tx_batch,
+        gso = gso,
+        pacer_threads = pacer_threads,
+        -- SMPTE 2022-1: #fec=LxD у rtp output, FEC на порты +2 (колонки) и +4 (строки)
+        fec = output_data.config.fec,
+        fec_row = output_data.config.fec_row,
     })
 end
 
@@ -6686,6 +6729,9 @@ function make_channel(channel_config)
 
     local has_backups = #channel_data.input > 1
     local backup_type = normalize_backup_type(channel_config.backup_type, has_backups)
+    if backup_type == "merge" then
+        backup_type = merge_rtp_inputs(channel_config, channel_data) and "disabled" or "active"
+    end
     channel_config.backup_type = backup_type
     local no_data_timeout = read_number_opt(channel_config, "no_data_timeout_sec") or 3
     local probe_interval = read_number_opt(channel_config, "probe_interval_sec") or 3
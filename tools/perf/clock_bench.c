@@ -0,0 +1,97 @@
+/*
+ * Coarse clock microbenchmark
+ *
+ * 500 streams, one 7-packet datagram per event, events are dispatched by
+ * batches like core/event.c. Per packet the clock is read as many times as
+ * the per-packet modules of a typical stream do (jitter on_ts and flush,
+ * analyze rate_stat, hls_output in wall clock mode).
+ * "precise" calls asc_utime() on each read, "coarse" reads asc_now_us()
+ * refreshed once per event batch.
+ *
+ * Build and run: tools/perf/clock_bench.sh
+ */
+
+#include <astra.h>
+#include <stdio.h>
+
+#define BENCH_STREAMS 500
+#define BENCH_READS_PER_PACKET 4
+#define BENCH_BATCH 64 // events per wakeup
+#define BENCH_STREAM_PPS 2660 // ~4 Mbit/s
+
+// core/loopctl.c is not linked (no Lua here)
+__thread bool is_main_loop_idle = true;
+
+void astra_abort(void)
+{
+    abort();
+}
+
+typedef struct
+{
+    uint64_t last;
+    uint64_t sum;
+} bench_stream_t;
+
+static bench_stream_t streams[BENCH_STREAMS];
+
+static double bench_run(bool is_coarse, uint64_t packets)
+{
+    const uint64_t datagrams = packets / 7;
+    uint64_t calls = 0;
+    const uint64_t start = asc_utime();
+
+    for(uint64_t d = 0; d < datagrams; ++d)
+    {
+        if(is_coarse && (d % BENCH_BATCH) == 0)
+        {
+            asc_now_update();
+            ++calls;
+        }
+
+        bench_stream_t *const s = &streams[d % BENCH_STREAMS];
+        for(int p = 0; p < 7; ++p)
+        {
+            for(int r = 0; r < BENCH_READS_PER_PACKET; ++r)
+            {
+                const uint64_t now = (is_coarse) ? asc_now_us() : asc_utime();
+                if(now > s->last)
+                    s->sum += now - s->last;
+                s->last = now;
+            }
+        }
+        if(!is_coarse)
+            calls += 7 * BENCH_READS_PER_PACKET;
+    }
+
+    const uint64_t elapsed = asc_utime() - start;
+    printf("%s clock_calls=%llu", (is_coarse) ? "coarse" : "precise", (unsigned long long)calls);
+
+    uint64_t check = 0;
+    for(int i = 0; i < BENCH_STREAMS; ++i)
+        check += streams[i].sum;
+    if(check == 0)
+        fprintf(stderr, "unexpected: clock is not moving\n");
+
+    return (double)elapsed * 1000.0 / (double)(datagrams * 7);
+}
+
+int main(int argc, char **argv)
+{
+    uint64_t packets = 20000000;
+    if(argc > 1)
+        packets = strtoull(argv[1], NULL, 10);
+
+    const double pps = (double)BENCH_STREAMS * BENCH_STREAM_PPS;
+
+    const double precise = bench_run(false, packets);
+    printf(" ns_per_packet=%.2f cpu_pct_at_%d_streams=%.1f\n"
+           , precise, BENCH_STREAMS, precise * pps / 1e7);
+
+    memset(streams, 0, sizeof(streams));
+    const double coarse = bench_run(true, packets);
+    printf(" ns_per_packet=%.2f cpu_pct_at_%d_streams=%.1f\n"
+           , coarse, BENCH_STREAMS, coarse * pps / 1e7);
+
+    return 0;
+}
@@ -0,0 +1,30 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+# Coarse clock microbenchmark: clock cost per TS packet for 500 streams,
+# asc_utime() on each read vs asc_now_us() refreshed per event batch.
+#
+# Usage:
+#   tools/perf/clock_bench.sh
+#   PACKETS=50000000 tools/perf/clock_bench.sh
+
+ROOT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")/../.." && pwd)"
+
+CC="${CC:-cc}"
+PACKETS="${PACKETS:-20000000}"
+
+if [[ ! -f "${ROOT_DIR}/config.h" ]]; then
+  echo "ERROR: config.h not found, run ./configure.sh first"
+  exit 1
+fi
+
+TMP_DIR="$(mktemp -d)"
+trap 'rm -rf "${TMP_DIR}"' EXIT
+
+cd "${ROOT_DIR}"
+"${CC}" -O2 -std=iso9899:1999 -D_GNU_SOURCE -I. -pthread \
+  -o "${TMP_DIR}/clock_bench" \
+  tools/perf/clock_bench.c \
+  core/clock.c
+
+"${TMP_DIR}/clock_bench" "${PACKETS}"
@@ -0,0 +1,109 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+# Main loop benchmark: polling (epoll_wait(0) + usleep(1000)) vs blocking
+# (epoll_wait until the nearest timer deadline).
+#
+# Measures:
+# - idle CPU of the process (N udp_input -> udp_output pipelines, no traffic)
+# - datagram-to-send latency through one pipeline (tools/perf/udp_latency_probe.py)
+#
+# Usage:
+#   tools/perf/main_loop_benchmark.sh
+#   STREAMS=500 TIMERS=200 IDLE_SEC=10 PROBE_COUNT=2000 tools/perf/main_loop_benchmark.sh
+
+if [[ "$(uname -s)" != "Linux" ]]; then
+  echo "SKIP: this benchmark is intended for Linux"
+  exit 0
+fi
+
+ROOT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")/../.." && pwd)"
+
+BIN="${ROOT_DIR}/stream"
+if [[ ! -x "${BIN}" ]]; then
+  echo "ERROR: stream binary not found: ${BIN}"
+  exit 1
+fi
+
+STREAMS="${STREAMS:-100}"
+TIMERS="${TIMERS:-50}"
+IDLE_SEC="${IDLE_SEC:-10}"
+PROBE_PPS="${PROBE_PPS:-200}"
+PROBE_COUNT="${PROBE_COUNT:-1000}"
+IN_BASE_PORT="${IN_BASE_PORT:-21000}"
+OUT_BASE_PORT="${OUT_BASE_PORT:-31000}"
+
+TMP_DIR="$(mktemp -d)"
+STREAM_PID=""
+
+cleanup() {
+  if [[ -n "${STREAM_PID}" ]]; then
+    kill "${STREAM_PID}" 2>/dev/null || true
+    wait "${STREAM_PID}" 2>/dev/null || true
+  fi
+  rm -rf "${TMP_DIR}" 2>/dev/null || true
+}
+trap cleanup EXIT
+
+proc_ticks() {
+  # utime + stime (clock ticks)
+  awk '{ print $14 + $15 }' "/proc/$1/stat"
+}
+
+run_mode() {
+  local mode="$1"
+  local blocking=0
+  if [[ "${mode}" == "blocking" ]]; then
+    blocking=1
+  fi
+
+  local script="${TMP_DIR}/main_loop_${mode}.lua"
+  cat >"${script}" <<EOF
+__astra_main_loop_blocking = ${blocking}
+log.set({ stdout = false })
+
+pipelines = {}
+for i = 0, ${STREAMS} - 1 do
+    local input = udp_input({ addr = "127.0.0.1", port = ${IN_BASE_PORT} + i })
+    local output = udp_output({ upstream = input:stream(), addr = "127.0.0.1", port = ${OUT_BASE_PORT} + i })
+    table.insert(pipelines, { input, output })
+end
+
+-- периодические таймеры как у analyze/jitter/Lua timer{}
+timers = {}
+for i = 1, ${TIMERS} do
+    table.insert(timers, timer({ interval = 1, callback = function() end }))
+end
+EOF
+
+  # "-": скрипт читается из stdin (пути вне scripts/ трактуются как config)
+  "${BIN}" - <"${script}" >/dev/null 2>&1 &
+  STREAM_PID=$!
+
+  # main.c перечитывает __astra_main_loop_blocking раз в 2 секунды
+  sleep 3
+
+  local hz
+  hz="$(getconf CLK_TCK)"
+  local t0 t1
+  t0="$(proc_ticks "${STREAM_PID}")"
+  sleep "${IDLE_SEC}"
+  t1="$(proc_ticks "${STREAM_PID}")"
+  local idle_cpu
+  idle_cpu="$(awk -v a="${t0}" -v b="${t1}" -v hz="${hz}" -v s="${IDLE_SEC}" \
+    'BEGIN { printf "%.2f", ((b - a) / hz) * 100.0 / s }')"
+
+  local latency
+  latency="$(python3 "${ROOT_DIR}/tools/perf/udp_latency_probe.py" \
+    --in-port "${IN_BASE_PORT}" --out-port "${OUT_BASE_PORT}" \
+    --pps "${PROBE_PPS}" --count "${PROBE_COUNT}")"
+
+  echo "mode=${mode} streams=${STREAMS} timers=${TIMERS} idle_cpu_pct=${idle_cpu} ${latency}"
+
+  kill "${STREAM_PID}" 2>/dev/null || true
+  wait "${STREAM_PID}" 2>/dev/null || true
+  STREAM_PID=""
+}
+
+run_mode polling
+run_mode blocking
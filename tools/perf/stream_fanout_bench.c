@@ -0,0 +1,237 @@
+/*
+ * Stream fan-out microbenchmark
+ *
+ * Measures the cost of __module_stream_send() / __module_stream_send_batch()
+ * for 1/10/100 children (ns per packet for the whole fan-out).
+ * "list" is the legacy dispatch (asc_list_t + shared cursor), kept here
+ * as a reference to compare against the current module_stream.c.
+ * "profile" is the same dispatch with the profiler (core/profile.h) enabled,
+ * one of 8 callbacks timed (default) and every callback timed.
+ * "copy" children copy each batch into a private ring (http_upstream before
+ * the chunk pool), "chunk" children reference the packets of the ingest
+ * chunk, "chunk_copy" - packets without a chunk, one copy per dispatch.
+ *
+ * Build and run: tools/perf/stream_fanout_bench.sh
+ */
+
+#include <astra.h>
+#include <stdio.h>
+
+#define BENCH_CHILDS_MAX 100
+#define BENCH_RING_SIZE (TS_PACKET_SIZE * 7 * 64)
+
+struct module_data_t
+{
+    MODULE_STREAM_DATA();
+
+    uint64_t bytes;
+
+    uint8_t *ring;
+    size_t ring_pos;
+    ts_chunk_t *chunk;
+};
+
+static module_data_t bench_child[BENCH_CHILDS_MAX];
+
+// core/loopctl.c is not linked (no Lua here)
+__thread bool is_main_loop_idle = true;
+
+void astra_abort(void)
+{
+    abort();
+}
+
+// modules/astra/module_lua.c is not linked, instances are not listed
+const char *module_lua_type = NULL;
+
+bool module_option_string(const char *name, const char **string, size_t *length)
+{
+    __uarg(name);
+    __uarg(string);
+    __uarg(length);
+    return false;
+}
+
+static void on_ts(module_data_t *mod, const uint8_t *ts)
+{
+    mod->bytes += ts[3];
+}
+
+static void on_ts_batch(module_data_t *mod, const uint8_t *ts, size_t count)
+{
+    for(size_t i = 0; i < count; ++i)
+        mod->bytes += ts[i * TS_PACKET_SIZE + 3];
+}
+
+static void on_ts_batch_copy(module_data_t *mod, const uint8_t *ts, size_t count)
+{
+    const size_t size = count * TS_PACKET_SIZE;
+    if(mod->ring_pos + size > BENCH_RING_SIZE)
+        mod->ring_pos = 0;
+    memcpy(&mod->ring[mod->ring_pos], ts, size);
+    mod->ring_pos += size;
+    mod->bytes += ts[3];
+}
+
+static void on_ts_batch_chunk(module_data_t *mod, const uint8_t *ts, size_t count)
+{
+    const uint8_t *data = NULL;
+    ts_chunk_t *chunk = module_stream_chunk(ts, count, &data);
+    if(mod->chunk)
+        ts_chunk_unref(mod->chunk);
+    mod->chunk = chunk;
+    mod->bytes += data[3];
+}
+
+static void list_send(asc_list_t *childs, const uint8_t *ts)
+{
+    asc_list_for(childs)
+    {
+        module_stream_t *i = (module_stream_t *)asc_list_data(childs);
+        if(i->on_ts)
+            i->on_ts(i->self, ts);
+    }
+}
+
+static double bench_run(const char *mode, int childs, uint64_t packets, size_t batch)
+{
+    static uint8_t ts[TS_PACKET_SIZE * 7];
+    for(size_t i = 0; i < sizeof(ts); i += TS_PACKET_SIZE)
+    {
+        ts[i] = 0x47;
+        ts[i + 3] = 0x10;
+    }
+
+    module_stream_t parent;
+    memset(&parent, 0, sizeof(parent));
+    __module_stream_init(&parent);
+
+    asc_list_t *list = asc_list_init();
+
+    // clients are attached over time, so list nodes are scattered over the heap
+    void *scatter[BENCH_CHILDS_MAX];
+
+    for(int i = 0; i < childs; ++i)
+    {
+        scatter[i] = malloc(256 + (size_t)(rand() % 4096));
+
+        module_data_t *mod = &bench_child[i];
+        memset(mod, 0, sizeof(*mod));
+        mod->__stream.self = mod;
+        mod->__stream.on_ts = on_ts;
+        if(batch > 1)
+            mod->__stream.on_ts_batch = on_ts_batch;
+        if(strcmp(mode, "copy") == 0)
+        {
+            mod->ring = (uint8_t *)malloc(BENCH_RING_SIZE);
+            mod->__stream.on_ts_batch = on_ts_batch_copy;
+        }
+        else if(strncmp(mode, "chunk", 5) == 0)
+            mod->__stream.on_ts_batch = on_ts_batch_chunk;
+        __module_stream_init(&mod->__stream);
+        __module_stream_attach(&parent, &mod->__stream);
+        asc_list_insert_tail(list, &mod->__stream);
+    }
+
+    const bool is_list = (strcmp(mode, "list") == 0);
+
+    // the input receives into a pool chunk
+    ts_chunk_t *ingest = ts_chunk_alloc(sizeof(ts));
+    memcpy(ingest->data, ts, sizeof(ts));
+    ingest->size = sizeof(ts);
+
+    const uint64_t start = asc_utime();
+
+    if(strcmp(mode, "chunk") == 0)
+    {
+        for(uint64_t n = 0; n < packets; n += batch)
+            __module_stream_send_chunk(&parent, ingest, ingest->data, batch);
+    }
+    else if(batch > 1)
+    {
+        for(uint64_t n = 0; n < packets; n += batch)
+            __module_stream_send_batch(&parent, ts, batch);
+    }
+    else if(is_list)
+    {
+        for(uint64_t n = 0; n < packets; ++n)
+            list_send(list, ts);
+    }
+    else
+    {
+        for(uint64_t n = 0; n < packets; ++n)
+            __module_stream_send(&parent, ts);
+    }
+
+    const uint64_t elapsed = asc_utime() - start;
+
+    uint64_t check = 0;
+    for(int i = 0; i < childs; ++i)
+    {
+        check += bench_child[i].bytes;
+        free(bench_child[i].ring);
+        if(bench_child[i].chunk)
+            ts_chunk_unref(bench_child[i].chunk);
+        __module_stream_destroy(&bench_child[i].__stream);
+    }
+    __module_stream_destroy(&parent);
+    ts_chunk_unref(ingest);
+
+    for(int i = 0; i < childs; ++i)
+        free(scatter[i]);
+
+    asc_list_first(list);
+    while(!asc_list_eol(list))
+        asc_list_remove_current(list);
+    asc_list_destroy(list);
+
+    if(check == 0)
+        fprintf(stderr, "unexpected: no packets delivered\n");
+
+    return (double)elapsed * 1000.0 / (double)packets;
+}
+
+int main(int argc, char **argv)
+{
+    uint64_t packets = 2000000;
+    if(argc > 1)
+        packets = strtoull(argv[1], NULL, 10);
+    packets -= packets % 7;
+    if(packets == 0)
+        packets = 7;
+
+    static const int childs_set[] = { 1, 10, 100 };
+
+    for(size_t i = 0; i < ASC_ARRAY_SIZE(childs_set); ++i)
+    {
+        const int childs = childs_set[i];
+        const uint64_t count = packets / (uint64_t)childs;
+
+        printf("childs=%d list_ns_per_packet=%.1f stream_ns_per_packet=%.1f batch7_ns_per_packet=%.1f\n"
+               , childs
+               , bench_run("list", childs, count, 1)
+               , bench_run("stream", childs, count, 1)
+               , bench_run("stream", childs, count, 7));
+
+        asc_profile_set(true, 8);
+        const double profile8 = bench_run("stream", childs, count, 1);
+        const double profile8_batch = bench_run("stream", childs, count, 7);
+        asc_profile_set(true, 1);
+        const double profile1 = bench_run("stream", childs, count, 1);
+        const double profile1_batch = bench_run("stream", childs, count, 7);
+        asc_profile_set(false, 0);
+
+        printf("childs=%d profile8_ns_per_packet=%.1f profile8_batch7_ns_per_packet=%.1f"
+               " profile1_ns_per_packet=%.1f profile1_batch7_ns_per_packet=%.1f\n"
+               , childs, profile8, profile8_batch, profile1, profile1_batch);
+
+        printf("childs=%d copy_batch7_ns_per_packet=%.1f chunk_batch7_ns_per_packet=%.1f"
+               " chunk_copy_batch7_ns_per_packet=%.1f\n"
+               , childs
+               , bench_run("copy", childs, count, 7)
+               , bench_run("chunk", childs, count, 7)
+               , bench_run("chunk_copy", childs, count, 7));
+    }
+
+    return 0;
+}
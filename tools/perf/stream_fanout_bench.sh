@@ -0,0 +1,33 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+# Stream fan-out microbenchmark: ns/packet of __module_stream_send()
+# for 1/10/100 children (legacy asc_list_t dispatch vs module_stream.c),
+# copy per child vs references to the TS chunk pool.
+#
+# Usage:
+#   tools/perf/stream_fanout_bench.sh
+#   PACKETS=10000000 tools/perf/stream_fanout_bench.sh
+
+ROOT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")/../.." && pwd)"
+
+CC="${CC:-cc}"
+PACKETS="${PACKETS:-2000000}"
+
+if [[ ! -f "${ROOT_DIR}/config.h" ]]; then
+  echo "ERROR: config.h not found, run ./configure.sh first"
+  exit 1
+fi
+
+TMP_DIR="$(mktemp -d)"
+trap 'rm -rf "${TMP_DIR}"' EXIT
+
+cd "${ROOT_DIR}"
+"${CC}" -O2 -std=iso9899:1999 -D_GNU_SOURCE -DWITH_EPOLL=1 -I. -pthread \
+  -o "${TMP_DIR}/stream_fanout_bench" \
+  tools/perf/stream_fanout_bench.c \
+  modules/astra/module_stream.c modules/astra/ts_chunk.c \
+  core/loop.c core/thread.c core/event.c core/timer.c \
+  core/list.c core/log.c core/clock.c core/profile.c
+
+"${TMP_DIR}/stream_fanout_bench" "${PACKETS}"
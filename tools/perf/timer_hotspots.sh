@@ -2,7 +2,7 @@
 set -euo pipefail
 
 if [[ $# -lt 1 ]]; then
-  echo "Usage: $0 <pid> [seconds=20] [out_file=tools/perf/timer_hotspots.txt]"
+  echo "Usage: [API_URL=http://127.0.0.1:8000 [API_TOKEN=...]] $0 <pid> [seconds=20] [out_file=tools/perf/timer_hotspots.txt]"
   exit 1
 fi
 
@@ -15,6 +15,61 @@ if ! kill -0 "$PID" 2>/dev/null; then
   exit 1
 fi
 
+# Точные счётчики из процесса (core/timer.c): API_URL=http://127.0.0.1:8000 [API_TOKEN=...]
+# Два снимка /api/v1/metrics?timers=1 с интервалом SECONDS_CAPTURE, выводится дельта.
+if [[ -n "${API_URL:-}" ]]; then
+  TMP_BEFORE="$(mktemp /tmp/astra-timers-XXXXXX.json)"
+  TMP_AFTER="$(mktemp /tmp/astra-timers-XXXXXX.json)"
+  trap 'rm -f "$TMP_BEFORE" "$TMP_AFTER"' EXIT
+
+  CURL_ARGS=(-fsS)
+  if [[ -n "${API_TOKEN:-}" ]]; then
+    CURL_ARGS+=(-H "Authorization: Bearer ${API_TOKEN}")
+  fi
+
+  curl "${CURL_ARGS[@]}" "${API_URL%/}/api/v1/metrics?timers=1" >"$TMP_BEFORE"
+  sleep "$SECONDS_CAPTURE"
+  curl "${CURL_ARGS[@]}" "${API_URL%/}/api/v1/metrics?timers=1" >"$TMP_AFTER"
+
+  {
+    echo "# Timer hotspots (process counters)"
+    echo "pid=$PID seconds=$SECONDS_CAPTURE captured_at=$(date -Iseconds)"
+    echo
+    python3 - "$TMP_BEFORE" "$TMP_AFTER" "$SECONDS_CAPTURE" <<'PY'
+import json
+import sys
+
+def load(path):
+    with open(path) as f:
+        data = json.load(f)
+    return {t["name"]: t for t in data.get("timers") or []}
+
+before = load(sys.argv[1])
+after = load(sys.argv[2])
+seconds = float(sys.argv[3]) or 1.0
+
+rows = []
+for name, t in after.items():
+    b = before.get(name, {})
+    calls = t.get("calls", 0) - b.get("calls", 0)
+    runtime = t.get("runtime_us", 0) - b.get("runtime_us", 0)
+    if calls <= 0:
+        continue
+    rows.append((runtime, calls, t.get("max_us", 0), name))
+
+rows.sort(reverse=True)
+total = sum(r[0] for r in rows) or 1
+print("%12s %10s %10s %10s %7s  %s" % ("runtime_us", "calls/s", "avg_us", "max_us", "share", "callback"))
+for runtime, calls, max_us, name in rows:
+    print("%12d %10.1f %10.1f %10d %6.1f%%  %s" % (
+        runtime, calls / seconds, runtime / calls, max_us, 100.0 * runtime / total, name))
+PY
+  } >"$OUT_FILE"
+
+  echo "OK: $OUT_FILE"
+  exit 0
+fi
+
 if command -v perf >/dev/null 2>&1; then
   TMP_DATA="$(mktemp /tmp/astra-perf-XXXXXX.data)"
   trap 'rm -f "$TMP_DATA"' EXIT
@@ -0,0 +1,338 @@
+/*
+ * UDP GSO/GRO loopback benchmark
+ *
+ * A sender thread pushes datagrams of one size to a receiver thread on
+ * 127.0.0.1 by batches of BENCH_BATCH, like a udp_relay worker:
+ *   sendto   - one syscall per datagram
+ *   sendmmsg - one syscall per batch
+ *   gso      - one sendmmsg per batch, runs of udp_gso_segments() datagrams
+ *              with UDP_SEGMENT (modules/udp/udp_gso.c)
+ * The receiver reads by recvmmsg of BENCH_BATCH datagrams or, with UDP_GRO,
+ * by recvmmsg of BENCH_GRO_MSGS coalesced buffers.
+ * Syscalls are counted by the threads, CPU is getrusage(RUSAGE_THREAD) of
+ * each thread. On loopback the kernel delivers the datagram in the context
+ * of the sender, so the send side carries most of the receive work too.
+ * The sender keeps at most BENCH_WINDOW datagrams in flight (usleep while
+ * over, reported as waits) so the socket buffer does not drop.
+ *
+ * Build and run: tools/perf/udp_gso_bench.sh
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include "modules/udp/udp_gso.h"
+
+#define BENCH_BATCH 64
+#define BENCH_GRO_MSGS 8
+#define BENCH_WINDOW 2048
+#define BENCH_RCVBUF (32 * 1024 * 1024)
+
+#ifndef SO_RCVBUFFORCE
+#   define SO_RCVBUFFORCE 33
+#endif
+
+typedef enum
+{
+    TX_SENDTO = 0,
+    TX_SENDMMSG,
+    TX_GSO,
+} tx_mode_t;
+
+typedef struct
+{
+    const char *name;
+    tx_mode_t tx;
+    bool gro;
+} bench_mode_t;
+
+static const bench_mode_t modes[] =
+{
+    { "sendto+recvmmsg", TX_SENDTO, false },
+    { "sendmmsg+recvmmsg", TX_SENDMMSG, false },
+    { "gso+recvmmsg", TX_GSO, false },
+    { "gso+gro", TX_GSO, true },
+};
+
+typedef struct
+{
+    const bench_mode_t *mode;
+    size_t size;
+    uint64_t datagrams;
+
+    int tx_fd;
+    int rx_fd;
+    struct sockaddr_in dst;
+
+    uint64_t sent; // atomic
+    uint64_t received; // atomic
+    bool sender_done; // atomic
+
+    uint64_t tx_calls;
+    uint64_t tx_waits;
+    uint64_t rx_calls;
+    uint64_t rx_bytes;
+    double tx_cpu;
+    double rx_cpu;
+} bench_t;
+
+static double thread_cpu(void)
+{
+    struct rusage ru;
+    getrusage(RUSAGE_THREAD, &ru);
+    return (double)ru.ru_utime.tv_sec + (double)ru.ru_utime.tv_usec / 1e6
+         + (double)ru.ru_stime.tv_sec + (double)ru.ru_stime.tv_usec / 1e6;
+}
+
+static double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void *sender_thread(void *arg)
+{
+    bench_t *const b = (bench_t *)arg;
+    const double cpu = thread_cpu();
+
+    uint8_t *const data = (uint8_t *)calloc(BENCH_BATCH, b->size);
+    struct iovec iov[BENCH_BATCH];
+    struct mmsghdr msgs[BENCH_BATCH];
+    uint8_t cmsg[BENCH_BATCH][UDP_GSO_CMSG_SIZE];
+    memset(msgs, 0, sizeof(msgs));
+    for(int i = 0; i < BENCH_BATCH; ++i)
+    {
+        memset(&data[i * b->size], 0x47, b->size);
+        iov[i].iov_base = &data[i * b->size];
+        iov[i].iov_len = b->size;
+    }
+    const int per_run = udp_gso_segments(b->size);
+
+    uint64_t sent = 0;
+    while(sent < b->datagrams)
+    {
+        while(sent - __atomic_load_n(&b->received, __ATOMIC_RELAXED) > BENCH_WINDOW)
+        {
+            ++b->tx_waits;
+            usleep(20);
+        }
+
+        const uint64_t left = b->datagrams - sent;
+        const int count = (left < BENCH_BATCH) ? (int)left : BENCH_BATCH;
+
+        if(b->mode->tx == TX_SENDTO)
+        {
+            for(int i = 0; i < count; ++i)
+            {
+                ++b->tx_calls;
+                if(sendto(b->tx_fd, iov[i].iov_base, b->size, 0,
+                          (struct sockaddr *)&b->dst, sizeof(b->dst)) < 0)
+                {
+                    fprintf(stderr, "sendto: %s\n", strerror(errno));
+                    exit(1);
+                }
+            }
+        }
+        else
+        {
+            int n = 0;
+            for(int i = 0; i < count; ++n)
+            {
+                const int run = (b->mode->tx == TX_GSO)
+                              ? ((count - i < per_run) ? count - i : per_run)
+                              : 1;
+                memset(&msgs[n].msg_hdr, 0, sizeof(msgs[n].msg_hdr));
+                msgs[n].msg_hdr.msg_name = &b->dst;
+                msgs[n].msg_hdr.msg_namelen = sizeof(b->dst);
+                msgs[n].msg_hdr.msg_iov = &iov[i];
+                msgs[n].msg_hdr.msg_iovlen = (size_t)run;
+                if(b->mode->tx == TX_GSO && run > 1)
+                    udp_gso_set(&msgs[n].msg_hdr, cmsg[n], (uint16_t)b->size);
+                i += run;
+            }
+            for(int off = 0; off < n;)
+            {
+                ++b->tx_calls;
+                const int r = sendmmsg(b->tx_fd, &msgs[off], (unsigned int)(n - off), 0);
+                if(r <= 0)
+                {
+                    fprintf(stderr, "sendmmsg: %s\n", strerror(errno));
+                    exit(1);
+                }
+                off += r;
+            }
+        }
+        sent += (uint64_t)count;
+        __atomic_store_n(&b->sent, sent, __ATOMIC_RELAXED);
+    }
+
+    __atomic_store_n(&b->sender_done, true, __ATOMIC_RELEASE);
+    b->tx_cpu = thread_cpu() - cpu;
+    free(data);
+    return NULL;
+}
+
+static void *receiver_thread(void *arg)
+{
+    bench_t *const b = (bench_t *)arg;
+    const double cpu = thread_cpu();
+
+    const int msg_count = (b->mode->gro) ? BENCH_GRO_MSGS : BENCH_BATCH;
+    const size_t buffer_size = (b->mode->gro) ? UDP_GRO_BUFFER_SIZE : 2048;
+    uint8_t *const data = (uint8_t *)malloc((size_t)msg_count * buffer_size);
+    struct iovec iov[BENCH_BATCH];
+    struct mmsghdr msgs[BENCH_BATCH];
+    uint8_t cmsg[BENCH_BATCH][UDP_GRO_CMSG_SIZE];
+
+    uint64_t received = 0;
+    while(true)
+    {
+        memset(msgs, 0, sizeof(msgs));
+        for(int i = 0; i < msg_count; ++i)
+        {
+            iov[i].iov_base = &data[i * buffer_size];
+            iov[i].iov_len = buffer_size;
+            msgs[i].msg_hdr.msg_iov = &iov[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+            if(b->mode->gro)
+            {
+                msgs[i].msg_hdr.msg_control = cmsg[i];
+                msgs[i].msg_hdr.msg_controllen = sizeof(cmsg[i]);
+            }
+        }
+
+        ++b->rx_calls;
+        const int r = recvmmsg(b->rx_fd, msgs, (unsigned int)msg_count, MSG_WAITFORONE, NULL);
+        if(r <= 0)
+        {
+            if(r < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            {
+                fprintf(stderr, "recvmmsg: %s\n", strerror(errno));
+                exit(1);
+            }
+            // SO_RCVTIMEO: the rest was dropped
+            if(__atomic_load_n(&b->sender_done, __ATOMIC_ACQUIRE))
+                break;
+            continue;
+        }
+
+        for(int i = 0; i < r; ++i)
+        {
+            const size_t len = msgs[i].msg_len;
+            b->rx_bytes += len;
+            int segment = (b->mode->gro) ? udp_gro_segment(&msgs[i].msg_hdr) : 0;
+            if(segment <= 0 || (size_t)segment >= len)
+                ++received;
+            else
+                received += (len + (size_t)segment - 1) / (size_t)segment;
+        }
+        __atomic_store_n(&b->received, received, __ATOMIC_RELAXED);
+
+        if(received >= b->datagrams)
+            break;
+    }
+
+    b->rx_cpu = thread_cpu() - cpu;
+    free(data);
+    return NULL;
+}
+
+static int open_socket(struct sockaddr_in *sa)
+{
+    const int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    memset(sa, 0, sizeof(*sa));
+    sa->sin_family = AF_INET;
+    sa->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(*sa);
+    if(fd < 0 || bind(fd, (struct sockaddr *)sa, sizeof(*sa)) != 0
+       || getsockname(fd, (struct sockaddr *)sa, &len) != 0)
+    {
+        fprintf(stderr, "socket: %s\n", strerror(errno));
+        exit(1);
+    }
+    return fd;
+}
+
+static void bench_run(const bench_mode_t *mode, size_t size, uint64_t datagrams)
+{
+    bench_t b;
+    memset(&b, 0, sizeof(b));
+    b.mode = mode;
+    b.size = size;
+    b.datagrams = datagrams;
+
+    struct sockaddr_in tx_sa;
+    b.tx_fd = open_socket(&tx_sa);
+    b.rx_fd = open_socket(&b.dst);
+
+    const int rcvbuf = BENCH_RCVBUF;
+    if(setsockopt(b.rx_fd, SOL_SOCKET, SO_RCVBUFFORCE, &rcvbuf, sizeof(rcvbuf)) != 0)
+        setsockopt(b.rx_fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    struct timeval tv = { 0, 200000 };
+    setsockopt(b.rx_fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    if(mode->tx == TX_GSO && !udp_gso_probe(b.tx_fd))
+    {
+        printf("%-18s SKIP: UDP_SEGMENT is not supported\n", mode->name);
+        goto out;
+    }
+    if(mode->gro && !udp_gro_set(b.rx_fd, true))
+    {
+        printf("%-18s SKIP: UDP_GRO is not supported\n", mode->name);
+        goto out;
+    }
+
+    const double start = now_s();
+    pthread_t tx;
+    pthread_t rx;
+    pthread_create(&rx, NULL, receiver_thread, &b);
+    pthread_create(&tx, NULL, sender_thread, &b);
+    pthread_join(tx, NULL);
+    pthread_join(rx, NULL);
+    const double elapsed = now_s() - start;
+
+    const double gbit = (double)b.rx_bytes * 8.0 / 1e9;
+    const uint64_t received = __atomic_load_n(&b.received, __ATOMIC_RELAXED);
+    if(gbit <= 0.0)
+    {
+        printf("%-18s nothing received\n", mode->name);
+        goto out;
+    }
+    printf("%-18s %6.2f Gbit/s  tx_calls/Gbit=%-8.0f rx_calls/Gbit=%-8.0f"
+           " cpu_s/Gbit: tx=%.3f rx=%.3f total=%.3f  waits=%llu loss=%.3f%%\n",
+           mode->name, gbit / elapsed,
+           (double)b.tx_calls / gbit, (double)b.rx_calls / gbit,
+           b.tx_cpu / gbit, b.rx_cpu / gbit, (b.tx_cpu + b.rx_cpu) / gbit,
+           (unsigned long long)b.tx_waits,
+           100.0 * (double)(datagrams - received) / (double)datagrams);
+
+out:
+    close(b.tx_fd);
+    close(b.rx_fd);
+}
+
+int main(int argc, char **argv)
+{
+    const uint64_t datagrams = (argc > 1) ? strtoull(argv[1], NULL, 10) : 1000000;
+    const size_t size = (argc > 2) ? strtoul(argv[2], NULL, 10) : 1316;
+    if(datagrams == 0 || size == 0 || size > 1472)
+    {
+        fprintf(stderr, "usage: %s [datagrams] [size 1..1472]\n", argv[0]);
+        return 1;
+    }
+
+    printf("datagrams=%llu size=%zu batch=%d gso_segments=%d\n",
+           (unsigned long long)datagrams, size, BENCH_BATCH, udp_gso_segments(size));
+    for(size_t i = 0; i < sizeof(modes) / sizeof(*modes); ++i)
+        bench_run(&modes[i], size, datagrams);
+    return 0;
+}
@@ -0,0 +1,36 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+# UDP GSO/GRO loopback benchmark: syscalls and CPU-seconds per Gbit,
+# sendto / sendmmsg / sendmmsg+UDP_SEGMENT, recvmmsg / recvmmsg+UDP_GRO.
+#
+# Usage:
+#   tools/perf/udp_gso_bench.sh
+#   DATAGRAMS=5000000 SIZE=1328 tools/perf/udp_gso_bench.sh
+
+ROOT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")/../.." && pwd)"
+
+CC="${CC:-cc}"
+DATAGRAMS="${DATAGRAMS:-1000000}"
+SIZE="${SIZE:-1316}"
+
+if [[ "$(uname -s)" != "Linux" ]]; then
+  echo "SKIP: UDP GSO/GRO is Linux-only"
+  exit 0
+fi
+
+if [[ ! -f "${ROOT_DIR}/config.h" ]]; then
+  echo "ERROR: config.h not found, run ./configure.sh first"
+  exit 1
+fi
+
+TMP_DIR="$(mktemp -d)"
+trap 'rm -rf "${TMP_DIR}"' EXIT
+
+cd "${ROOT_DIR}"
+"${CC}" -O2 -std=iso9899:1999 -D_GNU_SOURCE -I. -pthread \
+  -o "${TMP_DIR}/udp_gso_bench" \
+  tools/perf/udp_gso_bench.c \
+  modules/udp/udp_gso.c
+
+"${TMP_DIR}/udp_gso_bench" "${DATAGRAMS}" "${SIZE}"
@@ -0,0 +1,128 @@
+#!/usr/bin/env python3
+"""
+Measure datagram-to-send latency through a UDP -> stream -> UDP pipeline.
+
+Sends TS datagrams (7*188 bytes) to --in-port and receives them on --out-port.
+Each datagram carries a sequence number and a send timestamp inside the TS
+payload, so the latency is measured per datagram on the same host clock.
+
+Python 3.5+ compatible (no f-strings, no type annotations).
+"""
+
+import argparse
+import json
+import select
+import socket
+import struct
+import time
+
+
+TS_PACKET_SIZE = 188
+TS_PER_DATAGRAM = 7
+MAGIC = b"LATP"
+
+
+def build_datagram(seq, sent_ns):
+    out = bytearray()
+    for i in range(TS_PER_DATAGRAM):
+        pkt = bytearray([0xFF] * TS_PACKET_SIZE)
+        pkt[0] = 0x47
+        pkt[1] = 0x1F
+        pkt[2] = 0xFE
+        pkt[3] = 0x10 | ((seq * TS_PER_DATAGRAM + i) & 0x0F)
+        if i == 0:
+            pkt[4:8] = MAGIC
+            pkt[8:24] = struct.pack("!QQ", seq, sent_ns)
+        out += pkt
+    return bytes(out)
+
+
+def parse_datagram(data):
+    pos = data.find(MAGIC)
+    if pos < 0 or len(data) < pos + 20:
+        return None
+    return struct.unpack("!QQ", data[pos + 4:pos + 20])
+
+
+def percentile(values, p):
+    if not values:
+        return 0.0
+    idx = int(round((p / 100.0) * (len(values) - 1)))
+    return values[idx]
+
+
+def main():
+    ap = argparse.ArgumentParser(description="UDP pipeline latency probe")
+    ap.add_argument("--addr", default="127.0.0.1")
+    ap.add_argument("--in-port", type=int, required=True, help="stream input port (we send here)")
+    ap.add_argument("--out-port", type=int, required=True, help="stream output port (we listen here)")
+    ap.add_argument("--pps", type=int, default=100, help="datagrams per second")
+    ap.add_argument("--count", type=int, default=1000, help="datagrams to send")
+    ap.add_argument("--json", action="store_true", help="print JSON summary")
+    args = ap.parse_args()
+
+    rx = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    rx.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    rx.bind((args.addr, args.out_port))
+    rx.setblocking(False)
+
+    tx = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+
+    interval = 1.0 / max(1, args.pps)
+    latencies_us = []
+    received = 0
+    next_send = time.time()
+    sent = 0
+    deadline = None
+
+    while True:
+        now = time.time()
+        if sent < args.count and now >= next_send:
+            # "sent" timestamp is taken as close to sendto() as possible
+            sent_ns = int(time.monotonic() * 1e9)
+            tx.sendto(build_datagram(sent, sent_ns), (args.addr, args.in_port))
+            sent += 1
+            next_send += interval
+            if sent == args.count:
+                deadline = time.time() + 1.0
+
+        if deadline is not None and time.time() >= deadline:
+            break
+
+        timeout = max(0.0, next_send - time.time()) if sent < args.count else 0.05
+        r, _, _ = select.select([rx], [], [], timeout)
+        if not r:
+            continue
+        while True:
+            try:
+                data = rx.recv(2048)
+            except (BlockingIOError, socket.error):
+                break
+            recv_ns = int(time.monotonic() * 1e9)
+            parsed = parse_datagram(data)
+            if not parsed:
+                continue
+            received += 1
+            latencies_us.append((recv_ns - parsed[1]) / 1000.0)
+
+    latencies_us.sort()
+    summary = {
+        "sent": sent,
+        "received": received,
+        "avg_us": (sum(latencies_us) / len(latencies_us)) if latencies_us else 0.0,
+        "p50_us": percentile(latencies_us, 50),
+        "p95_us": percentile(latencies_us, 95),
+        "p99_us": percentile(latencies_us, 99),
+        "max_us": latencies_us[-1] if latencies_us else 0.0,
+    }
+
+    if args.json:
+        print(json.dumps(summary, sort_keys=True))
+    else:
+        print("sent=%d received=%d avg=%.1fus p50=%.1fus p95=%.1fus p99=%.1fus max=%.1fus" % (
+            summary["sent"], summary["received"], summary["avg_us"],
+            summary["p50_us"], summary["p95_us"], summary["p99_us"], summary["max_us"]))
+
+
+if __name__ == "__main__":
+    main()
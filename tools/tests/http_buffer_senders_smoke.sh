@@ -0,0 +1,334 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+# Smoke test: http_buffer отдаёт клиентов пулом epoll sender потоков.
+# - 300 клиентов на одном ресурсе: у всех непрерывный TS, число потоков процесса не растёт
+# - клиент, который молчит после connect, не блокирует listener и закрывается по таймауту
+# - клиент, который не читает, закрывается по client_read_timeout_sec, остальные продолжают
+# - 404/405 отвечаются без потоков, clients_connected возвращается в 0
+# - удаление ресурса из конфига отключает его клиентов
+
+ROOT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")/../.." && pwd)"
+
+BUFFER_PORT=19690
+SOURCE_PORT=19691
+CLIENTS=300
+
+STREAM_BIN="${ROOT_DIR}/stream"
+if [[ ! -x "${STREAM_BIN}" ]]; then
+  echo "ERROR: stream binary not found/executable: ${STREAM_BIN}"
+  exit 1
+fi
+
+TMP_DIR=""
+STREAM_PID=""
+SOURCE_PID=""
+
+cleanup() {
+  if [[ -n "${STREAM_PID}" ]]; then
+    kill "${STREAM_PID}" 2>/dev/null || true
+    wait "${STREAM_PID}" 2>/dev/null || true
+    STREAM_PID=""
+  fi
+  if [[ -n "${SOURCE_PID}" ]]; then
+    kill "${SOURCE_PID}" 2>/dev/null || true
+    wait "${SOURCE_PID}" 2>/dev/null || true
+    SOURCE_PID=""
+  fi
+}
+trap 'cleanup; [[ -n "${TMP_DIR}" ]] && rm -rf "${TMP_DIR}"' EXIT
+
+TMP_DIR="$(mktemp -d)"
+SCRIPT="${TMP_DIR}/scripts/senders.lua"
+STATUS="${TMP_DIR}/status"
+REMOVE="${TMP_DIR}/remove"
+LOG="${TMP_DIR}/stream.log"
+
+# источник: HTTP TS ~4 Мбит/с, в payload сквозной номер пакета
+python3 - "${SOURCE_PORT}" <<'PY' &
+import socket, struct, sys, time
+srv = socket.socket()
+srv.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+srv.bind(("127.0.0.1", int(sys.argv[1])))
+srv.listen(4)
+while True:
+    conn, _ = srv.accept()
+    try:
+        conn.recv(4096)
+        conn.sendall(b"HTTP/1.0 200 OK\r\nContent-Type: video/MP2T\r\n\r\n")
+        n = 0
+        start = time.time()
+        while True:
+            chunk = b"".join(
+                b"\x47\x01\x00" + bytes([0x10 | ((n + i) & 0x0F)]) + struct.pack(">Q", n + i) + b"\xff" * 176
+                for i in range(14))
+            conn.sendall(chunk)
+            n += 14
+            delay = start + n / 2660.0 - time.time()
+            if delay > 0:
+                time.sleep(delay)
+    except OSError:
+        pass
+    conn.close()
+PY
+SOURCE_PID=$!
+
+# путь scripts/*.lua запускается как скрипт, а не как конфиг сервера
+mkdir -p "${TMP_DIR}/scripts"
+cat >"${SCRIPT}" <<EOF_LUA
+buffer_settings = {
+    enabled = true,
+    listen_host = "127.0.0.1",
+    listen_port = ${BUFFER_PORT},
+    max_clients_total = 2000,
+    client_read_timeout_sec = 3,
+    sender_threads = 2,
+}
+buffer_instance = http_buffer({})
+buffer_instance:apply_config({
+    settings = buffer_settings,
+    resources = {
+        {
+            id = "senders",
+            name = "senders",
+            path = "/senders",
+            enable = true,
+            backup_type = "passive",
+            buffering_sec = 4,
+            bandwidth_kbps = 4000,
+            smart_start_enabled = false,
+            keyframe_detect_mode = "auto",
+            pacing_mode = "none",
+            ts_resync_enabled = true,
+            inputs = {
+                { id = "src", url = "http://127.0.0.1:${SOURCE_PORT}/src", enable = true, priority = 0 },
+            },
+        },
+    },
+    allow = {},
+})
+status_timer = timer({
+    interval = 1,
+    callback = function()
+        local remove = io.open("${REMOVE}", "r")
+        if remove then
+            remove:close()
+            os.remove("${REMOVE}")
+            buffer_instance:apply_config({ settings = buffer_settings, resources = {}, allow = {} })
+        end
+        local r = buffer_instance:list_status()[1]
+        local f = io.open("${STATUS}", "w")
+        if r then
+            f:write(string.format("%d %d\n", r.clients_connected, r.buffer.write_index))
+        else
+            f:write("0 0\n")
+        end
+        f:close()
+    end,
+})
+EOF_LUA
+
+(cd "${TMP_DIR}" && exec "${STREAM_BIN}" scripts/senders.lua >"${LOG}" 2>&1) &
+STREAM_PID=$!
+
+STREAM_PID="${STREAM_PID}" STATUS="${STATUS}" REMOVE="${REMOVE}" LOG="${LOG}" python3 - <<PY
+import os, selectors, socket, struct, sys, time
+
+PORT = ${BUFFER_PORT}
+CLIENTS = ${CLIENTS}
+CAPACITY = 4000 * 1000 // 8 * 4 // 188
+PID = os.environ["STREAM_PID"]
+STATUS = os.environ["STATUS"]
+REMOVE = os.environ["REMOVE"]
+LOG = os.environ["LOG"]
+errors = []
+
+def status():
+    try:
+        clients, write_index = open(STATUS).read().split()
+        return int(clients), int(write_index)
+    except (OSError, ValueError):
+        return None
+
+def threads():
+    return len(os.listdir("/proc/%s/task" % PID))
+
+def request(raw):
+    s = socket.create_connection(("127.0.0.1", PORT), timeout=3)
+    s.sendall(raw)
+    data = b""
+    try:
+        while True:
+            chunk = s.recv(4096)
+            if not chunk:
+                break
+            data += chunk
+    except OSError:
+        pass
+    s.close()
+    return data
+
+deadline = time.time() + 15
+while time.time() < deadline:
+    st = status()
+    if st and st[1] > CAPACITY:
+        break
+    time.sleep(0.2)
+else:
+    print("ERROR: buffer is not filled: %r" % (status(),))
+    sys.exit(1)
+
+baseline = threads()
+
+if not request(b"GET /nope HTTP/1.1\r\n\r\n").startswith(b"HTTP/1.1 404"):
+    errors.append("no 404")
+if not request(b"POST /senders HTTP/1.1\r\n\r\n").startswith(b"HTTP/1.1 405"):
+    errors.append("no 405")
+
+# молчащий клиент не задерживает следующие запросы
+silent = socket.create_connection(("127.0.0.1", PORT))
+silent_at = time.time()
+
+# клиент, который не читает
+stuck = socket.create_connection(("127.0.0.1", PORT))
+stuck.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, 4096)
+stuck.sendall(b"GET /senders HTTP/1.1\r\n\r\n")
+
+class Client:
+    def __init__(self):
+        self.sock = socket.create_connection(("127.0.0.1", PORT))
+        self.sock.sendall(b"GET /senders?x=1 HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n")
+        self.sock.setblocking(False)
+        self.head = b""
+        self.tail = b""
+        self.packets = 0
+        self.expected = None
+        self.error = None
+        self.eof = False
+
+    def feed(self, chunk):
+        if not self.head:
+            self.tail += chunk
+            head, sep, rest = self.tail.partition(b"\r\n\r\n")
+            if not sep:
+                return
+            self.head = head
+            if not head.startswith(b"HTTP/1.1 200"):
+                self.error = "bad header %r" % head[:40]
+            chunk = rest
+            self.tail = b""
+        data = self.tail + chunk
+        full = len(data) - len(data) % 188
+        for off in range(0, full, 188):
+            p = data[off:off + 188]
+            n = struct.unpack(">Q", p[4:12])[0]
+            if p[0] != 0x47 or (self.expected is not None and n != self.expected):
+                if self.error is None:
+                    self.error = "packet %d after %r" % (n, self.expected)
+            self.expected = n + 1
+        self.packets += full // 188
+        self.tail = data[full:]
+
+clients = [Client() for _ in range(CLIENTS)]
+sel = selectors.DefaultSelector()
+for c in clients:
+    sel.register(c.sock, selectors.EVENT_READ, c)
+
+# у каждого клиента больше 2 секунд потока сверх стартового буфера
+target = CAPACITY + 2 * 2660
+max_threads = 0
+blocked = False
+deadline = time.time() + 30
+while time.time() < deadline and any(c.packets < target and not c.eof for c in clients):
+    for key, _ in sel.select(timeout=0.2):
+        c = key.data
+        try:
+            chunk = c.sock.recv(262144)
+        except BlockingIOError:
+            continue
+        except OSError:
+            chunk = b""
+        if not chunk:
+            c.eof = True
+            sel.unregister(c.sock)
+            continue
+        c.feed(chunk)
+    max_threads = max(max_threads, threads())
+
+    if time.time() - silent_at > 1.0 and clients[0].packets == 0 and not blocked:
+        blocked = True
+        errors.append("listener is blocked by a silent client")
+
+short = [c for c in clients if c.packets < target]
+if short:
+    errors.append("%d clients got less than %d packets (min %d)"
+                  % (len(short), target, min(c.packets for c in short)))
+bad = [c.error for c in clients if c.error]
+if bad:
+    errors.append("%d clients with errors, first: %s" % (len(bad), bad[0]))
+if any(c.eof for c in clients):
+    errors.append("%d clients disconnected" % sum(1 for c in clients if c.eof))
+if max_threads > baseline + 1:
+    errors.append("threads grow with clients: %d -> %d" % (baseline, max_threads))
+
+time.sleep(1.2)
+st = status()
+if not st or st[0] < CLIENTS:
+    errors.append("clients_connected during play: %r" % (st,))
+
+# молчащий клиент закрыт по client_read_timeout_sec
+def closed(sock, timeout):
+    sock.settimeout(0.5)
+    end = time.time() + timeout
+    while time.time() < end:
+        try:
+            if not sock.recv(262144):
+                return True
+        except socket.timeout:
+            continue
+        except OSError:
+            return True
+    return False
+
+if not closed(silent, 6):
+    errors.append("silent client is not closed")
+
+# нечитающий клиент остаётся в счёте, пока не заполнит буферы сокета и не выйдет таймаут
+for c in clients:
+    c.sock.close()
+deadline = time.time() + 30
+while time.time() < deadline:
+    st = status()
+    if st and st[0] == 0:
+        break
+    time.sleep(0.3)
+else:
+    errors.append("stuck client is not closed: %r" % (st,))
+stuck.close()
+
+# ресурс удалён из конфига: клиент отключается, ресурс освобождается последним клиентом
+last = Client()
+last.sock.setblocking(True)
+last.sock.settimeout(3)
+if not last.sock.recv(4096).startswith(b"HTTP/1.1 200"):
+    errors.append("no stream before remove")
+open(REMOVE, "w").close()
+if not closed(last.sock, 6):
+    errors.append("client of the removed resource is not closed")
+last.sock.close()
+if request(b"GET /senders HTTP/1.1\r\n\r\n")[:12] != b"HTTP/1.1 404":
+    errors.append("removed resource is still served")
+
+log = open(LOG, errors="replace").read()
+if "2 sender threads" not in log:
+    errors.append("sender pool is not started")
+
+if errors:
+    for e in errors:
+        print("ERROR:", e)
+    sys.exit(1)
+print("OK: %d clients, threads %d -> %d" % (CLIENTS, baseline, max_threads))
+PY
+
+cleanup
+echo "OK"
@@ -0,0 +1,239 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+# Smoke test: общее кольцо http_upstream для /play клиентов legacy потока.
+# - несколько клиентов получают непрерывный TS (счётчики без разрывов)
+# - клиент, который не читает, при lag_policy=skip продолжает с ключевого кадра
+#   (payload_unit_start + random_access_indicator), выравнивание по 188 байт сохраняется
+# - при lag_policy=disconnect такой клиент отключается, остальные не страдают
+
+ROOT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")/../.." && pwd)"
+
+HTTP_PORT=19650
+IN_PORT=19660
+
+STREAM_BIN="${ROOT_DIR}/stream"
+if [[ ! -x "${STREAM_BIN}" ]]; then
+  echo "ERROR: stream binary not found/executable: ${STREAM_BIN}"
+  exit 1
+fi
+
+TMP_DIR=""
+STREAM_PID=""
+
+cleanup() {
+  if [[ -n "${STREAM_PID}" ]]; then
+    kill "${STREAM_PID}" 2>/dev/null || true
+    wait "${STREAM_PID}" 2>/dev/null || true
+    STREAM_PID=""
+  fi
+}
+trap 'cleanup; [[ -n "${TMP_DIR}" ]] && rm -rf "${TMP_DIR}"' EXIT
+
+TMP_DIR="$(mktemp -d)"
+
+run_mode() {
+  local policy="$1"
+  local cfg="${TMP_DIR}/ring_${policy}.json"
+  local log="${TMP_DIR}/stream_${policy}.log"
+
+  cat >"${cfg}" <<EOF_CFG
+{
+  "settings": {
+    "http_auth_enabled": false,
+    "http_play_allow": true,
+    "http_play_buffer_kb": 512,
+    "http_play_buffer_fill_kb": 16,
+    "http_play_lag_policy": "${policy}",
+    "performance_passthrough_dataplane": "off"
+  },
+  "make_stream": [
+    {
+      "id": "ring_play",
+      "type": "udp",
+      "enable": true,
+      "input": [
+        "udp://127.0.0.1:${IN_PORT}"
+      ]
+    }
+  ]
+}
+EOF_CFG
+
+  "${STREAM_BIN}" scripts/server.lua -a 127.0.0.1 -p "${HTTP_PORT}" \
+    --config "${cfg}" \
+    --data-dir "${TMP_DIR}/data_${policy}" \
+    --log "${log}" \
+    --no-stdout &
+  STREAM_PID=$!
+
+  for _ in $(seq 1 80); do
+    if curl -fsS "http://127.0.0.1:${HTTP_PORT}/" >/dev/null 2>&1; then
+      break
+    fi
+    sleep 0.2
+  done
+
+  POLICY="${policy}" LOG="${log}" python3 - <<PY
+import os, socket, sys, threading, time
+
+IN_PORT = ${IN_PORT}
+HTTP_PORT = ${HTTP_PORT}
+POLICY = os.environ["POLICY"]
+LOG = os.environ["LOG"]
+
+# 7 пакетов PID 0x100, каждая 50-я датаграмма начинается с ключевого кадра.
+# метка пакета: номер датаграммы и пакета в байтах 8..10, заполнение < 0x80
+def datagram(n):
+    out = b""
+    for i in range(7):
+        cc = (n * 7 + i) & 0x0F
+        if i == 0 and n % 50 == 0:
+            head = bytes([0x47, 0x41, 0x00, 0x30 | cc, 0x01, 0x40, 0x00, 0x00])
+        else:
+            head = bytes([0x47, 0x01, 0x00, 0x10 | cc, 0x00, 0x00, 0x00, 0x00])
+        mark = bytes([(n >> 8) & 0x7F, n & 0xFF, i])
+        out += head + mark + bytes([(n + i) & 0x7F]) * (188 - len(head) - len(mark))
+    return out
+
+def is_keyframe(p):
+    return (p[1] & 0x40) and (p[3] & 0x20) and p[4] > 0 and (p[5] & 0x40)
+
+class Client(threading.Thread):
+    def __init__(self, slow=False):
+        threading.Thread.__init__(self)
+        self.sock = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        if slow:
+            self.sock.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, 4096)
+        self.sock.settimeout(5)
+        self.sock.connect(("127.0.0.1", HTTP_PORT))
+        self.sock.sendall(b"GET /play/ring_play HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n")
+        self.data = b""
+        self.stop = False
+        self.paused = slow
+        self.eof = False
+
+    def run(self):
+        self.sock.settimeout(0.1)
+        while not self.stop:
+            if self.paused:
+                time.sleep(0.05)
+                continue
+            try:
+                chunk = self.sock.recv(65536)
+            except socket.timeout:
+                continue
+            except OSError:
+                self.eof = True
+                break
+            if not chunk:
+                self.eof = True
+                break
+            self.data += chunk
+
+def check(name, c, errors, allow_skip):
+    head, sep, body = c.data.partition(b"\r\n\r\n")
+    if not sep or not head.startswith(b"HTTP/1.1 200"):
+        errors.append("%s: bad response header %r" % (name, head[:64]))
+        return (0, 0)
+    if len(body) == 0 or len(body) % 188 != 0:
+        errors.append("%s: body %d bytes" % (name, len(body)))
+        return (0, 0)
+    skips = 0
+    expected = None
+    pad = False
+    for off in range(0, len(body), 188):
+        p = body[off:off + 188]
+        if p[0] != 0x47:
+            errors.append("%s: lost sync at %d" % (name, off))
+            break
+        if p[187] == 0xFF:
+            # пакет, прерванный пропуском, дополнен
+            if not allow_skip or pad:
+                errors.append("%s: padding at %d" % (name, off))
+                break
+            pad = True
+            expected = None
+            continue
+        mark = ((p[8] << 8) | p[9], p[10])
+        if expected is not None and mark != expected:
+            if not allow_skip or not is_keyframe(p):
+                errors.append("%s: %r after %r at %d" % (name, mark, expected, off))
+                break
+            skips += 1
+        elif expected is None and pad and not is_keyframe(p):
+            errors.append("%s: no keyframe after padding at %d" % (name, off))
+            break
+        pad = False
+        n, i = mark
+        expected = (n, i + 1) if i < 6 else (n + 1, 0)
+    return (len(body) // 188, skips)
+
+errors = []
+src = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+
+def send(first, last, delay=0.001):
+    for n in range(first, last):
+        src.sendto(datagram(n), ("127.0.0.1", IN_PORT))
+        if n % 4 == 3:
+            time.sleep(delay)
+
+# вход запускается первым клиентом
+clients = [Client() for _ in range(3)]
+slow = Client(slow=True)
+for c in clients + [slow]:
+    c.start()
+time.sleep(0.5)
+
+# ~2.5 MiB: медленный клиент отстаёт больше чем на буфер 512 KiB
+send(0, 2000)
+time.sleep(0.3)
+slow.paused = False
+send(2000, 2600)
+time.sleep(1.5)
+
+for c in clients + [slow]:
+    c.stop = True
+for c in clients + [slow]:
+    c.join()
+    c.sock.close()
+
+result = []
+for i, c in enumerate(clients):
+    count, skips = check("client%d" % i, c, errors, False)
+    result.append(count)
+    if count < 1000 * 7:
+        errors.append("client%d: %d packets" % (i, count))
+
+log = open(LOG, errors="replace").read()
+if POLICY == "skip":
+    count, skips = check("slow", slow, errors, True)
+    if skips == 0:
+        errors.append("slow: no skip (%d packets)" % count)
+    if slow.eof:
+        errors.append("slow: disconnected")
+    result.append((count, skips))
+else:
+    if not slow.eof:
+        errors.append("slow: not disconnected")
+    if "client is too slow" not in log:
+        errors.append("slow: no log message")
+    result.append("disconnected")
+
+if "client instance is not released" in log:
+    errors.append("client instance is not released")
+
+if errors:
+    for e in errors:
+        print("ERROR:", e)
+    sys.exit(1)
+print("OK %s: %r" % (POLICY, result))
+PY
+
+  cleanup
+}
+
+run_mode skip
+run_mode disconnect
+
+echo "OK"
@@ -0,0 +1,258 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+# Smoke test: http_server с http_workers (SO_REUSEPORT, приём на data loop).
+# - шторм подключений: все запросы получают ответ, соединения распределены по worker
+# - битый запрос и слишком длинная строка запроса обрабатываются в worker (bad_requests, 414)
+# - /play клиенты получают непрерывный TS от worker, streams считается по worker
+# - клиент, который не читает, при lag_policy=disconnect отключается worker,
+#   основной цикл освобождает клиента без ошибок
+
+ROOT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")/../.." && pwd)"
+
+HTTP_PORT=19670
+IN_PORT=19680
+
+STREAM_BIN="${ROOT_DIR}/stream"
+if [[ ! -x "${STREAM_BIN}" ]]; then
+  echo "ERROR: stream binary not found/executable: ${STREAM_BIN}"
+  exit 1
+fi
+
+TMP_DIR=""
+STREAM_PID=""
+
+cleanup() {
+  if [[ -n "${STREAM_PID}" ]]; then
+    kill "${STREAM_PID}" 2>/dev/null || true
+    wait "${STREAM_PID}" 2>/dev/null || true
+    STREAM_PID=""
+  fi
+}
+trap 'cleanup; [[ -n "${TMP_DIR}" ]] && rm -rf "${TMP_DIR}"' EXIT
+
+TMP_DIR="$(mktemp -d)"
+CFG="${TMP_DIR}/workers.json"
+LOG="${TMP_DIR}/stream.log"
+
+cat >"${CFG}" <<EOF_CFG
+{
+  "settings": {
+    "http_auth_enabled": false,
+    "http_play_allow": true,
+    "http_play_buffer_kb": 512,
+    "http_play_buffer_fill_kb": 16,
+    "http_play_lag_policy": "disconnect",
+    "http_workers": 2,
+    "performance_data_loops": 2,
+    "performance_passthrough_dataplane": "off"
+  },
+  "make_stream": [
+    {
+      "id": "workers_play",
+      "type": "udp",
+      "enable": true,
+      "input": [
+        "udp://127.0.0.1:${IN_PORT}"
+      ]
+    }
+  ]
+}
+EOF_CFG
+
+"${STREAM_BIN}" scripts/server.lua -a 127.0.0.1 -p "${HTTP_PORT}" \
+  --config "${CFG}" \
+  --data-dir "${TMP_DIR}/data" \
+  --log "${LOG}" \
+  --no-stdout &
+STREAM_PID=$!
+
+for _ in $(seq 1 80); do
+  if curl -fsS "http://127.0.0.1:${HTTP_PORT}/" >/dev/null 2>&1; then
+    break
+  fi
+  sleep 0.2
+done
+
+LOG="${LOG}" python3 - <<PY
+import json, os, socket, sys, threading, time
+
+IN_PORT = ${IN_PORT}
+HTTP_PORT = ${HTTP_PORT}
+LOG = os.environ["LOG"]
+
+errors = []
+
+def request(raw, timeout=5):
+    s = socket.create_connection(("127.0.0.1", HTTP_PORT), timeout=timeout)
+    s.sendall(raw)
+    data = b""
+    try:
+        while True:
+            chunk = s.recv(65536)
+            if not chunk:
+                break
+            data += chunk
+    except OSError:
+        pass
+    s.close()
+    return data
+
+def metrics():
+    data = request(b"GET /api/v1/metrics HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: close\r\n\r\n")
+    head, _, body = data.partition(b"\r\n\r\n")
+    if not head.startswith(b"HTTP/1.1 200"):
+        errors.append("metrics: %r" % head[:64])
+        return []
+    return ((json.loads(body).get("http") or {}).get("main") or {}).get("workers") or []
+
+# шторм: 400 соединений, по 50 одновременно
+results = []
+def storm(count):
+    for _ in range(count):
+        results.append(request(b"GET / HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: close\r\n\r\n"))
+threads = [threading.Thread(target=storm, args=(8,)) for _ in range(50)]
+for t in threads:
+    t.start()
+for t in threads:
+    t.join()
+bad = [r[:32] for r in results if not r.startswith(b"HTTP/1.1 ")]
+if len(results) != 400 or bad:
+    errors.append("storm: %d responses, %d without status %r" % (len(results), len(bad), bad[:3]))
+
+# ответы worker без обращения к основному циклу
+if request(b"GARBAGE\r\n\r\n") != b"":
+    errors.append("bad request: response is not expected")
+long_line = request(b"GET /" + b"a" * 5000 + b" HTTP/1.1\r\n\r\n")
+if not long_line.startswith(b"HTTP/1.1 414"):
+    errors.append("long request line: %r" % long_line[:32])
+
+workers = metrics()
+if len(workers) != 2:
+    errors.append("workers: %r" % workers)
+else:
+    accepted = [w.get("accepted", 0) for w in workers]
+    if sum(accepted) < 400 or min(accepted) == 0:
+        errors.append("accepted by workers: %r" % accepted)
+    if sum(w.get("bad_requests", 0) for w in workers) < 2:
+        errors.append("bad_requests: %r" % [w.get("bad_requests") for w in workers])
+    if sum(w.get("dispatched", 0) for w in workers) < 400:
+        errors.append("dispatched: %r" % [w.get("dispatched") for w in workers])
+    if max(w.get("accept_latency_max_us", 0) for w in workers) <= 0:
+        errors.append("accept latency is not measured")
+
+# /play: 3 клиента читают, 1 не читает
+def datagram(n):
+    out = b""
+    for i in range(7):
+        cc = (n * 7 + i) & 0x0F
+        head = bytes([0x47, 0x01, 0x00, 0x10 | cc])
+        mark = bytes([(n >> 8) & 0x7F, n & 0xFF, i])
+        out += head + mark + bytes([(n + i) & 0x7F]) * (188 - len(head) - len(mark))
+    return out
+
+class Client(threading.Thread):
+    def __init__(self, slow=False):
+        threading.Thread.__init__(self)
+        self.sock = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        if slow:
+            self.sock.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, 4096)
+        self.sock.connect(("127.0.0.1", HTTP_PORT))
+        self.sock.sendall(b"GET /play/workers_play HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n")
+        self.data = b""
+        self.stop = False
+        self.slow = slow
+        self.eof = False
+
+    def run(self):
+        self.sock.settimeout(0.1)
+        while not self.stop:
+            if self.slow:
+                time.sleep(0.05)
+                continue
+            try:
+                chunk = self.sock.recv(65536)
+            except socket.timeout:
+                continue
+            except OSError:
+                self.eof = True
+                break
+            if not chunk:
+                self.eof = True
+                break
+            self.data += chunk
+
+src = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+def send(first, last):
+    for n in range(first, last):
+        src.sendto(datagram(n), ("127.0.0.1", IN_PORT))
+        if n % 4 == 3:
+            time.sleep(0.001)
+
+clients = [Client() for _ in range(3)]
+slow = Client(slow=True)
+for c in clients + [slow]:
+    c.start()
+time.sleep(0.5)
+send(0, 1500)
+
+streams = sum(w.get("streams", 0) for w in metrics())
+if streams != 4:
+    errors.append("streams during play: %d" % streams)
+
+send(1500, 3000)
+time.sleep(2.5)
+
+# медленный клиент дочитывает буфер и должен получить разрыв
+slow.slow = False
+time.sleep(1.0)
+
+if not slow.eof:
+    errors.append("slow: not disconnected")
+
+for c in clients + [slow]:
+    c.stop = True
+for c in clients + [slow]:
+    c.join()
+    c.sock.close()
+
+for i, c in enumerate(clients):
+    head, sep, body = c.data.partition(b"\r\n\r\n")
+    if not sep or not head.startswith(b"HTTP/1.1 200"):
+        errors.append("client%d: bad response header %r" % (i, head[:64]))
+        continue
+    expected = None
+    for off in range(0, len(body) - len(body) % 188, 188):
+        p = body[off:off + 188]
+        mark = ((p[4] << 8) | p[5], p[6])
+        if p[0] != 0x47 or (expected is not None and mark != expected):
+            errors.append("client%d: %r after %r at %d" % (i, mark, expected, off))
+            break
+        n, k = mark
+        expected = (n, k + 1) if k < 6 else (n + 1, 0)
+    if len(body) < 2000 * 7 * 188:
+        errors.append("client%d: %d bytes" % (i, len(body)))
+
+time.sleep(0.5)
+streams = sum(w.get("streams", 0) for w in metrics())
+if streams != 0:
+    errors.append("streams after play: %d" % streams)
+
+log = open(LOG, errors="replace").read()
+if "client is too slow" not in log:
+    errors.append("slow: no log message")
+if "accepting on 2 workers" not in log:
+    errors.append("workers are not started")
+for message in ("client instance is not released", "failed to listen"):
+    if message in log:
+        errors.append(message)
+
+if errors:
+    for e in errors:
+        print("ERROR:", e)
+    sys.exit(1)
+print("OK: workers %r" % [(w.get("accepted"), w.get("dispatched")) for w in workers])
+PY
+
+cleanup
+echo "OK"
@@ -0,0 +1,320 @@
+/*
+ * core/log.c test: asynchronous writer, rate limit, reopen
+ *
+ * phase 1: sync mode (no writer thread), caller cost per line
+ * phase 2: async mode, producer threads without rate limit: every line is
+ *          written or counted as dropped, per-thread order is kept
+ * phase 3: rate limit: one flooding call site is limited and summarized
+ *          ("suppressed N messages"), a quiet call site is not affected
+ * phase 4: steady rate: a call site firing every ms after its burst passes
+ *          rate_limit lines per second, also below 63 lines per second
+ * phase 5: asc_log_message_site() (Lua log.*) is limited per site,
+ *          asc_log_message() without a site is not limited
+ * phase 6: asc_log_hup() reopens the file after rename
+ *
+ * Build and run: tools/tests/log_async_test.sh
+ */
+
+#include <astra.h>
+#include <pthread.h>
+#include <stdio.h>
+
+#define PRODUCERS 4
+
+typedef struct
+{
+    int id;
+    uint64_t count;
+    uint64_t elapsed;
+} producer_t;
+
+// core/loopctl.c is not linked (no Lua here)
+__thread bool is_main_loop_idle = true;
+
+void astra_abort(void)
+{
+    abort();
+}
+
+static char log_path[256];
+static uint64_t errors = 0;
+
+static void * producer_thread(void *arg)
+{
+    producer_t *p = (producer_t *)arg;
+    const uint64_t start = asc_utime();
+    for(uint64_t i = 0; i < p->count; ++i)
+        asc_log_info("[test] producer=%d seq=%llu", p->id, (unsigned long long)i);
+    p->elapsed = asc_utime() - start;
+    return NULL;
+}
+
+static uint64_t run_producers(uint64_t count)
+{
+    pthread_t threads[PRODUCERS];
+    producer_t producers[PRODUCERS];
+    uint64_t elapsed = 0;
+
+    for(int i = 0; i < PRODUCERS; ++i)
+    {
+        producers[i].id = i;
+        producers[i].count = count;
+        producers[i].elapsed = 0;
+        pthread_create(&threads[i], NULL, producer_thread, &producers[i]);
+    }
+    for(int i = 0; i < PRODUCERS; ++i)
+    {
+        pthread_join(threads[i], NULL);
+        elapsed += producers[i].elapsed;
+    }
+
+    // ns per line on the caller side
+    return elapsed * 1000 / (count * PRODUCERS);
+}
+
+/* checks order of producer lines, returns number of lines */
+static uint64_t check_file(const char *path, uint64_t *other, const char *summary)
+{
+    FILE *fp = fopen(path, "r");
+    if(!fp)
+    {
+        printf("failed to open %s\n", path);
+        ++errors;
+        return 0;
+    }
+
+    long long next[PRODUCERS];
+    for(int i = 0; i < PRODUCERS; ++i)
+        next[i] = -1;
+
+    uint64_t count = 0;
+    bool is_summary = false;
+    char line[1024];
+    while(fgets(line, sizeof(line), fp))
+    {
+        int id = 0;
+        long long seq = 0;
+        const char *text = strstr(line, "[test] producer=");
+        if(text && sscanf(text, "[test] producer=%d seq=%lld", &id, &seq) == 2
+           && id >= 0 && id < PRODUCERS)
+        {
+            if(seq <= next[id])
+            {
+                printf("order: producer=%d seq=%lld after %lld\n", id, seq, next[id]);
+                ++errors;
+            }
+            next[id] = seq;
+            ++count;
+        }
+        else
+        {
+            if(summary && strstr(line, summary))
+                is_summary = true;
+            if(other)
+                ++(*other);
+        }
+
+        // time stamp prefix: "Oct 17 04:03:05: INFO: "
+        if(!strstr(line, ": INFO: ") && !strstr(line, ": WARNING: "))
+        {
+            printf("no prefix: %s", line);
+            ++errors;
+        }
+    }
+    fclose(fp);
+
+    if(summary && !is_summary)
+    {
+        printf("no summary \"%s\"\n", summary);
+        ++errors;
+    }
+
+    return count;
+}
+
+/* lines passed per second by a call site firing every ms after its burst */
+static double steady_rate(int rate)
+{
+    asc_log_set_rate_limit(rate);
+
+    // drain the burst
+    asc_log_stats_t before;
+    asc_log_stats_t after;
+    asc_log_stats(&before);
+    do
+    {
+        asc_log_warning("[test] steady");
+        asc_log_stats(&after);
+    } while(after.suppressed == before.suppressed);
+
+    uint64_t fired = 0;
+    const uint64_t start = asc_utime();
+    asc_log_stats(&before);
+    while(asc_utime() - start < 2000000)
+    {
+        asc_usleep(1000);
+        asc_log_warning("[test] steady");
+        ++fired;
+    }
+    const uint64_t elapsed = asc_utime() - start;
+    asc_log_stats(&after);
+
+    const uint64_t passed = fired - (after.suppressed - before.suppressed);
+    return (double)passed * 1000000.0 / (double)elapsed;
+}
+
+int main(int argc, char **argv)
+{
+    uint64_t count = 50000;
+    if(argc > 1)
+        count = strtoull(argv[1], NULL, 10);
+
+    snprintf(log_path, sizeof(log_path), "/tmp/astra-log-test-%d.log", (int)getpid());
+    unlink(log_path);
+
+    asc_log_set_stdout(false);
+    asc_log_set_file(log_path);
+    asc_log_set_rate_limit(0);
+
+    /* phase 1: sync */
+    const uint64_t sync_ns = run_producers(count / 10);
+    uint64_t lines = check_file(log_path, NULL, NULL);
+    if(lines != count / 10 * PRODUCERS)
+    {
+        printf("sync: lines=%llu\n", (unsigned long long)lines);
+        ++errors;
+    }
+    printf("sync lines=%llu caller_ns=%llu\n"
+           , (unsigned long long)lines, (unsigned long long)sync_ns);
+
+    /* phase 2: async */
+    unlink(log_path);
+    asc_log_core_init();
+    asc_log_set_stdout(false);
+    asc_log_set_file(log_path);
+    asc_log_set_rate_limit(0);
+
+    asc_log_stats_t before;
+    asc_log_stats(&before);
+    const uint64_t async_ns = run_producers(count);
+    asc_log_flush();
+    asc_log_stats_t after;
+    asc_log_stats(&after);
+
+    // "dropped" summary is written once per second
+    asc_usleep(1200000);
+    asc_log_flush();
+
+    const uint64_t dropped = after.dropped - before.dropped;
+    lines = check_file(log_path, NULL, (dropped) ? "dropped" : NULL);
+    if(lines + dropped != count * PRODUCERS)
+    {
+        printf("async: lines=%llu dropped=%llu expected=%llu\n"
+               , (unsigned long long)lines, (unsigned long long)dropped
+               , (unsigned long long)(count * PRODUCERS));
+        ++errors;
+    }
+    printf("async lines=%llu dropped=%llu caller_ns=%llu\n"
+           , (unsigned long long)lines, (unsigned long long)dropped
+           , (unsigned long long)async_ns);
+
+    /* phase 3: rate limit */
+    unlink(log_path);
+    asc_log_hup();
+    asc_log_set_rate_limit(100);
+
+    asc_log_stats(&before);
+    const uint64_t start = asc_utime();
+    uint64_t flood = 0;
+    while(asc_utime() - start < 2000000)
+    {
+        asc_log_warning("[test] flood %llu", (unsigned long long)flood);
+        ++flood;
+        if((flood % 1000) == 0)
+            asc_log_info("[test] producer=0 seq=%llu", (unsigned long long)(flood / 1000));
+        if((flood % 64) == 0)
+            asc_usleep(100);
+    }
+    asc_usleep(1200000);
+    asc_log_flush();
+    asc_log_stats(&after);
+
+    const uint64_t suppressed = after.suppressed - before.suppressed;
+    uint64_t other = 0;
+    lines = check_file(log_path, &other, "suppressed");
+    // burst 10s + 2s of 100 lines, summaries
+    const uint64_t flood_lines = other;
+    if(lines != flood / 1000 || flood_lines < 1000 + 100 || flood_lines > 1000 + 2 * 100 + 10
+       || suppressed == 0)
+    {
+        printf("limit: quiet=%llu flood_lines=%llu suppressed=%llu\n"
+               , (unsigned long long)lines, (unsigned long long)flood_lines
+               , (unsigned long long)suppressed);
+        ++errors;
+    }
+    printf("limit flood=%llu written=%llu suppressed=%llu\n"
+           , (unsigned long long)flood, (unsigned long long)flood_lines
+           , (unsigned long long)suppressed);
+    asc_log_set_rate_limit(0);
+
+    /* phase 4: steady rate */
+    static const int steady_rates[] = { 20, 200 };
+    for(size_t i = 0; i < ASC_ARRAY_SIZE(steady_rates); ++i)
+    {
+        const int rate = steady_rates[i];
+        const double passed = steady_rate(rate);
+        if(passed < rate * 0.97 - 1 || passed > rate * 1.03 + 1)
+        {
+            printf("steady: rate_limit=%d passed=%.1f/s\n", rate, passed);
+            ++errors;
+        }
+        printf("steady rate_limit=%d passed=%.1f/s\n", rate, passed);
+    }
+    asc_log_set_rate_limit(0);
+
+    /* phase 5: message sites */
+    asc_log_set_rate_limit(100);
+    asc_log_stats(&before);
+    for(int i = 0; i < 3000; ++i)
+        asc_log_message_site(ASC_LOG_LEVEL_INFO, "test.lua:10", "[test] site");
+    asc_log_stats(&after);
+    // burst 10s of 100 lines
+    const uint64_t site_suppressed = after.suppressed - before.suppressed;
+    asc_log_stats(&before);
+    for(int i = 0; i < 3000; ++i)
+        asc_log_message(ASC_LOG_LEVEL_INFO, "[test] no site");
+    asc_log_stats(&after);
+    const uint64_t nosite_suppressed = after.suppressed - before.suppressed;
+    if(site_suppressed < 1900 || site_suppressed > 2000 || nosite_suppressed != 0)
+    {
+        printf("site: suppressed=%llu no_site_suppressed=%llu\n"
+               , (unsigned long long)site_suppressed
+               , (unsigned long long)nosite_suppressed);
+        ++errors;
+    }
+    printf("site suppressed=%llu no_site_suppressed=%llu\n"
+           , (unsigned long long)site_suppressed, (unsigned long long)nosite_suppressed);
+    asc_log_set_rate_limit(0);
+
+    /* phase 6: reopen */
+    char rotated[300];
+    snprintf(rotated, sizeof(rotated), "%s.1", log_path);
+    rename(log_path, rotated);
+    asc_log_hup();
+    asc_usleep(500000);
+    asc_log_info("[test] producer=0 seq=0");
+    asc_log_flush();
+    lines = check_file(log_path, NULL, NULL);
+    if(lines != 1)
+    {
+        printf("reopen: lines=%llu\n", (unsigned long long)lines);
+        ++errors;
+    }
+    unlink(rotated);
+
+    asc_log_core_destroy();
+    unlink(log_path);
+
+    printf("%s\n", errors ? "FAILED" : "OK");
+    return errors ? 1 : 0;
+}
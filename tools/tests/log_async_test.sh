@@ -0,0 +1,31 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+# Test for core/log.c: asynchronous writer thread (MPSC ring, writev),
+# per call site rate limit with summaries (C format strings and Lua
+# chunk:line sites), dropped lines, reopen on HUP.
+#
+# Usage:
+#   tools/tests/log_async_test.sh
+#   LINES=200000 tools/tests/log_async_test.sh
+
+ROOT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")/../.." && pwd)"
+
+CC="${CC:-cc}"
+LINES="${LINES:-50000}"
+
+if [[ ! -f "${ROOT_DIR}/config.h" ]]; then
+  echo "ERROR: config.h not found, run ./configure.sh first"
+  exit 1
+fi
+
+TMP_DIR="$(mktemp -d)"
+trap 'rm -rf "${TMP_DIR}"' EXIT
+
+cd "${ROOT_DIR}"
+"${CC}" -O2 -std=iso9899:1999 -D_GNU_SOURCE -I. -pthread \
+  -o "${TMP_DIR}/log_async_test" \
+  tools/tests/log_async_test.c \
+  core/log.c core/clock.c
+
+"${TMP_DIR}/log_async_test" "${LINES}"
@@ -0,0 +1,102 @@
+/*
+ * core/loop.c test: asc_loop_call() while data loops stop
+ *
+ * Chains of calls bounce between two data loops, every hop queues the next
+ * one on the other loop. asc_loop_core_destroy() stops the loops while the
+ * chains are still running: every queued call must run exactly once, either
+ * by the loop before it exits or in place once the loop is stopped.
+ *
+ * Build and run: tools/tests/loop_call_test.sh
+ */
+
+#include <astra.h>
+#include <stdio.h>
+
+#define CHAINS 8
+#define HOPS 4000
+
+typedef struct
+{
+    int loop;
+    int hops;
+} chain_t;
+
+// core/loopctl.c is not linked (no Lua here)
+__thread bool is_main_loop_idle = true;
+
+void astra_abort(void)
+{
+    abort();
+}
+
+static uint64_t queued = 0;
+static uint64_t done = 0;
+
+static void on_call(void *arg)
+{
+    chain_t *chain = (chain_t *)arg;
+    __atomic_add_fetch(&done, 1, __ATOMIC_RELAXED);
+
+    if(--chain->hops <= 0)
+        return;
+
+    chain->loop = (chain->loop == 1) ? 2 : 1;
+    __atomic_add_fetch(&queued, 1, __ATOMIC_RELAXED);
+    asc_loop_call(asc_loop_get(chain->loop), on_call, chain);
+}
+
+static bool run(uint32_t seed)
+{
+    chain_t chains[CHAINS];
+
+    asc_loop_core_init();
+    if(!asc_loop_core_start(2))
+    {
+        printf("failed to start data loops\n");
+        return false;
+    }
+
+    queued = 0;
+    done = 0;
+    for(int i = 0; i < CHAINS; ++i)
+    {
+        chains[i].loop = 1 + (i & 1);
+        chains[i].hops = HOPS;
+        __atomic_add_fetch(&queued, 1, __ATOMIC_RELAXED);
+        asc_loop_call(asc_loop_get(chains[i].loop), on_call, &chains[i]);
+    }
+
+    // stop in the middle of the chains
+    asc_usleep(seed % 2000);
+    asc_loop_core_destroy();
+
+    const uint64_t q = __atomic_load_n(&queued, __ATOMIC_RELAXED);
+    const uint64_t d = __atomic_load_n(&done, __ATOMIC_RELAXED);
+    if(q == d && d == (uint64_t)CHAINS * HOPS)
+        return true;
+
+    printf("seed=%u queued=%llu done=%llu expected=%llu\n"
+           , seed, (unsigned long long)q, (unsigned long long)d
+           , (unsigned long long)CHAINS * HOPS);
+    return false;
+}
+
+int main(int argc, char **argv)
+{
+    int rounds = 300;
+    if(argc > 1)
+        rounds = atoi(argv[1]);
+
+    asc_log_set_stdout(false);
+
+    bool ok = true;
+    uint32_t seed = 1;
+    for(int i = 0; i < rounds && ok; ++i)
+    {
+        seed = seed * 1103515245 + 12345;
+        ok = run(seed >> 8);
+    }
+
+    printf("rounds=%d %s\n", rounds, ok ? "OK" : "FAILED");
+    return ok ? 0 : 1;
+}
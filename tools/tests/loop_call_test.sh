@@ -0,0 +1,37 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+# core/loop.c test: asc_loop_call() between data loops while they stop,
+# every queued call runs exactly once.
+#
+# Usage:
+#   tools/tests/loop_call_test.sh
+#   ROUNDS=3000 tools/tests/loop_call_test.sh
+#   SANITIZE=thread tools/tests/loop_call_test.sh
+
+ROOT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")/../.." && pwd)"
+
+CC="${CC:-cc}"
+ROUNDS="${ROUNDS:-300}"
+SANITIZE="${SANITIZE:-}"
+
+if [[ ! -f "${ROOT_DIR}/config.h" ]]; then
+  echo "ERROR: config.h not found, run ./configure.sh first"
+  exit 1
+fi
+
+EXTRA_CFLAGS=()
+if [[ -n "${SANITIZE}" ]]; then
+  EXTRA_CFLAGS+=("-fsanitize=${SANITIZE}" "-g")
+fi
+
+TMP_DIR="$(mktemp -d)"
+trap 'rm -rf "${TMP_DIR}"' EXIT
+
+cd "${ROOT_DIR}"
+"${CC}" -O2 -std=iso9899:1999 -D_GNU_SOURCE -DWITH_EPOLL=1 -I. -pthread ${EXTRA_CFLAGS[@]+"${EXTRA_CFLAGS[@]}"} \
+  -o "${TMP_DIR}/loop_call_test" \
+  tools/tests/loop_call_test.c \
+  core/loop.c core/timer.c core/thread.c core/event.c core/list.c core/log.c core/clock.c core/profile.c
+
+"${TMP_DIR}/loop_call_test" "${ROUNDS}"
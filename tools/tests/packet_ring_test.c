@@ -0,0 +1,259 @@
+/*
+ * modules/udp/packet_ring.c test: frame parser and BPF filter builder
+ *
+ * phase 1: IPv4/UDP parser: payload and destination, IP options,
+ *          fragments, truncated and non-UDP frames
+ * phase 2: filter for a list of destinations, run by a small classic BPF
+ *          interpreter: only listed address/port pairs pass, outgoing
+ *          copies and fragments are dropped, empty list drops all
+ * phase 3: list longer than BPF_MAXINSNS: the filter passes all UDP
+ *
+ * Build and run: tools/tests/packet_ring_test.sh
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include <linux/filter.h>
+#include <linux/if_packet.h>
+#include "modules/udp/packet_ring.h"
+
+static uint64_t errors = 0;
+
+static void check(const char *name, int64_t value, int64_t expected)
+{
+    if(value != expected)
+    {
+        printf("%s=%lld expected %lld\n", name, (long long)value, (long long)expected);
+        ++errors;
+    }
+}
+
+/* IPv4 + UDP, options - 32-bit words of IP options */
+static int frame(uint8_t *buf, const char *dst, uint16_t port, int payload, int options
+                 , uint8_t proto, uint16_t frag)
+{
+    const int ihl = 5 + options;
+    const int total = ihl * 4 + 8 + payload;
+    memset(buf, 0, (size_t)total);
+    buf[0] = (uint8_t)(0x40 | ihl);
+    buf[2] = (uint8_t)(total >> 8);
+    buf[3] = (uint8_t)total;
+    buf[6] = (uint8_t)(frag >> 8);
+    buf[7] = (uint8_t)frag;
+    buf[8] = 64;
+    buf[9] = proto;
+    const in_addr_t src = inet_addr("10.0.0.1");
+    const in_addr_t daddr = inet_addr(dst);
+    memcpy(buf + 12, &src, 4);
+    memcpy(buf + 16, &daddr, 4);
+    uint8_t *udp = buf + ihl * 4;
+    udp[0] = 0x12;
+    udp[1] = 0x34;
+    udp[2] = (uint8_t)(port >> 8);
+    udp[3] = (uint8_t)port;
+    udp[4] = (uint8_t)((8 + payload) >> 8);
+    udp[5] = (uint8_t)(8 + payload);
+    for(int i = 0; i < payload; ++i)
+        udp[8 + i] = (uint8_t)i;
+    return total;
+}
+
+static uint32_t load(const uint8_t *pkt, int len, uint32_t k, int size, bool *ok)
+{
+    if(k + (uint32_t)size > (uint32_t)len)
+    {
+        *ok = false;
+        return 0;
+    }
+    uint32_t v = 0;
+    for(int i = 0; i < size; ++i)
+        v = (v << 8) | pkt[k + (uint32_t)i];
+    return v;
+}
+
+/* the subset of classic BPF emitted by packet_ring_filter_build() */
+static uint32_t bpf_run(const struct sock_filter *code, int n, const uint8_t *pkt, int len, int pkttype)
+{
+    uint32_t a = 0;
+    uint32_t x = 0;
+    for(int pc = 0; pc < n; ++pc)
+    {
+        const struct sock_filter *f = &code[pc];
+        bool ok = true;
+        switch(f->code)
+        {
+            case BPF_LD | BPF_W | BPF_ABS:
+                if(f->k == (uint32_t)(SKF_AD_OFF + SKF_AD_PKTTYPE))
+                    a = (uint32_t)pkttype;
+                else
+                    a = load(pkt, len, f->k, 4, &ok);
+                break;
+            case BPF_LD | BPF_H | BPF_ABS:
+                a = load(pkt, len, f->k, 2, &ok);
+                break;
+            case BPF_LD | BPF_B | BPF_ABS:
+                a = load(pkt, len, f->k, 1, &ok);
+                break;
+            case BPF_LD | BPF_H | BPF_IND:
+                a = load(pkt, len, f->k + x, 2, &ok);
+                break;
+            case BPF_LDX | BPF_B | BPF_MSH:
+                x = (load(pkt, len, f->k, 1, &ok) & 0x0F) * 4;
+                break;
+            case BPF_JMP | BPF_JEQ | BPF_K:
+                pc += (a == f->k) ? f->jt : f->jf;
+                break;
+            case BPF_JMP | BPF_JSET | BPF_K:
+                pc += (a & f->k) ? f->jt : f->jf;
+                break;
+            case BPF_RET | BPF_K:
+                return f->k;
+            default:
+                printf("unknown opcode 0x%04x at %d\n", f->code, pc);
+                ++errors;
+                return 0;
+        }
+        if(!ok)
+            return 0; // like the kernel: out of bounds load drops
+        if(pc + 1 >= n)
+        {
+            printf("jump out of the program at %d\n", pc);
+            ++errors;
+            return 0;
+        }
+    }
+    return 0;
+}
+
+static void phase_parse(void)
+{
+    uint8_t buf[2048];
+    packet_ring_dst_t dst;
+    const uint8_t *payload = NULL;
+
+    int len = frame(buf, "239.1.1.1", 1234, 1316, 0, 17, 0);
+    check("parse.size", packet_ring_parse(buf, len, &dst, &payload), 1316);
+    check("parse.addr", dst.addr, inet_addr("239.1.1.1"));
+    check("parse.port", dst.port, 1234);
+    check("parse.payload", payload - buf, 28);
+    check("parse.payload[5]", payload[5], 5);
+
+    // padding after the datagram is ignored
+    check("parse.padded", packet_ring_parse(buf, len + 6, &dst, &payload), 1316);
+
+    len = frame(buf, "239.1.1.2", 5000, 188, 2, 17, 0);
+    check("parse.options.size", packet_ring_parse(buf, len, &dst, &payload), 188);
+    check("parse.options.payload", payload - buf, 36);
+    check("parse.options.port", dst.port, 5000);
+
+    len = frame(buf, "239.1.1.1", 1234, 1316, 0, 17, 0x2000); // MF
+    check("parse.fragment", packet_ring_parse(buf, len, &dst, &payload), -1);
+    len = frame(buf, "239.1.1.1", 1234, 1316, 0, 17, 0x00B9); // offset
+    check("parse.fragment_offset", packet_ring_parse(buf, len, &dst, &payload), -1);
+    len = frame(buf, "239.1.1.1", 1234, 1316, 0, 17, 0x4000); // DF only
+    check("parse.df", packet_ring_parse(buf, len, &dst, &payload), 1316);
+
+    len = frame(buf, "239.1.1.1", 1234, 1316, 0, 6, 0);
+    check("parse.tcp", packet_ring_parse(buf, len, &dst, &payload), -1);
+
+    len = frame(buf, "239.1.1.1", 1234, 1316, 0, 17, 0);
+    check("parse.truncated", packet_ring_parse(buf, len - 1, &dst, &payload), -1);
+    check("parse.short", packet_ring_parse(buf, 19, &dst, &payload), -1);
+
+    buf[24] = 0xFF; // UDP length beyond the IP datagram
+    check("parse.udp_length", packet_ring_parse(buf, len, &dst, &payload), -1);
+
+    len = frame(buf, "239.1.1.1", 1234, 1316, 0, 17, 0);
+    buf[0] = 0x65; // IPv6 version
+    check("parse.version", packet_ring_parse(buf, len, &dst, &payload), -1);
+}
+
+static void phase_filter(void)
+{
+    static struct sock_filter code[PACKET_RING_FILTER_MAX];
+    uint8_t buf[2048];
+    int len;
+
+    int n = packet_ring_filter_build(code, PACKET_RING_FILTER_MAX, NULL, 0);
+    check("filter.empty.size", n, 1);
+    len = frame(buf, "239.1.1.1", 1234, 1316, 0, 17, 0);
+    check("filter.empty", bpf_run(code, n, buf, len, PACKET_HOST) != 0, 0);
+
+    packet_ring_dst_t dst[3];
+    dst[0].addr = inet_addr("239.1.1.1");
+    dst[0].port = 1234;
+    dst[1].addr = inet_addr("239.1.1.2");
+    dst[1].port = 1234;
+    dst[2].addr = inet_addr("127.0.0.1");
+    dst[2].port = 19500;
+    n = packet_ring_filter_build(code, PACKET_RING_FILTER_MAX, dst, 3);
+    check("filter.size", n, 11 + 3 * 5 + 1);
+
+    len = frame(buf, "239.1.1.1", 1234, 1316, 0, 17, 0);
+    check("filter.dst0", bpf_run(code, n, buf, len, PACKET_HOST) != 0, 1);
+    check("filter.multicast", bpf_run(code, n, buf, len, PACKET_MULTICAST) != 0, 1);
+    check("filter.outgoing", bpf_run(code, n, buf, len, PACKET_OUTGOING) != 0, 0);
+    len = frame(buf, "239.1.1.2", 1234, 188, 0, 17, 0);
+    check("filter.dst1", bpf_run(code, n, buf, len, PACKET_HOST) != 0, 1);
+    len = frame(buf, "127.0.0.1", 19500, 1316, 0, 17, 0);
+    check("filter.dst2", bpf_run(code, n, buf, len, PACKET_HOST) != 0, 1);
+    len = frame(buf, "127.0.0.1", 19500, 1316, 3, 17, 0);
+    check("filter.options", bpf_run(code, n, buf, len, PACKET_HOST) != 0, 1);
+
+    len = frame(buf, "239.1.1.1", 1235, 1316, 0, 17, 0);
+    check("filter.port", bpf_run(code, n, buf, len, PACKET_HOST) != 0, 0);
+    len = frame(buf, "239.1.1.3", 1234, 1316, 0, 17, 0);
+    check("filter.addr", bpf_run(code, n, buf, len, PACKET_HOST) != 0, 0);
+    len = frame(buf, "239.1.1.2", 19500, 1316, 0, 17, 0); // addr of one, port of another
+    check("filter.cross", bpf_run(code, n, buf, len, PACKET_HOST) != 0, 0);
+    len = frame(buf, "239.1.1.1", 1234, 1316, 0, 6, 0);
+    check("filter.tcp", bpf_run(code, n, buf, len, PACKET_HOST) != 0, 0);
+    len = frame(buf, "239.1.1.1", 1234, 1316, 0, 17, 0x2000);
+    check("filter.fragment", bpf_run(code, n, buf, len, PACKET_HOST) != 0, 0);
+
+    check("filter.small", packet_ring_filter_build(code, 8, dst, 3), -1);
+}
+
+static void phase_overflow(void)
+{
+    static struct sock_filter code[PACKET_RING_FILTER_MAX];
+    static packet_ring_dst_t dst[1000];
+    uint8_t buf[2048];
+    char addr[32];
+
+    for(int i = 0; i < 1000; ++i)
+    {
+        snprintf(addr, sizeof(addr), "239.2.%d.%d", i / 250, i % 250 + 1);
+        dst[i].addr = inet_addr(addr);
+        dst[i].port = 1234;
+    }
+
+    int n = packet_ring_filter_build(code, PACKET_RING_FILTER_MAX, dst, 800);
+    check("overflow.800.size", n, 11 + 800 * 5 + 1);
+    int len = frame(buf, "239.2.3.50", 1234, 1316, 0, 17, 0); // 800th
+    check("overflow.800.last", bpf_run(code, n, buf, len, PACKET_HOST) != 0, 1);
+
+    n = packet_ring_filter_build(code, PACKET_RING_FILTER_MAX, dst, 1000);
+    check("overflow.1000.size", n, 12);
+    len = frame(buf, "239.9.9.9", 9999, 1316, 0, 17, 0);
+    check("overflow.any_udp", bpf_run(code, n, buf, len, PACKET_HOST) != 0, 1);
+    len = frame(buf, "239.9.9.9", 9999, 1316, 0, 6, 0);
+    check("overflow.tcp", bpf_run(code, n, buf, len, PACKET_HOST) != 0, 0);
+    check("overflow.outgoing", bpf_run(code, n, buf, len, PACKET_OUTGOING) != 0, 0);
+}
+
+int main(void)
+{
+    phase_parse();
+    phase_filter();
+    phase_overflow();
+
+    if(errors)
+    {
+        printf("FAIL: %llu errors\n", (unsigned long long)errors);
+        return 1;
+    }
+    printf("OK\n");
+    return 0;
+}
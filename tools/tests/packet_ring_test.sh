@@ -0,0 +1,34 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+# Test for modules/udp/packet_ring.c (AF_PACKET TPACKET_V3 ingest): IPv4/UDP
+# frame parser and the BPF filter built for a list of destinations.
+# Linux-only, does not open the ring itself (no CAP_NET_RAW needed).
+#
+# Usage:
+#   tools/tests/packet_ring_test.sh
+
+if [[ "$(uname -s)" != "Linux" ]]; then
+  echo "SKIP: packet_ring test is Linux-only"
+  exit 0
+fi
+
+ROOT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")/../.." && pwd)"
+
+CC="${CC:-cc}"
+
+if [[ ! -f "${ROOT_DIR}/config.h" ]]; then
+  echo "ERROR: config.h not found, run ./configure.sh first"
+  exit 1
+fi
+
+TMP_DIR="$(mktemp -d)"
+trap 'rm -rf "${TMP_DIR}"' EXIT
+
+cd "${ROOT_DIR}"
+"${CC}" -O2 -std=iso9899:1999 -D_GNU_SOURCE -DWITH_EPOLL=1 -Wall -Wextra -I. -pthread \
+  -o "${TMP_DIR}/packet_ring_test" \
+  tools/tests/packet_ring_test.c modules/udp/packet_ring.c \
+  core/log.c core/clock.c
+
+"${TMP_DIR}/packet_ring_test"
@@ -0,0 +1,168 @@
+/*
+ * core/profile.c test: callback profiler
+ *
+ * phase 1: every callback timed, owner callback with a nested stream
+ *          callback: self time of both, calls, packets, max
+ * phase 2: enable again with sample 4: counters of the previous run are
+ *          cleared, estimated time and calls
+ * phase 3: owner table: registered, removed and registered again owners
+ *
+ * Build and run: tools/tests/profile_test.sh
+ */
+
+#include <astra.h>
+#include <stdio.h>
+
+#define OWNERS 10000
+
+// core/loopctl.c is not linked (no Lua here)
+__thread bool is_main_loop_idle = true;
+
+void astra_abort(void)
+{
+    abort();
+}
+
+typedef struct
+{
+    asc_profile_t profile;
+    uint64_t spin_us;
+} test_owner_t;
+
+static test_owner_t owner_a;
+static test_owner_t owner_b; // stream child, not in the owner table
+static test_owner_t owners[OWNERS];
+
+static uint64_t errors = 0;
+
+static void spin(uint64_t usec)
+{
+    const uint64_t start = asc_utime();
+    while(asc_utime() - start < usec)
+        ;
+}
+
+static void on_b(void)
+{
+    spin(owner_b.spin_us);
+}
+
+static void on_a(void *arg)
+{
+    test_owner_t *owner = (test_owner_t *)arg;
+    spin(owner->spin_us);
+
+    asc_profile_frame_t frame;
+    asc_profile_enter(&frame);
+    on_b();
+    asc_profile_leave(&frame, &owner_b.profile, 7);
+}
+
+static void on_owner(void *arg)
+{
+    __uarg(arg);
+}
+
+static void check_range(const char *name, uint64_t value, uint64_t min, uint64_t max)
+{
+    if(value < min || value > max)
+    {
+        printf("%s=%llu expected %llu..%llu\n", name, (unsigned long long)value
+               , (unsigned long long)min, (unsigned long long)max);
+        ++errors;
+    }
+}
+
+static void run(size_t count)
+{
+    for(size_t i = 0; i < count; ++i)
+        asc_profile_call(on_a, &owner_a);
+}
+
+int main(void)
+{
+    asc_profile_register(&owner_a, &owner_a.profile);
+
+    /* phase 1: every callback */
+    asc_profile_set(true, 1);
+    owner_a.spin_us = 2000;
+    owner_b.spin_us = 1000;
+    run(50);
+
+    asc_profile_t a, b;
+    asc_profile_read(&owner_a.profile, &a);
+    asc_profile_read(&owner_b.profile, &b);
+    printf("sample=1 a: calls=%llu cpu_ns=%llu max_ns=%llu b: calls=%llu packets=%llu cpu_ns=%llu\n"
+           , (unsigned long long)a.calls, (unsigned long long)a.cpu_ns
+           , (unsigned long long)a.max_ns, (unsigned long long)b.calls
+           , (unsigned long long)b.packets, (unsigned long long)b.cpu_ns);
+
+    // wall clock spin: preemption makes it longer, never shorter
+    check_range("a.cpu_ns", a.cpu_ns, 95000000, 150000000);
+    check_range("b.cpu_ns", b.cpu_ns, 47500000, 75000000);
+    check_range("a.max_ns", a.max_ns, 1900000, 50000000);
+    check_range("a.calls", a.calls, 50, 50);
+    check_range("b.calls", b.calls, 50, 50);
+    check_range("b.packets", b.packets, 350, 350);
+
+    /* phase 2: sample 4 */
+    asc_profile_set(false, 0);
+    asc_profile_set(true, 4);
+    asc_profile_read(&owner_a.profile, &a);
+    check_range("cleared a.calls", a.calls, 0, 0);
+    check_range("cleared a.cpu_ns", a.cpu_ns, 0, 0);
+
+    owner_a.spin_us = 200;
+    owner_b.spin_us = 100;
+    run(400);
+
+    asc_profile_read(&owner_a.profile, &a);
+    asc_profile_read(&owner_b.profile, &b);
+    printf("sample=4 a: calls=%llu cpu_ns=%llu b: calls=%llu packets=%llu cpu_ns=%llu\n"
+           , (unsigned long long)a.calls, (unsigned long long)a.cpu_ns
+           , (unsigned long long)b.calls, (unsigned long long)b.packets
+           , (unsigned long long)b.cpu_ns);
+
+    check_range("a.cpu_ns", a.cpu_ns, 76000000, 120000000);
+    check_range("b.cpu_ns", b.cpu_ns, 38000000, 60000000);
+    // owner calls are counted by samples, stream calls are exact
+    check_range("a.calls", a.calls, 400, 400);
+    check_range("b.calls", b.calls, 400, 400);
+    check_range("b.packets", b.packets, 2800, 2800);
+
+    /* phase 3: owner table */
+    asc_profile_set(false, 0);
+    asc_profile_set(true, 1);
+    for(size_t i = 0; i < OWNERS; ++i)
+        asc_profile_register(&owners[i], &owners[i].profile);
+    for(size_t i = 0; i < OWNERS; i += 2)
+        asc_profile_unregister(&owners[i]);
+    for(size_t i = 0; i < OWNERS; i += 4)
+        asc_profile_register(&owners[i], &owners[i].profile);
+
+    for(size_t i = 0; i < OWNERS; ++i)
+        asc_profile_call(on_owner, &owners[i]);
+
+    size_t wrong = 0;
+    for(size_t i = 0; i < OWNERS; ++i)
+    {
+        asc_profile_t p;
+        asc_profile_read(&owners[i].profile, &p);
+        const bool is_registered = (i % 2) == 1 || (i % 4) == 0;
+        if(p.calls != (is_registered ? 1U : 0U))
+            ++wrong;
+    }
+    if(wrong)
+    {
+        printf("owner table: %zu owners with wrong calls\n", wrong);
+        ++errors;
+    }
+
+    for(size_t i = 0; i < OWNERS; ++i)
+        asc_profile_unregister(&owners[i]);
+    asc_profile_unregister(&owner_a);
+    asc_profile_set(false, 0);
+
+    printf("%s\n", errors ? "FAILED" : "OK");
+    return errors ? 1 : 0;
+}
@@ -0,0 +1,28 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+# Test for core/profile.c (callback profiler): self time of nested callbacks,
+# sampling, counters cleared on enable, owner table with removed entries.
+#
+# Usage:
+#   tools/tests/profile_test.sh
+
+ROOT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")/../.." && pwd)"
+
+CC="${CC:-cc}"
+
+if [[ ! -f "${ROOT_DIR}/config.h" ]]; then
+  echo "ERROR: config.h not found, run ./configure.sh first"
+  exit 1
+fi
+
+TMP_DIR="$(mktemp -d)"
+trap 'rm -rf "${TMP_DIR}"' EXIT
+
+cd "${ROOT_DIR}"
+"${CC}" -O2 -std=iso9899:1999 -D_GNU_SOURCE -I. -pthread \
+  -o "${TMP_DIR}/profile_test" \
+  tools/tests/profile_test.c \
+  core/profile.c core/log.c core/clock.c
+
+"${TMP_DIR}/profile_test"
@@ -0,0 +1,249 @@
+/*
+ * modules/udp/rtp_fec.c test: SMPTE 2022-1 FEC loopback with injected loss
+ *
+ * phase 1: vectorized XOR against the byte loop, "LxD" parsing
+ * phase 2: 2D 5x10, no loss: every packet released once, in order
+ * phase 3: 2D 5x10 over the sequence wrap: single losses, a burst of a row,
+ *          two losses of a column rebuilt through the rows, lost FEC packets,
+ *          shorter payloads; recovered packets are byte-exact
+ * phase 4: columns only 4x4: a burst of L is recovered, L + 1 is not
+ * phase 5: reordered packets are released in order, restart is a resync
+ *
+ * Build and run: tools/tests/rtp_fec_test.sh
+ */
+
+#include <stdio.h>
+#include "modules/udp/rtp_fec.h"
+
+static uint64_t errors = 0;
+
+static void check(const char *name, uint64_t value, uint64_t expected)
+{
+    if(value != expected)
+    {
+        printf("%s=%llu expected %llu\n", name, (unsigned long long)value
+               , (unsigned long long)expected);
+        ++errors;
+    }
+}
+
+/* payload of the packet n: 7 TS, every 9th packet is shorter */
+static size_t media_build(uint8_t *packet, uint16_t seq)
+{
+    const size_t size = (seq % 9 == 0) ? 3 * TS_PACKET_SIZE : 7 * TS_PACKET_SIZE;
+    const uint32_t ts = (uint32_t)seq * 900;
+    packet[0] = 0x80;
+    packet[1] = 33;
+    packet[2] = (uint8_t)(seq >> 8);
+    packet[3] = (uint8_t)seq;
+    packet[4] = (uint8_t)(ts >> 24);
+    packet[5] = (uint8_t)(ts >> 16);
+    packet[6] = (uint8_t)(ts >> 8);
+    packet[7] = (uint8_t)ts;
+    packet[8] = packet[9] = packet[10] = packet[11] = 0x17;
+    for(size_t i = 0; i < size; ++i)
+        packet[12 + i] = (uint8_t)(seq * 31 + i * 7 + (i >> 8));
+    return 12 + size;
+}
+
+static struct
+{
+    uint16_t expected;
+    uint64_t released;
+    uint64_t mismatch;
+} out;
+
+static void on_media(void *arg, const uint8_t *packet, size_t size)
+{
+    (void)arg;
+    uint8_t original[RTP_FEC_RTP_SIZE + RTP_FEC_PAYLOAD_MAX];
+    const uint16_t seq = (uint16_t)((packet[2] << 8) | packet[3]);
+    if(seq != out.expected)
+    {
+        // a packet declared unrecoverable is skipped
+        while(out.expected != seq)
+            ++out.expected;
+    }
+    const size_t original_size = media_build(original, seq);
+    if(size != original_size || memcmp(packet, original, size) != 0)
+    {
+        if(out.mismatch == 0)
+            printf("mismatch at seq %u, size %zu expected %zu\n", seq, size, original_size);
+        ++out.mismatch;
+    }
+    ++out.expected;
+    ++out.released;
+}
+
+static bool lost_in(uint16_t seq, const uint16_t *lost, int count)
+{
+    for(int i = 0; i < count; ++i)
+    {
+        if(lost[i] == seq)
+            return true;
+    }
+    return false;
+}
+
+/* encoder -> loss -> decoder, FEC packets follow the media packet that completes them */
+static void run(rtp_fec_decoder_t *dec, int cols, int rows, bool row, uint16_t first, int count
+                , const uint16_t *lost, int lost_count, int fec_drop_every)
+{
+    static rtp_fec_encoder_t enc;
+    rtp_fec_encoder_init(&enc, cols, rows, row);
+    uint8_t packet[RTP_FEC_RTP_SIZE + RTP_FEC_PAYLOAD_MAX];
+    int fec_index = 0;
+
+    for(int i = 0; i < count; ++i)
+    {
+        const uint16_t seq = (uint16_t)(first + i);
+        const size_t size = media_build(packet, seq);
+        const int n = rtp_fec_encode(&enc, packet, &packet[RTP_FEC_RTP_SIZE], size - RTP_FEC_RTP_SIZE);
+        if(!lost_in(seq, lost, lost_count))
+            rtp_fec_decoder_media(dec, packet, size);
+        for(int k = 0; k < n; ++k, ++fec_index)
+        {
+            if(fec_drop_every > 0 && fec_index % fec_drop_every == fec_drop_every - 1)
+                continue;
+            rtp_fec_decoder_fec(dec, enc.out[k].data, enc.out[k].size);
+        }
+    }
+}
+
+static void test_xor(void)
+{
+    uint8_t a[300], b[300], c[300];
+    for(size_t size = 0; size < 200; ++size)
+    {
+        for(size_t off = 0; off < 5; ++off)
+        {
+            for(size_t i = 0; i < sizeof(a); ++i)
+            {
+                a[i] = (uint8_t)(i * 13 + size);
+                b[i] = (uint8_t)(i * 29 + off);
+            }
+            memcpy(c, a, sizeof(c));
+            for(size_t i = 0; i < size; ++i)
+                c[off + i] ^= b[off + 1 + i];
+            rtp_fec_xor(&a[off], &b[off + 1], size);
+            if(memcmp(a, c, sizeof(a)) != 0)
+            {
+                printf("xor mismatch size=%zu off=%zu\n", size, off);
+                ++errors;
+                return;
+            }
+        }
+    }
+
+    int cols = 0, rows = 0;
+    check("parse 5x10", rtp_fec_parse("5x10", &cols, &rows) && cols == 5 && rows == 10, 1);
+    check("parse 20x5", rtp_fec_parse("20x5", &cols, &rows), 1);
+    check("parse 20x6", rtp_fec_parse("20x6", &cols, &rows), 0);
+    check("parse 5x3", rtp_fec_parse("5x3", &cols, &rows), 0);
+    check("parse 5x", rtp_fec_parse("5x", &cols, &rows), 0);
+    check("parse 5", rtp_fec_parse("5", &cols, &rows), 0);
+}
+
+int main(void)
+{
+    static rtp_fec_decoder_t dec;
+
+    /* phase 1 */
+    test_xor();
+
+    /* phase 2 */
+    memset(&out, 0, sizeof(out));
+    out.expected = 1000;
+    rtp_fec_decoder_init(&dec, on_media, NULL);
+    run(&dec, 5, 10, true, 1000, 3000, NULL, 0, 0);
+    check("p2.released", out.released, 3000);
+    check("p2.mismatch", out.mismatch, 0);
+    check("p2.media", dec.media, 3000);
+    check("p2.fec_column", dec.fec[RTP_FEC_COLUMN], 3000 / 10);
+    check("p2.fec_row", dec.fec[RTP_FEC_ROW], 3000 / 5);
+    check("p2.columns", (uint64_t)dec.cols, 5);
+    check("p2.rows", (uint64_t)dec.rows, 10);
+    check("p2.recovered", dec.recovered, 0);
+    check("p2.unrecoverable", dec.unrecoverable, 0);
+
+    /* phase 3: the stream starts at 65000, matrix of 50 */
+    static const uint16_t lost3[] =
+    {
+        65010, // single
+        65100, 65101, 65102, 65103, 65104, // a row: the columns
+        65205, 65215, // two of a column: the rows
+        65499, 65535, 0, 1, // over the wrap: 65535 and 0 in the same row
+        300, 311, 322, 333, // a diagonal
+        405, // shorter payload (405 % 9 == 0)
+    };
+    const int lost3_count = (int)(sizeof(lost3) / sizeof(lost3[0]));
+    memset(&out, 0, sizeof(out));
+    out.expected = 65000;
+    rtp_fec_decoder_init(&dec, on_media, NULL);
+    run(&dec, 5, 10, true, 65000, 2000, lost3, lost3_count, 0);
+    check("p3.released", out.released, 2000);
+    check("p3.mismatch", out.mismatch, 0);
+    check("p3.recovered", dec.recovered, (uint64_t)lost3_count);
+    check("p3.unrecoverable", dec.unrecoverable, 0);
+    check("p3.resyncs", dec.resyncs, 0);
+
+    /* phase 3: every 7th FEC packet is lost too, single losses remain recoverable by 2D */
+    static const uint16_t lost3b[] = { 20, 133, 246, 359, 472, 585 };
+    memset(&out, 0, sizeof(out));
+    out.expected = 0;
+    rtp_fec_decoder_init(&dec, on_media, NULL);
+    run(&dec, 5, 10, true, 0, 1000, lost3b, 6, 7);
+    check("p3b.released", out.released, 1000);
+    check("p3b.mismatch", out.mismatch, 0);
+    check("p3b.recovered", dec.recovered, 6);
+    check("p3b.unrecoverable", dec.unrecoverable, 0);
+
+    /* phase 4: columns only */
+    static const uint16_t lost4[] = { 100, 101, 102, 103, 200, 201, 202, 203, 204 };
+    memset(&out, 0, sizeof(out));
+    out.expected = 0;
+    rtp_fec_decoder_init(&dec, on_media, NULL);
+    run(&dec, 4, 4, false, 0, 600, lost4, 9, 0);
+    check("p4.fec_row", dec.fec[RTP_FEC_ROW], 0);
+    check("p4.mismatch", out.mismatch, 0);
+    // 200 and 204 share a column: both lost
+    check("p4.recovered", dec.recovered, 7);
+    check("p4.unrecoverable", dec.unrecoverable, 2);
+    check("p4.released", out.released, 600 - 2);
+
+    /* phase 5: after a FEC stream pairs are swapped, then the source restarts */
+    memset(&out, 0, sizeof(out));
+    out.expected = 0;
+    rtp_fec_decoder_init(&dec, on_media, NULL);
+    run(&dec, 5, 10, true, 0, 500, NULL, 0, 0);
+    {
+        uint8_t a[RTP_FEC_RTP_SIZE + RTP_FEC_PAYLOAD_MAX];
+        uint8_t b[RTP_FEC_RTP_SIZE + RTP_FEC_PAYLOAD_MAX];
+        for(uint16_t seq = 500; seq < 700; seq += 2)
+        {
+            const size_t sa = media_build(a, seq);
+            const size_t sb = media_build(b, (uint16_t)(seq + 1));
+            rtp_fec_decoder_media(&dec, b, sb);
+            rtp_fec_decoder_media(&dec, a, sa);
+            rtp_fec_decoder_media(&dec, a, sa);
+        }
+        check("p5.released", out.released, 700);
+        check("p5.duplicates", dec.duplicates, 100);
+        check("p5.mismatch", out.mismatch, 0);
+
+        out.expected = 30000;
+        for(uint16_t seq = 30000; seq < 30010; ++seq)
+            rtp_fec_decoder_media(&dec, a, media_build(a, seq));
+        check("p5.resyncs", dec.resyncs, 1);
+        check("p5.released_after", out.released, 710);
+        check("p5.unrecoverable", dec.unrecoverable, 0);
+    }
+
+    if(errors)
+    {
+        printf("FAIL: %llu errors\n", (unsigned long long)errors);
+        return 1;
+    }
+    printf("OK\n");
+    return 0;
+}
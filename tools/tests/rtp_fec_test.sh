@@ -0,0 +1,30 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+# Test for modules/udp/rtp_fec.c (SMPTE 2022-1 FEC): encoder -> loss ->
+# decoder loopback, recovered packets, unrecoverable losses, reorder and resync.
+#
+# Usage:
+#   tools/tests/rtp_fec_test.sh
+
+ROOT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")/../.." && pwd)"
+
+CC="${CC:-cc}"
+
+if [[ ! -f "${ROOT_DIR}/config.h" ]]; then
+  echo "ERROR: config.h not found, run ./configure.sh first"
+  exit 1
+fi
+
+TMP_DIR="$(mktemp -d)"
+trap 'rm -rf "${TMP_DIR}"' EXIT
+
+cd "${ROOT_DIR}"
+"${CC}" -O2 -std=iso9899:1999 -D_GNU_SOURCE -Wall -Wextra -I. -pthread \
+  -o "${TMP_DIR}/rtp_fec_test" \
+  tools/tests/rtp_fec_test.c modules/udp/rtp_fec.c \
+  lua/lapi.c lua/lcode.c lua/lctype.c lua/ldebug.c lua/ldo.c lua/ldump.c lua/lfunc.c \
+  lua/lgc.c lua/llex.c lua/lmem.c lua/lobject.c lua/lopcodes.c lua/lparser.c lua/lstate.c \
+  lua/lstring.c lua/ltable.c lua/ltm.c lua/lundump.c lua/lvm.c lua/lzio.c -lm
+
+"${TMP_DIR}/rtp_fec_test"
@@ -0,0 +1,119 @@
+/*
+ * modules/udp/rtp_merge.c test: SMPTE 2022-7 seamless merge
+ *
+ * phase 1: two legs, leg 1 delayed: every sequence number forwarded once,
+ *          duplicates and skew of the delayed leg
+ * phase 2: losses on one leg are taken from the other, the loss on both
+ *          legs is the loss of the merged stream, sequence wrap
+ * phase 3: leg behind the window is dropped as late, restarted sequence
+ *          on all legs is a resync
+ *
+ * Build and run: tools/tests/rtp_merge_test.sh
+ */
+
+#include <stdio.h>
+#include "modules/udp/rtp_merge.h"
+
+static uint64_t errors = 0;
+
+static void check(const char *name, uint64_t value, uint64_t expected)
+{
+    if(value != expected)
+    {
+        printf("%s=%llu expected %llu\n", name, (unsigned long long)value
+               , (unsigned long long)expected);
+        ++errors;
+    }
+}
+
+static void check_range(const char *name, uint64_t value, uint64_t min, uint64_t max)
+{
+    if(value < min || value > max)
+    {
+        printf("%s=%llu expected %llu..%llu\n", name, (unsigned long long)value
+               , (unsigned long long)min, (unsigned long long)max);
+        ++errors;
+    }
+}
+
+/* leg 1 lags by `delay` datagrams, 1 ms per datagram */
+static uint64_t run(rtp_merge_t *merge, uint16_t first, int count, int delay
+                    , const uint16_t *lost0, int lost0_count
+                    , const uint16_t *lost1, int lost1_count)
+{
+    uint64_t forwarded = 0;
+    for(int i = 0; i < count + delay; ++i)
+    {
+        const uint64_t now_us = 1000000 + (uint64_t)i * 1000;
+        if(i < count)
+        {
+            const uint16_t seq = (uint16_t)(first + i);
+            bool drop = false;
+            for(int n = 0; n < lost0_count; ++n)
+                drop = drop || lost0[n] == seq;
+            if(!drop && rtp_merge_accept(merge, 0, seq, now_us))
+                ++forwarded;
+        }
+        if(i >= delay)
+        {
+            const uint16_t seq = (uint16_t)(first + i - delay);
+            bool drop = false;
+            for(int n = 0; n < lost1_count; ++n)
+                drop = drop || lost1[n] == seq;
+            if(!drop && rtp_merge_accept(merge, 1, seq, now_us))
+                ++forwarded;
+        }
+    }
+    return forwarded;
+}
+
+int main(void)
+{
+    static rtp_merge_t merge;
+
+    /* phase 1 */
+    rtp_merge_init(&merge, 2, 300);
+    check("window", (uint64_t)merge.window, 512);
+
+    check("forwarded", run(&merge, 1000, 2000, 5, NULL, 0, NULL, 0), 2000);
+    check("leg0.forwarded", merge.leg[0].forwarded, 2000);
+    check("leg1.duplicates", merge.leg[1].duplicates, 2000);
+    check("leg1.skew_us", merge.leg[1].skew_us, 5000);
+    check("leg1.skew_max_us", merge.leg[1].skew_max_us, 5000);
+    check("leg0.skew_us", merge.leg[0].skew_us, 0);
+    check("lost", merge.lost, 0);
+
+    /* phase 2: over the wrap */
+    rtp_merge_init(&merge, 2, 512);
+    static const uint16_t lost0[] = { 65530, 65531, 65532, 2, 3, 100 };
+    static const uint16_t lost1[] = { 7, 100, 101 };
+    check("forwarded", run(&merge, 65000, 1200, 3, lost0, 6, lost1, 3), 1199);
+    check("leg0.lost", merge.leg[0].lost, 6);
+    check("leg1.lost", merge.leg[1].lost, 3);
+    check("leg0.forwarded", merge.leg[0].forwarded, 1200 - 6);
+    check("leg1.forwarded", merge.leg[1].forwarded, 5);
+    check("recovered", merge.recovered, 5);
+    check("lost", merge.lost, 1);
+    check("resyncs", merge.resyncs, 0);
+
+    /* phase 3: leg 1 lags by more than the window */
+    rtp_merge_init(&merge, 2, 64);
+    check("forwarded", run(&merge, 0, 500, 100, NULL, 0, NULL, 0), 500);
+    // the tail of leg 1 behind the stopped leg 0 is inside the window again
+    check("leg1.late", merge.leg[1].late, 500 - 64);
+    check("leg1.duplicates", merge.leg[1].duplicates, 64);
+    check("leg1.forwarded", merge.leg[1].forwarded, 0);
+    check("resyncs", merge.resyncs, 0);
+
+    // both legs restart the sequence behind the window
+    rtp_merge_init(&merge, 2, 64);
+    check("forwarded", run(&merge, 20000, 300, 2, NULL, 0, NULL, 0), 300);
+    const uint64_t forwarded = run(&merge, 5000, 300, 2, NULL, 0, NULL, 0);
+    check("resyncs", merge.resyncs, 1);
+    // datagrams before the resync are dropped, behind it the lagging leg 1 fills the gap
+    check_range("forwarded after restart", forwarded, 300 - 32, 299);
+    check_range("leg1.forwarded", merge.leg[1].forwarded, 1, 32);
+
+    printf("%s\n", errors ? "FAILED" : "OK");
+    return errors ? 1 : 0;
+}
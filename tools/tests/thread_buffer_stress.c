@@ -0,0 +1,353 @@
+/*
+ * asc_thread_buffer_t stress test
+ *
+ * One writer thread and one reader thread hammer the SPSC ring with
+ * random chunk sizes, mixing write()/reserve+commit on the writer and
+ * read()/peek+consume on the reader.
+ *
+ * phase 1: byte stream, the reader checks every byte (no loss allowed)
+ * phase 2: TS packets, the writer flushes on overflow (as udp_output does),
+ *          the reader checks that packets are intact and ordered
+ * phase 3: same as phase 2, but the reader copies packets out with read(),
+ *          which keeps the cached head between calls
+ *
+ * Build and run: tools/tests/thread_buffer_stress.sh
+ */
+
+#include <astra.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+
+typedef struct
+{
+    asc_thread_buffer_t *buffer;
+    size_t buffer_size;
+    uint64_t total;
+    uint32_t seed;
+    volatile int done;
+
+    uint64_t errors;
+    uint64_t received;
+    uint64_t flushes;
+    uint64_t gaps;
+} stress_t;
+
+// core/loopctl.c is not linked (no Lua here)
+__thread bool is_main_loop_idle = true;
+
+void astra_abort(void)
+{
+    abort();
+}
+
+static uint32_t stress_rand(uint32_t *seed)
+{
+    *seed ^= *seed << 13;
+    *seed ^= *seed >> 17;
+    *seed ^= *seed << 5;
+    return *seed;
+}
+
+static uint8_t stream_byte(uint64_t pos)
+{
+    return (uint8_t)((pos * 2654435761u) >> 13);
+}
+
+/*
+ * phase 1: byte stream
+ */
+
+static void * stream_writer(void *arg)
+{
+    stress_t *st = (stress_t *)arg;
+    uint32_t seed = st->seed;
+    uint64_t pos = 0;
+    uint8_t chunk[4096];
+
+    while(pos < st->total)
+    {
+        size_t size = 1 + stress_rand(&seed) % sizeof(chunk);
+        if(size > st->total - pos)
+            size = (size_t)(st->total - pos);
+
+        if(stress_rand(&seed) & 1)
+        {
+            for(size_t i = 0; i < size; ++i)
+                chunk[i] = stream_byte(pos + i);
+            if(asc_thread_buffer_write(st->buffer, chunk, size) == (ssize_t)size)
+                pos += size;
+            else
+                sched_yield();
+        }
+        else
+        {
+            uint8_t *ptr = NULL;
+            size_t space = asc_thread_buffer_reserve(st->buffer, &ptr);
+            if(space > size)
+                space = size;
+            for(size_t i = 0; i < space; ++i)
+                ptr[i] = stream_byte(pos + i);
+            asc_thread_buffer_commit(st->buffer, space);
+            pos += space;
+            if(!space)
+                sched_yield();
+        }
+    }
+
+    __atomic_store_n(&st->done, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+static void * stream_reader(void *arg)
+{
+    stress_t *st = (stress_t *)arg;
+    uint32_t seed = st->seed * 7 + 1;
+    uint64_t pos = 0;
+    uint8_t chunk[4096];
+
+    while(pos < st->total)
+    {
+        if(stress_rand(&seed) & 1)
+        {
+            const size_t size = 1 + stress_rand(&seed) % sizeof(chunk);
+            const ssize_t r = asc_thread_buffer_read(st->buffer, chunk, size);
+            for(ssize_t i = 0; i < r; ++i)
+            {
+                if(chunk[i] != stream_byte(pos + i))
+                    ++st->errors;
+            }
+            if(r > 0)
+                pos += r;
+            else
+                sched_yield();
+        }
+        else
+        {
+            const uint8_t *ptr = NULL;
+            size_t size = asc_thread_buffer_peek(st->buffer, &ptr);
+            const size_t limit = 1 + stress_rand(&seed) % sizeof(chunk);
+            if(size > limit)
+                size = limit;
+            for(size_t i = 0; i < size; ++i)
+            {
+                if(ptr[i] != stream_byte(pos + i))
+                    ++st->errors;
+            }
+            asc_thread_buffer_consume(st->buffer, size);
+            pos += size;
+            if(!size)
+                sched_yield();
+        }
+    }
+
+    st->received = pos;
+    return NULL;
+}
+
+/*
+ * phase 2: TS packets with flush on overflow
+ */
+
+static void packet_fill(uint8_t *ts, uint64_t seq)
+{
+    ts[0] = 0x47;
+    memcpy(&ts[4], &seq, sizeof(seq));
+    for(size_t i = 12; i < TS_PACKET_SIZE; ++i)
+        ts[i] = stream_byte(seq + i);
+}
+
+static bool packet_check(const uint8_t *ts, uint64_t *seq)
+{
+    if(ts[0] != 0x47)
+        return false;
+    memcpy(seq, &ts[4], sizeof(*seq));
+    for(size_t i = 12; i < TS_PACKET_SIZE; ++i)
+    {
+        if(ts[i] != stream_byte(*seq + i))
+            return false;
+    }
+    return true;
+}
+
+static void * packet_writer(void *arg)
+{
+    stress_t *st = (stress_t *)arg;
+    uint32_t seed = st->seed;
+    uint8_t block[TS_PACKET_SIZE * 7];
+
+    for(uint64_t seq = 0; seq < st->total;)
+    {
+        const size_t count = 1 + stress_rand(&seed) % 7;
+        for(size_t i = 0; i < count; ++i)
+            packet_fill(&block[i * TS_PACKET_SIZE], seq + i);
+
+        const size_t size = count * TS_PACKET_SIZE;
+        if(asc_thread_buffer_write(st->buffer, block, size) != (ssize_t)size)
+        {
+            asc_thread_buffer_flush(st->buffer);
+            ++st->flushes;
+            sched_yield();
+        }
+        seq += count;
+
+        // let the reader run on a single core as well
+        if((stress_rand(&seed) & 0x7) == 0)
+            sched_yield();
+    }
+
+    __atomic_store_n(&st->done, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+static void * packet_reader(void *arg)
+{
+    stress_t *st = (stress_t *)arg;
+    uint32_t seed = st->seed * 7 + 1;
+    uint64_t next = 0;
+
+    while(true)
+    {
+        const int done = __atomic_load_n(&st->done, __ATOMIC_ACQUIRE);
+
+        const uint8_t *ptr = NULL;
+        size_t size = asc_thread_buffer_peek(st->buffer, &ptr);
+        if(!size)
+        {
+            if(done && asc_thread_buffer_count(st->buffer) == 0)
+                break;
+            sched_yield();
+            continue;
+        }
+
+        if(size % TS_PACKET_SIZE)
+            ++st->errors;
+
+        size -= size % TS_PACKET_SIZE;
+        const size_t limit = (1 + stress_rand(&seed) % 64) * TS_PACKET_SIZE;
+        if(size > limit)
+            size = limit;
+
+        for(size_t i = 0; i < size; i += TS_PACKET_SIZE)
+        {
+            uint64_t seq = 0;
+            if(!packet_check(&ptr[i], &seq) || seq < next)
+                ++st->errors;
+            else if(seq > next)
+                ++st->gaps;
+            next = seq + 1;
+            ++st->received;
+        }
+        asc_thread_buffer_consume(st->buffer, size);
+
+        // slow reader from time to time to provoke overflows
+        if((stress_rand(&seed) & 0xFFF) == 0)
+            asc_usleep(200);
+    }
+
+    return NULL;
+}
+
+/*
+ * phase 3: TS packets with flush on overflow, reader uses read()
+ */
+
+static void * packet_copy_reader(void *arg)
+{
+    stress_t *st = (stress_t *)arg;
+    uint32_t seed = st->seed * 7 + 1;
+    uint64_t next = 0;
+    uint8_t block[TS_PACKET_SIZE * 64];
+
+    while(true)
+    {
+        const int done = __atomic_load_n(&st->done, __ATOMIC_ACQUIRE);
+
+        const size_t limit = (1 + stress_rand(&seed) % 64) * TS_PACKET_SIZE;
+        const ssize_t size = asc_thread_buffer_read(st->buffer, block, limit);
+        if(size <= 0)
+        {
+            if(done && asc_thread_buffer_count(st->buffer) == 0)
+                break;
+            sched_yield();
+            continue;
+        }
+
+        if(size % TS_PACKET_SIZE
+           || asc_thread_buffer_count(st->buffer) > st->buffer_size)
+        {
+            ++st->errors;
+        }
+
+        for(ssize_t i = 0; i + TS_PACKET_SIZE <= size; i += TS_PACKET_SIZE)
+        {
+            uint64_t seq = 0;
+            if(!packet_check(&block[i], &seq) || seq < next)
+                ++st->errors;
+            else if(seq > next)
+                ++st->gaps;
+            next = seq + 1;
+            ++st->received;
+        }
+
+        // slow reader from time to time to provoke overflows
+        if((stress_rand(&seed) & 0xFFF) == 0)
+            asc_usleep(200);
+    }
+
+    return NULL;
+}
+
+static bool run(const char *name, void *(*writer)(void *), void *(*reader)(void *)
+                , size_t buffer_size, uint64_t total, uint32_t seed)
+{
+    stress_t st;
+    memset(&st, 0, sizeof(st));
+    st.buffer = asc_thread_buffer_init(buffer_size);
+    st.buffer_size = buffer_size;
+    st.total = total;
+    st.seed = seed;
+
+    pthread_t w, r;
+    const uint64_t start = asc_utime();
+    pthread_create(&r, NULL, reader, &st);
+    pthread_create(&w, NULL, writer, &st);
+    pthread_join(w, NULL);
+    pthread_join(r, NULL);
+    const uint64_t elapsed = asc_utime() - start;
+
+    asc_thread_buffer_destroy(st.buffer);
+
+    printf("%s buffer=%zu received=%" PRIu64 " flushes=%" PRIu64 " gaps=%" PRIu64
+           " errors=%" PRIu64 " time=%" PRIu64 "ms\n"
+           , name, buffer_size, st.received, st.flushes, st.gaps, st.errors
+           , elapsed / 1000);
+
+    return st.errors == 0;
+}
+
+int main(int argc, char **argv)
+{
+    uint64_t total = 200 * 1024 * 1024;
+    if(argc > 1)
+        total = strtoull(argv[1], NULL, 10);
+
+    bool ok = true;
+
+    // odd sizes: offsets wrap at every possible position
+    ok &= run("stream", stream_writer, stream_reader, 4093, total, 1);
+    ok &= run("stream", stream_writer, stream_reader, 1024 * 1024 + 7, total, 2);
+
+    ok &= run("packet", packet_writer, packet_reader, TS_PACKET_SIZE * 64
+              , total / TS_PACKET_SIZE, 3);
+    ok &= run("packet", packet_writer, packet_reader, TS_PACKET_SIZE * 4096
+              , total / TS_PACKET_SIZE, 4);
+
+    ok &= run("read", packet_writer, packet_copy_reader, TS_PACKET_SIZE * 64
+              , total / TS_PACKET_SIZE, 5);
+    ok &= run("read", packet_writer, packet_copy_reader, TS_PACKET_SIZE * 4096
+              , total / TS_PACKET_SIZE, 6);
+
+    printf("%s\n", ok ? "OK" : "FAILED");
+    return ok ? 0 : 1;
+}
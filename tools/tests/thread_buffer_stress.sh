@@ -0,0 +1,38 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+# Stress test for asc_thread_buffer_t (lock-free SPSC ring):
+# writer/reader threads with random chunk sizes, write()/reserve+commit,
+# read()/peek+consume, flush on overflow.
+#
+# Usage:
+#   tools/tests/thread_buffer_stress.sh
+#   TOTAL_BYTES=2000000000 tools/tests/thread_buffer_stress.sh
+#   SANITIZE=thread tools/tests/thread_buffer_stress.sh
+
+ROOT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")/../.." && pwd)"
+
+CC="${CC:-cc}"
+TOTAL_BYTES="${TOTAL_BYTES:-200000000}"
+SANITIZE="${SANITIZE:-}"
+
+if [[ ! -f "${ROOT_DIR}/config.h" ]]; then
+  echo "ERROR: config.h not found, run ./configure.sh first"
+  exit 1
+fi
+
+EXTRA_CFLAGS=()
+if [[ -n "${SANITIZE}" ]]; then
+  EXTRA_CFLAGS+=("-fsanitize=${SANITIZE}" "-g")
+fi
+
+TMP_DIR="$(mktemp -d)"
+trap 'rm -rf "${TMP_DIR}"' EXIT
+
+cd "${ROOT_DIR}"
+"${CC}" -O2 -std=iso9899:1999 -D_GNU_SOURCE -DWITH_EPOLL=1 -I. -pthread ${EXTRA_CFLAGS[@]+"${EXTRA_CFLAGS[@]}"} \
+  -o "${TMP_DIR}/thread_buffer_stress" \
+  tools/tests/thread_buffer_stress.c \
+  core/thread.c core/event.c core/list.c core/log.c core/clock.c core/profile.c
+
+"${TMP_DIR}/thread_buffer_stress" "${TOTAL_BYTES}"
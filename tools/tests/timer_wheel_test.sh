@@ -0,0 +1,30 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+# Test for core/timer.c (timing wheel + heap): deadlines, cancel in callback,
+# far-future timers, asc_timer_core_next_shot(), per-callback accounting.
+#
+# Usage:
+#   tools/tests/timer_wheel_test.sh
+#   DURATION_MS=20000 tools/tests/timer_wheel_test.sh
+
+ROOT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")/../.." && pwd)"
+
+CC="${CC:-cc}"
+DURATION_MS="${DURATION_MS:-5000}"
+
+if [[ ! -f "${ROOT_DIR}/config.h" ]]; then
+  echo "ERROR: config.h not found, run ./configure.sh first"
+  exit 1
+fi
+
+TMP_DIR="$(mktemp -d)"
+trap 'rm -rf "${TMP_DIR}"' EXIT
+
+cd "${ROOT_DIR}"
+"${CC}" -O2 -std=iso9899:1999 -D_GNU_SOURCE -I. -pthread \
+  -o "${TMP_DIR}/timer_wheel_test" \
+  tools/tests/timer_wheel_test.c \
+  core/timer.c core/list.c core/log.c core/clock.c core/profile.c
+
+"${TMP_DIR}/timer_wheel_test" "${DURATION_MS}"
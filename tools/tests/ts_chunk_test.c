@@ -0,0 +1,246 @@
+/*
+ * modules/astra/ts_chunk.c test: TS chunk pool and zero-copy dispatch
+ *
+ * phase 1: pool: chunks allocated on one thread are released on others,
+ *          all chunks are returned, slabs are reused, high water
+ * phase 2: ingest chunk: children of the stream and the children of the
+ *          nested stream reference the packets in place, no copies
+ * phase 3: packets without a chunk are copied once per dispatch for all
+ *          children, the copy is released when the children release it
+ *
+ * Build and run: tools/tests/ts_chunk_test.sh
+ */
+
+#include <astra.h>
+#include <pthread.h>
+#include <stdio.h>
+
+#define THREADS 4
+#define ROUNDS 200000
+#define CHILDS 3
+
+struct module_data_t
+{
+    MODULE_STREAM_DATA();
+
+    module_stream_t *forward; // nested stream: the child sends the packets further
+    ts_chunk_t *chunk;
+    const uint8_t *data;
+};
+
+// core/loopctl.c is not linked (no Lua here)
+__thread bool is_main_loop_idle = true;
+
+void astra_abort(void)
+{
+    abort();
+}
+
+// modules/astra/module_lua.c is not linked, instances are not listed
+const char *module_lua_type = NULL;
+
+bool module_option_string(const char *name, const char **string, size_t *length)
+{
+    __uarg(name);
+    __uarg(string);
+    __uarg(length);
+    return false;
+}
+
+static uint64_t errors = 0;
+
+static void check(const char *name, uint64_t value, uint64_t expected)
+{
+    if(value != expected)
+    {
+        printf("%s=%llu expected %llu\n", name, (unsigned long long)value
+               , (unsigned long long)expected);
+        ++errors;
+    }
+}
+
+/* phase 1 */
+
+typedef struct
+{
+    ts_chunk_t *volatile slot[64];
+} exchange_t;
+
+static exchange_t exchange[THREADS];
+
+static void * pool_thread(void *arg)
+{
+    const int id = (int)(intptr_t)arg;
+    exchange_t *const own = &exchange[id];
+    exchange_t *const next = &exchange[(id + 1) % THREADS];
+
+    for(int i = 0; i < ROUNDS; ++i)
+    {
+        const size_t size = (i % 3 == 0) ? TS_CHUNK_LARGE_SIZE : 7 * TS_PACKET_SIZE;
+        ts_chunk_t *chunk = ts_chunk_alloc(size);
+        memset(chunk->data, id, size);
+        chunk->size = (uint32_t)size;
+
+        // the next thread releases it
+        ts_chunk_t *prev = __atomic_exchange_n(&next->slot[i % 64], chunk, __ATOMIC_ACQ_REL);
+        if(prev)
+            ts_chunk_unref(prev);
+
+        // released by the previous thread, the data is intact
+        ts_chunk_t *own_chunk = __atomic_exchange_n(&own->slot[(i * 7) % 64], NULL, __ATOMIC_ACQ_REL);
+        if(own_chunk)
+        {
+            if(own_chunk->data[own_chunk->size - 1] != own_chunk->data[0])
+                __atomic_add_fetch(&errors, 1, __ATOMIC_RELAXED);
+            ts_chunk_unref(own_chunk);
+        }
+    }
+    return NULL;
+}
+
+/* phase 2, 3 */
+
+static void on_ts_batch(module_data_t *mod, const uint8_t *ts, size_t count)
+{
+    if(mod->chunk)
+        ts_chunk_unref(mod->chunk);
+    mod->chunk = module_stream_chunk(ts, count, &mod->data);
+    if(memcmp(mod->data, ts, count * TS_PACKET_SIZE) != 0)
+        ++errors;
+
+    if(mod->forward)
+        __module_stream_send_batch(mod->forward, ts, count);
+}
+
+static void on_ts(module_data_t *mod, const uint8_t *ts)
+{
+    on_ts_batch(mod, ts, 1);
+}
+
+static void child_init(module_data_t *mod, module_stream_t *parent)
+{
+    memset(mod, 0, sizeof(*mod));
+    mod->__stream.self = mod;
+    mod->__stream.on_ts = on_ts;
+    mod->__stream.on_ts_batch = on_ts_batch;
+    __module_stream_init(&mod->__stream);
+    __module_stream_attach(parent, &mod->__stream);
+}
+
+static void child_release(module_data_t *mod)
+{
+    if(mod->chunk)
+        ts_chunk_unref(mod->chunk);
+    mod->chunk = NULL;
+    mod->data = NULL;
+}
+
+int main(void)
+{
+    /* phase 1 */
+    pthread_t threads[THREADS];
+    for(int i = 0; i < THREADS; ++i)
+        pthread_create(&threads[i], NULL, pool_thread, (void *)(intptr_t)i);
+    for(int i = 0; i < THREADS; ++i)
+        pthread_join(threads[i], NULL);
+    for(int i = 0; i < THREADS; ++i)
+    {
+        for(int n = 0; n < 64; ++n)
+        {
+            if(exchange[i].slot[n])
+                ts_chunk_unref(exchange[i].slot[n]);
+        }
+    }
+
+    ts_chunk_stats_t stats;
+    ts_chunk_stats(&stats);
+    printf("pool allocs=%llu slabs=%llu chunks=%llu high_water=%llu bytes=%llu\n"
+           , (unsigned long long)stats.allocs, (unsigned long long)stats.slabs
+           , (unsigned long long)stats.chunks, (unsigned long long)stats.high_water
+           , (unsigned long long)stats.bytes);
+    check("pool in_use", stats.in_use, 0);
+    check("pool allocs", stats.allocs, (uint64_t)THREADS * ROUNDS);
+    // at most 64 chunks per exchange and one per thread in the hands
+    if(stats.high_water > THREADS * 64 + THREADS || stats.high_water < THREADS)
+    {
+        printf("pool high_water=%llu\n", (unsigned long long)stats.high_water);
+        ++errors;
+    }
+    if(stats.chunks > (THREADS * 64 + THREADS) * 2 + 2 * 64)
+    {
+        printf("pool chunks=%llu: slabs are not reused\n", (unsigned long long)stats.chunks);
+        ++errors;
+    }
+
+    /* phase 2 */
+    module_stream_t parent;
+    memset(&parent, 0, sizeof(parent));
+    __module_stream_init(&parent);
+
+    module_stream_t nested;
+    memset(&nested, 0, sizeof(nested));
+    __module_stream_init(&nested);
+
+    static module_data_t childs[CHILDS];
+    static module_data_t grandchild;
+    for(int i = 0; i < CHILDS; ++i)
+        child_init(&childs[i], &parent);
+    childs[0].forward = &nested;
+    child_init(&grandchild, &nested);
+
+    ts_chunk_t *ingest = ts_chunk_alloc(TS_CHUNK_SMALL_SIZE);
+    for(size_t i = 0; i < 7 * TS_PACKET_SIZE; ++i)
+        ingest->data[12 + i] = (uint8_t)i;
+    ingest->size = 12 + 7 * TS_PACKET_SIZE; // RTP header in front of the packets
+
+    __module_stream_send_chunk(&parent, ingest, &ingest->data[12], 7);
+
+    for(int i = 0; i < CHILDS; ++i)
+    {
+        check("ingest chunk", childs[i].chunk == ingest, 1);
+        check("ingest data", childs[i].data == &ingest->data[12], 1);
+    }
+    check("ingest nested chunk", grandchild.chunk == ingest, 1);
+    check("ingest refcount", ingest->refcount, 1 + CHILDS + 1);
+
+    for(int i = 0; i < CHILDS; ++i)
+        child_release(&childs[i]);
+    child_release(&grandchild);
+    check("ingest released", ingest->refcount, 1);
+    ts_chunk_unref(ingest);
+
+    /* phase 3 */
+    static uint8_t ts[7 * TS_PACKET_SIZE];
+    for(size_t i = 0; i < sizeof(ts); ++i)
+        ts[i] = (uint8_t)(i * 3);
+
+    __module_stream_send_batch(&parent, ts, 7);
+    __module_stream_send_batch(&parent, ts, 7);
+
+    ts_chunk_t *const copy = childs[0].chunk;
+    for(int i = 1; i < CHILDS; ++i)
+    {
+        check("copy shared chunk", childs[i].chunk == copy, 1);
+        check("copy shared data", childs[i].data == childs[0].data, 1);
+    }
+    // the nested level has its own copy
+    check("copy nested", grandchild.chunk == copy && grandchild.data == childs[0].data, 0);
+    check("copy data", memcmp(childs[0].data, ts, sizeof(ts)), 0);
+
+    for(int i = 0; i < CHILDS; ++i)
+        child_release(&childs[i]);
+    child_release(&grandchild);
+
+    // the writer chunk of the thread stays open
+    ts_chunk_stats(&stats);
+    check("in_use", stats.in_use, 1);
+
+    for(int i = 0; i < CHILDS; ++i)
+        __module_stream_destroy(&childs[i].__stream);
+    __module_stream_destroy(&grandchild.__stream);
+    __module_stream_destroy(&nested);
+    __module_stream_destroy(&parent);
+
+    printf("%s\n", errors ? "FAILED" : "OK");
+    return errors ? 1 : 0;
+}
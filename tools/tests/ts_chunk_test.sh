@@ -0,0 +1,31 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+# Test for modules/astra/ts_chunk.c (TS chunk pool): chunks released on other
+# threads, slab reuse, references to the ingest chunk and the copy shared by
+# the children of the dispatch.
+#
+# Usage:
+#   tools/tests/ts_chunk_test.sh
+
+ROOT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")/../.." && pwd)"
+
+CC="${CC:-cc}"
+
+if [[ ! -f "${ROOT_DIR}/config.h" ]]; then
+  echo "ERROR: config.h not found, run ./configure.sh first"
+  exit 1
+fi
+
+TMP_DIR="$(mktemp -d)"
+trap 'rm -rf "${TMP_DIR}"' EXIT
+
+cd "${ROOT_DIR}"
+"${CC}" -O2 -std=iso9899:1999 -D_GNU_SOURCE -DWITH_EPOLL=1 -I. -pthread \
+  -o "${TMP_DIR}/ts_chunk_test" \
+  tools/tests/ts_chunk_test.c \
+  modules/astra/module_stream.c modules/astra/ts_chunk.c \
+  core/loop.c core/thread.c core/event.c core/timer.c \
+  core/list.c core/log.c core/clock.c core/profile.c
+
+"${TMP_DIR}/ts_chunk_test"
@@ -0,0 +1,237 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+# Linux-only smoke test: SMPTE 2022-1 FEC (#fec=LxD у rtp output, #fec у rtp input).
+# - fec_tx: udp вход -> rtp://...#fec=5x10: FEC колонок на порт +2, строк на +4
+#   (legacy udp_output, udp_output с #sync через пул пейсинга, udp_relay в dataplane auto)
+# - прокси теряет каждую 37-ю медиа датаграмму, FEC пропускает без потерь
+# - fec_rx: rtp вход с #fec -> udp выход: все TS по порядку без пропусков,
+#   fec в /api/v1/stream-status/fec_rx: recovered = потерям, unrecoverable = 0,
+#   у fec_tx отправленные FEC пакеты (outputs_status[].fec или dataplane.fec)
+
+if [[ "$(uname -s)" != "Linux" ]]; then
+  echo "SKIP: udp fec smoke test is Linux-only"
+  exit 0
+fi
+
+ROOT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")/../.." && pwd)"
+
+HTTP_PORT=19600
+IN_PORT=19610
+TX_PORT=19620 # +2, +4 - FEC
+RX_PORT=19630 # +2, +4 - FEC после прокси
+OUT_PORT=19640
+
+STREAM_BIN="${ROOT_DIR}/stream"
+if [[ ! -x "${STREAM_BIN}" ]]; then
+  echo "ERROR: stream binary not found/executable: ${STREAM_BIN}"
+  exit 1
+fi
+
+TMP_DIR=""
+STREAM_PID=""
+
+cleanup() {
+  if [[ -n "${STREAM_PID}" ]]; then
+    kill "${STREAM_PID}" 2>/dev/null || true
+    wait "${STREAM_PID}" 2>/dev/null || true
+    STREAM_PID=""
+  fi
+}
+trap 'cleanup; [[ -n "${TMP_DIR}" ]] && rm -rf "${TMP_DIR}"' EXIT
+
+TMP_DIR="$(mktemp -d)"
+
+run_mode() {
+  local mode="$1"
+  local dataplane="off"
+  local tx_opts="fec=5x10"
+  if [[ "${mode}" == "auto" ]]; then
+    # fec_tx уходит в udp_relay, fec_rx (#fec) остаётся в legacy pipeline
+    dataplane="auto"
+  elif [[ "${mode}" == "sync" ]]; then
+    tx_opts="fec=5x10&sync=1"
+  fi
+  local cfg="${TMP_DIR}/udp_fec_${mode}.json"
+
+  cat >"${cfg}" <<EOF_CFG
+{
+  "settings": {
+    "http_auth_enabled": false,
+    "http_play_allow": false,
+
+    "performance_passthrough_dataplane": "${dataplane}",
+    "performance_passthrough_workers": 1
+  },
+  "make_stream": [
+    { "id": "fec_tx", "type": "udp", "enable": true,
+      "input": [ "udp://127.0.0.1:${IN_PORT}" ], "output": [ "rtp://127.0.0.1:${TX_PORT}#${tx_opts}" ] },
+    { "id": "fec_rx", "type": "udp", "enable": true,
+      "input": [ "rtp://127.0.0.1:${RX_PORT}#fec" ], "output": [ "udp://127.0.0.1:${OUT_PORT}" ] }
+  ]
+}
+EOF_CFG
+
+  "${STREAM_BIN}" scripts/server.lua -a 127.0.0.1 -p "${HTTP_PORT}" \
+    --config "${cfg}" \
+    --data-dir "${TMP_DIR}/data_${mode}" \
+    --log "${TMP_DIR}/stream_${mode}.log" \
+    --no-stdout &
+  STREAM_PID=$!
+
+  for _ in $(seq 1 80); do
+    if curl -fsS "http://127.0.0.1:${HTTP_PORT}/" >/dev/null 2>&1; then
+      break
+    fi
+    sleep 0.2
+  done
+
+  MODE="${mode}" python3 - <<PY
+import json, os, socket, struct, sys, threading, time, urllib.request
+
+MODE = os.environ["MODE"]
+HTTP_PORT = ${HTTP_PORT}
+IN_PORT = ${IN_PORT}
+TX_PORT = ${TX_PORT}
+RX_PORT = ${RX_PORT}
+OUT_PORT = ${OUT_PORT}
+
+BITRATE = 8000000
+TS_PER_SEC = BITRATE // (8 * 188)
+PCR_EVERY = TS_PER_SEC * 40 // 1000
+DURATION = 4.0
+PID = 0x100
+DROP_EVERY = 37
+DROP_UNTIL = 1500 # хвост без потерь: последние матрицы доходят целиком
+
+def pcr_bytes(n):
+    base = n * 188 * 8 * 90000 // BITRATE
+    ext = (n * 188 * 8 * 27000000 // BITRATE) % 300
+    return struct.pack("!IH", (base >> 1) & 0xFFFFFFFF, ((base & 1) << 15) | 0x7E00 | ext)
+
+def ts(n):
+    # номер пакета в payload - проверка порядка на выходе
+    if n % PCR_EVERY == 0:
+        head = bytes([0x47, PID >> 8, PID & 0xFF, 0x30 | (n & 0x0F), 7, 0x10]) + pcr_bytes(n)
+    else:
+        head = bytes([0x47, PID >> 8, PID & 0xFF, 0x10 | (n & 0x0F)])
+    return head + struct.pack("!I", n) + b"\xff" * (184 - len(head))
+
+done = False
+stats = {"media": 0, "dropped": 0, "fec": 0}
+received = []
+
+def proxy(offset):
+    s = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    s.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, 8 << 20)
+    s.bind(("127.0.0.1", TX_PORT + offset))
+    s.settimeout(0.2)
+    out = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    while True:
+        try:
+            d = s.recv(2048)
+        except socket.timeout:
+            if done:
+                return
+            continue
+        if offset == 0:
+            stats["media"] += 1
+            if stats["media"] <= DROP_UNTIL and stats["media"] % DROP_EVERY == 0:
+                stats["dropped"] += 1
+                continue
+        else:
+            stats["fec"] += 1
+        out.sendto(d, ("127.0.0.1", RX_PORT + offset))
+
+def sink():
+    s = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    s.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, 8 << 20)
+    s.bind(("127.0.0.1", OUT_PORT))
+    s.settimeout(0.2)
+    while True:
+        try:
+            received.append(s.recv(2048))
+        except socket.timeout:
+            if done:
+                return
+
+threads = [threading.Thread(target=proxy, args=(o,)) for o in (0, 2, 4)]
+threads.append(threading.Thread(target=sink))
+for t in threads:
+    t.start()
+time.sleep(0.2)
+
+src = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+n = 0
+start = time.monotonic()
+while time.monotonic() - start < DURATION:
+    for _ in range(10):
+        src.sendto(b"".join(ts(k) for k in range(n, n + 7)), ("127.0.0.1", IN_PORT))
+        n += 7
+    time.sleep(max(0.0, start + n / TS_PER_SEC - time.monotonic()))
+sent = n
+time.sleep(1.0)
+
+def status(name):
+    with urllib.request.urlopen("http://127.0.0.1:%d/api/v1/stream-status/%s" % (HTTP_PORT, name), timeout=3) as r:
+        st = json.loads(r.read().decode())
+    return st.get("status") or st
+
+try:
+    tx = status("fec_tx")
+    rx = status("fec_rx")
+finally:
+    done = True
+    for t in threads:
+        t.join()
+
+errors = []
+numbers = []
+for d in received:
+    for off in range(0, len(d), 188):
+        pkt = d[off:off + 188]
+        af = 1 + pkt[4] if pkt[3] & 0x20 else 0
+        numbers.append(struct.unpack("!I", pkt[4 + af:8 + af])[0])
+if not numbers or numbers != list(range(numbers[0], numbers[0] + len(numbers))):
+    errors.append("output: TS out of order or lost (%d TS)" % len(numbers))
+# sync: хвост остаётся в буфере синхронизации
+if len(numbers) < (sent // 2 if MODE == "sync" else sent):
+    errors.append("output: %d TS of %d" % (len(numbers), sent))
+
+if stats["dropped"] == 0 or stats["fec"] == 0:
+    errors.append("proxy: %r" % stats)
+fec = rx.get("fec") or {}
+if rx.get("dataplane"):
+    errors.append("fec_rx is on the dataplane")
+if fec.get("recovered") != stats["dropped"] or fec.get("unrecoverable") != 0:
+    errors.append("fec_rx: recovered=%r unrecoverable=%r dropped=%d"
+                  % (fec.get("recovered"), fec.get("unrecoverable"), stats["dropped"]))
+if fec.get("columns") != 5 or fec.get("rows") != 10:
+    errors.append("fec_rx: matrix %rx%r" % (fec.get("columns"), fec.get("rows")))
+
+if MODE == "auto":
+    tx_fec = ((tx.get("dataplane") or {}).get("fec") or [{}])[0]
+else:
+    if tx.get("dataplane"):
+        errors.append("fec_tx is on the dataplane")
+    tx_fec = ((tx.get("outputs_status") or [{}])[0]).get("fec") or {}
+if not tx_fec.get("column_packets") or not tx_fec.get("row_packets") or tx_fec.get("send_errors"):
+    errors.append("fec_tx: %r" % tx_fec)
+
+if errors:
+    for e in errors:
+        print("ERROR [%s]:" % MODE, e)
+    sys.exit(1)
+print("OK [%s]: %d TS, dropped=%d recovered=%d, fec sent column=%d row=%d"
+      % (MODE, len(numbers), stats["dropped"], fec.get("recovered"),
+         tx_fec.get("column_packets"), tx_fec.get("row_packets")))
+PY
+
+  cleanup
+}
+
+run_mode off
+run_mode sync
+run_mode auto
+
+echo "OK"
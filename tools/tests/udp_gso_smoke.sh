@@ -0,0 +1,203 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+# Linux-only smoke test: UDP_GRO на входе и UDP_SEGMENT (GSO) на выходе.
+# Прогон в dataplane (udp_relay) и в legacy pipeline (udp_input/udp_output):
+# - источник шлёт серии по 8 датаграмм одним GSO sendmsg, вход с gro=1 принимает серию
+#   одним буфером и режет её обратно
+# - udp и rtp выходы с gso=1: получатели без GRO видят все датаграммы по порядку
+# - dataplane: ingest.gro, gro_coalesced > 0, gso.active=1, gso.sends > 0,
+#   tx_syscalls меньше datagrams_out в /api/v1/stream-status/<id>
+# Ядро без UDP_SEGMENT/UDP_GRO - SKIP.
+
+if [[ "$(uname -s)" != "Linux" ]]; then
+  echo "SKIP: udp gso smoke test is Linux-only"
+  exit 0
+fi
+
+if ! python3 - <<'PY' 2>/dev/null
+import socket
+s = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+s.getsockopt(socket.SOL_UDP, 103)
+s.setsockopt(socket.SOL_UDP, 104, 1)
+PY
+then
+  echo "SKIP: UDP_SEGMENT/UDP_GRO are not supported by kernel"
+  exit 0
+fi
+
+ROOT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")/../.." && pwd)"
+
+HTTP_PORT=19520
+IN_PORT_A=19530
+IN_PORT_B=19531
+OUT_PORT_A=19532
+OUT_PORT_B=19533
+
+STREAM_BIN="${ROOT_DIR}/stream"
+if [[ ! -x "${STREAM_BIN}" ]]; then
+  echo "ERROR: stream binary not found/executable: ${STREAM_BIN}"
+  exit 1
+fi
+
+TMP_DIR=""
+STREAM_PID=""
+
+cleanup() {
+  if [[ -n "${STREAM_PID}" ]]; then
+    kill "${STREAM_PID}" 2>/dev/null || true
+    wait "${STREAM_PID}" 2>/dev/null || true
+    STREAM_PID=""
+  fi
+}
+trap 'cleanup; [[ -n "${TMP_DIR}" ]] && rm -rf "${TMP_DIR}"' EXIT
+
+TMP_DIR="$(mktemp -d)"
+
+run_mode() {
+  local mode="$1"
+  local cfg="${TMP_DIR}/udp_gso_${mode}.json"
+
+  cat >"${cfg}" <<EOF_CFG
+{
+  "settings": {
+    "http_auth_enabled": false,
+    "http_play_allow": false,
+
+    "performance_passthrough_dataplane": "${mode}",
+    "performance_passthrough_workers": 1,
+    "performance_udp_gro": true,
+    "performance_udp_gso": true
+  },
+  "make_stream": [
+    { "id": "gso_a", "type": "udp", "enable": true,
+      "input": [ "udp://127.0.0.1:${IN_PORT_A}" ], "output": [ "udp://127.0.0.1:${OUT_PORT_A}" ] },
+    { "id": "gso_b", "type": "udp", "enable": true,
+      "input": [ "rtp://127.0.0.1:${IN_PORT_B}" ], "output": [ "rtp://127.0.0.1:${OUT_PORT_B}" ] }
+  ]
+}
+EOF_CFG
+
+  "${STREAM_BIN}" scripts/server.lua -a 127.0.0.1 -p "${HTTP_PORT}" \
+    --config "${cfg}" \
+    --data-dir "${TMP_DIR}/data_${mode}" \
+    --log "${TMP_DIR}/stream_${mode}.log" \
+    --no-stdout &
+  STREAM_PID=$!
+
+  for _ in $(seq 1 80); do
+    if curl -fsS "http://127.0.0.1:${HTTP_PORT}/" >/dev/null 2>&1; then
+      break
+    fi
+    sleep 0.2
+  done
+
+  MODE="${mode}" python3 - <<PY
+import json, os, socket, struct, sys, threading, time, urllib.request
+
+MODE = os.environ["MODE"]
+HTTP_PORT = ${HTTP_PORT}
+IN = {"gso_a": ${IN_PORT_A}, "gso_b": ${IN_PORT_B}}
+OUTS = {"gso_a": ${OUT_PORT_A}, "gso_b": ${OUT_PORT_B}}
+OUT_RTP = {"gso_a": False, "gso_b": True}
+SOL_UDP = 17
+UDP_SEGMENT = 103
+
+N = 800
+RUN = 8
+
+def ts(n):
+    out = b""
+    for i in range(7):
+        out += bytes([0x47, 0x01, 0x00, 0x10 | ((n * 7 + i) & 0x0F)]) + struct.pack("!I", n) + b"\xff" * 180
+    return out
+
+def rtp(n):
+    return struct.pack("!BBHII", 0x80, 33, n & 0xFFFF, n * 3000, 0x1717) + ts(n)
+
+done = False
+received = {}
+
+def drain(name, port):
+    s = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    s.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, 4 << 20)
+    s.bind(("127.0.0.1", port))
+    s.settimeout(0.2)
+    skip = 12 if OUT_RTP[name] else 0
+    res = received.setdefault(name, [])
+    while True:
+        try:
+            d = s.recv(2048)
+            res.append((len(d) - skip, struct.unpack("!I", d[skip + 4:skip + 8])[0]))
+        except socket.timeout:
+            if done:
+                return
+readers = [threading.Thread(target=drain, args=(k, v)) for k, v in OUTS.items()]
+for t in readers:
+    t.start()
+time.sleep(0.2)
+
+src = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+for n in range(0, N, RUN):
+    run_a = b"".join(ts(k) for k in range(n, n + RUN))
+    run_b = b"".join(rtp(k) for k in range(n, n + RUN))
+    src.sendmsg([run_a], [(SOL_UDP, UDP_SEGMENT, struct.pack("=H", 1316))], 0, ("127.0.0.1", IN["gso_a"]))
+    src.sendmsg([run_b], [(SOL_UDP, UDP_SEGMENT, struct.pack("=H", 1328))], 0, ("127.0.0.1", IN["gso_b"]))
+    time.sleep(0.004)
+
+time.sleep(1.0)
+done = True
+for t in readers:
+    t.join()
+
+errors = []
+for name in OUTS:
+    got = received.get(name, [])
+    if [x[1] for x in got] != list(range(N)):
+        errors.append("%s: %d datagrams, expected %d in order" % (name, len(got), N))
+    elif any(x[0] != 1316 for x in got):
+        errors.append("%s: payload sizes %r" % (name, sorted(set(x[0] for x in got))))
+
+summary = []
+for name in OUTS:
+    with urllib.request.urlopen("http://127.0.0.1:%d/api/v1/stream-status/%s" % (HTTP_PORT, name), timeout=3) as r:
+        status = json.loads(r.read().decode())
+    st = status.get("status") or status
+    if MODE != "force":
+        if st.get("dataplane"):
+            errors.append("%s is on the dataplane" % name)
+        continue
+    dp = st.get("dataplane") or {}
+    ingest = dp.get("ingest") or {}
+    gso = dp.get("gso") or {}
+    if ingest.get("gro") is not True or not ingest.get("gro_coalesced"):
+        errors.append("%s: ingest=%r" % (name, ingest))
+    if ingest.get("datagrams") != N or dp.get("datagrams_out") != N:
+        errors.append("%s: ingest.datagrams=%r datagrams_out=%r" % (name, ingest.get("datagrams"), dp.get("datagrams_out")))
+    if gso.get("active") != 1 or not gso.get("sends") or gso.get("fallbacks") != 0:
+        errors.append("%s: gso=%r" % (name, gso))
+    if not dp.get("tx_syscalls") or dp["tx_syscalls"] * 2 > N:
+        errors.append("%s: tx_syscalls=%r for %d datagrams" % (name, dp.get("tx_syscalls"), N))
+    summary.append("%s reads=%s tx_syscalls=%s gso.sends=%s"
+                   % (name, ingest.get("reads"), dp.get("tx_syscalls"), gso.get("sends")))
+
+if errors:
+    for e in errors:
+        print("ERROR [%s]:" % MODE, e)
+    sys.exit(1)
+print("OK [%s]: %d datagrams x %d streams %s" % (MODE, N, len(OUTS), "; ".join(summary)))
+PY
+
+  if grep -q "GSO send failed\|not supported by kernel\|not supported on this platform" "${TMP_DIR}/stream_${mode}.log"; then
+    echo "ERROR [${mode}]: GSO/GRO fallback in the log"
+    grep "GSO\|GRO\|UDP_SEGMENT" "${TMP_DIR}/stream_${mode}.log" || true
+    exit 1
+  fi
+
+  cleanup
+}
+
+run_mode force
+run_mode off
+
+echo "OK"
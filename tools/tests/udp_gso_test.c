@@ -0,0 +1,194 @@
+/*
+ * modules/udp/udp_gso.c test: UDP_SEGMENT send and UDP_GRO receive on loopback
+ *
+ * phase 1: segments per send for TS datagram sizes
+ * phase 2: one GSO send of a run (the last datagram shorter): a socket
+ *          without UDP_GRO receives every datagram, a socket with UDP_GRO
+ *          receives the run in one buffer, split by the UDP_GRO segment
+ * phase 3: a run over the segment limit of the kernel is refused,
+ *          udp_gso_unsupported() tells to send it without GSO
+ *
+ * Phases 2 and 3 are skipped on kernels without UDP_SEGMENT or UDP_GRO.
+ *
+ * Build and run: tools/tests/udp_gso_test.sh
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include "modules/udp/udp_gso.h"
+
+#define RUN 10 // full datagrams of the run
+#define SEGMENT 1316
+#define TAIL 500
+
+static uint64_t errors = 0;
+
+static void check(const char *name, int64_t value, int64_t expected)
+{
+    if(value != expected)
+    {
+        printf("%s=%lld expected %lld\n", name, (long long)value, (long long)expected);
+        ++errors;
+    }
+}
+
+static int udp_socket(struct sockaddr_in *sa)
+{
+    const int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    memset(sa, 0, sizeof(*sa));
+    sa->sin_family = AF_INET;
+    sa->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(*sa);
+    if(fd < 0 || bind(fd, (struct sockaddr *)sa, sizeof(*sa)) != 0
+       || getsockname(fd, (struct sockaddr *)sa, &len) != 0)
+    {
+        printf("socket: %s\n", strerror(errno));
+        ++errors;
+    }
+    struct timeval tv = { 1, 0 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    return fd;
+}
+
+/* RUN datagrams of SEGMENT and one of TAIL, byte 0 - index */
+static int send_run(int fd, const struct sockaddr_in *dst, int count, size_t segment, size_t tail)
+{
+    static uint8_t data[(RUN + 1) * SEGMENT];
+    static struct iovec iov[256];
+    for(int i = 0; i < count; ++i)
+    {
+        iov[i].iov_base = &data[(size_t)i * segment % sizeof(data)];
+        iov[i].iov_len = (tail && i == count - 1) ? tail : segment;
+    }
+    for(int i = 0; i < count && i <= RUN; ++i)
+    {
+        memset(&data[(size_t)i * segment], 0x47, segment);
+        data[(size_t)i * segment] = (uint8_t)i;
+    }
+
+    uint8_t cmsg[UDP_GSO_CMSG_SIZE];
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name = (void *)dst;
+    msg.msg_namelen = sizeof(*dst);
+    msg.msg_iov = iov;
+    msg.msg_iovlen = (size_t)count;
+    udp_gso_set(&msg, cmsg, (uint16_t)segment);
+    return (int)sendmsg(fd, &msg, 0);
+}
+
+static void phase_segments(void)
+{
+    check("segments.1316", udp_gso_segments(1316), 49);
+    check("segments.1328", udp_gso_segments(1328), 49);
+    check("segments.188", udp_gso_segments(188), UDP_GSO_SEGMENTS_MAX);
+    check("segments.0", udp_gso_segments(0), 1);
+    check("segments.huge", udp_gso_segments(70000), 1);
+}
+
+static void phase_loopback(int tx)
+{
+    struct sockaddr_in plain_sa;
+    struct sockaddr_in gro_sa;
+    const int plain = udp_socket(&plain_sa);
+    const int gro = udp_socket(&gro_sa);
+    if(!udp_gro_set(gro, true))
+    {
+        printf("SKIP: UDP_GRO is not supported\n");
+        close(plain);
+        close(gro);
+        return;
+    }
+
+    const int total = RUN * SEGMENT + TAIL;
+    check("send.plain", send_run(tx, &plain_sa, RUN + 1, SEGMENT, TAIL), total);
+    check("send.gro", send_run(tx, &gro_sa, RUN + 1, SEGMENT, TAIL), total);
+
+    // without UDP_GRO the kernel segments the run on receive
+    static uint8_t buf[UDP_GRO_BUFFER_SIZE];
+    for(int i = 0; i <= RUN; ++i)
+    {
+        const ssize_t len = recv(plain, buf, sizeof(buf), 0);
+        check("plain.size", len, (i == RUN) ? TAIL : SEGMENT);
+        check("plain.index", buf[0], i);
+    }
+
+    // with UDP_GRO: whole runs, split by the segment size
+    int datagrams = 0;
+    int buffers = 0;
+    while(datagrams <= RUN)
+    {
+        uint8_t cmsg[UDP_GRO_CMSG_SIZE];
+        struct iovec iov = { buf, sizeof(buf) };
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = cmsg;
+        msg.msg_controllen = sizeof(cmsg);
+        const ssize_t len = recvmsg(gro, &msg, 0);
+        if(len <= 0)
+        {
+            printf("gro.recv: %s\n", strerror(errno));
+            ++errors;
+            break;
+        }
+        ++buffers;
+        int segment = udp_gro_segment(&msg);
+        if(segment <= 0 || segment >= len)
+            segment = (int)len;
+        for(int off = 0; off < len; off += segment, ++datagrams)
+        {
+            const int size = ((int)len - off < segment) ? (int)len - off : segment;
+            check("gro.size", size, (datagrams == RUN) ? TAIL : SEGMENT);
+            check("gro.index", buf[off], datagrams);
+        }
+    }
+    check("gro.datagrams", datagrams, RUN + 1);
+    check("gro.buffers", buffers, 1);
+
+    close(plain);
+    close(gro);
+}
+
+static void phase_limit(int tx)
+{
+    struct sockaddr_in sa;
+    const int rx = udp_socket(&sa);
+
+    // far over UDP_MAX_SEGMENTS of any kernel
+    errno = 0;
+    check("limit.send", send_run(tx, &sa, 200, 64, 0), -1);
+    check("limit.unsupported", udp_gso_unsupported(errno), 1);
+    check("eagain.unsupported", udp_gso_unsupported(EAGAIN), 0);
+    check("enobufs.unsupported", udp_gso_unsupported(ENOBUFS), 0);
+
+    close(rx);
+}
+
+int main(void)
+{
+    phase_segments();
+
+    const int tx = socket(AF_INET, SOCK_DGRAM, 0);
+    if(!udp_gso_probe(tx))
+        printf("SKIP: UDP_SEGMENT is not supported\n");
+    else
+    {
+        phase_loopback(tx);
+        phase_limit(tx);
+    }
+    close(tx);
+
+    if(errors)
+    {
+        printf("FAIL: %llu errors\n", (unsigned long long)errors);
+        return 1;
+    }
+    printf("OK\n");
+    return 0;
+}
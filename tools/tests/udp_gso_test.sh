@@ -0,0 +1,33 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+# Test for modules/udp/udp_gso.c: UDP_SEGMENT send and UDP_GRO receive
+# on loopback (segments per send, split of a coalesced run, refused run).
+# Linux-only, kernels without the options skip the socket phases.
+#
+# Usage:
+#   tools/tests/udp_gso_test.sh
+
+if [[ "$(uname -s)" != "Linux" ]]; then
+  echo "SKIP: udp_gso test is Linux-only"
+  exit 0
+fi
+
+ROOT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")/../.." && pwd)"
+
+CC="${CC:-cc}"
+
+if [[ ! -f "${ROOT_DIR}/config.h" ]]; then
+  echo "ERROR: config.h not found, run ./configure.sh first"
+  exit 1
+fi
+
+TMP_DIR="$(mktemp -d)"
+trap 'rm -rf "${TMP_DIR}"' EXIT
+
+cd "${ROOT_DIR}"
+"${CC}" -O2 -std=iso9899:1999 -D_GNU_SOURCE -DWITH_EPOLL=1 -Wall -Wextra -I. -pthread \
+  -o "${TMP_DIR}/udp_gso_test" \
+  tools/tests/udp_gso_test.c modules/udp/udp_gso.c
+
+"${TMP_DIR}/udp_gso_test"
@@ -0,0 +1,179 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+# Linux-only smoke test: RFC 4445 MDI (DF:MLR) по времени приёма из ядра (SO_TIMESTAMPNS).
+# Прогон в dataplane (udp_relay) и в legacy pipeline (udp_input):
+# - вход udp с #mdi=1, вход rtp - через настройку performance_udp_mdi
+# - источник шлёт ровный поток (датаграмма каждые 5 мс), дважды пропускает 7 TS (CC)
+#   и один раз делает паузу 60 мс со всплеском после неё
+# - mdi в /api/v1/stream-status/<id> (dataplane.mdi или mdi): clock=kernel,
+#   lost=14, df_ms > 0, гистограмма интервалов прихода покрывает все датаграммы
+
+if [[ "$(uname -s)" != "Linux" ]]; then
+  echo "SKIP: udp mdi smoke test is Linux-only"
+  exit 0
+fi
+
+ROOT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")/../.." && pwd)"
+
+HTTP_PORT=19580
+IN_PORT_A=19590
+IN_PORT_B=19591
+OUT_PORT_A=19592
+OUT_PORT_B=19593
+
+STREAM_BIN="${ROOT_DIR}/stream"
+if [[ ! -x "${STREAM_BIN}" ]]; then
+  echo "ERROR: stream binary not found/executable: ${STREAM_BIN}"
+  exit 1
+fi
+
+TMP_DIR=""
+STREAM_PID=""
+
+cleanup() {
+  if [[ -n "${STREAM_PID}" ]]; then
+    kill "${STREAM_PID}" 2>/dev/null || true
+    wait "${STREAM_PID}" 2>/dev/null || true
+    STREAM_PID=""
+  fi
+}
+trap 'cleanup; [[ -n "${TMP_DIR}" ]] && rm -rf "${TMP_DIR}"' EXIT
+
+TMP_DIR="$(mktemp -d)"
+
+run_mode() {
+  local mode="$1"
+  local cfg="${TMP_DIR}/udp_mdi_${mode}.json"
+
+  cat >"${cfg}" <<EOF_CFG
+{
+  "settings": {
+    "http_auth_enabled": false,
+    "http_play_allow": false,
+
+    "performance_passthrough_dataplane": "${mode}",
+    "performance_passthrough_workers": 1,
+    "performance_udp_mdi": true
+  },
+  "make_stream": [
+    { "id": "mdi_a", "type": "udp", "enable": true,
+      "input": [ "udp://127.0.0.1:${IN_PORT_A}#mdi=1" ], "output": [ "udp://127.0.0.1:${OUT_PORT_A}" ] },
+    { "id": "mdi_b", "type": "udp", "enable": true,
+      "input": [ "rtp://127.0.0.1:${IN_PORT_B}" ], "output": [ "rtp://127.0.0.1:${OUT_PORT_B}" ] }
+  ]
+}
+EOF_CFG
+
+  "${STREAM_BIN}" scripts/server.lua -a 127.0.0.1 -p "${HTTP_PORT}" \
+    --config "${cfg}" \
+    --data-dir "${TMP_DIR}/data_${mode}" \
+    --log "${TMP_DIR}/stream_${mode}.log" \
+    --no-stdout &
+  STREAM_PID=$!
+
+  for _ in $(seq 1 80); do
+    if curl -fsS "http://127.0.0.1:${HTTP_PORT}/" >/dev/null 2>&1; then
+      break
+    fi
+    sleep 0.2
+  done
+
+  MODE="${mode}" python3 - <<PY
+import json, os, socket, struct, sys, time, urllib.request
+
+MODE = os.environ["MODE"]
+HTTP_PORT = ${HTTP_PORT}
+IN = {"mdi_a": ${IN_PORT_A}, "mdi_b": ${IN_PORT_B}}
+IN_RTP = {"mdi_a": False, "mdi_b": True}
+
+N = 700
+GAPS = (200, 450) # перед этими датаграммами пропущено по 7 TS
+PAUSE = 300 # перед ней пауза 60 мс, потом всплеск
+
+# выходы никто не читает, но порты заняты - без ICMP unreachable
+sinks = []
+for port in (${OUT_PORT_A}, ${OUT_PORT_B}):
+    s = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    s.bind(("127.0.0.1", port))
+    sinks.append(s)
+
+def ts(cc):
+    out = b""
+    for i in range(7):
+        out += bytes([0x47, 0x01, 0x00, 0x10 | ((cc + i) & 0x0F)]) + b"\xff" * 184
+    return out
+
+src = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+cc = 0
+start = time.monotonic()
+for n in range(N):
+    if n in GAPS:
+        cc += 7
+    if n == PAUSE:
+        # расписание не сдвигается: после паузы ~12 датаграмм уходят всплеском
+        time.sleep(0.06)
+    for name, port in IN.items():
+        payload = ts(cc)
+        if IN_RTP[name]:
+            payload = struct.pack("!BBHII", 0x80, 33, n & 0xFFFF, n * 450, 0x1717) + payload
+        src.sendto(payload, ("127.0.0.1", port))
+    cc += 7
+    time.sleep(max(0.0, start + (n + 1) * 0.005 - time.monotonic()))
+
+time.sleep(1.2)
+
+errors = []
+summary = []
+for name in IN:
+    with urllib.request.urlopen("http://127.0.0.1:%d/api/v1/stream-status/%s" % (HTTP_PORT, name), timeout=3) as r:
+        status = json.loads(r.read().decode())
+    st = status.get("status") or status
+    if MODE == "force":
+        dp = st.get("dataplane") or {}
+        mdi = dp.get("mdi") or {}
+        if (dp.get("ingest") or {}).get("timestamps") is not True:
+            errors.append("%s: ingest=%r" % (name, dp.get("ingest")))
+    else:
+        if st.get("dataplane"):
+            errors.append("%s is on the dataplane" % name)
+        mdi = st.get("mdi") or {}
+    if not mdi:
+        errors.append("%s: no mdi in status" % name)
+        continue
+    if mdi.get("clock") != "kernel" or mdi.get("user_stamps"):
+        errors.append("%s: clock=%r user_stamps=%r" % (name, mdi.get("clock"), mdi.get("user_stamps")))
+    if mdi.get("datagrams") != N:
+        errors.append("%s: datagrams=%r, expected %d" % (name, mdi.get("datagrams"), N))
+    if mdi.get("lost") != 7 * len(GAPS) or mdi.get("mlr_max", 0) < 7:
+        errors.append("%s: lost=%r mlr_max=%r" % (name, mdi.get("lost"), mdi.get("mlr_max")))
+    if mdi.get("intervals", 0) < 2 or not mdi.get("rate_bps"):
+        errors.append("%s: intervals=%r rate_bps=%r" % (name, mdi.get("intervals"), mdi.get("rate_bps")))
+    if not mdi.get("df_max_ms"):
+        errors.append("%s: df_max_ms=%r" % (name, mdi.get("df_max_ms")))
+    if mdi.get("iat_peak_us", 0) < 50000:
+        errors.append("%s: iat_peak_us=%r after a 60 ms pause" % (name, mdi.get("iat_peak_us")))
+    hist = mdi.get("iat_hist") or []
+    if len(hist) != 12 or "le_us" in hist[-1] or sum(b.get("count", 0) for b in hist) != N - 1:
+        errors.append("%s: iat_hist=%r" % (name, hist))
+    summary.append("%s mdi=%s df_max=%sms iat_peak=%sus" % (name, mdi.get("mdi"), mdi.get("df_max_ms"), mdi.get("iat_peak_us")))
+
+if errors:
+    for e in errors:
+        print("ERROR [%s]:" % MODE, e)
+    sys.exit(1)
+print("OK [%s]: %s" % (MODE, "; ".join(summary)))
+PY
+
+  if grep -q "timestamps are not supported" "${TMP_DIR}/stream_${mode}.log"; then
+    echo "ERROR [${mode}]: MDI without kernel timestamps"
+    exit 1
+  fi
+
+  cleanup
+}
+
+run_mode force
+run_mode off
+
+echo "OK"
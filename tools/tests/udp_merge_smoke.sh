@@ -0,0 +1,210 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+# Linux-only smoke test: SMPTE 2022-7 merge (backup_type "merge") двух RTP входов.
+# Прогон в dataplane (udp_relay legs) и в legacy pipeline (udp_input option merge):
+# - leg 1 теряет 10 датаграмм, leg 2 (отстаёт на 2 датаграммы) теряет другие 10
+# - выход получает каждый TS пакет ровно один раз, без потерь
+# - merge.* и legs[] в /api/v1/stream-status/<id>
+# - legacy: leg, который не удалось bind, пропускается с ошибкой в логе и не попадает в legs[]
+
+if [[ "$(uname -s)" != "Linux" ]]; then
+  echo "SKIP: udp merge smoke test is Linux-only"
+  exit 0
+fi
+
+ROOT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")/../.." && pwd)"
+
+HTTP_PORT=19440
+IN_PORT_A=19450
+IN_PORT_B=19451
+OUT_PORT=19452
+
+STREAM_BIN="${ROOT_DIR}/stream"
+if [[ ! -x "${STREAM_BIN}" ]]; then
+  echo "ERROR: stream binary not found/executable: ${STREAM_BIN}"
+  exit 1
+fi
+
+TMP_DIR=""
+STREAM_PID=""
+
+cleanup() {
+  if [[ -n "${STREAM_PID}" ]]; then
+    kill "${STREAM_PID}" 2>/dev/null || true
+    wait "${STREAM_PID}" 2>/dev/null || true
+    STREAM_PID=""
+  fi
+}
+trap 'cleanup; [[ -n "${TMP_DIR}" ]] && rm -rf "${TMP_DIR}"' EXIT
+
+TMP_DIR="$(mktemp -d)"
+
+run_mode() {
+  local mode="$1"
+  local cfg="${TMP_DIR}/udp_merge_${mode}.json"
+  local extra_input=""
+  if [[ "${mode}" == "off" ]]; then
+    # не локальный unicast адрес: bind() завершается ошибкой
+    extra_input=', "rtp://192.0.2.1:'"${IN_PORT_B}"'"'
+  fi
+
+  cat >"${cfg}" <<EOF_CFG
+{
+  "settings": {
+    "http_auth_enabled": false,
+    "http_play_allow": false,
+
+    "performance_passthrough_dataplane": "${mode}",
+    "performance_passthrough_workers": 1
+  },
+  "make_stream": [
+    {
+      "id": "merge",
+      "type": "udp",
+      "enable": true,
+      "backup_type": "merge",
+      "input": [
+        "rtp://127.0.0.1:${IN_PORT_A}",
+        "rtp://127.0.0.1:${IN_PORT_B}"${extra_input}
+      ],
+      "output": [
+        "udp://127.0.0.1:${OUT_PORT}"
+      ]
+    }
+  ]
+}
+EOF_CFG
+
+  "${STREAM_BIN}" scripts/server.lua -a 127.0.0.1 -p "${HTTP_PORT}" \
+    --config "${cfg}" \
+    --data-dir "${TMP_DIR}/data_${mode}" \
+    --log "${TMP_DIR}/stream_${mode}.log" \
+    --no-stdout &
+  STREAM_PID=$!
+
+  for _ in $(seq 1 80); do
+    if curl -fsS "http://127.0.0.1:${HTTP_PORT}/" >/dev/null 2>&1; then
+      break
+    fi
+    sleep 0.2
+  done
+
+  MODE="${mode}" LOG="${TMP_DIR}/stream_${mode}.log" python3 - <<PY
+import json, os, socket, struct, sys, threading, time, urllib.request
+
+MODE = os.environ["MODE"]
+HTTP_PORT = ${HTTP_PORT}
+IN_A = ${IN_PORT_A}
+IN_B = ${IN_PORT_B}
+OUT_PORT = ${OUT_PORT}
+
+N = 400
+LAG = 2
+LOST_A = set(range(100, 110))
+LOST_B = set(range(200, 210))
+
+def rtp(seq):
+    hdr = struct.pack("!BBHII", 0x80, 33, (65300 + seq) & 0xFFFF, seq * 3000, 0x2022)
+    body = b""
+    for i in range(7):
+        body += bytes([0x47, 0x01, 0x00, 0x10 | ((seq * 7 + i) & 0x0F)]) + struct.pack("!HB", seq, i) + b"\xff" * 181
+    return hdr + body
+
+out = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+out.bind(("127.0.0.1", OUT_PORT))
+out.settimeout(0.2)
+done = False
+received = []
+
+def drain():
+    while True:
+        try:
+            received.append(out.recv(2048))
+        except socket.timeout:
+            if done:
+                return
+
+reader = threading.Thread(target=drain)
+reader.start()
+
+src = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+for n in range(N + LAG):
+    if n < N and n not in LOST_A:
+        src.sendto(rtp(n), ("127.0.0.1", IN_A))
+    b = n - LAG
+    if b >= 0 and b not in LOST_B:
+        src.sendto(rtp(b), ("127.0.0.1", IN_B))
+    time.sleep(0.002)
+
+time.sleep(1.0)
+done = True
+reader.join()
+
+errors = []
+packets = []
+for d in received:
+    if len(d) % 188 != 0:
+        errors.append("output datagram %d bytes" % len(d))
+        break
+    for off in range(0, len(d), 188):
+        p = d[off:off + 188]
+        if p[0] != 0x47:
+            errors.append("output lost sync")
+            break
+        packets.append(struct.unpack("!HB", p[4:7]))
+expected = sorted((n, i) for n in range(N) for i in range(7))
+if sorted(packets) != expected:
+    errors.append("output: %d packets, %d unique, expected %d" % (len(packets), len(set(packets)), len(expected)))
+
+with urllib.request.urlopen("http://127.0.0.1:%d/api/v1/stream-status/merge" % HTTP_PORT, timeout=3) as r:
+    status = json.loads(r.read().decode())
+st = status.get("status") or status
+merge = st.get("merge") or {}
+if MODE == "force" and not st.get("dataplane"):
+    errors.append("stream is not on the dataplane")
+if MODE == "off" and st.get("dataplane"):
+    errors.append("stream is on the dataplane")
+
+legs = merge.get("legs") or [{}, {}]
+expected = {
+    "forwarded": N,
+    "lost": 0,
+    # leg 2 отстаёт на LAG: впереди головы merge оказываются только последние LAG потерь leg 1
+    "recovered": LAG,
+    "resyncs": 0,
+}
+for key, value in expected.items():
+    if merge.get(key) != value:
+        errors.append("merge.%s=%r expected %r" % (key, merge.get(key), value))
+expected_legs = [
+    { "datagrams": N - len(LOST_A), "forwarded": N - len(LOST_A), "lost": len(LOST_A), "duplicates": 0 },
+    { "datagrams": N - len(LOST_B), "forwarded": len(LOST_A), "lost": len(LOST_B),
+      "duplicates": N - len(LOST_B) - len(LOST_A) },
+]
+for i, exp in enumerate(expected_legs):
+    leg = legs[i] if i < len(legs) else {}
+    for key, value in exp.items():
+        if leg.get(key) != value:
+            errors.append("legs[%d].%s=%r expected %r" % (i + 1, key, leg.get(key), value))
+if len(legs) != 2:
+    errors.append("legs: %d, expected 2" % len(legs))
+if MODE == "off" and "rtp://192.0.2.1:%d: bind failed, skipped" % IN_B not in open(os.environ["LOG"], errors="replace").read():
+    errors.append("failed leg is not reported")
+if len(legs) > 1 and not (legs[1].get("skew_max_us") or 0) > 0:
+    errors.append("legs[2].skew_max_us=%r" % legs[1].get("skew_max_us"))
+
+if errors:
+    for e in errors:
+        print("ERROR [%s]:" % MODE, e)
+    sys.exit(1)
+print("OK [%s]: packets=%d recovered=%d skew_max_us=%d" % (MODE, len(packets), merge["recovered"], legs[1]["skew_max_us"]))
+PY
+
+  cleanup
+}
+
+run_mode force
+run_mode off
+
+echo "OK"
@@ -0,0 +1,229 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+# Linux-only smoke test: общий пул потоков пейсинга udp_output (#sync, #cbr).
+# - вход ~8 Мбит/с приходит всплесками по 100 мс, PCR каждые 40 мс
+# - три sync outputs (udp, udp+cbr, rtp) на двух потоках пейсинга
+#   (performance_udp_pacer_threads=2): получатели видят ровный поток без всплесков,
+#   все датаграммы по порядку, у cbr - null пакеты
+# - outputs_status[].pacing в /api/v1/stream-status/<id>: отклонение от целевого
+#   времени отправки, номера потоков пула
+
+if [[ "$(uname -s)" != "Linux" ]]; then
+  echo "SKIP: udp pacer smoke test is Linux-only"
+  exit 0
+fi
+
+ROOT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")/../.." && pwd)"
+
+HTTP_PORT=19560
+IN_PORT=19570
+OUT_PORT_A=19571
+OUT_PORT_B=19572
+OUT_PORT_C=19573
+
+STREAM_BIN="${ROOT_DIR}/stream"
+if [[ ! -x "${STREAM_BIN}" ]]; then
+  echo "ERROR: stream binary not found/executable: ${STREAM_BIN}"
+  exit 1
+fi
+
+TMP_DIR=""
+STREAM_PID=""
+
+cleanup() {
+  if [[ -n "${STREAM_PID}" ]]; then
+    kill "${STREAM_PID}" 2>/dev/null || true
+    wait "${STREAM_PID}" 2>/dev/null || true
+  fi
+  if [[ -n "${TMP_DIR}" ]]; then
+    rm -rf "${TMP_DIR}" 2>/dev/null || true
+  fi
+}
+trap cleanup EXIT
+
+TMP_DIR="$(mktemp -d)"
+CFG="${TMP_DIR}/udp_pacer.json"
+
+cat >"${CFG}" <<EOF
+{
+  "settings": {
+    "http_auth_enabled": false,
+    "http_play_allow": false,
+
+    "performance_passthrough_dataplane": "off",
+    "performance_udp_pacer_threads": 2
+  },
+  "make_stream": [
+    {
+      "id": "pacer",
+      "type": "udp",
+      "enable": true,
+      "input": [ "udp://127.0.0.1:${IN_PORT}" ],
+      "output": [
+        "udp://127.0.0.1:${OUT_PORT_A}#sync=1",
+        "udp://127.0.0.1:${OUT_PORT_B}#sync=1&cbr=10",
+        "rtp://127.0.0.1:${OUT_PORT_C}#sync=1"
+      ]
+    }
+  ]
+}
+EOF
+
+"${STREAM_BIN}" scripts/server.lua -a 127.0.0.1 -p "${HTTP_PORT}" \
+  --config "${CFG}" \
+  --data-dir "${TMP_DIR}/data" \
+  --log "${TMP_DIR}/stream.log" \
+  --no-stdout &
+STREAM_PID=$!
+
+for _ in $(seq 1 80); do
+  if curl -fsS "http://127.0.0.1:${HTTP_PORT}/" >/dev/null 2>&1; then
+    break
+  fi
+  sleep 0.2
+done
+
+python3 - <<PY
+import json, socket, struct, sys, threading, time, urllib.request
+
+HTTP_PORT = ${HTTP_PORT}
+IN_PORT = ${IN_PORT}
+OUTS = {"a": ${OUT_PORT_A}, "b": ${OUT_PORT_B}, "c": ${OUT_PORT_C}}
+OUT_RTP = {"a": False, "b": False, "c": True}
+
+BITRATE = 8000000
+TS_PER_SEC = BITRATE // (8 * 188)
+BURST_SEC = 0.1
+PCR_EVERY = TS_PER_SEC * 40 // 1000
+DURATION = 5.0
+PID = 0x100
+
+def pcr_bytes(n):
+    base = n * 188 * 8 * 90000 // BITRATE
+    ext = (n * 188 * 8 * 27000000 // BITRATE) % 300
+    return struct.pack("!IH", (base >> 1) & 0xFFFFFFFF, ((base & 1) << 15) | 0x7E00 | ext)
+
+def ts(n):
+    # номер пакета в payload - проверка порядка на выходе
+    if n % PCR_EVERY == 0:
+        head = bytes([0x47, PID >> 8, PID & 0xFF, 0x30 | (n & 0x0F), 7, 0x10]) + pcr_bytes(n)
+    else:
+        head = bytes([0x47, PID >> 8, PID & 0xFF, 0x10 | (n & 0x0F)])
+    return head + struct.pack("!I", n) + b"\xff" * (184 - len(head))
+
+done = False
+received = {}
+
+def drain(name, port):
+    s = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    s.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, 8 << 20)
+    s.bind(("127.0.0.1", port))
+    s.settimeout(0.2)
+    res = received.setdefault(name, [])
+    while True:
+        try:
+            d = s.recv(2048)
+            res.append((time.monotonic(), d))
+        except socket.timeout:
+            if done:
+                return
+
+readers = [threading.Thread(target=drain, args=(k, v)) for k, v in OUTS.items()]
+for t in readers:
+    t.start()
+time.sleep(0.2)
+
+src = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+n = 0
+start = time.monotonic()
+per_burst = int(TS_PER_SEC * BURST_SEC) // 7 * 7
+while time.monotonic() - start < DURATION:
+    for _ in range(per_burst // 7):
+        src.sendto(b"".join(ts(k) for k in range(n, n + 7)), ("127.0.0.1", IN_PORT))
+        n += 7
+    time.sleep(max(0.0, start + n / TS_PER_SEC - time.monotonic()))
+sent = n
+
+with urllib.request.urlopen("http://127.0.0.1:%d/api/v1/stream-status/pacer" % HTTP_PORT, timeout=3) as r:
+    status = json.loads(r.read().decode())
+
+done = True
+for t in readers:
+    t.join()
+
+errors = []
+summary = []
+for name in OUTS:
+    got = received.get(name, [])
+    skip = 12 if OUT_RTP[name] else 0
+    numbers = []
+    nulls = 0
+    for _, d in got:
+        for off in range(skip, len(d), 188):
+            pkt = d[off:off + 188]
+            if ((pkt[1] & 0x1F) << 8 | pkt[2]) == 0x1FFF:
+                nulls += 1
+                continue
+            af = 1 + pkt[4] if pkt[3] & 0x20 else 0
+            numbers.append(struct.unpack("!I", pkt[4 + af:8 + af])[0])
+    # первый блок с первого PCR, хвост остаётся в буфере синхронизации
+    if len(numbers) < sent // 2:
+        errors.append("%s: %d TS of %d" % (name, len(numbers), sent))
+    if numbers != list(range(numbers[0], numbers[0] + len(numbers))) if numbers else True:
+        errors.append("%s: TS out of order or lost" % name)
+    if name == "b" and nulls == 0:
+        errors.append("b: no cbr stuffing")
+    if name != "b" and nulls != 0:
+        errors.append("%s: %d null packets without cbr" % (name, nulls))
+    if OUT_RTP[name]:
+        seq = [struct.unpack("!H", d[2:4])[0] for _, d in got]
+        if any((b - a) & 0xFFFF != 1 for a, b in zip(seq, seq[1:])):
+            errors.append("%s: RTP sequence gaps" % name)
+
+    # всплеск входа - ~75 датаграмм подряд, после пейсинга за 20 мс не больше ~3x от ровного потока
+    times = [x[0] for x in got]
+    worst = 0
+    j = 0
+    for i in range(len(times)):
+        while times[i] - times[j] > 0.02:
+            j += 1
+        worst = max(worst, i - j + 1)
+    rate = len(times) / (times[-1] - times[0]) if len(times) > 1 else 0
+    if worst > max(8, rate * 0.02 * 3):
+        errors.append("%s: %d datagrams in 20ms, average %.1f" % (name, worst, rate * 0.02))
+    summary.append("%s=%d/20ms" % (name, worst))
+
+outputs = status.get("outputs_status") or []
+threads = set()
+for idx, name in enumerate(OUTS):
+    pacing = (outputs[idx] if idx < len(outputs) else {}).get("pacing") or {}
+    if not pacing.get("datagrams"):
+        errors.append("%s: pacing=%r" % (name, pacing))
+        continue
+    threads.add(pacing.get("pacer_thread"))
+    if pacing.get("deviation_avg_us", 1e9) > 5000:
+        errors.append("%s: deviation_avg_us=%r" % (name, pacing.get("deviation_avg_us")))
+    if pacing.get("late", 0) * 10 > pacing["datagrams"]:
+        errors.append("%s: late=%r of %r" % (name, pacing.get("late"), pacing["datagrams"]))
+    if pacing.get("overflows") or pacing.get("send_errors"):
+        errors.append("%s: overflows=%r send_errors=%r" % (name, pacing.get("overflows"), pacing.get("send_errors")))
+    summary.append("%s dev avg/max %s/%sus" % (name, pacing.get("deviation_avg_us"), pacing.get("deviation_max_us")))
+if threads != {0, 1}:
+    errors.append("pacer threads %r, expected {0, 1}" % threads)
+
+if errors:
+    for e in errors:
+        print("ERROR:", e)
+    sys.exit(1)
+print("OK: %d TS, %s" % (sent, "; ".join(summary)))
+PY
+
+# "next PCR is not found" после остановки входа - буфер выработан, это норма
+if grep -q "wrong syncing time\|first PCR is not found\|sync buffer overflow" "${TMP_DIR}/stream.log"; then
+  echo "ERROR: sync errors in the log"
+  grep "udp_output" "${TMP_DIR}/stream.log" || true
+  exit 1
+fi
+
+echo "OK"
@@ -0,0 +1,180 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+# Linux-only smoke test: общий ingest для потоков с одним входом.
+# Прогон в dataplane (udp_relay ingest registry) и в legacy pipeline (udp_input_instance_list):
+# - три потока читают один udp://127.0.0.1:PORT, у каждого свой output
+# - unicast на общий порт ядро отдаёт одному сокету: без общего ingest выходы делят поток
+# - каждый выход получает все датаграммы, ingest.subscribers=3 в /api/v1/stream-status/<id>
+
+if [[ "$(uname -s)" != "Linux" ]]; then
+  echo "SKIP: udp ingest smoke test is Linux-only"
+  exit 0
+fi
+
+ROOT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")/../.." && pwd)"
+
+HTTP_PORT=19480
+IN_PORT=19490
+OUT_PORT_A=19491
+OUT_PORT_B=19492
+OUT_PORT_C=19493
+
+STREAM_BIN="${ROOT_DIR}/stream"
+if [[ ! -x "${STREAM_BIN}" ]]; then
+  echo "ERROR: stream binary not found/executable: ${STREAM_BIN}"
+  exit 1
+fi
+
+TMP_DIR=""
+STREAM_PID=""
+
+cleanup() {
+  if [[ -n "${STREAM_PID}" ]]; then
+    kill "${STREAM_PID}" 2>/dev/null || true
+    wait "${STREAM_PID}" 2>/dev/null || true
+    STREAM_PID=""
+  fi
+}
+trap 'cleanup; [[ -n "${TMP_DIR}" ]] && rm -rf "${TMP_DIR}"' EXIT
+
+TMP_DIR="$(mktemp -d)"
+
+run_mode() {
+  local mode="$1"
+  local cfg="${TMP_DIR}/udp_ingest_${mode}.json"
+
+  cat >"${cfg}" <<EOF_CFG
+{
+  "settings": {
+    "http_auth_enabled": false,
+    "http_play_allow": false,
+
+    "performance_passthrough_dataplane": "${mode}",
+    "performance_passthrough_workers": 2
+  },
+  "make_stream": [
+    { "id": "ingest_a", "type": "udp", "enable": true,
+      "input": [ "udp://127.0.0.1:${IN_PORT}" ], "output": [ "udp://127.0.0.1:${OUT_PORT_A}" ] },
+    { "id": "ingest_b", "type": "udp", "enable": true,
+      "input": [ "udp://127.0.0.1:${IN_PORT}" ], "output": [ "udp://127.0.0.1:${OUT_PORT_B}" ] },
+    { "id": "ingest_c", "type": "udp", "enable": true,
+      "input": [ "udp://127.0.0.1:${IN_PORT}" ], "output": [ "udp://127.0.0.1:${OUT_PORT_C}" ] }
+  ]
+}
+EOF_CFG
+
+  "${STREAM_BIN}" scripts/server.lua -a 127.0.0.1 -p "${HTTP_PORT}" \
+    --config "${cfg}" \
+    --data-dir "${TMP_DIR}/data_${mode}" \
+    --log "${TMP_DIR}/stream_${mode}.log" \
+    --no-stdout &
+  STREAM_PID=$!
+
+  for _ in $(seq 1 80); do
+    if curl -fsS "http://127.0.0.1:${HTTP_PORT}/" >/dev/null 2>&1; then
+      break
+    fi
+    sleep 0.2
+  done
+
+  MODE="${mode}" python3 - <<PY
+import json, os, socket, struct, sys, threading, time, urllib.request
+
+MODE = os.environ["MODE"]
+HTTP_PORT = ${HTTP_PORT}
+IN_PORT = ${IN_PORT}
+OUTS = {"ingest_a": ${OUT_PORT_A}, "ingest_b": ${OUT_PORT_B}, "ingest_c": ${OUT_PORT_C}}
+
+N = 500
+
+def datagram(n):
+    out = b""
+    for i in range(7):
+        out += bytes([0x47, 0x01, 0x00, 0x10 | ((n * 7 + i) & 0x0F)]) + struct.pack("!I", n) + b"\xff" * 180
+    return out
+
+done = False
+received = {}
+
+def drain(name, port):
+    s = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    s.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, 4 << 20)
+    s.bind(("127.0.0.1", port))
+    s.settimeout(0.2)
+    res = received.setdefault(name, [])
+    while True:
+        try:
+            res.append(struct.unpack("!I", s.recv(2048)[4:8])[0])
+        except socket.timeout:
+            if done:
+                return
+
+readers = [threading.Thread(target=drain, args=(k, v)) for k, v in OUTS.items()]
+for t in readers:
+    t.start()
+time.sleep(0.2)
+
+src = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+for n in range(N):
+    src.sendto(datagram(n), ("127.0.0.1", IN_PORT))
+    time.sleep(0.001)
+
+time.sleep(1.0)
+done = True
+for t in readers:
+    t.join()
+
+errors = []
+for name in OUTS:
+    seqs = received.get(name, [])
+    if seqs != list(range(N)):
+        errors.append("%s: %d datagrams, expected %d in order" % (name, len(seqs), N))
+
+keys = set()
+workers = set()
+for name in OUTS:
+    with urllib.request.urlopen("http://127.0.0.1:%d/api/v1/stream-status/%s" % (HTTP_PORT, name), timeout=3) as r:
+        status = json.loads(r.read().decode())
+    st = status.get("status") or status
+    if MODE == "force":
+        dp = st.get("dataplane") or {}
+        if not dp:
+            errors.append("%s is not on the dataplane" % name)
+            continue
+        ingest = dp.get("ingest") or {}
+        workers.add(dp.get("worker_index"))
+        if ingest.get("worker") != dp.get("worker_index"):
+            errors.append("%s: ingest.worker=%r worker_index=%r" % (name, ingest.get("worker"), dp.get("worker_index")))
+        if ingest.get("datagrams") != N:
+            errors.append("%s: ingest.datagrams=%r expected %d" % (name, ingest.get("datagrams"), N))
+        if dp.get("datagrams_in") != N:
+            errors.append("%s: datagrams_in=%r expected %d" % (name, dp.get("datagrams_in"), N))
+    else:
+        if st.get("dataplane"):
+            errors.append("%s is on the dataplane" % name)
+        inputs = st.get("inputs") or [{}]
+        ingest = inputs[0].get("ingest") or {}
+    if ingest.get("subscribers") != 3 or ingest.get("shared") is not True:
+        errors.append("%s: ingest=%r" % (name, ingest))
+    keys.add(ingest.get("key"))
+
+if len(keys) != 1:
+    errors.append("ingest keys %r" % keys)
+if MODE == "force" and len(workers) != 1:
+    errors.append("streams on workers %r, expected one" % workers)
+
+if errors:
+    for e in errors:
+        print("ERROR [%s]:" % MODE, e)
+    sys.exit(1)
+print("OK [%s]: %d datagrams x %d outputs, ingest %s" % (MODE, N, len(OUTS), keys.pop()))
+PY
+
+  cleanup
+}
+
+run_mode force
+run_mode off
+
+echo "OK"
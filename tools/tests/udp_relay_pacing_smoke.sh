@@ -0,0 +1,229 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+# Linux-only smoke test: пейсинг outputs в udp_relay dataplane.
+# - вход приходит всплесками по 32 датаграммы каждые 32 мс (~10.5 Мбит/с, PCR каждые 4 датаграммы)
+# - output без пейсинга получает всплески, #pace=bitrate и #pace=pcr - слоты по pace_burst
+# - все датаграммы доходят по порядку, stats.pacing в /api/v1/stream-status/<id>
+
+if [[ "$(uname -s)" != "Linux" ]]; then
+  echo "SKIP: udp_relay dataplane smoke test is Linux-only"
+  exit 0
+fi
+
+ROOT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")/../.." && pwd)"
+
+HTTP_PORT=19460
+IN_PORT=19470
+OUT_RAW_PORT=19471
+OUT_BITRATE_PORT=19472
+OUT_PCR_PORT=19473
+
+STREAM_BIN="${ROOT_DIR}/stream"
+if [[ ! -x "${STREAM_BIN}" ]]; then
+  echo "ERROR: stream binary not found/executable: ${STREAM_BIN}"
+  exit 1
+fi
+
+TMP_DIR=""
+STREAM_PID=""
+
+cleanup() {
+  if [[ -n "${STREAM_PID}" ]]; then
+    kill "${STREAM_PID}" 2>/dev/null || true
+  fi
+  if [[ -n "${TMP_DIR}" ]]; then
+    rm -rf "${TMP_DIR}" 2>/dev/null || true
+  fi
+}
+trap cleanup EXIT
+
+TMP_DIR="$(mktemp -d)"
+CFG="${TMP_DIR}/udp_relay_pacing.json"
+
+cat >"${CFG}" <<EOF
+{
+  "settings": {
+    "http_auth_enabled": false,
+    "http_play_allow": false,
+
+    "performance_passthrough_dataplane": "force",
+    "performance_passthrough_workers": 1,
+    "performance_passthrough_rx_batch": 32
+  },
+  "make_stream": [
+    {
+      "id": "dp_pacing",
+      "type": "udp",
+      "enable": true,
+      "input": [
+        "udp://127.0.0.1:${IN_PORT}"
+      ],
+      "output": [
+        "udp://127.0.0.1:${OUT_RAW_PORT}",
+        "udp://127.0.0.1:${OUT_BITRATE_PORT}#pace=bitrate",
+        "rtp://127.0.0.1:${OUT_PCR_PORT}#pace=pcr&pace_burst=2"
+      ]
+    }
+  ]
+}
+EOF
+
+"${STREAM_BIN}" scripts/server.lua -a 127.0.0.1 -p "${HTTP_PORT}" \
+  --config "${CFG}" \
+  --data-dir "${TMP_DIR}/data" \
+  --log "${TMP_DIR}/stream.log" \
+  --no-stdout &
+STREAM_PID=$!
+
+for _ in $(seq 1 80); do
+  if curl -fsS "http://127.0.0.1:${HTTP_PORT}/" >/dev/null 2>&1; then
+    break
+  fi
+  sleep 0.2
+done
+
+python3 - <<PY
+import json, socket, struct, sys, threading, time, urllib.request
+
+HTTP_PORT = ${HTTP_PORT}
+IN_PORT = ${IN_PORT}
+OUTS = {"raw": ${OUT_RAW_PORT}, "bitrate": ${OUT_BITRATE_PORT}, "pcr": ${OUT_PCR_PORT}}
+
+N = 2560
+BURST = 32
+PERIOD = 0.032  # 1000 датаграмм/с
+
+def pcr_field(pcr):
+    base, ext = pcr // 300, pcr % 300
+    return struct.pack("!IH", (base >> 1) & 0xFFFFFFFF, ((base & 1) << 15) | 0x7E00 | ext)
+
+def datagram(n):
+    out = b""
+    for i in range(7):
+        cc = (n * 7 + i) & 0x0F
+        if i == 0 and n % 4 == 0:
+            # adaptation field с PCR: 1000 датаграмм/с -> 27000 тиков на датаграмму
+            out += bytes([0x47, 0x01, 0x00, 0x30 | cc, 7, 0x10]) + pcr_field(n * 27000 + 1)
+            out += struct.pack("!I", n) + b"\xff" * (188 - 16)
+        else:
+            out += bytes([0x47, 0x01, 0x00, 0x10 | cc]) + struct.pack("!I", n) + b"\xff" * 180
+    return out
+
+def seq_of(d):
+    p = d[12:] if d[0] == 0x80 else d
+    return struct.unpack("!I", p[12:16] if (p[3] & 0x20) else p[4:8])[0]
+
+SO_TIMESTAMPNS = getattr(socket, "SO_TIMESTAMPNS", 35)  # время приёма ядром, не потока python
+
+done = False
+received = {}
+
+def drain(name, port):
+    s = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    s.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, 4 << 20)
+    s.setsockopt(socket.SOL_SOCKET, SO_TIMESTAMPNS, 1)
+    s.bind(("127.0.0.1", port))
+    s.settimeout(0.2)
+    res = received.setdefault(name, [])
+    while True:
+        try:
+            data, anc, _, _ = s.recvmsg(2048, 64)
+        except socket.timeout:
+            if done:
+                return
+            continue
+        ts = time.time()
+        for level, kind, value in anc:
+            if level == socket.SOL_SOCKET and kind == SO_TIMESTAMPNS:
+                sec, nsec = struct.unpack("qq", value[:16])
+                ts = sec + nsec / 1e9
+        res.append((ts, data))
+
+readers = [threading.Thread(target=drain, args=(k, v)) for k, v in OUTS.items()]
+for t in readers:
+    t.start()
+time.sleep(0.2)
+
+src = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+src.setsockopt(socket.SOL_SOCKET, socket.SO_SNDBUF, 4 << 20)
+start = time.monotonic()
+for n in range(N):
+    if n % BURST == 0:
+        delay = start + (n // BURST) * PERIOD - time.monotonic()
+        if delay > 0:
+            time.sleep(delay)
+    src.sendto(datagram(n), ("127.0.0.1", IN_PORT))
+
+time.sleep(1.5)
+done = True
+for t in readers:
+    t.join()
+
+def clusters(items):
+    # датаграммы с паузой меньше 150 мкс - один всплеск
+    sizes, run = [], 1
+    for (a, _), (b, _) in zip(items, items[1:]):
+        if b - a < 0.00015:
+            run += 1
+        else:
+            sizes.append(run)
+            run = 1
+    sizes.append(run)
+    return sizes
+
+errors = []
+report = []
+for name in OUTS:
+    items = received.get(name, [])
+    seqs = [seq_of(d) for _, d in items]
+    if seqs != list(range(N)):
+        errors.append("%s: %d datagrams, in order: %s" % (name, len(seqs), seqs == sorted(seqs)))
+        continue
+    # без первой половины: скорость ещё оценивается
+    tail = sorted(clusters(items[N // 2:]))
+    p90 = tail[int(len(tail) * 0.9)]
+    report.append("%s p90=%d max=%d" % (name, p90, tail[-1]))
+    if name == "raw" and p90 < 16:
+        errors.append("raw: p90 cluster %d, expected input bursts" % p90)
+    if name == "bitrate" and p90 > 8:
+        errors.append("bitrate: p90 cluster %d, expected slots of 4" % p90)
+    if name == "pcr" and p90 > 4:
+        errors.append("pcr: p90 cluster %d, expected slots of 2" % p90)
+
+with urllib.request.urlopen("http://127.0.0.1:%d/api/v1/stream-status/dp_pacing" % HTTP_PORT, timeout=3) as r:
+    status = json.loads(r.read().decode())
+dp = status.get("dataplane") or (status.get("status") or {}).get("dataplane") or {}
+pacing = dp.get("pacing") or {}
+outs = pacing.get("outputs") or []
+if len(outs) != 2:
+    errors.append("pacing.outputs=%r" % outs)
+rate = pacing.get("rate_bps") or 0
+pcr_rate = pacing.get("pcr_rate_bps") or 0
+if not 9000000 < rate < 12000000:
+    errors.append("pacing.rate_bps=%r" % rate)
+if not 10400000 < pcr_rate < 10650000:
+    errors.append("pacing.pcr_rate_bps=%r" % pcr_rate)
+for o, burst, mode in zip(outs, (4, 2), ("bitrate", "pcr")):
+    if o.get("mode") != mode or o.get("burst") != burst:
+        errors.append("pacing output %r" % o)
+    if o.get("datagrams") != N or o.get("overflows") != 0 or o.get("queue") != 0:
+        errors.append("pacing output %s: datagrams=%r overflows=%r queue=%r"
+                      % (mode, o.get("datagrams"), o.get("overflows"), o.get("queue")))
+    if not 0 < (o.get("queue_max") or 0) <= o.get("queue_limit", 0):
+        errors.append("pacing output %s: queue_max=%r" % (mode, o.get("queue_max")))
+    if not 1 < (o.get("burst_avg") or 0) <= burst * 3:
+        errors.append("pacing output %s: burst_avg=%r" % (mode, o.get("burst_avg")))
+if dp.get("send_drops") != 0:
+    errors.append("send_drops=%r" % dp.get("send_drops"))
+
+if errors:
+    for e in errors:
+        print("ERROR:", e)
+    print("clusters:", "; ".join(report))
+    sys.exit(1)
+print("OK: %s; rate=%d pcr_rate=%d burst_avg=%.1f/%.1f queue_max=%d/%d" % ("; ".join(report), rate, pcr_rate
+      , outs[0]["burst_avg"], outs[1]["burst_avg"], outs[0]["queue_max"], outs[1]["queue_max"]))
+PY
+
+echo "OK"
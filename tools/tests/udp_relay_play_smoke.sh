@@ -0,0 +1,209 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+# Linux-only smoke test: HTTP /play dataplane-потока отдаёт воркер udp_relay.
+# - несколько клиентов /play/<id> получают заголовок и непрерывный TS (CC без разрывов)
+# - клиент подключившийся позже получает историю кольца (buffer_fill) и продолжает live
+# - play_clients/play_bytes в /api/v1/stream-status/<id>, отключение клиентов
+
+if [[ "$(uname -s)" != "Linux" ]]; then
+  echo "SKIP: udp_relay dataplane smoke test is Linux-only"
+  exit 0
+fi
+
+ROOT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")/../.." && pwd)"
+
+HTTP_PORT=19400
+IN_PORT=19410
+OUT_PORT=19411
+
+STREAM_BIN="${ROOT_DIR}/stream"
+if [[ ! -x "${STREAM_BIN}" ]]; then
+  echo "ERROR: stream binary not found/executable: ${STREAM_BIN}"
+  exit 1
+fi
+
+TMP_DIR=""
+STREAM_PID=""
+
+cleanup() {
+  if [[ -n "${STREAM_PID}" ]]; then
+    kill "${STREAM_PID}" 2>/dev/null || true
+  fi
+  if [[ -n "${TMP_DIR}" ]]; then
+    rm -rf "${TMP_DIR}" 2>/dev/null || true
+  fi
+}
+trap cleanup EXIT
+
+TMP_DIR="$(mktemp -d)"
+CFG="${TMP_DIR}/udp_relay_play.json"
+
+cat >"${CFG}" <<EOF_CFG
+{
+  "settings": {
+    "http_auth_enabled": false,
+    "http_play_allow": true,
+    "http_play_buffer_fill_kb": 16,
+    "http_play_dataplane": true,
+
+    "performance_passthrough_dataplane": "force",
+    "performance_passthrough_workers": 1
+  },
+  "make_stream": [
+    {
+      "id": "dp_play",
+      "type": "udp",
+      "enable": true,
+      "input": [
+        "udp://127.0.0.1:${IN_PORT}"
+      ],
+      "output": [
+        "udp://127.0.0.1:${OUT_PORT}"
+      ]
+    }
+  ]
+}
+EOF_CFG
+
+"${STREAM_BIN}" scripts/server.lua -a 127.0.0.1 -p "${HTTP_PORT}" \
+  --config "${CFG}" \
+  --data-dir "${TMP_DIR}/data" \
+  --log "${TMP_DIR}/stream.log" \
+  --no-stdout &
+STREAM_PID=$!
+
+for _ in $(seq 1 80); do
+  if curl -fsS "http://127.0.0.1:${HTTP_PORT}/" >/dev/null 2>&1; then
+    break
+  fi
+  sleep 0.2
+done
+
+python3 - <<PY
+import json, socket, sys, threading, time, urllib.request
+
+IN_PORT = ${IN_PORT}
+HTTP_PORT = ${HTTP_PORT}
+
+def datagram(n):
+    out = b""
+    for i in range(7):
+        cc = (n * 7 + i) & 0x0F
+        out += bytes([0x47, 0x01, 0x00, 0x10 | cc]) + bytes([(n * 7 + i) & 0xFF]) * 184
+    return out
+
+def status():
+    with urllib.request.urlopen("http://127.0.0.1:%d/api/v1/stream-status/dp_play" % HTTP_PORT, timeout=3) as r:
+        st = json.loads(r.read().decode())
+    return st.get("dataplane") or (st.get("status") or {}).get("dataplane") or {}
+
+class Client(threading.Thread):
+    def __init__(self):
+        threading.Thread.__init__(self)
+        self.sock = socket.create_connection(("127.0.0.1", HTTP_PORT), timeout=5)
+        self.sock.sendall(b"GET /play/dp_play HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n")
+        self.data = b""
+        self.stop = False
+
+    def run(self):
+        self.sock.settimeout(0.2)
+        while not self.stop:
+            try:
+                chunk = self.sock.recv(65536)
+            except socket.timeout:
+                continue
+            if not chunk:
+                break
+            self.data += chunk
+
+def check_client(name, c, errors):
+    head, sep, body = c.data.partition(b"\r\n\r\n")
+    if not sep or not head.startswith(b"HTTP/1.1 200"):
+        errors.append("%s: bad response header %r" % (name, head[:64]))
+        return 0
+    if b"video/MP2T" not in head:
+        errors.append("%s: content type %r" % (name, head))
+    if len(body) == 0 or len(body) % 188 != 0:
+        errors.append("%s: body %d bytes" % (name, len(body)))
+        return 0
+    prev = None
+    for off in range(0, len(body), 188):
+        p = body[off:off + 188]
+        if p[0] != 0x47:
+            errors.append("%s: lost sync at %d" % (name, off))
+            break
+        cc = p[3] & 0x0F
+        if prev is not None and cc != ((prev + 1) & 0x0F):
+            errors.append("%s: cc %d after %d at %d" % (name, cc, prev, off))
+            break
+        if (p[4] & 0x0F) != cc:
+            errors.append("%s: payload does not match cc at %d" % (name, off))
+            break
+        prev = cc
+    return len(body) // 188
+
+errors = []
+src = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+
+# поток идёт до подключения клиентов: кольцо заполняется для первого клиента
+for n in range(50):
+    src.sendto(datagram(n), ("127.0.0.1", IN_PORT))
+    time.sleep(0.002)
+
+clients = [Client() for _ in range(3)]
+for c in clients:
+    c.start()
+time.sleep(0.5)
+
+for n in range(50, 450):
+    if n == 250:
+        # история кольца: buffer_fill 16 KiB = 12 датаграмм
+        late = Client()
+        late.start()
+        time.sleep(0.3)
+    src.sendto(datagram(n), ("127.0.0.1", IN_PORT))
+    time.sleep(0.002)
+time.sleep(0.5)
+
+dp = status()
+if dp.get("play_clients") != 4:
+    errors.append("play_clients=%r expected 4" % dp.get("play_clients"))
+
+clients.append(late)
+
+for c in clients:
+    c.stop = True
+for c in clients:
+    c.join()
+
+counts = [check_client("client%d" % i, c, errors) for i, c in enumerate(clients)]
+# кольцо создаётся первым клиентом: у первых клиентов истории нет
+expected = [400 * 7] * 3 + [(12 + 200) * 7]
+if counts != expected:
+    errors.append("packets %r expected %r" % (counts, expected))
+
+for c in clients:
+    c.sock.close()
+time.sleep(0.5)
+
+# клиенты ушли, воркер отдал сокеты
+for n in range(450, 470):
+    src.sendto(datagram(n), ("127.0.0.1", IN_PORT))
+    time.sleep(0.002)
+time.sleep(0.3)
+
+dp = status()
+if dp.get("play_clients") != 0:
+    errors.append("play_clients=%r after disconnect" % dp.get("play_clients"))
+if (dp.get("play_bytes") or 0) < sum(counts) * 188:
+    errors.append("play_bytes=%r" % dp.get("play_bytes"))
+
+if errors:
+    for e in errors:
+        print("ERROR:", e)
+    sys.exit(1)
+print("OK: packets=%s play_bytes=%d" % (counts, dp["play_bytes"]))
+PY
+
+echo "OK"
@@ -0,0 +1,242 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+# Linux-only smoke test: балансировка потоков между воркерами udp_relay.
+# - два воркера, два потока с id, которые hash-политика кладёт на один воркер
+# - performance_passthrough_rebalance: балансировщик видит перекос busy% и переносит
+#   один поток на свободный воркер, ровно один перенос (без обратного)
+# - rb_a с pace=bitrate: таймер пейсинга переезжает вместе с потоком
+# - выходы и /play клиент получают все датаграммы по порядку во время переноса
+# - balancer.decisions в /api/v1/metrics (dataplane.engine), worker_index/migrations
+#   в /api/v1/stream-status/<id>
+
+if [[ "$(uname -s)" != "Linux" ]]; then
+  echo "SKIP: udp_relay rebalance smoke test is Linux-only"
+  exit 0
+fi
+
+ROOT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")/../.." && pwd)"
+
+HTTP_PORT=19540
+IN_PORT_A=19550
+IN_PORT_C=19551
+OUT_PORT_A=19552
+OUT_PORT_C=19553
+
+STREAM_BIN="${ROOT_DIR}/stream"
+if [[ ! -x "${STREAM_BIN}" ]]; then
+  echo "ERROR: stream binary not found/executable: ${STREAM_BIN}"
+  exit 1
+fi
+
+TMP_DIR=""
+STREAM_PID=""
+
+cleanup() {
+  if [[ -n "${STREAM_PID}" ]]; then
+    kill "${STREAM_PID}" 2>/dev/null || true
+  fi
+  if [[ -n "${TMP_DIR}" ]]; then
+    rm -rf "${TMP_DIR}" 2>/dev/null || true
+  fi
+}
+trap cleanup EXIT
+
+TMP_DIR="$(mktemp -d)"
+CFG="${TMP_DIR}/udp_relay_rebalance.json"
+
+# rb_a и rb_c: fnv1a_32(id) % 2 == 1
+cat >"${CFG}" <<EOF
+{
+  "settings": {
+    "http_auth_enabled": false,
+    "http_play_allow": true,
+    "http_play_buffer_fill_kb": 16,
+    "http_play_dataplane": true,
+
+    "performance_passthrough_dataplane": "force",
+    "performance_passthrough_workers": 2,
+    "performance_passthrough_worker_policy": "hash",
+    "performance_passthrough_rebalance": true,
+    "performance_passthrough_rebalance_interval_sec": 1,
+    "performance_passthrough_rebalance_threshold_pct": 1,
+    "performance_passthrough_rebalance_max_moves": 2
+  },
+  "make_stream": [
+    { "id": "rb_a", "type": "udp", "enable": true,
+      "input": [ "udp://127.0.0.1:${IN_PORT_A}" ], "output": [ "udp://127.0.0.1:${OUT_PORT_A}#pace=bitrate&pace_queue=1024" ] },
+    { "id": "rb_c", "type": "udp", "enable": true,
+      "input": [ "udp://127.0.0.1:${IN_PORT_C}" ], "output": [ "udp://127.0.0.1:${OUT_PORT_C}" ] }
+  ]
+}
+EOF
+
+"${STREAM_BIN}" scripts/server.lua -a 127.0.0.1 -p "${HTTP_PORT}" \
+  --config "${CFG}" \
+  --data-dir "${TMP_DIR}/data" \
+  --log "${TMP_DIR}/stream.log" \
+  --no-stdout &
+STREAM_PID=$!
+
+for _ in $(seq 1 80); do
+  if curl -fsS "http://127.0.0.1:${HTTP_PORT}/" >/dev/null 2>&1; then
+    break
+  fi
+  sleep 0.2
+done
+
+python3 - <<PY
+import json, socket, struct, sys, threading, time, urllib.request
+
+HTTP_PORT = ${HTTP_PORT}
+IN = {"rb_a": ${IN_PORT_A}, "rb_c": ${IN_PORT_C}}
+OUTS = {"rb_a": ${OUT_PORT_A}, "rb_c": ${OUT_PORT_C}}
+SO_RCVBUFFORCE = 33
+
+N = 30000
+BURST = 16
+
+# 16 шаблонов по CC, номер датаграммы в первом TS пакете
+templates = []
+for k in range(16):
+    d = b""
+    for i in range(7):
+        d += bytes([0x47, 0x01, 0x00, 0x10 | ((k * 7 + i) & 0x0F)]) + b"\xff" * 184
+    templates.append(d)
+
+def datagram(n):
+    d = bytearray(templates[n % 16])
+    struct.pack_into("!I", d, 4, n)
+    return bytes(d)
+
+def get(path):
+    with urllib.request.urlopen("http://127.0.0.1:%d%s" % (HTTP_PORT, path), timeout=3) as r:
+        return json.loads(r.read().decode())
+
+def dataplane(name):
+    st = get("/api/v1/stream-status/%s" % name)
+    st = st.get("status") or st
+    return st.get("dataplane") or {}
+
+def engine():
+    return ((get("/api/v1/metrics").get("dataplane") or {}).get("engine")) or {}
+
+done = False
+received = {}
+
+def drain(name, port):
+    s = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    try:
+        s.setsockopt(socket.SOL_SOCKET, SO_RCVBUFFORCE, 8 << 20)
+    except OSError:
+        s.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, 8 << 20)
+    s.bind(("127.0.0.1", port))
+    s.settimeout(0.2)
+    res = received.setdefault(name, [])
+    while True:
+        try:
+            res.append(struct.unpack("!I", s.recv(2048)[4:8])[0])
+        except socket.timeout:
+            if done:
+                return
+
+play = {"data": b""}
+def play_client():
+    c = socket.create_connection(("127.0.0.1", HTTP_PORT), timeout=5)
+    c.sendall(b"GET /play/rb_a HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n")
+    c.settimeout(0.2)
+    buf = []
+    while True:
+        try:
+            chunk = c.recv(262144)
+        except socket.timeout:
+            if done:
+                break
+            continue
+        if not chunk:
+            break
+        buf.append(chunk)
+    play["data"] = b"".join(buf)
+    c.close()
+
+threads = [threading.Thread(target=drain, args=(k, v)) for k, v in OUTS.items()]
+threads.append(threading.Thread(target=play_client))
+for t in threads:
+    t.start()
+time.sleep(0.3)
+
+before = {name: dataplane(name).get("worker_index") for name in OUTS}
+
+src = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+start = time.time()
+for n in range(0, N, BURST):
+    for k in range(n, n + BURST):
+        src.sendto(datagram(k), ("127.0.0.1", IN["rb_a"]))
+        src.sendto(datagram(k), ("127.0.0.1", IN["rb_c"]))
+    time.sleep(0.002)
+elapsed = time.time() - start
+
+time.sleep(1.0)
+done = True
+for t in threads:
+    t.join()
+
+errors = []
+if before["rb_a"] != before["rb_c"]:
+    errors.append("streams start on different workers: %r" % before)
+
+for name in OUTS:
+    seqs = received.get(name, [])
+    if seqs != list(range(N)):
+        errors.append("%s: %d datagrams, expected %d in order" % (name, len(seqs), N))
+
+# /play: TS без разрывов CC и номеров датаграмм
+head, sep, body = play["data"].partition(b"\r\n\r\n")
+if not sep or not head.startswith(b"HTTP/1.1 200"):
+    errors.append("play: bad response %r" % head[:64])
+else:
+    prev = None
+    packets = len(body) // 188
+    for off in range(0, packets * 188, 188):
+        cc = body[off + 3] & 0x0F
+        if body[off] != 0x47 or (prev is not None and cc != ((prev + 1) & 0x0F)):
+            errors.append("play: discontinuity at packet %d" % (off // 188))
+            break
+        prev = cc
+    if packets < N * 7 // 2:
+        errors.append("play: %d packets" % packets)
+
+after = {}
+moved = 0
+for name in OUTS:
+    dp = dataplane(name)
+    after[name] = dp.get("worker_index")
+    moved += dp.get("migrations") or 0
+if after["rb_a"] == after["rb_c"] or moved != 1:
+    errors.append("workers after=%r migrations=%d" % (after, moved))
+
+eng = engine()
+bal = eng.get("balancer") or {}
+decisions = bal.get("decisions") or []
+workers = eng.get("workers") or []
+if not bal.get("enabled") or bal.get("migrations") != 1 or len(decisions) != 1:
+    errors.append("balancer=%r" % bal)
+else:
+    d = decisions[0]
+    if d.get("id") not in OUTS or d.get("from") != before["rb_a"] or d.get("to") == d.get("from"):
+        errors.append("decision=%r" % d)
+if sorted(w.get("active_streams") for w in workers) != [1, 1]:
+    errors.append("workers=%r" % workers)
+if not all(w.get("busy_us", 0) > 0 for w in workers):
+    errors.append("busy_us=%r" % [w.get("busy_us") for w in workers])
+
+if errors:
+    for e in errors:
+        print("ERROR:", e)
+    sys.exit(1)
+print("OK: %d datagrams x 2 streams in %.1fs, moved %s worker[%d] -> worker[%d] (%.0f pps, busy %.1f%%), runs=%d"
+      % (N, elapsed, decisions[0]["id"], decisions[0]["from"], decisions[0]["to"],
+         decisions[0]["load_pps"], decisions[0]["from_busy_pct"], bal.get("runs")))
+PY
+
+echo "OK"
@@ -0,0 +1,203 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+# Linux-only smoke test: RTP вход в udp_relay dataplane.
+# - rtp:// вход (CSRC, extension, padding, wrap seq, потеря, перестановка, дубликат)
+# - udp:// выход получает чистый TS 1316, rtp:// выход - свой RTP с непрерывным seq
+# - счётчики rtp_* в /api/v1/stream-status/<id> (dataplane)
+
+if [[ "$(uname -s)" != "Linux" ]]; then
+  echo "SKIP: udp_relay dataplane smoke test is Linux-only"
+  exit 0
+fi
+
+ROOT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")/../.." && pwd)"
+
+HTTP_PORT=19360
+IN_PORT=19370
+OUT_PORT=19371
+OUT_RTP_PORT=19372
+
+STREAM_BIN="${ROOT_DIR}/stream"
+if [[ ! -x "${STREAM_BIN}" ]]; then
+  echo "ERROR: stream binary not found/executable: ${STREAM_BIN}"
+  exit 1
+fi
+
+TMP_DIR=""
+STREAM_PID=""
+
+cleanup() {
+  if [[ -n "${STREAM_PID}" ]]; then
+    kill "${STREAM_PID}" 2>/dev/null || true
+  fi
+  if [[ -n "${TMP_DIR}" ]]; then
+    rm -rf "${TMP_DIR}" 2>/dev/null || true
+  fi
+}
+trap cleanup EXIT
+
+TMP_DIR="$(mktemp -d)"
+CFG="${TMP_DIR}/udp_relay_rtp.json"
+
+cat >"${CFG}" <<EOF
+{
+  "settings": {
+    "http_auth_enabled": false,
+    "http_play_allow": false,
+
+    "performance_passthrough_dataplane": "force",
+    "performance_passthrough_workers": 1,
+    "performance_passthrough_rx_batch": 32
+  },
+  "make_stream": [
+    {
+      "id": "dp_rtp",
+      "type": "udp",
+      "enable": true,
+      "input": [
+        "rtp://127.0.0.1:${IN_PORT}"
+      ],
+      "output": [
+        "udp://127.0.0.1:${OUT_PORT}",
+        "rtp://127.0.0.1:${OUT_RTP_PORT}"
+      ]
+    }
+  ]
+}
+EOF
+
+"${STREAM_BIN}" scripts/server.lua -a 127.0.0.1 -p "${HTTP_PORT}" \
+  --config "${CFG}" \
+  --data-dir "${TMP_DIR}/data" \
+  --log "${TMP_DIR}/stream.log" \
+  --no-stdout &
+STREAM_PID=$!
+
+for _ in $(seq 1 80); do
+  if curl -fsS "http://127.0.0.1:${HTTP_PORT}/" >/dev/null 2>&1; then
+    break
+  fi
+  sleep 0.2
+done
+
+python3 - <<PY
+import json, socket, struct, sys, threading, time, urllib.request
+
+IN_PORT = ${IN_PORT}
+OUT_PORT = ${OUT_PORT}
+OUT_RTP_PORT = ${OUT_RTP_PORT}
+HTTP_PORT = ${HTTP_PORT}
+
+def ts_payload(n):
+    out = b""
+    for i in range(7):
+        out += bytes([0x47, 0x01, 0x00, 0x10 | ((n * 7 + i) & 0x0F)]) + bytes([(n + i) & 0xFF]) * 184
+    return out
+
+def rtp(seq, n):
+    csrc = [0x11111111, 0x22222222] if n % 3 == 0 else []
+    ext = n % 5 == 0
+    pad = 4 if n % 7 == 0 else 0
+    b0 = 0x80 | len(csrc) | (0x10 if ext else 0) | (0x20 if pad else 0)
+    hdr = struct.pack("!BBHII", b0, 33, seq & 0xFFFF, n * 3000, 0x12345678)
+    for c in csrc:
+        hdr += struct.pack("!I", c)
+    if ext:
+        hdr += struct.pack("!HH", 0xBEDE, 1) + b"\x00" * 4
+    body = ts_payload(n)
+    if pad:
+        body += b"\x00" * (pad - 1) + bytes([pad])
+    return hdr + body
+
+out = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+out.bind(("127.0.0.1", OUT_PORT))
+out.settimeout(0.2)
+out_rtp = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+out_rtp.bind(("127.0.0.1", OUT_RTP_PORT))
+out_rtp.settimeout(0.2)
+
+# seq начинается перед wrap; 3 пакета потеряны, пара переставлена, три дубликата:
+# подряд, старого номера из окна и опоздавшего пакета после его прихода.
+N = 400
+order = list(range(N))
+for lost in (100, 101, 102):
+    order.remove(lost)
+i = order.index(200)
+order[i], order[i + 1] = order[i + 1], order[i]
+order.insert(order.index(300) + 1, 300)
+order.insert(order.index(250) + 1, 240)
+order.insert(order.index(205) + 1, 200)
+sent_unique = len(set(order))
+
+def drain(sock, res):
+    while True:
+        try:
+            res.append(sock.recv(2048))
+        except socket.timeout:
+            if done:
+                return
+
+# выходы читаем параллельно, чтобы не упереться в SO_RCVBUF
+done = False
+raw, wrapped = [], []
+readers = [threading.Thread(target=drain, args=(out, raw)), threading.Thread(target=drain, args=(out_rtp, wrapped))]
+for t in readers:
+    t.start()
+
+src = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+for n in order:
+    src.sendto(rtp(65400 + n, n), ("127.0.0.1", IN_PORT))
+    time.sleep(0.002)
+
+time.sleep(1.0)
+done = True
+for t in readers:
+    t.join()
+
+errors = []
+if len(raw) != sent_unique:
+    errors.append("udp output: %d datagrams, expected %d" % (len(raw), sent_unique))
+if any(len(d) != 1316 or d[0] != 0x47 or d[188] != 0x47 for d in raw):
+    errors.append("udp output: not a clean TS datagram")
+if len(wrapped) != sent_unique:
+    errors.append("rtp output: %d datagrams, expected %d" % (len(wrapped), sent_unique))
+seqs = []
+for d in wrapped:
+    if len(d) != 1328 or d[0] != 0x80 or (d[1] & 0x7F) != 33 or d[12] != 0x47:
+        errors.append("rtp output: bad RTP datagram")
+        break
+    seqs.append(struct.unpack("!H", d[2:4])[0])
+for a, b in zip(seqs, seqs[1:]):
+    if (b - a) & 0xFFFF != 1:
+        errors.append("rtp output: seq %d after %d" % (b, a))
+        break
+if raw and wrapped and raw[0] != wrapped[0][12:]:
+    errors.append("rtp output: payload differs from udp output")
+
+with urllib.request.urlopen("http://127.0.0.1:%d/api/v1/stream-status/dp_rtp" % HTTP_PORT, timeout=3) as r:
+    status = json.loads(r.read().decode())
+dp = status.get("dataplane") or (status.get("status") or {}).get("dataplane") or {}
+expected = {
+    "rtp": True,
+    "rtp_out_count": 1,
+    "rtp_datagrams": len(order),
+    "rtp_lost": 3,
+    "rtp_gaps": 2,
+    "rtp_reordered": 1,
+    "rtp_duplicates": 3,
+    "rtp_resyncs": 0,
+    "bad_datagrams": 0,
+}
+for key, value in expected.items():
+    if dp.get(key) != value:
+        errors.append("dataplane %s=%r expected %r" % (key, dp.get(key), value))
+
+if errors:
+    for e in errors:
+        print("ERROR:", e)
+    sys.exit(1)
+print("OK: udp=%d rtp=%d lost=%d reordered=%d" % (len(raw), len(wrapped), dp["rtp_lost"], dp["rtp_reordered"]))
+PY
+
+echo "OK"
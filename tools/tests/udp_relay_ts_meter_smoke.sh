@@ -0,0 +1,178 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+# Linux-only smoke test: TS метрики udp_relay dataplane.
+# - PAT/PMT, PCR каждые 40 мс, CC ошибки на одном PID, scrambled PID
+# - dataplane.ts в /api/v1/stream-status/<id>: pids, cc_errors, pcr, bitrate
+
+if [[ "$(uname -s)" != "Linux" ]]; then
+  echo "SKIP: udp_relay dataplane smoke test is Linux-only"
+  exit 0
+fi
+
+ROOT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")/../.." && pwd)"
+
+HTTP_PORT=19380
+IN_PORT=19390
+OUT_PORT=19391
+
+STREAM_BIN="${ROOT_DIR}/stream"
+if [[ ! -x "${STREAM_BIN}" ]]; then
+  echo "ERROR: stream binary not found/executable: ${STREAM_BIN}"
+  exit 1
+fi
+
+TMP_DIR=""
+STREAM_PID=""
+
+cleanup() {
+  if [[ -n "${STREAM_PID}" ]]; then
+    kill "${STREAM_PID}" 2>/dev/null || true
+  fi
+  if [[ -n "${TMP_DIR}" ]]; then
+    rm -rf "${TMP_DIR}" 2>/dev/null || true
+  fi
+}
+trap cleanup EXIT
+
+TMP_DIR="$(mktemp -d)"
+CFG="${TMP_DIR}/udp_relay_ts.json"
+
+cat >"${CFG}" <<EOF
+{
+  "settings": {
+    "http_auth_enabled": false,
+    "http_play_allow": false,
+
+    "performance_passthrough_dataplane": "force",
+    "performance_passthrough_workers": 1,
+    "performance_passthrough_rx_batch": 32
+  },
+  "make_stream": [
+    {
+      "id": "dp_ts",
+      "type": "udp",
+      "enable": true,
+      "input": [
+        "udp://127.0.0.1:${IN_PORT}"
+      ],
+      "output": [
+        "udp://127.0.0.1:${OUT_PORT}"
+      ]
+    }
+  ]
+}
+EOF
+
+"${STREAM_BIN}" scripts/server.lua -a 127.0.0.1 -p "${HTTP_PORT}" \
+  --config "${CFG}" \
+  --data-dir "${TMP_DIR}/data" \
+  --log "${TMP_DIR}/stream.log" \
+  --no-stdout &
+STREAM_PID=$!
+
+for _ in $(seq 1 80); do
+  if curl -fsS "http://127.0.0.1:${HTTP_PORT}/" >/dev/null 2>&1; then
+    break
+  fi
+  sleep 0.2
+done
+
+python3 - <<PY
+import json, socket, struct, sys, time, urllib.request
+
+IN_PORT = ${IN_PORT}
+HTTP_PORT = ${HTTP_PORT}
+
+PMT_PID = 0x1000
+VIDEO_PID = 0x100
+AUDIO_PID = 0x101
+SCRAMBLED_PID = 0x102
+
+def packet(pid, cc, payload=b"", pusi=False, af=b"", scrambled=False):
+    b3 = (0x80 if scrambled else 0) | (0x30 if af else 0x10) | (cc & 0x0F)
+    hdr = bytes([0x47, (0x40 if pusi else 0) | (pid >> 8), pid & 0xFF, b3])
+    if af:
+        hdr += bytes([len(af)]) + af
+    body = hdr + payload
+    return body + b"\xff" * (188 - len(body))
+
+def pcr_af(pcr):
+    base, ext = pcr // 300, pcr % 300
+    return bytes([0x10, (base >> 25) & 0xFF, (base >> 17) & 0xFF, (base >> 9) & 0xFF, (base >> 1) & 0xFF,
+                  ((base & 1) << 7) | 0x7E | (ext >> 8), ext & 0xFF])
+
+# PAT: program 1 -> PMT_PID (CRC не проверяется dataplane)
+pat = bytes([0x00, 0x00, 0xB0, 13, 0x00, 0x01, 0xC1, 0x00, 0x00, 0x00, 0x01, 0xE0 | (PMT_PID >> 8), PMT_PID & 0xFF]) + b"\x00" * 4
+pmt = bytes([0x00, 0x02, 0xB0, 13, 0x00, 0x01, 0xC1, 0x00, 0x00, 0xE0 | (VIDEO_PID >> 8), VIDEO_PID & 0xFF, 0xF0, 0x00]) + b"\x00" * 4
+
+cc = {}
+def next_cc(pid):
+    cc[pid] = (cc.get(pid, -1) + 1) & 0x0F
+    return cc[pid]
+
+SECONDS = 3
+PCR_MS = 40
+packets = []
+cc_injected = 0
+for tick in range(SECONDS * 1000 // PCR_MS):
+    packets.append(packet(0, next_cc(0), pat, pusi=True))
+    packets.append(packet(PMT_PID, next_cc(PMT_PID), pmt, pusi=True))
+    packets.append(packet(VIDEO_PID, next_cc(VIDEO_PID), af=pcr_af(tick * PCR_MS * 27000)))
+    for _ in range(14):
+        packets.append(packet(VIDEO_PID, next_cc(VIDEO_PID)))
+    for i in range(4):
+        c = next_cc(AUDIO_PID)
+        if tick in (10, 20) and i == 0:
+            c = next_cc(AUDIO_PID) # пропуск одного CC
+            cc_injected += 1
+        packets.append(packet(AUDIO_PID, c))
+    packets.append(packet(SCRAMBLED_PID, next_cc(SCRAMBLED_PID), scrambled=True))
+    while len(packets) % 7:
+        packets.append(packet(0x1FFF, 0))
+
+src = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+per_tick = len(packets) // (SECONDS * 1000 // PCR_MS)
+start = time.time()
+for i in range(0, len(packets), 7):
+    due = start + (i // per_tick) * PCR_MS / 1000.0
+    delay = due - time.time()
+    if delay > 0:
+        time.sleep(delay)
+    src.sendto(b"".join(packets[i:i + 7]), ("127.0.0.1", IN_PORT))
+
+time.sleep(0.3)
+with urllib.request.urlopen("http://127.0.0.1:%d/api/v1/stream-status/dp_ts" % HTTP_PORT, timeout=3) as r:
+    status = json.loads(r.read().decode())
+dp = status.get("dataplane") or (status.get("status") or {}).get("dataplane") or {}
+ts = dp.get("ts") or {}
+pids = {p["pid"]: p for p in ts.get("pids") or []}
+
+errors = []
+def expect(name, value, ok):
+    if not ok:
+        errors.append("%s=%r" % (name, value))
+
+expect("pat_seen", ts.get("pat_seen"), ts.get("pat_seen") is True)
+expect("pmt_seen", ts.get("pmt_seen"), ts.get("pmt_seen") is True)
+expect("scrambled", ts.get("scrambled"), ts.get("scrambled") is True)
+expect("pcr_pid", ts.get("pcr_pid"), ts.get("pcr_pid") == VIDEO_PID)
+expect("cc_errors", ts.get("cc_errors"), ts.get("cc_errors") == cc_injected)
+expect("pids", sorted(pids), sorted(pids) == sorted([0, PMT_PID, VIDEO_PID, AUDIO_PID, SCRAMBLED_PID, 0x1FFF]))
+video = pids.get(VIDEO_PID) or {}
+expect("video.packets", video.get("packets"), video.get("packets") == 15 * (SECONDS * 1000 // PCR_MS))
+expect("video.pcr_interval_us", video.get("pcr_interval_us"), video.get("pcr_interval_us") == PCR_MS * 1000)
+expect("video.pcr_jitter_max_us", video.get("pcr_jitter_max_us"), 0 <= (video.get("pcr_jitter_max_us") or -1) < 30000)
+# 15 пакетов за 40 мс = 564 кбит/с
+expect("video.bitrate", video.get("bitrate"), 400000 < (video.get("bitrate") or 0) < 700000)
+expect("audio.cc_errors", (pids.get(AUDIO_PID) or {}).get("cc_errors"), (pids.get(AUDIO_PID) or {}).get("cc_errors") == cc_injected)
+expect("pmt", (pids.get(PMT_PID) or {}).get("pmt"), (pids.get(PMT_PID) or {}).get("pmt") is True)
+
+if errors:
+    for e in errors:
+        print("ERROR:", e)
+    sys.exit(1)
+print("OK: pids=%d cc_errors=%d pcr_interval_us=%d bitrate=%d" % (len(pids), ts["cc_errors"], video["pcr_interval_us"], video["bitrate"]))
+PY
+
+echo "OK"